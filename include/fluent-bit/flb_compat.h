@@ -128,11 +128,18 @@ static inline int usleep(LONGLONG usec)
     // Convert into 100ns unit.
     return nanosleep(usec * 10);
 }
+
+/* Buffers for vectored writes, see flb_io_net_writev() */
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
 #else
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <libgen.h>
 #include <dlfcn.h>
@@ -0,0 +1,87 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_COMPRESS_H
+#define FLB_COMPRESS_H
+
+#include <fluent-bit/flb_info.h>
+#include <stdio.h>
+
+/* Codecs */
+#define FLB_COMPRESS_NONE    0
+#define FLB_COMPRESS_GZIP    1
+#define FLB_COMPRESS_ZSTD    2
+#define FLB_COMPRESS_LZ4     3
+#define FLB_COMPRESS_SNAPPY  4
+
+/* Use the default compression level of the codec */
+#define FLB_COMPRESS_LEVEL_DEFAULT  -1
+
+struct flb_compress;
+
+/*
+ * A compression codec: besides one-shot decompression it provides a
+ * streaming interface, so callers can compress data as they generate it
+ * instead of building the whole payload first.
+ */
+struct flb_compress_codec {
+    int type;                   /* FLB_COMPRESS_* identifier      */
+    char *name;                 /* name used by 'compress'        */
+    char *encoding;             /* HTTP Content-Encoding or NULL  */
+
+    /* streaming compression */
+    int (*cb_init) (struct flb_compress *);
+    int (*cb_update) (struct flb_compress *, const void *, size_t);
+    int (*cb_finish) (struct flb_compress *);
+    void (*cb_destroy) (struct flb_compress *);
+
+    /* one-shot decompression */
+    int (*cb_uncompress) (const void *, size_t, void **, size_t *);
+};
+
+/* Streaming compression context */
+struct flb_compress {
+    int level;                  /* compression level              */
+    void *state;                /* codec private state            */
+    char *buf;                  /* compressed output              */
+    size_t size;                /* bytes used in 'buf'            */
+    size_t alloc;               /* bytes allocated for 'buf'      */
+    struct flb_compress_codec *codec;
+};
+
+struct flb_compress_codec *flb_compress_codec_get(const char *name);
+struct flb_compress_codec *flb_compress_codec_lookup(int type);
+
+struct flb_compress *flb_compress_create(struct flb_compress_codec *codec,
+                                         int level);
+int flb_compress_update(struct flb_compress *ctx,
+                        const void *data, size_t size);
+int flb_compress_finish(struct flb_compress *ctx,
+                        void **out_data, size_t *out_len);
+void flb_compress_destroy(struct flb_compress *ctx);
+
+int flb_compress_buffer(struct flb_compress_codec *codec, int level,
+                        const void *in_data, size_t in_len,
+                        void **out_data, size_t *out_len);
+int flb_uncompress_buffer(struct flb_compress_codec *codec,
+                          const void *in_data, size_t in_len,
+                          void **out_data, size_t *out_len);
+
+#endif
@@ -151,6 +151,7 @@ struct flb_config {
     int   storage_checksum;         /* checksum enabled */
     int   storage_max_chunks_up;    /* max number of chunks 'up' in memory */
     char *storage_bl_mem_limit;     /* storage backlog memory limit */
+    char *storage_compression;      /* codec for filesystem chunks */
 
     /* Embedded SQL Database support (SQLite3) */
 #ifdef FLB_HAVE_SQLDB
@@ -187,7 +188,17 @@ struct flb_config {
 
     void *sched;
 
-    struct flb_task_map tasks_map[2048];
+    /* Routing table: compiled Match rules and routes cache per Tag */
+    void *router;
+
+    /*
+     * Tasks table: maps a task ID to its task. It grows on demand up to
+     * FLB_TASK_MAP_MAX entries and the free entries are chained in a list,
+     * so getting and releasing an ID is O(1).
+     */
+    struct flb_task_map *tasks_map;
+    int tasks_map_size;
+    int tasks_map_free;
 };
 
 #define FLB_CONFIG_LOG_LEVEL(c) (c->log->level)
@@ -240,6 +251,7 @@ enum conf_type {
 #define FLB_CONF_STORAGE_CHECKSUM      "storage.checksum"
 #define FLB_CONF_STORAGE_BL_MEM_LIMIT  "storage.backlog.mem_limit"
 #define FLB_CONF_STORAGE_MAX_CHUNKS_UP "storage.max_chunks_up"
+#define FLB_CONF_STORAGE_COMPRESSION   "storage.compression"
 
 /* Coroutines */
 #define FLB_CONF_STR_CORO_STACK_SIZE "Coro_Stack_Size"
@@ -50,6 +50,9 @@
 #define FLB_ENGINE_TASK         2
 #define FLB_ENGINE_IN_THREAD    3
 
+/* flb_input.h might be in progress when this header is included */
+struct flb_input_plugin;
+
 int flb_engine_start(struct flb_config *config);
 int flb_engine_failed(struct flb_config *config);
 int flb_engine_flush(struct flb_config *config,
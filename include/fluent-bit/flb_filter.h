@@ -41,6 +41,7 @@
 
 struct flb_input_instance;
 struct flb_filter_instance;
+struct flb_filter_record;
 
 struct flb_filter_plugin {
     int flags;             /* Flags (not available at the moment */
@@ -57,6 +58,15 @@ struct flb_filter_plugin {
                       void **, size_t *,
                       struct flb_filter_instance *,
                       void *, struct flb_config *);
+
+    /*
+     * Record based filter: if set it's used instead of 'cb_filter'. It
+     * receives a decoded view of each record, see flb_filter_record.h.
+     */
+    int (*cb_filter_record) (struct flb_filter_record *,
+                             const char *, int,
+                             struct flb_filter_instance *,
+                             void *, struct flb_config *);
     int (*cb_exit) (void *, struct flb_config *);
 
     struct mk_list _head;  /* Link to parent list (config->filters) */
@@ -101,10 +111,10 @@ const char *flb_filter_get_property(const char *key,
 struct flb_filter_instance *flb_filter_new(struct flb_config *config,
                                            const char *filter, void *data);
 void flb_filter_exit(struct flb_config *config);
-void flb_filter_do(struct flb_input_chunk *ic,
-                   const void *data, size_t bytes,
-                   const char *tag, int tag_len,
-                   struct flb_config *config);
+int flb_filter_do(struct flb_input_chunk *ic,
+                  const void *data, size_t bytes,
+                  const char *tag, int tag_len,
+                  struct flb_config *config);
 const char *flb_filter_name(struct flb_filter_instance *ins);
 int flb_filter_init_all(struct flb_config *config);
 void flb_filter_set_context(struct flb_filter_instance *ins, void *context);
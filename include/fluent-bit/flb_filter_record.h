@@ -0,0 +1,93 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_FILTER_RECORD_H
+#define FLB_FILTER_RECORD_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_time.h>
+#include <msgpack.h>
+
+/* Status of every key/value entry in a record view */
+#define FLB_FILTER_KV_ORIGINAL   0   /* untouched entry from the record */
+#define FLB_FILTER_KV_ADDED      1   /* appended by a filter            */
+#define FLB_FILTER_KV_RENAMED    2   /* key replaced by a filter        */
+#define FLB_FILTER_KV_REMOVED    4   /* removed by a filter             */
+
+struct flb_filter_kv {
+    int flags;
+    msgpack_object key;
+    msgpack_object val;
+};
+
+/*
+ * Record view
+ * ===========
+ * Filters registering a 'cb_filter_record' callback don't get the raw
+ * msgpack buffer, instead they receive a decoded view of each record: the
+ * list of key/value entries plus the status of each one (the edit log).
+ *
+ * Filters add, remove or rename entries through the functions below and
+ * the filter chain serializes the record only once after all the filters
+ * have been applied. Records that were not modified by any filter are
+ * copied as they are.
+ */
+struct flb_filter_record {
+    struct flb_time tm;            /* record timestamp                */
+    msgpack_object *time;          /* original timestamp object       */
+    msgpack_object *map;           /* original map                    */
+    const char *raw;               /* raw record buffer               */
+    size_t raw_size;               /* raw record buffer size          */
+    int modified;                  /* an edit has been recorded       */
+    int drop;                      /* the record must be dropped      */
+    int count;                     /* number of entries (+ removed)   */
+    int size;                      /* allocated entries               */
+    struct flb_filter_kv *kv;      /* entries                         */
+    msgpack_zone zone;             /* memory for data added by filters */
+};
+
+/* Check if a given entry is still part of the record */
+#define flb_filter_record_kv_valid(r, i)                        \
+    (((r)->kv[i].flags & FLB_FILTER_KV_REMOVED) == 0)
+
+int flb_filter_record_init(struct flb_filter_record *r);
+void flb_filter_record_destroy(struct flb_filter_record *r);
+int flb_filter_record_load(struct flb_filter_record *r,
+                           msgpack_object *root,
+                           const char *raw, size_t raw_size);
+int flb_filter_record_pack(struct flb_filter_record *r, msgpack_packer *mp_pck);
+
+/* Filters API */
+int flb_filter_record_entries(struct flb_filter_record *r);
+int flb_filter_record_key_find(struct flb_filter_record *r,
+                               const char *key, int key_len);
+int flb_filter_record_key_cmp(struct flb_filter_record *r, int idx,
+                              const char *key, int key_len);
+int flb_filter_record_add(struct flb_filter_record *r,
+                          const char *key, int key_len, msgpack_object *val);
+int flb_filter_record_add_str(struct flb_filter_record *r,
+                              const char *key, int key_len,
+                              const char *val, int val_len);
+int flb_filter_record_remove(struct flb_filter_record *r, int idx);
+int flb_filter_record_rename(struct flb_filter_record *r, int idx,
+                             const char *key, int key_len);
+void flb_filter_record_drop(struct flb_filter_record *r);
+
+#endif
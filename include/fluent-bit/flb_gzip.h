@@ -23,6 +23,14 @@
 
 #include <fluent-bit/flb_info.h>
 #include <stdio.h>
+#include <stdint.h>
+
+/* gzip framing around a raw deflate stream */
+#define FLB_GZIP_HEADER_SIZE  10
+#define FLB_GZIP_FOOTER_SIZE   8
+
+void flb_gzip_header(void *buf);
+void flb_gzip_footer(void *buf, uint32_t crc, size_t in_len);
 
 int flb_gzip_compress(void *in_data, size_t in_len,
                       void **out_data, size_t *out_len);
@@ -30,6 +30,7 @@
 #include <fluent-bit/flb_str.h>
 #include <fluent-bit/flb_bits.h>
 #include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_ring.h>
 #include <fluent-bit/flb_filter.h>
 #include <fluent-bit/flb_thread.h>
 #include <fluent-bit/flb_mp.h>
@@ -136,6 +137,8 @@ struct flb_input_instance {
     int id;                              /* instance id                  */
     int log_level;                       /* log level for this plugin    */
     flb_pipefd_t channel[2];             /* pipe(2) channel              */
+    struct flb_ring *ring;               /* lock-free ingestion ring     */
+    int ring_users;                      /* producers using the ring now */
     int threaded;                        /* bool / Threaded instance ?   */
     char name[32];                       /* numbered name (cpu -> cpu.0) */
     char *alias;                         /* alias name for the instance  */
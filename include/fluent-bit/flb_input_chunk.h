@@ -23,6 +23,7 @@
 
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_time.h>
 #include <monkey/mk_core.h>
 #include <msgpack.h>
 
@@ -38,14 +39,40 @@
  */
 #define FLB_INPUT_CHUNK_FS_MAX_SIZE   2048000  /* 2MB */
 
+/*
+ * Chunk metadata: a fixed size header with the chunk statistics followed
+ * by the Tag. The header is written when the chunk is locked, flushed or
+ * put down, not on every append:
+ *
+ *   magic   version  flags   records    oldest time    newest time
+ *  2 bytes  1 byte   1 byte  uint32 BE  uint64 BE (ns) uint64 BE (ns)
+ *
+ *   data size   Tag
+ *   uint64 BE
+ *
+ * The data size is the content size the statistics account for: if the
+ * process died after some appends the sizes don't match and the chunk is
+ * counted again when mapped.
+ *
+ * Chunks written by previous versions only contain the Tag, they don't
+ * start with the magic bytes (0xF1 is never the first byte of a valid
+ * UTF-8 Tag followed by 0x77).
+ */
+#define FLB_INPUT_CHUNK_MAGIC_BYTE_0  0xF1
+#define FLB_INPUT_CHUNK_MAGIC_BYTE_1  0x77
+#define FLB_INPUT_CHUNK_META_VERSION  1
+#define FLB_INPUT_CHUNK_META_HEADER   32
+
 struct flb_input_chunk {
     int busy;                       /* buffer is being flushed  */
     int fs_backlog;                 /* chunk originated from fs backlog */
     int sp_done;                    /* sp already processed this chunk */
-#ifdef FLB_HAVE_METRICS
+    int meta_header;                /* metadata has the stats header ? */
+    int meta_dirty;                 /* stats header not written yet */
     int total_records;              /* total records in the chunk */
     int added_records;              /* recently added records */
-#endif
+    struct flb_time tm_min;         /* oldest record timestamp */
+    struct flb_time tm_max;         /* newest record timestamp */
     void *chunk;                    /* context of struct cio_chunk */
     off_t stream_off;               /* stream offset */
     msgpack_packer mp_pck;          /* msgpack packer */
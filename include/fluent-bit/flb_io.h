@@ -24,6 +24,7 @@
 #include <monkey/mk_core.h>
 
 #include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_compat.h>
 #include <fluent-bit/flb_thread.h>
 #include <fluent-bit/flb_output.h>
 #include <fluent-bit/flb_upstream.h>
@@ -47,6 +48,8 @@ int flb_io_net_connect(struct flb_upstream_conn *u_conn,
 
 int flb_io_net_write(struct flb_upstream_conn *u, const void *data,
                      size_t len, size_t *out_len);
+int flb_io_net_writev(struct flb_upstream_conn *u, const struct iovec *iov,
+                      int iovcnt, size_t *out_len);
 ssize_t flb_io_net_read(struct flb_upstream_conn *u, void *buf, size_t len);
 
 #endif
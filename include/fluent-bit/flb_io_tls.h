@@ -25,6 +25,8 @@
 
 #ifdef FLB_HAVE_TLS
 
+#include <fluent-bit/flb_sds.h>
+#include <monkey/mk_core.h>
 #include <mbedtls/net.h>
 #include <mbedtls/ssl.h>
 #include <mbedtls/entropy.h>
@@ -34,6 +36,21 @@
 #define FLB_TLS_CERT             2
 #define FLB_TLS_PRIV_KEY         4
 
+/* Seconds a cached session is offered to the server */
+#define FLB_TLS_SESSION_TTL      300
+
+/*
+ * Client session of an upstream host:port. It's offered on the next
+ * connection to the same server so the handshake is resumed (session id or
+ * ticket) instead of doing a full key exchange.
+ */
+struct flb_tls_session_entry {
+    flb_sds_t key;                 /* host:port                 */
+    time_t created;                /* time of the full handshake */
+    mbedtls_ssl_session session;
+    struct mk_list _head;
+};
+
 /* mbedTLS library context */
 struct flb_tls_context {
     int verify;                    /* FLB_TRUE | FLB_FALSE      */
@@ -46,6 +63,17 @@ struct flb_tls_context {
     mbedtls_dhm_context dhm;
     mbedtls_entropy_context entropy;
     mbedtls_ctr_drbg_context ctr_drbg;
+    pthread_mutex_t mutex;         /* ctr_drbg lock for workers */
+
+    /* Sessions cache, shared by the upstream connections of the owner */
+    int session_cache;             /* FLB_TRUE | FLB_FALSE      */
+    struct mk_list sessions;       /* struct flb_tls_session_entry */
+    pthread_mutex_t sessions_mutex;
+    uint64_t handshakes_full;
+    uint64_t handshakes_resumed;
+#ifdef FLB_HAVE_METRICS
+    struct flb_metrics *metrics;   /* metrics of the owner, optional */
+#endif
 };
 
 /* TLS connected session */
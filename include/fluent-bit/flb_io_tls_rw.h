@@ -25,6 +25,7 @@
 
 #ifdef FLB_HAVE_TLS
 
+#include <fluent-bit/flb_compat.h>
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_thread.h>
 #include <fluent-bit/flb_upstream.h>
@@ -33,6 +34,8 @@ int flb_io_tls_net_read(struct flb_thread *th, struct flb_upstream_conn *u_conn,
                         void *buf, size_t len);
 int flb_io_tls_net_write(struct flb_thread *th, struct flb_upstream_conn *u_conn,
                          const void *data, size_t len, size_t *out_len);
+int flb_io_tls_net_writev(struct flb_thread *th, struct flb_upstream_conn *u_conn,
+                          const struct iovec *iov, int iovcnt, size_t *out_len);
 
 #endif
 
@@ -29,6 +29,13 @@
 #define FLB_LIB_NONE       0
 #define FLB_LIB_OK         1
 
+/* Data push return value: the input ring is full, try again later */
+#define FLB_LIB_BUSY      -2
+
+/* Type of the data pushed into the 'lib' input ring */
+#define FLB_LIB_DATA_JSON      0
+#define FLB_LIB_DATA_MSGPACK   1
+
 /* Library mode context data */
 struct flb_lib_ctx {
     int status;
@@ -71,6 +78,8 @@ FLB_EXPORT int flb_stop(flb_ctx_t *ctx);
 
 /* data ingestion for "lib" input instance */
 FLB_EXPORT int flb_lib_push(flb_ctx_t *ctx, int ffd, const void *data, size_t len);
+FLB_EXPORT int flb_lib_push_msgpack(flb_ctx_t *ctx, int ffd,
+                                    const void *data, size_t len);
 FLB_EXPORT int flb_lib_config_file(flb_ctx_t *ctx, const char *path);
 
 #endif
@@ -30,6 +30,7 @@
 #include <fluent-bit/flb_config.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <time.h>
 
 /* FIXME: this extern should be auto-populated from flb_thread_storage.h */
 extern FLB_TLS_DEFINE(struct flb_log, flb_log_ctx)
@@ -52,6 +53,37 @@ extern FLB_TLS_DEFINE(struct flb_log, flb_log_ctx)
 
 #define FLB_LOG_EVENT    MK_EVENT_NOTIFICATION
 #define FLB_LOG_MNG      1024
+#define FLB_LOG_TIMER    1025
+
+/* Messages queued per thread, the log worker writes them in batches */
+#define FLB_LOG_RING_SLOTS    1024
+#define FLB_LOG_BATCH         64
+
+/* Error and warning messages per second from the same file:line */
+#define FLB_LOG_RATE_BURST    10
+#define FLB_LOG_RATE_SLOTS    64
+
+/*
+ * A call site is keyed by its file name and line. The slot is owned by the
+ * producer thread, the log worker only reads 'file', 'line' and 'window'
+ * and takes 'suppressed' to report it when the call site goes quiet.
+ */
+struct flb_log_rate {
+    const char *file;          /* call site                  */
+    int line;
+    time_t window;             /* current second             */
+    int count;                 /* messages in the window     */
+    int suppressed;            /* messages not printed       */
+};
+
+/* Thread local state of the messages producer */
+struct flb_log_cache {
+    time_t time_sec;           /* second of the cached time  */
+    int time_len;
+    char time_buf[64];         /* formatted time header      */
+    struct flb_log_rate rate[FLB_LOG_RATE_SLOTS];
+    struct mk_list _head;      /* link to flb_log->caches    */
+};
 
 /* Logging main context */
 struct flb_log {
@@ -63,6 +95,13 @@ struct flb_log {
     pthread_t tid;             /* thread ID   */
     struct flb_worker *worker; /* non-real worker reference */
     struct mk_event_loop *evl;
+    int colors;                /* output is a terminal ?  */
+
+    /* Report of suppressed messages, every second */
+    struct mk_event event_timer;
+    int timer_fd;
+    struct mk_list caches;     /* producers rate state    */
+    pthread_mutex_t caches_mutex;
 
     /* Initialization variables */
     int pth_init;
@@ -113,11 +152,11 @@ void flb_log_print(int type, const char *file, int line, const char *fmt, ...);
 
 #define flb_error(fmt, ...)                                          \
     if (flb_log_check(FLB_LOG_ERROR))                                \
-        flb_log_print(FLB_LOG_ERROR, NULL, 0, fmt, ##__VA_ARGS__)
+        flb_log_print(FLB_LOG_ERROR, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
 
 #define flb_warn(fmt, ...)                                           \
     if (flb_log_check(FLB_LOG_WARN))                                 \
-        flb_log_print(FLB_LOG_WARN, NULL, 0, fmt, ##__VA_ARGS__)
+        flb_log_print(FLB_LOG_WARN, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
 
 #define flb_info(fmt, ...)                                           \
     if (flb_log_check(FLB_LOG_INFO))                                 \
@@ -140,6 +179,9 @@ void flb_log_print(int type, const char *file, int line, const char *fmt, ...);
 #endif
 
 int flb_log_worker_init(void *data);
+void flb_log_worker_destroy(struct flb_worker *worker);
+int flb_log_rate_check(struct flb_log_cache *cache, const char *file,
+                       int line, time_t now, int *suppressed);
 int flb_errno_print(int errnum, const char *file, int line);
 
 #ifdef __FILENAME__
@@ -37,6 +37,8 @@
 #define FLB_METRIC_OUT_ERROR          12
 #define FLB_METRIC_OUT_RETRY          13
 #define FLB_METRIC_OUT_RETRY_FAILED   14
+#define FLB_METRIC_OUT_TLS_FULL       15
+#define FLB_METRIC_OUT_TLS_RESUMED    16
 
 struct flb_metric {
     int id;
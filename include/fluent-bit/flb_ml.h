@@ -0,0 +1,111 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_ML_H
+#define FLB_ML_H
+
+#include <fluent-bit/flb_info.h>
+
+#ifdef FLB_HAVE_REGEX
+
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_regex.h>
+#include <fluent-bit/flb_regex_set.h>
+#include <monkey/mk_core.h>
+
+/* Result of processing a line */
+#define FLB_ML_NA              -1   /* not part of a multiline record       */
+#define FLB_ML_MORE             0   /* appended to the record in progress   */
+
+#define FLB_ML_START_STATE      "start_state"
+#define FLB_ML_STATES_MAX       32
+#define FLB_ML_MAX_LINES        1000 /* default lines limit of a record     */
+#define FLB_ML_FLUSH_TIMEOUT    4    /* default seconds to wait for a line  */
+
+struct flb_ml_rule {
+    char *pattern;
+    int to_state;
+    struct flb_regex *regex;
+    struct mk_list _head;
+};
+
+struct flb_ml_state {
+    flb_sds_t name;
+    int rules_count;
+    struct flb_ml_rule **rules;     /* rules of the state, in order         */
+    struct flb_regex_set *set;      /* compiled rules of the state          */
+};
+
+/*
+ * Multiline rule set
+ * ==================
+ * A state machine that joins the lines of a record, e.g: a stack trace.
+ * Every rule goes from one or more states to a new one when its regex
+ * matches a line. A record begins with a line matched by a rule of the
+ * start state and it continues while the lines match a rule of the
+ * current state; going back to the start state completes it.
+ *
+ * The rules of each state are compiled into a single regex set, so a line
+ * is checked against all of them in one scan. The lines are kept in an
+ * append buffer and the caller gets the whole record once at the end.
+ */
+struct flb_ml {
+    flb_sds_t name;
+    int max_lines;                  /* lines limit of a record              */
+    int flush_timeout;              /* seconds to wait for the next line    */
+    int states_count;
+    struct flb_ml_state states[FLB_ML_STATES_MAX];
+    struct mk_list rules;
+};
+
+/* Record in progress of a stream of lines, e.g: a file */
+struct flb_ml_stream {
+    int state;                      /* current state, -1 if no record       */
+    int lines;
+    time_t last;                    /* time of the last line appended       */
+    struct flb_time time;           /* time of the first line               */
+    flb_sds_t buf;
+};
+
+typedef int (*flb_ml_flush_cb)(const char *buf, size_t size,
+                               struct flb_time *tm, void *data);
+
+struct flb_ml *flb_ml_create(const char *name);
+int flb_ml_rule_add(struct flb_ml *ml, const char *from_states,
+                    const char *pattern, const char *to_state);
+int flb_ml_compile(struct flb_ml *ml);
+struct flb_ml *flb_ml_builtin_create(const char *name);
+void flb_ml_destroy(struct flb_ml *ml);
+
+int flb_ml_stream_init(struct flb_ml_stream *stream);
+void flb_ml_stream_destroy(struct flb_ml_stream *stream);
+
+int flb_ml_process(struct flb_ml *ml, struct flb_ml_stream *stream,
+                   const char *line, size_t len, struct flb_time *tm,
+                   flb_ml_flush_cb cb, void *data);
+int flb_ml_flush(struct flb_ml *ml, struct flb_ml_stream *stream,
+                 flb_ml_flush_cb cb, void *data);
+int flb_ml_flush_pending(struct flb_ml *ml, struct flb_ml_stream *stream,
+                         time_t now, flb_ml_flush_cb cb, void *data);
+
+#endif
+
+#endif
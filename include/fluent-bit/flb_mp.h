@@ -21,7 +21,13 @@
 #ifndef FLB_MP_H
 #define FLB_MP_H
 
+#include <fluent-bit/flb_info.h>
+
+struct flb_time;
+
 int flb_mp_count(const void *data, size_t bytes);
+int flb_mp_count_time(const void *data, size_t bytes,
+                      struct flb_time *tm_min, struct flb_time *tm_max);
 void flb_mp_set_map_header_size(char *buf, int arr_size);
 
 #endif
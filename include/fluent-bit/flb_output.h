@@ -38,21 +38,36 @@
 #include <fluent-bit/flb_network.h>
 #include <fluent-bit/flb_engine.h>
 #include <fluent-bit/flb_task.h>
+#include <fluent-bit/flb_mp.h>
 #include <fluent-bit/flb_thread.h>
 #include <fluent-bit/flb_callback.h>
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_str.h>
 #include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_output_worker.h>
+#include <fluent-bit/flb_compress.h>
 
 #ifdef FLB_HAVE_REGEX
 #include <fluent-bit/flb_regex.h>
 #endif
 
+#ifdef FLB_HAVE_METRICS
+#include <fluent-bit/flb_metrics.h>
+#endif
+
 /* Output plugin masks */
 #define FLB_OUTPUT_NET          32  /* output address may set host and port */
+#define FLB_OUTPUT_COMPRESS     64  /* payload compression with 'compress'  */
+#define FLB_OUTPUT_WORKERS     128  /* flush callback can run in workers    */
 #define FLB_OUTPUT_PLUGIN_CORE   0
 #define FLB_OUTPUT_PLUGIN_PROXY  1
 
+/*
+ * Default limit of tasks routed to an output instance, a stalled output
+ * cannot take more than a quarter of the tasks table.
+ */
+#define FLB_OUTPUT_TASKS_LIMIT   (FLB_TASK_MAP_MAX / 4)
+
 /*
  * Tests callbacks
  * ===============
@@ -195,8 +210,14 @@ struct flb_output_instance {
 
     /* Plugin properties */
     int retry_limit;                     /* max of retries allowed       */
+    int workers;                         /* number of worker threads     */
+    int tasks_limit;                     /* max tasks routed, -1: none   */
+    int tasks_count;                     /* tasks routed to the instance */
+    int tasks_paused;                    /* tasks_limit reached ?        */
     int use_tls;                         /* bool, try to use TLS for I/O */
     char *match;                         /* match rule for tag/routing   */
+    int compress_level;                  /* codec level or -1 (default)  */
+    struct flb_compress_codec *compress; /* payload compression codec    */
 #ifdef FLB_HAVE_REGEX
     struct flb_regex *match_regex;       /* match rule (regex) based on Tags */
 #endif
@@ -204,6 +225,7 @@ struct flb_output_instance {
 #ifdef FLB_HAVE_TLS
     int tls_verify;                      /* Verify certs (default: true) */
     int tls_debug;                       /* mbedtls debug level          */
+    int tls_session_cache;               /* Resume sessions (def: true)  */
     char *tls_vhost;                     /* Virtual hostname for SNI     */
     char *tls_ca_path;                   /* Path to certificates         */
     char *tls_ca_file;                   /* CA root cert                 */
@@ -242,6 +264,12 @@ struct flb_output_instance {
     /* IO upstream context, if flags & (FLB_OUTPUT_TCP | FLB_OUTPUT TLS)) */
     struct flb_upstream *upstream;
 
+    /*
+     * Worker threads: if 'workers' is set, flush co-routines are handed to
+     * this pool and run in their own event loops instead of the engine one.
+     */
+    struct flb_out_worker_pool *worker_pool;
+
     /*
      * The threads_queue is the head for the linked list that holds co-routines
      * nodes information that needs to be processed.
@@ -300,6 +328,8 @@ struct flb_output_thread {
     struct flb_config *config;         /* FLB context        */
     struct flb_output_instance *o_ins; /* output instance    */
     struct flb_thread *parent;         /* parent thread addr */
+    struct flb_out_worker *worker;     /* worker running it  */
+    uint64_t ret_event;                /* pending return     */
     struct mk_list _head;              /* Link to struct flb_task->threads */
 };
 
@@ -482,6 +512,8 @@ struct flb_thread *flb_output_thread(struct flb_task *task,
     out_th->buffer  = buf;
     out_th->config  = config;
     out_th->parent  = th;
+    out_th->worker  = NULL;
+    out_th->ret_event = 0;
 
     th->caller = co_active();
     th->callee = co_create(config->coro_stack_size,
@@ -505,6 +537,28 @@ struct flb_thread *flb_output_thread(struct flb_task *task,
     return th;
 }
 
+#ifdef FLB_HAVE_METRICS
+/*
+ * Output metrics are updated from the engine thread and, when the instance
+ * runs workers, from the worker threads too: the pool lock serializes them.
+ */
+static inline void flb_output_metrics_sum(struct flb_output_instance *ins,
+                                          int id, size_t val)
+{
+    if (!ins->metrics) {
+        return;
+    }
+
+    if (ins->worker_pool) {
+        pthread_mutex_lock(&ins->worker_pool->mutex);
+    }
+    flb_metrics_sum(id, val, ins->metrics);
+    if (ins->worker_pool) {
+        pthread_mutex_unlock(&ins->worker_pool->mutex);
+    }
+}
+#endif
+
 /*
  * This function is used by the output plugins to return. It's mandatory
  * as it will take care to signal the event loop letting know the flush
@@ -515,7 +569,6 @@ struct flb_thread *flb_output_thread(struct flb_task *task,
  */
 static inline void flb_output_return(int ret, struct flb_thread *th) {
     int n;
-    uint32_t set;
     uint64_t val;
     struct flb_task *task;
     struct flb_output_thread *out_th;
@@ -533,34 +586,42 @@ static inline void flb_output_return(int ret, struct flb_thread *th) {
      * - Return value: FLB_OK (0) or FLB_ERROR (1)
      * - Task ID
      *
-     * We put together the return value with the task_id on the 32 bits at right
+     * The event type is encoded with the return value and the IDs, see
+     * FLB_TASK_SET() for the layout.
      */
-    set = FLB_TASK_SET(ret, task->id, out_th->id);
-    val = FLB_BITS_U64_SET(2 /* FLB_ENGINE_TASK */, set);
+    val = FLB_TASK_SET(ret, task->id, out_th->id);
 
-    n = flb_pipe_w(task->config->ch_manager[1], (void *) &val, sizeof(val));
-    if (n == -1) {
-        flb_errno();
+    /*
+     * A co-routine running inside an output worker cannot notify the engine
+     * by itself: the engine might destroy it before it yields. The worker
+     * delivers the event once the co-routine is back in its event loop.
+     */
+    if (out_th->worker) {
+        out_th->ret_event = val;
+    }
+    else {
+        n = flb_pipe_w(task->config->ch_manager[1], (void *) &val, sizeof(val));
+        if (n == -1) {
+            flb_errno();
+        }
     }
 
 #ifdef FLB_HAVE_METRICS
-    if (out_th->o_ins->metrics) {
-        if (ret == FLB_OK) {
-            records = task->records;
-            flb_metrics_sum(FLB_METRIC_OUT_OK_RECORDS, records,
-                            out_th->o_ins->metrics);
-            flb_metrics_sum(FLB_METRIC_OUT_OK_BYTES, task->size,
-                            out_th->o_ins->metrics);
-        }
-        else if (ret == FLB_ERROR) {
-            flb_metrics_sum(FLB_METRIC_OUT_ERROR, 1, out_th->o_ins->metrics);
-        }
-        else if (ret == FLB_RETRY) {
-            /*
-             * Counting retries is happening in the event loop/scheduler side
-             * since it also needs to count if some retry fails to re-schedule.
-             */
-        }
+    if (ret == FLB_OK) {
+        records = task->records;
+        flb_output_metrics_sum(out_th->o_ins, FLB_METRIC_OUT_OK_RECORDS,
+                               records);
+        flb_output_metrics_sum(out_th->o_ins, FLB_METRIC_OUT_OK_BYTES,
+                               task->size);
+    }
+    else if (ret == FLB_ERROR) {
+        flb_output_metrics_sum(out_th->o_ins, FLB_METRIC_OUT_ERROR, 1);
+    }
+    else if (ret == FLB_RETRY) {
+        /*
+         * Counting retries is happening in the event loop/scheduler side
+         * since it also needs to count if some retry fails to re-schedule.
+         */
     }
 #endif
 }
@@ -581,6 +642,36 @@ static inline void flb_output_return_do(int x)
     flb_output_return_do(x);                                            \
     return
 
+/* Task being flushed by the caller, must be used from a flush callback */
+static inline struct flb_task *flb_output_flush_task()
+{
+    struct flb_thread *th;
+    struct flb_output_thread *out_th;
+
+    th = (struct flb_thread *) pthread_getspecific(flb_thread_key);
+    if (!th) {
+        return NULL;
+    }
+    out_th = (struct flb_output_thread *) FLB_THREAD_DATA(th);
+    return out_th->task;
+}
+
+/*
+ * Number of records in the buffer given to a flush callback. When it's the
+ * whole task buffer the count is taken from the chunk metadata, otherwise
+ * the buffer is counted.
+ */
+static inline int flb_output_records_count(const void *data, size_t bytes)
+{
+    struct flb_task *task;
+
+    task = flb_output_flush_task();
+    if (task && task->buf == data && task->size == bytes) {
+        return task->records;
+    }
+    return flb_mp_count(data, bytes);
+}
+
 static inline int flb_output_config_map_set(struct flb_output_instance *ins,
                                             void *context)
 {
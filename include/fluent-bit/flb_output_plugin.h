@@ -27,12 +27,14 @@
 
 #define flb_plg_error(ctx, fmt, ...)                                    \
     if (flb_log_check_level(ctx->log_level, FLB_LOG_ERROR))             \
-        flb_log_print(FLB_LOG_ERROR, NULL, 0, "[output:%s:%s] " fmt,    \
+        flb_log_print(FLB_LOG_ERROR, __FILE__, __LINE__,                \
+                      "[output:%s:%s] " fmt,                            \
                       ctx->p->name, flb_output_name(ctx), ##__VA_ARGS__)
 
 #define flb_plg_warn(ctx, fmt, ...)                                     \
     if (flb_log_check_level(ctx->log_level, FLB_LOG_WARN))              \
-        flb_log_print(FLB_LOG_WARN, NULL, 0, "[output:%s:%s] " fmt,     \
+        flb_log_print(FLB_LOG_WARN, __FILE__, __LINE__,                 \
+                      "[output:%s:%s] " fmt,                            \
                       ctx->p->name, flb_output_name(ctx), ##__VA_ARGS__)
 
 #define flb_plg_info(ctx, fmt, ...)                                     \
@@ -0,0 +1,78 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_OUTPUT_WORKER_H
+#define FLB_OUTPUT_WORKER_H
+
+#include <monkey/mk_core.h>
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_pipe.h>
+
+struct flb_config;
+struct flb_thread;
+struct flb_output_instance;
+
+/* Maximum number of workers that can be assigned to an output instance */
+#define FLB_OUTPUT_WORKERS_MAX    64
+
+/*
+ * An output worker is a POSIX thread that owns an event loop. Flush
+ * co-routines created by the engine for an output instance that have
+ * 'workers' enabled are handed to one of these threads and run there,
+ * including all their network I/O.
+ */
+struct flb_out_worker {
+    int id;                            /* worker id within the pool    */
+    int running;                       /* FLB_TRUE while looping       */
+    pthread_t tid;                     /* POSIX thread id              */
+    struct mk_event event;             /* channel event (read end)     */
+    flb_pipefd_t ch_events[2];         /* engine -> worker channel     */
+    struct mk_event_loop *evl;         /* worker event loop            */
+    struct flb_out_worker_pool *pool;  /* parent pool                  */
+    struct mk_list _head;              /* link to pool->workers        */
+};
+
+struct flb_out_worker_pool {
+    int size;                          /* number of workers            */
+    struct mk_list *next;              /* round-robin cursor           */
+    pthread_mutex_t mutex;             /* protect shared counters      */
+    struct flb_output_instance *ins;   /* parent output instance       */
+    struct flb_config *config;         /* Fluent Bit context           */
+    struct mk_list workers;            /* list of struct flb_out_worker */
+};
+
+void flb_output_worker_prepare();
+
+/*
+ * Event loop of the current thread: the engine and each output worker
+ * register their own loop so network I/O done inside a co-routine gets
+ * registered in the loop of the thread that will resume it.
+ */
+void flb_output_worker_evl_set(struct mk_event_loop *evl);
+struct mk_event_loop *flb_output_worker_evl_get();
+
+struct flb_out_worker_pool *flb_output_worker_pool_create(
+                                            struct flb_output_instance *ins,
+                                            struct flb_config *config);
+int flb_output_worker_dispatch(struct flb_out_worker_pool *pool,
+                               struct flb_thread *th);
+void flb_output_worker_pool_destroy(struct flb_out_worker_pool *pool);
+
+#endif
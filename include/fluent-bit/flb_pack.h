@@ -82,6 +82,7 @@ int flb_msgpack_to_json(char *json_str, size_t str_len,
                         const msgpack_object *obj);
 char* flb_msgpack_to_json_str(size_t size, const msgpack_object *obj);
 flb_sds_t flb_msgpack_raw_to_json_sds(const void *in_buf, size_t in_size);
+int flb_msgpack_to_json_sds(flb_sds_t *json, const msgpack_object *obj);
 
 int flb_pack_time_now(msgpack_packer *pck);
 int flb_msgpack_expand_map(char *map_data, size_t map_size,
@@ -26,6 +26,7 @@
 #include <fluent-bit/flb_regex.h>
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_parser_time.h>
 #include <msgpack.h>
 
 #define FLB_PARSER_REGEX 1
@@ -59,6 +60,8 @@ struct flb_parser {
     int time_with_year;   /* do time_fmt consider a year (%Y) ? */
     char *time_fmt_year;
     int time_with_tz;     /* do time_fmt consider a timezone ?  */
+    struct flb_parser_time *time_decoder;     /* compiled time_fmt      */
+    struct flb_parser_time_cache time_cache;  /* last day to epoch      */
     struct flb_regex *regex;
     struct mk_list _head;
 };
@@ -107,6 +110,7 @@ int flb_parser_frac(const char *str, int len, double *frac, const char **end);
 int flb_parser_time_lookup(const char *time, size_t tsize, time_t now,
                            struct flb_parser *parser,
                            struct tm *tm, double *ns);
+time_t flb_parser_time_epoch(struct flb_parser *parser, const struct tm *tm);
 int flb_parser_typecast(const char *key, int key_len,
                         const char *val, int val_len,
                         msgpack_packer *pck,
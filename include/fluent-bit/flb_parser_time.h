@@ -0,0 +1,78 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_PARSER_TIME_H
+#define FLB_PARSER_TIME_H
+
+#include <fluent-bit/flb_info.h>
+#include <time.h>
+
+/* Maximum number of operations of a compiled Time_Format */
+#define FLB_PARSER_TIME_OPS_MAX   48
+
+/* Compiled Time_Format operations */
+enum {
+    FLB_PTIME_LITERAL = 0,  /* exact character            */
+    FLB_PTIME_SPACE,        /* zero or more white spaces  */
+    FLB_PTIME_YEAR,         /* %Y                         */
+    FLB_PTIME_YEAR2,        /* %y                         */
+    FLB_PTIME_MONTH,        /* %m                         */
+    FLB_PTIME_MONTH_NAME,   /* %b, %h, %B                 */
+    FLB_PTIME_MDAY,         /* %d, %e                     */
+    FLB_PTIME_HOUR,         /* %H                         */
+    FLB_PTIME_MIN,          /* %M                         */
+    FLB_PTIME_SEC,          /* %S                         */
+    FLB_PTIME_FRAC,         /* .%L or ,%L after seconds   */
+    FLB_PTIME_EPOCH,        /* %s                         */
+    FLB_PTIME_TZ            /* %z                         */
+};
+
+struct flb_parser_time_op {
+    int type;
+    char c;                 /* character of FLB_PTIME_LITERAL */
+};
+
+/*
+ * A Time_Format compiled into a list of fixed digit and literal readers,
+ * formats using other conversions are not compiled and keep using
+ * strptime(3).
+ */
+struct flb_parser_time {
+    int ops_len;
+    struct flb_parser_time_op ops[FLB_PARSER_TIME_OPS_MAX];
+};
+
+/* Start of the last day converted to epoch by a parser */
+struct flb_parser_time_cache {
+    int valid;
+    int year;
+    int mon;
+    int mday;
+    long gmtoff;
+    time_t day;
+};
+
+struct flb_parser_time *flb_parser_time_compile(const char *fmt);
+int flb_parser_time_decode(struct flb_parser_time *pt,
+                           const char *str, size_t len,
+                           struct tm *tm, double *ns);
+void flb_parser_time_destroy(struct flb_parser_time *pt);
+
+#endif
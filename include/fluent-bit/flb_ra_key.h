@@ -53,6 +53,8 @@ struct flb_ra_value {
 struct flb_ra_value *flb_ra_key_to_value(flb_sds_t ckey,
                                          msgpack_object map,
                                          struct mk_list *subkeys);
+msgpack_object *flb_ra_key_to_object(flb_sds_t ckey, msgpack_object map,
+                                     struct mk_list *subkeys);
 void flb_ra_key_value_destroy(struct flb_ra_value *v);
 int flb_ra_key_strcmp(flb_sds_t ckey, msgpack_object map,
                       struct mk_list *subkeys, char *str, int len);
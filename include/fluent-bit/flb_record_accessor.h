@@ -44,5 +44,7 @@ int flb_ra_regex_match(struct flb_record_accessor *ra, msgpack_object map,
                        struct flb_regex_search *result);
 struct flb_ra_value *flb_ra_get_value_object(struct flb_record_accessor *ra,
                                              msgpack_object map);
+msgpack_object *flb_ra_get_object(struct flb_record_accessor *ra,
+                                  msgpack_object map);
 
 #endif
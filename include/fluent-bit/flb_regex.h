@@ -30,8 +30,27 @@
 #include <stdlib.h>
 #include <stddef.h>
 
+/*
+ * Matching engines: a pattern supported by one of them uses it to know if a
+ * string matches, Onigmo is still used to get the captures and for the
+ * patterns no other engine supports.
+ */
+struct flb_regex_engine {
+    const char *name;
+    void *(*create) (const char *);                 /* pattern        */
+    int (*match) (void *, const char *, size_t);    /* 1, 0 or -1     */
+    void (*destroy) (void *);
+};
+
 struct flb_regex {
-    void *regex;
+    void *regex;                      /* Onigmo                       */
+    struct flb_regex_engine *engine;  /* matching engine or NULL      */
+    void *engine_ctx;
+
+    /* pre-check statistics, see flb_regex_do() */
+    int checks;
+    int rejects;
+    int skip;
 };
 
 struct flb_regex_search {
@@ -62,6 +81,8 @@ int flb_regex_results_get(struct flb_regex_search *result, int i,
 void flb_regex_results_release(struct flb_regex_search *result);
 int flb_regex_results_size(struct flb_regex_search *result);
 
+const char *flb_regex_engine_name(struct flb_regex *r);
+
 void flb_regex_exit();
 
 #endif
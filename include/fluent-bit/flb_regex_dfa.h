@@ -0,0 +1,96 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_REGEX_DFA_H
+#define FLB_REGEX_DFA_H
+
+#include <fluent-bit/flb_info.h>
+
+#ifdef FLB_HAVE_REGEX
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Limits: bigger patterns are left to Onigmo */
+#define FLB_REGEX_DFA_NFA_MAX      4096   /* NFA states of a pattern set   */
+#define FLB_REGEX_DFA_REPEAT_MAX   256    /* counted repetitions {n,m}     */
+#define FLB_REGEX_DFA_STATES_MAX   2048   /* cached DFA states             */
+
+struct flb_regex_dfa_nfa {
+    int type;
+    int out;
+    int out1;                       /* second branch, assertion, pattern */
+    uint8_t set[32];                /* bytes accepted by a byte state    */
+};
+
+struct flb_regex_dfa_state {
+    int prev;                       /* class of the previous byte        */
+    int core_len;
+    int *core;                      /* NFA states reached, sorted        */
+    uint32_t hash;
+    int32_t next[256];              /* transitions, -1 if not computed   */
+    char accept[4];                 /* a pattern matches, by next class  */
+    char *matched;                  /* patterns matched, by next class   */
+};
+
+/*
+ * DFA regex engine
+ * ================
+ * Matching only (no captures) engine for the patterns without
+ * backreferences, lookaround, inline options or Unicode properties. A set
+ * of patterns is compiled into a single NFA and run as a lazy DFA: states
+ * are built the first time they are reached and cached, so the matching
+ * time is linear in the size of the input for any number of patterns.
+ *
+ * The semantics follow Onigmo with the Ruby syntax and UTF-8 encoding: '^'
+ * and '$' match on line boundaries, '.' does not match a new line and
+ * '\d', '\w', '\s' and '\h' are ASCII only.
+ */
+struct flb_regex_dfa {
+    int patterns;                   /* number of patterns                */
+    int nfa_len;
+    int start;                      /* NFA start state                   */
+    struct flb_regex_dfa_nfa *nfa;
+
+    /* state cache */
+    int states_len;
+    struct flb_regex_dfa_state **states;
+    int *table;                     /* hash table of states              */
+    int table_size;
+
+    /* scratch buffers */
+    int *stack;
+    int *list;
+    int *mark;
+    int gen;
+
+    pthread_mutex_t lock;
+};
+
+int flb_regex_dfa_check(const char *pattern);
+struct flb_regex_dfa *flb_regex_dfa_create(const char **patterns, int count);
+int flb_regex_dfa_exec(struct flb_regex_dfa *dfa, const char *str, size_t len,
+                       char *matched);
+void flb_regex_dfa_destroy(struct flb_regex_dfa *dfa);
+
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_REGEX_SET_H
+#define FLB_REGEX_SET_H
+
+#include <fluent-bit/flb_info.h>
+
+#ifdef FLB_HAVE_REGEX
+
+#include <fluent-bit/flb_regex.h>
+#include <fluent-bit/flb_regex_dfa.h>
+#include <stdint.h>
+
+/* Pattern types */
+#define FLB_REGEX_SET_REGEX      0   /* evaluated by the regex engine     */
+#define FLB_REGEX_SET_LITERAL    1   /* plain string, no regex required   */
+
+/* Automaton size limit, bigger sets search every literal with memmem(3) */
+#define FLB_REGEX_SET_STATES_MAX 4096
+
+struct flb_regex_set_entry {
+    int type;
+    int anchor_start;              /* literal starts a line: '^'        */
+    int anchor_end;                /* literal ends a line: '$'          */
+    int lit_id;                    /* required literal, -1 if none      */
+    int dfa_id;                    /* pattern in the DFA, -1 if none    */
+    char *pattern;                 /* pattern supported by the DFA      */
+    struct flb_regex *regex;       /* compiled pattern (not owned)      */
+};
+
+/*
+ * Regex set
+ * =========
+ * A list of patterns matched against the same string. When the set is
+ * compiled every pattern is analyzed: plain strings (optionally anchored)
+ * are resolved without the regex engine and for the other patterns a
+ * literal that any match must contain is extracted when possible.
+ *
+ * A scan looks for all the literals of the set in one pass over the string
+ * (Aho-Corasick automaton), after that a pattern only runs the regex engine
+ * if its literal was found. The patterns supported by the DFA engine are
+ * all matched by the scan in a second pass.
+ */
+struct flb_regex_set {
+    int count;
+    int size;
+    struct flb_regex_set_entry *entries;
+
+    /* literals */
+    int lits_count;
+    char **lits;
+    int *lits_len;
+    char *found;                   /* last scan: literal found ?       */
+
+    /* automaton */
+    int states;
+    int32_t *delta;                /* transitions: states x 256        */
+    int *out_lit;                  /* literal ending at a state, or -1 */
+    int *out_link;                 /* next state with an output        */
+
+    /* DFA of the regex patterns */
+    struct flb_regex_dfa *dfa;
+    int dfa_valid;                 /* last scan: DFA results available */
+    char *dfa_matched;
+};
+
+struct flb_regex_set *flb_regex_set_create();
+void flb_regex_set_destroy(struct flb_regex_set *set);
+int flb_regex_set_add(struct flb_regex_set *set,
+                      const char *pattern, struct flb_regex *regex);
+int flb_regex_set_compile(struct flb_regex_set *set);
+void flb_regex_set_scan(struct flb_regex_set *set,
+                        const char *str, size_t len);
+int flb_regex_set_candidate(struct flb_regex_set *set, int id);
+int flb_regex_set_match(struct flb_regex_set *set, int id,
+                        const char *str, size_t len);
+
+#endif
+
+#endif
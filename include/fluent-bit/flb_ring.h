@@ -0,0 +1,70 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_RING_H
+#define FLB_RING_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_pipe.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+/* Return values of flb_ring_push() and flb_ring_pop() */
+#define FLB_RING_OK        0
+#define FLB_RING_ERROR    -1
+#define FLB_RING_FULL     -2
+#define FLB_RING_EMPTY    -3
+
+#define FLB_RING_SLOTS_DEFAULT   4096
+
+struct flb_ring_slot {
+    uint64_t seq;               /* sequence used to publish the slot */
+    int type;                   /* caller defined entry type         */
+    void *data;                 /* entry data, owned by the ring     */
+    size_t size;                /* entry data length                 */
+};
+
+/*
+ * Bounded multi-producer single-consumer queue. Producers from any thread
+ * reserve a slot with a compare-and-swap and never block, the consumer
+ * (the engine thread) is woken up through a file descriptor that is only
+ * written when it's not already signaled.
+ */
+struct flb_ring {
+    uint64_t head;              /* next slot to reserve (producers)  */
+    char pad[56];               /* keep head and tail in own lines   */
+    uint64_t tail;              /* next slot to consume (consumer)   */
+    int signaled;               /* consumer wakeup is pending        */
+    size_t mask;
+    size_t slots_size;
+    struct flb_ring_slot *slots;
+    flb_pipefd_t ch[2];         /* eventfd (both ends) or pipe(2)    */
+};
+
+struct flb_ring *flb_ring_create(size_t slots);
+void flb_ring_destroy(struct flb_ring *ring);
+
+int flb_ring_push(struct flb_ring *ring, int type, void *data, size_t size);
+int flb_ring_pop(struct flb_ring *ring, int *type, void **data, size_t *size);
+
+flb_pipefd_t flb_ring_fd(struct flb_ring *ring);
+void flb_ring_consume_signal(struct flb_ring *ring);
+
+#endif
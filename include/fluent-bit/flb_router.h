@@ -22,15 +22,74 @@
 #define FLB_ROUTER_H
 
 #include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_output.h>
 
+struct flb_hash;
+
+/* Maximum number of Tags which routes are cached */
+#define FLB_ROUTER_CACHE_SIZE    1024
+
+/* Routes bitmap size that callers can keep in the stack (512 instances) */
+#define FLB_ROUTER_WORDS_STACK   8
+
 struct flb_router_path {
     struct flb_output_instance *ins;
     struct mk_list _head;
 };
 
+/*
+ * A 'Match' wildcard rule compiled into the list of literal parts found
+ * between the '*' characters, e.g: 'kube.*.log' becomes 'kube.' (prefix)
+ * and '.log' (suffix). Matching a Tag is a linear scan, it don't need
+ * recursion nor a NULL terminated Tag.
+ */
+struct flb_router_pattern {
+    int active;                    /* there is a wildcard rule         */
+    int head;                      /* first part is anchored at start  */
+    int tail;                      /* last part is anchored at end     */
+    int min_len;                   /* sum of the parts length          */
+    int n_parts;                   /* number of literal parts          */
+    flb_sds_t *parts;              /* literal parts                    */
+    void *regex;                   /* Match_Regex rule (not owned)     */
+};
+
+/*
+ * The routing table keeps the compiled rules of every filter and output
+ * instance. The routes of each Tag (a bitmap where bit 'i' is the filter
+ * 'i' and bit 'n_filters + i' is the output 'i', following the order of
+ * the config lists) are cached, so routing a known Tag is a single
+ * lookup. The table is only accessed from the engine thread.
+ */
+struct flb_router_table {
+    int n_filters;
+    int n_outputs;
+    int words;                     /* number of uint64_t in a bitmap   */
+    struct flb_router_pattern *patterns;
+    struct flb_hash *cache;        /* Tag -> routes bitmap             */
+};
+
+#define flb_router_routes_filter(t, routes, i)                          \
+    ((routes)[(i) / 64] & (1ULL << ((i) % 64)))
+
+#define flb_router_routes_output(t, routes, i)                          \
+    ((routes)[((t)->n_filters + (i)) / 64] &                            \
+     (1ULL << (((t)->n_filters + (i)) % 64)))
+
 int flb_router_match(const char *tag, int tag_len,
                      const char *match, void *match_regex);
+
+int flb_router_pattern_init(struct flb_router_pattern *p,
+                            const char *match, void *match_regex);
+int flb_router_pattern_match(struct flb_router_pattern *p,
+                             const char *tag, int tag_len);
+void flb_router_pattern_destroy(struct flb_router_pattern *p);
+
+struct flb_router_table *flb_router_table_create(struct flb_config *config);
+int flb_router_table_get(struct flb_router_table *table,
+                         const char *tag, int tag_len, uint64_t *routes);
+void flb_router_table_destroy(struct flb_router_table *table);
+
 int flb_router_io_set(struct flb_config *config);
 void flb_router_exit(struct flb_config *config);
 
@@ -29,11 +29,19 @@
 /* Sched contstants */
 #define FLB_SCHED_CAP            2000
 #define FLB_SCHED_BASE           5
-#define FLB_SCHED_REQUEST_FRAME  10
+#define FLB_SCHED_REQUEST_FRAME  1   /* seconds between wheel ticks */
+
+/* Timer wheel: two levels of 64 slots, level 0 slots are one tick long */
+#define FLB_SCHED_WHEEL_BITS     6
+#define FLB_SCHED_WHEEL_SLOTS    (1 << FLB_SCHED_WHEEL_BITS)
+#define FLB_SCHED_WHEEL_MASK     (FLB_SCHED_WHEEL_SLOTS - 1)
+#define FLB_SCHED_WHEEL_LEVELS   2
+#define FLB_SCHED_WHEEL_SPAN     (1 << (FLB_SCHED_WHEEL_BITS * \
+                                        FLB_SCHED_WHEEL_LEVELS))
 
 /* Timer types */
-#define FLB_SCHED_TIMER_REQUEST     1  /* timerfd             */
-#define FLB_SCHED_TIMER_FRAME       2  /* timer frame checker */
+#define FLB_SCHED_TIMER_REQUEST     1  /* unused, requests live in the wheel */
+#define FLB_SCHED_TIMER_FRAME       2  /* timer wheel tick    */
 #define FLB_SCHED_TIMER_CB_ONESHOT  3  /* one-shot callback timer  */
 #define FLB_SCHED_TIMER_CB_PERM     4  /* permanent callback timer */
 
@@ -67,39 +75,43 @@ struct flb_sched_timer {
     struct mk_list _head;
 };
 
-/* Struct representing a FLB_SCHED_TIMER_REQUEST */
+/* Struct representing a retry request waiting in the timer wheel */
 struct flb_sched_request {
-    flb_pipefd_t fd;
     time_t created;
     time_t timeout;
-    void *data;
-    struct flb_sched_timer *timer; /* parent timer linked from */
-    struct mk_list _head;          /* link to flb_sched->[requests|wait] */
+    time_t expire;                 /* created + timeout */
+    void *data;                    /* struct flb_task_retry */
+    struct mk_list _head;          /* link to a wheel slot */
+};
+
+/*
+ * Hierarchical timer wheel: level 0 keeps the requests expiring within the
+ * next FLB_SCHED_WHEEL_SLOTS ticks, one slot per tick. Level 1 slots cover
+ * FLB_SCHED_WHEEL_SLOTS ticks each and are cascaded down into level 0 when
+ * the wheel reaches them. Insert and cancel are O(1), a tick only touches
+ * the requests of the slots being expired or cascaded.
+ */
+struct flb_sched_wheel {
+    time_t now;                    /* last tick processed */
+    int count;                     /* requests in the wheel */
+    struct mk_list slots[FLB_SCHED_WHEEL_LEVELS][FLB_SCHED_WHEEL_SLOTS];
 };
 
 /* Scheduler context */
 struct flb_sched {
 
     /*
-     * Scheduler lists:
+     * Retry requests:
      *
      * The scheduler is used to issue 'retries' of flush requests when these
      * cannot be processed and the output plugins ask for a retry.
      *
-     * If a retry have not reached a limit and is allowed, it needs to be
-     * queued:
-     *
-     *  - For retries that will happen within the next 60 seconds, they are
-     *    placed in the 'requests' list and a timeout is registered with
-     *    the operating system (timerfd).
-     *
-     *  - For retries that will happen 'after' 60 seconds, they are queued
-     *    into the requests_wait' list. They stay there until their
-     *    flush time happens within the next 60 seconds, so they are moved
-     *    to the sched_requests list and a further timeout is created.
+     * If a retry have not reached a limit and is allowed, it's queued into
+     * the timer wheel. A single timer (frame_fd) ticks every
+     * FLB_SCHED_REQUEST_FRAME seconds and the requests that expired are
+     * dispatched in a batch, no matter how many retries are pending.
      */
-    struct mk_list requests;
-    struct mk_list requests_wait;
+    struct flb_sched_wheel wheel;
 
     /* Timers: list of timers for different purposes */
     struct mk_list timers;
@@ -110,7 +122,7 @@ struct flb_sched {
      */
     struct mk_list timers_drop;
 
-    /* Frame timer context */
+    /* Wheel tick timer context */
     flb_pipefd_t frame_fd;
 
     struct flb_config *config;
@@ -129,6 +141,8 @@ struct flb_sched_timer *flb_sched_timer_create(struct flb_sched *sched);
 int flb_sched_timer_destroy(struct flb_sched_timer *timer);
 
 int flb_sched_request_invalidate(struct flb_config *config, void *data);
+int flb_sched_wheel_advance(struct flb_sched *sched, time_t now,
+                            struct mk_list *expired);
 
 int flb_sched_timer_cb_create(struct flb_config *config, int type, int ms,
                               void (*cb)(struct flb_config *, void *),
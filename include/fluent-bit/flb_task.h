@@ -23,6 +23,7 @@
 
 #include <monkey/mk_core.h>
 #include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_input.h>
 
 /* Task status */
@@ -37,21 +38,30 @@
  * The FLB_OUTPUT_RETURN macro lookup the current active 'engine thread' and
  * it 'engine task' associated, so it emits an event to the main event loop
  * indicating an output thread has done. In order to specify return values
- * and the proper IDs an unsigned 32 bits number is used:
+ * and the proper IDs the whole 64 bits engine event is used:
  *
- *     AAAA     BBBBBBBBBBBBBB CCCCCCCCCCCCCC   > 32 bit number
- *       ^            ^              ^
- *    4 bits       14 bits        14 bits
- *  return val     task_id       thread_id
+ *   AAAA BBBBBBBBBBBBBBBBBBBB CCCCCCCC DDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDD
+ *     ^           ^              ^                    ^
+ *   4 bits     20 bits         8 bits              32 bits
+ * return val  thread_id   event type (2)           task_id
+ *
+ * The event type keeps the place it has on other engine events, the low 8
+ * bits of the high word.
  */
 
-#define FLB_TASK_RET(val)  (val >> 28)
-#define FLB_TASK_ID(val)   (uint32_t) (val & 0xfffc000) >> 14
-#define FLB_TASK_TH(val)   (val & 0x3fff)
-#define FLB_TASK_SET(ret, task_id, th_id)               \
-    (uint32_t) ((ret << 28) | (task_id << 14) | th_id)
+#define FLB_TASK_TH_MASK   0xfffff
+#define FLB_TASK_RET(val)  (int) ((uint64_t) (val) >> 60)
+#define FLB_TASK_TH(val)   (int) (((uint64_t) (val) >> 40) & FLB_TASK_TH_MASK)
+#define FLB_TASK_ID(val)   (int) ((uint64_t) (val) & 0xffffffff)
+#define FLB_TASK_SET(ret, task_id, th_id)                               \
+    (((uint64_t) (ret) << 60) |                                         \
+     ((uint64_t) ((th_id) & FLB_TASK_TH_MASK) << 40) |                  \
+     ((uint64_t) 2 /* FLB_ENGINE_TASK */ << 32) |                       \
+     (uint32_t) (task_id))
 
 struct flb_task_route {
+    int held;                           /* waiting for the tasks_limit */
+    int released;                       /* flush done, slot given back */
     struct flb_output_instance *out;
     struct mk_list _head;
 };
@@ -64,10 +74,13 @@ struct flb_task_route {
  * This reference is used later by the scheduler to re-dispatch the
  * task data to the desired output path.
  */
+struct flb_sched_request;
+
 struct flb_task_retry {
     int attemps;                        /* number of attemps, default 1 */
     struct flb_output_instance *o_ins;  /* route that we are retrying   */
     struct flb_task *parent;            /* parent task reference        */
+    struct flb_sched_request *sched_req;/* pending scheduler request    */
     struct mk_list _head;               /* link to parent task list     */
 };
 
@@ -78,14 +91,15 @@ struct flb_task {
     uint8_t status;                     /* new task or running ?     */
     int n_threads;                      /* number number of threads  */
     int users;                          /* number of users (threads) */
+    int held;                           /* routes held by tasks_limit */
     char *tag;                          /* record tag                */
     int tag_len;                        /* tag length                */
     const char *buf;                    /* buffer                    */
     size_t size;                        /* buffer data size          */
     void *ic;                           /* input chunk */
-#ifdef FLB_HAVE_METRICS
     int records;                        /* numbers of records in 'buf'   */
-#endif
+    struct flb_time tm_min;             /* oldest record time in 'buf'   */
+    struct flb_time tm_max;             /* newest record time in 'buf'   */
     struct mk_list threads;             /* ref flb_input_instance->tasks */
     struct mk_list routes;              /* routes to dispatch data       */
     struct mk_list retries;             /* queued in-memory retries      */
@@ -95,6 +109,8 @@ struct flb_task {
 };
 
 int flb_task_running_count(struct flb_config *config);
+int flb_task_map_get_id(struct flb_config *config);
+void flb_task_map_free_id(int id, struct flb_config *config);
 int flb_task_running_print(struct flb_config *config);
 
 struct flb_task *flb_task_create(uint64_t ref_id,
@@ -106,6 +122,11 @@ struct flb_task *flb_task_create(uint64_t ref_id,
                                  struct flb_config *config,
                                  int *err);
 
+void flb_task_route_destroy(struct flb_task_route *route);
+int flb_task_route_can_start(struct flb_task_route *route);
+void flb_task_route_start(struct flb_task *task, struct flb_task_route *route);
+void flb_task_route_release(struct flb_task *task,
+                            struct flb_output_instance *o_ins);
 void flb_task_add_thread(struct flb_thread *thread,
                          struct flb_task *task);
 
@@ -23,8 +23,13 @@
 
 #include <inttypes.h>
 
+/* Initial and maximum number of entries of the tasks table */
+#define FLB_TASK_MAP_SIZE   2048
+#define FLB_TASK_MAP_MAX    (1024 * 1024)
+
 struct flb_task_map {
     void    *task;
+    int     next_free;      /* next free entry, -1 if it's the last one */
 };
 
 #endif
@@ -22,7 +22,6 @@
 #define FLB_TIME_H
 
 #include <fluent-bit/flb_info.h>
-#include <fluent-bit/flb_time_utils.h>
 
 #include <time.h>
 #include <msgpack.h>
@@ -30,6 +29,9 @@ struct flb_time {
     struct timespec tm;
 };
 
+/* included after the definition, tasks and chunks embed 'struct flb_time' */
+#include <fluent-bit/flb_time_utils.h>
+
 /*
    to represent eventtime of fluentd
    see also
@@ -72,6 +74,17 @@ static inline int flb_time_equal(struct flb_time *t0, struct flb_time *t1) {
     return t0->tm.tv_sec == t1->tm.tv_sec && t0->tm.tv_nsec == t1->tm.tv_nsec;
 }
 
+/* Returns -1, 0 or 1 if t0 is before, equal or after t1 */
+static inline int flb_time_cmp(struct flb_time *t0, struct flb_time *t1) {
+    if (t0->tm.tv_sec != t1->tm.tv_sec) {
+        return t0->tm.tv_sec < t1->tm.tv_sec ? -1 : 1;
+    }
+    if (t0->tm.tv_nsec != t1->tm.tv_nsec) {
+        return t0->tm.tv_nsec < t1->tm.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
 int flb_time_get(struct flb_time *tm);
 int flb_time_msleep(uint32_t ms);
 double flb_time_to_double(struct flb_time *tm);
@@ -80,6 +93,7 @@ int flb_time_add(struct flb_time *base, struct flb_time *duration,
 int flb_time_diff(struct flb_time *time1,
                   struct flb_time *time0, struct flb_time *result);
 int flb_time_append_to_msgpack(struct flb_time *tm, msgpack_packer *pk, int fmt);
+int flb_time_msgpack_to_time(struct flb_time *time, msgpack_object *obj);
 int flb_time_pop_from_msgpack(struct flb_time *time, msgpack_unpacked *upk,
                               msgpack_object **map);
 
@@ -25,43 +25,8 @@
 #include <fluent-bit/flb_thread.h>
 #include <fluent-bit/flb_scheduler.h>
 
-static void flb_time_thread_wakeup(struct flb_config *config, void *data)
-{
-    (void) config;
-    struct flb_thread *th;
+struct flb_config;
 
-    th = (struct flb_thread *) data;
-    flb_thread_resume(th);
-}
-
-/*
- * Sleep running thread for 'ms' (milliseconds). This function assume
- * that's running in a co-routine.
- *
- * Internally it creates a timer and once the signal gets into the
- * event loop after expiration time, this function resume.
- *
- * A context that invokes flb_time_sleep() will resume upon an
- * internal call to flb_time_thread_wakeup().
- */
-static FLB_INLINE void flb_time_sleep(int ms, struct flb_config *config)
-{
-    int ret;
-    struct flb_thread *th;
-
-    th = (struct flb_thread *) pthread_getspecific(flb_thread_key);
-    if (!th) {
-        flb_error("[thread] invalid context for thread_sleep()");
-        return;
-    }
-
-    ret = flb_sched_timer_cb_create(config, FLB_SCHED_TIMER_CB_ONESHOT,
-                                    ms, flb_time_thread_wakeup, th);
-    if (ret == -1) {
-        return;
-    }
-
-    flb_thread_yield(th, FLB_FALSE);
-}
+void flb_time_sleep(int ms, struct flb_config *config);
 
 #endif
@@ -79,6 +79,12 @@ struct flb_upstream {
      */
     struct mk_list busy_queue;
 
+    /*
+     * Output workers might share this upstream, the mutex protects the
+     * 'av_queue' and 'busy_queue' lists.
+     */
+    pthread_mutex_t mutex;
+
 #ifdef FLB_HAVE_TLS
     /* context with mbedTLS data to handle certificates and keys */
     struct flb_tls *tls;
@@ -92,6 +98,12 @@ struct flb_upstream_conn {
     struct mk_event event;
     struct flb_thread *thread;
 
+    /*
+     * Event loop where the connection events are registered: it's the loop
+     * of the thread that created the connection (engine or output worker).
+     */
+    struct mk_event_loop *evl;
+
     /* Socker */
     flb_sockfd_t fd;
 
@@ -24,6 +24,8 @@
 #include <fluent-bit/flb_config.h>
 
 struct flb_config;
+struct flb_ring;
+struct flb_log_cache;
 
 struct flb_worker {
     struct mk_event event;
@@ -33,12 +35,10 @@ struct flb_worker {
     void *data;                /* opaque data */
     pthread_t tid;             /* thread ID   */
 
-    /* Logging */
-#ifdef _WIN32
-    intptr_t log[2];
-#else
-    int log[2];
-#endif
+    /* Logging: messages ring, drained by the log worker */
+    struct flb_ring *log_ring;
+    struct flb_log_cache *log_cache;
+    uint64_t log_dropped;      /* messages lost, ring full */
 
     /* Runtime context */
     void *config;
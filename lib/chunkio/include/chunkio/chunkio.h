@@ -51,6 +51,17 @@
 /* defaults */
 #define CIO_MAX_CHUNKS_UP  64   /* default limit for cio_ctx->max_chunks_up */
 
+/* Chunk compression: codec identifiers are defined by the caller (1-255) */
+#define CIO_COMPRESS_NONE   0
+
+/*
+ * Compress or uncompress 'in_data' with the codec 'type'. The output buffer
+ * must be allocated with malloc(3), Chunk I/O will release it.
+ */
+typedef int (*cio_compress_cb)(int type,
+                               const void *in_data, size_t in_len,
+                               void **out_data, size_t *out_len);
+
 struct cio_ctx {
     int flags;
     int page_size;
@@ -74,6 +85,15 @@ struct cio_ctx {
      */
     size_t max_chunks_up;
 
+    /*
+     * compression: file chunks are compressed with 'compress_type' when
+     * they are locked or put down. Chunk I/O does not implement any codec,
+     * they are provided by the caller through the callbacks.
+     */
+    int compress_type;
+    cio_compress_cb compress_cb;
+    cio_compress_cb uncompress_cb;
+
     /* streams */
     struct mk_list streams;
 };
@@ -90,8 +110,13 @@ int cio_qsort(struct cio_ctx *ctx, int (*compar)(const void *, const void *));
 void cio_set_log_callback(struct cio_ctx *ctx, void (*log_cb));
 int cio_set_log_level(struct cio_ctx *ctx, int level);
 int cio_set_max_chunks_up(struct cio_ctx *ctx, int n);
+int cio_set_compression(struct cio_ctx *ctx, int type,
+                        cio_compress_cb compress_cb,
+                        cio_compress_cb uncompress_cb);
 
 int cio_meta_write(struct cio_chunk *ch, char *buf, size_t size);
+int cio_meta_update(struct cio_chunk *ch, size_t offset,
+                    char *buf, size_t size);
 int cio_meta_cmp(struct cio_chunk *ch, char *meta_buf, int meta_len);
 int cio_meta_read(struct cio_chunk *ch, char **meta_buf, int *meta_len);
 int cio_meta_size(struct cio_chunk *ch);
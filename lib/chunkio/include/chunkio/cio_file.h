@@ -38,6 +38,12 @@ struct cio_file {
     /* cached addr */
     char *st_content;
     crc_t crc_cur;
+
+    /* compression */
+    int compress;             /* codec of the content in the file */
+    size_t raw_size;          /* uncompressed content size */
+    size_t compress_size;     /* compressed content size */
+    char *raw_buf;            /* uncompressed content, loaded on demand */
 };
 
 struct cio_file *cio_file_open(struct cio_ctx *ctx,
@@ -49,6 +55,8 @@ struct cio_file *cio_file_open(struct cio_ctx *ctx,
 void cio_file_close(struct cio_chunk *ch, int delete);
 int cio_file_write(struct cio_chunk *ch, const void *buf, size_t count);
 int cio_file_write_metadata(struct cio_chunk *ch, char *buf, size_t size);
+int cio_file_update_metadata(struct cio_chunk *ch, size_t offset,
+                             char *buf, size_t size);
 int cio_file_sync(struct cio_chunk *ch);
 int cio_file_fs_size_change(struct cio_file *cf, size_t new_size);
 int cio_file_close_stream(struct cio_stream *st);
@@ -57,6 +65,8 @@ void cio_file_hash_print(struct cio_file *cf);
 void cio_file_calculate_checksum(struct cio_file *cf, crc_t *out);
 void cio_file_scan_dump(struct cio_ctx *ctx, struct cio_stream *st);
 int cio_file_read_prepare(struct cio_ctx *ctx, struct cio_chunk *ch);
+int cio_file_compress(struct cio_chunk *ch);
+int cio_file_uncompress(struct cio_chunk *ch);
 
 
 int cio_file_is_up(struct cio_chunk *ch, struct cio_file *cf);
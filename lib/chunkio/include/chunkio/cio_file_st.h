@@ -28,6 +28,10 @@
  *
  * - 2 first bytes as identification: 0xC1 0x00
  * - 4 bytes for checksum of content section (CRC32)
+ * - 16 bytes of padding, bytes 10 to 18 of the file are used for
+ *   compression: 1 byte for the codec and 8 bytes for the uncompressed size
+ *   of the user data (the first padding bytes are skipped since the crc32
+ *   is copied using the native crc_t size)
  * - Content section is composed by:
  *   - 2 bytes to specify the length of metadata
  *   - optional metadata
@@ -38,6 +42,8 @@
  *    +--------------+----------------+
  *    |   4 BYTES CRC32 + 16 BYTES    +--> CRC32(Content) + Padding
  *    +-------------------------------+
+ *    |  1 BYTE CODEC + 8 BYTES SIZE  +--> Compression (within Padding)
+ *    +-------------------------------+
  *    |            Content            |
  *    |  +-------------------------+  |
  *    |  |         2 BYTES         +-----> Metadata Length
@@ -49,7 +55,7 @@
  *    |  +-------------------------+  |
  *    |  +-------------------------+  |
  *    |  |                         |  |
- *    |  |       Content Data      +-----> User Data
+ *    |  |       Content Data      +-----> User Data (maybe compressed)
  *    |  |                         |  |
  *    |  +-------------------------+  |
  *    +-------------------------------+
@@ -59,6 +65,8 @@
 #define CIO_FILE_ID_01          0x00    /* header: second byte */
 #define CIO_FILE_HEADER_MIN       24    /* 24 bytes for the header */
 #define CIO_FILE_CONTENT_OFFSET   22
+#define CIO_FILE_COMPRESS_OFFSET  10    /* codec, 0 means uncompressed */
+#define CIO_FILE_RAW_SIZE_OFFSET  11    /* uncompressed size (8 bytes) */
 
 /* Return pointer to hash position */
 static inline char *cio_file_st_get_hash(char *map)
@@ -66,6 +74,38 @@ static inline char *cio_file_st_get_hash(char *map)
     return map + 2;
 }
 
+/* Return the codec used to compress the user data */
+static inline int cio_file_st_get_compress(char *map)
+{
+    return (uint8_t) map[CIO_FILE_COMPRESS_OFFSET];
+}
+
+/* Return the uncompressed size of the user data */
+static inline uint64_t cio_file_st_get_raw_size(char *map)
+{
+    int i;
+    uint64_t size = 0;
+    unsigned char *p = (unsigned char *) map + CIO_FILE_RAW_SIZE_OFFSET;
+
+    for (i = 0; i < 8; i++) {
+        size = (size << 8) | p[i];
+    }
+    return size;
+}
+
+/* Set the compression codec and uncompressed size (big endian) */
+static inline void cio_file_st_set_compress(char *map, int type, uint64_t size)
+{
+    int i;
+    unsigned char *p = (unsigned char *) map + CIO_FILE_RAW_SIZE_OFFSET;
+
+    map[CIO_FILE_COMPRESS_OFFSET] = (uint8_t) type;
+    for (i = 7; i >= 0; i--) {
+        p[i] = (uint8_t) size;
+        size >>= 8;
+    }
+}
+
 /* Return metadata length */
 static inline uint16_t cio_file_st_get_meta_len(char *map)
 {
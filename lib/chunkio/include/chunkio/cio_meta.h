@@ -24,6 +24,8 @@
 #include <chunkio/cio_chunk.h>
 
 int cio_meta_write(struct cio_chunk *ch, char *buf, size_t size);
+int cio_meta_update(struct cio_chunk *ch, size_t offset,
+                    char *buf, size_t size);
 int cio_meta_read(struct cio_chunk *ch, char **meta_buf, int *meta_len);
 int cio_meta_cmp(struct cio_chunk *ch, char *meta_buf, int meta_len);
 int cio_meta_size(struct cio_chunk *ch);
@@ -32,6 +32,10 @@ struct cio_stats {
     int chunks_fs;           /* number of chunks in file type */
     int chunks_fs_up;        /* number of chunks in file type 'Up' in memory */
     int chunks_fs_down;      /* number of chunks in file type 'down' */
+    int chunks_fs_compressed;/* number of compressed chunks in file type */
+
+    /* Compression */
+    size_t fs_bytes_saved;   /* file system bytes saved by compression */
 };
 
 void cio_stats_get(struct cio_ctx *ctx, struct cio_stats *stats);
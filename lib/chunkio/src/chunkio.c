@@ -217,3 +217,21 @@ int cio_set_max_chunks_up(struct cio_ctx *ctx, int n)
     ctx->max_chunks_up = n;
     return 0;
 }
+
+/*
+ * Register the compression callbacks. Chunks are compressed with 'type',
+ * use CIO_COMPRESS_NONE to only read chunks compressed previously.
+ */
+int cio_set_compression(struct cio_ctx *ctx, int type,
+                        cio_compress_cb compress_cb,
+                        cio_compress_cb uncompress_cb)
+{
+    if (type < CIO_COMPRESS_NONE || type > 255) {
+        return -1;
+    }
+
+    ctx->compress_type = type;
+    ctx->compress_cb = compress_cb;
+    ctx->uncompress_cb = uncompress_cb;
+    return 0;
+}
@@ -141,6 +141,9 @@ int cio_chunk_write_at(struct cio_chunk *ch, off_t offset,
     }
     else if (type == CIO_STORE_FS) {
         cf = ch->backend;
+        if (cio_file_uncompress(ch) == -1) {
+            return -1;
+        }
         cf->data_size = offset;
     }
 
@@ -200,6 +203,11 @@ int cio_chunk_get_content(struct cio_chunk *ch, char **buf, size_t *size)
         if (ret != CIO_OK) {
             return ret;
         }
+        if (cf->compress != CIO_COMPRESS_NONE) {
+            *size = cf->raw_size;
+            *buf = cf->raw_buf;
+            return ret;
+        }
         *size = cf->data_size;
         *buf = cio_file_st_get_content(cf->map);
         return ret;
@@ -222,7 +230,12 @@ size_t cio_chunk_get_content_end_pos(struct cio_chunk *ch)
     }
     else if (type == CIO_STORE_FS) {
         cf = ch->backend;
-        pos = (off_t) (cio_file_st_get_content(cf->map) + cf->data_size);
+        if (cf->compress != CIO_COMPRESS_NONE) {
+            pos = (off_t) (cf->raw_buf + cf->raw_size);
+        }
+        else {
+            pos = (off_t) (cio_file_st_get_content(cf->map) + cf->data_size);
+        }
     }
 
     return pos;
@@ -241,6 +254,9 @@ ssize_t cio_chunk_get_content_size(struct cio_chunk *ch)
     }
     else if (type == CIO_STORE_FS) {
         cf = ch->backend;
+        if (cf->compress != CIO_COMPRESS_NONE) {
+            return cf->raw_size;
+        }
         return cf->data_size;
     }
 
@@ -294,6 +310,12 @@ int cio_chunk_lock(struct cio_chunk *ch)
     }
 
     ch->lock = CIO_TRUE;
+
+    /* No more data will be appended, compress the file content */
+    if (ch->st->type == CIO_STORE_FS) {
+        cio_file_compress(ch);
+    }
+
     return CIO_OK;
 }
 
@@ -340,6 +362,10 @@ int cio_chunk_tx_begin(struct cio_chunk *ch)
     }
     else if (type == CIO_STORE_FS) {
         cf = ch->backend;
+        if (cio_file_uncompress(ch) == -1) {
+            ch->tx_active = CIO_FALSE;
+            return CIO_ERROR;
+        }
         ch->tx_crc = cf->crc_cur;
         ch->tx_content_length = cf->data_size;
     }
@@ -260,6 +260,12 @@ static int munmap_file(struct cio_ctx *ctx, struct cio_chunk *ch)
     cf->data_size = 0;
     cf->alloc_size = 0;
 
+    /* Release the uncompressed content */
+    if (cf->raw_buf) {
+        free(cf->raw_buf);
+        cf->raw_buf = NULL;
+    }
+
     /* Adjust counters */
     cio_chunk_counter_total_up_sub(ctx);
 
@@ -378,6 +384,14 @@ static int mmap_file(struct cio_ctx *ctx, struct cio_chunk *ch, size_t size)
     }
 
     cf->st_content = cio_file_st_get_content(cf->map);
+
+    /* Compression info */
+    cf->compress = cio_file_st_get_compress(cf->map);
+    if (cf->compress != CIO_COMPRESS_NONE) {
+        cf->raw_size = cio_file_st_get_raw_size(cf->map);
+        cf->compress_size = cf->data_size;
+    }
+
     cio_log_debug(ctx, "%s:%s mapped OK", ch->st->name, ch->name);
 
     /* The mmap succeeded, adjust the counters */
@@ -423,6 +437,42 @@ static int file_open(struct cio_ctx *ctx, struct cio_file *cf)
     return 0;
 }
 
+/* Uncompress the file content into 'raw_buf', it's kept until unmapped */
+static int load_raw_content(struct cio_chunk *ch, struct cio_file *cf)
+{
+    int ret;
+    void *buf;
+    size_t size;
+    struct cio_ctx *ctx = ch->ctx;
+
+    if (cf->raw_buf) {
+        return 0;
+    }
+
+    if (!ctx->uncompress_cb) {
+        cio_log_error(ctx, "[cio file] chunk %s:%s is compressed (codec=%i) "
+                      "but no codec has been registered",
+                      ch->st->name, ch->name, cf->compress);
+        return -1;
+    }
+
+    /* The map may have been moved by a resize, get the content again */
+    cf->st_content = cio_file_st_get_content(cf->map);
+    ret = ctx->uncompress_cb(cf->compress, cf->st_content, cf->data_size,
+                             &buf, &size);
+    if (ret != 0 || size != cf->raw_size) {
+        cio_log_error(ctx, "[cio file] cannot uncompress chunk %s:%s",
+                      ch->st->name, ch->name);
+        if (ret == 0) {
+            free(buf);
+        }
+        return -1;
+    }
+
+    cf->raw_buf = buf;
+    return 0;
+}
+
 int cio_file_read_prepare(struct cio_ctx *ctx, struct cio_chunk *ch)
 
 {
@@ -431,12 +481,198 @@ int cio_file_read_prepare(struct cio_ctx *ctx, struct cio_chunk *ch)
 
     if (!cf->map) {
         ret = mmap_file(ctx, ch, 0);
-        return ret;
+        if (ret != CIO_OK) {
+            return ret;
+        }
+    }
+
+    if (cf->compress != CIO_COMPRESS_NONE) {
+        return load_raw_content(ch, cf);
+    }
+
+    return 0;
+}
+
+/* write(2) the whole buffer */
+static int write_all(int fd, const char *buf, size_t size)
+{
+    ssize_t bytes;
+
+    while (size > 0) {
+        bytes = write(fd, buf, size);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += bytes;
+        size -= bytes;
     }
 
     return 0;
 }
 
+/*
+ * Replace the content of a mapped file: the header, metadata and the new
+ * content are written to a temporary file which is renamed over the chunk
+ * file once it's on disk, so a crash leaves either the old or the new file
+ * but never a mix of both. The new file is mapped in place of the old one.
+ */
+static int file_replace(struct cio_chunk *ch, struct cio_file *cf,
+                        const char *content, size_t size,
+                        int compress, size_t raw_size)
+{
+    int fd;
+    int ret;
+    size_t len;
+    size_t header_len;
+    char *tmp_path;
+    char *header;
+    crc_t crc;
+    struct cio_ctx *ctx = ch->ctx;
+
+    /* Header and metadata are kept, only the codec info is updated */
+    header_len = CIO_FILE_HEADER_MIN + cio_file_st_get_meta_len(cf->map);
+    header = malloc(header_len);
+    if (!header) {
+        cio_errno();
+        return -1;
+    }
+    memcpy(header, cf->map, header_len);
+    cio_file_st_set_compress(header, compress, raw_size);
+
+    if (ctx->flags & CIO_CHECKSUM) {
+        crc = cio_crc32_init();
+        crc = cio_crc32_update(crc,
+                               (unsigned char *) header +
+                               CIO_FILE_CONTENT_OFFSET,
+                               header_len - CIO_FILE_CONTENT_OFFSET);
+        crc = cio_crc32_update(crc, (unsigned char *) content, size);
+        crc = htonl(cio_crc32_finalize(crc));
+        memcpy(header + 2, &crc, sizeof(crc));
+    }
+
+    /* Hidden files are skipped when scanning the streams */
+    len = strlen(ctx->root_path) + strlen(ch->st->name) + strlen(ch->name) + 8;
+    tmp_path = malloc(len);
+    if (!tmp_path) {
+        cio_errno();
+        free(header);
+        return -1;
+    }
+    snprintf(tmp_path, len, "%s/%s/.%s.tmp",
+             ctx->root_path, ch->st->name, ch->name);
+
+    fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, (mode_t) 0600);
+    if (fd == -1) {
+        cio_errno();
+        cio_log_error(ctx, "[cio file] cannot create %s", tmp_path);
+        free(header);
+        free(tmp_path);
+        return -1;
+    }
+
+    ret = write_all(fd, header, header_len);
+    if (ret == 0) {
+        ret = write_all(fd, content, size);
+    }
+    if (ret == 0) {
+        ret = fsync(fd);
+    }
+    if (ret == 0) {
+        ret = rename(tmp_path, cf->path);
+    }
+    free(header);
+
+    if (ret == -1) {
+        cio_errno();
+        cio_log_error(ctx, "[cio file] cannot replace content of %s:%s",
+                      ch->st->name, ch->name);
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+    free(tmp_path);
+
+    /* Drop the map of the old file, its content is not longer needed */
+    cf->synced = CIO_TRUE;
+    munmap_file(ctx, ch);
+    close(cf->fd);
+    cf->fd = fd;
+
+    return mmap_file(ctx, ch, 0);
+}
+
+/*
+ * Compress the content of a mapped file, the file is replaced by a smaller
+ * one. Chunks that do not get smaller are left as they are.
+ */
+int cio_file_compress(struct cio_chunk *ch)
+{
+    int ret;
+    void *buf;
+    size_t size;
+    size_t raw_size;
+    struct cio_ctx *ctx = ch->ctx;
+    struct cio_file *cf = ch->backend;
+
+    if (ctx->compress_type == CIO_COMPRESS_NONE || !ctx->compress_cb ||
+        cf->compress != CIO_COMPRESS_NONE || cf->data_size == 0 ||
+        (cf->flags & CIO_OPEN_RD) || cio_file_is_up(ch, cf) == CIO_FALSE) {
+        return 0;
+    }
+
+    cf->st_content = cio_file_st_get_content(cf->map);
+    ret = ctx->compress_cb(ctx->compress_type, cf->st_content, cf->data_size,
+                           &buf, &size);
+    if (ret != 0) {
+        cio_log_warn(ctx, "[cio file] cannot compress chunk %s:%s",
+                     ch->st->name, ch->name);
+        return -1;
+    }
+
+    if (size >= cf->data_size) {
+        free(buf);
+        return 0;
+    }
+
+    raw_size = cf->data_size;
+    ret = file_replace(ch, cf, buf, size, ctx->compress_type, raw_size);
+    free(buf);
+    if (ret != 0) {
+        return -1;
+    }
+
+    cio_log_debug(ctx, "[cio file] compressed %s:%s from %lu to %lu bytes",
+                  ch->st->name, ch->name, raw_size, size);
+
+    return 0;
+}
+
+/*
+ * Restore the uncompressed content in the file, this is required before
+ * any change in the content area. On failure the chunk is left compressed.
+ */
+int cio_file_uncompress(struct cio_chunk *ch)
+{
+    int ret;
+    struct cio_file *cf = ch->backend;
+
+    if (cf->compress == CIO_COMPRESS_NONE) {
+        return 0;
+    }
+
+    ret = load_raw_content(ch, cf);
+    if (ret == -1) {
+        return -1;
+    }
+
+    return file_replace(ch, cf, cf->raw_buf, cf->raw_size,
+                        CIO_COMPRESS_NONE, 0);
+}
+
 /*
  * If the maximum number of 'up' chunks is reached, put this chunk
  * down (only at open time).
@@ -629,6 +865,9 @@ int cio_file_down(struct cio_chunk *ch)
         return -1;
     }
 
+    /* Compress the content while it's not needed in memory */
+    cio_file_compress(ch);
+
     /* unmap memory */
     munmap_file(ch->ctx, ch);
 
@@ -662,6 +901,11 @@ void cio_file_close(struct cio_chunk *ch, int delete)
         return;
     }
 
+    /* Chunks that are kept in the file system are stored compressed */
+    if (delete == CIO_FALSE && cf->map) {
+        cio_file_compress(ch);
+    }
+
     /* Safe unmap of the file content */
     munmap_file(ch->ctx, ch);
 
@@ -710,6 +954,14 @@ int cio_file_write(struct cio_chunk *ch, const void *buf, size_t count)
         return -1;
     }
 
+    /* New data is appended to the uncompressed content */
+    if (cf->compress != CIO_COMPRESS_NONE) {
+        ret = cio_file_uncompress(ch);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
     /* get available size */
     av_size = get_available_size(cf, &meta_len);
 
@@ -772,6 +1024,37 @@ int cio_file_write(struct cio_chunk *ch, const void *buf, size_t count)
     return 0;
 }
 
+/*
+ * Overwrite a range of the existing metadata, the metadata length does not
+ * change so the content data is not moved.
+ */
+int cio_file_update_metadata(struct cio_chunk *ch, size_t offset,
+                             char *buf, size_t size)
+{
+    char *meta;
+    struct cio_file *cf = ch->backend;
+
+    if (cio_file_is_up(ch, cf) == CIO_FALSE) {
+        return -1;
+    }
+
+    if (offset + size > cio_file_st_get_meta_len(cf->map)) {
+        return -1;
+    }
+
+    meta = cio_file_st_get_meta(cf->map);
+    memcpy(meta + offset, buf, size);
+
+    /* Metadata is covered by the checksum */
+    if (ch->ctx->flags & CIO_CHECKSUM) {
+        cf->crc_cur = cio_crc32_init();
+        cio_file_calculate_checksum(cf, &cf->crc_cur);
+    }
+    cf->synced = CIO_FALSE;
+
+    return 0;
+}
+
 int cio_file_write_metadata(struct cio_chunk *ch, char *buf, size_t size)
 {
     int ret;
@@ -940,6 +1223,7 @@ int cio_file_sync(struct cio_chunk *ch)
             return -1;
         }
         cf->map = tmp;
+        cf->st_content = cio_file_st_get_content(cf->map);
     }
 
     /* Finalize CRC32 checksum */
@@ -95,6 +95,16 @@ int cio_file_read_prepare(struct cio_ctx *ctx, struct cio_chunk *ch)
     return -1;
 }
 
+int cio_file_compress(struct cio_chunk *ch)
+{
+    return 0;
+}
+
+int cio_file_uncompress(struct cio_chunk *ch)
+{
+    return 0;
+}
+
 int cio_file_is_up(struct cio_chunk *ch, struct cio_file *cf)
 {
     return CIO_FALSE;
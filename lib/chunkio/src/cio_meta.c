@@ -72,6 +72,30 @@ int cio_meta_write(struct cio_chunk *ch, char *buf, size_t size)
     return -1;
 }
 
+/*
+ * Overwrite 'size' bytes of the metadata at 'offset'. It's meant for fixed
+ * size fields updated often, since the metadata length is the same the
+ * content data is never moved.
+ */
+int cio_meta_update(struct cio_chunk *ch, size_t offset,
+                    char *buf, size_t size)
+{
+    struct cio_memfs *mf;
+
+    if (ch->st->type == CIO_STORE_MEM) {
+        mf = (struct cio_memfs *) ch->backend;
+        if (!mf->meta_data || offset + size > mf->meta_len) {
+            return -1;
+        }
+        memcpy(mf->meta_data + offset, buf, size);
+        return 0;
+    }
+    else if (ch->st->type == CIO_STORE_FS) {
+        return cio_file_update_metadata(ch, offset, buf, size);
+    }
+    return -1;
+}
+
 int cio_meta_size(struct cio_chunk *ch) {
     if (ch->st->type == CIO_STORE_MEM) {
         struct cio_memfs *mf = (struct cio_memfs *) ch->backend;
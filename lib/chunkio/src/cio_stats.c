@@ -23,6 +23,7 @@
 #include <chunkio/chunkio_compat.h>
 #include <chunkio/chunkio.h>
 #include <chunkio/cio_chunk.h>
+#include <chunkio/cio_file.h>
 #include <chunkio/cio_stats.h>
 
 void cio_stats_get(struct cio_ctx *ctx, struct cio_stats *stats)
@@ -30,6 +31,7 @@ void cio_stats_get(struct cio_ctx *ctx, struct cio_stats *stats)
     struct mk_list *head;
     struct mk_list *f_head;
     struct cio_chunk *ch;
+    struct cio_file *cf;
     struct cio_stream *stream;
 
     memset(stats, 0, sizeof(struct cio_stats));
@@ -58,6 +60,13 @@ void cio_stats_get(struct cio_ctx *ctx, struct cio_stats *stats)
             else {
                 stats->chunks_fs_down++;
             }
+
+            /* Compression, only known for chunks that have been mapped */
+            cf = ch->backend;
+            if (cf->compress != CIO_COMPRESS_NONE) {
+                stats->chunks_fs_compressed++;
+                stats->fs_bytes_saved += cf->raw_size - cf->compress_size;
+            }
         }
     }
 }
@@ -76,4 +85,6 @@ void cio_stats_print_summary(struct cio_ctx *ctx)
     printf("- chunks file total : %i\n", st.chunks_fs);
     printf("  - files up        : %i\n", st.chunks_fs_up);
     printf("  - files down      : %i\n", st.chunks_fs_down);
+    printf("  - files compressed: %i (%zu bytes saved)\n",
+           st.chunks_fs_compressed, st.fs_bytes_saved);
 }
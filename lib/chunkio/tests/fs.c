@@ -18,6 +18,7 @@
  */
 
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <arpa/inet.h>
 
 #include <chunkio/chunkio.h>
@@ -27,6 +28,7 @@
 #include <chunkio/cio_meta.h>
 #include <chunkio/cio_stream.h>
 #include <chunkio/cio_utils.h>
+#include <chunkio/cio_stats.h>
 
 #include "cio_tests_internal.h"
 
@@ -452,11 +454,188 @@ static void test_issue_flb_2025()
     cio_destroy(ctx);
 }
 
+/* Trivial run-length codec: pairs of (count, byte) */
+#define TEST_CODEC  7
+
+static int rle_compress(int type, const void *in_data, size_t in_len,
+                        void **out_data, size_t *out_len)
+{
+    size_t i = 0;
+    size_t n = 0;
+    unsigned char c;
+    unsigned char *out;
+    const unsigned char *in = in_data;
+
+    TEST_CHECK(type == TEST_CODEC);
+
+    out = malloc(in_len * 2);
+    while (i < in_len) {
+        c = 1;
+        while (i + c < in_len && in[i + c] == in[i] && c < 255) {
+            c++;
+        }
+        out[n++] = c;
+        out[n++] = in[i];
+        i += c;
+    }
+
+    *out_data = out;
+    *out_len = n;
+    return 0;
+}
+
+static int rle_uncompress(int type, const void *in_data, size_t in_len,
+                          void **out_data, size_t *out_len)
+{
+    size_t i;
+    size_t n = 0;
+    unsigned char *out;
+    const unsigned char *in = in_data;
+
+    if (type != TEST_CODEC || in_len % 2 != 0) {
+        return -1;
+    }
+
+    for (i = 0; i < in_len; i += 2) {
+        n += in[i];
+    }
+
+    out = malloc(n + 1);
+    n = 0;
+    for (i = 0; i < in_len; i += 2) {
+        memset(out + n, in[i + 1], in[i]);
+        n += in[i];
+    }
+
+    *out_data = out;
+    *out_len = n;
+    return 0;
+}
+
+static int fail_uncompress(int type, const void *in_data, size_t in_len,
+                           void **out_data, size_t *out_len)
+{
+    return -1;
+}
+
+/* Compressed chunks: lock, down/up, append and reload */
+static void test_fs_compress()
+{
+    int i;
+    int ret;
+    int err;
+    int meta_len;
+    char *meta;
+    char *buf;
+    char *in_data;
+    size_t size;
+    size_t in_size = 64000;
+    struct stat st;
+    struct cio_ctx *ctx;
+    struct cio_chunk *chunk;
+    struct cio_stream *stream;
+    struct cio_stats stats;
+
+    cio_utils_recursive_delete("tmp");
+
+    in_data = malloc(in_size * 2);
+    for (i = 0; i < in_size * 2; i++) {
+        in_data[i] = 'a' + ((i / 1000) % 26);
+    }
+
+    ctx = cio_create("tmp", log_cb, CIO_LOG_DEBUG, CIO_CHECKSUM);
+    ret = cio_set_compression(ctx, TEST_CODEC, rle_compress, rle_uncompress);
+    TEST_CHECK(ret == 0);
+
+    stream = cio_stream_create(ctx, "test", CIO_STORE_FS);
+    chunk = cio_chunk_open(ctx, stream, "c", CIO_OPEN, 1000, &err);
+    TEST_CHECK(chunk != NULL);
+    if (!chunk) {
+        exit(1);
+    }
+    cio_meta_write(chunk, "tag", 3);
+    ret = cio_chunk_write(chunk, in_data, in_size);
+    TEST_CHECK(ret == 0);
+
+    /* Locking the chunk compress the content */
+    cio_chunk_lock(chunk);
+    ret = stat("tmp/test/c", &st);
+    TEST_CHECK(ret == 0 && st.st_size < 4096);
+    TEST_CHECK(cio_chunk_get_content_size(chunk) == in_size);
+
+    ret = cio_chunk_get_content(chunk, &buf, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(size == in_size && memcmp(buf, in_data, size) == 0);
+
+    cio_stats_get(ctx, &stats);
+    TEST_CHECK(stats.chunks_fs_compressed == 1);
+    TEST_CHECK(stats.fs_bytes_saved == in_size - (st.st_size - 27));
+
+    /* The content is replaced through a temporary file */
+    ret = stat("tmp/test/.c.tmp", &st);
+    TEST_CHECK(ret == -1 && errno == ENOENT);
+
+    /* A failed uncompress leaves the compressed chunk untouched */
+    cio_chunk_unlock(chunk);
+    cio_chunk_down(chunk);
+    cio_chunk_up(chunk);
+    cio_set_compression(ctx, TEST_CODEC, rle_compress, fail_uncompress);
+    ret = cio_chunk_write(chunk, "x", 1);
+    TEST_CHECK(ret == -1);
+    cio_set_compression(ctx, TEST_CODEC, rle_compress, rle_uncompress);
+    ret = cio_chunk_get_content(chunk, &buf, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(size == in_size && memcmp(buf, in_data, size) == 0);
+    cio_chunk_lock(chunk);
+
+    /* Down and up */
+    ret = cio_chunk_down(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    ret = cio_chunk_up(chunk);
+    TEST_CHECK(ret == CIO_OK);
+
+    ret = cio_meta_read(chunk, &meta, &meta_len);
+    TEST_CHECK(ret == 0 && meta_len == 3 && memcmp(meta, "tag", 3) == 0);
+    ret = cio_chunk_get_content(chunk, &buf, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(size == in_size && memcmp(buf, in_data, size) == 0);
+
+    /* Appending data restores the uncompressed layout */
+    cio_chunk_unlock(chunk);
+    ret = cio_chunk_write(chunk, in_data + in_size, in_size);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(cio_chunk_get_content_size(chunk) == in_size * 2);
+    ret = cio_chunk_get_content(chunk, &buf, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(size == in_size * 2 && memcmp(buf, in_data, size) == 0);
+
+    /* Put it down compressed and load it again with a new context */
+    ret = cio_chunk_down(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    cio_destroy(ctx);
+
+    ctx = cio_create("tmp", log_cb, CIO_LOG_DEBUG, CIO_CHECKSUM);
+    cio_set_compression(ctx, CIO_COMPRESS_NONE, NULL, rle_uncompress);
+    stream = cio_stream_create(ctx, "test", CIO_STORE_FS);
+    chunk = cio_chunk_open(ctx, stream, "c", CIO_OPEN, 1000, &err);
+    TEST_CHECK(chunk != NULL);
+    if (!chunk) {
+        exit(1);
+    }
+    ret = cio_chunk_get_content(chunk, &buf, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(size == in_size * 2 && memcmp(buf, in_data, size) == 0);
+
+    cio_destroy(ctx);
+    free(in_data);
+}
+
 TEST_LIST = {
     {"fs_write",   test_fs_write},
     {"fs_checksum",  test_fs_checksum},
     {"fs_up_down", test_fs_up_down},
     {"issue_51",   test_issue_51},
     {"issue_flb_2025", test_issue_flb_2025},
+    {"fs_compress", test_fs_compress},
     { 0 }
 };
@@ -40,22 +40,73 @@ static void delete_rules(struct grep_ctx *ctx)
     struct mk_list *tmp;
     struct mk_list *head;
     struct grep_rule *rule;
+    struct grep_key *key;
 
     mk_list_foreach_safe(head, tmp, &ctx->rules) {
         rule = mk_list_entry(head, struct grep_rule, _head);
         flb_sds_destroy(rule->field);
         flb_free(rule->regex_pattern);
-        flb_ra_destroy(rule->ra);
         flb_regex_destroy(rule->regex);
         mk_list_del(&rule->_head);
         flb_free(rule);
     }
+
+    mk_list_foreach_safe(head, tmp, &ctx->keys) {
+        key = mk_list_entry(head, struct grep_key, _head);
+        flb_sds_destroy(key->field);
+        flb_ra_destroy(key->ra);
+        flb_regex_set_destroy(key->set);
+        mk_list_del(&key->_head);
+        flb_free(key);
+    }
+}
+
+/* Get the key context of a field, rules on the same field share it */
+static struct grep_key *get_key(struct grep_ctx *ctx, flb_sds_t field)
+{
+    struct mk_list *head;
+    struct grep_key *key;
+
+    mk_list_foreach(head, &ctx->keys) {
+        key = mk_list_entry(head, struct grep_key, _head);
+        if (strcmp(key->field, field) == 0) {
+            return key;
+        }
+    }
+
+    key = flb_calloc(1, sizeof(struct grep_key));
+    if (!key) {
+        flb_errno();
+        return NULL;
+    }
+
+    key->field = flb_sds_create(field);
+    key->ra = flb_ra_create(field, FLB_FALSE);
+    key->set = flb_regex_set_create();
+    if (!key->field || !key->ra || !key->set) {
+        flb_plg_error(ctx->ins, "invalid record accessor? '%s'", field);
+        if (key->field) {
+            flb_sds_destroy(key->field);
+        }
+        if (key->ra) {
+            flb_ra_destroy(key->ra);
+        }
+        if (key->set) {
+            flb_regex_set_destroy(key->set);
+        }
+        flb_free(key);
+        return NULL;
+    }
+    mk_list_add(&key->_head, &ctx->keys);
+
+    return key;
 }
 
 static int set_rules(struct grep_ctx *ctx, struct flb_filter_instance *f_ins)
 {
     flb_sds_t tmp;
     struct mk_list *head;
+    struct grep_key *key;
     struct mk_list *split;
     struct flb_split_entry *sentry;
     struct flb_kv *kv;
@@ -118,10 +169,11 @@ static int set_rules(struct grep_ctx *ctx, struct flb_filter_instance *f_ins)
         /* Release split */
         flb_utils_split_free(split);
 
-        /* Create a record accessor context for this rule */
-        rule->ra = flb_ra_create(rule->field, FLB_FALSE);
-        if (!rule->ra) {
-            flb_plg_error(ctx->ins, "invalid record accessor? '%s'", rule->field);
+        /* Lookup or create the record key of this rule */
+        rule->key = get_key(ctx, rule->field);
+        if (!rule->key) {
+            flb_sds_destroy(rule->field);
+            flb_free(rule->regex_pattern);
             delete_rules(ctx);
             flb_free(rule);
             return -1;
@@ -132,6 +184,19 @@ static int set_rules(struct grep_ctx *ctx, struct flb_filter_instance *f_ins)
         if (!rule->regex) {
             flb_plg_error(ctx->ins, "could not compile regex pattern '%s'",
                       rule->regex_pattern);
+            flb_sds_destroy(rule->field);
+            flb_free(rule->regex_pattern);
+            delete_rules(ctx);
+            flb_free(rule);
+            return -1;
+        }
+
+        rule->pattern_id = flb_regex_set_add(rule->key->set,
+                                             rule->regex_pattern, rule->regex);
+        if (rule->pattern_id == -1) {
+            flb_sds_destroy(rule->field);
+            flb_free(rule->regex_pattern);
+            flb_regex_destroy(rule->regex);
             delete_rules(ctx);
             flb_free(rule);
             return -1;
@@ -141,22 +206,64 @@ static int set_rules(struct grep_ctx *ctx, struct flb_filter_instance *f_ins)
         mk_list_add(&rule->_head, &ctx->rules);
     }
 
+    /* Build the literal prefilter of every key */
+    mk_list_foreach(head, &ctx->keys) {
+        key = mk_list_entry(head, struct grep_key, _head);
+        if (flb_regex_set_compile(key->set) == -1) {
+            delete_rules(ctx);
+            return -1;
+        }
+    }
+
     return 0;
 }
 
+/*
+ * Check a rule against the record: the key value is looked up and scanned
+ * for the literals of all its rules once per record, then the rule pattern
+ * only runs the regex engine if its required literal was found.
+ */
+static inline int rule_match(struct grep_rule *rule, msgpack_object map,
+                             struct grep_ctx *ctx)
+{
+    struct grep_key *key = rule->key;
+
+    if (key->record != ctx->records) {
+        key->record = ctx->records;
+        key->val = flb_ra_get_object(key->ra, map);
+        if (key->val && key->val->type != MSGPACK_OBJECT_STR) {
+            key->val = NULL;
+        }
+        if (key->val) {
+            flb_regex_set_scan(key->set, key->val->via.str.ptr,
+                               key->val->via.str.size);
+        }
+    }
+
+    if (!key->val) {
+        return FLB_FALSE;
+    }
+
+    return flb_regex_set_match(key->set, rule->pattern_id,
+                               key->val->via.str.ptr, key->val->via.str.size);
+}
+
 /* Given a msgpack record, do some filter action based on the defined rules */
 static inline int grep_filter_data(msgpack_object map, struct grep_ctx *ctx)
 {
-    ssize_t ret;
+    int ret;
     struct mk_list *head;
     struct grep_rule *rule;
 
+    /* new record: key values must be looked up again */
+    ctx->records++;
+
     /* For each rule, validate against map fields */
     mk_list_foreach(head, &ctx->rules) {
         rule = mk_list_entry(head, struct grep_rule, _head);
 
-        ret = flb_ra_regex_match(rule->ra, map, rule->regex, NULL);
-        if (ret <= 0) { /* no match */
+        ret = rule_match(rule, map, ctx);
+        if (ret == FLB_FALSE) { /* no match */
             if (rule->type == GREP_REGEX) {
                 return GREP_RET_EXCLUDE;
             }
@@ -188,6 +295,8 @@ static int cb_grep_init(struct flb_filter_instance *f_ins,
         return -1;
     }
     mk_list_init(&ctx->rules);
+    mk_list_init(&ctx->keys);
+    ctx->records = 0;
     ctx->ins = f_ins;
 
     /* Load rules */
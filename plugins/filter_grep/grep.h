@@ -25,6 +25,7 @@
 #include <fluent-bit/flb_filter.h>
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_record_accessor.h>
+#include <fluent-bit/flb_regex_set.h>
 
 /* rule types */
 #define GREP_REGEX    1
@@ -35,16 +36,32 @@
 #define GREP_RET_EXCLUDE  1
 
 struct grep_ctx {
+    uint64_t records;              /* current record number           */
     struct mk_list rules;
+    struct mk_list keys;
     struct flb_filter_instance *ins;
 };
 
+/*
+ * A record key read by one or more rules: the value is looked up once per
+ * record and the patterns of all its rules are compiled into a regex set.
+ */
+struct grep_key {
+    flb_sds_t field;
+    struct flb_record_accessor *ra;
+    struct flb_regex_set *set;
+    uint64_t record;               /* record of the last lookup       */
+    msgpack_object *val;           /* string value, NULL if not found */
+    struct mk_list _head;
+};
+
 struct grep_rule {
     int type;
+    int pattern_id;                /* pattern id in the key regex set */
     flb_sds_t field;
     char *regex_pattern;
     struct flb_regex *regex;
-    struct flb_record_accessor *ra;
+    struct grep_key *key;
     struct mk_list _head;
 };
 
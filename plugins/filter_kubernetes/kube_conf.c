@@ -35,6 +35,7 @@
 
 #include "kube_meta.h"
 #include "kube_conf.h"
+#include "kube_watch.h"
 
 struct flb_kube *flb_kube_conf_create(struct flb_filter_instance *ins,
                                       struct flb_config *config)
@@ -163,6 +164,11 @@ void flb_kube_conf_destroy(struct flb_kube *ctx)
         return;
     }
 
+    /* Stop the metadata workers before releasing what they use */
+    if (ctx->watch) {
+        flb_kube_watch_destroy(ctx->watch);
+    }
+
     if (ctx->hash_table) {
         flb_hash_destroy(ctx->hash_table);
     }
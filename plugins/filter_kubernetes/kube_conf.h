@@ -66,6 +66,7 @@
 #endif
 
 struct kube_meta;
+struct flb_kube_watch;
 
 /* Filter context */
 struct flb_kube {
@@ -81,6 +82,12 @@ struct flb_kube {
     int tls_verify;
     flb_sds_t meta_preload_cache_dir;
 
+    /* Background metadata: watch the pods of the node */
+    int meta_watch;
+    int meta_watch_timeout;   /* seconds of every watch request      */
+    int meta_miss_wait;       /* milliseconds to wait on a cache miss */
+    char *node_name;
+
     /* Configuration proposed through Annotations (boolean) */
     int k8s_logging_parser;   /* allow to process a suggested parser ? */
     int k8s_logging_exclude;  /* allowed to suggest to exclude logs ?  */
@@ -151,6 +158,7 @@ struct flb_kube {
     struct flb_config *config;
     struct flb_hash *hash_table;
     struct flb_upstream *upstream;
+    struct flb_kube_watch *watch;
     struct flb_filter_instance *ins;
 };
 
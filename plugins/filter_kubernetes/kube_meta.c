@@ -36,6 +36,7 @@
 #include "kube_conf.h"
 #include "kube_meta.h"
 #include "kube_property.h"
+#include "kube_watch.h"
 
 #define FLB_KUBE_META_CONTAINER_STATUSES_KEY "containerStatuses"
 #define FLB_KUBE_META_CONTAINER_STATUSES_KEY_LEN \
@@ -146,7 +147,7 @@ static int get_local_pod_info(struct flb_kube *ctx)
 }
 
 /* Gather metadata from API Server */
-static int get_api_server_info(struct flb_kube *ctx,
+static int get_api_server_info(struct flb_kube *ctx, struct flb_upstream *u,
                                const char *namespace, const char *podname,
                                char **out_buf, size_t *out_size)
 {
@@ -206,11 +207,11 @@ static int get_api_server_info(struct flb_kube *ctx,
     }
 
     if (packed == -1) {
-        if (!ctx->upstream) {
+        if (!u) {
             return -1;
         }
 
-        u_conn = flb_upstream_conn_get(ctx->upstream);
+        u_conn = flb_upstream_conn_get(u);
         if (!u_conn) {
             flb_plg_error(ctx->ins, "upstream connection error");
             return -1;
@@ -876,7 +877,8 @@ static inline int extract_meta(struct flb_kube *ctx,
 
 /*
  * Given a fixed meta data (namespace and podname), get API server information
- * and merge buffers.
+ * and merge buffers. When the pods are watched, the information comes from
+ * the node snapshot and the API server is never queried from here.
  */
 static int get_and_merge_meta(struct flb_kube *ctx, struct flb_kube_meta *meta,
                               char **out_buf, size_t *out_size)
@@ -885,9 +887,17 @@ static int get_and_merge_meta(struct flb_kube *ctx, struct flb_kube_meta *meta,
     char *api_buf;
     size_t api_size;
 
-    ret = get_api_server_info(ctx,
-                              meta->namespace, meta->podname,
-                              &api_buf, &api_size);
+    if (ctx->watch) {
+        ret = flb_kube_watch_pod_get(ctx->watch,
+                                     meta->namespace, meta->namespace_len,
+                                     meta->podname, meta->podname_len,
+                                     &api_buf, &api_size);
+    }
+    else {
+        ret = get_api_server_info(ctx, ctx->upstream,
+                                  meta->namespace, meta->podname,
+                                  &api_buf, &api_size);
+    }
     if (ret == -1) {
         return -1;
     }
@@ -929,42 +939,62 @@ static int wait_for_dns(struct flb_kube *ctx)
     return -1;
 }
 
-static int flb_kube_network_init(struct flb_kube *ctx, struct flb_config *config)
+/*
+ * Create a synchronous upstream to the API server. Every thread talking to
+ * the API server gets its own upstream and TLS context, the caller owns
+ * both and must destroy the TLS context even if this call fails.
+ */
+struct flb_upstream *flb_kube_upstream_create(struct flb_kube *ctx,
+                                              struct flb_tls *tls)
 {
     int io_type = FLB_IO_TCP;
+    struct flb_upstream *u;
+
+    if (ctx->api_https == FLB_TRUE) {
+        tls->context = flb_tls_context_new(ctx->tls_verify,
+                                           ctx->tls_debug,
+                                           ctx->tls_vhost,
+                                           ctx->tls_ca_path,
+                                           ctx->tls_ca_file,
+                                           NULL, NULL, NULL);
+        if (!tls->context) {
+            return NULL;
+        }
+        io_type = FLB_IO_TLS;
+    }
+
+    /* Create an Upstream context */
+    u = flb_upstream_create(ctx->config,
+                            ctx->api_host,
+                            ctx->api_port,
+                            io_type,
+                            tls);
+    if (!u) {
+        return NULL;
+    }
+
+    /* Remove async flag from upstream */
+    u->flags &= ~(FLB_IO_ASYNC);
+
+    return u;
+}
 
+static int flb_kube_network_init(struct flb_kube *ctx, struct flb_config *config)
+{
     ctx->upstream = NULL;
 
     if (ctx->api_https == FLB_TRUE) {
         if (!ctx->tls_ca_path && !ctx->tls_ca_file) {
             ctx->tls_ca_file  = flb_strdup(FLB_KUBE_CA);
         }
-        ctx->tls.context = flb_tls_context_new(ctx->tls_verify,
-                                               ctx->tls_debug,
-                                               ctx->tls_vhost,
-                                               ctx->tls_ca_path,
-                                               ctx->tls_ca_file,
-                                               NULL, NULL, NULL);
-        if (!ctx->tls.context) {
-            return -1;
-        }
-        io_type = FLB_IO_TLS;
     }
 
-    /* Create an Upstream context */
-    ctx->upstream = flb_upstream_create(config,
-                                        ctx->api_host,
-                                        ctx->api_port,
-                                        io_type,
-                                        &ctx->tls);
+    /* note: if ctx->tls.context is set, it's destroyed upon context exit */
+    ctx->upstream = flb_kube_upstream_create(ctx, &ctx->tls);
     if (!ctx->upstream) {
-        /* note: if ctx->tls.context is set, it's destroyed upon context exit */
         return -1;
     }
 
-    /* Remove async flag from upstream */
-    ctx->upstream->flags &= ~(FLB_IO_ASYNC);
-
     return 0;
 }
 
@@ -997,7 +1027,8 @@ int flb_kube_meta_init(struct flb_kube *ctx, struct flb_config *config)
             return -1;
         }
 
-        ret = get_api_server_info(ctx, ctx->namespace, ctx->podname,
+        ret = get_api_server_info(ctx, ctx->upstream,
+                                  ctx->namespace, ctx->podname,
                                   &meta_buf, &meta_size);
         if (ret == -1) {
             if (!ctx->podname) {
@@ -1016,9 +1047,27 @@ int flb_kube_meta_init(struct flb_kube *ctx, struct flb_config *config)
         flb_plg_info(ctx->ins, "Fluent Bit not running in a POD");
     }
 
+    /* Start the background metadata workers */
+    if (ctx->meta_watch == FLB_TRUE && ctx->upstream) {
+        ctx->watch = flb_kube_watch_create(ctx);
+        if (!ctx->watch) {
+            flb_plg_error(ctx->ins, "could not start the metadata watcher");
+            return -1;
+        }
+        flb_plg_info(ctx->ins, "watching pods metadata in background");
+    }
+
     return 0;
 }
 
+/* Retrieve the packed API server information of a pod */
+int flb_kube_meta_api_get(struct flb_kube *ctx, struct flb_upstream *u,
+                          const char *namespace, const char *podname,
+                          char **out_buf, size_t *out_size)
+{
+    return get_api_server_info(ctx, u, namespace, podname, out_buf, out_size);
+}
+
 int flb_kube_dummy_meta_get(char **out_buf, size_t *out_size)
 {
     int len;
@@ -1073,6 +1122,11 @@ int flb_kube_meta_get(struct flb_kube *ctx,
         return -1;
     }
 
+    /* Drop the metadata of pods deleted or modified in the meantime */
+    if (ctx->watch) {
+        flb_kube_watch_invalidate(ctx->watch, ctx->hash_table);
+    }
+
     /* Check if we have some data associated to the cache key */
     ret = flb_hash_get(ctx->hash_table,
                        meta->cache_key, meta->cache_key_len,
@@ -24,6 +24,8 @@
 #include "kube_props.h"
 
 struct flb_kube;
+struct flb_tls;
+struct flb_upstream;
 
 struct flb_kube_meta {
     int fields;
@@ -65,5 +67,10 @@ int flb_kube_meta_get(struct flb_kube *ctx,
                       struct flb_kube_meta *meta,
                       struct flb_kube_props *props);
 int flb_kube_meta_release(struct flb_kube_meta *meta);
+int flb_kube_meta_api_get(struct flb_kube *ctx, struct flb_upstream *u,
+                          const char *namespace, const char *podname,
+                          char **out_buf, size_t *out_size);
+struct flb_upstream *flb_kube_upstream_create(struct flb_kube *ctx,
+                                              struct flb_tls *tls);
 
 #endif
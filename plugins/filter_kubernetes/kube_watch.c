@@ -0,0 +1,949 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_filter_plugin.h>
+#include <fluent-bit/flb_compat.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_hash.h>
+#include <fluent-bit/flb_io.h>
+#include <fluent-bit/flb_upstream.h>
+#include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_worker.h>
+
+#include <sys/socket.h>
+#include <msgpack.h>
+
+#include "kube_conf.h"
+#include "kube_meta.h"
+#include "kube_watch.h"
+
+/* Lookup a key in a msgpack map */
+static msgpack_object *map_get(msgpack_object *map, const char *key)
+{
+    int i;
+    int len;
+    msgpack_object *k;
+
+    if (!map || map->type != MSGPACK_OBJECT_MAP) {
+        return NULL;
+    }
+
+    len = strlen(key);
+    for (i = 0; i < map->via.map.size; i++) {
+        k = &map->via.map.ptr[i].key;
+        if (k->type == MSGPACK_OBJECT_STR && k->via.str.size == len &&
+            strncmp(k->via.str.ptr, key, len) == 0) {
+            return &map->via.map.ptr[i].val;
+        }
+    }
+
+    return NULL;
+}
+
+static flb_sds_t str_get(msgpack_object *map, const char *key)
+{
+    msgpack_object *o;
+
+    o = map_get(map, key);
+    if (!o || o->type != MSGPACK_OBJECT_STR) {
+        return NULL;
+    }
+    return flb_sds_create_len(o->via.str.ptr, o->via.str.size);
+}
+
+/* Compose the 'namespace:podname' key of a pod object */
+static flb_sds_t pod_key(msgpack_object *pod)
+{
+    msgpack_object *meta;
+    msgpack_object *ns;
+    msgpack_object *name;
+    flb_sds_t key;
+
+    meta = map_get(pod, "metadata");
+    ns = map_get(meta, "namespace");
+    name = map_get(meta, "name");
+    if (!ns || !name ||
+        ns->type != MSGPACK_OBJECT_STR || name->type != MSGPACK_OBJECT_STR) {
+        return NULL;
+    }
+
+    key = flb_sds_create_size(ns->via.str.size + name->via.str.size + 1);
+    if (!key) {
+        return NULL;
+    }
+    flb_sds_printf(&key, "%.*s:%.*s",
+                   (int) ns->via.str.size, ns->via.str.ptr,
+                   (int) name->via.str.size, name->via.str.ptr);
+    return key;
+}
+
+static int key_list_add(struct mk_list *list, const char *key, int len)
+{
+    struct mk_list *head;
+    struct flb_kube_watch_key *k;
+
+    mk_list_foreach(head, list) {
+        k = mk_list_entry(head, struct flb_kube_watch_key, _head);
+        if (flb_sds_len(k->key) == len && strncmp(k->key, key, len) == 0) {
+            return 0;
+        }
+    }
+
+    k = flb_malloc(sizeof(struct flb_kube_watch_key));
+    if (!k) {
+        flb_errno();
+        return -1;
+    }
+    k->key = flb_sds_create_len(key, len);
+    if (!k->key) {
+        flb_free(k);
+        return -1;
+    }
+    mk_list_add(&k->_head, list);
+    return 0;
+}
+
+static void key_list_destroy(struct mk_list *list)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_kube_watch_key *k;
+
+    mk_list_foreach_safe(head, tmp, list) {
+        k = mk_list_entry(head, struct flb_kube_watch_key, _head);
+        mk_list_del(&k->_head);
+        flb_sds_destroy(k->key);
+        flb_free(k);
+    }
+}
+
+/* Store a pod in the snapshot, the caller holds the mutex */
+static void snapshot_put(struct flb_kube_watch *w, msgpack_object *pod)
+{
+    int ret;
+    const char *old_buf;
+    size_t old_size;
+    flb_sds_t key;
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+
+    key = pod_key(pod);
+    if (!key) {
+        return;
+    }
+
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+    msgpack_pack_object(&pck, *pod);
+
+    ret = flb_hash_get(w->pods, key, flb_sds_len(key), &old_buf, &old_size);
+    if (ret >= 0) {
+        if (old_size == sbuf.size && memcmp(old_buf, sbuf.data, sbuf.size) == 0) {
+            msgpack_sbuffer_destroy(&sbuf);
+            flb_sds_destroy(key);
+            return;
+        }
+        /* metadata built from the previous version is stale */
+        key_list_add(&w->invalid, key, flb_sds_len(key));
+    }
+
+    flb_hash_add(w->pods, key, flb_sds_len(key), sbuf.data, sbuf.size);
+    flb_hash_del(w->misses, key);
+    msgpack_sbuffer_destroy(&sbuf);
+    flb_sds_destroy(key);
+}
+
+/* Remove a pod from the snapshot, the caller holds the mutex */
+static void snapshot_del(struct flb_kube_watch *w, const char *key)
+{
+    if (flb_hash_del(w->pods, key) == 0) {
+        key_list_add(&w->invalid, key, strlen(key));
+    }
+}
+
+/* GET an API server end point, the JSON response is packed to msgpack */
+static int api_get(struct flb_kube_watch *w, const char *uri,
+                   char **out_buf, size_t *out_size)
+{
+    int ret;
+    int root_type;
+    size_t b_sent;
+    struct flb_kube *ctx = w->ctx;
+    struct flb_http_client *c;
+    struct flb_upstream_conn *u_conn;
+
+    u_conn = flb_upstream_conn_get(w->u_watch);
+    if (!u_conn) {
+        flb_plg_error(ctx->ins, "[watch] upstream connection error");
+        return -1;
+    }
+
+    c = flb_http_client(u_conn, FLB_HTTP_GET, uri, NULL, 0, NULL, 0, NULL, 0);
+    if (!c) {
+        flb_upstream_conn_release(u_conn);
+        return -1;
+    }
+
+    /* a pod list has no practical size limit */
+    flb_http_buffer_size(c, 0);
+    flb_http_add_header(c, "User-Agent", 10, "Fluent-Bit", 10);
+    if (ctx->auth_len > 0) {
+        flb_http_add_header(c, "Authorization", 13, ctx->auth, ctx->auth_len);
+    }
+
+    ret = flb_http_do(c, &b_sent);
+    if (ret != 0 || c->resp.status != 200) {
+        flb_plg_warn(ctx->ins, "[watch] GET %s failed, HTTP status=%i",
+                     uri, c->resp.status);
+        flb_http_client_destroy(c);
+        flb_upstream_conn_release(u_conn);
+        return -1;
+    }
+
+    ret = flb_pack_json(c->resp.payload, c->resp.payload_size,
+                        out_buf, out_size, &root_type);
+    flb_http_client_destroy(c);
+    flb_upstream_conn_release(u_conn);
+
+    return ret;
+}
+
+/* Lookup the node name where the local pod runs */
+static flb_sds_t local_node_name(struct flb_kube_watch *w)
+{
+    int ret;
+    size_t off = 0;
+    char *buf;
+    size_t size;
+    flb_sds_t name = NULL;
+    msgpack_unpacked result;
+    struct flb_kube *ctx = w->ctx;
+
+    if (!ctx->namespace || !ctx->podname) {
+        return NULL;
+    }
+
+    ret = flb_kube_meta_api_get(ctx, w->u_watch,
+                                ctx->namespace, ctx->podname, &buf, &size);
+    if (ret == -1) {
+        return NULL;
+    }
+
+    msgpack_unpacked_init(&result);
+    if (msgpack_unpack_next(&result, buf, size, &off) ==
+        MSGPACK_UNPACK_SUCCESS) {
+        name = str_get(map_get(&result.data, "spec"), "nodeName");
+    }
+    msgpack_unpacked_destroy(&result);
+    flb_free(buf);
+
+    return name;
+}
+
+/* Replace the snapshot with the pods currently scheduled on the node */
+static int pods_list(struct flb_kube_watch *w)
+{
+    int i;
+    int ret;
+    size_t off = 0;
+    char *buf;
+    size_t size;
+    flb_sds_t key;
+    flb_sds_t uri;
+    flb_sds_t version;
+    struct mk_list keys;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct mk_list *k_head;
+    struct flb_hash_entry *entry;
+    struct flb_kube_watch_key *k;
+    msgpack_unpacked result;
+    msgpack_object *items;
+
+    uri = flb_sds_create_size(256);
+    if (!uri) {
+        return -1;
+    }
+    flb_sds_printf(&uri, FLB_KUBE_API_PODS_FMT, w->node_name);
+    ret = api_get(w, uri, &buf, &size);
+    flb_sds_destroy(uri);
+    if (ret == -1) {
+        return -1;
+    }
+
+    msgpack_unpacked_init(&result);
+    ret = msgpack_unpack_next(&result, buf, size, &off);
+    if (ret != MSGPACK_UNPACK_SUCCESS) {
+        msgpack_unpacked_destroy(&result);
+        flb_free(buf);
+        return -1;
+    }
+
+    items = map_get(&result.data, "items");
+    version = str_get(map_get(&result.data, "metadata"), "resourceVersion");
+    if (!version) {
+        msgpack_unpacked_destroy(&result);
+        flb_free(buf);
+        return -1;
+    }
+
+    mk_list_init(&keys);
+
+    pthread_mutex_lock(&w->mutex);
+    if (items && items->type == MSGPACK_OBJECT_ARRAY) {
+        for (i = 0; i < items->via.array.size; i++) {
+            snapshot_put(w, &items->via.array.ptr[i]);
+            key = pod_key(&items->via.array.ptr[i]);
+            if (key) {
+                key_list_add(&keys, key, flb_sds_len(key));
+                flb_sds_destroy(key);
+            }
+        }
+    }
+
+    /* pods missed while not watching: only keep the listed ones */
+    mk_list_foreach_safe(head, tmp, &w->pods->entries) {
+        entry = mk_list_entry(head, struct flb_hash_entry, _head_parent);
+        ret = FLB_FALSE;
+        mk_list_foreach(k_head, &keys) {
+            k = mk_list_entry(k_head, struct flb_kube_watch_key, _head);
+            if (strcmp(k->key, entry->key) == 0) {
+                ret = FLB_TRUE;
+                break;
+            }
+        }
+        if (ret == FLB_FALSE) {
+            key_list_add(&w->invalid, entry->key, entry->key_len);
+            flb_hash_del(w->pods, entry->key);
+        }
+    }
+
+    if (w->resource_version) {
+        flb_sds_destroy(w->resource_version);
+    }
+    w->resource_version = version;
+    w->synced = FLB_TRUE;
+    pthread_cond_broadcast(&w->cond_update);
+    pthread_mutex_unlock(&w->mutex);
+
+    flb_plg_info(w->ctx->ins, "[watch] node %s: %i pods listed",
+                 w->node_name, mk_list_size(&keys));
+
+    key_list_destroy(&keys);
+    msgpack_unpacked_destroy(&result);
+    flb_free(buf);
+
+    return 0;
+}
+
+/*
+ * Process one watch event: {"type": "ADDED", "object": {...}}. Returns -1
+ * when the watch must be restarted from a new list.
+ */
+static int watch_event(struct flb_kube_watch *w, const char *json, size_t len)
+{
+    int ret;
+    int root_type;
+    size_t off = 0;
+    char *buf;
+    size_t size;
+    flb_sds_t key;
+    flb_sds_t type;
+    flb_sds_t version;
+    msgpack_unpacked result;
+    msgpack_object *object;
+
+    ret = flb_pack_json(json, len, &buf, &size, &root_type);
+    if (ret != 0) {
+        return 0;
+    }
+
+    msgpack_unpacked_init(&result);
+    if (msgpack_unpack_next(&result, buf, size, &off) !=
+        MSGPACK_UNPACK_SUCCESS) {
+        msgpack_unpacked_destroy(&result);
+        flb_free(buf);
+        return 0;
+    }
+
+    ret = 0;
+    type = str_get(&result.data, "type");
+    object = map_get(&result.data, "object");
+
+    if (!type || !object) {
+        ret = 0;
+    }
+    else if (strcmp(type, "ERROR") == 0) {
+        /* usually '410 Gone': the resource version is too old */
+        flb_plg_debug(w->ctx->ins, "[watch] error event, listing pods again");
+        ret = -1;
+    }
+    else {
+        version = str_get(map_get(object, "metadata"), "resourceVersion");
+
+        pthread_mutex_lock(&w->mutex);
+        if (strcmp(type, "ADDED") == 0 || strcmp(type, "MODIFIED") == 0) {
+            snapshot_put(w, object);
+        }
+        else if (strcmp(type, "DELETED") == 0) {
+            key = pod_key(object);
+            if (key) {
+                snapshot_del(w, key);
+                flb_sds_destroy(key);
+            }
+        }
+        if (version) {
+            if (w->resource_version) {
+                flb_sds_destroy(w->resource_version);
+            }
+            w->resource_version = version;
+        }
+        w->events++;
+        pthread_cond_broadcast(&w->cond_update);
+        pthread_mutex_unlock(&w->mutex);
+    }
+
+    if (type) {
+        flb_sds_destroy(type);
+    }
+    msgpack_unpacked_destroy(&result);
+    flb_free(buf);
+
+    return ret;
+}
+
+static inline void sds_shift(flb_sds_t s, size_t bytes)
+{
+    size_t len = flb_sds_len(s);
+
+    memmove(s, s + bytes, len - bytes);
+    flb_sds_len_set(s, len - bytes);
+    s[len - bytes] = '\0';
+}
+
+/*
+ * Run one watch request. The response is a stream of JSON events (one per
+ * line, usually chunked) that lasts until the server side timeout, events
+ * are applied to the snapshot as they arrive. Returns -1 if the pods must
+ * be listed again.
+ */
+static int watch_stream(struct flb_kube_watch *w)
+{
+    int ret = 0;
+    int status;
+    int done = FLB_FALSE;
+    int chunked = FLB_FALSE;
+    int headers = FLB_FALSE;
+    long chunk;
+    ssize_t n;
+    size_t b_sent;
+    size_t need;
+    char *p;
+    char tmp[4096];
+    flb_sds_t req;
+    flb_sds_t raw;
+    flb_sds_t lines;
+    flb_sds_t out;
+    struct flb_kube *ctx = w->ctx;
+    struct flb_upstream_conn *u_conn;
+
+    u_conn = flb_upstream_conn_get(w->u_watch);
+    if (!u_conn) {
+        flb_plg_error(ctx->ins, "[watch] upstream connection error");
+        return -1;
+    }
+
+    req = flb_sds_create_size(1024);
+    raw = flb_sds_create_size(sizeof(tmp));
+    lines = flb_sds_create_size(sizeof(tmp));
+    if (!req || !raw || !lines) {
+        ret = -1;
+        goto exit;
+    }
+
+    pthread_mutex_lock(&w->mutex);
+    flb_sds_printf(&req, "GET " FLB_KUBE_API_WATCH_FMT " HTTP/1.1\r\n",
+                   w->node_name, w->resource_version, ctx->meta_watch_timeout);
+    pthread_mutex_unlock(&w->mutex);
+    flb_sds_printf(&req, "Host: %s:%i\r\nUser-Agent: Fluent-Bit\r\n",
+                   ctx->api_host, ctx->api_port);
+    if (ctx->auth_len > 0) {
+        flb_sds_printf(&req, "Authorization: %s\r\n", ctx->auth);
+    }
+    out = flb_sds_cat(req, "Connection: close\r\n\r\n", 21);
+    if (!out) {
+        ret = -1;
+        goto exit;
+    }
+    req = out;
+
+    ret = flb_io_net_write(u_conn, req, flb_sds_len(req), &b_sent);
+    if (ret == -1) {
+        goto exit;
+    }
+    ret = 0;
+
+    /* let flb_kube_watch_destroy() interrupt the blocking read */
+    pthread_mutex_lock(&w->mutex);
+    w->conn_fd = u_conn->fd;
+    pthread_mutex_unlock(&w->mutex);
+
+    while (w->running == FLB_TRUE) {
+        n = flb_io_net_read(u_conn, tmp, sizeof(tmp));
+        if (n <= 0) {
+            /* end of the watch window */
+            break;
+        }
+
+        out = flb_sds_cat(raw, tmp, n);
+        if (!out) {
+            ret = -1;
+            break;
+        }
+        raw = out;
+
+        if (headers == FLB_FALSE) {
+            p = strstr(raw, "\r\n\r\n");
+            if (!p) {
+                continue;
+            }
+            *p = '\0';
+            status = (flb_sds_len(raw) > 12) ? atoi(raw + 9) : 0;
+            if (status != 200) {
+                flb_plg_warn(ctx->ins, "[watch] HTTP status=%i", status);
+                ret = -1;
+                break;
+            }
+            if (strcasestr(raw, "Transfer-Encoding: chunked")) {
+                chunked = FLB_TRUE;
+            }
+            headers = FLB_TRUE;
+            sds_shift(raw, (p + 4) - raw);
+        }
+
+        /* collect the body in 'lines' */
+        if (chunked == FLB_TRUE) {
+            while ((p = strstr(raw, "\r\n")) != NULL) {
+                chunk = strtol(raw, NULL, 16);
+                if (chunk <= 0) {
+                    /* last chunk */
+                    done = FLB_TRUE;
+                    break;
+                }
+                need = (p - raw) + 2 + chunk + 2;
+                if (flb_sds_len(raw) < need) {
+                    break;
+                }
+                out = flb_sds_cat(lines, p + 2, chunk);
+                if (!out) {
+                    ret = -1;
+                    break;
+                }
+                lines = out;
+                sds_shift(raw, need);
+            }
+        }
+        else {
+            out = flb_sds_cat(lines, raw, flb_sds_len(raw));
+            if (!out) {
+                ret = -1;
+                break;
+            }
+            lines = out;
+            flb_sds_len_set(raw, 0);
+        }
+
+        /* process every complete event */
+        while (ret == 0 && (p = memchr(lines, '\n', flb_sds_len(lines)))) {
+            if (p > lines) {
+                ret = watch_event(w, lines, p - lines);
+            }
+            sds_shift(lines, (p + 1) - lines);
+        }
+        if (ret != 0 || done == FLB_TRUE) {
+            break;
+        }
+    }
+
+exit:
+    pthread_mutex_lock(&w->mutex);
+    w->conn_fd = -1;
+    pthread_mutex_unlock(&w->mutex);
+
+    flb_upstream_conn_release(u_conn);
+    if (req) {
+        flb_sds_destroy(req);
+    }
+    if (raw) {
+        flb_sds_destroy(raw);
+    }
+    if (lines) {
+        flb_sds_destroy(lines);
+    }
+
+    return ret;
+}
+
+/* Sleep up to 'secs' seconds, wake up if the watcher is stopped */
+static void watch_sleep(struct flb_kube_watch *w, int secs)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += secs;
+
+    pthread_mutex_lock(&w->mutex);
+    while (w->running == FLB_TRUE) {
+        if (pthread_cond_timedwait(&w->cond_request, &w->mutex, &ts) != 0) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&w->mutex);
+}
+
+static void watch_worker(void *data)
+{
+    int ret;
+    struct flb_kube_watch *w = data;
+
+    if (!w->node_name) {
+        w->node_name = local_node_name(w);
+    }
+    if (!w->node_name) {
+        flb_plg_warn(w->ctx->ins, "[watch] unknown node name, pods will be "
+                     "fetched on demand only");
+        return;
+    }
+
+    while (w->running == FLB_TRUE) {
+        if (w->synced == FLB_FALSE) {
+            ret = pods_list(w);
+            if (ret == -1) {
+                watch_sleep(w, FLB_KUBE_WATCH_RETRY);
+                continue;
+            }
+        }
+
+        ret = watch_stream(w);
+        if (ret == -1 && w->running == FLB_TRUE) {
+            w->synced = FLB_FALSE;
+            watch_sleep(w, 1);
+        }
+    }
+}
+
+/* Fetch the pods requested by the filter and missing in the snapshot */
+static void fetch_worker(void *data)
+{
+    int ret;
+    size_t off;
+    char *p;
+    char *buf;
+    size_t size;
+    msgpack_unpacked result;
+    struct flb_kube_watch_key *k;
+    struct flb_kube_watch *w = data;
+
+    pthread_mutex_lock(&w->mutex);
+    while (w->running == FLB_TRUE) {
+        if (mk_list_is_empty(&w->requests) == 0) {
+            pthread_cond_wait(&w->cond_request, &w->mutex);
+            continue;
+        }
+        k = mk_list_entry_first(&w->requests, struct flb_kube_watch_key, _head);
+        mk_list_del(&k->_head);
+        pthread_mutex_unlock(&w->mutex);
+
+        /* the key is 'namespace:podname' */
+        p = strchr(k->key, ':');
+        *p = '\0';
+        ret = flb_kube_meta_api_get(w->ctx, w->u_fetch,
+                                    k->key, p + 1, &buf, &size);
+        *p = ':';
+
+        pthread_mutex_lock(&w->mutex);
+        w->fetches++;
+        if (ret == 0) {
+            off = 0;
+            msgpack_unpacked_init(&result);
+            if (msgpack_unpack_next(&result, buf, size, &off) ==
+                MSGPACK_UNPACK_SUCCESS) {
+                snapshot_put(w, &result.data);
+            }
+            msgpack_unpacked_destroy(&result);
+            flb_free(buf);
+        }
+        pthread_cond_broadcast(&w->cond_update);
+
+        flb_sds_destroy(k->key);
+        flb_free(k);
+    }
+    pthread_mutex_unlock(&w->mutex);
+}
+
+struct flb_kube_watch *flb_kube_watch_create(struct flb_kube *ctx)
+{
+    int ret;
+    const char *env;
+    struct flb_kube_watch *w;
+
+    w = flb_calloc(1, sizeof(struct flb_kube_watch));
+    if (!w) {
+        flb_errno();
+        return NULL;
+    }
+    w->ctx = ctx;
+    w->conn_fd = -1;
+    w->running = FLB_TRUE;
+    mk_list_init(&w->requests);
+    mk_list_init(&w->invalid);
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->cond_update, NULL);
+    pthread_cond_init(&w->cond_request, NULL);
+
+    if (ctx->node_name) {
+        w->node_name = flb_sds_create(ctx->node_name);
+    }
+    else if ((env = getenv("NODE_NAME")) != NULL) {
+        w->node_name = flb_sds_create(env);
+    }
+
+    w->pods = flb_hash_create(FLB_HASH_EVICT_NONE, FLB_HASH_TABLE_SIZE, 0);
+    w->misses = flb_hash_create(FLB_HASH_EVICT_OLDER, FLB_HASH_TABLE_SIZE,
+                                FLB_KUBE_WATCH_MISS_MAX);
+    if (!w->pods || !w->misses) {
+        flb_kube_watch_destroy(w);
+        return NULL;
+    }
+
+    /*
+     * The filter upstream is only used from the filter context. Workers do
+     * not run an event loop to monitor idle connections, so they do not
+     * keep them alive.
+     */
+    w->u_watch = flb_kube_upstream_create(ctx, &w->tls_watch);
+    w->u_fetch = flb_kube_upstream_create(ctx, &w->tls_fetch);
+    if (!w->u_watch || !w->u_fetch) {
+        flb_kube_watch_destroy(w);
+        return NULL;
+    }
+    w->u_watch->net.keepalive = FLB_FALSE;
+    w->u_fetch->net.keepalive = FLB_FALSE;
+
+    ret = flb_worker_create(watch_worker, w, &w->tid_watch, ctx->config);
+    if (ret == -1) {
+        w->running = FLB_FALSE;
+        flb_kube_watch_destroy(w);
+        return NULL;
+    }
+
+    ret = flb_worker_create(fetch_worker, w, &w->tid_fetch, ctx->config);
+    if (ret == -1) {
+        w->tid_fetch = 0;
+        flb_kube_watch_destroy(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+void flb_kube_watch_destroy(struct flb_kube_watch *w)
+{
+    /* Stop the workers, a running watch is interrupted */
+    pthread_mutex_lock(&w->mutex);
+    w->running = FLB_FALSE;
+    if (w->conn_fd != -1) {
+        shutdown(w->conn_fd, SHUT_RDWR);
+    }
+    pthread_cond_broadcast(&w->cond_request);
+    pthread_cond_broadcast(&w->cond_update);
+    pthread_mutex_unlock(&w->mutex);
+
+    if (w->tid_watch) {
+        pthread_join(w->tid_watch, NULL);
+    }
+    if (w->tid_fetch) {
+        pthread_join(w->tid_fetch, NULL);
+    }
+
+    key_list_destroy(&w->requests);
+    key_list_destroy(&w->invalid);
+    if (w->pods) {
+        flb_hash_destroy(w->pods);
+    }
+    if (w->misses) {
+        flb_hash_destroy(w->misses);
+    }
+    if (w->u_watch) {
+        flb_upstream_destroy(w->u_watch);
+    }
+    if (w->u_fetch) {
+        flb_upstream_destroy(w->u_fetch);
+    }
+#ifdef FLB_HAVE_TLS
+    if (w->tls_watch.context) {
+        flb_tls_context_destroy(w->tls_watch.context);
+    }
+    if (w->tls_fetch.context) {
+        flb_tls_context_destroy(w->tls_fetch.context);
+    }
+#endif
+    if (w->node_name) {
+        flb_sds_destroy(w->node_name);
+    }
+    if (w->resource_version) {
+        flb_sds_destroy(w->resource_version);
+    }
+
+    pthread_cond_destroy(&w->cond_update);
+    pthread_cond_destroy(&w->cond_request);
+    pthread_mutex_destroy(&w->mutex);
+    flb_free(w);
+}
+
+/*
+ * Get a copy of a pod from the snapshot. On a miss the pod is requested to
+ * the fetcher and the caller waits up to 'kube_meta_miss_wait' milliseconds,
+ * then it gives up: the record goes on without metadata. A pod given up is
+ * not waited for again (nor requested) for FLB_KUBE_WATCH_MISS_TTL seconds,
+ * so the records of an unknown pod do not wait one after the other.
+ */
+int flb_kube_watch_pod_get(struct flb_kube_watch *w,
+                           const char *namespace, int namespace_len,
+                           const char *podname, int podname_len,
+                           char **out_buf, size_t *out_size)
+{
+    int ret;
+    int requested = FLB_FALSE;
+    char key[512];
+    int key_len;
+    const char *buf;
+    size_t size;
+    time_t now;
+    time_t expire;
+    struct timespec ts;
+
+    key_len = snprintf(key, sizeof(key), "%.*s:%.*s",
+                       namespace_len, namespace, podname_len, podname);
+    if (key_len <= 0 || key_len >= sizeof(key)) {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = ts.tv_sec;
+    ts.tv_sec += w->ctx->meta_miss_wait / 1000;
+    ts.tv_nsec += (w->ctx->meta_miss_wait % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&w->mutex);
+    while (1) {
+        ret = flb_hash_get(w->pods, key, key_len, &buf, &size);
+        if (ret >= 0) {
+            *out_buf = flb_malloc(size);
+            if (!*out_buf) {
+                flb_errno();
+                ret = -1;
+                break;
+            }
+            memcpy(*out_buf, buf, size);
+            *out_size = size;
+            ret = 0;
+            break;
+        }
+
+        if (requested == FLB_FALSE) {
+            ret = flb_hash_get(w->misses, key, key_len, &buf, &size);
+            if (ret >= 0 && size == sizeof(time_t)) {
+                memcpy(&expire, buf, sizeof(time_t));
+                if (now < expire) {
+                    ret = -1;
+                    break;
+                }
+                flb_hash_del(w->misses, key);
+            }
+
+            key_list_add(&w->requests, key, key_len);
+            pthread_cond_broadcast(&w->cond_request);
+            requested = FLB_TRUE;
+        }
+
+        if (w->ctx->meta_miss_wait <= 0 || w->running == FLB_FALSE ||
+            pthread_cond_timedwait(&w->cond_update, &w->mutex, &ts) != 0) {
+            /* a late fetch still lands in the snapshot and clears this */
+            expire = now + FLB_KUBE_WATCH_MISS_TTL;
+            flb_hash_add(w->misses, key, key_len,
+                         (const char *) &expire, sizeof(time_t));
+            ret = -1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&w->mutex);
+
+    return ret;
+}
+
+/*
+ * Drop the cached metadata of the pods deleted or modified since the last
+ * call, cache keys are 'namespace:podname[:container]'. It runs in the
+ * filter context, the only one that access the metadata cache.
+ */
+void flb_kube_watch_invalidate(struct flb_kube_watch *w, struct flb_hash *ht)
+{
+    int len;
+    struct mk_list list;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct mk_list *e_tmp;
+    struct mk_list *e_head;
+    struct flb_hash_entry *entry;
+    struct flb_kube_watch_key *k;
+
+    pthread_mutex_lock(&w->mutex);
+    if (mk_list_is_empty(&w->invalid) == 0) {
+        pthread_mutex_unlock(&w->mutex);
+        return;
+    }
+    mk_list_init(&list);
+    mk_list_foreach_safe(head, tmp, &w->invalid) {
+        mk_list_del(head);
+        mk_list_add(head, &list);
+    }
+    pthread_mutex_unlock(&w->mutex);
+
+    mk_list_foreach_safe(head, tmp, &list) {
+        k = mk_list_entry(head, struct flb_kube_watch_key, _head);
+        len = flb_sds_len(k->key);
+
+        mk_list_foreach_safe(e_head, e_tmp, &ht->entries) {
+            entry = mk_list_entry(e_head, struct flb_hash_entry, _head_parent);
+            if (entry->key_len >= len &&
+                strncmp(entry->key, k->key, len) == 0 &&
+                (entry->key[len] == ':' || entry->key[len] == '\0')) {
+                flb_hash_del(ht, entry->key);
+            }
+        }
+    }
+    key_list_destroy(&list);
+}
@@ -0,0 +1,98 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_FILTER_KUBE_WATCH_H
+#define FLB_FILTER_KUBE_WATCH_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_hash.h>
+#include <fluent-bit/flb_io_tls.h>
+#include <fluent-bit/flb_upstream.h>
+
+#include <pthread.h>
+
+/* API end points used by the watcher */
+#define FLB_KUBE_API_PODS_FMT   "/api/v1/pods?fieldSelector=spec.nodeName%%3D%s"
+#define FLB_KUBE_API_WATCH_FMT  FLB_KUBE_API_PODS_FMT                     \
+    "&watch=1&allowWatchBookmarks=true&resourceVersion=%s&timeoutSeconds=%i"
+
+/* Seconds to wait before listing pods again after an API server error */
+#define FLB_KUBE_WATCH_RETRY    5
+
+/* Seconds a pod that could not be fetched is not waited for again */
+#define FLB_KUBE_WATCH_MISS_TTL 5
+#define FLB_KUBE_WATCH_MISS_MAX 1024
+
+struct flb_kube;
+
+/* A pod requested by the filter, or a pod whose cache must be dropped */
+struct flb_kube_watch_key {
+    flb_sds_t key;                 /* namespace:podname */
+    struct mk_list _head;
+};
+
+/*
+ * Node metadata snapshot: a background thread lists and watches the pods
+ * scheduled on this node and keeps them packed in msgpack, a second thread
+ * fetches the pods the filter could not find in the snapshot. The filter
+ * never waits for the API server, only (optionally) for the snapshot.
+ */
+struct flb_kube_watch {
+    int running;
+    int synced;                    /* initial pod list loaded ?      */
+    int conn_fd;                   /* socket of the active watch     */
+    flb_sds_t node_name;
+    flb_sds_t resource_version;
+
+    pthread_t tid_watch;
+    pthread_t tid_fetch;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_update;    /* the snapshot changed           */
+    pthread_cond_t cond_request;   /* the filter requested a pod     */
+
+    struct flb_hash *pods;         /* namespace:podname -> pod       */
+    struct mk_list requests;       /* pods to fetch                  */
+    struct mk_list invalid;        /* pods to drop from the cache    */
+    struct flb_hash *misses;       /* namespace:podname -> expire    */
+
+    /* each worker owns its connections to the API server */
+    struct flb_tls tls_watch;
+    struct flb_tls tls_fetch;
+    struct flb_upstream *u_watch;  /* pods list and watch            */
+    struct flb_upstream *u_fetch;  /* pods requested by the filter   */
+
+    /* counters */
+    uint64_t events;
+    uint64_t fetches;
+
+    struct flb_kube *ctx;
+};
+
+struct flb_kube_watch *flb_kube_watch_create(struct flb_kube *ctx);
+void flb_kube_watch_destroy(struct flb_kube_watch *w);
+
+int flb_kube_watch_pod_get(struct flb_kube_watch *w,
+                           const char *namespace, int namespace_len,
+                           const char *podname, int podname_len,
+                           char **out_buf, size_t *out_size);
+void flb_kube_watch_invalidate(struct flb_kube_watch *w, struct flb_hash *ht);
+
+#endif
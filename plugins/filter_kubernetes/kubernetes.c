@@ -201,6 +201,115 @@ static int cb_kube_init(struct flb_filter_instance *f_ins,
     return 0;
 }
 
+/* Size of a packed record timestamp: EventTime, integer or float */
+static size_t record_time_size(const unsigned char *p, size_t size)
+{
+    size_t len;
+
+    if (*p <= 0x7f) {
+        len = 1;
+    }
+    else {
+        switch (*p) {
+        case 0xcc: case 0xd0:
+            len = 2;
+            break;
+        case 0xcd: case 0xd1:
+            len = 3;
+            break;
+        case 0xca: case 0xce: case 0xd2:
+            len = 5;
+            break;
+        case 0xcb: case 0xcf: case 0xd3:
+            len = 9;
+            break;
+        case 0xd7: /* fixext 8 */
+            len = 10;
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    if (len > size) {
+        return 0;
+    }
+    return len;
+}
+
+/*
+ * Append a record plus the cached 'kubernetes' map without re-encoding
+ * the map entries: they are copied as they are and only the map header is
+ * rewritten with the new number of entries. The timestamp is packed again
+ * from 'tm' so integer and float timestamps are normalized to EventTime,
+ * the same output pack_map_content() produces. The record buffer must be
+ * a packed [timestamp, map] array, otherwise -1 is returned and nothing
+ * is written.
+ */
+static int splice_map_content(msgpack_packer *pck, msgpack_sbuffer *sbuf,
+                              const char *rec_buf, size_t rec_size,
+                              struct flb_time *tm,
+                              const char *kube_buf, size_t kube_size)
+{
+    size_t off;
+    size_t len;
+    uint32_t map_size;
+    const unsigned char *p = (const unsigned char *) rec_buf;
+
+    /* fixarray of 2 entries */
+    if (rec_size < 3 || p[0] != 0x92) {
+        return -1;
+    }
+    off = 1;
+
+    len = record_time_size(p + off, rec_size - off);
+    if (len == 0 || off + len >= rec_size) {
+        return -1;
+    }
+    off += len;
+
+    /* map header */
+    if ((p[off] & 0xf0) == 0x80) {
+        map_size = p[off] & 0x0f;
+        len = 1;
+    }
+    else if (p[off] == 0xde && off + 3 <= rec_size) {
+        map_size = ((uint32_t) p[off + 1] << 8) | p[off + 2];
+        len = 3;
+    }
+    else if (p[off] == 0xdf && off + 5 <= rec_size) {
+        map_size = ((uint32_t) p[off + 1] << 24) |
+            ((uint32_t) p[off + 2] << 16) |
+            ((uint32_t) p[off + 3] << 8) | p[off + 4];
+        len = 5;
+    }
+    else {
+        return -1;
+    }
+
+    /* array header and timestamp */
+    msgpack_pack_array(pck, 2);
+    flb_time_append_to_msgpack(tm, pck, 0);
+
+    if (kube_buf && kube_size > 0) {
+        map_size++;
+    }
+    msgpack_pack_map(pck, map_size);
+
+    /* original entries */
+    off += len;
+    msgpack_sbuffer_write(sbuf, rec_buf + off, rec_size - off);
+
+    /* Kubernetes */
+    if (kube_buf && kube_size > 0) {
+        msgpack_pack_str(pck, 10);
+        msgpack_pack_str_body(pck, "kubernetes", 10);
+        msgpack_sbuffer_write(sbuf, kube_buf, kube_size);
+    }
+
+    return 0;
+}
+
 static int pack_map_content(msgpack_packer *pck, msgpack_sbuffer *sbuf,
                             msgpack_object source_map,
                             const char *kube_buf, size_t kube_size,
@@ -413,12 +522,7 @@ static int pack_map_content(msgpack_packer *pck, msgpack_sbuffer *sbuf,
     if (kube_buf && kube_size > 0) {
         msgpack_pack_str(pck, 10);
         msgpack_pack_str_body(pck, "kubernetes", 10);
-
-        off = 0;
-        msgpack_unpacked_init(&result);
-        msgpack_unpack_next(&result, kube_buf, kube_size, &off);
-        msgpack_pack_object(pck, result.data);
-        msgpack_unpacked_destroy(&result);
+        msgpack_sbuffer_write(sbuf, kube_buf, kube_size);
     }
 
     return 0;
@@ -434,6 +538,9 @@ static int cb_kube_filter(const void *data, size_t bytes,
     int ret;
     size_t pre = 0;
     size_t off = 0;
+    size_t rec_off = 0;
+    size_t rec_size;
+    const char *rec_buf;
     char *dummy_cache_buf = NULL;
     const char *cache_buf = NULL;
     size_t cache_size = 0;
@@ -476,6 +583,9 @@ static int cb_kube_filter(const void *data, size_t bytes,
     msgpack_unpacked_init(&result);
     while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
         root = result.data;
+        rec_buf = (const char *) data + rec_off;
+        rec_size = off - rec_off;
+        rec_off = off;
 
         if (root.type != MSGPACK_OBJECT_ARRAY ||
             root.via.array.size != 2 ||
@@ -550,17 +660,29 @@ static int cb_kube_filter(const void *data, size_t bytes,
          */
         flb_time_pop_from_msgpack(&time_lookup, &result, &obj);
 
-        /* get records map */
-        map  = root.via.array.ptr[1];
+        /*
+         * If the log is not merged the record content does not change, the
+         * cached metadata is spliced into the original record bytes.
+         */
+        ret = -1;
+        if (ctx->merge_log == FLB_FALSE) {
+            ret = splice_map_content(&tmp_pck, &tmp_sbuf,
+                                     rec_buf, rec_size, &time_lookup,
+                                     cache_buf, cache_size);
+        }
 
-        /* Compose the new array (0=timestamp, 1=record) */
-        msgpack_pack_array(&tmp_pck, 2);
+        if (ret == -1) {
+            /* get records map */
+            map  = root.via.array.ptr[1];
 
+            /* Compose the new array (0=timestamp, 1=record) */
+            msgpack_pack_array(&tmp_pck, 2);
 
-        ret = pack_map_content(&tmp_pck, &tmp_sbuf,
-                               map,
-                               cache_buf, cache_size,
-                               &meta, &time_lookup, parser, ctx);
+            ret = pack_map_content(&tmp_pck, &tmp_sbuf,
+                                   map,
+                                   cache_buf, cache_size,
+                                   &meta, &time_lookup, parser, ctx);
+        }
         if (ret == -1) {
             msgpack_sbuffer_destroy(&tmp_sbuf);
             msgpack_unpacked_destroy(&result);
@@ -692,6 +814,37 @@ static struct flb_config_map config_map[] = {
      "set directory with metadata files"
     },
 
+    /*
+     * Watch the pods of the node in background threads: metadata is served
+     * from a local snapshot and the filter never waits for the API server.
+     */
+    {
+     FLB_CONFIG_MAP_BOOL, "kube_meta_watch", "false",
+     0, FLB_TRUE, offsetof(struct flb_kube, meta_watch),
+     "watch the pods of the node and serve metadata from a local snapshot"
+    },
+
+    {
+     FLB_CONFIG_MAP_TIME, "kube_meta_watch_timeout", "300",
+     0, FLB_TRUE, offsetof(struct flb_kube, meta_watch_timeout),
+     "duration of every watch request made to the API server"
+    },
+
+    /* On a snapshot miss, wait for the pod up to N milliseconds */
+    {
+     FLB_CONFIG_MAP_INT, "kube_meta_miss_wait", "0",
+     0, FLB_TRUE, offsetof(struct flb_kube, meta_miss_wait),
+     "milliseconds to hold records of an unknown pod, then they are "
+     "released without metadata"
+    },
+
+    /* Node to watch, defaults to $NODE_NAME or the node of the local pod */
+    {
+     FLB_CONFIG_MAP_STR, "kube_node_name", NULL,
+     0, FLB_TRUE, offsetof(struct flb_kube, node_name),
+     "name of the node whose pods are watched"
+    },
+
     /* Kubernetes TLS: CA file */
     {
      FLB_CONFIG_MAP_STR, "kube_ca_file", FLB_KUBE_CA,
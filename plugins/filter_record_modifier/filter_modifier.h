@@ -49,11 +49,5 @@ struct record_modifier_ctx {
     struct flb_filter_instance *ins;
 };
 
-typedef enum {
-    TO_BE_REMOVED = 0,
-    TO_BE_REMAINED = 1,
-    TAIL_OF_ARRAY = 2
-} bool_map_t;
-
 
 #endif /* FLB_FILTER_RECORD_MODIFIER_H */
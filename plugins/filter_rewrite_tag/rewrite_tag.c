@@ -26,6 +26,7 @@
 #include <fluent-bit/flb_regex.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_mp.h>
 #include <fluent-bit/flb_record_accessor.h>
 #include <msgpack.h>
 
@@ -107,6 +108,47 @@ static int emitter_create(struct flb_rewrite_tag *ctx)
     return 0;
 }
 
+/* Get the key context of a record accessor, rules on the same key share it */
+static struct rewrite_key *get_key(struct flb_rewrite_tag *ctx, char *field)
+{
+    struct mk_list *head;
+    struct rewrite_key *key;
+
+    mk_list_foreach(head, &ctx->keys) {
+        key = mk_list_entry(head, struct rewrite_key, _head);
+        if (strcmp(key->field, field) == 0) {
+            return key;
+        }
+    }
+
+    key = flb_calloc(1, sizeof(struct rewrite_key));
+    if (!key) {
+        flb_errno();
+        return NULL;
+    }
+
+    key->field = flb_sds_create(field);
+    key->ra = flb_ra_create(field, FLB_FALSE);
+    key->set = flb_regex_set_create();
+    if (!key->field || !key->ra || !key->set) {
+        flb_plg_error(ctx->ins, "invalid record accessor key ? '%s'", field);
+        if (key->field) {
+            flb_sds_destroy(key->field);
+        }
+        if (key->ra) {
+            flb_ra_destroy(key->ra);
+        }
+        if (key->set) {
+            flb_regex_set_destroy(key->set);
+        }
+        flb_free(key);
+        return NULL;
+    }
+    mk_list_add(&key->_head, &ctx->keys);
+
+    return key;
+}
+
 /*
  * Validate and prepare internal contexts based on the received
  * config_map values.
@@ -116,6 +158,7 @@ static int process_config(struct flb_rewrite_tag *ctx)
     struct mk_list *head;
     struct flb_slist_entry *entry;
     struct rewrite_rule *rule;
+    struct rewrite_key *key;
     struct flb_config_map_val *val;
 
     if (!ctx->cm_rules) {
@@ -139,10 +182,8 @@ static int process_config(struct flb_rewrite_tag *ctx)
 
         /* key */
         entry = flb_slist_entry_get(val->val.list, 0);
-        rule->ra_key = flb_ra_create(entry->str, FLB_FALSE);
-        if (!rule->ra_key) {
-            flb_plg_error(ctx->ins, "invalid record accessor key ? '%s'",
-                          entry->str);
+        rule->key = get_key(ctx, entry->str);
+        if (!rule->key) {
             flb_free(rule);
             return -1;
         }
@@ -153,7 +194,14 @@ static int process_config(struct flb_rewrite_tag *ctx)
         if (!rule->regex) {
             flb_plg_error(ctx->ins, "could not compile regex pattern '%s'",
                           entry->str);
-            flb_ra_destroy(rule->ra_key);
+            flb_free(rule);
+            return -1;
+        }
+
+        rule->pattern_id = flb_regex_set_add(rule->key->set, entry->str,
+                                             rule->regex);
+        if (rule->pattern_id == -1) {
+            flb_regex_destroy(rule->regex);
             flb_free(rule);
             return -1;
         }
@@ -164,7 +212,6 @@ static int process_config(struct flb_rewrite_tag *ctx)
 
         if (!rule->ra_tag) {
             flb_plg_error(ctx->ins, "could not compose tag: %s", entry->str);
-            flb_ra_destroy(rule->ra_key);
             flb_regex_destroy(rule->regex);
             flb_free(rule);
             return -1;
@@ -183,6 +230,14 @@ static int process_config(struct flb_rewrite_tag *ctx)
         return 0;
     }
 
+    /* Build the literal prefilter of every key */
+    mk_list_foreach(head, &ctx->keys) {
+        key = mk_list_entry(head, struct rewrite_key, _head);
+        if (flb_regex_set_compile(key->set) == -1) {
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -205,6 +260,7 @@ static int cb_rewrite_tag_init(struct flb_filter_instance *ins,
     ctx->ins = ins;
     ctx->config = config;
     mk_list_init(&ctx->rules);
+    mk_list_init(&ctx->keys);
 
     /*
      * Emitter name: every rewrite_tag instance needs an emitter input plugin,
@@ -285,24 +341,134 @@ static int cb_rewrite_tag_init(struct flb_filter_instance *ins,
     return 0;
 }
 
+/* Get the group of records of a new tag, create it if it does not exist */
+static struct rewrite_group *group_get(struct mk_list *groups,
+                                       struct rewrite_group **last,
+                                       flb_sds_t tag)
+{
+    struct mk_list *head;
+    struct rewrite_group *group;
+
+    /* consecutive records likely go to the same tag */
+    if (*last && flb_sds_cmp((*last)->tag, tag, flb_sds_len(tag)) == 0) {
+        return *last;
+    }
+
+    mk_list_foreach(head, groups) {
+        group = mk_list_entry(head, struct rewrite_group, _head);
+        if (flb_sds_cmp(group->tag, tag, flb_sds_len(tag)) == 0) {
+            *last = group;
+            return group;
+        }
+    }
+
+    group = flb_malloc(sizeof(struct rewrite_group));
+    if (!group) {
+        flb_errno();
+        return NULL;
+    }
+    group->tag = flb_sds_create_len(tag, flb_sds_len(tag));
+    if (!group->tag) {
+        flb_free(group);
+        return NULL;
+    }
+    group->records = 0;
+    group->emitted = FLB_FALSE;
+    msgpack_sbuffer_init(&group->mp_sbuf);
+    mk_list_add(&group->_head, groups);
+    *last = group;
+
+    return group;
+}
+
+/*
+ * Hand every group to the emitter as one block. It returns the number of
+ * records emitted, groups refused by the emitter are flagged so their
+ * records stay in the original chunk.
+ */
+static int groups_emit(struct mk_list *groups, struct flb_rewrite_tag *ctx)
+{
+    int ret;
+    int emitted = 0;
+    struct mk_list *head;
+    struct rewrite_group *group;
+
+    mk_list_foreach(head, groups) {
+        group = mk_list_entry(head, struct rewrite_group, _head);
+        ret = in_emitter_add_records(group->tag, flb_sds_len(group->tag),
+                                     group->mp_sbuf.data, group->mp_sbuf.size,
+                                     ctx->ins_emitter);
+        if (ret == -1) {
+            flb_plg_debug(ctx->ins, "%i records for tag '%s' keep the "
+                          "original tag", group->records, group->tag);
+            continue;
+        }
+        group->emitted = FLB_TRUE;
+        emitted += group->records;
+    }
+
+    return emitted;
+}
+
+static void groups_destroy(struct mk_list *groups)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct rewrite_group *group;
+
+    mk_list_foreach_safe(head, tmp, groups) {
+        group = mk_list_entry(head, struct rewrite_group, _head);
+        mk_list_del(&group->_head);
+        flb_sds_destroy(group->tag);
+        msgpack_sbuffer_destroy(&group->mp_sbuf);
+        flb_free(group);
+    }
+}
+
 /*
  * On given record, check if a rule applies or not to the map, if so, compose
- * the new tag, emit the record and return FLB_TRUE, otherwise just return
+ * the new tag into 'out_tag' and return FLB_TRUE, otherwise just return
  * FLB_FALSE and the original record will remain.
  */
 static int process_record(const char *tag, int tag_len, msgpack_object map,
-                          const void *buf, size_t buf_size, int *keep,
+                          int *keep, flb_sds_t *out_tag,
                           struct flb_rewrite_tag *ctx)
 {
     int ret;
-    flb_sds_t out_tag;
     struct mk_list *head;
     struct rewrite_rule *rule = NULL;
+    struct rewrite_key *key;
     struct flb_regex_search result = {0};
 
+    /* new record: key values must be looked up again */
+    ctx->records++;
+
     mk_list_foreach(head, &ctx->rules) {
         rule = mk_list_entry(head, struct rewrite_rule, _head);
-        ret = flb_ra_regex_match(rule->ra_key, map, rule->regex, &result);
+        key = rule->key;
+
+        /* lookup and scan the key value once per record */
+        if (key->record != ctx->records) {
+            key->record = ctx->records;
+            key->val = flb_ra_get_object(key->ra, map);
+            if (key->val && key->val->type != MSGPACK_OBJECT_STR) {
+                key->val = NULL;
+            }
+            if (key->val) {
+                flb_regex_set_scan(key->set, key->val->via.str.ptr,
+                                   key->val->via.str.size);
+            }
+        }
+
+        /* skip the regex if the value lacks a literal of the pattern */
+        if (!key->val ||
+            flb_regex_set_candidate(key->set, rule->pattern_id) == FLB_FALSE) {
+            rule = NULL;
+            continue;
+        }
+
+        ret = flb_regex_do(rule->regex, key->val->via.str.ptr,
+                           key->val->via.str.size, &result);
         if (ret < 0) { /* no match */
             rule = NULL;
             continue;
@@ -317,19 +483,13 @@ static int process_record(const char *tag, int tag_len, msgpack_object map,
     }
 
     /* Compose new tag */
-    out_tag = flb_ra_translate(rule->ra_tag, (char *) tag, tag_len, map, &result);
+    *out_tag = flb_ra_translate(rule->ra_tag, (char *) tag, tag_len, map,
+                                &result);
 
     /* Release any capture info from 'results' */
     flb_regex_results_release(&result);
 
-    /* Emit record with new tag */
-    ret = in_emitter_add_record(out_tag, flb_sds_len(out_tag), buf, buf_size,
-                                ctx->ins_emitter);
-
-    /* Release the tag */
-    flb_sds_destroy(out_tag);
-
-    if (ret == -1) {
+    if (!*out_tag) {
         return FLB_FALSE;
     }
 
@@ -344,67 +504,110 @@ static int cb_rewrite_tag_filter(const void *data, size_t bytes,
                                  void *filter_context,
                                  struct flb_config *config)
 {
+    int i;
     int ret;
     int keep;
-    int emitted = 0;
+    int count = 0;
+    int dropped = 0;
+    int emitted;
     size_t pre = 0;
     size_t off = 0;
     msgpack_sbuffer mp_sbuf;
-    msgpack_packer mp_pck;
     msgpack_object map;
     msgpack_object root;
     msgpack_unpacked result;
+    flb_sds_t out_tag;
+    struct mk_list groups;
+    struct rewrite_group *group;
+    struct rewrite_group *last = NULL;
+    struct rewrite_record *rec;
+    struct rewrite_record *recs;
     struct flb_rewrite_tag *ctx = (struct flb_rewrite_tag *) filter_context;
     (void) f_ins;
     (void) config;
 
-    /* Create temporal msgpack buffer */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+    recs = flb_malloc(sizeof(struct rewrite_record) * flb_mp_count(data, bytes));
+    if (!recs) {
+        flb_errno();
+        return FLB_FILTER_NOTOUCH;
+    }
+
+    /* Records to emit, grouped by new tag */
+    mk_list_init(&groups);
 
     msgpack_unpacked_init(&result);
     while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
         root = result.data;
         map = root.via.array.ptr[1];
 
+        rec = &recs[count++];
+        rec->off = pre;
+        rec->size = off - pre;
+        rec->keep = FLB_TRUE;
+        rec->group = NULL;
+        pre = off;
+
         /*
          * Process the record according the defined rules. If it returns FLB_TRUE means
-         * the record was emitter with a different tag.
+         * the record must be emitted with a different tag, it's added to the group
+         * of that tag.
          *
-         * If a record was emitted, the variable 'keep' will define if the record must
+         * If a record is emitted, the variable 'keep' will define if the record must
          * be preserved or not.
          */
-        ret = process_record(tag, tag_len, map, (char *) data + pre, off - pre, &keep, ctx);
-        if (ret == FLB_TRUE) {
-            /* A record with the new tag was emitted */
-            emitted++;
+        ret = process_record(tag, tag_len, map, &keep, &out_tag, ctx);
+        if (ret == FLB_FALSE) {
+            continue;
         }
 
-        /*
-         * Here we decide if the original record must be preserved or not:
-         *
-         * - record with new tag was emitted and the rule says it must be preserved
-         * - record was not emitted
-         */
-        if ((ret == FLB_TRUE && keep == FLB_TRUE) || ret == FLB_FALSE) {
-            msgpack_sbuffer_write(&mp_sbuf, (char *) data + pre, off - pre);
+        group = group_get(&groups, &last, out_tag);
+        flb_sds_destroy(out_tag);
+        if (!group) {
+            continue;
         }
-
-        /* Adjust previous offset */
-        pre = off;
+        msgpack_sbuffer_write(&group->mp_sbuf,
+                              (char *) data + rec->off, rec->size);
+        group->records++;
+        rec->group = group;
+        rec->keep = keep;
     }
     msgpack_unpacked_destroy(&result);
 
+    /* One append per new tag */
+    emitted = groups_emit(&groups, ctx);
     if (emitted == 0) {
-        msgpack_sbuffer_destroy(&mp_sbuf);
+        groups_destroy(&groups);
+        flb_free(recs);
         return FLB_FILTER_NOTOUCH;
     }
 #ifdef FLB_HAVE_METRICS
-    else if (emitted > 0) {
-        flb_metrics_sum(FLB_RTAG_METRIC_EMITTED, emitted, ctx->ins->metrics);
-    }
+    flb_metrics_sum(FLB_RTAG_METRIC_EMITTED, emitted, ctx->ins->metrics);
 #endif
 
+    /*
+     * Here we decide if the original record must be preserved or not:
+     *
+     * - record with new tag was emitted and the rule says it must be preserved
+     * - record was not emitted, or the emitter refused its group
+     */
+    msgpack_sbuffer_init(&mp_sbuf);
+    for (i = 0; i < count; i++) {
+        rec = &recs[i];
+        if (rec->keep == FLB_FALSE && rec->group->emitted == FLB_TRUE) {
+            dropped++;
+            continue;
+        }
+        msgpack_sbuffer_write(&mp_sbuf, (char *) data + rec->off, rec->size);
+    }
+    groups_destroy(&groups);
+    flb_free(recs);
+
+    /* every original record is kept */
+    if (dropped == 0) {
+        msgpack_sbuffer_destroy(&mp_sbuf);
+        return FLB_FILTER_NOTOUCH;
+    }
+
     *out_buf = mp_sbuf.data;
     *out_bytes = mp_sbuf.size;
 
@@ -417,15 +620,24 @@ static void destroy_rules(struct flb_rewrite_tag *ctx)
     struct mk_list *tmp;
     struct mk_list *head;
     struct rewrite_rule *rule;
+    struct rewrite_key *key;
 
     mk_list_foreach_safe(head, tmp, &ctx->rules) {
         rule = mk_list_entry(head, struct rewrite_rule, _head);
         flb_regex_destroy(rule->regex);
-        flb_ra_destroy(rule->ra_key);
         flb_ra_destroy(rule->ra_tag);
         mk_list_del(&rule->_head);
         flb_free(rule);
     }
+
+    mk_list_foreach_safe(head, tmp, &ctx->keys) {
+        key = mk_list_entry(head, struct rewrite_key, _head);
+        flb_sds_destroy(key->field);
+        flb_ra_destroy(key->ra);
+        flb_regex_set_destroy(key->set);
+        mk_list_del(&key->_head);
+        flb_free(key);
+    }
 }
 
 static int cb_rewrite_tag_exit(void *data, struct flb_config *config)
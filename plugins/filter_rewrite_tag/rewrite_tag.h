@@ -23,27 +23,58 @@
 
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_regex.h>
+#include <fluent-bit/flb_regex_set.h>
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_input.h>
 
 #define FLB_RTAG_METRIC_EMITTED    200
 #define FLB_RTAG_MEM_BUF_LIMIT_DEFAULT  "10M"
 
+/* Record key shared by the rules reading it */
+struct rewrite_key {
+    flb_sds_t field;                       /* record accessor pattern */
+    struct flb_record_accessor *ra;        /* key record accessor */
+    struct flb_regex_set *set;             /* patterns of the key rules */
+    uint64_t record;                       /* record of the last lookup */
+    msgpack_object *val;                   /* string value or NULL */
+    struct mk_list _head;                  /* link to flb_rewrite_tag->keys */
+};
+
 /* Rewrite rule  */
 struct rewrite_rule {
     int keep_record;                       /* keep original record ? */
+    int pattern_id;                        /* pattern id in the key set */
     struct flb_regex *regex;               /* matching regex */
-    struct flb_record_accessor *ra_key;    /* key record accessor */
+    struct rewrite_key *key;               /* record key */
     struct flb_record_accessor *ra_tag;    /* tag record accessor */
     struct mk_list _head;                  /* link to flb_rewrite_tag->rules */
 };
 
+/* Records of a chunk emitted with the same new tag */
+struct rewrite_group {
+    flb_sds_t tag;                         /* new tag */
+    int records;                           /* number of records */
+    int emitted;                           /* accepted by the emitter ? */
+    msgpack_sbuffer mp_sbuf;               /* records */
+    struct mk_list _head;                  /* link to the groups list */
+};
+
+/* Outcome of the rules for a record of the chunk */
+struct rewrite_record {
+    size_t off;                            /* record offset in the chunk */
+    size_t size;                           /* record size */
+    int keep;                              /* keep the original record ? */
+    struct rewrite_group *group;           /* group of the new tag or NULL */
+};
+
 /* Plugin context */
 struct flb_rewrite_tag {
     flb_sds_t emitter_name;                 /* emitter input plugin name */
     flb_sds_t emitter_storage_type;         /* emitter storage type */
     size_t emitter_mem_buf_limit;           /* Emitter buffer limit */
+    uint64_t records;                       /* current record number */
     struct mk_list rules;                   /* processed rules */
+    struct mk_list keys;                    /* record keys of the rules */
     struct mk_list *cm_rules;               /* config_map rules (only strings) */
     struct flb_input_instance *ins_emitter; /* emitter input plugin instance */
     struct flb_filter_instance *ins;        /* self-filter instance */
@@ -51,9 +82,9 @@ struct flb_rewrite_tag {
 };
 
 /* Register external function to emit records, check 'plugins/in_emitter' */
-int in_emitter_add_record(const char *tag, int tag_len,
-                          const char *buf_data, size_t buf_size,
-                          struct flb_input_instance *in);
+int in_emitter_add_records(const char *tag, int tag_len,
+                           const char *buf_data, size_t buf_size,
+                           struct flb_input_instance *in);
 int in_emitter_get_collector_id(struct flb_input_instance *in);
 
 
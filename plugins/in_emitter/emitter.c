@@ -37,6 +37,8 @@ struct em_chunk {
 
 struct flb_emitter {
     int coll_fd;                        /* collector id */
+    size_t buffered;                    /* bytes in pending chunks */
+    struct em_chunk *last;              /* chunk of the last append */
     struct mk_list chunks;              /* list of all pending chunks */
     struct flb_input_instance *ins;     /* input instance */
 };
@@ -67,8 +69,12 @@ struct em_chunk *em_chunk_create(const char *tag, int tag_len,
     return ec;
 }
 
-static void em_chunk_destroy(struct em_chunk *ec)
+static void em_chunk_destroy(struct em_chunk *ec, struct flb_emitter *ctx)
 {
+    if (ctx->last == ec) {
+        ctx->last = NULL;
+    }
+    ctx->buffered -= ec->mp_sbuf.size;
     mk_list_del(&ec->_head);
     flb_sds_destroy(ec->tag);
     msgpack_sbuffer_destroy(&ec->mp_sbuf);
@@ -76,13 +82,34 @@ static void em_chunk_destroy(struct em_chunk *ec)
 }
 
 
+/*
+ * Check if the emitter can buffer 'size' more bytes. The pending chunks are
+ * limited by the instance mem_buf_limit: while the engine does not take them
+ * (e.g: the instance is paused) new records must be refused.
+ */
+static int in_emitter_can_accept(struct flb_input_instance *in, size_t size)
+{
+    struct flb_emitter *ctx = (struct flb_emitter *) in->context;
+
+    if (in->mem_buf_limit == 0) {
+        return FLB_TRUE;
+    }
+
+    if (ctx->buffered + size > in->mem_buf_limit) {
+        return FLB_FALSE;
+    }
+
+    return FLB_TRUE;
+}
+
 /*
  * Function used by filters to ingest custom records with custom tags, at the
- * moment it's only used by rewrite_tag filter.
+ * moment it's only used by rewrite_tag filter. The buffer can contain many
+ * records for the same tag, they are appended as one block.
  */
-int in_emitter_add_record(const char *tag, int tag_len,
-                          const char *buf_data, size_t buf_size,
-                          struct flb_input_instance *in)
+int in_emitter_add_records(const char *tag, int tag_len,
+                           const char *buf_data, size_t buf_size,
+                           struct flb_input_instance *in)
 {
     struct mk_list *head;
     struct em_chunk *ec = NULL;
@@ -90,14 +117,25 @@ int in_emitter_add_record(const char *tag, int tag_len,
 
     ctx = (struct flb_emitter *) in->context;
 
-    /* Check if any target chunk already exists */
-    mk_list_foreach(head, &ctx->chunks) {
-        ec = mk_list_entry(head, struct em_chunk, _head);
-        if (flb_sds_cmp(ec->tag, tag, tag_len) != 0) {
-            ec = NULL;
-            continue;
+    if (in_emitter_can_accept(in, buf_size) == FLB_FALSE) {
+        flb_plg_warn(ctx->ins, "memory buffer limit reached, records for "
+                     "tag '%.*s' rejected", tag_len, tag);
+        return -1;
+    }
+
+    /* Check if any target chunk already exists, likely the last one used */
+    if (ctx->last && flb_sds_cmp(ctx->last->tag, tag, tag_len) == 0) {
+        ec = ctx->last;
+    }
+    else {
+        mk_list_foreach(head, &ctx->chunks) {
+            ec = mk_list_entry(head, struct em_chunk, _head);
+            if (flb_sds_cmp(ec->tag, tag, tag_len) != 0) {
+                ec = NULL;
+                continue;
+            }
+            break;
         }
-        break;
     }
 
     /* No candidate chunk found, so create a new one */
@@ -112,6 +150,9 @@ int in_emitter_add_record(const char *tag, int tag_len,
 
     /* Append raw msgpack data */
     msgpack_sbuffer_write(&ec->mp_sbuf, buf_data, buf_size);
+    ctx->buffered += buf_size;
+    ctx->last = ec;
+
     return 0;
 }
 
@@ -150,7 +191,7 @@ static int cb_queue_chunks(struct flb_input_instance *in,
         }
 
         /* Release the echunk */
-        em_chunk_destroy(echunk);
+        em_chunk_destroy(echunk, ctx);
     }
 
     return 0;
@@ -169,6 +210,8 @@ static int cb_emitter_init(struct flb_input_instance *in,
         return -1;
     }
     ctx->ins = in;
+    ctx->buffered = 0;
+    ctx->last = NULL;
     mk_list_init(&ctx->chunks);
 
     /* export plugin context */
@@ -208,8 +251,7 @@ static int cb_emitter_exit(void *data, struct flb_config *config)
 
     mk_list_foreach_safe(head, tmp, &ctx->chunks) {
         echunk = mk_list_entry(head, struct em_chunk, _head);
-        mk_list_del(&echunk->_head);
-        flb_free(echunk);
+        em_chunk_destroy(echunk, ctx);
     }
 
     flb_free(ctx);
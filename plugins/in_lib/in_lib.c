@@ -30,49 +30,42 @@
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_error.h>
+#include <fluent-bit/flb_lib.h>
+#include <fluent-bit/flb_time.h>
 #include "in_lib.h"
 
 #include <msgpack.h>
+#include <mpack/mpack.h>
 
-static int in_lib_collect(struct flb_input_instance *ins,
-                          struct flb_config *config, void *in_context)
+/* Make room for 'size' more bytes in the JSON buffer */
+static int buf_reserve(struct flb_in_lib_config *ctx, size_t size)
 {
-    int ret;
-    int bytes;
-    int out_size;
-    int capacity;
-    int size;
+    int new_size;
     char *ptr;
-    char *pack;
-    struct flb_in_lib_config *ctx = in_context;
-
-    capacity = (ctx->buf_size - ctx->buf_len);
 
-    /* Allocate memory as required (FIXME: this will be limited in later) */
-    if (capacity == 0) {
-        size = ctx->buf_size + LIB_BUF_CHUNK;
-        ptr = flb_realloc(ctx->buf_data, size);
-        if (!ptr) {
-            flb_errno();
-            return -1;
-        }
-        ctx->buf_data = ptr;
-        ctx->buf_size = size;
-        capacity = LIB_BUF_CHUNK;
+    if (ctx->buf_size - ctx->buf_len >= size) {
+        return 0;
     }
 
-    bytes = flb_pipe_r(ctx->fd,
-                       ctx->buf_data + ctx->buf_len,
-                       capacity);
-    flb_plg_trace(ctx->ins, "in_lib read() = %i", bytes);
-    if (bytes == -1) {
-        perror("read");
-        if (errno == -EPIPE) {
-            return -1;
-        }
-        return 0;
+    new_size = ctx->buf_len + size;
+    new_size += LIB_BUF_CHUNK - (new_size % LIB_BUF_CHUNK);
+    ptr = flb_realloc(ctx->buf_data, new_size);
+    if (!ptr) {
+        flb_errno();
+        return -1;
     }
-    ctx->buf_len += bytes;
+    ctx->buf_data = ptr;
+    ctx->buf_size = new_size;
+
+    return 0;
+}
+
+/* Pack the JSON data collected so far, it might be incomplete */
+static int process_json(struct flb_in_lib_config *ctx)
+{
+    int ret;
+    int out_size;
+    char *pack;
 
     /* initially we should support json input */
     ret = flb_pack_json_state(ctx->buf_data, ctx->buf_len,
@@ -85,6 +78,7 @@ static int in_lib_collect(struct flb_input_instance *ins,
         flb_plg_warn(ctx->ins, "lib data invalid");
         flb_pack_state_reset(&ctx->state);
         flb_pack_state_init(&ctx->state);
+        ctx->buf_len = 0;
         return -1;
     }
     ctx->buf_len = 0;
@@ -98,11 +92,83 @@ static int in_lib_collect(struct flb_input_instance *ins,
     return ret;
 }
 
+/* Check that a msgpack buffer only contains complete records */
+static int msgpack_validate(const char *data, size_t size)
+{
+    mpack_reader_t reader;
+
+    mpack_reader_init_data(&reader, data, size);
+    while (mpack_reader_remaining(&reader, NULL) > 0) {
+        if (mpack_peek_tag(&reader).type != mpack_type_array) {
+            mpack_reader_flag_error(&reader, mpack_error_type);
+            break;
+        }
+        mpack_discard(&reader);
+    }
+
+    return mpack_reader_destroy(&reader) == mpack_ok ? 0 : -1;
+}
+
+static int in_lib_collect(struct flb_input_instance *ins,
+                          struct flb_config *config, void *in_context)
+{
+    int ret;
+    int type;
+    size_t n;
+    size_t size;
+    void *data;
+    struct flb_in_lib_config *ctx = in_context;
+
+    flb_ring_consume_signal(ctx->ring);
+
+    /*
+     * Entries pushed after the signal was consumed trigger a new wakeup, so
+     * draining at most one lap of the ring gives other events a chance to
+     * run without leaving entries behind.
+     */
+    for (n = 0; n < ctx->ring->slots_size; n++) {
+        ret = flb_ring_pop(ctx->ring, &type, &data, &size);
+        if (ret != FLB_RING_OK) {
+            break;
+        }
+
+        if (type == FLB_LIB_DATA_MSGPACK) {
+            /* keep the order with JSON data pushed before */
+            if (ctx->buf_len > 0) {
+                process_json(ctx);
+            }
+
+            ret = msgpack_validate(data, size);
+            if (ret == 0) {
+                flb_input_chunk_append_raw(ctx->ins, NULL, 0, data, size);
+            }
+            else {
+                flb_plg_warn(ctx->ins, "lib msgpack data invalid, "
+                             "%lu bytes skipped", size);
+            }
+        }
+        else if (buf_reserve(ctx, size) == 0) {
+            memcpy(ctx->buf_data + ctx->buf_len, data, size);
+            ctx->buf_len += size;
+        }
+        flb_free(data);
+    }
+    flb_plg_trace(ctx->ins, "in_lib ring entries = %lu", n);
+
+    if (ctx->buf_len > 0) {
+        return process_json(ctx);
+    }
+
+    return 0;
+}
+
 /* Initialize plugin */
 static int in_lib_init(struct flb_input_instance *in,
                        struct flb_config *config, void *data)
 {
     int ret;
+    int slots = 0;
+    const char *tmp;
     struct flb_in_lib_config *ctx;
     (void) data;
 
@@ -125,9 +191,22 @@ static int in_lib_init(struct flb_input_instance *in,
         return -1;
     }
 
+    /* Number of entries that can be queued before callers get busy */
+    tmp = flb_input_get_property("ring_size", in);
+    if (tmp) {
+        slots = atoi(tmp);
+    }
+
     /* Init communication channel */
-    flb_input_channel_init(in);
-    ctx->fd = in->channel[0];
+    ctx->ring = flb_ring_create(slots);
+    if (!ctx->ring) {
+        flb_plg_error(ctx->ins, "could not create ingestion ring");
+        flb_free(ctx->buf_data);
+        flb_free(ctx);
+        return -1;
+    }
+    ctx->fd = flb_ring_fd(ctx->ring);
+    in->ring = ctx->ring;
 
     /* Set the context */
     flb_input_set_context(in, ctx);
@@ -139,6 +218,8 @@ static int in_lib_init(struct flb_input_instance *in,
                                         config);
     if (ret == -1) {
         flb_plg_error(ctx->ins, "Could not set collector for LIB input plugin");
+        in->ring = NULL;
+        flb_ring_destroy(ctx->ring);
         flb_free(ctx->buf_data);
         flb_free(ctx);
         return -1;
@@ -158,6 +239,16 @@ static int in_lib_exit(void *data, struct flb_config *config)
         flb_free(ctx->buf_data);
     }
 
+    /*
+     * Detach the ring so new pushes get an error, then wait for the
+     * producers that got it before to finish (see lib_ring_push()).
+     */
+    __atomic_store_n(&ctx->ins->ring, NULL, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&ctx->ins->ring_users, __ATOMIC_SEQ_CST) > 0) {
+        flb_time_msleep(1);
+    }
+    flb_ring_destroy(ctx->ring);
+
     s = &ctx->state;
     flb_pack_state_reset(s);
     flb_free(ctx);
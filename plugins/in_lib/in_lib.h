@@ -24,12 +24,14 @@
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_ring.h>
 
 #define LIB_BUF_CHUNK   65536
 
 /* Library input configuration & context */
 struct flb_in_lib_config {
-    int fd;                     /* instance input channel  */
+    int fd;                     /* ring wakeup descriptor  */
+    struct flb_ring *ring;      /* data pushed by callers  */
     int buf_size;               /* buffer size / capacity  */
     int buf_len;                /* read buffer length      */
     char *buf_data;             /* the real buffer         */
@@ -273,8 +273,7 @@ static int in_systemd_collect(struct flb_input_instance *ins,
     if (ctx->db) {
         sd_journal_get_cursor(ctx->j, &cursor);
         if (cursor) {
-            flb_systemd_db_set_cursor(ctx, cursor);
-            flb_free(cursor);
+            flb_systemd_db_update_cursor(ctx, cursor);
         }
     }
 #endif
@@ -369,6 +368,19 @@ static int in_systemd_collect_archive(struct flb_input_instance *ins,
     return 0;
 }
 
+#ifdef FLB_HAVE_SQLDB
+static int in_systemd_db_flush(struct flb_input_instance *ins,
+                               struct flb_config *config, void *in_context)
+{
+    struct flb_systemd_config *ctx = in_context;
+    (void) ins;
+    (void) config;
+
+    flb_systemd_db_flush(ctx);
+    return 0;
+}
+#endif
+
 static int in_systemd_init(struct flb_input_instance *ins,
                            struct flb_config *config, void *data)
 {
@@ -393,6 +405,21 @@ static int in_systemd_init(struct flb_input_instance *ins,
     }
     ctx->coll_fd_archive = ret;
 
+#ifdef FLB_HAVE_SQLDB
+    /* Timer to write the last cursor */
+    if (ctx->db && ctx->db_flush_interval > 0) {
+        ret = flb_input_set_collector_time(ins, in_systemd_db_flush,
+                                           ctx->db_flush_interval, 0,
+                                           config);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "error setting up collector for cursor");
+            flb_systemd_config_destroy(ctx);
+            return -1;
+        }
+        ctx->coll_fd_db_flush = ret;
+    }
+#endif
+
     return 0;
 }
 
@@ -56,6 +56,7 @@ struct flb_systemd_config *flb_systemd_config_create(struct flb_input_instance *
     ctx->ins = ins;
 #ifdef FLB_HAVE_SQLDB
     ctx->db_sync = -1;
+    ctx->db_flush_interval = FLB_SYSTEMD_DB_FLUSH;
 #endif
 
     /* Create the channel manager */
@@ -134,6 +135,16 @@ struct flb_systemd_config *flb_systemd_config_create(struct flb_input_instance *
         }
     }
 
+    tmp = flb_input_get_property("db.flush_interval", ins);
+    if (tmp) {
+        ctx->db_flush_interval = flb_utils_time_to_seconds(tmp);
+        if (ctx->db_flush_interval < 0) {
+            flb_plg_error(ctx->ins,
+                          "invalid 'db.flush_interval' config value");
+            ctx->db_flush_interval = FLB_SYSTEMD_DB_FLUSH;
+        }
+    }
+
     /* Database file */
     tmp = flb_input_get_property("db", ins);
     if (tmp) {
@@ -294,6 +305,10 @@ int flb_systemd_config_destroy(struct flb_systemd_config *ctx)
 
 #ifdef FLB_HAVE_SQLDB
     if (ctx->db) {
+        flb_systemd_db_flush(ctx);
+        if (ctx->db_cursor) {
+            flb_free(ctx->db_cursor);
+        }
         sqlite3_finalize(ctx->stmt_cursor);
         flb_systemd_db_close(ctx->db);
     }
@@ -40,6 +40,7 @@
 #define FLB_SYSTEMD_UNKNOWN  "unknown"
 #define FLB_SYSTEMD_MAX_FIELDS   8000
 #define FLB_SYSTEMD_MAX_ENTRIES  5000
+#define FLB_SYSTEMD_DB_FLUSH     1     /* seconds between cursor writes */
 
 /* Input configuration & context */
 struct flb_systemd_config {
@@ -56,6 +57,7 @@ struct flb_systemd_config {
     int coll_fd_archive;       /* archive collector        */
     int coll_fd_journal;       /* journal, events mode     */
     int coll_fd_pending;       /* pending records          */
+    int coll_fd_db_flush;      /* cursor writes            */
     int dynamic_tag;
     int max_fields;            /* max number of fields per record */
     int max_entries;           /* max number of records per iteration */
@@ -64,6 +66,9 @@ struct flb_systemd_config {
 #ifdef FLB_HAVE_SQLDB
     struct flb_sqldb *db;
     int db_sync;
+    int db_flush_interval;     /* max seconds the cursor stays in memory */
+    time_t db_last_flush;
+    char *db_cursor;           /* cursor to be written, NULL if none     */
     sqlite3_stmt *stmt_cursor;
 #endif
     struct flb_input_instance *ins;
@@ -89,6 +89,7 @@ struct flb_sqldb *flb_systemd_db_open(const char *path,
 {
     int ret;
     char tmp[64];
+    const char *journal_mode;
     struct flb_sqldb *db;
 
     /* Open/create the database */
@@ -116,7 +117,18 @@ struct flb_sqldb *flb_systemd_db_open(const char *path,
         }
     }
 
+    journal_mode = flb_input_get_property("db.journal_mode", ins);
+    if (journal_mode) {
+        ret = flb_sqldb_journal_mode(db, journal_mode);
+        if (ret != 0) {
+            flb_plg_error(ctx->ins, "db could not set pragma 'journal_mode'");
+            flb_sqldb_close(db);
+            return NULL;
+        }
+    }
+
     flb_systemd_db_sanitize(db, ins);
+    ctx->db_last_flush = time(NULL);
 
     return db;
 }
@@ -173,6 +185,53 @@ int flb_systemd_db_set_cursor(struct flb_systemd_config *ctx, const char *cursor
     return 0;
 }
 
+/* Write the last cursor read, if any */
+int flb_systemd_db_flush(struct flb_systemd_config *ctx)
+{
+    int ret;
+
+    ctx->db_last_flush = time(NULL);
+    if (!ctx->db_cursor) {
+        return 0;
+    }
+
+    ret = flb_systemd_db_set_cursor(ctx, ctx->db_cursor);
+    if (ret == -1) {
+        flb_plg_error(ctx->ins, "db: could not update cursor");
+        return -1;
+    }
+
+    flb_free(ctx->db_cursor);
+    ctx->db_cursor = NULL;
+    return 0;
+}
+
+/*
+ * Register the cursor of the last record read. Only the last one matters so
+ * it's kept in memory and written every 'db.flush_interval' seconds: a crash
+ * can lose at most that interval. The cursor is owned by the context.
+ */
+int flb_systemd_db_update_cursor(struct flb_systemd_config *ctx, char *cursor)
+{
+    if (ctx->db_flush_interval == 0) {
+        flb_systemd_db_set_cursor(ctx, cursor);
+        flb_free(cursor);
+        return 0;
+    }
+
+    if (ctx->db_cursor) {
+        flb_free(ctx->db_cursor);
+    }
+    ctx->db_cursor = cursor;
+
+    /* the flush timer may be late if the engine is busy */
+    if (time(NULL) - ctx->db_last_flush >= ctx->db_flush_interval) {
+        return flb_systemd_db_flush(ctx);
+    }
+
+    return 0;
+}
+
 char *flb_systemd_db_get_cursor(struct flb_systemd_config *ctx)
 {
     int ret;
@@ -61,5 +61,7 @@ int flb_systemd_db_close(struct flb_sqldb *db);
 int flb_systemd_db_init_cursor(struct flb_systemd_config *ctx, const char *cursor);
 int flb_systemd_db_set_cursor(struct flb_systemd_config *ctx, const char *cursor);
 char *flb_systemd_db_get_cursor(struct flb_systemd_config *ctx);
+int flb_systemd_db_update_cursor(struct flb_systemd_config *ctx, char *cursor);
+int flb_systemd_db_flush(struct flb_systemd_config *ctx);
 
 #endif
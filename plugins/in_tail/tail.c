@@ -35,6 +35,7 @@
 
 #include "tail.h"
 #include "tail_fs.h"
+#include "tail_io.h"
 #include "tail_db.h"
 #include "tail_file.h"
 #include "tail_scan.h"
@@ -70,11 +71,10 @@ static int in_tail_collect_pending(struct flb_input_instance *ins,
     struct flb_tail_file *file;
     struct stat st;
 
-    /* Iterate promoted event files with pending bytes */
+    /* Gather current file sizes, the batched read is built from them */
     mk_list_foreach_safe(head, tmp, &ctx->files_event) {
         file = mk_list_entry(head, struct flb_tail_file, _head);
 
-        /* Gather current file size */
         ret = fstat(file->fd, &st);
         if (ret == -1) {
             flb_errno();
@@ -83,8 +83,17 @@ static int in_tail_collect_pending(struct flb_input_instance *ins,
         }
         file->size = st.st_size;
         file->pending_bytes = (file->size - file->offset);
+    }
+
+    /* Read the files with pending data in one batch, if supported */
+    flb_tail_io_read(ctx, &ctx->files_event);
 
-        if (file->pending_bytes <= 0) {
+    /* Iterate promoted event files with pending bytes */
+    mk_list_foreach_safe(head, tmp, &ctx->files_event) {
+        file = mk_list_entry(head, struct flb_tail_file, _head);
+
+        /* A batched read result must be consumed anyways */
+        if (file->pending_bytes <= 0 && file->io_pending == FLB_FALSE) {
             continue;
         }
 
@@ -100,8 +109,8 @@ static int in_tail_collect_pending(struct flb_input_instance *ins,
              * Adjust counter to verify if we need a further read(2) later.
              * For more details refer to tail_fs_inotify.c:96.
              */
-            if (file->offset < st.st_size) {
-                file->pending_bytes = (st.st_size - file->offset);
+            if (file->offset < file->size) {
+                file->pending_bytes = (file->size - file->offset);
                 active++;
             }
             else {
@@ -133,6 +142,9 @@ static int in_tail_collect_static(struct flb_input_instance *ins,
     struct flb_tail_config *ctx = in_context;
     struct flb_tail_file *file;
 
+    /* Read the files in one batch, if supported */
+    flb_tail_io_read(ctx, &ctx->files_static);
+
     /* Do a data chunk collection for each file */
     mk_list_foreach_safe(head, tmp, &ctx->files_static) {
         file = mk_list_entry(head, struct flb_tail_file, _head);
@@ -294,6 +306,13 @@ static int in_tail_init(struct flb_input_instance *in,
         return -1;
     }
 
+    /* Initialize the batched reads backend */
+    ret = flb_tail_io_init(ctx);
+    if (ret == -1) {
+        flb_tail_config_destroy(ctx);
+        return -1;
+    }
+
     /* Scan path */
     flb_tail_scan(ctx->path, ctx);
     flb_plg_trace(in, "scan path: %s", ctx->path);
@@ -372,7 +391,7 @@ static int in_tail_init(struct flb_input_instance *in,
 
 #ifdef FLB_HAVE_PARSER
     /* Register callback to process multiline queued buffer */
-    if (ctx->multiline == FLB_TRUE) {
+    if (ctx->multiline == FLB_TRUE || ctx->ml) {
         ret = flb_input_set_collector_time(in, flb_tail_mult_pending_flush,
                                            ctx->multiline_flush, 0,
                                            config);
@@ -385,6 +404,20 @@ static int in_tail_init(struct flb_input_instance *in,
     }
 #endif
 
+#ifdef FLB_HAVE_SQLDB
+    /* Register callback to write the pending file offsets */
+    if (ctx->db && ctx->db_flush_interval > 0) {
+        ret = flb_input_set_collector_time(in, flb_tail_db_flush_callback,
+                                           ctx->db_flush_interval, 0,
+                                           config);
+        if (ret == -1) {
+            flb_tail_config_destroy(ctx);
+            return -1;
+        }
+        ctx->coll_fd_db_flush = ret;
+    }
+#endif
+
     return 0;
 }
 
@@ -403,6 +436,13 @@ static int in_tail_exit(void *data, struct flb_config *config)
     (void) *config;
     struct flb_tail_config *ctx = data;
 
+#ifdef FLB_HAVE_SQLDB
+    /* Write all the pending offsets in one transaction */
+    if (ctx->db) {
+        flb_tail_db_flush(ctx);
+    }
+#endif
+
     flb_tail_file_remove_all(ctx);
     flb_tail_config_destroy(ctx);
 
@@ -425,7 +465,7 @@ static void in_tail_pause(void *data, struct flb_config *config)
         flb_input_collector_pause(ctx->coll_fd_dmode_flush, ctx->ins);
     }
 
-    if (ctx->multiline == FLB_TRUE) {
+    if (ctx->multiline == FLB_TRUE || ctx->ml) {
         flb_input_collector_pause(ctx->coll_fd_mult_flush, ctx->ins);
     }
 
@@ -444,7 +484,7 @@ static void in_tail_resume(void *data, struct flb_config *config)
         flb_input_collector_resume(ctx->coll_fd_dmode_flush, ctx->ins);
     }
 
-    if (ctx->multiline == FLB_TRUE) {
+    if (ctx->multiline == FLB_TRUE || ctx->ml) {
         flb_input_collector_resume(ctx->coll_fd_mult_flush, ctx->ins);
     }
 
@@ -566,6 +606,19 @@ static struct flb_config_map config_map[] = {
      0, FLB_FALSE, 0,
      "set a database sync method. values: extra, full, normal and off."
     },
+    {
+     FLB_CONFIG_MAP_TIME, "db.flush_interval", "1s",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, db_flush_interval),
+     "maximum time the file offsets are kept in memory before being written "
+     "to the database in a single transaction. A crash can lose at most this "
+     "interval of offsets. Set it to 0 to write every offset update."
+    },
+    {
+     FLB_CONFIG_MAP_STR, "db.journal_mode", "off",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, db_journal_mode),
+     "set the database journal mode. values: delete, truncate, persist, "
+     "memory, wal and off."
+    },
 #endif
 
     /* Multiline Options */
@@ -596,6 +649,20 @@ static struct flb_config_map config_map[] = {
      "option can be used to define multiple parsers, e.g: Parser_1 ab1, "
      "Parser_2 ab2, Parser_N abN."
     },
+    {
+     FLB_CONFIG_MAP_CLIST, "multiline.parser", NULL,
+     0, FLB_TRUE, offsetof(struct flb_tail_config, ml_parsers),
+     "built-in multiline rule set to join the lines of a record: java, go or "
+     "python. 'docker' can be added to the list to recombine split Docker "
+     "log lines first. The optional Parser is applied to the joined record. "
+     "This option cannot be used at the same time as Multiline."
+    },
+    {
+     FLB_CONFIG_MAP_INT, "multiline.max_lines", "1000",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, ml_max_lines),
+     "maximum number of lines of a multiline record, once reached the record "
+     "is flushed."
+    },
 
 #endif
 
@@ -25,6 +25,7 @@
 #include <fcntl.h>
 
 #include "tail_fs.h"
+#include "tail_io.h"
 #include "tail_db.h"
 #include "tail_config.h"
 #include "tail_scan.h"
@@ -149,6 +150,15 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
             return NULL;
         }
     }
+
+    /* Config: multiline rule sets, 'docker' enables the Docker mode */
+    if (ctx->ml_parsers) {
+        ret = flb_tail_ml_create(ctx, config);
+        if (ret == -1) {
+            flb_tail_config_destroy(ctx);
+            return NULL;
+        }
+    }
 #endif
 
     /* Config: Docker mode */
@@ -183,6 +193,7 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
     mk_list_init(&ctx->files_rotated);
 #ifdef FLB_HAVE_SQLDB
     ctx->db = NULL;
+    mk_list_init(&ctx->db_pending);
 #endif
 
 #ifdef FLB_HAVE_REGEX
@@ -228,6 +239,12 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
         }
     }
 
+    if (ctx->db_flush_interval < 0) {
+        flb_plg_error(ctx->ins, "invalid 'db.flush_interval' config value");
+        flb_tail_config_destroy(ctx);
+        return NULL;
+    }
+
     /* Initialize database */
     tmp = flb_input_get_property("db", ins);
     if (tmp) {
@@ -269,8 +286,11 @@ int flb_tail_config_destroy(struct flb_tail_config *config)
 
 #ifdef FLB_HAVE_PARSER
     flb_tail_mult_destroy(config);
+    flb_tail_ml_destroy(config);
 #endif
 
+    flb_tail_io_exit(config);
+
     /* Close pipe ends */
     flb_pipe_close(config->ch_manager[0]);
     flb_pipe_close(config->ch_manager[1]);
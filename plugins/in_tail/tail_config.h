@@ -28,6 +28,7 @@
 #include <fluent-bit/flb_sqldb.h>
 #ifdef FLB_HAVE_REGEX
 #include <fluent-bit/flb_regex.h>
+#include <fluent-bit/flb_ml.h>
 #endif
 
 /* Metrics */
@@ -37,6 +38,8 @@
 #define FLB_TAIL_METRIC_F_ROTATED 102  /* number of rotated files */
 #endif
 
+struct flb_tail_io;
+
 struct flb_tail_config {
     int fd_notify;             /* inotify fd               */
 #ifdef _WIN32
@@ -61,6 +64,7 @@ struct flb_tail_config {
     int coll_fd_pending;
     int coll_fd_dmode_flush;
     int coll_fd_mult_flush;
+    int coll_fd_db_flush;
 
     /* Backend collectors */
     int coll_fd_fs1;           /* used by fs_inotify & fs_stat */
@@ -87,6 +91,10 @@ struct flb_tail_config {
 #ifdef FLB_HAVE_SQLDB
     struct flb_sqldb *db;
     int db_sync;
+    int db_flush_interval;     /* max seconds an offset stays in memory */
+    flb_sds_t db_journal_mode;
+    time_t db_last_flush;
+    struct mk_list db_pending; /* files with an offset to be written    */
     sqlite3_stmt *stmt_offset;
 #endif
 
@@ -99,10 +107,18 @@ struct flb_tail_config {
     struct flb_parser *mult_parser_firstline;
     struct mk_list mult_parsers;
 
+    /* Multiline rule sets */
+    struct mk_list *ml_parsers; /* multiline.parser names   */
+    int ml_max_lines;           /* lines limit of a record  */
+    struct flb_ml *ml;          /* compiled rule set        */
+
     /* Docker mode */
     int docker_mode;           /* Docker mode enabled ?  */
     int docker_mode_flush;     /* Docker mode flush/wait */
 
+    /* Batched reads backend, NULL if not available (tail_io.c) */
+    struct flb_tail_io *io;
+
     /* Lists head for files consumed statically (read) and by events (inotify) */
     struct mk_list files_static;
     struct mk_list files_event;
@@ -68,13 +68,14 @@ struct flb_sqldb *flb_tail_db_open(const char *path,
     }
 
 
-    ret = flb_sqldb_query(db, SQL_PRAGMA_JOURNAL_MODE, NULL, NULL);
-    if (ret != FLB_OK) {
+    ret = flb_sqldb_journal_mode(db, ctx->db_journal_mode);
+    if (ret != 0) {
         flb_plg_error(ctx->ins, "db: could not set pragma 'journal_mode'");
         flb_sqldb_close(db);
         return NULL;
     }
 
+    ctx->db_last_flush = time(NULL);
     return db;
 }
 
@@ -132,8 +133,8 @@ int flb_tail_db_file_set(struct flb_tail_file *file,
 }
 
 /* Update Offset v2 */
-int flb_tail_db_file_offset(struct flb_tail_file *file,
-                            struct flb_tail_config *ctx)
+static int db_offset_write(struct flb_tail_file *file,
+                           struct flb_tail_config *ctx)
 {
     int ret;
 
@@ -153,6 +154,118 @@ int flb_tail_db_file_offset(struct flb_tail_file *file,
     return 0;
 }
 
+static void db_pending_del(struct flb_tail_file *file)
+{
+    if (file->db_pending == FLB_TRUE) {
+        mk_list_del(&file->_db_head);
+        file->db_pending = FLB_FALSE;
+    }
+}
+
+/*
+ * Write the offsets of all the files updated since the last flush in a
+ * single transaction. On error the offsets are kept for the next flush.
+ */
+int flb_tail_db_flush(struct flb_tail_config *ctx)
+{
+    int ret;
+    int count = 0;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_tail_file *file;
+
+    ctx->db_last_flush = time(NULL);
+    if (mk_list_is_empty(&ctx->db_pending) == 0) {
+        return 0;
+    }
+
+    ret = flb_sqldb_query(ctx->db, SQL_BEGIN, NULL, NULL);
+    if (ret != FLB_OK) {
+        return -1;
+    }
+
+    mk_list_foreach(head, &ctx->db_pending) {
+        file = mk_list_entry(head, struct flb_tail_file, _db_head);
+        ret = db_offset_write(file, ctx);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "db: could not update offset of %s",
+                          file->name);
+            flb_sqldb_query(ctx->db, SQL_ROLLBACK, NULL, NULL);
+            return -1;
+        }
+        count++;
+    }
+
+    ret = flb_sqldb_query(ctx->db, SQL_COMMIT, NULL, NULL);
+    if (ret != FLB_OK) {
+        flb_sqldb_query(ctx->db, SQL_ROLLBACK, NULL, NULL);
+        return -1;
+    }
+
+    mk_list_foreach_safe(head, tmp, &ctx->db_pending) {
+        file = mk_list_entry(head, struct flb_tail_file, _db_head);
+        db_pending_del(file);
+    }
+
+    flb_plg_trace(ctx->ins, "db: %i offsets flushed", count);
+    return 0;
+}
+
+/* cb_collect callback: flush the offsets every 'db.flush_interval' */
+int flb_tail_db_flush_callback(struct flb_input_instance *ins,
+                               struct flb_config *config, void *context)
+{
+    struct flb_tail_config *ctx = context;
+    (void) ins;
+    (void) config;
+
+    flb_tail_db_flush(ctx);
+    return 0;
+}
+
+/*
+ * Register the new offset of a file. Offsets are kept in memory and written
+ * together, a crash can lose at most 'db.flush_interval' seconds of them.
+ */
+int flb_tail_db_file_offset(struct flb_tail_file *file,
+                            struct flb_tail_config *ctx)
+{
+    if (ctx->db_flush_interval == 0) {
+        return db_offset_write(file, ctx);
+    }
+
+    if (file->db_pending == FLB_FALSE) {
+        mk_list_add(&file->_db_head, &ctx->db_pending);
+        file->db_pending = FLB_TRUE;
+    }
+
+    /* the flush timer may be late if the engine is busy */
+    if (time(NULL) - ctx->db_last_flush >= ctx->db_flush_interval) {
+        return flb_tail_db_flush(ctx);
+    }
+
+    return 0;
+}
+
+/* Write the offset of a file now if it's pending, e.g: file removal */
+int flb_tail_db_file_sync(struct flb_tail_file *file,
+                          struct flb_tail_config *ctx)
+{
+    int ret;
+
+    if (file->db_pending == FLB_FALSE) {
+        return 0;
+    }
+
+    db_pending_del(file);
+    ret = db_offset_write(file, ctx);
+    if (ret == -1) {
+        flb_plg_error(ctx->ins, "db: could not update offset of %s",
+                      file->name);
+    }
+    return ret;
+}
+
 /* Mark a file as rotated */
 int flb_tail_db_file_rotate(const char *new_name,
                             struct flb_tail_file *file,
@@ -182,6 +295,9 @@ int flb_tail_db_file_delete(struct flb_tail_file *file,
     int ret;
     char query[PATH_MAX];
 
+    /* the pending offset is not needed anymore */
+    db_pending_del(file);
+
     /* Check if the file exists */
     snprintf(query, sizeof(query) - 1, SQL_DELETE_FILE, file->db_id);
     ret = flb_sqldb_query(ctx->db, query, NULL, NULL);
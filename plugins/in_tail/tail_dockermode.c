@@ -53,39 +53,64 @@ int flb_tail_dmode_create(struct flb_tail_config *ctx,
     return 0;
 }
 
+/* Make sure the reusable line buffer of the file can hold 'size' bytes */
+static int dmode_repl_reserve(struct flb_tail_file *file, size_t size)
+{
+    size_t alloc;
+    flb_sds_t tmp;
+
+    alloc = flb_sds_alloc(file->dmode_repl);
+    if (alloc >= size) {
+        return 0;
+    }
+
+    tmp = flb_sds_increase(file->dmode_repl, size - alloc);
+    if (!tmp) {
+        return -1;
+    }
+    file->dmode_repl = tmp;
+
+    return 0;
+}
+
+/*
+ * Lookup the value of the 'log' key in the JSON line and, if cond() is
+ * true for it, replace it with the buffered docker mode content, followed
+ * by the original value if 'append' is set. The new line is composed into
+ * the file 'dmode_repl' buffer, so no memory is allocated per line: the
+ * caller must not release it.
+ */
 static int modify_json_cond(char *js, size_t js_len,
                             char **val, size_t *val_len,
                             char **out, size_t *out_len,
-                            int cond(char*, size_t),
-                            int mod(char*, size_t, char**, size_t*, void*), void *data)
+                            int cond(char*, size_t, struct flb_tail_file *),
+                            int append, struct flb_tail_file *file)
 {
     int ret;
-    struct flb_pack_state state;
+    struct flb_pack_state *state = &file->dmode_state;
     jsmntok_t *t;
     jsmntok_t *t_val = NULL;
     int i;
     int i_root = -1;
     int i_key = -1;
+    char *p;
     char *old_val;
     size_t old_val_len;
-    char *new_val = NULL;
-    size_t new_val_len = 0;
+    size_t new_val_len;
     size_t mod_len;
 
-    ret = flb_pack_state_init(&state);
-    if (ret != 0) {
-        ret = -1;
-        goto modify_json_cond_end;
-    }
+    /* Reuse the tokens array of the file */
+    jsmn_init(&state->parser);
+    state->tokens_count = 0;
 
-    ret = flb_json_tokenise(js, js_len, &state);
-    if (ret != 0 || state.tokens_count == 0) {
+    ret = flb_json_tokenise(js, js_len, state);
+    if (ret != 0 || state->tokens_count == 0) {
         ret = -1;
         goto modify_json_cond_end;
     }
 
-    for (i = 0; i < state.tokens_count; i++) {
-        t = &state.tokens[i];
+    for (i = 0; i < state->tokens_count; i++) {
+        t = &state->tokens[i];
 
         if (i_key >= 0) {
             if (t->parent == i_key) {
@@ -125,99 +150,68 @@ static int modify_json_cond(char *js, size_t js_len,
         *val_len = t_val->end - t_val->start;
     }
 
-    if (!cond || cond(js + t_val->start, t_val->end - t_val->start)) {
+    if (!cond || cond(js + t_val->start, t_val->end - t_val->start, file)) {
         old_val = js + t_val->start;
         old_val_len = t_val->end - t_val->start;
-        ret = mod(old_val, old_val_len, &new_val, &new_val_len, data);
-        if (ret != 0) {
-            ret = -1;
-            goto modify_json_cond_end;
-        }
-
         ret = 1;
 
-        if (new_val == old_val) {
+        /* Nothing buffered to prepend, the line stays as it is */
+        if (append && flb_sds_len(file->dmode_buf) == 0) {
             goto modify_json_cond_end;
         }
 
+        new_val_len = flb_sds_len(file->dmode_buf);
+        if (append) {
+            new_val_len += old_val_len;
+        }
+
         mod_len = js_len + new_val_len - old_val_len;
-        *out = flb_malloc(mod_len);
-        if (!*out) {
-            flb_errno();
-            flb_free(new_val);
+        if (dmode_repl_reserve(file, mod_len) != 0) {
             ret = -1;
             goto modify_json_cond_end;
         }
-        *out_len = mod_len;
 
-        memcpy(*out, js, t_val->start);
-        memcpy(*out + t_val->start, new_val, new_val_len);
-        memcpy(*out + t_val->start + new_val_len, js + t_val->end, js_len - t_val->end);
+        p = file->dmode_repl;
+        memcpy(p, js, t_val->start);
+        p += t_val->start;
+        memcpy(p, file->dmode_buf, flb_sds_len(file->dmode_buf));
+        p += flb_sds_len(file->dmode_buf);
+        if (append) {
+            memcpy(p, old_val, old_val_len);
+            p += old_val_len;
+        }
+        memcpy(p, js + t_val->end, js_len - t_val->end);
+        flb_sds_len_set(file->dmode_repl, mod_len);
 
-        flb_free(new_val);
+        *out = file->dmode_repl;
+        *out_len = mod_len;
     }
 
  modify_json_cond_end:
-    flb_pack_state_reset(&state);
     if (ret < 0) {
         *out = NULL;
     }
     return ret;
 }
 
-static int unesc_ends_with_nl(char *str, size_t len)
+static int unesc_ends_with_nl(char *str, size_t len,
+                              struct flb_tail_file *file)
 {
-    char* unesc;
+    char *unesc;
     int unesc_len;
-    int nl;
 
-    unesc = flb_malloc(len + 1);
-    if (!unesc) {
-        flb_errno();
+    /* The value is unescaped into the line buffer, not used yet */
+    if (dmode_repl_reserve(file, len + 1) != 0) {
         return FLB_FALSE;
     }
-    unesc_len = flb_unescape_string(str, len, &unesc);
-    nl = unesc[unesc_len - 1] == '\n';
-    flb_free(unesc);
-    return nl;
-}
 
-static int prepend_sds_to_str(char *str, size_t len, char **out, size_t *out_len, void *data)
-{
-    flb_sds_t sds = data;
-
-    if (flb_sds_len(sds) == 0) {
-        *out = str;
-        *out_len = len;
-        return 0;
-    }
-
-    size_t mod_len = flb_sds_len(sds) + len;
-    *out = flb_malloc(mod_len);
-    if (!*out) {
-        flb_errno();
-        return -1;
-    }
-    *out_len = mod_len;
-
-    memcpy(*out, sds, flb_sds_len(sds));
-    memcpy(*out + flb_sds_len(sds), str, len);
-    return 0;
-}
-
-static int use_sds(char *str, size_t len, char **out, size_t *out_len, void *data)
-{
-    flb_sds_t sds = data;
-    size_t mod_len = flb_sds_len(sds);
-    *out = flb_malloc(mod_len);
-    if (!*out) {
-        flb_errno();
-        return -1;
+    unesc = file->dmode_repl;
+    unesc_len = flb_unescape_string(str, len, &unesc);
+    if (unesc_len <= 0) {
+        return FLB_FALSE;
     }
-    *out_len = mod_len;
 
-    memcpy(*out, sds, flb_sds_len(sds));
-    return 0;
+    return unesc[unesc_len - 1] == '\n';
 }
 
 int flb_tail_dmode_process_content(time_t now,
@@ -234,7 +228,7 @@ int flb_tail_dmode_process_content(time_t now,
                            &val, &val_len,
                            repl_line, repl_line_len,
                            unesc_ends_with_nl,
-                           prepend_sds_to_str, file->dmode_buf);
+                           FLB_TRUE, file);
     if (ret >= 0) {
         flb_sds_len_set(file->dmode_lastline, 0);
 
@@ -272,7 +266,7 @@ void flb_tail_dmode_flush(msgpack_sbuffer *mp_sbuf, msgpack_packer *mp_pck,
                            NULL, NULL,
                            &repl_line, &repl_line_len,
                            NULL,
-                           use_sds, file->dmode_buf);
+                           FLB_FALSE, file);
     if (ret < 0) {
         return;
     }
@@ -302,7 +296,6 @@ void flb_tail_dmode_flush(msgpack_sbuffer *mp_sbuf, msgpack_packer *mp_pck,
                             repl_line, repl_line_len, file);
 
  dmode_flush_end:
-    flb_free(repl_line);
     flb_free(out_buf);
 }
 
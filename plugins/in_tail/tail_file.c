@@ -189,19 +189,23 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
     size_t line_len;
     char *repl_line;
     size_t repl_line_len;
-    time_t now = time(NULL);
+    time_t now;
+    struct flb_time now_time;
     struct flb_time out_time = {0};
-    msgpack_sbuffer mp_sbuf;
-    msgpack_packer mp_pck;
     msgpack_sbuffer *out_sbuf;
     msgpack_packer *out_pck;
     struct flb_tail_config *ctx = file->config;
 
-    /* Create a temporal msgpack buffer */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
-    out_sbuf = &mp_sbuf;
-    out_pck  = &mp_pck;
+    /*
+     * Lines without a parsed time are stamped with the time of this read,
+     * so the clock is read once for the whole buffer and not per line.
+     */
+    flb_time_get(&now_time);
+    now = now_time.tm.tv_sec;
+
+    /* Records are packed into the file buffer, it's reused across reads */
+    out_sbuf = &file->sbuf;
+    out_pck  = &file->pck;
 
     /* Parse the data content */
     data = file->buf_data;
@@ -218,6 +222,12 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
 
         /* Empty line (just \n) */
         if (len == 0) {
+#ifdef FLB_HAVE_PARSER
+            /* blank lines can be part of a multiline record, e.g: Go */
+            if (ctx->ml && file->ml_stream.state >= 0) {
+                flb_tail_ml_process(&now_time, data, 0, file, ctx);
+            }
+#endif
             data++;
             processed_bytes++;
             continue;
@@ -243,13 +253,9 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
                                                  &repl_line, &repl_line_len,
                                                  file, ctx);
             if (ret >= 0) {
-                if (repl_line == line) {
-                    repl_line = NULL;
-                }
-                else {
-                    line = repl_line;
-                    line_len = repl_line_len;
-                }
+                /* the replaced line is owned by the file, don't free it */
+                line = repl_line;
+                line_len = repl_line_len;
                 if (ret == 0) {
                     goto go_next;
                 }
@@ -260,13 +266,21 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
         }
 
 #ifdef FLB_HAVE_PARSER
+        /* Multiline rule set: the record is packed once it's complete */
+        if (ctx->ml) {
+            ret = flb_tail_ml_process(&now_time, line, line_len, file, ctx);
+            if (ret == FLB_ML_MORE) {
+                goto go_next;
+            }
+        }
+
         if (ctx->parser) {
             /* Common parser (non-multiline) */
             ret = flb_parser_do(ctx->parser, line, line_len,
                                 &out_buf, &out_size, &out_time);
             if (ret >= 0) {
                 if (flb_time_to_double(&out_time) == 0) {
-                    flb_time_get(&out_time);
+                    out_time = now_time;
                 }
 
                 if (ctx->ignore_older > 0) {
@@ -287,7 +301,7 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
             }
             else {
                 /* Parser failed, pack raw text */
-                flb_time_get(&out_time);
+                out_time = now_time;
                 flb_tail_file_pack_line(out_sbuf, out_pck, &out_time,
                                         data, len, file);
             }
@@ -301,7 +315,7 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
 
                 flb_tail_mult_flush(out_sbuf, out_pck, file, ctx);
 
-                flb_time_get(&out_time);
+                out_time = now_time;
                 flb_tail_file_pack_line(out_sbuf, out_pck, &out_time,
                                         line, line_len, file);
             }
@@ -314,19 +328,17 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
             }
         }
         else {
-            flb_time_get(&out_time);
+            out_time = now_time;
             flb_tail_file_pack_line(out_sbuf, out_pck, &out_time,
                                     line, line_len, file);
         }
 #else
-        flb_time_get(&out_time);
+        out_time = now_time;
         flb_tail_file_pack_line(out_sbuf, out_pck, &out_time,
                                 line, line_len, file);
 #endif
 
     go_next:
-        flb_free(repl_line);
-        repl_line = NULL;
         /* Adjust counters */
         data += len + 1;
         processed_bytes += len + 1;
@@ -337,13 +349,26 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
     *bytes = processed_bytes;
 
     /* Append buffer content to a chunk */
-    flb_input_chunk_append_raw(ctx->ins,
-                               file->tag_buf,
-                               file->tag_len,
-                               out_sbuf->data,
-                               out_sbuf->size);
+    if (out_sbuf->size > 0) {
+        flb_input_chunk_append_raw(ctx->ins,
+                                   file->tag_buf,
+                                   file->tag_len,
+                                   out_sbuf->data,
+                                   out_sbuf->size);
+    }
+
+    /*
+     * Keep the allocation for the next read, unless an unusual big batch
+     * (e.g: a large multiline flush) made it grow too much.
+     */
+    if (out_sbuf->alloc > ctx->buf_max_size * 4) {
+        msgpack_sbuffer_destroy(out_sbuf);
+        msgpack_sbuffer_init(out_sbuf);
+    }
+    else {
+        msgpack_sbuffer_clear(out_sbuf);
+    }
 
-    msgpack_sbuffer_destroy(out_sbuf);
     return lines;
 }
 
@@ -619,11 +644,33 @@ int flb_tail_file_append(char *path, struct stat *st, int mode,
     file->mult_flush_timeout = 0;
     file->mult_skipping = FLB_FALSE;
     msgpack_sbuffer_init(&file->mult_sbuf);
+#ifdef FLB_HAVE_PARSER
+    file->ml_stream.state = -1;
+    file->ml_stream.buf = NULL;
+    if (ctx->ml && flb_ml_stream_init(&file->ml_stream) == -1) {
+        flb_errno();
+        goto error;
+    }
+#endif
     file->dmode_flush_timeout = 0;
     file->dmode_buf = flb_sds_create_size(ctx->docker_mode == FLB_TRUE ? 65536 : 0);
     file->dmode_lastline = flb_sds_create_size(ctx->docker_mode == FLB_TRUE ? 20000 : 0);
+    file->dmode_repl = flb_sds_create_size(ctx->docker_mode == FLB_TRUE ? 20000 : 0);
+    if (!file->dmode_buf || !file->dmode_lastline || !file->dmode_repl) {
+        flb_errno();
+        goto error;
+    }
+    if (ctx->docker_mode == FLB_TRUE) {
+        ret = flb_pack_state_init(&file->dmode_state);
+        if (ret != 0) {
+            goto error;
+        }
+    }
+    msgpack_sbuffer_init(&file->sbuf);
+    msgpack_packer_init(&file->pck, &file->sbuf, msgpack_sbuffer_write);
 #ifdef FLB_HAVE_SQLDB
-    file->db_id     = 0;
+    file->db_id      = 0;
+    file->db_pending = FLB_FALSE;
 #endif
     file->skip_next = FLB_FALSE;
     file->skip_warn = FLB_FALSE;
@@ -703,7 +750,7 @@ int flb_tail_file_append(char *path, struct stat *st, int mode,
         if (offset == -1) {
             flb_errno();
             flb_tail_file_remove(file);
-            goto error;
+            return -1;
         }
     }
 
@@ -724,6 +771,14 @@ error:
         if (file->name) {
             flb_free(file->name);
         }
+        flb_sds_destroy(file->dmode_buf);
+        flb_sds_destroy(file->dmode_lastline);
+        flb_sds_destroy(file->dmode_repl);
+        flb_pack_state_reset(&file->dmode_state);
+        msgpack_sbuffer_destroy(&file->sbuf);
+#ifdef FLB_HAVE_PARSER
+        flb_ml_stream_destroy(&file->ml_stream);
+#endif
         flb_free(file);
     }
     close(fd);
@@ -753,8 +808,21 @@ void flb_tail_file_remove(struct flb_tail_file *file)
         mk_list_del(&file->_rotate_head);
     }
 
+#ifdef FLB_HAVE_SQLDB
+    /* Persist the last offset before forgetting the file */
+    if (ctx->db) {
+        flb_tail_db_file_sync(file, ctx);
+    }
+#endif
+
     flb_sds_destroy(file->dmode_buf);
     flb_sds_destroy(file->dmode_lastline);
+    flb_sds_destroy(file->dmode_repl);
+    flb_pack_state_reset(&file->dmode_state);
+    msgpack_sbuffer_destroy(&file->sbuf);
+#ifdef FLB_HAVE_PARSER
+    flb_ml_stream_destroy(&file->ml_stream);
+#endif
     mk_list_del(&file->_head);
     flb_tail_fs_remove(file);
     close(file->fd);
@@ -795,25 +863,19 @@ int flb_tail_file_remove_all(struct flb_tail_config *ctx)
     return count;
 }
 
-int flb_tail_file_chunk(struct flb_tail_file *file)
+/*
+ * Make room in the file buffer for the next read, it returns the number of
+ * bytes that can be read in 'capacity'.
+ */
+int flb_tail_file_read_prepare(struct flb_tail_file *file, size_t *capacity)
 {
-    int ret;
     char *tmp;
     size_t size;
-    off_t capacity;
-    off_t processed_bytes;
-    ssize_t bytes;
-    struct stat st;
-    struct flb_tail_config *ctx;
-
-    /* Check if we the engine issued a pause */
-    ctx = file->config;
-    if (flb_input_buf_paused(ctx->ins) == FLB_TRUE) {
-        return FLB_TAIL_BUSY;
-    }
+    off_t available;
+    struct flb_tail_config *ctx = file->config;
 
-    capacity = (file->buf_size - file->buf_len) - 1;
-    if (capacity < 1) {
+    available = (file->buf_size - file->buf_len) - 1;
+    if (available < 1) {
         /*
          * If there is no more room for more data, try to increase the
          * buffer under the limit of buffer_max_size.
@@ -858,10 +920,89 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
                 return FLB_TAIL_ERROR;
             }
         }
-        capacity = (file->buf_size - file->buf_len) - 1;
+        available = (file->buf_size - file->buf_len) - 1;
+    }
+
+    *capacity = available;
+    return FLB_TAIL_OK;
+}
+
+/*
+ * A result read in a batch by the I/O backend was kept while the input was
+ * paused: if in the meantime the file was consumed or truncated the data
+ * does not belong to the buffer anymore, so it's dropped and the file
+ * position rewinded to where the read started.
+ */
+static int io_result_stale(struct flb_tail_file *file)
+{
+    int ret;
+    off_t offset;
+    struct stat st;
+    struct flb_tail_config *ctx = file->config;
+
+    if (file->io_offset == file->offset &&
+        file->io_buf_len == file->buf_len) {
+        if (file->io_bytes <= 0) {
+            return FLB_FALSE;
+        }
+
+        ret = fstat(file->fd, &st);
+        if (ret == 0 &&
+            st.st_size >= file->offset + file->buf_len + file->io_bytes) {
+            return FLB_FALSE;
+        }
+    }
+
+    flb_plg_debug(ctx->ins, "inode=%"PRIu64" file=%s dropping stale read "
+                  "of %zd bytes", file->inode, file->name, file->io_bytes);
+
+    if (file->io_bytes > 0) {
+        offset = lseek(file->fd, -file->io_bytes, SEEK_CUR);
+        if (offset == -1) {
+            flb_errno();
+        }
+    }
+
+    return FLB_TRUE;
+}
+
+int flb_tail_file_chunk(struct flb_tail_file *file)
+{
+    int ret;
+    size_t capacity;
+    off_t processed_bytes;
+    ssize_t bytes;
+    struct stat st;
+    struct flb_tail_config *ctx;
+
+    /* Check if we the engine issued a pause */
+    ctx = file->config;
+    if (flb_input_buf_paused(ctx->ins) == FLB_TRUE) {
+        return FLB_TAIL_BUSY;
+    }
+
+    if (file->io_pending == FLB_TRUE && io_result_stale(file) == FLB_TRUE) {
+        /* Read it again from the current position */
+        file->io_pending = FLB_FALSE;
+    }
+
+    if (file->io_pending == FLB_TRUE) {
+        /* The data was already read in a batch by the I/O backend */
+        file->io_pending = FLB_FALSE;
+        bytes = file->io_bytes;
+        if (bytes < 0) {
+            errno = -bytes;
+            bytes = -1;
+        }
+    }
+    else {
+        ret = flb_tail_file_read_prepare(file, &capacity);
+        if (ret != FLB_TAIL_OK) {
+            return ret;
+        }
+        bytes = read(file->fd, file->buf_data + file->buf_len, capacity);
     }
 
-    bytes = read(file->fd, file->buf_data + file->buf_len, capacity);
     if (bytes > 0) {
         /* we read some data, let the content processor take care of it */
         file->buf_len += bytes;
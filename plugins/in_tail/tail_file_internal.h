@@ -23,8 +23,10 @@
 
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_ml.h>
 
 #include "tail.h"
 #include "tail_config.h"
@@ -59,11 +61,16 @@ struct flb_tail_file {
     msgpack_sbuffer mult_sbuf;  /* temporal msgpack buffer               */
     msgpack_packer mult_pck;    /* temporal msgpack packer               */
     struct flb_time mult_time;  /* multiline time parsed from first line */
+#ifdef FLB_HAVE_PARSER
+    struct flb_ml_stream ml_stream; /* record of the multiline rule set  */
+#endif
 
     /* docker mode */
     time_t dmode_flush_timeout; /* time when docker mode started         */
     flb_sds_t dmode_buf;        /* buffer for docker mode                */
     flb_sds_t dmode_lastline;   /* last incomplete line                  */
+    flb_sds_t dmode_repl;       /* rewritten line, reused for every line */
+    struct flb_pack_state dmode_state; /* JSON tokens, reused            */
 
     /* buffering */
     off_t parsed;
@@ -71,6 +78,17 @@ struct flb_tail_file {
     size_t buf_size;
     char *buf_data;
 
+    /* result of a read done in a batch by the I/O backend (tail_io.c) */
+    int io_pending;             /* bool: read result not consumed yet    */
+    ssize_t io_bytes;           /* bytes read or -errno                  */
+    int io_queued;              /* bool: read submitted, not completed   */
+    off_t io_offset;            /* file offset when the read was queued  */
+    off_t io_buf_len;           /* buffer length when it was queued      */
+
+    /* records packed from the buffer, reused across reads */
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+
     /*
      * Long-lines handling: this flag is enabled when a previous line was
      * too long and the buffer did not contain a \n, so when reaching the
@@ -88,6 +106,8 @@ struct flb_tail_file {
 
     /* database reference */
     uint64_t db_id;
+    int db_pending;            /* offset not written yet ? */
+    struct mk_list _db_head;   /* link to config->db_pending */
 
     /* reference */
     int tail_mode;
@@ -254,6 +254,7 @@ static int tail_fs_event(struct flb_input_instance *ins,
                           file->inode, file->name);
             file->offset = offset;
             file->buf_len = 0;
+            file->io_pending = FLB_FALSE;
 
             /* Update offset in the database file */
 #ifdef FLB_HAVE_SQLDB
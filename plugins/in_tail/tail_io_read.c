@@ -0,0 +1,48 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_input.h>
+
+#include "tail_config.h"
+#include "tail_io.h"
+
+/*
+ * Default I/O backend: there is no batched read, every file is read with
+ * a plain read(2) from flb_tail_file_chunk().
+ */
+
+int flb_tail_io_init(struct flb_tail_config *ctx)
+{
+    ctx->io = NULL;
+    return 0;
+}
+
+int flb_tail_io_read(struct flb_tail_config *ctx, struct mk_list *files)
+{
+    (void) ctx;
+    (void) files;
+    return 0;
+}
+
+void flb_tail_io_exit(struct flb_tail_config *ctx)
+{
+    (void) ctx;
+}
@@ -0,0 +1,383 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_plugin.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "tail_config.h"
+#include "tail_file.h"
+#include "tail_io.h"
+
+/*
+ * I/O backend based on io_uring(7), Linux >= 5.6: the reads of every file
+ * with pending data are submitted to the kernel in a single system call,
+ * each one directly into the buffer of its file. Once all of them are
+ * completed the result is stored in the file, so flb_tail_file_chunk()
+ * consumes it instead of calling read(2).
+ *
+ * If the kernel does not support it (or it's blocked, e.g: by a seccomp
+ * profile) the plugin falls back to read(2).
+ */
+
+/* Max number of reads submitted at once */
+#define FLB_TAIL_IO_ENTRIES  256
+
+struct flb_tail_io {
+    int fd;                     /* io_uring instance                     */
+    unsigned int entries;       /* number of submission queue entries    */
+
+    /* submission queue */
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+
+    /* completion queue */
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* mapped memory */
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+};
+
+static inline int tail_io_setup(unsigned int entries,
+                                struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int tail_io_enter(int fd, unsigned int to_submit,
+                                unsigned int min_complete, unsigned int flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                   flags, NULL, 0);
+}
+
+static void io_destroy(struct flb_tail_io *io)
+{
+    if (io->sqes && io->sqes != MAP_FAILED) {
+        munmap(io->sqes, io->sqes_size);
+    }
+    if (io->cq_ring && io->cq_ring != MAP_FAILED &&
+        io->cq_ring != io->sq_ring) {
+        munmap(io->cq_ring, io->cq_ring_size);
+    }
+    if (io->sq_ring && io->sq_ring != MAP_FAILED) {
+        munmap(io->sq_ring, io->sq_ring_size);
+    }
+    if (io->fd >= 0) {
+        close(io->fd);
+    }
+    flb_free(io);
+}
+
+static int io_map(struct flb_tail_io *io, struct io_uring_params *p)
+{
+    char *sq;
+    char *cq;
+
+    io->sq_ring_size = p->sq_off.array + (p->sq_entries * sizeof(unsigned int));
+    io->cq_ring_size = p->cq_off.cqes +
+                       (p->cq_entries * sizeof(struct io_uring_cqe));
+
+    /* Both rings can share the same mapping */
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        if (io->cq_ring_size > io->sq_ring_size) {
+            io->sq_ring_size = io->cq_ring_size;
+        }
+        io->cq_ring_size = io->sq_ring_size;
+    }
+
+    io->sq_ring = mmap(NULL, io->sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, io->fd, IORING_OFF_SQ_RING);
+    if (io->sq_ring == MAP_FAILED) {
+        flb_errno();
+        return -1;
+    }
+
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        io->cq_ring = io->sq_ring;
+    }
+    else {
+        io->cq_ring = mmap(NULL, io->cq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, io->fd,
+                           IORING_OFF_CQ_RING);
+        if (io->cq_ring == MAP_FAILED) {
+            flb_errno();
+            return -1;
+        }
+    }
+
+    io->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, io->fd, IORING_OFF_SQES);
+    if (io->sqes == MAP_FAILED) {
+        flb_errno();
+        return -1;
+    }
+
+    sq = io->sq_ring;
+    io->sq_head  = (unsigned int *) (sq + p->sq_off.head);
+    io->sq_tail  = (unsigned int *) (sq + p->sq_off.tail);
+    io->sq_mask  = (unsigned int *) (sq + p->sq_off.ring_mask);
+    io->sq_array = (unsigned int *) (sq + p->sq_off.array);
+
+    cq = io->cq_ring;
+    io->cq_head = (unsigned int *) (cq + p->cq_off.head);
+    io->cq_tail = (unsigned int *) (cq + p->cq_off.tail);
+    io->cq_mask = (unsigned int *) (cq + p->cq_off.ring_mask);
+    io->cqes    = (struct io_uring_cqe *) (cq + p->cq_off.cqes);
+
+    io->entries = p->sq_entries;
+
+    return 0;
+}
+
+int flb_tail_io_init(struct flb_tail_config *ctx)
+{
+    int ret;
+    struct io_uring_params p;
+    struct flb_tail_io *io;
+
+    ctx->io = NULL;
+
+    io = flb_calloc(1, sizeof(struct flb_tail_io));
+    if (!io) {
+        flb_errno();
+        return -1;
+    }
+
+    memset(&p, '\0', sizeof(p));
+    io->fd = tail_io_setup(FLB_TAIL_IO_ENTRIES, &p);
+    if (io->fd == -1) {
+        flb_plg_info(ctx->ins, "io_uring is not available (%s), "
+                     "using read(2)", strerror(errno));
+        flb_free(io);
+        return 0;
+    }
+
+    /* Reads must use and update the current position of the file */
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        flb_plg_info(ctx->ins, "io_uring does not support reads from the "
+                     "current file position, using read(2)");
+        io_destroy(io);
+        return 0;
+    }
+
+    ret = io_map(io, &p);
+    if (ret == -1) {
+        flb_plg_info(ctx->ins, "cannot map io_uring queues, using read(2)");
+        io_destroy(io);
+        return 0;
+    }
+
+    flb_plg_debug(ctx->ins, "io_uring fd=%i entries=%u", io->fd, io->entries);
+    ctx->io = io;
+
+    return 0;
+}
+
+/*
+ * Submit 'count' queued reads and wait for all of them to complete, the
+ * result of each read is stored in its file. Returns the number of
+ * completed reads or -1 if the ring failed more than once in a row: the
+ * reads still in flight are then unknown to the caller.
+ */
+static int io_submit_wait(struct flb_tail_io *io, unsigned int count)
+{
+    int ret;
+    int errors = 0;
+    unsigned int head;
+    unsigned int tail;
+    unsigned int submitted = 0;
+    unsigned int completed = 0;
+    struct io_uring_cqe *cqe;
+    struct flb_tail_file *file;
+
+    while (completed < count) {
+        ret = tail_io_enter(io->fd, count - submitted, 1,
+                            IORING_ENTER_GETEVENTS);
+        if (ret == -1) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            flb_errno();
+            if (++errors > 1) {
+                return -1;
+            }
+            /*
+             * Take back the entries not consumed by the kernel, those
+             * files are read with read(2), and wait for the reads already
+             * in flight.
+             */
+            __atomic_store_n(io->sq_tail,
+                             __atomic_load_n(io->sq_head, __ATOMIC_ACQUIRE),
+                             __ATOMIC_RELEASE);
+            count = submitted;
+            continue;
+        }
+        errors = 0;
+        submitted += ret;
+
+        /* Reap completions */
+        head = *io->cq_head;
+        tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            cqe = &io->cqes[head & *io->cq_mask];
+            file = (struct flb_tail_file *) (uintptr_t) cqe->user_data;
+            file->io_bytes = cqe->res;
+            file->io_queued = FLB_FALSE;
+            file->io_pending = FLB_TRUE;
+            completed++;
+            head++;
+        }
+        __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return completed;
+}
+
+/*
+ * The ring cannot be used anymore: move the position of the files whose
+ * read was lost back to the data known by the plugin and let
+ * flb_tail_file_chunk() read them with read(2) from now on.
+ */
+static void io_fallback(struct flb_tail_config *ctx, struct mk_list *files)
+{
+    off_t offset;
+    struct mk_list *head;
+    struct flb_tail_file *file;
+
+    flb_plg_warn(ctx->ins, "io_uring failed, using read(2)");
+
+    mk_list_foreach(head, files) {
+        file = mk_list_entry(head, struct flb_tail_file, _head);
+        if (file->io_queued == FLB_FALSE) {
+            continue;
+        }
+        file->io_queued = FLB_FALSE;
+
+        offset = lseek(file->fd, file->offset + file->buf_len, SEEK_SET);
+        if (offset == -1) {
+            flb_errno();
+        }
+    }
+
+    io_destroy(ctx->io);
+    ctx->io = NULL;
+}
+
+int flb_tail_io_read(struct flb_tail_config *ctx, struct mk_list *files)
+{
+    int ret;
+    int total = 0;
+    size_t capacity;
+    unsigned int tail;
+    unsigned int index;
+    unsigned int queued = 0;
+    struct mk_list *head;
+    struct io_uring_sqe *sqe;
+    struct flb_tail_file *file;
+    struct flb_tail_io *io = ctx->io;
+
+    if (!io || flb_input_buf_paused(ctx->ins) == FLB_TRUE) {
+        return 0;
+    }
+
+    tail = *io->sq_tail;
+    mk_list_foreach(head, files) {
+        file = mk_list_entry(head, struct flb_tail_file, _head);
+
+        /* Skip files without new data or with a result not consumed yet */
+        if (file->pending_bytes <= 0 || file->io_pending == FLB_TRUE) {
+            continue;
+        }
+
+        ret = flb_tail_file_read_prepare(file, &capacity);
+        if (ret != FLB_TAIL_OK) {
+            continue;
+        }
+
+        index = tail & *io->sq_mask;
+        sqe = &io->sqes[index];
+        memset(sqe, '\0', sizeof(struct io_uring_sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = file->fd;
+        sqe->off = (uint64_t) -1;  /* current file position */
+        sqe->addr = (uint64_t) (uintptr_t) (file->buf_data + file->buf_len);
+        sqe->len = capacity;
+        sqe->user_data = (uint64_t) (uintptr_t) file;
+        io->sq_array[index] = index;
+        tail++;
+        queued++;
+
+        /* state the result is valid for, see flb_tail_file_chunk() */
+        file->io_queued = FLB_TRUE;
+        file->io_offset = file->offset;
+        file->io_buf_len = file->buf_len;
+
+        if (queued == io->entries) {
+            __atomic_store_n(io->sq_tail, tail, __ATOMIC_RELEASE);
+            ret = io_submit_wait(io, queued);
+            if (ret == -1) {
+                io_fallback(ctx, files);
+                return total;
+            }
+            total += ret;
+            tail = *io->sq_tail;
+            queued = 0;
+        }
+    }
+
+    if (queued > 0) {
+        __atomic_store_n(io->sq_tail, tail, __ATOMIC_RELEASE);
+        ret = io_submit_wait(io, queued);
+        if (ret == -1) {
+            io_fallback(ctx, files);
+            return total;
+        }
+        total += ret;
+    }
+
+    return total;
+}
+
+void flb_tail_io_exit(struct flb_tail_config *ctx)
+{
+    if (ctx->io) {
+        io_destroy(ctx->io);
+        ctx->io = NULL;
+    }
+}
@@ -22,6 +22,8 @@
 #include <fluent-bit/flb_input_plugin.h>
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_kv.h>
+#include <fluent-bit/flb_slist.h>
+#include <fluent-bit/flb_ml.h>
 
 #include "tail_config.h"
 #include "tail_multiline.h"
@@ -491,6 +493,156 @@ int flb_tail_mult_flush(msgpack_sbuffer *mp_sbuf, msgpack_packer *mp_pck,
     return 0;
 }
 
+/* Destination of the records composed by a multiline rule set */
+struct tail_ml_out {
+    struct flb_tail_file *file;
+    msgpack_sbuffer *mp_sbuf;
+    msgpack_packer *mp_pck;
+};
+
+int flb_tail_ml_create(struct flb_tail_config *ctx, struct flb_config *config)
+{
+    struct mk_list *head;
+    struct flb_slist_entry *e;
+
+    if (ctx->multiline == FLB_TRUE) {
+        flb_plg_error(ctx->ins, "'multiline.parser' cannot be used at the "
+                      "same time as 'multiline'");
+        return -1;
+    }
+
+    if (ctx->ml_max_lines <= 0) {
+        flb_plg_error(ctx->ins, "invalid 'multiline.max_lines' value");
+        return -1;
+    }
+
+    if (ctx->multiline_flush <= 0) {
+        ctx->multiline_flush = 1;
+    }
+
+    mk_list_foreach(head, ctx->ml_parsers) {
+        e = mk_list_entry(head, struct flb_slist_entry, _head);
+
+        /* split Docker lines are recombined by the Docker mode */
+        if (strcasecmp(e->str, "docker") == 0) {
+            ctx->docker_mode = FLB_TRUE;
+            continue;
+        }
+
+        if (ctx->ml) {
+            flb_plg_error(ctx->ins, "multiline: only one rule set can be used "
+                          "besides 'docker'");
+            return -1;
+        }
+
+        ctx->ml = flb_ml_builtin_create(e->str);
+        if (!ctx->ml) {
+            flb_plg_error(ctx->ins, "multiline: invalid parser '%s'", e->str);
+            return -1;
+        }
+        ctx->ml->max_lines = ctx->ml_max_lines;
+        ctx->ml->flush_timeout = ctx->multiline_flush;
+        flb_plg_debug(ctx->ins, "multiline: using '%s' rule set", e->str);
+    }
+
+    return 0;
+}
+
+void flb_tail_ml_destroy(struct flb_tail_config *ctx)
+{
+    if (ctx->ml) {
+        flb_ml_destroy(ctx->ml);
+        ctx->ml = NULL;
+    }
+}
+
+/* Pack a record composed by the rule set, the parser runs once per record */
+static int tail_ml_pack(const char *buf, size_t size, struct flb_time *tm,
+                        void *data)
+{
+    int ret;
+    void *out_buf;
+    size_t out_size;
+    struct flb_time out_time;
+    struct tail_ml_out *out = data;
+    struct flb_tail_file *file = out->file;
+    struct flb_tail_config *ctx = file->config;
+
+    if (ctx->parser) {
+        flb_time_zero(&out_time);
+        ret = flb_parser_do(ctx->parser, buf, size,
+                            &out_buf, &out_size, &out_time);
+        if (ret >= 0) {
+            if (flb_time_to_double(&out_time) == 0) {
+                flb_time_copy(&out_time, tm);
+            }
+            flb_tail_pack_line_map(out->mp_sbuf, out->mp_pck, &out_time,
+                                   (char **) &out_buf, &out_size, file);
+            flb_free(out_buf);
+            return 0;
+        }
+    }
+
+    flb_tail_file_pack_line(out->mp_sbuf, out->mp_pck, tm,
+                            (char *) buf, size, file);
+    return 0;
+}
+
+/*
+ * Process a line with the rule set, the completed records are packed into
+ * the file buffer. Returns FLB_ML_NA if the line is not part of a record.
+ */
+int flb_tail_ml_process(struct flb_time *tm, char *buf, int len,
+                        struct flb_tail_file *file,
+                        struct flb_tail_config *ctx)
+{
+    struct tail_ml_out out;
+
+    out.file = file;
+    out.mp_sbuf = &file->sbuf;
+    out.mp_pck = &file->pck;
+
+    return flb_ml_process(ctx->ml, &file->ml_stream, buf, len, tm,
+                          tail_ml_pack, &out);
+}
+
+static int tail_ml_pending_flush(struct flb_input_instance *ins,
+                                 struct flb_tail_config *ctx, time_t now)
+{
+    int ret;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+    struct mk_list *head;
+    struct flb_tail_file *file;
+    struct tail_ml_out out;
+
+    mk_list_foreach(head, &ctx->files_event) {
+        file = mk_list_entry(head, struct flb_tail_file, _head);
+        if (file->ml_stream.state < 0) {
+            continue;
+        }
+
+        msgpack_sbuffer_init(&mp_sbuf);
+        msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+        out.file = file;
+        out.mp_sbuf = &mp_sbuf;
+        out.mp_pck = &mp_pck;
+        ret = flb_ml_flush_pending(ctx->ml, &file->ml_stream, now,
+                                   tail_ml_pack, &out);
+        if (ret == 0 && mp_sbuf.size > 0) {
+            flb_input_chunk_append_raw(ins,
+                                       file->tag_buf,
+                                       file->tag_len,
+                                       mp_sbuf.data,
+                                       mp_sbuf.size);
+        }
+        msgpack_sbuffer_destroy(&mp_sbuf);
+    }
+
+    return 0;
+}
+
 int flb_tail_mult_pending_flush(struct flb_input_instance *ins,
                                 struct flb_config *config, void *context)
 {
@@ -503,6 +655,10 @@ int flb_tail_mult_pending_flush(struct flb_input_instance *ins,
 
     now = time(NULL);
 
+    if (ctx->ml) {
+        return tail_ml_pending_flush(ins, ctx, now);
+    }
+
     /* Iterate promoted event files with pending bytes */
     mk_list_foreach(head, &ctx->files_event) {
         file = mk_list_entry(head, struct flb_tail_file, _head);
@@ -55,4 +55,11 @@ int flb_tail_mult_flush(msgpack_sbuffer *mp_sbuf,
 int flb_tail_mult_pending_flush(struct flb_input_instance *ins,
                                 struct flb_config *config, void *context);
 
+/* Multiline rule sets (flb_ml) */
+int flb_tail_ml_create(struct flb_tail_config *ctx, struct flb_config *config);
+void flb_tail_ml_destroy(struct flb_tail_config *ctx);
+int flb_tail_ml_process(struct flb_time *tm, char *buf, int len,
+                        struct flb_tail_file *file,
+                        struct flb_tail_config *ctx);
+
 #endif
@@ -56,7 +56,8 @@
 #define SQL_PRAGMA_SYNC                         \
     "PRAGMA synchronous=%i;"
 
-#define SQL_PRAGMA_JOURNAL_MODE                 \
-    "PRAGMA journal_mode=OFF;"
+#define SQL_BEGIN     "BEGIN;"
+#define SQL_COMMIT    "COMMIT;"
+#define SQL_ROLLBACK  "ROLLBACK;"
 
 #endif
@@ -67,7 +67,7 @@ static int azure_format(const void *in_buf, size_t in_bytes,
     flb_sds_t record;
 
     /* Count number of items */
-    array_size = flb_mp_count(in_buf, in_bytes);
+    array_size = flb_output_records_count(in_buf, in_bytes);
     msgpack_unpacked_init(&result);
 
     /* Create temporal msgpack buffer */
@@ -68,7 +68,7 @@ static void cb_counter_flush(const void *data, size_t bytes,
     struct flb_time tm;
 
     /* Count number of parent items */
-    cnt = flb_mp_count(data, bytes);
+    cnt = flb_output_records_count(data, bytes);
     ctx->total += cnt;
 
     flb_time_get(&tm);
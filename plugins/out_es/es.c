@@ -22,6 +22,7 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_network.h>
 #include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_compress.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_signv4.h>
@@ -462,6 +463,13 @@ static int cb_es_init(struct flb_output_instance *ins,
 {
     struct flb_elasticsearch *ctx;
 
+    /* The codec must be known by the server as a Content-Encoding */
+    if (ins->compress && !ins->compress->encoding) {
+        flb_plg_error(ins, "compression '%s' is not supported over HTTP",
+                      ins->compress->name);
+        return -1;
+    }
+
     ctx = flb_es_conf_create(ins, config);
     if (!ctx) {
         flb_plg_error(ins, "cannot initialize plugin");
@@ -591,7 +599,10 @@ static void cb_es_flush(const void *data, size_t bytes,
     char *pack;
     void *out_buf;
     size_t out_size;
+    void *body;
+    size_t body_size;
     size_t b_sent;
+    struct flb_compress_codec *codec = NULL;
     struct flb_elasticsearch *ctx = out_context;
     struct flb_upstream_conn *u_conn;
     struct flb_http_client *c;
@@ -617,12 +628,36 @@ static void cb_es_flush(const void *data, size_t bytes,
     pack = (char *) out_buf;
     pack_size = out_size;
 
+    /* Compress the request body, 'pack' is kept for error tracing */
+    body = pack;
+    body_size = pack_size;
+    if (ctx->ins->compress) {
+        ret = flb_compress_buffer(ctx->ins->compress, ctx->ins->compress_level,
+                                  pack, pack_size, &body, &body_size);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "cannot compress payload (%s), "
+                          "disabling compression", ctx->ins->compress->name);
+            body = pack;
+            body_size = pack_size;
+        }
+        else {
+            codec = ctx->ins->compress;
+        }
+    }
+
     /* Compose HTTP Client request */
     c = flb_http_client(u_conn, FLB_HTTP_POST, ctx->uri,
-                        pack, pack_size, NULL, 0, NULL, 0);
+                        body, body_size, NULL, 0, NULL, 0);
 
     flb_http_buffer_size(c, ctx->buffer_size);
 
+    if (codec) {
+        flb_http_add_header(c,
+                            FLB_HTTP_HEADER_CONTENT_ENCODING,
+                            sizeof(FLB_HTTP_HEADER_CONTENT_ENCODING) - 1,
+                            codec->encoding, strlen(codec->encoding));
+    }
+
 #ifndef FLB_HAVE_AWS
     flb_http_add_header(c, "User-Agent", 10, "Fluent-Bit", 10);
 #endif
@@ -697,6 +732,9 @@ static void cb_es_flush(const void *data, size_t bytes,
 
     /* Cleanup */
     flb_http_client_destroy(c);
+    if (body != pack) {
+        flb_free(body);
+    }
     flb_free(pack);
     flb_upstream_conn_release(u_conn);
     if (signature) {
@@ -707,6 +745,9 @@ static void cb_es_flush(const void *data, size_t bytes,
     /* Issue a retry */
  retry:
     flb_http_client_destroy(c);
+    if (body != pack) {
+        flb_free(body);
+    }
     flb_free(pack);
     flb_upstream_conn_release(u_conn);
     FLB_OUTPUT_RETURN(FLB_RETRY);
@@ -878,5 +919,5 @@ struct flb_output_plugin out_es_plugin = {
     .test_formatter.callback = elasticsearch_format,
 
     /* Plugin flags */
-    .flags          = FLB_OUTPUT_NET | FLB_IO_OPT_TLS,
+    .flags          = FLB_OUTPUT_NET | FLB_OUTPUT_COMPRESS | FLB_IO_OPT_TLS,
 };
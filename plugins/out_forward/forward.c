@@ -26,6 +26,7 @@
 #include <fluent-bit/flb_upstream_ha.h>
 #include <fluent-bit/flb_sha512.h>
 #include <fluent-bit/flb_config_map.h>
+#include <fluent-bit/flb_compress.h>
 #include <msgpack.h>
 
 #include "forward.h"
@@ -436,18 +437,13 @@ static int secure_forward_handshake(struct flb_upstream_conn *u_conn,
     return 0;
 }
 
-static int secure_forward_write_options(struct flb_upstream_conn *u_conn,
-                                        struct flb_forward_config *fc,
-                                        struct flb_forward *ctx,
+/* Pack the options map, it's sent after the entries */
+static void secure_forward_pack_options(msgpack_packer *mp_pck,
                                         size_t size,
                                         char *chunk,
-                                        size_t *bytes_sent_ptr)
+                                        int compressed)
 {
-    int ret;
     int opt_count = 1;
-    msgpack_packer   mp_pck;
-    msgpack_sbuffer  mp_sbuf;
-    size_t bytes_sent = 0;
     size_t chunk_size = 0;
 
     if(chunk) {
@@ -456,33 +452,33 @@ static int secure_forward_write_options(struct flb_upstream_conn *u_conn,
             opt_count++;
         }
     }
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+    if (compressed == FLB_TRUE) {
+        opt_count++;
+    }
 
     // options is map
-    msgpack_pack_map(&mp_pck,opt_count);
+    msgpack_pack_map(mp_pck, opt_count);
 
     // "chunk": '<checksum-base-64>'
     if(chunk && chunk_size > 0) {
-        msgpack_pack_str(&mp_pck, 5);
-        msgpack_pack_str_body(&mp_pck, "chunk", 5);
-        msgpack_pack_str(&mp_pck, chunk_size);
-        msgpack_pack_str_body(&mp_pck, chunk, chunk_size);
+        msgpack_pack_str(mp_pck, 5);
+        msgpack_pack_str_body(mp_pck, "chunk", 5);
+        msgpack_pack_str(mp_pck, chunk_size);
+        msgpack_pack_str_body(mp_pck, chunk, chunk_size);
     }
 
     // "size": entries
-    msgpack_pack_str(&mp_pck, 4);
-    msgpack_pack_str_body(&mp_pck, "size", 4);
-    msgpack_pack_int64(&mp_pck, size);
+    msgpack_pack_str(mp_pck, 4);
+    msgpack_pack_str_body(mp_pck, "size", 4);
+    msgpack_pack_int64(mp_pck, size);
 
-    ret = flb_io_net_write(u_conn, mp_sbuf.data, mp_sbuf.size, &bytes_sent);
-    if (ret == -1) {
-        msgpack_sbuffer_destroy(&mp_sbuf);
-        return -1;
+    // "compressed": "gzip"
+    if (compressed == FLB_TRUE) {
+        msgpack_pack_str(mp_pck, 10);
+        msgpack_pack_str_body(mp_pck, "compressed", 10);
+        msgpack_pack_str(mp_pck, 4);
+        msgpack_pack_str_body(mp_pck, "gzip", 4);
     }
-    if(bytes_sent_ptr) *bytes_sent_ptr = bytes_sent;
-    msgpack_sbuffer_destroy(&mp_sbuf);
-    return 0;
 }
 
 
@@ -843,6 +839,14 @@ static int cb_forward_init(struct flb_output_instance *ins,
     mk_list_init(&ctx->configs);
     flb_output_set_context(ins, ctx);
 
+    /* Forward protocol only defines gzip for CompressedPackedForward */
+    if (ins->compress && ins->compress->type != FLB_COMPRESS_GZIP) {
+        flb_plg_error(ctx->ins, "compression '%s' is not supported, only "
+                      "'gzip' is defined by the Forward protocol",
+                      ins->compress->name);
+        return -1;
+    }
+
     /* Configure HA or simple mode ? */
     tmp = flb_output_get_property("upstream", ins);
     if (tmp) {
@@ -893,9 +897,11 @@ static int data_compose(const void *data, size_t bytes,
         }
     }
     else {
-        while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
-            entries++;
-        }
+        /*
+         * The original buffer is sent as it is, the number of entries is
+         * known from the chunk metadata.
+         */
+        entries = flb_output_records_count(data, bytes);
     }
 
     /* cleanup */
@@ -952,11 +958,16 @@ static void cb_forward_flush(const void *data, size_t bytes,
 {
     int ret = -1;
     int entries = 0;
+    int iovcnt = 2;
+    int compressed = FLB_FALSE;
     size_t total;
-    size_t bytes_sent;
     msgpack_packer   mp_pck;
     msgpack_sbuffer  mp_sbuf;
+    msgpack_sbuffer  opt_sbuf;
+    struct iovec iov[3];
     void *tmp_buf = NULL;
+    void *gz_buf = NULL;
+    size_t gz_size;
     const void *out_buf = NULL;
     size_t out_size = 0;
     struct flb_forward *ctx = out_context;
@@ -965,7 +976,7 @@ static void cb_forward_flush(const void *data, size_t bytes,
     struct flb_upstream_node *node;
     (void) i_ins;
     (void) config;
-    char *chunkptr;
+    char *chunkptr = NULL;
     struct flb_sha512 sha512;
     uint8_t checksum[64];
     char checksum_hex[33];
@@ -992,7 +1003,7 @@ static void cb_forward_flush(const void *data, size_t bytes,
     msgpack_sbuffer_init(&mp_sbuf);
     msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
 
-    /* Count number of entries, is there a better way to do this ? */
+    /* Count number of entries */
     entries = data_compose(data, bytes, &tmp_buf, &out_size, fc, ctx);
     out_buf = tmp_buf;
     if (out_buf == NULL && fc->time_as_integer == FLB_FALSE) {
@@ -1003,8 +1014,29 @@ static void cb_forward_flush(const void *data, size_t bytes,
     flb_plg_debug(ctx->ins, "%i entries tag='%s' tag_len=%i",
                   entries, tag, tag_len);
 
+    /*
+     * CompressedPackedForward: the entries are sent as a gzip binary and
+     * the receiver is notified through the 'compressed' option.
+     */
+    if (ctx->ins->compress) {
+        ret = flb_compress_buffer(ctx->ins->compress, ctx->ins->compress_level,
+                                  out_buf, out_size, &gz_buf, &gz_size);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "cannot gzip payload, "
+                          "disabling compression");
+        }
+        else {
+            flb_free(tmp_buf);
+            tmp_buf = gz_buf;
+            out_buf = gz_buf;
+            out_size = gz_size;
+            compressed = FLB_TRUE;
+        }
+    }
+
     /* Output: root array */
-    msgpack_pack_array(&mp_pck, fc->send_options ? 3 : 2);
+    msgpack_pack_array(&mp_pck,
+                       (fc->send_options || compressed) ? 3 : 2);
     if (fc->tag) {
         const int len = strlen(fc->tag);
 
@@ -1015,7 +1047,34 @@ static void cb_forward_flush(const void *data, size_t bytes,
         msgpack_pack_str(&mp_pck, tag_len);
         msgpack_pack_str_body(&mp_pck, tag, tag_len);
     }
-    msgpack_pack_array(&mp_pck, entries);
+    if (compressed == FLB_TRUE) {
+        msgpack_pack_bin(&mp_pck, out_size);
+    }
+    else {
+        msgpack_pack_array(&mp_pck, entries);
+    }
+
+    /* Options are sent after the entries */
+    msgpack_sbuffer_init(&opt_sbuf);
+    if (fc->send_options || compressed) {
+        if (fc->require_ack_response) {
+            /* for ack we calculate  sha512 of context, take 16 bytes,  make 32 byte hex string of it */
+            flb_sha512_init(&sha512);
+            flb_sha512_update(&sha512,data,bytes);
+            flb_sha512_sum(&sha512,checksum); // => 65 bytes
+            secure_forward_bin_to_hex(checksum, 16, checksum_hex);
+            checksum_hex[32] = '\0';
+            chunkptr = (char*) checksum_hex;
+        }
+
+        flb_plg_debug(ctx->ins,
+                      "send options entries=%d chunk='%s'",
+                      entries, chunkptr ? chunkptr : "NULL");
+
+        msgpack_packer_init(&mp_pck, &opt_sbuf, msgpack_sbuffer_write);
+        secure_forward_pack_options(&mp_pck, entries, chunkptr, compressed);
+        iovcnt++;
+    }
 
     /* Get a TCP connection instance */
     if (ctx->ha_mode == FLB_TRUE) {
@@ -1027,9 +1086,8 @@ static void cb_forward_flush(const void *data, size_t bytes,
     if (!u_conn) {
         flb_plg_error(ctx->ins, "no upstream connections available");
         msgpack_sbuffer_destroy(&mp_sbuf);
-        if (fc->time_as_integer == FLB_TRUE) {
-            flb_free(tmp_buf);
-        }
+        msgpack_sbuffer_destroy(&opt_sbuf);
+        flb_free(tmp_buf);
         FLB_OUTPUT_RETURN(FLB_RETRY);
     }
 
@@ -1041,78 +1099,37 @@ static void cb_forward_flush(const void *data, size_t bytes,
         if (ret == -1) {
             flb_upstream_conn_release(u_conn);
             msgpack_sbuffer_destroy(&mp_sbuf);
-            if (fc->time_as_integer == FLB_TRUE) {
-                flb_free(tmp_buf);
-            }
+            msgpack_sbuffer_destroy(&opt_sbuf);
+            flb_free(tmp_buf);
             FLB_OUTPUT_RETURN(FLB_RETRY);
         }
     }
 
-    /* Write message header */
-    ret = flb_io_net_write(u_conn, mp_sbuf.data, mp_sbuf.size, &bytes_sent);
-    if (ret == -1) {
-        flb_plg_error(ctx->ins, "could not write chunk header");
-        msgpack_sbuffer_destroy(&mp_sbuf);
-        flb_upstream_conn_release(u_conn);
-        if (fc->time_as_integer == FLB_TRUE) {
-            flb_free(tmp_buf);
-        }
-        FLB_OUTPUT_RETURN(FLB_RETRY);
-    }
+    /* Write message header, body (records) and options at once */
+    iov[0].iov_base = mp_sbuf.data;
+    iov[0].iov_len = mp_sbuf.size;
+    iov[1].iov_base = (void *) out_buf;
+    iov[1].iov_len = out_size;
+    iov[2].iov_base = opt_sbuf.data;
+    iov[2].iov_len = opt_sbuf.size;
 
+    ret = flb_io_net_writev(u_conn, iov, iovcnt, &total);
     msgpack_sbuffer_destroy(&mp_sbuf);
-    total = ret;
-
-    /* Write body (records) */
-    ret = flb_io_net_write(u_conn, out_buf, out_size, &bytes_sent);
+    msgpack_sbuffer_destroy(&opt_sbuf);
+    flb_free(tmp_buf);
     if (ret == -1) {
-        flb_plg_error(ctx->ins, "error writing content body");
-        if (fc->time_as_integer == FLB_TRUE) {
-            flb_free(tmp_buf);
-        }
+        flb_plg_error(ctx->ins, "error writing records");
         flb_upstream_conn_release(u_conn);
         FLB_OUTPUT_RETURN(FLB_RETRY);
     }
 
-    total += bytes_sent;
-
-    if (fc->time_as_integer == FLB_TRUE) {
-        flb_free(tmp_buf);
-    }
-
-    if (fc->send_options) {
-        chunkptr = NULL;
-        if (fc->require_ack_response) {
-            /* for ack we calculate  sha512 of context, take 16 bytes,  make 32 byte hex string of it */
-            flb_sha512_init(&sha512);
-            flb_sha512_update(&sha512,data,bytes);
-            flb_sha512_sum(&sha512,checksum); // => 65 bytes
-            secure_forward_bin_to_hex(checksum, 16, checksum_hex);
-            checksum_hex[32] = '\0';
-            chunkptr = (char*) checksum_hex;
-        }
-
-        flb_plg_debug(ctx->ins,
-                      "send options entries=%d chunk='%s'",
-                      entries, chunkptr ? chunkptr : "NULL");
-
-        ret = secure_forward_write_options(u_conn, fc, ctx, entries, chunkptr, &bytes_sent);
+    if (chunkptr) {
+        ret = secure_forward_read_ack(u_conn, fc, ctx, chunkptr);
         if (ret < 0) {
-            flb_plg_error(ctx->ins, "error writing option");
+            flb_plg_error(ctx->ins, "error wait ACK");
             flb_upstream_conn_release(u_conn);
             FLB_OUTPUT_RETURN(FLB_RETRY);
         }
-
-        total += bytes_sent;
-
-        if(chunkptr) {
-            ret = secure_forward_read_ack(u_conn, fc, ctx, chunkptr);
-            if (ret < 0) {
-                flb_plg_error(ctx->ins, "error wait ACK");
-                flb_upstream_conn_release(u_conn);
-                FLB_OUTPUT_RETURN(FLB_RETRY);
-            }
-        }
     }
 
     flb_upstream_conn_release(u_conn);
@@ -1185,5 +1202,5 @@ struct flb_output_plugin out_forward_plugin = {
     .cb_flush     = cb_forward_flush,
     .cb_exit      = cb_forward_exit,
     .config_map   = config_map,
-    .flags        = FLB_OUTPUT_NET | FLB_IO_OPT_TLS,
+    .flags        = FLB_OUTPUT_NET | FLB_OUTPUT_COMPRESS | FLB_IO_OPT_TLS,
 };
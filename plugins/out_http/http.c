@@ -27,7 +27,7 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_sds.h>
-#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_compress.h>
 #include <msgpack.h>
 
 #include <stdio.h>
@@ -69,8 +69,8 @@ static int http_post(struct flb_out_http *ctx,
 {
     int ret;
     int out_ret = FLB_OK;
-    int compressed = FLB_FALSE;
     size_t b_sent;
+    struct flb_compress_codec *codec = NULL;
     void *payload_buf = NULL;
     size_t payload_size = 0;
     struct flb_upstream *u;
@@ -95,15 +95,18 @@ static int http_post(struct flb_out_http *ctx,
     payload_size = body_len;
 
     /* Should we compress the payload ? */
-    if (ctx->compress_gzip == FLB_TRUE) {
-        ret = flb_gzip_compress((void *) body, body_len,
-                                &payload_buf, &payload_size);
+    if (ctx->ins->compress) {
+        ret = flb_compress_buffer(ctx->ins->compress, ctx->ins->compress_level,
+                                  body, body_len,
+                                  &payload_buf, &payload_size);
         if (ret == -1) {
-            flb_plg_error(ctx->ins,
-                          "cannot gzip payload, disabling compression");
+            flb_plg_error(ctx->ins, "cannot compress payload (%s), "
+                          "disabling compression", ctx->ins->compress->name);
+            payload_buf = (void *) body;
+            payload_size = body_len;
         }
         else {
-            compressed = FLB_TRUE;
+            codec = ctx->ins->compress;
         }
     }
 
@@ -145,9 +148,12 @@ static int http_post(struct flb_out_http *ctx,
                             tag, tag_len);
     }
 
-    /* Content Encoding: gzip */
-    if (compressed == FLB_TRUE) {
-        flb_http_set_content_encoding_gzip(c);
+    /* Content Encoding */
+    if (codec) {
+        flb_http_add_header(c,
+                            FLB_HTTP_HEADER_CONTENT_ENCODING,
+                            sizeof(FLB_HTTP_HEADER_CONTENT_ENCODING) - 1,
+                            codec->encoding, strlen(codec->encoding));
     }
 
     /* Basic Auth headers */
@@ -364,11 +370,6 @@ static struct flb_config_map config_map[] = {
      0, FLB_TRUE, offsetof(struct flb_out_http, json_date_key),
      NULL
     },
-    {
-     FLB_CONFIG_MAP_STR, "compress", NULL,
-     0, FLB_FALSE, 0,
-     NULL
-    },
     {
      FLB_CONFIG_MAP_SLIST_1, "header", NULL,
      FLB_CONFIG_MAP_MULT, FLB_TRUE, offsetof(struct flb_out_http, headers),
@@ -420,5 +421,6 @@ struct flb_output_plugin out_http_plugin = {
     .cb_flush    = cb_http_flush,
     .cb_exit     = cb_http_exit,
     .config_map  = config_map,
-    .flags       = FLB_OUTPUT_NET | FLB_IO_OPT_TLS,
+    .flags       = FLB_OUTPUT_NET | FLB_OUTPUT_COMPRESS | FLB_IO_OPT_TLS |
+                   FLB_OUTPUT_WORKERS,
 };
@@ -55,9 +55,6 @@ struct flb_out_http {
     /* Include tag in header */
     flb_sds_t header_tag;
 
-    /* Compression mode (gzip) */
-    int compress_gzip;
-
     /* Upstream connection to the backend server */
     struct flb_upstream *u;
 
@@ -56,6 +56,14 @@ struct flb_out_http *flb_http_conf_create(struct flb_output_instance *ins,
         return NULL;
     }
 
+    /* The codec must be known by the receiver as a Content-Encoding */
+    if (ins->compress && !ins->compress->encoding) {
+        flb_plg_error(ctx->ins, "compression '%s' is not supported over HTTP",
+                      ins->compress->name);
+        flb_free(ctx);
+        return NULL;
+    }
+
     /*
      * Check if a Proxy have been set, if so the Upstream manager will use
      * the Proxy end-point and then we let the HTTP client know about it, so
@@ -174,15 +182,6 @@ struct flb_out_http *flb_http_conf_create(struct flb_output_instance *ins,
         }
     }
 
-    /* Compress (gzip) */
-    tmp = flb_output_get_property("compress", ins);
-    ctx->compress_gzip = FLB_FALSE;
-    if (tmp) {
-        if (strcasecmp(tmp, "gzip") == 0) {
-            ctx->compress_gzip = FLB_TRUE;
-        }
-    }
-
     ctx->u = upstream;
     ctx->uri = uri;
     ctx->host = ins->host.name;
@@ -177,7 +177,10 @@ static void out_lib_flush(const void *data, size_t bytes,
             break;
         }
 
-        /* Invoke user callback */
+        /*
+         * Invoke user callback, when the instance runs 'workers' it's called
+         * from several threads at the same time.
+         */
         ctx->cb_func(data_for_user, data_size, ctx->cb_data);
         last_off = off;
         count++;
@@ -201,5 +204,5 @@ struct flb_output_plugin out_lib_plugin = {
     .cb_init      = out_lib_init,
     .cb_flush     = out_lib_flush,
     .cb_exit      = out_lib_exit,
-    .flags        = 0,
+    .flags        = FLB_OUTPUT_WORKERS,
 };
@@ -149,7 +149,7 @@ static flb_sds_t logdna_compose_payload(struct flb_logdna *ctx,
     msgpack_sbuffer mp_sbuf;
 
     /* Count number of records */
-    total_lines = flb_mp_count(data, bytes);
+    total_lines = flb_output_records_count(data, bytes);
 
     /* Initialize msgpack buffers */
     msgpack_unpacked_init(&result);
@@ -171,7 +171,7 @@ static flb_sds_t newrelic_compose_payload(struct flb_newrelic *ctx,
      */
 
     /* Count number of records */
-    total_records = flb_mp_count(data, bytes);
+    total_records = flb_output_records_count(data, bytes);
 
     /* Initialize msgpack buffers */
     msgpack_unpacked_init(&result);
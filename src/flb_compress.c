@@ -0,0 +1,727 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_compress.h>
+#include <fluent-bit/flb_gzip.h>
+#include <miniz/miniz.h>
+
+#ifdef FLB_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef FLB_HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#ifdef FLB_HAVE_SNAPPY
+#include <snappy-c.h>
+#endif
+
+/* Minimum room requested on every write to the output buffer */
+#define FLB_COMPRESS_CHUNK  16384
+
+/* Make sure the output buffer have room for 'size' more bytes */
+static int out_reserve(struct flb_compress *ctx, size_t size)
+{
+    size_t alloc;
+    char *tmp;
+
+    if (ctx->alloc - ctx->size >= size) {
+        return 0;
+    }
+
+    alloc = ctx->alloc * 2;
+    if (alloc < ctx->size + size) {
+        alloc = ctx->size + size;
+    }
+
+    tmp = flb_realloc(ctx->buf, alloc);
+    if (!tmp) {
+        flb_errno();
+        return -1;
+    }
+    ctx->buf = tmp;
+    ctx->alloc = alloc;
+
+    return 0;
+}
+
+/* Same as above for the buffers used by the uncompress callbacks */
+static int buf_reserve(char **buf, size_t *alloc, size_t size, size_t room)
+{
+    size_t new_alloc;
+    char *tmp;
+
+    if (*alloc - size >= room) {
+        return 0;
+    }
+
+    new_alloc = *alloc * 2;
+    if (new_alloc < size + room) {
+        new_alloc = size + room;
+    }
+
+    tmp = flb_realloc(*buf, new_alloc);
+    if (!tmp) {
+        flb_errno();
+        return -1;
+    }
+    *buf = tmp;
+    *alloc = new_alloc;
+
+    return 0;
+}
+
+/*
+ * GZip: miniz only provides raw deflate streams, the content is deflated
+ * here as it comes and framed with the gzip header and footer of flb_gzip.
+ */
+
+struct gzip_state {
+    mz_stream strm;
+    mz_ulong crc;
+    size_t in_len;
+};
+
+static int gzip_deflate(struct flb_compress *ctx, int flush)
+{
+    int status;
+    size_t avail;
+    struct gzip_state *gz = ctx->state;
+
+    while (1) {
+        if (out_reserve(ctx, FLB_COMPRESS_CHUNK) != 0) {
+            return -1;
+        }
+
+        avail = ctx->alloc - ctx->size;
+        gz->strm.next_out = (unsigned char *) ctx->buf + ctx->size;
+        gz->strm.avail_out = avail;
+
+        status = mz_deflate(&gz->strm, flush);
+        ctx->size += avail - gz->strm.avail_out;
+
+        if (status == MZ_STREAM_END) {
+            return 0;
+        }
+        else if (status != MZ_OK && status != MZ_BUF_ERROR) {
+            flb_error("[compress] gzip deflate failed (%i)", status);
+            return -1;
+        }
+
+        /* Everything was consumed and the output was not exhausted */
+        if (flush == MZ_NO_FLUSH && gz->strm.avail_in == 0 &&
+            gz->strm.avail_out > 0) {
+            return 0;
+        }
+    }
+}
+
+static int gzip_init(struct flb_compress *ctx)
+{
+    int ret;
+    int level;
+    struct gzip_state *gz;
+
+    gz = flb_calloc(1, sizeof(struct gzip_state));
+    if (!gz) {
+        flb_errno();
+        return -1;
+    }
+
+    level = ctx->level;
+    if (level == FLB_COMPRESS_LEVEL_DEFAULT) {
+        level = MZ_DEFAULT_COMPRESSION;
+    }
+
+    ret = mz_deflateInit2(&gz->strm, level, MZ_DEFLATED,
+                          -MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY);
+    if (ret != MZ_OK) {
+        flb_free(gz);
+        return -1;
+    }
+    gz->crc = MZ_CRC32_INIT;
+    ctx->state = gz;
+
+    /* Header: magic bytes, deflate method, no flags, unknown OS */
+    if (out_reserve(ctx, FLB_GZIP_HEADER_SIZE) != 0) {
+        return -1;
+    }
+    flb_gzip_header(ctx->buf);
+    ctx->size = FLB_GZIP_HEADER_SIZE;
+
+    return 0;
+}
+
+static int gzip_update(struct flb_compress *ctx, const void *data, size_t size)
+{
+    struct gzip_state *gz = ctx->state;
+
+    gz->crc = mz_crc32(gz->crc, data, size);
+    gz->in_len += size;
+
+    gz->strm.next_in = data;
+    gz->strm.avail_in = size;
+
+    return gzip_deflate(ctx, MZ_NO_FLUSH);
+}
+
+static int gzip_finish(struct flb_compress *ctx)
+{
+    struct gzip_state *gz = ctx->state;
+
+    gz->strm.next_in = NULL;
+    gz->strm.avail_in = 0;
+    if (gzip_deflate(ctx, MZ_FINISH) != 0) {
+        return -1;
+    }
+
+    /* Footer: CRC32 and input size */
+    if (out_reserve(ctx, FLB_GZIP_FOOTER_SIZE) != 0) {
+        return -1;
+    }
+    flb_gzip_footer(ctx->buf + ctx->size, gz->crc, gz->in_len);
+    ctx->size += FLB_GZIP_FOOTER_SIZE;
+
+    return 0;
+}
+
+static void gzip_destroy(struct flb_compress *ctx)
+{
+    struct gzip_state *gz = ctx->state;
+
+    if (gz) {
+        mz_deflateEnd(&gz->strm);
+        flb_free(gz);
+    }
+}
+
+static int gzip_uncompress(const void *in_data, size_t in_len,
+                           void **out_data, size_t *out_len)
+{
+    return flb_gzip_uncompress((void *) in_data, in_len, out_data, out_len);
+}
+
+#ifdef FLB_HAVE_ZSTD
+static int zstd_stream(struct flb_compress *ctx, const void *data, size_t size,
+                       ZSTD_EndDirective mode)
+{
+    size_t ret;
+    ZSTD_inBuffer in = { data, size, 0 };
+    ZSTD_outBuffer out;
+
+    do {
+        if (out_reserve(ctx, ZSTD_CStreamOutSize()) != 0) {
+            return -1;
+        }
+        out.dst = ctx->buf + ctx->size;
+        out.size = ctx->alloc - ctx->size;
+        out.pos = 0;
+
+        ret = ZSTD_compressStream2(ctx->state, &out, &in, mode);
+        if (ZSTD_isError(ret)) {
+            flb_error("[compress] zstd: %s", ZSTD_getErrorName(ret));
+            return -1;
+        }
+        ctx->size += out.pos;
+    } while ((mode == ZSTD_e_end && ret != 0) || in.pos < in.size);
+
+    return 0;
+}
+
+static int zstd_init(struct flb_compress *ctx)
+{
+    ZSTD_CCtx *cctx;
+
+    cctx = ZSTD_createCCtx();
+    if (!cctx) {
+        return -1;
+    }
+    ctx->state = cctx;
+
+    if (ctx->level != FLB_COMPRESS_LEVEL_DEFAULT) {
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, ctx->level);
+    }
+
+    return 0;
+}
+
+static int zstd_update(struct flb_compress *ctx, const void *data, size_t size)
+{
+    return zstd_stream(ctx, data, size, ZSTD_e_continue);
+}
+
+static int zstd_finish(struct flb_compress *ctx)
+{
+    return zstd_stream(ctx, NULL, 0, ZSTD_e_end);
+}
+
+static void zstd_destroy(struct flb_compress *ctx)
+{
+    ZSTD_freeCCtx(ctx->state);
+}
+
+static int zstd_uncompress(const void *in_data, size_t in_len,
+                           void **out_data, size_t *out_len)
+{
+    size_t ret = 1;
+    size_t size = 0;
+    size_t alloc = 0;
+    char *buf = NULL;
+    ZSTD_DCtx *dctx;
+    ZSTD_inBuffer in = { in_data, in_len, 0 };
+    ZSTD_outBuffer out;
+
+    dctx = ZSTD_createDCtx();
+    if (!dctx) {
+        return -1;
+    }
+
+    while (in.pos < in.size) {
+        if (buf_reserve(&buf, &alloc, size, ZSTD_DStreamOutSize()) != 0) {
+            ret = 1;
+            break;
+        }
+        out.dst = buf + size;
+        out.size = alloc - size;
+        out.pos = 0;
+
+        ret = ZSTD_decompressStream(dctx, &out, &in);
+        if (ZSTD_isError(ret)) {
+            flb_error("[compress] zstd: %s", ZSTD_getErrorName(ret));
+            break;
+        }
+        size += out.pos;
+    }
+    ZSTD_freeDCtx(dctx);
+
+    /* A non zero value means the last frame is incomplete */
+    if (ret != 0) {
+        flb_free(buf);
+        return -1;
+    }
+
+    *out_data = buf;
+    *out_len = size;
+
+    return 0;
+}
+#endif
+
+#ifdef FLB_HAVE_LZ4
+struct lz4_state {
+    LZ4F_cctx *cctx;
+    LZ4F_preferences_t prefs;
+};
+
+static int lz4_init(struct flb_compress *ctx)
+{
+    size_t ret;
+    struct lz4_state *lz;
+
+    lz = flb_calloc(1, sizeof(struct lz4_state));
+    if (!lz) {
+        flb_errno();
+        return -1;
+    }
+    ctx->state = lz;
+
+    ret = LZ4F_createCompressionContext(&lz->cctx, LZ4F_VERSION);
+    if (LZ4F_isError(ret)) {
+        return -1;
+    }
+
+    if (ctx->level != FLB_COMPRESS_LEVEL_DEFAULT) {
+        lz->prefs.compressionLevel = ctx->level;
+    }
+
+    if (out_reserve(ctx, LZ4F_HEADER_SIZE_MAX) != 0) {
+        return -1;
+    }
+    ret = LZ4F_compressBegin(lz->cctx, ctx->buf, ctx->alloc, &lz->prefs);
+    if (LZ4F_isError(ret)) {
+        flb_error("[compress] lz4: %s", LZ4F_getErrorName(ret));
+        return -1;
+    }
+    ctx->size = ret;
+
+    return 0;
+}
+
+static int lz4_update(struct flb_compress *ctx, const void *data, size_t size)
+{
+    size_t ret;
+    struct lz4_state *lz = ctx->state;
+
+    if (out_reserve(ctx, LZ4F_compressBound(size, &lz->prefs)) != 0) {
+        return -1;
+    }
+
+    ret = LZ4F_compressUpdate(lz->cctx, ctx->buf + ctx->size,
+                              ctx->alloc - ctx->size, data, size, NULL);
+    if (LZ4F_isError(ret)) {
+        flb_error("[compress] lz4: %s", LZ4F_getErrorName(ret));
+        return -1;
+    }
+    ctx->size += ret;
+
+    return 0;
+}
+
+static int lz4_finish(struct flb_compress *ctx)
+{
+    size_t ret;
+    struct lz4_state *lz = ctx->state;
+
+    if (out_reserve(ctx, LZ4F_compressBound(0, &lz->prefs)) != 0) {
+        return -1;
+    }
+
+    ret = LZ4F_compressEnd(lz->cctx, ctx->buf + ctx->size,
+                           ctx->alloc - ctx->size, NULL);
+    if (LZ4F_isError(ret)) {
+        flb_error("[compress] lz4: %s", LZ4F_getErrorName(ret));
+        return -1;
+    }
+    ctx->size += ret;
+
+    return 0;
+}
+
+static void lz4_destroy(struct flb_compress *ctx)
+{
+    struct lz4_state *lz = ctx->state;
+
+    if (lz) {
+        LZ4F_freeCompressionContext(lz->cctx);
+        flb_free(lz);
+    }
+}
+
+static int lz4_uncompress(const void *in_data, size_t in_len,
+                          void **out_data, size_t *out_len)
+{
+    size_t ret = 1;
+    size_t src_size;
+    size_t dst_size;
+    size_t off = 0;
+    size_t size = 0;
+    size_t alloc = 0;
+    char *buf = NULL;
+    LZ4F_dctx *dctx;
+
+    ret = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+    if (LZ4F_isError(ret)) {
+        return -1;
+    }
+
+    ret = 1;
+    while (off < in_len) {
+        if (buf_reserve(&buf, &alloc, size, in_len * 2) != 0) {
+            ret = 1;
+            break;
+        }
+        src_size = in_len - off;
+        dst_size = alloc - size;
+
+        ret = LZ4F_decompress(dctx, buf + size, &dst_size,
+                              (const char *) in_data + off, &src_size, NULL);
+        if (LZ4F_isError(ret)) {
+            flb_error("[compress] lz4: %s", LZ4F_getErrorName(ret));
+            break;
+        }
+        off += src_size;
+        size += dst_size;
+    }
+    LZ4F_freeDecompressionContext(dctx);
+
+    /* A non zero value means the last frame is incomplete */
+    if (ret != 0) {
+        flb_free(buf);
+        return -1;
+    }
+
+    *out_data = buf;
+    *out_len = size;
+
+    return 0;
+}
+#endif
+
+#ifdef FLB_HAVE_SNAPPY
+/*
+ * Snappy does not provide a streaming API for its raw format: the input is
+ * buffered and compressed once it's finished.
+ */
+struct snappy_state {
+    char *buf;
+    size_t size;
+    size_t alloc;
+};
+
+static int snappy_init(struct flb_compress *ctx)
+{
+    ctx->state = flb_calloc(1, sizeof(struct snappy_state));
+    if (!ctx->state) {
+        flb_errno();
+        return -1;
+    }
+
+    return 0;
+}
+
+static int snappy_update(struct flb_compress *ctx, const void *data,
+                         size_t size)
+{
+    struct snappy_state *sn = ctx->state;
+
+    if (buf_reserve(&sn->buf, &sn->alloc, sn->size, size) != 0) {
+        return -1;
+    }
+    memcpy(sn->buf + sn->size, data, size);
+    sn->size += size;
+
+    return 0;
+}
+
+static int snappy_finish(struct flb_compress *ctx)
+{
+    size_t len;
+    snappy_status ret;
+    struct snappy_state *sn = ctx->state;
+
+    len = snappy_max_compressed_length(sn->size);
+    if (out_reserve(ctx, len) != 0) {
+        return -1;
+    }
+
+    ret = snappy_compress(sn->buf, sn->size, ctx->buf + ctx->size, &len);
+    if (ret != SNAPPY_OK) {
+        flb_error("[compress] snappy: compression failed (%i)", ret);
+        return -1;
+    }
+    ctx->size += len;
+
+    return 0;
+}
+
+static void snappy_destroy(struct flb_compress *ctx)
+{
+    struct snappy_state *sn = ctx->state;
+
+    if (sn) {
+        flb_free(sn->buf);
+        flb_free(sn);
+    }
+}
+
+static int snappy_uncompress_cb(const void *in_data, size_t in_len,
+                                void **out_data, size_t *out_len)
+{
+    size_t len;
+    char *buf;
+    snappy_status ret;
+
+    ret = snappy_uncompressed_length(in_data, in_len, &len);
+    if (ret != SNAPPY_OK) {
+        flb_error("[compress] snappy: invalid content");
+        return -1;
+    }
+
+    /* Always allocate at least one byte */
+    buf = flb_malloc(len + 1);
+    if (!buf) {
+        flb_errno();
+        return -1;
+    }
+
+    ret = snappy_uncompress(in_data, in_len, buf, &len);
+    if (ret != SNAPPY_OK) {
+        flb_error("[compress] snappy: invalid content");
+        flb_free(buf);
+        return -1;
+    }
+
+    *out_data = buf;
+    *out_len = len;
+
+    return 0;
+}
+#endif
+
+/* Registered codecs */
+static struct flb_compress_codec codecs[] = {
+    {
+        FLB_COMPRESS_GZIP, "gzip", "gzip",
+        gzip_init, gzip_update, gzip_finish, gzip_destroy,
+        gzip_uncompress
+    },
+#ifdef FLB_HAVE_ZSTD
+    {
+        FLB_COMPRESS_ZSTD, "zstd", "zstd",
+        zstd_init, zstd_update, zstd_finish, zstd_destroy,
+        zstd_uncompress
+    },
+#endif
+#ifdef FLB_HAVE_LZ4
+    {
+        FLB_COMPRESS_LZ4, "lz4", NULL,
+        lz4_init, lz4_update, lz4_finish, lz4_destroy,
+        lz4_uncompress
+    },
+#endif
+#ifdef FLB_HAVE_SNAPPY
+    {
+        FLB_COMPRESS_SNAPPY, "snappy", NULL,
+        snappy_init, snappy_update, snappy_finish, snappy_destroy,
+        snappy_uncompress_cb
+    },
+#endif
+    { 0 }
+};
+
+/* Lookup a codec by name, it returns NULL if it's not supported */
+struct flb_compress_codec *flb_compress_codec_get(const char *name)
+{
+    struct flb_compress_codec *codec;
+
+    for (codec = codecs; codec->name; codec++) {
+        if (strcasecmp(codec->name, name) == 0) {
+            return codec;
+        }
+    }
+
+    return NULL;
+}
+
+/* Lookup a codec by type (FLB_COMPRESS_*) */
+struct flb_compress_codec *flb_compress_codec_lookup(int type)
+{
+    struct flb_compress_codec *codec;
+
+    for (codec = codecs; codec->name; codec++) {
+        if (codec->type == type) {
+            return codec;
+        }
+    }
+
+    return NULL;
+}
+
+struct flb_compress *flb_compress_create(struct flb_compress_codec *codec,
+                                         int level)
+{
+    int ret;
+    struct flb_compress *ctx;
+
+    ctx = flb_calloc(1, sizeof(struct flb_compress));
+    if (!ctx) {
+        flb_errno();
+        return NULL;
+    }
+    ctx->codec = codec;
+    ctx->level = level;
+
+    ret = codec->cb_init(ctx);
+    if (ret != 0) {
+        flb_error("[compress] could not initialize %s codec", codec->name);
+        flb_compress_destroy(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+/* Compress more data, the output is kept in the context */
+int flb_compress_update(struct flb_compress *ctx,
+                        const void *data, size_t size)
+{
+    if (size == 0) {
+        return 0;
+    }
+
+    return ctx->codec->cb_update(ctx, data, size);
+}
+
+/*
+ * Finish the compressed stream and hand the output buffer to the caller,
+ * who must release it with flb_free(). The context must be destroyed
+ * anyways.
+ */
+int flb_compress_finish(struct flb_compress *ctx,
+                        void **out_data, size_t *out_len)
+{
+    int ret;
+
+    ret = ctx->codec->cb_finish(ctx);
+    if (ret != 0) {
+        return -1;
+    }
+
+    *out_data = ctx->buf;
+    *out_len = ctx->size;
+
+    ctx->buf = NULL;
+    ctx->size = 0;
+    ctx->alloc = 0;
+
+    return 0;
+}
+
+void flb_compress_destroy(struct flb_compress *ctx)
+{
+    if (ctx->state) {
+        ctx->codec->cb_destroy(ctx);
+    }
+    flb_free(ctx->buf);
+    flb_free(ctx);
+}
+
+/* Compress a buffer in one call */
+int flb_compress_buffer(struct flb_compress_codec *codec, int level,
+                        const void *in_data, size_t in_len,
+                        void **out_data, size_t *out_len)
+{
+    int ret;
+    struct flb_compress *ctx;
+
+    ctx = flb_compress_create(codec, level);
+    if (!ctx) {
+        return -1;
+    }
+
+    ret = flb_compress_update(ctx, in_data, in_len);
+    if (ret == 0) {
+        ret = flb_compress_finish(ctx, out_data, out_len);
+    }
+    flb_compress_destroy(ctx);
+
+    return ret;
+}
+
+int flb_uncompress_buffer(struct flb_compress_codec *codec,
+                          const void *in_data, size_t in_len,
+                          void **out_data, size_t *out_len)
+{
+    return codec->cb_uncompress(in_data, in_len, out_data, out_len);
+}
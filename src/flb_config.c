@@ -105,6 +105,9 @@ struct flb_service_config service_configs[] = {
     {FLB_CONF_STORAGE_MAX_CHUNKS_UP,
      FLB_CONF_TYPE_INT,
      offsetof(struct flb_config, storage_max_chunks_up)},
+    {FLB_CONF_STORAGE_COMPRESSION,
+     FLB_CONF_TYPE_STR,
+     offsetof(struct flb_config, storage_compression)},
 
     /* Coroutines */
     {FLB_CONF_STR_CORO_STACK_SIZE,
@@ -187,7 +190,10 @@ struct flb_config *flb_config_init()
     mk_list_init(&config->workers);
     mk_list_init(&config->upstreams);
 
-    memset(&config->tasks_map, '\0', sizeof(config->tasks_map));
+    /* Tasks table is allocated with the first task */
+    config->tasks_map = NULL;
+    config->tasks_map_size = 0;
+    config->tasks_map_free = -1;
 
     /* Environment */
     config->env = flb_env_create();
@@ -318,6 +324,10 @@ void flb_config_exit(struct flb_config *config)
     /* Release scheduler */
     flb_sched_exit(config);
 
+    if (config->tasks_map) {
+        flb_free(config->tasks_map);
+    }
+
 #ifdef FLB_HAVE_HTTP_SERVER
     if (config->http_listen) {
         flb_free(config->http_listen);
@@ -337,6 +347,9 @@ void flb_config_exit(struct flb_config *config)
     if (config->storage_bl_mem_limit) {
         flb_free(config->storage_bl_mem_limit);
     }
+    if (config->storage_compression) {
+        flb_free(config->storage_compression);
+    }
 
 #ifdef FLB_HAVE_STREAM_PROCESSOR
     if (config->stream_processor_file) {
@@ -213,7 +213,9 @@ static void dump_storage(struct flb_config *ctx)
     fprintf(stdout, "├─ mem chunks    : %i\n", storage_st.chunks_mem);
     fprintf(stdout, "└─ fs chunks     : %i\n", storage_st.chunks_fs);
     fprintf(stdout, "   ├─ up         : %i\n", storage_st.chunks_fs_up);
-    fprintf(stdout, "   └─ down       : %i\n", storage_st.chunks_fs_down);
+    fprintf(stdout, "   ├─ down       : %i\n", storage_st.chunks_fs_down);
+    fprintf(stdout, "   └─ compressed : %i (%zu bytes saved)\n",
+            storage_st.chunks_fs_compressed, storage_st.fs_bytes_saved);
 }
 
 void flb_dump(struct flb_config *ctx)
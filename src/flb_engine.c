@@ -119,8 +119,8 @@ static inline int flb_engine_manager(flb_pipefd_t fd, struct flb_config *config)
         return -1;
     }
 
-    /* Get type and key */
-    type = FLB_BITS_U64_HIGH(val);
+    /* Get type and key, task events use the rest of the high word */
+    type = FLB_BITS_U64_HIGH(val) & 0xff;
     key  = FLB_BITS_U64_LOW(val);
 
     /* Flush all remaining data */
@@ -140,9 +140,9 @@ static inline int flb_engine_manager(flb_pipefd_t fd, struct flb_config *config)
          * The notion of ENGINE_TASK is associated to outputs. All thread
          * references below belongs to flb_output_thread's.
          */
-        ret       = FLB_TASK_RET(key);
-        task_id   = FLB_TASK_ID(key);
-        thread_id = FLB_TASK_TH(key);
+        ret       = FLB_TASK_RET(val);
+        task_id   = FLB_TASK_ID(val);
+        thread_id = FLB_TASK_TH(val);
 
 #ifdef FLB_HAVE_TRACE
         char *trace_st = NULL;
@@ -189,6 +189,7 @@ static inline int flb_engine_manager(flb_pipefd_t fd, struct flb_config *config)
                          flb_output_name(ins));
             }
             flb_task_retry_clean(task, out_th->parent);
+            flb_task_route_release(task, ins);
             flb_output_thread_destroy_id(thread_id, task);
             if (task->users == 0 && mk_list_size(&task->retries) == 0) {
                 flb_task_destroy(task, FLB_TRUE);
@@ -205,8 +206,8 @@ static inline int flb_engine_manager(flb_pipefd_t fd, struct flb_config *config)
                  * - It reached the maximum number of re-tries
                  */
 #ifdef FLB_HAVE_METRICS
-                flb_metrics_sum(FLB_METRIC_OUT_RETRY_FAILED, 1,
-                                out_th->o_ins->metrics);
+                flb_output_metrics_sum(out_th->o_ins,
+                                       FLB_METRIC_OUT_RETRY_FAILED, 1);
 #endif
                 /* Notify about this failed retry */
                 flb_warn("[engine] chunk '%s' cannot be retried: "
@@ -216,6 +217,7 @@ static inline int flb_engine_manager(flb_pipefd_t fd, struct flb_config *config)
                          flb_input_name(task->i_ins),
                          flb_output_name(ins));
 
+                flb_task_route_release(task, ins);
                 flb_output_thread_destroy_id(thread_id, task);
                 if (task->users == 0 && mk_list_size(&task->retries) == 0) {
                     flb_task_destroy(task, FLB_TRUE);
@@ -225,7 +227,7 @@ static inline int flb_engine_manager(flb_pipefd_t fd, struct flb_config *config)
             }
 
 #ifdef FLB_HAVE_METRICS
-            flb_metrics_sum(FLB_METRIC_OUT_RETRY, 1, out_th->o_ins->metrics);
+            flb_output_metrics_sum(out_th->o_ins, FLB_METRIC_OUT_RETRY, 1);
 #endif
 
             /* Always destroy the old thread */
@@ -248,6 +250,7 @@ static inline int flb_engine_manager(flb_pipefd_t fd, struct flb_config *config)
                          flb_output_name(ins));
 
                 flb_task_retry_destroy(retry);
+                flb_task_route_release(task, ins);
                 if (task->users == 0 && mk_list_size(&task->retries) == 0) {
                     flb_task_destroy(task, FLB_TRUE);
                 }
@@ -264,6 +267,7 @@ static inline int flb_engine_manager(flb_pipefd_t fd, struct flb_config *config)
             }
         }
         else if (ret == FLB_ERROR) {
+            flb_task_route_release(task, ins);
             flb_output_thread_destroy_id(thread_id, task);
             if (task->users == 0 && mk_list_size(&task->retries) == 0) {
                 flb_task_destroy(task, FLB_TRUE);
@@ -383,6 +387,16 @@ static int flb_engine_log_start(struct flb_config *config)
         type = FLB_LOG_STDERR;
     }
 
+    /*
+     * In library mode the worker thread starts the logger first: apply the
+     * settings to it, a second logger would leak the first one and its
+     * collector would keep running on released workers.
+     */
+    if (config->log) {
+        flb_log_set_level(config, level);
+        return flb_log_set_file(config, config->log_file);
+    }
+
     if (flb_log_init(config, type, level, config->log_file) == NULL) {
         return -1;
     }
@@ -431,6 +445,7 @@ int flb_engine_start(struct flb_config *config)
         return -1;
     }
     config->evl = evl;
+    flb_output_worker_evl_set(evl);
 
     /*
      * Create a communication channel: this routine creates a channel to
@@ -30,6 +30,27 @@
 #include <fluent-bit/flb_engine.h>
 #include <fluent-bit/flb_task.h>
 
+/*
+ * Start a flush co-routine: if the output instance runs workers, the
+ * co-routine is handed to one of them, otherwise it's resumed here.
+ */
+static inline void output_thread_start(struct flb_output_instance *o_ins,
+                                       struct flb_thread *th)
+{
+    int ret;
+
+    if (o_ins->worker_pool) {
+        ret = flb_output_worker_dispatch(o_ins->worker_pool, th);
+        if (ret == 0) {
+            return;
+        }
+        flb_warn("[engine_dispatch] could not hand flush to a worker of %s, "
+                 "running it in the engine thread", flb_output_name(o_ins));
+    }
+
+    flb_thread_resume(th);
+}
+
 /* It creates a new output thread using a 'Retry' context */
 int flb_engine_dispatch_retry(struct flb_task_retry *retry,
                               struct flb_config *config)
@@ -70,6 +91,7 @@ int flb_engine_dispatch_retry(struct flb_task_retry *retry,
     if (!task->buf) {
         /* Could not retrieve chunk content */
         flb_error("[engine_dispatch] could not retrieve chunk content, removing retry");
+        flb_task_route_release(task, retry->o_ins);
         flb_task_retry_destroy(retry);
         return -1;
     }
@@ -85,7 +107,7 @@ int flb_engine_dispatch_retry(struct flb_task_retry *retry,
     }
 
     flb_task_add_thread(th, task);
-    flb_thread_resume(th);
+    output_thread_start(retry->o_ins, th);
 
     return 0;
 }
@@ -123,6 +145,53 @@ static void test_run_formatter(struct flb_config *config,
     }
 }
 
+/*
+ * Start the routes held by an output tasks limit once the output has room
+ * again. As for a retry the chunk content is brought up again.
+ */
+static void held_routes_start(struct flb_task *task, struct flb_config *config)
+{
+    int ret;
+    size_t buf_size;
+    struct mk_list *head;
+    struct flb_thread *th;
+    struct flb_task_route *route;
+
+    mk_list_foreach(head, &task->routes) {
+        route = mk_list_entry(head, struct flb_task_route, _head);
+        if (route->held == FLB_FALSE ||
+            flb_task_route_can_start(route) == FLB_FALSE) {
+            continue;
+        }
+
+        ret = flb_input_chunk_set_up(task->ic);
+        if (ret == -1) {
+            return;
+        }
+
+        task->buf = flb_input_chunk_flush(task->ic, &buf_size);
+        if (!task->buf) {
+            return;
+        }
+        task->size = buf_size;
+
+        th = flb_output_thread(task,
+                               task->i_ins,
+                               route->out,
+                               config,
+                               task->buf, task->size,
+                               task->tag,
+                               task->tag_len);
+        if (!th) {
+            return;
+        }
+
+        flb_task_route_start(task, route);
+        flb_task_add_thread(th, task);
+        output_thread_start(route->out, th);
+    }
+}
+
 static int tasks_start(struct flb_input_instance *in,
                        struct flb_config *config)
 {
@@ -139,8 +208,11 @@ static int tasks_start(struct flb_input_instance *in,
     mk_list_foreach_safe(head, tmp, &in->tasks) {
         task = mk_list_entry(head, struct flb_task, _head);
 
-        /* Only process recently created tasks */
+        /* Only process recently created tasks or held routes */
         if (task->status != FLB_TASK_NEW) {
+            if (task->held > 0) {
+                held_routes_start(task, config);
+            }
             continue;
         }
         task->status = FLB_TASK_RUNNING;
@@ -148,6 +220,9 @@ static int tasks_start(struct flb_input_instance *in,
         /* A task contain one or more routes */
         mk_list_foreach_safe(r_head, r_tmp, &task->routes) {
             route = mk_list_entry(r_head, struct flb_task_route, _head);
+            if (route->held == FLB_TRUE) {
+                continue;
+            }
 
             /*
              * Test mode: if the output plugin is in test mode, just invoke
@@ -161,8 +236,7 @@ static int tasks_start(struct flb_input_instance *in,
                 test_run_formatter(config, in, out, task);
 
                 /* Remove the route */
-                mk_list_del(&route->_head);
-                flb_free(route);
+                flb_task_route_destroy(route);
                 continue;
             }
 
@@ -178,7 +252,7 @@ static int tasks_start(struct flb_input_instance *in,
                                    task->tag,
                                    task->tag_len);
             flb_task_add_thread(th, task);
-            flb_thread_resume(th);
+            output_thread_start(route->out, th);
         }
     }
 
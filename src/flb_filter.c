@@ -20,6 +20,7 @@
 
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_filter.h>
+#include <fluent-bit/flb_filter_record.h>
 #include <fluent-bit/flb_str.h>
 #include <fluent-bit/flb_env.h>
 #include <fluent-bit/flb_router.h>
@@ -53,15 +54,181 @@ static inline int prop_key_check(const char *key, const char *kv, int k_len)
     return -1;
 }
 
-void flb_filter_do(struct flb_input_chunk *ic,
-                   const void *data, size_t bytes,
-                   const char *tag, int tag_len,
-                   struct flb_config *config)
+/*
+ * Replace the working content of the chunk (the data appended by the last
+ * input operation) with a new buffer.
+ */
+static int filter_chunk_replace(struct flb_input_chunk *ic,
+                                const char **work_data, size_t *work_size,
+                                void *out_buf, size_t out_size)
+{
+    int ret;
+    size_t cur_size;
+    ssize_t content_size;
+    ssize_t write_at;
+
+    content_size = cio_chunk_get_content_size(ic->chunk);
+
+    /* where to position the new content */
+    write_at = (content_size - *work_size);
+
+    /* all records removed, reset data content length */
+    if (out_size == 0) {
+        flb_input_chunk_write_at(ic, write_at, "", 0);
+        *work_size = 0;
+        return 0;
+    }
+
+    ret = flb_input_chunk_write_at(ic, write_at, out_buf, out_size);
+    if (ret == -1) {
+        flb_error("[filter] could not write data to storage. "
+                  "Skipping filtering.");
+        return -1;
+    }
+
+    /* Point back the 'data' pointer to the new address */
+    ret = cio_chunk_get_content(ic->chunk, (char **) work_data, &cur_size);
+    if (ret != CIO_OK) {
+        flb_error("[filter] error retrieving data chunk");
+    }
+    else {
+        *work_data += (cur_size - out_size);
+        *work_size = out_size;
+    }
+
+    return 0;
+}
+
+/*
+ * Run a set of record based filters (a 'stage') over the buffer. Each
+ * record is decoded once and every filter of the stage works over the same
+ * view, then it's serialized once. Records that no filter touched are
+ * copied in bulk from the original buffer.
+ *
+ * Returns -1 if the new buffer could not be built, nothing is returned in
+ * that case so the caller keeps the data untouched.
+ */
+static int filter_record_stage(struct flb_filter_instance **stage, int size,
+                               int *dropped,
+                               const char *data, size_t bytes,
+                               const char *tag, int tag_len,
+                               void **out_buf, size_t *out_size,
+                               int *out_records,
+                               struct flb_config *config)
+{
+    int i;
+    int ret;
+    int records = 0;
+    int modified = FLB_FALSE;
+    size_t off = 0;
+    size_t prev = 0;
+    size_t pending = 0;
+    msgpack_unpacked result;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+    struct flb_filter_record record;
+    struct flb_filter_instance *f_ins;
+
+    ret = flb_filter_record_init(&record);
+    if (ret == -1) {
+        return -1;
+    }
+
+    msgpack_sbuffer_init(&mp_sbuf);
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+    msgpack_unpacked_init(&result);
+    while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
+        ret = flb_filter_record_load(&record, &result.data,
+                                     data + prev, off - prev);
+        if (ret == -1) {
+            /* not a [TIMESTAMP, MAP] entry, keep it as it is */
+            ret = 0;
+            records++;
+            prev = off;
+            continue;
+        }
+
+        for (i = 0; i < size; i++) {
+            f_ins = stage[i];
+            f_ins->p->cb_filter_record(&record, tag, tag_len,
+                                       f_ins, f_ins->context, config);
+            if (record.drop == FLB_TRUE) {
+                dropped[i]++;
+                break;
+            }
+        }
+
+        if (record.modified == FLB_FALSE && record.drop == FLB_FALSE) {
+            records++;
+            prev = off;
+            continue;
+        }
+
+        /* Copy untouched records found before this one */
+        modified = FLB_TRUE;
+        if (prev > pending) {
+            ret = msgpack_sbuffer_write(&mp_sbuf, data + pending,
+                                        prev - pending);
+            if (ret != 0) {
+                break;
+            }
+        }
+        pending = off;
+        prev = off;
+
+        if (record.drop == FLB_FALSE) {
+            ret = flb_filter_record_pack(&record, &mp_pck);
+            if (ret != 0) {
+                break;
+            }
+            records++;
+        }
+    }
+    msgpack_unpacked_destroy(&result);
+    flb_filter_record_destroy(&record);
+
+    if (modified == FLB_FALSE) {
+        msgpack_sbuffer_destroy(&mp_sbuf);
+        *out_records = records;
+        return FLB_FILTER_NOTOUCH;
+    }
+
+    if (ret == 0 && bytes > pending) {
+        ret = msgpack_sbuffer_write(&mp_sbuf, data + pending, bytes - pending);
+    }
+
+    if (ret != 0) {
+        msgpack_sbuffer_destroy(&mp_sbuf);
+        return -1;
+    }
+
+    *out_buf = mp_sbuf.data;
+    *out_size = mp_sbuf.size;
+    *out_records = records;
+
+    return FLB_FILTER_MODIFIED;
+}
+
+/*
+ * Run the filters over the data appended to the chunk, returns FLB_TRUE if
+ * the content was replaced by a filter.
+ */
+int flb_filter_do(struct flb_input_chunk *ic,
+                  const void *data, size_t bytes,
+                  const char *tag, int tag_len,
+                  struct flb_config *config)
 {
+    int i;
     int ret;
+    int modified = FLB_FALSE;
+    int f_id = 0;
+    int matched;
+    int stage_size = 0;
+    int *stage_dropped = NULL;
+    int out_records = 0;
 #ifdef FLB_HAVE_METRICS
     int in_records = 0;
-    int out_records = 0;
     int diff = 0;
     int pre_records = 0;
 #endif
@@ -69,23 +236,64 @@ void flb_filter_do(struct flb_input_chunk *ic,
     const char *work_data;
     size_t work_size;
     void *out_buf;
-    size_t cur_size;
     size_t out_size;
-    ssize_t content_size;
-    ssize_t write_at;
     struct mk_list *head;
     struct flb_filter_instance *f_ins;
+    struct flb_filter_instance **stage = NULL;
+    struct flb_router_table *router = config->router;
+    uint64_t routes_buf[FLB_ROUTER_WORDS_STACK];
+    uint64_t *routes = NULL;
 
     /* For the incoming Tag make sure to create a NULL terminated reference */
     ntag = flb_malloc(tag_len + 1);
     if (!ntag) {
         flb_errno();
         flb_error("[filter] could not filter record due to memory problems");
-        return;
+        return FLB_FALSE;
     }
     memcpy(ntag, tag, tag_len);
     ntag[tag_len] = '\0';
 
+    /* Lookup the filters that matches the Tag in the routing table */
+    if (router) {
+        if (router->words <= FLB_ROUTER_WORDS_STACK) {
+            routes = routes_buf;
+        }
+        else {
+            routes = flb_malloc(sizeof(uint64_t) * router->words);
+        }
+        if (routes) {
+            flb_router_table_get(router, tag, tag_len, routes);
+        }
+    }
+
+    /*
+     * Room for the record based filters, it's reserved before any filter
+     * runs: if it fails the chunk is left untouched instead of skipping
+     * part of the chain.
+     */
+    mk_list_foreach(head, &config->filters) {
+        f_ins = mk_list_entry(head, struct flb_filter_instance, _head);
+        if (f_ins->p->cb_filter_record) {
+            i = mk_list_size(&config->filters);
+            stage = flb_malloc(sizeof(struct flb_filter_instance *) * i);
+            stage_dropped = flb_malloc(sizeof(int) * i);
+            if (!stage || !stage_dropped) {
+                flb_errno();
+                flb_error("[filter] could not filter records of tag '%s' "
+                          "due to memory problems", ntag);
+                flb_free(stage);
+                flb_free(stage_dropped);
+                if (routes && routes != routes_buf) {
+                    flb_free(routes);
+                }
+                flb_free(ntag);
+                return FLB_FALSE;
+            }
+            break;
+        }
+    }
+
     work_data = (const char *) data;
     work_size = bytes;
 
@@ -95,97 +303,157 @@ void flb_filter_do(struct flb_input_chunk *ic,
     pre_records = ic->total_records - in_records;
 #endif
 
-    /* Iterate filters */
-    mk_list_foreach(head, &config->filters) {
-        f_ins = mk_list_entry(head, struct flb_filter_instance, _head);
-        if (flb_router_match(ntag, tag_len, f_ins->match
+    /*
+     * Iterate filters: consecutive filters implementing the record API are
+     * grouped in a 'stage' which runs as a single pass over the records,
+     * the stage is executed before the next buffer based filter or at the
+     * end of the chain.
+     */
+    head = config->filters.next;
+    while (1) {
+        f_ins = NULL;
+        if (head != &config->filters) {
+            f_ins = mk_list_entry(head, struct flb_filter_instance, _head);
+            head = head->next;
+
+            if (routes) {
+                matched = flb_router_routes_filter(router, routes, f_id);
+            }
+            else {
+                matched = flb_router_match(ntag, tag_len, f_ins->match
 #ifdef FLB_HAVE_REGEX
-        , f_ins->match_regex
+                                           , f_ins->match_regex
 #else
-        , NULL
+                                           , NULL
 #endif
-           )) {
-            /* Reset filtered buffer */
-            out_buf = NULL;
-            out_size = 0;
+                                           );
+            }
+            f_id++;
 
-            content_size = cio_chunk_get_content_size(ic->chunk);
+            if (!matched) {
+                continue;
+            }
 
-            /* where to position the new content if modified ? */
-            write_at = (content_size - work_size);
+            if (f_ins->p->cb_filter_record) {
+                stage[stage_size] = f_ins;
+                stage_dropped[stage_size] = 0;
+                stage_size++;
+                continue;
+            }
+        }
 
-            /* Invoke the filter callback */
-            ret = f_ins->p->cb_filter(work_data,      /* msgpack buffer   */
-                                      work_size,      /* msgpack size     */
-                                      ntag, tag_len,  /* input tag        */
-                                      &out_buf,       /* new data         */
-                                      &out_size,      /* new data size    */
-                                      f_ins,          /* filter instance  */
-                                      f_ins->context, /* filter priv data */
-                                      config);
+        /* Run pending record based filters */
+        if (stage_size > 0) {
+            out_buf = NULL;
+            out_size = 0;
 
-            /* Override buffer just if it was modified */
+            ret = filter_record_stage(stage, stage_size, stage_dropped,
+                                      work_data, work_size,
+                                      ntag, tag_len,
+                                      &out_buf, &out_size, &out_records,
+                                      config);
             if (ret == FLB_FILTER_MODIFIED) {
-                /* all records removed, no data to continue processing */
-                if (out_size == 0) {
-                    /* reset data content length */
-                    flb_input_chunk_write_at(ic, write_at, "", 0);
-
 #ifdef FLB_HAVE_METRICS
-                    ic->total_records = pre_records;
-
-                    /* Summarize all records removed */
-                    flb_metrics_sum(FLB_METRIC_N_DROPPED,
-                                    in_records, f_ins->metrics);
+                for (i = 0; i < stage_size; i++) {
+                    if (stage_dropped[i] > 0) {
+                        flb_metrics_sum(FLB_METRIC_N_DROPPED,
+                                        stage_dropped[i], stage[i]->metrics);
+                    }
+                }
+                in_records = out_records;
+                ic->total_records = pre_records + in_records;
 #endif
+                ret = filter_chunk_replace(ic, &work_data, &work_size,
+                                           out_buf, out_size);
+                flb_free(out_buf);
+                modified = FLB_TRUE;
+                if (ret == 0 && work_size == 0) {
+                    /* all records removed, no data to continue processing */
                     break;
                 }
-                else {
+            }
+            else if (ret == -1) {
+                flb_error("[filter] could not run record filters on tag '%s', "
+                          "records are passed untouched", ntag);
+            }
+            stage_size = 0;
+        }
+
+        if (!f_ins) {
+            break;
+        }
+
+        /* Reset filtered buffer */
+        out_buf = NULL;
+        out_size = 0;
+
+        /* Invoke the filter callback */
+        ret = f_ins->p->cb_filter(work_data,      /* msgpack buffer   */
+                                  work_size,      /* msgpack size     */
+                                  ntag, tag_len,  /* input tag        */
+                                  &out_buf,       /* new data         */
+                                  &out_size,      /* new data size    */
+                                  f_ins,          /* filter instance  */
+                                  f_ins->context, /* filter priv data */
+                                  config);
+
+        /* Override buffer just if it was modified */
+        if (ret == FLB_FILTER_MODIFIED) {
+            /* all records removed, no data to continue processing */
+            if (out_size == 0) {
+                filter_chunk_replace(ic, &work_data, &work_size, "", 0);
+                modified = FLB_TRUE;
+
 #ifdef FLB_HAVE_METRICS
-                    out_records = flb_mp_count(out_buf, out_size);
-                    if (out_records > in_records) {
-                        diff = (out_records - in_records);
-                        /* Summarize new records */
-                        flb_metrics_sum(FLB_METRIC_N_ADDED,
-                                        diff, f_ins->metrics);
-                    }
-                    else if (out_records < in_records) {
-                        diff = (in_records - out_records);
-                        /* Summarize dropped records */
-                        flb_metrics_sum(FLB_METRIC_N_DROPPED,
-                                        diff, f_ins->metrics);
-                    }
+                ic->total_records = pre_records;
 
-                    /* set number of records in new chunk */
-                    in_records = out_records;
-                    ic->total_records = pre_records + in_records;
+                /* Summarize all records removed */
+                flb_metrics_sum(FLB_METRIC_N_DROPPED,
+                                in_records, f_ins->metrics);
 #endif
+                break;
+            }
+            else {
+#ifdef FLB_HAVE_METRICS
+                out_records = flb_mp_count(out_buf, out_size);
+                if (out_records > in_records) {
+                    diff = (out_records - in_records);
+                    /* Summarize new records */
+                    flb_metrics_sum(FLB_METRIC_N_ADDED,
+                                    diff, f_ins->metrics);
                 }
-                ret = flb_input_chunk_write_at(ic, write_at,
-                                               out_buf, out_size);
-                if (ret == -1) {
-                    flb_error("[filter] could not write data to storage. "
-                              "Skipping filtering.");
-                    flb_free(out_buf);
-                    continue;
+                else if (out_records < in_records) {
+                    diff = (in_records - out_records);
+                    /* Summarize dropped records */
+                    flb_metrics_sum(FLB_METRIC_N_DROPPED,
+                                    diff, f_ins->metrics);
                 }
 
-                /* Point back the 'data' pointer to the new address */
-                ret = cio_chunk_get_content(ic->chunk,
-                                            (char **) &work_data, &cur_size);
-                if (ret != CIO_OK) {
-                    flb_error("[filter] error retrieving data chunk");
-                }
-                else {
-                    work_data += (cur_size - out_size);
-                    work_size = out_size;
-                }
-                flb_free(out_buf);
+                /* set number of records in new chunk */
+                in_records = out_records;
+                ic->total_records = pre_records + in_records;
+#endif
             }
+
+            filter_chunk_replace(ic, &work_data, &work_size,
+                                 out_buf, out_size);
+            flb_free(out_buf);
+            modified = FLB_TRUE;
         }
     }
 
+    if (stage) {
+        flb_free(stage);
+    }
+    if (stage_dropped) {
+        flb_free(stage_dropped);
+    }
+    if (routes && routes != routes_buf) {
+        flb_free(routes);
+    }
     flb_free(ntag);
+
+    return modified;
 }
 
 int flb_filter_set_property(struct flb_filter_instance *ins,
@@ -0,0 +1,332 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_filter_record.h>
+
+#include <msgpack.h>
+
+#define FLB_FILTER_RECORD_ZONE_SIZE   1024
+#define FLB_FILTER_RECORD_KV_SIZE     32
+
+int flb_filter_record_init(struct flb_filter_record *r)
+{
+    memset(r, '\0', sizeof(struct flb_filter_record));
+
+    r->kv = flb_malloc(sizeof(struct flb_filter_kv) * FLB_FILTER_RECORD_KV_SIZE);
+    if (!r->kv) {
+        flb_errno();
+        return -1;
+    }
+    r->size = FLB_FILTER_RECORD_KV_SIZE;
+
+    if (!msgpack_zone_init(&r->zone, FLB_FILTER_RECORD_ZONE_SIZE)) {
+        flb_free(r->kv);
+        r->kv = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void flb_filter_record_destroy(struct flb_filter_record *r)
+{
+    if (r->kv) {
+        flb_free(r->kv);
+        r->kv = NULL;
+    }
+    msgpack_zone_destroy(&r->zone);
+}
+
+static int kv_grow(struct flb_filter_record *r, int size)
+{
+    int new_size;
+    struct flb_filter_kv *tmp;
+
+    if (size <= r->size) {
+        return 0;
+    }
+
+    new_size = r->size;
+    while (new_size < size) {
+        new_size *= 2;
+    }
+
+    tmp = flb_realloc(r->kv, sizeof(struct flb_filter_kv) * new_size);
+    if (!tmp) {
+        flb_errno();
+        return -1;
+    }
+    r->kv = tmp;
+    r->size = new_size;
+
+    return 0;
+}
+
+/*
+ * Load a new record into the view. 'root' must be the unpacked record
+ * [TIMESTAMP, MAP] and 'raw' the buffer it was unpacked from.
+ */
+int flb_filter_record_load(struct flb_filter_record *r,
+                           msgpack_object *root,
+                           const char *raw, size_t raw_size)
+{
+    int i;
+    int ret;
+    msgpack_object *map;
+    msgpack_object_kv *kv;
+
+    msgpack_zone_clear(&r->zone);
+    r->count = 0;
+    r->modified = FLB_FALSE;
+    r->drop = FLB_FALSE;
+
+    if (root->type != MSGPACK_OBJECT_ARRAY || root->via.array.size != 2) {
+        return -1;
+    }
+
+    map = &root->via.array.ptr[1];
+    if (map->type != MSGPACK_OBJECT_MAP) {
+        return -1;
+    }
+
+    r->time = &root->via.array.ptr[0];
+    r->map = map;
+    r->raw = raw;
+    r->raw_size = raw_size;
+    flb_time_msgpack_to_time(&r->tm, r->time);
+
+    ret = kv_grow(r, map->via.map.size);
+    if (ret == -1) {
+        return -1;
+    }
+
+    kv = map->via.map.ptr;
+    for (i = 0; i < map->via.map.size; i++) {
+        r->kv[i].flags = FLB_FILTER_KV_ORIGINAL;
+        r->kv[i].key = kv[i].key;
+        r->kv[i].val = kv[i].val;
+    }
+    r->count = map->via.map.size;
+
+    return 0;
+}
+
+/* Serialize the record applying the edit log */
+int flb_filter_record_pack(struct flb_filter_record *r, msgpack_packer *mp_pck)
+{
+    int i;
+    int ret = 0;
+    int entries;
+
+    if (r->drop == FLB_TRUE) {
+        return 0;
+    }
+
+    /* Nothing changed, copy the original content */
+    if (r->modified == FLB_FALSE) {
+        ret = msgpack_sbuffer_write(mp_pck->data, r->raw, r->raw_size);
+        return ret == 0 ? 0 : -1;
+    }
+
+    entries = flb_filter_record_entries(r);
+
+    ret |= msgpack_pack_array(mp_pck, 2);
+    ret |= msgpack_pack_object(mp_pck, *r->time);
+    ret |= msgpack_pack_map(mp_pck, entries);
+
+    for (i = 0; i < r->count && ret == 0; i++) {
+        if (!flb_filter_record_kv_valid(r, i)) {
+            continue;
+        }
+        ret |= msgpack_pack_object(mp_pck, r->kv[i].key);
+        ret |= msgpack_pack_object(mp_pck, r->kv[i].val);
+    }
+
+    /* the buffer could not grow */
+    return ret == 0 ? 0 : -1;
+}
+
+/* Number of entries that are part of the record */
+int flb_filter_record_entries(struct flb_filter_record *r)
+{
+    int i;
+    int c = 0;
+
+    for (i = 0; i < r->count; i++) {
+        if (flb_filter_record_kv_valid(r, i)) {
+            c++;
+        }
+    }
+
+    return c;
+}
+
+/* Compare the key of entry 'idx', returns 0 on match */
+int flb_filter_record_key_cmp(struct flb_filter_record *r, int idx,
+                              const char *key, int key_len)
+{
+    msgpack_object *k;
+
+    k = &r->kv[idx].key;
+    if (k->type == MSGPACK_OBJECT_STR) {
+        if (k->via.str.size == key_len &&
+            memcmp(k->via.str.ptr, key, key_len) == 0) {
+            return 0;
+        }
+    }
+    else if (k->type == MSGPACK_OBJECT_BIN) {
+        if (k->via.bin.size == key_len &&
+            memcmp(k->via.bin.ptr, key, key_len) == 0) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/* Lookup a key, returns the entry index or -1 */
+int flb_filter_record_key_find(struct flb_filter_record *r,
+                               const char *key, int key_len)
+{
+    int i;
+
+    for (i = 0; i < r->count; i++) {
+        if (!flb_filter_record_kv_valid(r, i)) {
+            continue;
+        }
+        if (flb_filter_record_key_cmp(r, i, key, key_len) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int zone_str(struct flb_filter_record *r, msgpack_object *o,
+                    const char *str, int len)
+{
+    char *buf;
+
+    if (len == 0) {
+        o->type = MSGPACK_OBJECT_STR;
+        o->via.str.ptr = "";
+        o->via.str.size = 0;
+        return 0;
+    }
+
+    buf = msgpack_zone_malloc_no_align(&r->zone, len);
+    if (!buf) {
+        flb_errno();
+        return -1;
+    }
+    memcpy(buf, str, len);
+
+    o->type = MSGPACK_OBJECT_STR;
+    o->via.str.ptr = buf;
+    o->via.str.size = len;
+
+    return 0;
+}
+
+/*
+ * Append a new entry. The key is copied, the value is referenced: it must
+ * stay valid until the filter chain finishes (e.g: a value from the same
+ * record or memory owned by the filter context).
+ */
+int flb_filter_record_add(struct flb_filter_record *r,
+                          const char *key, int key_len, msgpack_object *val)
+{
+    int ret;
+    struct flb_filter_kv *kv;
+
+    ret = kv_grow(r, r->count + 1);
+    if (ret == -1) {
+        return -1;
+    }
+
+    kv = &r->kv[r->count];
+    ret = zone_str(r, &kv->key, key, key_len);
+    if (ret == -1) {
+        return -1;
+    }
+    kv->val = *val;
+    kv->flags = FLB_FILTER_KV_ADDED;
+
+    r->count++;
+    r->modified = FLB_TRUE;
+
+    return r->count - 1;
+}
+
+/* Append a new string entry, key and value are copied */
+int flb_filter_record_add_str(struct flb_filter_record *r,
+                              const char *key, int key_len,
+                              const char *val, int val_len)
+{
+    int ret;
+    msgpack_object o;
+
+    ret = zone_str(r, &o, val, val_len);
+    if (ret == -1) {
+        return -1;
+    }
+
+    return flb_filter_record_add(r, key, key_len, &o);
+}
+
+int flb_filter_record_remove(struct flb_filter_record *r, int idx)
+{
+    if (idx < 0 || idx >= r->count) {
+        return -1;
+    }
+
+    r->kv[idx].flags |= FLB_FILTER_KV_REMOVED;
+    r->modified = FLB_TRUE;
+
+    return 0;
+}
+
+int flb_filter_record_rename(struct flb_filter_record *r, int idx,
+                             const char *key, int key_len)
+{
+    int ret;
+
+    if (idx < 0 || idx >= r->count || !flb_filter_record_kv_valid(r, idx)) {
+        return -1;
+    }
+
+    ret = zone_str(r, &r->kv[idx].key, key, key_len);
+    if (ret == -1) {
+        return -1;
+    }
+    r->kv[idx].flags |= FLB_FILTER_KV_RENAMED;
+    r->modified = FLB_TRUE;
+
+    return 0;
+}
+
+void flb_filter_record_drop(struct flb_filter_record *r)
+{
+    r->drop = FLB_TRUE;
+}
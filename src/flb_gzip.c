@@ -24,9 +24,18 @@
 #include <fluent-bit/flb_gzip.h>
 #include <miniz/miniz.h>
 
-#define FLB_GZIP_HEADER_OFFSET 10
+/* gzip header flags */
+#define FLB_GZIP_FHCRC     0x02
+#define FLB_GZIP_FEXTRA    0x04
+#define FLB_GZIP_FNAME     0x08
+#define FLB_GZIP_FCOMMENT  0x10
 
-static inline void gzip_header(void *buf)
+/*
+ * Miniz don't support GZip format directly, the header and the CRC32 footer
+ * around the raw deflate content are composed here. These helpers are also
+ * used by the streaming gzip codec (flb_compress.c).
+ */
+void flb_gzip_header(void *buf)
 {
     uint8_t *p;
 
@@ -44,6 +53,26 @@ static inline void gzip_header(void *buf)
     *p++ = 0xFF;
 }
 
+/* Footer: CRC32 and input size (modulo 2^32), little endian */
+void flb_gzip_footer(void *buf, uint32_t crc, size_t in_len)
+{
+    uint8_t *p = buf;
+
+    *p++ = crc & 0xFF;
+    *p++ = (crc >> 8) & 0xFF;
+    *p++ = (crc >> 16) & 0xFF;
+    *p++ = (crc >> 24) & 0xFF;
+    *p++ = in_len & 0xFF;
+    *p++ = (in_len >> 8) & 0xFF;
+    *p++ = (in_len >> 16) & 0xFF;
+    *p++ = (in_len >> 24) & 0xFF;
+}
+
+static inline uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
 int flb_gzip_compress(void *in_data, size_t in_len,
                       void **out_data, size_t *out_len)
 {
@@ -84,10 +113,10 @@ int flb_gzip_compress(void *in_data, size_t in_len,
      * - deflate raw content
      * - append manual CRC32 data
      */
-    gzip_header(out_buf);
+    flb_gzip_header(out_buf);
 
     /* Header offset */
-    pb = (uint8_t *) out_buf + FLB_GZIP_HEADER_OFFSET;
+    pb = (uint8_t *) out_buf + FLB_GZIP_HEADER_SIZE;
 
     flush = Z_NO_FLUSH;
     while (1) {
@@ -115,93 +144,124 @@ int flb_gzip_compress(void *in_data, size_t in_len,
     *out_len = strm.total_out;
 
     /* Construct the gzip checksum (CRC32 footer) */
-    footer_start = FLB_GZIP_HEADER_OFFSET + *out_len;
-    pb = (uint8_t *) out_buf + footer_start;
-
+    footer_start = FLB_GZIP_HEADER_SIZE + *out_len;
     crc = mz_crc32(MZ_CRC32_INIT, in_data, in_len);
-    *pb++ = crc & 0xFF;
-    *pb++ = (crc >> 8) & 0xFF;
-    *pb++ = (crc >> 16) & 0xFF;
-    *pb++ = (crc >> 24) & 0xFF;
-    *pb++ = in_len & 0xFF;
-    *pb++ = (in_len >> 8) & 0xFF;
-    *pb++ = (in_len >> 16) & 0xFF;
-    *pb++ = (in_len >> 24) & 0xFF;
+    flb_gzip_footer((uint8_t *) out_buf + footer_start, crc, in_len);
 
     /* Set the real buffer size for the caller */
-    *out_len += FLB_GZIP_HEADER_OFFSET + 8;
+    *out_len += FLB_GZIP_HEADER_SIZE + FLB_GZIP_FOOTER_SIZE;
     *out_data = out_buf;
 
     return 0;
 }
 
 /*
- * Uncompress GZip data: note that the current function don't validate
- * the checksum, it's only used for testing purposes from the internal
- * tests located at tests/internal/gzip.c.
- *
- * This function is not used in Fluent Bit core, if you intent to use
- * it, make sure to implement the proper checksum verification and
- * possible byte extensions set by gzip format. It's not suitable to
- * unpack data zipped by a third party app.
+ * Uncompress GZip data: the optional header fields are skipped and the
+ * CRC32 and size of the footer are validated.
  */
 int flb_gzip_uncompress(void *in_data, size_t in_len,
                         void **out_data, size_t *out_len)
 {
-    uint8_t *p;
-    void *out_buf;
-    size_t out_size = 0;
-    void *zip_data;
-    size_t zip_len;
+    int status;
+    int flags;
+    size_t off;
+    size_t len;
+    size_t size = 0;
+    size_t alloc = 0;
+    char *tmp;
+    char *buf = NULL;
+    uint8_t *p = in_data;
+    mz_stream strm;
 
     /* Minimal length: header + crc32 */
-    if (in_len < 18) {
+    if (in_len < FLB_GZIP_HEADER_SIZE + FLB_GZIP_FOOTER_SIZE) {
         flb_error("[gzip] unexpected content length");
         return -1;
     }
 
     /* Magic bytes */
-    p = in_data;
     if (p[0] != 0x1F || p[1] != 0x8B || p[2] != 8) {
         flb_error("[gzip] invalid magic bytes");
         return -1;
     }
 
-    out_size = in_len * 2;
-    out_buf = flb_malloc(out_size);
-    if (!out_buf) {
-        flb_errno();
+    /* Skip optional header fields */
+    flags = p[3];
+    off = FLB_GZIP_HEADER_SIZE;
+    if (flags & FLB_GZIP_FEXTRA) {
+        if (off + 2 > in_len) {
+            flb_error("[gzip] invalid header");
+            return -1;
+        }
+        off += 2 + (p[off] | (p[off + 1] << 8));
+    }
+    if (flags & FLB_GZIP_FNAME) {
+        while (off < in_len && p[off] != '\0') {
+            off++;
+        }
+        off++;
+    }
+    if (flags & FLB_GZIP_FCOMMENT) {
+        while (off < in_len && p[off] != '\0') {
+            off++;
+        }
+        off++;
+    }
+    if (flags & FLB_GZIP_FHCRC) {
+        off += 2;
+    }
+    if (off + FLB_GZIP_FOOTER_SIZE > in_len) {
+        flb_error("[gzip] invalid header");
         return -1;
     }
 
-    /* Map zip content */
-    zip_data = (uint8_t *) in_data + FLB_GZIP_HEADER_OFFSET;
-    zip_len = in_len - (FLB_GZIP_HEADER_OFFSET + 8);
+    memset(&strm, '\0', sizeof(strm));
+    status = mz_inflateInit2(&strm, -Z_DEFAULT_WINDOW_BITS);
+    if (status != MZ_OK) {
+        return -1;
+    }
+    strm.next_in = p + off;
+    strm.avail_in = in_len - off - FLB_GZIP_FOOTER_SIZE;
 
-    mz_stream stream;
-    int status;
-    memset(&stream, 0, sizeof(stream));
+    do {
+        /* Grow the output buffer as needed */
+        if (alloc - size < in_len) {
+            len = alloc + (in_len * 2);
+            tmp = flb_realloc(buf, len);
+            if (!tmp) {
+                flb_errno();
+                status = MZ_MEM_ERROR;
+                break;
+            }
+            buf = tmp;
+            alloc = len;
+        }
 
-    stream.next_in = zip_data;
-    stream.avail_in = zip_len;
-    stream.next_out = out_buf;
-    stream.avail_out = out_size;
+        len = alloc - size;
+        strm.next_out = (unsigned char *) buf + size;
+        strm.avail_out = len;
+        status = mz_inflate(&strm, MZ_NO_FLUSH);
+        size += len - strm.avail_out;
+    } while (status == MZ_OK);
+    mz_inflateEnd(&strm);
 
-    status = mz_inflateInit2(&stream, -Z_DEFAULT_WINDOW_BITS);
-    if (status != MZ_OK) {
-        flb_free(out_buf);
+    if (status != MZ_STREAM_END) {
+        flb_error("[gzip] invalid deflate stream");
+        flb_free(buf);
         return -1;
     }
 
-    status = mz_inflate(&stream, MZ_FINISH);
-    if (status != MZ_STREAM_END) {
-        mz_inflateEnd(&stream);
-        flb_free(out_buf);
+    /* Validate the footer */
+    p = (uint8_t *) in_data + in_len - FLB_GZIP_FOOTER_SIZE;
+    if (read_le32(p) != mz_crc32(MZ_CRC32_INIT, (unsigned char *) buf, size) ||
+        read_le32(p + 4) != (uint32_t) size) {
+        flb_error("[gzip] checksum mismatch");
+        flb_free(buf);
         return -1;
     }
-    *out_len = stream.total_out;
-    *out_data = out_buf;
 
-    mz_inflateEnd(&stream);
+    *out_data = buf;
+    *out_len = size;
+
     return 0;
 }
@@ -1001,8 +1001,9 @@ int flb_http_do(struct flb_http_client *c, size_t *bytes)
     int new_size;
     ssize_t available;
     size_t out_size;
-    size_t bytes_header = 0;
-    size_t bytes_body = 0;
+    int iovcnt = 1;
+    size_t bytes_sent = 0;
+    struct iovec iov[2];
     char *tmp;
 
     /* Append pending headers */
@@ -1036,27 +1037,23 @@ int flb_http_do(struct flb_http_client *c, size_t *bytes)
     }
 #endif
 
-    /* Write the header */
-    ret = flb_io_net_write(c->u_conn,
-                           c->header_buf, c->header_len,
-                           &bytes_header);
+    /* Write the header and the body with a single operation */
+    iov[0].iov_base = c->header_buf;
+    iov[0].iov_len = c->header_len;
+    if (c->body_len > 0) {
+        iov[1].iov_base = (void *) c->body_buf;
+        iov[1].iov_len = c->body_len;
+        iovcnt++;
+    }
+
+    ret = flb_io_net_writev(c->u_conn, iov, iovcnt, &bytes_sent);
     if (ret == -1) {
         flb_errno();
         return -1;
     }
 
-    if (c->body_len > 0) {
-        ret = flb_io_net_write(c->u_conn,
-                               c->body_buf, c->body_len,
-                               &bytes_body);
-        if (ret == -1) {
-            flb_errno();
-            return -1;
-        }
-    }
-
     /* number of sent bytes */
-    *bytes = (bytes_header + bytes_body);
+    *bytes = bytes_sent;
 
     /* Read the server response, we need at least 19 bytes */
     c->resp.data_len = 0;
@@ -23,6 +23,7 @@
 #include <fluent-bit/flb_input_chunk.h>
 #include <fluent-bit/flb_storage.h>
 #include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_mp.h>
 #include <fluent-bit/stream_processor/flb_sp.h>
 
 static void generate_chunk_name(struct flb_input_instance *in,
@@ -43,6 +44,158 @@ ssize_t flb_input_chunk_get_size(struct flb_input_chunk *ic)
     return cio_chunk_get_content_size(ic->chunk);
 }
 
+static inline void store_u32(char *p, uint32_t val)
+{
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+}
+
+static inline void store_u64(char *p, uint64_t val)
+{
+    store_u32(p, val >> 32);
+    store_u32(p + 4, val);
+}
+
+static inline uint64_t load_u64(const char *buf, int bytes)
+{
+    int i;
+    uint64_t val = 0;
+    const unsigned char *p = (const unsigned char *) buf;
+
+    for (i = 0; i < bytes; i++) {
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+static inline int meta_has_header(const char *meta, int len)
+{
+    if (len >= FLB_INPUT_CHUNK_META_HEADER &&
+        (unsigned char) meta[0] == FLB_INPUT_CHUNK_MAGIC_BYTE_0 &&
+        (unsigned char) meta[1] == FLB_INPUT_CHUNK_MAGIC_BYTE_1) {
+        return FLB_TRUE;
+    }
+    return FLB_FALSE;
+}
+
+static void meta_header_pack(struct flb_input_chunk *ic, char *buf)
+{
+    uint64_t ns;
+    ssize_t size;
+
+    buf[0] = (char) FLB_INPUT_CHUNK_MAGIC_BYTE_0;
+    buf[1] = (char) FLB_INPUT_CHUNK_MAGIC_BYTE_1;
+    buf[2] = FLB_INPUT_CHUNK_META_VERSION;
+    buf[3] = 0;
+    store_u32(buf + 4, ic->total_records);
+
+    ns = (uint64_t) ic->tm_min.tm.tv_sec * 1000000000ULL +
+         ic->tm_min.tm.tv_nsec;
+    store_u64(buf + 8, ns);
+
+    ns = (uint64_t) ic->tm_max.tm.tv_sec * 1000000000ULL +
+         ic->tm_max.tm.tv_nsec;
+    store_u64(buf + 16, ns);
+
+    size = flb_input_chunk_get_size(ic);
+    if (size < 0) {
+        size = 0;
+    }
+    store_u64(buf + 24, size);
+}
+
+/* Load the statistics, returns the data size they account for */
+static uint64_t meta_header_unpack(struct flb_input_chunk *ic,
+                                   const char *buf)
+{
+    uint64_t ns;
+
+    ic->total_records = load_u64(buf + 4, 4);
+
+    ns = load_u64(buf + 8, 8);
+    flb_time_set(&ic->tm_min, ns / 1000000000ULL, ns % 1000000000ULL);
+
+    ns = load_u64(buf + 16, 8);
+    flb_time_set(&ic->tm_max, ns / 1000000000ULL, ns % 1000000000ULL);
+
+    return load_u64(buf + 24, 8);
+}
+
+/*
+ * Persist the statistics of the chunk. Appends only mark the header as
+ * dirty: on filesystem chunks every metadata update recomputes the CRC of
+ * the whole file, so it's written once when the chunk is locked, flushed
+ * or put down. The chunk must be 'up'.
+ */
+static int meta_header_update(struct flb_input_chunk *ic)
+{
+    int ret;
+    char buf[FLB_INPUT_CHUNK_META_HEADER];
+
+    if (ic->meta_header == FLB_FALSE || ic->meta_dirty == FLB_FALSE) {
+        return 0;
+    }
+
+    if (cio_chunk_is_up(ic->chunk) == CIO_FALSE) {
+        return -1;
+    }
+
+    meta_header_pack(ic, buf);
+    ret = cio_meta_update(ic->chunk, 0, buf, sizeof(buf));
+    if (ret == 0) {
+        ic->meta_dirty = FLB_FALSE;
+    }
+    return ret;
+}
+
+/* Write the pending statistics and put the chunk down */
+static int chunk_down(struct flb_input_chunk *ic)
+{
+    meta_header_update(ic);
+    return cio_chunk_down(ic->chunk);
+}
+
+/*
+ * Account the records of 'buf' in the chunk statistics. Returns the number
+ * of records.
+ */
+static int chunk_stats_add(struct flb_input_chunk *ic,
+                           const char *buf, size_t size)
+{
+    int records;
+    struct flb_time tm_min;
+    struct flb_time tm_max;
+
+    records = flb_mp_count_time(buf, size, &tm_min, &tm_max);
+    ic->total_records += records;
+
+    /* no timestamps found */
+    if (tm_min.tm.tv_sec == 0 && tm_min.tm.tv_nsec == 0 &&
+        tm_max.tm.tv_sec == 0 && tm_max.tm.tv_nsec == 0) {
+        return records;
+    }
+
+    if ((ic->tm_min.tm.tv_sec == 0 && ic->tm_min.tm.tv_nsec == 0) ||
+        flb_time_cmp(&tm_min, &ic->tm_min) < 0) {
+        ic->tm_min = tm_min;
+    }
+    if (flb_time_cmp(&tm_max, &ic->tm_max) > 0) {
+        ic->tm_max = tm_max;
+    }
+
+    return records;
+}
+
+static void chunk_stats_reset(struct flb_input_chunk *ic)
+{
+    ic->total_records = 0;
+    ic->added_records = 0;
+    flb_time_zero(&ic->tm_min);
+    flb_time_zero(&ic->tm_max);
+}
+
 int flb_input_chunk_write(void *data, const char *buf, size_t len)
 {
     int ret;
@@ -51,12 +204,9 @@ int flb_input_chunk_write(void *data, const char *buf, size_t len)
     ic = (struct flb_input_chunk *) data;
 
     ret = cio_chunk_write(ic->chunk, buf, len);
-#ifdef FLB_HAVE_METRICS
     if (ret == CIO_OK) {
-        ic->added_records = flb_mp_count(buf, len);
-        ic->total_records += ic->added_records;
+        ic->added_records = chunk_stats_add(ic, buf, len);
     }
-#endif
 
     return ret;
 }
@@ -77,11 +227,12 @@ int flb_input_chunk_write_at(void *data, off_t offset,
 struct flb_input_chunk *flb_input_chunk_map(struct flb_input_instance *in,
                                             void *chunk)
 {
-#ifdef FLB_HAVE_METRICS
     int ret;
+    int meta_len;
+    char *meta;
     char *buf_data;
     size_t buf_size;
-#endif
+    ssize_t size;
     struct flb_input_chunk *ic;
 
     /* Create context for the input instance */
@@ -95,17 +246,38 @@ struct flb_input_chunk *flb_input_chunk_map(struct flb_input_instance *in,
     ic->fs_backlog = FLB_TRUE;
     ic->chunk = chunk;
     ic->in = in;
+    ic->meta_header = FLB_FALSE;
+    ic->meta_dirty = FLB_FALSE;
+    chunk_stats_reset(ic);
     msgpack_packer_init(&ic->mp_pck, ic, flb_input_chunk_write);
     mk_list_add(&ic->_head, &in->chunks);
 
-#ifdef FLB_HAVE_METRICS
     ret = cio_chunk_get_content(ic->chunk, &buf_data, &buf_size);
     if (ret != CIO_OK) {
         flb_error("[input chunk] error retrieving content for metrics");
         return ic;
     }
 
-    ic->total_records = flb_mp_count(buf_data, buf_size);
+    /*
+     * Statistics are taken from the metadata, chunks written by previous
+     * versions are counted. A header older than the content (the process
+     * died before writing it) is counted again and rewritten later.
+     */
+    ret = cio_meta_read(ic->chunk, &meta, &meta_len);
+    if (ret == 0 && meta_has_header(meta, meta_len) == FLB_TRUE) {
+        ic->meta_header = FLB_TRUE;
+        size = meta_header_unpack(ic, meta);
+        if (size != flb_input_chunk_get_size(ic)) {
+            chunk_stats_reset(ic);
+            chunk_stats_add(ic, buf_data, buf_size);
+            ic->meta_dirty = FLB_TRUE;
+        }
+    }
+    else {
+        chunk_stats_add(ic, buf_data, buf_size);
+    }
+
+#ifdef FLB_HAVE_METRICS
     if (ic->total_records > 0) {
         flb_metrics_sum(FLB_METRIC_N_RECORDS, ic->total_records, in->metrics);
         flb_metrics_sum(FLB_METRIC_N_BYTES, buf_size, in->metrics);
@@ -122,6 +294,7 @@ struct flb_input_chunk *flb_input_chunk_create(struct flb_input_instance *in,
     int err;
     int set_down = FLB_FALSE;
     char name[64];
+    char *meta;
     struct cio_chunk *chunk;
     struct flb_storage_input *storage;
     struct flb_input_chunk *ic;
@@ -154,18 +327,10 @@ struct flb_input_chunk *flb_input_chunk_create(struct flb_input_instance *in,
         set_down = FLB_TRUE;
     }
 
-    /* write metadata (tag) */
-    if (tag_len > 65535) {
+    /* write metadata (stats header and tag) */
+    if (tag_len > 65535 - FLB_INPUT_CHUNK_META_HEADER) {
         /* truncate length */
-        tag_len = 65535;
-    }
-
-    /* Write tag into metadata section */
-    ret = cio_meta_write(chunk, (char *) tag, tag_len);
-    if (ret == -1) {
-        flb_error("[input chunk] could not write metadata");
-        cio_chunk_close(chunk, CIO_TRUE);
-        return NULL;
+        tag_len = 65535 - FLB_INPUT_CHUNK_META_HEADER;
     }
 
     /* Create context for the input instance */
@@ -180,9 +345,30 @@ struct flb_input_chunk *flb_input_chunk_create(struct flb_input_instance *in,
     ic->fs_backlog = FLB_FALSE;
     ic->in = in;
     ic->stream_off = 0;
-#ifdef FLB_HAVE_METRICS
-    ic->total_records = 0;
-#endif
+    ic->meta_header = FLB_TRUE;
+    ic->meta_dirty = FLB_FALSE;
+    chunk_stats_reset(ic);
+
+    meta = flb_malloc(FLB_INPUT_CHUNK_META_HEADER + tag_len);
+    if (!meta) {
+        flb_errno();
+        flb_free(ic);
+        cio_chunk_close(chunk, CIO_TRUE);
+        return NULL;
+    }
+    meta_header_pack(ic, meta);
+    memcpy(meta + FLB_INPUT_CHUNK_META_HEADER, tag, tag_len);
+
+    /* Write header and tag into metadata section */
+    ret = cio_meta_write(chunk, meta, FLB_INPUT_CHUNK_META_HEADER + tag_len);
+    flb_free(meta);
+    if (ret == -1) {
+        flb_error("[input chunk] could not write metadata");
+        flb_free(ic);
+        cio_chunk_close(chunk, CIO_TRUE);
+        return NULL;
+    }
+
     msgpack_packer_init(&ic->mp_pck, ic, flb_input_chunk_write);
     mk_list_add(&ic->_head, &in->chunks);
 
@@ -195,6 +381,11 @@ struct flb_input_chunk *flb_input_chunk_create(struct flb_input_instance *in,
 
 int flb_input_chunk_destroy(struct flb_input_chunk *ic, int del)
 {
+    /* The chunk is kept for a later run, it needs the final statistics */
+    if (del == FLB_FALSE) {
+        meta_header_update(ic);
+    }
+
     cio_chunk_close(ic->chunk, del);
     mk_list_del(&ic->_head);
     flb_free(ic);
@@ -206,6 +397,9 @@ int flb_input_chunk_destroy(struct flb_input_chunk *ic, int del)
 static struct flb_input_chunk *input_chunk_get(const char *tag, int tag_len,
                                                struct flb_input_instance *in)
 {
+    int ret;
+    int ic_tag_len;
+    const char *ic_tag;
     struct mk_list *head;
     struct flb_input_chunk *ic = NULL;
 
@@ -222,7 +416,9 @@ static struct flb_input_chunk *input_chunk_get(const char *tag, int tag_len,
             continue;
         }
 
-        if (cio_meta_cmp(ic->chunk, (char *) tag, tag_len) != 0) {
+        ret = flb_input_chunk_get_tag(ic, &ic_tag, &ic_tag_len);
+        if (ret == -1 || ic_tag_len != tag_len ||
+            memcmp(ic_tag, tag, tag_len) != 0) {
             ic = NULL;
             continue;
         }
@@ -359,7 +555,7 @@ int flb_input_chunk_set_up_down(struct flb_input_chunk *ic)
 
     if (flb_input_chunk_is_overlimit(in) == FLB_TRUE) {
         if (cio_chunk_is_up(ic->chunk) == CIO_TRUE) {
-            cio_chunk_down(ic->chunk);
+            chunk_down(ic);
 
             /* Adjust new counters */
             total = flb_input_chunk_total_size(ic->in);
@@ -381,7 +577,7 @@ int flb_input_chunk_is_up(struct flb_input_chunk *ic)
 int flb_input_chunk_down(struct flb_input_chunk *ic)
 {
     if (cio_chunk_is_up(ic->chunk) == CIO_TRUE) {
-        return cio_chunk_down(ic->chunk);
+        return chunk_down(ic);
     }
 
     return 0;
@@ -405,7 +601,14 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
     int ret;
     int set_down = FLB_FALSE;
     int min;
+    int modified;
+    int pre_records;
+    char *c_data;
+    size_t c_size;
     size_t size;
+    size_t pre_size;
+    struct flb_time pre_tm_min;
+    struct flb_time pre_tm_max;
     struct flb_input_chunk *ic;
     struct flb_storage_input *si;
 
@@ -452,6 +655,12 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
         set_down = FLB_TRUE;
     }
 
+    /* Keep the statistics before the new data, filters might change it */
+    pre_size = cio_chunk_get_content_size(ic->chunk);
+    pre_records = ic->total_records;
+    pre_tm_min = ic->tm_min;
+    pre_tm_max = ic->tm_max;
+
     /* Write the new data */
     ret = flb_input_chunk_write(ic, buf, buf_size);
     if (ret == -1) {
@@ -470,15 +679,28 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
 #endif
 
     /* Apply filters */
-    flb_filter_do(ic,
-                  buf, buf_size,
-                  tag, tag_len, in->config);
+    modified = flb_filter_do(ic,
+                             buf, buf_size,
+                             tag, tag_len, in->config);
 
     /* Get chunk size */
     size = cio_chunk_get_content_size(ic->chunk);
 
+    /* Filters rewrote the new data, account the final records */
+    if (modified == FLB_TRUE) {
+        ic->total_records = pre_records;
+        ic->tm_min = pre_tm_min;
+        ic->tm_max = pre_tm_max;
+        ret = cio_chunk_get_content(ic->chunk, &c_data, &c_size);
+        if (ret == CIO_OK && c_size > pre_size) {
+            chunk_stats_add(ic, c_data + pre_size, c_size - pre_size);
+        }
+    }
+    ic->meta_dirty = FLB_TRUE;
+
     /* Lock buffers where size > 2MB */
     if (size > FLB_INPUT_CHUNK_FS_MAX_SIZE) {
+        meta_header_update(ic);
         cio_chunk_lock(ic->chunk);
     }
 
@@ -490,9 +712,6 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
     }
 #ifdef FLB_HAVE_STREAM_PROCESSOR
     else if (in->config->stream_processor_ctx) {
-        char *c_data;
-        size_t c_size;
-
         /* Retrieve chunk (filtered) output content */
         cio_chunk_get_content(ic->chunk, &c_data, &c_size);
 
@@ -506,7 +725,7 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
 #endif
 
     if (set_down == FLB_TRUE) {
-        cio_chunk_down(ic->chunk);
+        chunk_down(ic);
     }
 
     /*
@@ -546,7 +765,7 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
             /* Do we have less than 1% available ? */
             min = (FLB_INPUT_CHUNK_FS_MAX_SIZE * 0.01);
             if (FLB_INPUT_CHUNK_FS_MAX_SIZE - size < min) {
-                cio_chunk_down(ic->chunk);
+                chunk_down(ic);
             }
         }
         return 0;
@@ -573,6 +792,9 @@ const void *flb_input_chunk_flush(struct flb_input_chunk *ic, size_t *size)
      * msgpack-c internal use a raw buffer for it operations, since we
      * already appended data we just can take out the references to avoid
      * a new memory allocation and skip a copy operation.
+     *
+     * If the chunk was compressed by the storage layer, the content is
+     * decompressed here and kept until the chunk goes down.
      */
     ret = cio_chunk_get_content(ic->chunk, &buf, size);
     if (ret == -1) {
@@ -587,6 +809,7 @@ const void *flb_input_chunk_flush(struct flb_input_chunk *ic, size_t *size)
 
     /* Set it busy as it likely it's a reference for an outgoing task */
     ic->busy = FLB_TRUE;
+    meta_header_update(ic);
 
     return buf;
 }
@@ -623,6 +846,12 @@ int flb_input_chunk_get_tag(struct flb_input_chunk *ic,
         return -1;
     }
 
+    /* Skip the stats header */
+    if (meta_has_header(buf, len) == FLB_TRUE) {
+        buf += FLB_INPUT_CHUNK_META_HEADER;
+        len -= FLB_INPUT_CHUNK_META_HEADER;
+    }
+
     *tag_len = len;
     *tag_buf = buf;
 
@@ -51,6 +51,7 @@
 #include <monkey/mk_core.h>
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_io.h>
 #include <fluent-bit/flb_io_tls.h>
 #include <fluent-bit/flb_io_tls_rw.h>
@@ -257,7 +258,7 @@ FLB_INLINE int flb_io_net_connect(struct flb_upstream_conn *u_conn,
 
         MK_EVENT_ZERO(&u_conn->event);
         u_conn->thread = th;
-        ret = mk_event_add(u->evl,
+        ret = mk_event_add(u_conn->evl,
                            fd,
                            FLB_ENGINE_EV_THREAD,
                            MK_EVENT_WRITE, &u_conn->event);
@@ -280,7 +281,7 @@ FLB_INLINE int flb_io_net_connect(struct flb_upstream_conn *u_conn,
         mask = u_conn->event.mask;
 
         /* We got a notification, remove the event registered */
-        ret = mk_event_del(u->evl, &u_conn->event);
+        ret = mk_event_del(u_conn->evl, &u_conn->event);
         if (ret == -1) {
             flb_error("[io] connect event handler error");
             flb_socket_close(fd);
@@ -340,11 +341,54 @@ connected:
     return 0;
 }
 
-static int net_io_write(struct flb_upstream_conn *u_conn,
-                        const void *data, size_t len, size_t *out_len)
+/* Number of vectors kept in the stack by flb_io_net_writev() */
+#define FLB_IO_IOV_STACK   8
+
+#ifndef IOV_MAX
+#define IOV_MAX            1024
+#endif
+
+/* Send the vectors with a single system call */
+static ssize_t net_io_sendv(flb_sockfd_t fd, struct iovec *vec, int cnt)
+{
+#ifdef FLB_SYSTEM_WINDOWS
+    return send(fd, vec->iov_base, vec->iov_len, 0);
+#else
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = (cnt > IOV_MAX) ? IOV_MAX : cnt;
+
+    return sendmsg(fd, &msg, 0);
+#endif
+}
+
+/* Skip 'bytes' already written from the head of the vectors */
+static void net_io_iov_advance(struct iovec **vec, int *cnt, size_t bytes)
+{
+    while (*cnt > 0 && bytes >= (*vec)->iov_len) {
+        bytes -= (*vec)->iov_len;
+        (*vec)++;
+        (*cnt)--;
+    }
+
+    if (*cnt > 0 && bytes > 0) {
+        (*vec)->iov_base = (char *) (*vec)->iov_base + bytes;
+        (*vec)->iov_len -= bytes;
+    }
+}
+
+/*
+ * Blocking write of the vectors, 'vec' is used as a cursor so its content
+ * is modified.
+ */
+static int net_io_writev(struct flb_upstream_conn *u_conn,
+                         struct iovec *vec, int cnt, size_t *out_len)
 {
     int ret;
     int tries = 0;
+    ssize_t bytes;
     size_t total = 0;
 
     if (u_conn->fd <= 0) {
@@ -356,9 +400,10 @@ static int net_io_write(struct flb_upstream_conn *u_conn,
         }
     }
 
-    while (total < len) {
-        ret = send(u_conn->fd, (char *) data + total, len - total, 0);
-        if (ret == -1) {
+    net_io_iov_advance(&vec, &cnt, 0);
+    while (cnt > 0) {
+        bytes = net_io_sendv(u_conn->fd, vec, cnt);
+        if (bytes == -1) {
             if (FLB_WOULDBLOCK()) {
                 /*
                  * FIXME: for now we are handling this in a very lazy way,
@@ -375,13 +420,25 @@ static int net_io_write(struct flb_upstream_conn *u_conn,
             return -1;
         }
         tries = 0;
-        total += ret;
+        total += bytes;
+        net_io_iov_advance(&vec, &cnt, bytes);
     }
 
     *out_len = total;
     return total;
 }
 
+static int net_io_write(struct flb_upstream_conn *u_conn,
+                        const void *data, size_t len, size_t *out_len)
+{
+    struct iovec vec;
+
+    vec.iov_base = (void *) data;
+    vec.iov_len = len;
+
+    return net_io_writev(u_conn, &vec, 1, out_len);
+}
+
 /*
  * Perform Async socket write(2) operations. This function depends on a main
  * event-loop and the co-routines interface to yield/resume once sockets are
@@ -389,47 +446,51 @@ static int net_io_write(struct flb_upstream_conn *u_conn,
  *
  * Intentionally we register/de-register the socket file descriptor from
  * the event loop each time when we require to do some work.
+ *
+ * All the vectors are submitted in one system call, on a partial write
+ * the coroutine waits for the socket and resumes from the last byte
+ * written. As in net_io_writev(), 'vec' is modified.
  */
-static FLB_INLINE int net_io_write_async(struct flb_thread *th,
-                                         struct flb_upstream_conn *u_conn,
-                                         const void *data, size_t len, size_t *out_len)
+static FLB_INLINE int net_io_writev_async(struct flb_thread *th,
+                                          struct flb_upstream_conn *u_conn,
+                                          struct iovec *vec, int cnt,
+                                          size_t *out_len)
 {
     int ret = 0;
     int error;
     uint32_t mask;
     ssize_t bytes;
     size_t total = 0;
-    size_t to_send;
     socklen_t slen = sizeof(error);
     char so_error_buf[256];
     struct flb_upstream *u = u_conn->u;
 
+    net_io_iov_advance(&vec, &cnt, 0);
+    if (cnt == 0) {
+        *out_len = 0;
+        return 0;
+    }
+
  retry:
     error = 0;
 
-    if (len - total > 524288) {
-        to_send = 524288;
-    }
-    else {
-        to_send = (len - total);
-    }
-    bytes = send(u_conn->fd, (char *) data + total, to_send, 0);
+    bytes = net_io_sendv(u_conn->fd, vec, cnt);
 
 #ifdef FLB_HAVE_TRACE
     if (bytes > 0) {
-        flb_trace("[io thread=%p] [fd %i] write_async(2)=%d (%lu/%lu)",
-                  th, u_conn->fd, bytes, total + bytes, len);
+        flb_trace("[io thread=%p] [fd %i] write_async(2)=%d (%lu)",
+                  th, u_conn->fd, bytes, total + bytes);
     }
     else {
-        flb_trace("[io thread=%p] [fd %i] write_async(2)=%d (%lu/%lu)",
-                  th, u_conn->fd, bytes, total, len);
+        flb_trace("[io thread=%p] [fd %i] write_async(2)=%d (%lu)",
+                  th, u_conn->fd, bytes, total);
     }
 #endif
 
     if (bytes == -1) {
         if (FLB_WOULDBLOCK()) {
             u_conn->thread = th;
-            ret = mk_event_add(u->evl,
+            ret = mk_event_add(u_conn->evl,
                                u_conn->fd,
                                FLB_ENGINE_EV_THREAD,
                                MK_EVENT_WRITE, &u_conn->event);
@@ -451,7 +512,7 @@ static FLB_INLINE int net_io_write_async(struct flb_thread *th,
             mask = u_conn->event.mask;
 
             /* We got a notification, remove the event registered */
-            ret = mk_event_del(u->evl, &u_conn->event);
+            ret = mk_event_del(u_conn->evl, &u_conn->event);
             if (ret == -1) {
                 return -1;
             }
@@ -487,13 +548,14 @@ static FLB_INLINE int net_io_write_async(struct flb_thread *th,
         }
     }
 
-    /* Update counters */
+    /* Update counters and resume from the last byte written */
     total += bytes;
-    if (total < len) {
+    net_io_iov_advance(&vec, &cnt, bytes);
+    if (cnt > 0) {
         if (u_conn->event.status == MK_EVENT_NONE) {
             u_conn->event.mask = MK_EVENT_EMPTY;
             u_conn->thread = th;
-            ret = mk_event_add(u->evl,
+            ret = mk_event_add(u_conn->evl,
                                u_conn->fd,
                                FLB_ENGINE_EV_THREAD,
                                MK_EVENT_WRITE, &u_conn->event);
@@ -511,12 +573,24 @@ static FLB_INLINE int net_io_write_async(struct flb_thread *th,
 
     if (u_conn->event.status & MK_EVENT_REGISTERED) {
         /* We got a notification, remove the event registered */
-        ret = mk_event_del(u->evl, &u_conn->event);
+        ret = mk_event_del(u_conn->evl, &u_conn->event);
         assert(ret == 0);
     }
 
     *out_len = total;
-    return bytes;
+    return total;
+}
+
+static FLB_INLINE int net_io_write_async(struct flb_thread *th,
+                                         struct flb_upstream_conn *u_conn,
+                                         const void *data, size_t len, size_t *out_len)
+{
+    struct iovec vec;
+
+    vec.iov_base = (void *) data;
+    vec.iov_len = len;
+
+    return net_io_writev_async(th, u_conn, &vec, 1, out_len);
 }
 
 static ssize_t net_io_read(struct flb_upstream_conn *u_conn,
@@ -537,7 +611,6 @@ static FLB_INLINE ssize_t net_io_read_async(struct flb_thread *th,
                                             void *buf, size_t len)
 {
     int ret;
-    struct flb_upstream *u = u_conn->u;
 
  retry_read:
 
@@ -545,7 +618,7 @@ static FLB_INLINE ssize_t net_io_read_async(struct flb_thread *th,
     if (ret == -1) {
         if (FLB_WOULDBLOCK()) {
             u_conn->thread = th;
-            ret = mk_event_add(u->evl,
+            ret = mk_event_add(u_conn->evl,
                                u_conn->fd,
                                FLB_ENGINE_EV_THREAD,
                                MK_EVENT_READ, &u_conn->event);
@@ -605,6 +678,69 @@ int flb_io_net_write(struct flb_upstream_conn *u_conn, const void *data,
     return ret;
 }
 
+/*
+ * Write a set of buffers to an upstream connection/server. On plain TCP
+ * connections all of them are submitted in a single system call; over TLS
+ * small buffers are merged so they are sent in the same record.
+ */
+int flb_io_net_writev(struct flb_upstream_conn *u_conn, const struct iovec *iov,
+                      int iovcnt, size_t *out_len)
+{
+    int i;
+    int ret = -1;
+    size_t len = 0;
+    struct iovec vec_buf[FLB_IO_IOV_STACK];
+    struct iovec *vec = vec_buf;
+    struct flb_upstream *u = u_conn->u;
+    struct flb_thread *th = pthread_getspecific(flb_thread_key);
+
+    *out_len = 0;
+    for (i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+
+    flb_trace("[io thread=%p] [net_writev] trying %zd bytes in %i buffers",
+              th, len, iovcnt);
+
+    if (u->flags & FLB_IO_TCP) {
+        /* the vectors are consumed while writing, work over a copy */
+        if (iovcnt > FLB_IO_IOV_STACK) {
+            vec = flb_malloc(sizeof(struct iovec) * iovcnt);
+            if (!vec) {
+                flb_errno();
+                return -1;
+            }
+        }
+        memcpy(vec, iov, sizeof(struct iovec) * iovcnt);
+
+        if (u->flags & FLB_IO_ASYNC) {
+            ret = net_io_writev_async(th, u_conn, vec, iovcnt, out_len);
+        }
+        else {
+            ret = net_io_writev(u_conn, vec, iovcnt, out_len);
+        }
+
+        if (vec != vec_buf) {
+            flb_free(vec);
+        }
+    }
+#ifdef FLB_HAVE_TLS
+    else if (u->flags & FLB_IO_TLS) {
+        ret = flb_io_tls_net_writev(th, u_conn, iov, iovcnt, out_len);
+    }
+#endif
+
+    if (ret == -1 && u_conn->fd > 0) {
+        flb_socket_close(u_conn->fd);
+        u_conn->fd = -1;
+        u_conn->event.fd = -1;
+    }
+
+    flb_trace("[io thread=%p] [net_writev] ret=%i total=%lu/%lu",
+              th, ret, *out_len, len);
+    return ret;
+}
+
 ssize_t flb_io_net_read(struct flb_upstream_conn *u_conn, void *buf, size_t len)
 {
     int ret = -1;
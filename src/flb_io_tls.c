@@ -37,9 +37,17 @@
 #include <fluent-bit/flb_network.h>
 #include <fluent-bit/flb_engine.h>
 #include <fluent-bit/flb_thread.h>
+#include <fluent-bit/flb_time.h>
+
+#ifdef FLB_HAVE_METRICS
+#include <fluent-bit/flb_metrics.h>
+#endif
 
 #define FLB_TLS_CLIENT   "Fluent Bit"
 
+/* Payload of a TLS record, buffers are merged up to this size on writev */
+#define FLB_TLS_RECORD   MBEDTLS_SSL_OUT_CONTENT_LEN
+
 #define io_tls_error(ret) _io_tls_error(ret, __FILE__, __LINE__)
 
 void _io_tls_error(int ret, char *file, int line)
@@ -55,11 +63,10 @@ static inline int io_tls_event_switch(struct flb_upstream_conn *u_conn,
 {
     int ret;
     struct mk_event *event;
-    struct flb_upstream *u = u_conn->u;
 
     event = &u_conn->event;
     if ((event->mask & mask) == 0) {
-        ret = mk_event_add(u->evl,
+        ret = mk_event_add(u_conn->evl,
                            event->fd,
                            FLB_ENGINE_EV_THREAD,
                            mask, &u_conn->event);
@@ -137,6 +144,10 @@ struct flb_tls_context *flb_tls_context_new(int verify,
     ctx->debug     = debug;
     ctx->vhost     = (char *) vhost;
     ctx->certs_set = 0;
+    ctx->session_cache = FLB_TRUE;
+    mk_list_init(&ctx->sessions);
+    pthread_mutex_init(&ctx->mutex, NULL);
+    pthread_mutex_init(&ctx->sessions_mutex, NULL);
 
     mbedtls_entropy_init(&ctx->entropy);
     mbedtls_ctr_drbg_init(&ctx->ctr_drbg);
@@ -207,8 +218,24 @@ struct flb_tls_context *flb_tls_context_new(int verify,
     return NULL;
 }
 
+static void session_entry_destroy(struct flb_tls_session_entry *entry)
+{
+    mk_list_del(&entry->_head);
+    mbedtls_ssl_session_free(&entry->session);
+    flb_sds_destroy(entry->key);
+    flb_free(entry);
+}
+
 void flb_tls_context_destroy(struct flb_tls_context *ctx)
 {
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_tls_session_entry *entry;
+
+    mk_list_foreach_safe(head, tmp, &ctx->sessions) {
+        entry = mk_list_entry(head, struct flb_tls_session_entry, _head);
+        session_entry_destroy(entry);
+    }
     if (ctx->certs_set & FLB_TLS_CA_ROOT) {
         mbedtls_x509_crt_free(&ctx->ca_cert);
     }
@@ -221,6 +248,8 @@ void flb_tls_context_destroy(struct flb_tls_context *ctx)
         mbedtls_pk_free(&ctx->priv_key);
     }
 
+    pthread_mutex_destroy(&ctx->mutex);
+    pthread_mutex_destroy(&ctx->sessions_mutex);
     flb_free(ctx);
 }
 
@@ -234,6 +263,22 @@ static void flb_tls_debug(void *ctx, int level,
               line, str);
 }
 
+/*
+ * The random generator is shared by all the sessions of the context, since
+ * output workers might run handshakes in parallel access to it is serialized.
+ */
+static int flb_tls_random(void *data, unsigned char *output, size_t len)
+{
+    int ret;
+    struct flb_tls_context *ctx = data;
+
+    pthread_mutex_lock(&ctx->mutex);
+    ret = mbedtls_ctr_drbg_random(&ctx->ctr_drbg, output, len);
+    pthread_mutex_unlock(&ctx->mutex);
+
+    return ret;
+}
+
 struct flb_tls_session *flb_tls_session_new(struct flb_tls_context *ctx)
 {
     int ret;
@@ -259,9 +304,7 @@ struct flb_tls_session *flb_tls_session_new(struct flb_tls_context *ctx)
         io_tls_error(ret);
     }
 
-    mbedtls_ssl_conf_rng(&session->conf,
-                         mbedtls_ctr_drbg_random,
-                         &ctx->ctr_drbg);
+    mbedtls_ssl_conf_rng(&session->conf, flb_tls_random, ctx);
 
     if (ctx->debug >= 0) {
         mbedtls_ssl_conf_dbg(&session->conf, flb_tls_debug, NULL);
@@ -318,11 +361,141 @@ int flb_tls_session_destroy(struct flb_tls_session *session)
     return 0;
 }
 
+/* Lookup the cached session of a server, the caller must hold the lock */
+static struct flb_tls_session_entry *session_cache_get(struct flb_tls_context *ctx,
+                                                       const char *key,
+                                                       int key_len)
+{
+    time_t now;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_tls_session_entry *entry;
+
+    now = time(NULL);
+    mk_list_foreach_safe(head, tmp, &ctx->sessions) {
+        entry = mk_list_entry(head, struct flb_tls_session_entry, _head);
+        if (flb_sds_len(entry->key) != key_len ||
+            strncmp(entry->key, key, key_len) != 0) {
+            continue;
+        }
+
+        if (now - entry->created > FLB_TLS_SESSION_TTL) {
+            session_entry_destroy(entry);
+            return NULL;
+        }
+        return entry;
+    }
+
+    return NULL;
+}
+
+/*
+ * Offer the cached session of the server to the new connection, the master
+ * secret is returned so the caller can tell if the server resumed it.
+ */
+static int session_cache_offer(struct flb_tls_context *ctx,
+                               struct flb_tls_session *session,
+                               const char *key, int key_len,
+                               unsigned char *master)
+{
+    int ret = -1;
+    struct flb_tls_session_entry *entry;
+
+    pthread_mutex_lock(&ctx->sessions_mutex);
+    entry = session_cache_get(ctx, key, key_len);
+    if (entry) {
+        ret = mbedtls_ssl_set_session(&session->ssl, &entry->session);
+        if (ret == 0) {
+            memcpy(master, entry->session.master, sizeof(entry->session.master));
+        }
+        else {
+            io_tls_error(ret);
+            session_entry_destroy(entry);
+            ret = -1;
+        }
+    }
+    pthread_mutex_unlock(&ctx->sessions_mutex);
+
+    return ret;
+}
+
+/* Store the session of a full handshake, or drop it if 'session' is NULL */
+static void session_cache_set(struct flb_tls_context *ctx,
+                              struct flb_tls_session *session,
+                              const char *key, int key_len)
+{
+    int ret;
+    struct flb_tls_session_entry *entry;
+
+    pthread_mutex_lock(&ctx->sessions_mutex);
+    entry = session_cache_get(ctx, key, key_len);
+    if (!session) {
+        if (entry) {
+            session_entry_destroy(entry);
+        }
+        pthread_mutex_unlock(&ctx->sessions_mutex);
+        return;
+    }
+
+    if (!entry) {
+        entry = flb_calloc(1, sizeof(struct flb_tls_session_entry));
+        if (!entry) {
+            flb_errno();
+            pthread_mutex_unlock(&ctx->sessions_mutex);
+            return;
+        }
+        entry->key = flb_sds_create_len(key, key_len);
+        if (!entry->key) {
+            flb_free(entry);
+            pthread_mutex_unlock(&ctx->sessions_mutex);
+            return;
+        }
+        mbedtls_ssl_session_init(&entry->session);
+        mk_list_add(&entry->_head, &ctx->sessions);
+    }
+
+    ret = mbedtls_ssl_get_session(&session->ssl, &entry->session);
+    if (ret != 0) {
+        io_tls_error(ret);
+        session_entry_destroy(entry);
+    }
+    else {
+        entry->created = time(NULL);
+    }
+    pthread_mutex_unlock(&ctx->sessions_mutex);
+}
+
+static void session_cache_stats(struct flb_tls_context *ctx, int resumed)
+{
+    pthread_mutex_lock(&ctx->sessions_mutex);
+    if (resumed == FLB_TRUE) {
+        ctx->handshakes_resumed++;
+    }
+    else {
+        ctx->handshakes_full++;
+    }
+
+#ifdef FLB_HAVE_METRICS
+    if (ctx->metrics) {
+        flb_metrics_sum(resumed == FLB_TRUE ?
+                        FLB_METRIC_OUT_TLS_RESUMED : FLB_METRIC_OUT_TLS_FULL,
+                        1, ctx->metrics);
+    }
+#endif
+    pthread_mutex_unlock(&ctx->sessions_mutex);
+}
+
 /* Perform a TLS handshake */
 int net_io_tls_handshake(void *_u_conn, void *_th)
 {
     int ret;
     int flag;
+    int key_len = 0;
+    int offered = FLB_FALSE;
+    int resumed = FLB_FALSE;
+    char key[256];
+    unsigned char master[48];
+    struct flb_tls_context *ctx;
     struct flb_tls_session *session;
     struct flb_upstream_conn *u_conn = _u_conn;
     struct flb_upstream *u = u_conn->u;
@@ -335,10 +508,24 @@ int net_io_tls_handshake(void *_u_conn, void *_th)
                   u->tcp_host, u->tcp_port);
         return -1;
     }
-    if (!u->tls->context->vhost) {
-        u->tls->context->vhost = u->tcp_host;
+    ctx = u->tls->context;
+    if (!ctx->vhost) {
+        ctx->vhost = u->tcp_host;
+    }
+    mbedtls_ssl_set_hostname(&session->ssl, ctx->vhost);
+
+    /* Try to resume the last session with the server */
+    if (ctx->session_cache == FLB_TRUE) {
+        key_len = snprintf(key, sizeof(key) - 1, "%s:%i",
+                           u->tcp_host, u->tcp_port);
+        if (key_len >= sizeof(key) - 1) {
+            key_len = 0;
+        }
+        else if (session_cache_offer(ctx, session, key, key_len,
+                                     master) == 0) {
+            offered = FLB_TRUE;
+        }
     }
-    mbedtls_ssl_set_hostname(&session->ssl, u->tls->context->vhost);
 
     /* Store session and mbedtls net context fd */
     u_conn->tls_session = session;
@@ -370,7 +557,7 @@ int net_io_tls_handshake(void *_u_conn, void *_th)
          * FIXME: if we need multiple reads we are invoking the same
          * system call multiple times.
          */
-        ret = mk_event_add(u->evl,
+        ret = mk_event_add(u_conn->evl,
                            u_conn->event.fd,
                            FLB_ENGINE_EV_THREAD,
                            flag, &u_conn->event);
@@ -386,15 +573,32 @@ int net_io_tls_handshake(void *_u_conn, void *_th)
     }
 
     if (u_conn->event.status & MK_EVENT_REGISTERED) {
-        mk_event_del(u->evl, &u_conn->event);
+        mk_event_del(u_conn->evl, &u_conn->event);
     }
-    flb_trace("[io_tls] connection OK");
+
+    /* A resumed session keeps the master secret of the cached one */
+    if (offered == FLB_TRUE &&
+        memcmp(master, session->ssl.session->master, sizeof(master)) == 0) {
+        resumed = FLB_TRUE;
+    }
+    else if (key_len > 0) {
+        session_cache_set(ctx, session, key, key_len);
+    }
+    session_cache_stats(ctx, resumed);
+
+    flb_debug("[io_tls] connection #%i %s handshake", u_conn->fd,
+              resumed == FLB_TRUE ? "resumed" : "full");
 
     return 0;
 
  error:
     if (u_conn->event.status & MK_EVENT_REGISTERED) {
-        mk_event_del(u->evl, &u_conn->event);
+        mk_event_del(u_conn->evl, &u_conn->event);
+    }
+
+    /* Don't offer the session again if it was the cause of the failure */
+    if (offered == FLB_TRUE) {
+        session_cache_set(ctx, NULL, key, key_len);
     }
     flb_tls_session_destroy(u_conn->tls_session);
     u_conn->tls_session = NULL;
@@ -434,7 +638,6 @@ int flb_io_tls_net_write(struct flb_thread *th, struct flb_upstream_conn *u_conn
 {
     int ret;
     size_t total = 0;
-    struct flb_upstream *u = u_conn->u;
 
     u_conn->thread = th;
 
@@ -459,15 +662,90 @@ int flb_io_tls_net_write(struct flb_thread *th, struct flb_upstream_conn *u_conn
         return -1;
     }
 
-    /* Update counter and check if we need to continue writing */
+    /*
+     * Update counter and check if we need to continue writing. A write takes
+     * one record at most, the next one is written right away: mbedTLS asks
+     * to wait above if the socket is not ready.
+     */
     total += ret;
     if (total < len) {
-        io_tls_event_switch(u_conn, MK_EVENT_WRITE);
-        flb_thread_yield(th, FLB_FALSE);
         goto retry_write;
     }
 
     *out_len = total;
-    mk_event_del(u->evl, &u_conn->event);
+    mk_event_del(u_conn->evl, &u_conn->event);
     return 0;
 }
+
+/*
+ * mbedTLS has no vectored write interface: the buffers are merged so the
+ * data is sent in full records, once nothing is pending a buffer bigger
+ * than a record is written directly.
+ */
+int flb_io_tls_net_writev(struct flb_thread *th, struct flb_upstream_conn *u_conn,
+                          const struct iovec *iov, int iovcnt, size_t *out_len)
+{
+    int i;
+    int ret = 0;
+    char *base;
+    char *buf = NULL;
+    size_t off;
+    size_t len;
+    size_t used = 0;
+    size_t bytes;
+    size_t total = 0;
+
+    for (i = 0; i < iovcnt && ret == 0; i++) {
+        base = iov[i].iov_base;
+        off = 0;
+
+        while (off < iov[i].iov_len) {
+            len = iov[i].iov_len - off;
+            if (used == 0 && len >= FLB_TLS_RECORD) {
+                ret = flb_io_tls_net_write(th, u_conn, base + off, len, &bytes);
+                if (ret == 0) {
+                    total += bytes;
+                }
+                break;
+            }
+
+            if (!buf) {
+                buf = flb_malloc(FLB_TLS_RECORD);
+                if (!buf) {
+                    flb_errno();
+                    return -1;
+                }
+            }
+
+            if (len > FLB_TLS_RECORD - used) {
+                len = FLB_TLS_RECORD - used;
+            }
+            memcpy(buf + used, base + off, len);
+            used += len;
+            off += len;
+
+            if (used == FLB_TLS_RECORD) {
+                ret = flb_io_tls_net_write(th, u_conn, buf, used, &bytes);
+                if (ret != 0) {
+                    break;
+                }
+                total += bytes;
+                used = 0;
+            }
+        }
+    }
+
+    if (ret == 0 && used > 0) {
+        ret = flb_io_tls_net_write(th, u_conn, buf, used, &bytes);
+        if (ret == 0) {
+            total += bytes;
+        }
+    }
+
+    if (buf) {
+        flb_free(buf);
+    }
+
+    *out_len = total;
+    return ret;
+}
@@ -107,6 +107,7 @@ void flb_init_env()
 {
     flb_thread_prepare();
     flb_output_prepare();
+    flb_output_worker_prepare();
 }
 
 flb_ctx_t *flb_create()
@@ -446,12 +447,77 @@ int flb_lib_free(void* data)
 }
 
 
+/*
+ * Enqueue a copy of the data in the input instance ring. The caller never
+ * blocks: if the ring is full it gets FLB_LIB_BUSY and should retry later.
+ *
+ * The input detaches the ring (sets it to NULL) when it exits and waits
+ * until 'ring_users' drops to zero before destroying it, so the ring is
+ * only used while this caller is registered as a user.
+ */
+static int lib_ring_push(struct flb_input_instance *i_ins, int type,
+                         const void *data, size_t len)
+{
+    int ret;
+    void *buf;
+    struct flb_ring *ring;
+
+    buf = flb_malloc(len);
+    if (!buf) {
+        flb_errno();
+        return -1;
+    }
+    memcpy(buf, data, len);
+
+    __atomic_add_fetch(&i_ins->ring_users, 1, __ATOMIC_SEQ_CST);
+    ring = __atomic_load_n(&i_ins->ring, __ATOMIC_SEQ_CST);
+    if (!ring) {
+        __atomic_sub_fetch(&i_ins->ring_users, 1, __ATOMIC_SEQ_CST);
+        flb_free(buf);
+        flb_error("[lib] input instance %s is closed", i_ins->name);
+        return -1;
+    }
+
+    ret = flb_ring_push(ring, type, buf, len);
+    __atomic_sub_fetch(&i_ins->ring_users, 1, __ATOMIC_SEQ_CST);
+
+    if (ret != FLB_RING_OK) {
+        flb_free(buf);
+        if (ret == FLB_RING_FULL) {
+            return FLB_LIB_BUSY;
+        }
+        return -1;
+    }
+
+    return len;
+}
+
 /* Push some data into the Engine */
 int flb_lib_push(flb_ctx_t *ctx, int ffd, const void *data, size_t len)
 {
-    int ret;
     struct flb_input_instance *i_ins;
 
+    if (ctx->status == FLB_LIB_NONE || ctx->status == FLB_LIB_ERROR) {
+        flb_error("[lib] cannot push data, engine is not running");
+        return -1;
+    }
+
+    i_ins = in_instance_get(ctx, ffd);
+    if (!i_ins) {
+        return -1;
+    }
+
+    return lib_ring_push(i_ins, FLB_LIB_DATA_JSON, data, len);
+}
+
+/*
+ * Push a batch of records already encoded as msgpack, 'data' must contain
+ * a sequence of complete [timestamp, map] entries. Returns the number of
+ * bytes queued, FLB_LIB_BUSY if the input ring is full or -1 on error.
+ */
+int flb_lib_push_msgpack(flb_ctx_t *ctx, int ffd, const void *data, size_t len)
+{
+    struct flb_input_instance *i_ins;
 
     if (ctx->status == FLB_LIB_NONE || ctx->status == FLB_LIB_ERROR) {
         flb_error("[lib] cannot push data, engine is not running");
@@ -463,12 +529,13 @@ int flb_lib_push(flb_ctx_t *ctx, int ffd, const void *data, size_t len)
         return -1;
     }
 
-    ret = flb_pipe_w(i_ins->channel[1], data, len);
-    if (ret == -1) {
-        flb_errno();
+    if (!i_ins->ring) {
+        flb_error("[lib] input instance %s does not accept msgpack data",
+                  i_ins->name);
         return -1;
     }
-    return ret;
+
+    return lib_ring_push(i_ins, FLB_LIB_DATA_MSGPACK, data, len);
 }
 
 static void flb_lib_worker(void *data)
@@ -558,6 +625,9 @@ int flb_stop(flb_ctx_t *ctx)
 
     flb_debug("[lib] sending STOP signal to the engine");
 
+    /* New pushes get an error, the inputs wait for the ones in flight */
+    ctx->status = FLB_LIB_NONE;
+
     tid = ctx->config->worker;
     flb_engine_exit(ctx->config);
     ret = pthread_join(tid, NULL);
@@ -26,6 +26,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 
 #include <monkey/mk_core.h>
 #include <fluent-bit/flb_log.h>
@@ -33,6 +36,8 @@
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_worker.h>
 #include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_ring.h>
+#include <fluent-bit/flb_utils.h>
 
 FLB_TLS_DEFINE(struct flb_log, flb_log_ctx)
 
@@ -57,51 +62,158 @@ static inline int consume_byte(flb_pipefd_t fd)
     return 0;
 }
 
-static inline int log_push(struct log_message *msg, struct flb_log *log)
+static int log_writev(int fd, struct iovec *iov, int n)
+{
+#ifdef _WIN32
+    int i;
+    int ret = 0;
+
+    for (i = 0; i < n; i++) {
+        ret = write(fd, iov[i].iov_base, iov[i].iov_len);
+    }
+    return ret;
+#else
+    return writev(fd, iov, n);
+#endif
+}
+
+/* Write a batch of messages to the log output */
+static inline int log_push(struct iovec *iov, int n, struct flb_log *log)
 {
     int fd;
     int ret = -1;
 
     if (log->type == FLB_LOG_STDERR) {
-        return write(STDERR_FILENO, msg->msg, msg->size);
+        return log_writev(STDERR_FILENO, iov, n);
     }
     else if (log->type == FLB_LOG_FILE) {
         fd = open(log->out, O_CREAT | O_WRONLY | O_APPEND, 0666);
         if (fd == -1) {
             fprintf(stderr, "[log] error opening log file %s. Using stderr.\n",
                     log->out);
-            return write(STDERR_FILENO, msg->msg, msg->size);
+            return log_writev(STDERR_FILENO, iov, n);
         }
-        ret = write(fd, msg->msg, msg->size);
+        ret = log_writev(fd, iov, n);
         close(fd);
     }
 
     return ret;
 }
 
-static inline int log_read(flb_pipefd_t fd, struct flb_log *log)
+/* Write all the messages queued by a worker thread */
+static void log_drain(struct flb_worker *worker, struct flb_log *log)
 {
-    int bytes;
-    struct log_message msg;
+    int i;
+    int n = 0;
+    int len;
+    int type;
+    size_t size;
+    uint64_t dropped;
+    void *data;
+    char buf[128];
+    struct iovec iov[FLB_LOG_BATCH];
+
+    dropped = __atomic_exchange_n(&worker->log_dropped, 0, __ATOMIC_SEQ_CST);
+    if (dropped > 0) {
+        len = snprintf(buf, sizeof(buf) - 1,
+                       "[log] %" PRIu64 " messages dropped, queue is full\n",
+                       dropped);
+        iov[n].iov_base = buf;
+        iov[n].iov_len = len;
+        n++;
+    }
 
-    /*
-     * Since write operations to the pipe are always atomic 'if' they are
-     * under the PIPE_BUF limit (4KB on Linux) and our messages are always 1KB,
-     * we can trust we will always get a full message on each read(2).
-     */
-    bytes = flb_pipe_read_all(fd, &msg, sizeof(struct log_message));
-    if (bytes <= 0) {
-        perror("bytes");
-        return -1;
+    while (flb_ring_pop(worker->log_ring, &type, &data, &size) == FLB_RING_OK) {
+        iov[n].iov_base = data;
+        iov[n].iov_len = size;
+        n++;
+
+        if (n == FLB_LOG_BATCH) {
+            log_push(iov, n, log);
+            for (i = 0; i < n; i++) {
+                if (iov[i].iov_base != buf) {
+                    flb_free(iov[i].iov_base);
+                }
+            }
+            n = 0;
+        }
     }
-    if (msg.size > sizeof(msg.msg)) {
-        fprintf(stderr, "[log] message too long: %zi > %zi",
-                msg.size, sizeof(msg.msg));
-        return -1;
+
+    if (n > 0) {
+        log_push(iov, n, log);
+        for (i = 0; i < n; i++) {
+            if (iov[i].iov_base != buf) {
+                flb_free(iov[i].iov_base);
+            }
+        }
     }
-    log_push(&msg, log);
+}
 
-    return bytes;
+static int log_time_header(struct flb_log_cache *cache, time_t now,
+                           int colors, char *buf, size_t size);
+
+/*
+ * Report the messages suppressed by call sites which did not log again in
+ * a later second, otherwise the count would wait for their next message.
+ * If 'force' is set every pending count is reported.
+ */
+static void log_rate_flush(struct flb_log *log, int force)
+{
+    int i;
+    int len;
+    int line;
+    int count;
+    time_t now;
+    const char *file;
+    char buf[512];
+    struct iovec iov;
+    struct mk_list *head;
+    struct flb_log_rate *r;
+    struct flb_log_cache *cache;
+
+    now = time(NULL);
+
+    pthread_mutex_lock(&log->caches_mutex);
+    mk_list_foreach(head, &log->caches) {
+        cache = mk_list_entry(head, struct flb_log_cache, _head);
+        for (i = 0; i < FLB_LOG_RATE_SLOTS; i++) {
+            r = &cache->rate[i];
+            if (__atomic_load_n(&r->suppressed, __ATOMIC_SEQ_CST) == 0) {
+                continue;
+            }
+            if (!force && __atomic_load_n(&r->window, __ATOMIC_SEQ_CST) == now) {
+                /* the call site is still being limited */
+                continue;
+            }
+
+            file = __atomic_load_n(&r->file, __ATOMIC_SEQ_CST);
+            line = __atomic_load_n(&r->line, __ATOMIC_SEQ_CST);
+            count = __atomic_exchange_n(&r->suppressed, 0, __ATOMIC_SEQ_CST);
+            if (count == 0 || !file) {
+                /* reported by the producer in the meantime */
+                continue;
+            }
+
+            len = log_time_header(NULL, now, log->colors, buf, sizeof(buf));
+            if (len < 0) {
+                continue;
+            }
+            len += snprintf(buf + len, sizeof(buf) - len,
+                            "[%s%5s%s] [log] %s:%i: %i similar messages "
+                            "suppressed\n",
+                            log->colors ? ANSI_YELLOW : "", "warn",
+                            log->colors ? ANSI_RESET : "",
+                            file, line, count);
+            if (len >= sizeof(buf)) {
+                len = sizeof(buf) - 1;
+                buf[len - 1] = '\n';
+            }
+            iov.iov_base = buf;
+            iov.iov_len = len;
+            log_push(&iov, 1, log);
+        }
+    }
+    pthread_mutex_unlock(&log->caches_mutex);
 }
 
 /* Central collector of messages */
@@ -124,7 +236,13 @@ static void log_worker_collector(void *data)
         mk_event_wait(log->evl);
         mk_event_foreach(event, log->evl) {
             if (event->type == FLB_LOG_EVENT) {
-                log_read(event->fd, log);
+                /* the event is the first member of the worker */
+                flb_ring_consume_signal(((struct flb_worker *) event)->log_ring);
+                log_drain((struct flb_worker *) event, log);
+            }
+            else if (event->type == FLB_LOG_TIMER) {
+                flb_utils_timer_consume(event->fd);
+                log_rate_flush(log, FLB_FALSE);
             }
             else if (event->type == FLB_LOG_MNG) {
                 consume_byte(event->fd);
@@ -143,26 +261,137 @@ int flb_log_worker_init(void *data)
     struct flb_config *config = worker->config;
     struct flb_log *log = config->log;
 
-    /* Pipe to communicate Thread with worker log-collector */
-    ret = flb_pipe_create(worker->log);
-    if (ret == -1) {
-        perror("pipe");
+    /* Already initialized by the thread creating the worker */
+    if (worker->log_ring) {
+        return 0;
+    }
+
+    /* Ring to queue messages for the worker log-collector */
+    worker->log_ring = flb_ring_create(FLB_LOG_RING_SLOTS);
+    if (!worker->log_ring) {
         return -1;
     }
 
-    /* Register the read-end of the pipe (log[0]) into the event loop */
+    worker->log_cache = flb_calloc(1, sizeof(struct flb_log_cache));
+    if (!worker->log_cache) {
+        perror("calloc");
+        flb_ring_destroy(worker->log_ring);
+        worker->log_ring = NULL;
+        return -1;
+    }
+    worker->log_dropped = 0;
+
+    /* Register the ring notifications into the event loop */
     MK_EVENT_ZERO(&worker->event);
-    ret = mk_event_add(log->evl, worker->log[0],
+    ret = mk_event_add(log->evl, flb_ring_fd(worker->log_ring),
                        FLB_LOG_EVENT, MK_EVENT_READ, &worker->event);
     if (ret == -1) {
-        close(worker->log[0]);
-        close(worker->log[1]);
+        flb_log_worker_destroy(worker);
         return -1;
     }
 
+    /* Let the log worker report the suppressed messages */
+    pthread_mutex_lock(&log->caches_mutex);
+    mk_list_add(&worker->log_cache->_head, &log->caches);
+    pthread_mutex_unlock(&log->caches_mutex);
+
     return 0;
 }
 
+/*
+ * The rate state is unlinked from the log context by flb_log_stop(), the
+ * caches are released after the logger is stopped.
+ */
+void flb_log_worker_destroy(struct flb_worker *worker)
+{
+    if (worker->log_ring) {
+        flb_ring_destroy(worker->log_ring);
+        worker->log_ring = NULL;
+    }
+    if (worker->log_cache) {
+        flb_free(worker->log_cache);
+        worker->log_cache = NULL;
+    }
+}
+
+/* Hash of a call site, the file name is hashed by content */
+static inline uint32_t log_rate_hash(const char *file, int line)
+{
+    uint32_t hash = 5381;
+
+    while (*file) {
+        hash = ((hash << 5) + hash) + (unsigned char) *file++;
+    }
+    return (hash ^ line) * 2654435761u;
+}
+
+/*
+ * Rate limit of the messages from a call site: FLB_LOG_RATE_BURST messages
+ * per second. Returns FLB_FALSE if the message must be suppressed, when a new
+ * second starts 'suppressed' gets the number of messages lost in the last
+ * one (unless the log worker reported them already).
+ *
+ * Call sites are looked up by file name and line with linear probing, a slot
+ * is only reused when its call site went quiet and has nothing pending to
+ * report. If every slot is in use the message is not limited.
+ */
+int flb_log_rate_check(struct flb_log_cache *cache, const char *file,
+                       int line, time_t now, int *suppressed)
+{
+    int i;
+    int found = FLB_FALSE;
+    uint32_t hash;
+    struct flb_log_rate *r = NULL;
+    struct flb_log_rate *idle = NULL;
+
+    *suppressed = 0;
+
+    hash = log_rate_hash(file, line);
+    for (i = 0; i < FLB_LOG_RATE_SLOTS; i++) {
+        r = &cache->rate[(hash + i) % FLB_LOG_RATE_SLOTS];
+        if (!r->file) {
+            break;
+        }
+        if (r->line == line && (r->file == file || strcmp(r->file, file) == 0)) {
+            found = FLB_TRUE;
+            break;
+        }
+        if (!idle && r->window < now &&
+            __atomic_load_n(&r->suppressed, __ATOMIC_SEQ_CST) == 0) {
+            idle = r;
+        }
+    }
+
+    if (found == FLB_FALSE) {
+        if (i == FLB_LOG_RATE_SLOTS) {
+            if (!idle) {
+                return FLB_TRUE;
+            }
+            r = idle;
+        }
+        __atomic_store_n(&r->file, file, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&r->line, line, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&r->window, now, __ATOMIC_SEQ_CST);
+        r->count = 1;
+        return FLB_TRUE;
+    }
+
+    if (r->window != now) {
+        *suppressed = __atomic_exchange_n(&r->suppressed, 0, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&r->window, now, __ATOMIC_SEQ_CST);
+        r->count = 1;
+        return FLB_TRUE;
+    }
+
+    if (r->count < FLB_LOG_RATE_BURST) {
+        r->count++;
+        return FLB_TRUE;
+    }
+
+    __atomic_fetch_add(&r->suppressed, 1, __ATOMIC_SEQ_CST);
+    return FLB_FALSE;
+}
+
 int flb_log_set_level(struct flb_config *config, int level)
 {
     config->log->level = level;
@@ -239,6 +468,9 @@ struct flb_log *flb_log_init(struct flb_config *config, int type,
     log->out   = out;
     log->evl   = evl;
     log->tid   = 0;
+    log->colors = isatty(STDOUT_FILENO);
+    mk_list_init(&log->caches);
+    pthread_mutex_init(&log->caches_mutex, NULL);
 
     ret = flb_pipe_create(log->ch_mng);
     if (ret == -1) {
@@ -261,6 +493,18 @@ struct flb_log *flb_log_init(struct flb_config *config, int type,
         return NULL;
     }
 
+    /* Timer to report the messages suppressed by the rate limit */
+    MK_EVENT_ZERO(&log->event_timer);
+    log->timer_fd = mk_event_timeout_create(log->evl, 1, 0, &log->event_timer);
+    if (log->timer_fd == -1) {
+        fprintf(stderr, "[log] could not create timer\n");
+        mk_event_loop_destroy(log->evl);
+        flb_free(log);
+        config->log = NULL;
+        return NULL;
+    }
+    log->event_timer.type = FLB_LOG_TIMER;
+
     /*
      * Since the main process/thread might want to write log messages,
      * it will need a 'worker-like' context, here we create a fake worker
@@ -278,6 +522,8 @@ struct flb_log *flb_log_init(struct flb_config *config, int type,
     worker->data    = NULL;
     worker->log_ctx = log;
     worker->config  = config;
+    worker->log_ring = NULL;
+    worker->log_cache = NULL;
 
     /* Set the worker context global */
     FLB_TLS_SET(flb_worker_ctx, worker);
@@ -322,21 +568,84 @@ struct flb_log *flb_log_init(struct flb_config *config, int type,
     return log;
 }
 
+/* Format the time header once per second */
+static int log_time_header(struct flb_log_cache *cache, time_t now,
+                           int colors, char *buf, size_t size)
+{
+    int len;
+    const char *bold_color = colors ? ANSI_BOLD : "";
+    const char *reset_color = colors ? ANSI_RESET : "";
+    struct tm result;
+    struct tm *current;
+
+    if (cache && cache->time_len > 0 && cache->time_sec == now) {
+        memcpy(buf, cache->time_buf, cache->time_len);
+        return cache->time_len;
+    }
+
+    current = localtime_r(&now, &result);
+    if (current == NULL) {
+        return -1;
+    }
+
+    len = snprintf(buf, size - 1,
+                   "%s[%s%i/%02i/%02i %02i:%02i:%02i%s]%s ",
+                   bold_color, reset_color,
+                   current->tm_year + 1900,
+                   current->tm_mon + 1,
+                   current->tm_mday,
+                   current->tm_hour,
+                   current->tm_min,
+                   current->tm_sec,
+                   bold_color, reset_color);
+
+    if (cache && len > 0 && len < sizeof(cache->time_buf)) {
+        memcpy(cache->time_buf, buf, len);
+        cache->time_len = len;
+        cache->time_sec = now;
+    }
+
+    return len;
+}
+
 void flb_log_print(int type, const char *file, int line, const char *fmt, ...)
 {
+    int ret;
     int len;
     int total;
+    int colors = FLB_TRUE;
+    int suppressed = 0;
     time_t now;
+    char *buf;
     const char *header_color = NULL;
     const char *header_title = NULL;
-    const char *bold_color = ANSI_BOLD;
     const char *reset_color = ANSI_RESET;
-    struct tm result;
-    struct tm *current;
-    struct log_message msg = {0};
+    struct log_message msg;
+    struct flb_worker *w;
+    struct flb_log_cache *cache = NULL;
     va_list args;
 
-    va_start(args, fmt);
+    w = flb_worker_get();
+    if (w) {
+        cache = w->log_cache;
+        if (w->log_ctx) {
+            colors = ((struct flb_log *) w->log_ctx)->colors;
+        }
+    }
+    else {
+        colors = isatty(STDOUT_FILENO);
+    }
+
+    now = time(NULL);
+
+    /* Rate limit repeated errors and warnings from the same call site */
+    if (cache && file &&
+        (type == FLB_LOG_ERROR || type == FLB_LOG_WARN)) {
+        ret = flb_log_rate_check(cache, file, line, now, &suppressed);
+        if (ret == FLB_FALSE) {
+            return;
+        }
+    }
 
     switch (type) {
     case FLB_LOG_HELP:
@@ -370,62 +679,56 @@ void flb_log_print(int type, const char *file, int line, const char *fmt, ...)
     }
 
     /* Only print colors to a terminal */
-    if (!isatty(STDOUT_FILENO)) {
+    if (!colors) {
         header_color = "";
-        bold_color = "";
         reset_color = "";
     }
 
-    now = time(NULL);
-    current = localtime_r(&now, &result);
-
-    if (current == NULL) {
-        va_end(args);
+    len = log_time_header(cache, now, colors, msg.msg, sizeof(msg.msg));
+    if (len < 0) {
         return;
     }
 
-    len = snprintf(msg.msg, sizeof(msg.msg) - 1,
-                   "%s[%s%i/%02i/%02i %02i:%02i:%02i%s]%s [%s%5s%s] ",
-                   /*      time     */                    /* type */
-
-                   /* time variables */
-                   bold_color, reset_color,
-                   current->tm_year + 1900,
-                   current->tm_mon + 1,
-                   current->tm_mday,
-                   current->tm_hour,
-                   current->tm_min,
-                   current->tm_sec,
-                   bold_color, reset_color,
-
-                   /* type format */
-                   header_color, header_title, reset_color);
+    len += snprintf(msg.msg + len, sizeof(msg.msg) - 1 - len,
+                    "[%s%5s%s] ", header_color, header_title, reset_color);
 
+    va_start(args, fmt);
     total = vsnprintf(msg.msg + len,
                       (sizeof(msg.msg) - 2) - len,
                       fmt, args);
+    va_end(args);
     if (total < 0) {
-        va_end(args);
         return;
     }
 
     total = strlen(msg.msg + len) + len;
+    if (suppressed > 0) {
+        ret = snprintf(msg.msg + total, (sizeof(msg.msg) - 2) - total,
+                       " (%i similar messages suppressed)", suppressed);
+        if (ret > 0) {
+            total = strlen(msg.msg + total) + total;
+        }
+    }
     msg.msg[total++] = '\n';
     msg.msg[total]   = '\0';
     msg.size = total;
-    va_end(args);
 
-    struct flb_worker *w;
+    if (!w || !w->log_ring) {
+        fprintf(stderr, "%s", (char *) msg.msg);
+        return;
+    }
 
-    w = flb_worker_get();
-    if (w) {
-        int n = flb_pipe_write_all(w->log[1], &msg, sizeof(msg));
-        if (n == -1) {
-            perror("write");
-        }
+    buf = flb_malloc(msg.size);
+    if (!buf) {
+        __atomic_fetch_add(&w->log_dropped, 1, __ATOMIC_SEQ_CST);
+        return;
     }
-    else {
-        fprintf(stderr, "%s", (char *) msg.msg);
+    memcpy(buf, msg.msg, msg.size);
+
+    ret = flb_ring_push(w->log_ring, type, buf, msg.size);
+    if (ret != FLB_RING_OK) {
+        flb_free(buf);
+        __atomic_fetch_add(&w->log_dropped, 1, __ATOMIC_SEQ_CST);
     }
 }
 
@@ -434,21 +737,48 @@ int flb_errno_print(int errnum, const char *file, int line)
     char buf[256];
 
     strerror_r(errnum, buf, sizeof(buf) - 1);
-    flb_error("[%s:%i errno=%i] %s", file, line, errnum, buf);
+
+    /* rate limited by the caller file:line, not by this one */
+    if (flb_log_check(FLB_LOG_ERROR)) {
+        flb_log_print(FLB_LOG_ERROR, file, line,
+                      "[%s:%i errno=%i] %s", file, line, errnum, buf);
+    }
     return 0;
 }
 
 int flb_log_stop(struct flb_log *log, struct flb_config *config)
 {
     uint64_t val = FLB_TRUE;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_worker *worker;
 
     /* Signal the child worker, stop working */
     flb_pipe_w(log->ch_mng[1], &val, sizeof(val));
     pthread_join(log->tid, NULL);
 
+    /* Write the messages still queued */
+    log_drain(log->worker, log);
+    mk_list_foreach(head, &config->workers) {
+        worker = mk_list_entry(head, struct flb_worker, _head);
+        if (worker->log_ring) {
+            log_drain(worker, log);
+        }
+    }
+    log_rate_flush(log, FLB_TRUE);
+
     /* Release resources */
+    mk_list_foreach_safe(head, tmp, &log->caches) {
+        mk_list_del(head);
+    }
+    pthread_mutex_destroy(&log->caches_mutex);
+    mk_event_timeout_destroy(log->evl, &log->event_timer);
     mk_event_loop_destroy(log->evl);
     flb_pipe_destroy(log->ch_mng);
+    flb_log_worker_destroy(log->worker);
+    if (flb_worker_get() == log->worker) {
+        FLB_TLS_SET(flb_worker_ctx, NULL);
+    }
     flb_free(log->worker);
     flb_free(log);
 
@@ -0,0 +1,556 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_str.h>
+#include <fluent-bit/flb_ml.h>
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+/* Record buffers bigger than this are released after a flush */
+#define ML_BUF_KEEP     65536
+
+struct ml_builtin_rule {
+    char *from_states;
+    char *pattern;
+    char *to_state;
+};
+
+struct ml_builtin {
+    char *name;
+    struct ml_builtin_rule *rules;
+};
+
+/*
+ * Rules to detect the stack traces of the most common languages. They are
+ * based on the ones used by the Google Cloud Logging exception detector.
+ */
+static struct ml_builtin_rule rules_java[] = {
+    {"start_state, java_start_exception",
+     "(?:Exception|Error|Throwable|V8 errors stack trace)(?::|$)",
+     "java_after_exception"},
+    {"java_after_exception",
+     "^[\\t ]*nested exception is:[\\t ]*",
+     "java_start_exception"},
+    {"java_after_exception",
+     "^[\\r\\n]*$",
+     "java_after_exception"},
+    {"java_after_exception, java",
+     "^[\\t ]+(?:eval )?at ",
+     "java"},
+    {"java_after_exception, java",
+     "^[\\t ]+--- End of inner exception stack trace ---$",
+     "java"},
+    {"java_after_exception, java",
+     "^--- End of stack trace from previous location where exception was thrown ---$",
+     "java"},
+    {"java_after_exception, java",
+     "^[\\t ]*(?:Caused by|Suppressed):",
+     "java_after_exception"},
+    {"java_after_exception, java",
+     "^[\\t ]*... \\d+ (?:more|common frames omitted)",
+     "java"},
+    {NULL, NULL, NULL}
+};
+
+static struct ml_builtin_rule rules_go[] = {
+    {"start_state",
+     "\\bpanic: ",
+     "go_after_panic"},
+    {"go_after_panic, go_after_signal, go_frame_1",
+     "^$",
+     "go_goroutine"},
+    {"go_after_panic",
+     "^\\[signal ",
+     "go_after_signal"},
+    {"go_goroutine",
+     "^goroutine \\d+ \\[[^\\]]+\\]:$",
+     "go_frame_1"},
+    {"go_frame_1",
+     "^(?:[^\\s.:]+\\.)*[^\\s.():]+\\(|^created by ",
+     "go_frame_2"},
+    {"go_frame_2",
+     "^\\s",
+     "go_frame_1"},
+    {NULL, NULL, NULL}
+};
+
+static struct ml_builtin_rule rules_python[] = {
+    {"start_state",
+     "^Traceback \\(most recent call last\\):$",
+     "python"},
+    {"python",
+     "^[\\t ]+File ",
+     "python_code"},
+    {"python_code",
+     "[^\\t ]",
+     "python"},
+    {"python",
+     "^(?:[^\\s.():]+\\.)*[^\\s.():]+:",
+     "start_state"},
+    {NULL, NULL, NULL}
+};
+
+static struct ml_builtin builtins[] = {
+    {"java",   rules_java},
+    {"go",     rules_go},
+    {"python", rules_python},
+    {NULL, NULL}
+};
+
+/* Lookup a state by name, optionally register it if it does not exist */
+static int state_get(struct flb_ml *ml, const char *name, int len, int create)
+{
+    int i;
+    struct flb_ml_state *state;
+
+    for (i = 0; i < ml->states_count; i++) {
+        state = &ml->states[i];
+        if (flb_sds_len(state->name) == len &&
+            strncmp(state->name, name, len) == 0) {
+            return i;
+        }
+    }
+
+    if (create == FLB_FALSE) {
+        return -1;
+    }
+
+    if (ml->states_count == FLB_ML_STATES_MAX) {
+        flb_error("[multiline] %s: too many states", ml->name);
+        return -1;
+    }
+
+    state = &ml->states[ml->states_count];
+    state->name = flb_sds_create_len(name, len);
+    if (!state->name) {
+        return -1;
+    }
+    state->rules_count = 0;
+    state->rules = NULL;
+    state->set = NULL;
+
+    return ml->states_count++;
+}
+
+static int state_add_rule(struct flb_ml_state *state, struct flb_ml_rule *rule)
+{
+    struct flb_ml_rule **tmp;
+
+    tmp = flb_realloc(state->rules,
+                      sizeof(struct flb_ml_rule *) * (state->rules_count + 1));
+    if (!tmp) {
+        flb_errno();
+        return -1;
+    }
+    state->rules = tmp;
+    state->rules[state->rules_count++] = rule;
+
+    return 0;
+}
+
+/* First rule of the state matching the line, in the order they were added */
+static struct flb_ml_rule *state_match(struct flb_ml_state *state,
+                                       const char *line, size_t len)
+{
+    int i;
+
+    if (state->rules_count == 0) {
+        return NULL;
+    }
+
+    flb_regex_set_scan(state->set, line, len);
+    for (i = 0; i < state->rules_count; i++) {
+        if (flb_regex_set_match(state->set, i, line, len) == FLB_TRUE) {
+            return state->rules[i];
+        }
+    }
+
+    return NULL;
+}
+
+struct flb_ml *flb_ml_create(const char *name)
+{
+    int ret;
+    struct flb_ml *ml;
+
+    ml = flb_calloc(1, sizeof(struct flb_ml));
+    if (!ml) {
+        flb_errno();
+        return NULL;
+    }
+    mk_list_init(&ml->rules);
+    ml->max_lines = FLB_ML_MAX_LINES;
+    ml->flush_timeout = FLB_ML_FLUSH_TIMEOUT;
+
+    ml->name = flb_sds_create(name);
+    if (!ml->name) {
+        flb_free(ml);
+        return NULL;
+    }
+
+    /* the start state is always the first one */
+    ret = state_get(ml, FLB_ML_START_STATE, sizeof(FLB_ML_START_STATE) - 1,
+                    FLB_TRUE);
+    if (ret != 0) {
+        flb_ml_destroy(ml);
+        return NULL;
+    }
+
+    return ml;
+}
+
+/*
+ * Register a rule: 'from_states' is a comma separated list of the states
+ * where the rule applies.
+ */
+int flb_ml_rule_add(struct flb_ml *ml, const char *from_states,
+                    const char *pattern, const char *to_state)
+{
+    int id;
+    int ret;
+    const char *p;
+    const char *end;
+    struct flb_ml_rule *rule;
+
+    rule = flb_calloc(1, sizeof(struct flb_ml_rule));
+    if (!rule) {
+        flb_errno();
+        return -1;
+    }
+
+    rule->to_state = state_get(ml, to_state, strlen(to_state), FLB_TRUE);
+    if (rule->to_state == -1) {
+        flb_free(rule);
+        return -1;
+    }
+
+    rule->pattern = flb_strdup(pattern);
+    rule->regex = flb_regex_create(pattern);
+    if (!rule->pattern || !rule->regex) {
+        flb_error("[multiline] %s: invalid rule pattern '%s'",
+                  ml->name, pattern);
+        if (rule->regex) {
+            flb_regex_destroy(rule->regex);
+        }
+        flb_free(rule->pattern);
+        flb_free(rule);
+        return -1;
+    }
+    mk_list_add(&rule->_head, &ml->rules);
+
+    /* attach the rule to every origin state */
+    p = from_states;
+    while (*p) {
+        while (*p == ',' || isspace((unsigned char) *p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        end = p;
+        while (*end && *end != ',' && !isspace((unsigned char) *end)) {
+            end++;
+        }
+
+        id = state_get(ml, p, end - p, FLB_TRUE);
+        if (id == -1) {
+            return -1;
+        }
+        ret = state_add_rule(&ml->states[id], rule);
+        if (ret == -1) {
+            return -1;
+        }
+        p = end;
+    }
+
+    return 0;
+}
+
+/* Compile the rules of every state into a regex set */
+int flb_ml_compile(struct flb_ml *ml)
+{
+    int i;
+    int j;
+    int ret;
+    struct flb_ml_state *state;
+
+    if (ml->states[0].rules_count == 0) {
+        flb_error("[multiline] %s: no rules for '%s'",
+                  ml->name, FLB_ML_START_STATE);
+        return -1;
+    }
+
+    for (i = 0; i < ml->states_count; i++) {
+        state = &ml->states[i];
+        if (state->rules_count == 0 || state->set) {
+            continue;
+        }
+
+        state->set = flb_regex_set_create();
+        if (!state->set) {
+            return -1;
+        }
+
+        for (j = 0; j < state->rules_count; j++) {
+            ret = flb_regex_set_add(state->set, state->rules[j]->pattern,
+                                    state->rules[j]->regex);
+            if (ret == -1) {
+                return -1;
+            }
+        }
+
+        ret = flb_regex_set_compile(state->set);
+        if (ret == -1) {
+            flb_error("[multiline] %s: cannot compile rules of state '%s'",
+                      ml->name, state->name);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Create and compile one of the built-in rule sets */
+struct flb_ml *flb_ml_builtin_create(const char *name)
+{
+    int i;
+    int ret;
+    struct flb_ml *ml;
+    struct ml_builtin *b = NULL;
+    struct ml_builtin_rule *r;
+
+    for (i = 0; builtins[i].name; i++) {
+        if (strcasecmp(builtins[i].name, name) == 0) {
+            b = &builtins[i];
+            break;
+        }
+    }
+    if (!b) {
+        return NULL;
+    }
+
+    ml = flb_ml_create(b->name);
+    if (!ml) {
+        return NULL;
+    }
+
+    for (r = b->rules; r->from_states; r++) {
+        ret = flb_ml_rule_add(ml, r->from_states, r->pattern, r->to_state);
+        if (ret == -1) {
+            flb_ml_destroy(ml);
+            return NULL;
+        }
+    }
+
+    ret = flb_ml_compile(ml);
+    if (ret == -1) {
+        flb_ml_destroy(ml);
+        return NULL;
+    }
+
+    return ml;
+}
+
+void flb_ml_destroy(struct flb_ml *ml)
+{
+    int i;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_ml_rule *rule;
+    struct flb_ml_state *state;
+
+    for (i = 0; i < ml->states_count; i++) {
+        state = &ml->states[i];
+        if (state->set) {
+            flb_regex_set_destroy(state->set);
+        }
+        flb_free(state->rules);
+        flb_sds_destroy(state->name);
+    }
+
+    mk_list_foreach_safe(head, tmp, &ml->rules) {
+        rule = mk_list_entry(head, struct flb_ml_rule, _head);
+        mk_list_del(&rule->_head);
+        flb_regex_destroy(rule->regex);
+        flb_free(rule->pattern);
+        flb_free(rule);
+    }
+
+    flb_sds_destroy(ml->name);
+    flb_free(ml);
+}
+
+int flb_ml_stream_init(struct flb_ml_stream *stream)
+{
+    stream->state = -1;
+    stream->lines = 0;
+    stream->last = 0;
+    flb_time_zero(&stream->time);
+
+    stream->buf = flb_sds_create_size(256);
+    if (!stream->buf) {
+        return -1;
+    }
+
+    return 0;
+}
+
+void flb_ml_stream_destroy(struct flb_ml_stream *stream)
+{
+    if (stream->buf) {
+        flb_sds_destroy(stream->buf);
+        stream->buf = NULL;
+    }
+    stream->state = -1;
+}
+
+static int stream_append(struct flb_ml_stream *stream,
+                         const char *line, size_t len)
+{
+    flb_sds_t tmp;
+
+    if (stream->lines > 0) {
+        tmp = flb_sds_cat(stream->buf, "\n", 1);
+        if (!tmp) {
+            return -1;
+        }
+        stream->buf = tmp;
+    }
+
+    tmp = flb_sds_cat(stream->buf, line, len);
+    if (!tmp) {
+        return -1;
+    }
+    stream->buf = tmp;
+    stream->lines++;
+    stream->last = time(NULL);
+
+    return 0;
+}
+
+/*
+ * Process a line of the stream. When the record in progress is complete
+ * it's passed to the callback. If the line does not belong to a multiline
+ * record FLB_ML_NA is returned and the caller must handle it.
+ */
+int flb_ml_process(struct flb_ml *ml, struct flb_ml_stream *stream,
+                   const char *line, size_t len, struct flb_time *tm,
+                   flb_ml_flush_cb cb, void *data)
+{
+    int ret;
+    struct flb_ml_rule *rule;
+
+    if (!stream->buf) {
+        stream->buf = flb_sds_create_size(256);
+        if (!stream->buf) {
+            stream->state = -1;
+            return FLB_ML_NA;
+        }
+    }
+
+    if (stream->state >= 0) {
+        rule = state_match(&ml->states[stream->state], line, len);
+        if (rule) {
+            ret = stream_append(stream, line, len);
+            if (ret == -1) {
+                flb_ml_flush(ml, stream, cb, data);
+                return FLB_ML_NA;
+            }
+            stream->state = rule->to_state;
+
+            /* back to the start state or too many lines: the record ends */
+            if (stream->state == 0 || stream->lines >= ml->max_lines) {
+                flb_ml_flush(ml, stream, cb, data);
+            }
+            return FLB_ML_MORE;
+        }
+
+        /* not a continuation, the record is complete */
+        flb_ml_flush(ml, stream, cb, data);
+    }
+
+    rule = state_match(&ml->states[0], line, len);
+    if (!rule) {
+        return FLB_ML_NA;
+    }
+
+    flb_sds_len_set(stream->buf, 0);
+    stream->lines = 0;
+    ret = stream_append(stream, line, len);
+    if (ret == -1) {
+        return FLB_ML_NA;
+    }
+    flb_time_copy(&stream->time, tm);
+    stream->state = rule->to_state;
+
+    if (stream->state == 0 || stream->lines >= ml->max_lines) {
+        flb_ml_flush(ml, stream, cb, data);
+    }
+
+    return FLB_ML_MORE;
+}
+
+/* Pass the record in progress to the callback */
+int flb_ml_flush(struct flb_ml *ml, struct flb_ml_stream *stream,
+                 flb_ml_flush_cb cb, void *data)
+{
+    if (stream->state < 0 || stream->lines == 0) {
+        stream->state = -1;
+        return -1;
+    }
+
+    cb(stream->buf, flb_sds_len(stream->buf), &stream->time, data);
+
+    stream->state = -1;
+    stream->lines = 0;
+    flb_time_zero(&stream->time);
+
+    /* don't keep the memory of an unusual big record */
+    if (flb_sds_alloc(stream->buf) > ML_BUF_KEEP) {
+        flb_sds_destroy(stream->buf);
+        stream->buf = flb_sds_create_size(256);
+    }
+    else {
+        flb_sds_len_set(stream->buf, 0);
+    }
+
+    return 0;
+}
+
+/* Flush the record in progress if no lines arrived for a while */
+int flb_ml_flush_pending(struct flb_ml *ml, struct flb_ml_stream *stream,
+                         time_t now, flb_ml_flush_cb cb, void *data)
+{
+    if (stream->state < 0) {
+        return -1;
+    }
+
+    if (stream->last + ml->flush_timeout > now) {
+        return -1;
+    }
+
+    return flb_ml_flush(ml, stream, cb, data);
+}
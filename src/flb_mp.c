@@ -19,6 +19,9 @@
  */
 
 #include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_mp.h>
+
 #include <msgpack.h>
 #include <mpack/mpack.h>
 
@@ -41,6 +44,172 @@ int flb_mp_count(const void *data, size_t bytes)
     return count;
 }
 
+static inline uint64_t mp_load(const unsigned char *p, int bytes)
+{
+    int i;
+    uint64_t val = 0;
+
+    for (i = 0; i < bytes; i++) {
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+/*
+ * Read the timestamp of a [TIMESTAMP, MAP] record without decoding it, the
+ * timestamp is an event time extension, an integer or a float. Returns -1
+ * if the record does not look like an event.
+ */
+static int mp_record_time(const unsigned char *p, size_t size,
+                          struct flb_time *tm)
+{
+    double d;
+    union {
+        uint64_t u;
+        double d;
+    } f64;
+    union {
+        uint32_t u;
+        float f;
+    } f32;
+
+    /* fixarray of 2 entries */
+    if (size < 2 || p[0] != 0x92) {
+        return -1;
+    }
+    p++;
+    size--;
+
+    if (p[0] <= 0x7f) {
+        tm->tm.tv_sec = p[0];
+        tm->tm.tv_nsec = 0;
+        return 0;
+    }
+
+    switch (p[0]) {
+    case 0xd7: /* fixext 8 */
+        if (size < 10 || p[1] != 0) {
+            return -1;
+        }
+        tm->tm.tv_sec = mp_load(p + 2, 4);
+        tm->tm.tv_nsec = mp_load(p + 6, 4);
+        return 0;
+    case 0xc7: /* ext 8 */
+        if (size < 11 || p[1] != 8 || p[2] != 0) {
+            return -1;
+        }
+        tm->tm.tv_sec = mp_load(p + 3, 4);
+        tm->tm.tv_nsec = mp_load(p + 7, 4);
+        return 0;
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf:
+        if (size < 1 + (1 << (p[0] - 0xcc))) {
+            return -1;
+        }
+        tm->tm.tv_sec = mp_load(p + 1, 1 << (p[0] - 0xcc));
+        tm->tm.tv_nsec = 0;
+        return 0;
+    case 0xd0:
+        if (size < 2) {
+            return -1;
+        }
+        tm->tm.tv_sec = (int8_t) p[1];
+        tm->tm.tv_nsec = 0;
+        return 0;
+    case 0xd1:
+        if (size < 3) {
+            return -1;
+        }
+        tm->tm.tv_sec = (int16_t) mp_load(p + 1, 2);
+        tm->tm.tv_nsec = 0;
+        return 0;
+    case 0xd2:
+        if (size < 5) {
+            return -1;
+        }
+        tm->tm.tv_sec = (int32_t) mp_load(p + 1, 4);
+        tm->tm.tv_nsec = 0;
+        return 0;
+    case 0xd3:
+        if (size < 9) {
+            return -1;
+        }
+        tm->tm.tv_sec = (int64_t) mp_load(p + 1, 8);
+        tm->tm.tv_nsec = 0;
+        return 0;
+    case 0xca:
+        if (size < 5) {
+            return -1;
+        }
+        f32.u = mp_load(p + 1, 4);
+        d = f32.f;
+        break;
+    case 0xcb:
+        if (size < 9) {
+            return -1;
+        }
+        f64.u = mp_load(p + 1, 8);
+        d = f64.d;
+        break;
+    default:
+        return -1;
+    }
+
+    flb_time_from_double(tm, d);
+    return 0;
+}
+
+/*
+ * Count the records and get the oldest and newest timestamps in a single
+ * pass, records are skipped without being decoded. If no timestamp is
+ * found, tm_min and tm_max are set to zero. Returns the number of records.
+ */
+int flb_mp_count_time(const void *data, size_t bytes,
+                      struct flb_time *tm_min, struct flb_time *tm_max)
+{
+    int count = 0;
+    int found = FLB_FALSE;
+    size_t remaining;
+    const char *p;
+    struct flb_time tm;
+    struct flb_time min;
+    struct flb_time max;
+    mpack_reader_t reader;
+
+    mpack_reader_init_data(&reader, (const char *) data, bytes);
+    while ((remaining = mpack_reader_remaining(&reader, &p)) > 0) {
+        if (mp_record_time((const unsigned char *) p, remaining, &tm) == 0) {
+            if (found == FLB_FALSE) {
+                min = tm;
+                max = tm;
+                found = FLB_TRUE;
+            }
+            else if (flb_time_cmp(&tm, &min) < 0) {
+                min = tm;
+            }
+            else if (flb_time_cmp(&tm, &max) > 0) {
+                max = tm;
+            }
+        }
+        count++;
+        mpack_discard(&reader);
+    }
+    mpack_reader_destroy(&reader);
+
+    if (found == FLB_TRUE) {
+        *tm_min = min;
+        *tm_max = max;
+    }
+    else {
+        flb_time_zero(tm_min);
+        flb_time_zero(tm_max);
+    }
+
+    return count;
+}
+
 /* Adjust a mspack header buffer size */
 void flb_mp_set_map_header_size(char *buf, int arr_size)
 {
@@ -187,6 +187,12 @@ void flb_output_exit(struct flb_config *config)
         ins = mk_list_entry(head, struct flb_output_instance, _head);
         p = ins->p;
 
+        /* Stop worker threads before the plugin context goes away */
+        if (ins->worker_pool) {
+            flb_output_worker_pool_destroy(ins->worker_pool);
+            ins->worker_pool = NULL;
+        }
+
         /* Check a exit callback */
         if (p->cb_exit) {
             if(!p->proxy) {
@@ -329,6 +335,13 @@ struct flb_output_instance *flb_output_new(struct flb_config *config,
     instance->match_regex = NULL;
 #endif
     instance->retry_limit = 1;
+    instance->tasks_limit = FLB_OUTPUT_TASKS_LIMIT;
+    instance->tasks_count = 0;
+    instance->tasks_paused = FLB_FALSE;
+    instance->compress    = NULL;
+    instance->compress_level = FLB_COMPRESS_LEVEL_DEFAULT;
+    instance->workers     = 0;
+    instance->worker_pool = NULL;
     instance->host.name   = NULL;
     instance->host.address = NULL;
     instance->net_config_map = NULL;
@@ -351,6 +364,7 @@ struct flb_output_instance *flb_output_new(struct flb_config *config,
     instance->tls.context           = NULL;
     instance->tls_debug             = -1;
     instance->tls_verify            = FLB_TRUE;
+    instance->tls_session_cache     = FLB_TRUE;
     instance->tls_vhost             = NULL;
     instance->tls_ca_path           = NULL;
     instance->tls_ca_file           = NULL;
@@ -461,6 +475,55 @@ int flb_output_set_property(struct flb_output_instance *ins,
             ins->retry_limit = 0;
         }
     }
+    else if (prop_key_check("tasks_limit", k, len) == 0 && tmp) {
+        if (strcasecmp(tmp, "false") == 0 ||
+            strcasecmp(tmp, "off") == 0) {
+            /* Only limited by the size of the tasks table */
+            ins->tasks_limit = -1;
+        }
+        else {
+            ins->tasks_limit = atoi(tmp);
+        }
+        flb_sds_destroy(tmp);
+        if (ins->tasks_limit == 0 || ins->tasks_limit < -1) {
+            flb_error("[config] invalid tasks_limit for '%s'",
+                      flb_output_name(ins));
+            return -1;
+        }
+    }
+    else if (prop_key_check("workers", k, len) == 0 && tmp) {
+        ret = atoi(tmp);
+        flb_sds_destroy(tmp);
+        if (ret > 0 && !(ins->p->flags & FLB_OUTPUT_WORKERS)) {
+            flb_error("[config] output plugin '%s' does not support workers",
+                      ins->p->name);
+            return -1;
+        }
+        if (ret < 0 || ret > FLB_OUTPUT_WORKERS_MAX) {
+            flb_error("[config] invalid number of workers for '%s', "
+                      "maximum allowed is %i",
+                      flb_output_name(ins), FLB_OUTPUT_WORKERS_MAX);
+            return -1;
+        }
+        ins->workers = ret;
+    }
+    else if ((ins->flags & FLB_OUTPUT_COMPRESS) &&
+             prop_key_check("compress", k, len) == 0 && tmp) {
+        ins->compress = flb_compress_codec_get(tmp);
+        if (!ins->compress && strcasecmp(tmp, "none") != 0 &&
+            strcasecmp(tmp, "off") != 0) {
+            flb_error("[config] unknown or unsupported compression codec "
+                      "'%s' for '%s'", tmp, flb_output_name(ins));
+            flb_sds_destroy(tmp);
+            return -1;
+        }
+        flb_sds_destroy(tmp);
+    }
+    else if ((ins->flags & FLB_OUTPUT_COMPRESS) &&
+             prop_key_check("compress.level", k, len) == 0 && tmp) {
+        ins->compress_level = atoi(tmp);
+        flb_sds_destroy(tmp);
+    }
     else if (strncasecmp("net.", k, 4) == 0 && tmp) {
         kv = flb_kv_item_create(&ins->net_properties, (char *) k, NULL);
         if (!kv) {
@@ -516,6 +579,10 @@ int flb_output_set_property(struct flb_output_instance *ins,
         }
         flb_sds_destroy(tmp);
     }
+    else if (prop_key_check("tls.session_cache", k, len) == 0 && tmp) {
+        ins->tls_session_cache = flb_utils_bool(tmp);
+        flb_sds_destroy(tmp);
+    }
     else if (prop_key_check("tls.debug", k, len) == 0 && tmp) {
         ins->tls_debug = atoi(tmp);
         flb_sds_destroy(tmp);
@@ -623,6 +690,14 @@ int flb_output_init_all(struct flb_config *config)
                             "retries", ins->metrics);
             flb_metrics_add(FLB_METRIC_OUT_RETRY_FAILED,
                         "retries_failed", ins->metrics);
+#ifdef FLB_HAVE_TLS
+            if (ins->use_tls == FLB_TRUE) {
+                flb_metrics_add(FLB_METRIC_OUT_TLS_FULL,
+                                "tls_full_handshakes", ins->metrics);
+                flb_metrics_add(FLB_METRIC_OUT_TLS_RESUMED,
+                                "tls_resumed_handshakes", ins->metrics);
+            }
+#endif
         }
 #endif
 
@@ -653,6 +728,12 @@ int flb_output_init_all(struct flb_config *config)
                 flb_output_instance_destroy(ins);
                 return -1;
             }
+
+            /* the sessions cache is shared by all the upstream connections */
+            ins->tls.context->session_cache = ins->tls_session_cache;
+#ifdef FLB_HAVE_METRICS
+            ins->tls.context->metrics = ins->metrics;
+#endif
         }
 #endif
         /*
@@ -718,6 +799,16 @@ int flb_output_init_all(struct flb_config *config)
                       p->name);
             return -1;
         }
+
+        /* Spawn worker threads if requested */
+        if (ins->workers > 0) {
+            ins->worker_pool = flb_output_worker_pool_create(ins, config);
+            if (!ins->worker_pool) {
+                flb_error("[output] could not start workers for '%s'",
+                          flb_output_name(ins));
+                return -1;
+            }
+        }
     }
 
     return 0;
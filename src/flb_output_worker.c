@@ -0,0 +1,288 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Output Workers
+ * ==============
+ * By default every flush co-routine runs in the engine thread. When an
+ * output instance sets 'workers N', a pool of N threads is created for it,
+ * each one with it own event loop. The engine keeps creating the Tasks and
+ * the co-routines, but instead of resuming them locally it hands them to a
+ * worker through a pipe. From that point the co-routine lives in the worker
+ * thread: any network I/O it performs gets registered in the worker event
+ * loop and it's resumed from there.
+ *
+ * When the co-routine calls FLB_OUTPUT_RETURN(), the return event is not
+ * written to the engine right away, instead the worker sends it once the
+ * co-routine has yielded, so the engine can safely destroy it and continue
+ * with the usual return path (retries, scheduler, task cleanup).
+ */
+
+#include <monkey/mk_core.h>
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_worker.h>
+#include <fluent-bit/flb_thread.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_upstream.h>
+#include <fluent-bit/flb_output_worker.h>
+
+FLB_TLS_DEFINE(struct mk_event_loop, flb_engine_evl);
+
+void flb_output_worker_prepare()
+{
+    FLB_TLS_INIT(flb_engine_evl);
+}
+
+void flb_output_worker_evl_set(struct mk_event_loop *evl)
+{
+    FLB_TLS_SET(flb_engine_evl, evl);
+}
+
+struct mk_event_loop *flb_output_worker_evl_get()
+{
+    return FLB_TLS_GET(flb_engine_evl);
+}
+
+/* Resume a co-routine and notify the engine if it has finished */
+static void worker_thread_resume(struct flb_out_worker *worker,
+                                 struct flb_thread *th)
+{
+    int n;
+    uint64_t val;
+    struct flb_output_thread *out_th;
+    struct flb_config *config = worker->pool->config;
+
+    flb_thread_resume(th);
+
+    out_th = (struct flb_output_thread *) FLB_THREAD_DATA(th);
+    if (out_th->ret_event == 0) {
+        /* the co-routine is waiting for I/O */
+        return;
+    }
+
+    /*
+     * After this write the engine owns the co-routine again and it might
+     * destroy it at any time, don't touch 'th' after this point.
+     */
+    val = out_th->ret_event;
+    n = flb_pipe_w(config->ch_manager[1], (void *) &val, sizeof(val));
+    if (n == -1) {
+        flb_errno();
+    }
+}
+
+static void worker_loop(void *data)
+{
+    int n;
+    uint64_t val;
+    struct mk_event *event;
+    struct flb_thread *th;
+    struct flb_upstream_conn *u_conn;
+    struct flb_out_worker *worker = data;
+
+    flb_output_worker_evl_set(worker->evl);
+
+    flb_debug("[output:worker] %s worker #%i started",
+              flb_output_name(worker->pool->ins), worker->id);
+
+    while (worker->running == FLB_TRUE) {
+        mk_event_wait(worker->evl);
+        mk_event_foreach(event, worker->evl) {
+            if (event->type == FLB_ENGINE_EV_CORE) {
+                /* New co-routine handed by the engine, or exit request */
+                n = flb_pipe_r(worker->ch_events[0], &val, sizeof(val));
+                if (n <= 0) {
+                    flb_errno();
+                    continue;
+                }
+
+                th = (struct flb_thread *) (uintptr_t) val;
+                if (!th) {
+                    worker->running = FLB_FALSE;
+                    continue;
+                }
+                worker_thread_resume(worker, th);
+            }
+            else if (event->type == FLB_ENGINE_EV_CUSTOM) {
+                event->handler(event);
+            }
+            else if (event->type == FLB_ENGINE_EV_THREAD) {
+                /* Network I/O of a co-routine owned by this worker */
+                u_conn = (struct flb_upstream_conn *) event;
+                th = u_conn->thread;
+                flb_trace("[output:worker] resuming thread=%p", th);
+                worker_thread_resume(worker, th);
+            }
+        }
+    }
+
+    flb_debug("[output:worker] %s worker #%i stopped",
+              flb_output_name(worker->pool->ins), worker->id);
+}
+
+static void worker_destroy(struct flb_out_worker *worker)
+{
+    if (worker->evl) {
+        mk_event_loop_destroy(worker->evl);
+    }
+    if (worker->ch_events[0] > 0) {
+        flb_pipe_close(worker->ch_events[0]);
+    }
+    if (worker->ch_events[1] > 0) {
+        flb_pipe_close(worker->ch_events[1]);
+    }
+    flb_free(worker);
+}
+
+struct flb_out_worker_pool *flb_output_worker_pool_create(
+                                            struct flb_output_instance *ins,
+                                            struct flb_config *config)
+{
+    int i;
+    int ret;
+    pthread_t tid;
+    struct flb_out_worker *worker;
+    struct flb_out_worker_pool *pool;
+
+    pool = flb_calloc(1, sizeof(struct flb_out_worker_pool));
+    if (!pool) {
+        flb_errno();
+        return NULL;
+    }
+    pool->ins = ins;
+    pool->config = config;
+    pthread_mutex_init(&pool->mutex, NULL);
+    mk_list_init(&pool->workers);
+
+    for (i = 0; i < ins->workers; i++) {
+        worker = flb_calloc(1, sizeof(struct flb_out_worker));
+        if (!worker) {
+            flb_errno();
+            flb_output_worker_pool_destroy(pool);
+            return NULL;
+        }
+        worker->id = i;
+        worker->pool = pool;
+        worker->running = FLB_TRUE;
+
+        worker->evl = mk_event_loop_create(256);
+        if (!worker->evl) {
+            flb_error("[output:worker] could not create event loop for %s",
+                      flb_output_name(ins));
+            worker_destroy(worker);
+            flb_output_worker_pool_destroy(pool);
+            return NULL;
+        }
+
+        ret = mk_event_channel_create(worker->evl,
+                                      &worker->ch_events[0],
+                                      &worker->ch_events[1],
+                                      &worker->event);
+        if (ret != 0) {
+            flb_error("[output:worker] could not create channel for %s",
+                      flb_output_name(ins));
+            worker_destroy(worker);
+            flb_output_worker_pool_destroy(pool);
+            return NULL;
+        }
+
+        ret = flb_worker_create(worker_loop, worker, &tid, config);
+        if (ret == -1) {
+            flb_error("[output:worker] could not spawn worker for %s",
+                      flb_output_name(ins));
+            worker_destroy(worker);
+            flb_output_worker_pool_destroy(pool);
+            return NULL;
+        }
+        worker->tid = tid;
+
+        mk_list_add(&worker->_head, &pool->workers);
+        pool->size++;
+    }
+
+    flb_info("[output:%s:%s] started %i workers",
+             ins->p->name, flb_output_name(ins), pool->size);
+
+    return pool;
+}
+
+/*
+ * Hand a co-routine to the next worker in the pool (round-robin). On
+ * error the co-routine is left untouched so the caller can resume it in
+ * its own thread.
+ */
+int flb_output_worker_dispatch(struct flb_out_worker_pool *pool,
+                               struct flb_thread *th)
+{
+    int n;
+    uint64_t val;
+    struct flb_out_worker *worker;
+    struct flb_output_thread *out_th;
+
+    if (pool->size == 0) {
+        return -1;
+    }
+
+    if (!pool->next || pool->next->next == &pool->workers) {
+        pool->next = pool->workers.next;
+    }
+    else {
+        pool->next = pool->next->next;
+    }
+    worker = mk_list_entry(pool->next, struct flb_out_worker, _head);
+
+    out_th = (struct flb_output_thread *) FLB_THREAD_DATA(th);
+    out_th->worker = worker;
+
+    val = (uint64_t) (uintptr_t) th;
+    n = flb_pipe_w(worker->ch_events[1], &val, sizeof(val));
+    if (n == -1) {
+        flb_errno();
+        out_th->worker = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void flb_output_worker_pool_destroy(struct flb_out_worker_pool *pool)
+{
+    uint64_t val = 0;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_out_worker *worker;
+
+    /* Request every worker to stop and wait for it */
+    mk_list_foreach_safe(head, tmp, &pool->workers) {
+        worker = mk_list_entry(head, struct flb_out_worker, _head);
+        flb_pipe_w(worker->ch_events[1], &val, sizeof(val));
+        pthread_join(worker->tid, NULL);
+
+        mk_list_del(&worker->_head);
+        worker_destroy(worker);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    flb_free(pool);
+}
@@ -30,6 +30,7 @@
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_unescape.h>
+#include <fluent-bit/flb_utf8.h>
 
 #include <msgpack.h>
 #include <jsmn/jsmn.h>
@@ -80,132 +81,556 @@ int flb_json_tokenise(const char *js, size_t len,
     return 0;
 }
 
-static inline int is_float(const char *buf, int len)
+/*
+ * JSON to MessagePack encoder
+ * ===========================
+ * The encoder converts JSON to MessagePack in a single pass writing straight
+ * into a msgpack_sbuffer, there is no intermediate array of tokens.
+ *
+ * The number of entries of a map or array is unknown until the container is
+ * closed, so when it's opened a one byte header is reserved (fixmap or
+ * fixarray, up to 15 entries). When it's closed, if there are more entries
+ * the content is moved to make room for a 16 or 32 bits header. The output
+ * is the same that msgpack_pack_map() or msgpack_pack_array() generates.
+ */
+
+/* Parser states */
+#define JSON_VALUE   0     /* expecting a value                   */
+#define JSON_KEY     1     /* expecting a map key                 */
+#define JSON_NEXT    2     /* after a value: ',', '}', ']' or end */
+
+/* Open containers kept in the stack without allocating memory */
+#define JSON_STACK_SIZE  32
+
+struct json_frame {
+    int type;              /* FLB_PACK_JSON_OBJECT or FLB_PACK_JSON_ARRAY */
+    uint32_t count;        /* number of entries                           */
+    size_t pos;            /* offset of the header in the buffer          */
+};
+
+#define JSON_ONES        0x0101010101010101ULL
+#define JSON_HIGHS       0x8080808080808080ULL
+#define json_has_zero(v) (((v) - JSON_ONES) & ~(v) & JSON_HIGHS)
+#define json_has_byte(v, b) json_has_zero((v) ^ (JSON_ONES * (b)))
+
+static inline int json_is_space(char c)
 {
-    const char *end = buf + len;
-    const char *p = buf;
+    return (c == ' ' || c == '\n' || c == '\r' || c == '\t');
+}
+
+static inline const char *json_skip_spaces(const char *p, const char *end)
+{
+    while (p < end && json_is_space(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static inline int json_is_delimiter(char c)
+{
+    return (json_is_space(c) || c == ',' || c == ']' || c == '}' || c == ':');
+}
+
+static inline int json_is_hex(char c)
+{
+    return ((c >= '0' && c <= '9') ||
+            (c >= 'A' && c <= 'F') ||
+            (c >= 'a' && c <= 'f'));
+}
+
+/*
+ * Find the closing quote of a string, 'p' points to the first byte after
+ * the opening quote. Eight bytes are checked at a time looking for a quote
+ * or a backslash, escape sequences are validated.
+ */
+static inline int json_string_end(const char *p, const char *end,
+                                  const char **out, int *escaped)
+{
+    int i;
+    uint64_t v;
+
+    while (p < end) {
+        /* Skip blocks of plain characters */
+        while (end - p >= 8) {
+            memcpy(&v, p, 8);
+            if (json_has_byte(v, '"') || json_has_byte(v, '\\')) {
+                break;
+            }
+            p += 8;
+        }
 
-    while (p <= end) {
-        if (*p == '.') {
-            return 1;
+        while (p < end && *p != '"' && *p != '\\') {
+            p++;
         }
+        if (p >= end) {
+            break;
+        }
+
+        if (*p == '"') {
+            *out = p;
+            return 0;
+        }
+
+        /* Escape sequence */
+        *escaped = FLB_TRUE;
         p++;
+        if (p >= end) {
+            break;
+        }
+
+        switch (*p) {
+        case '"': case '/': case '\\': case 'b':
+        case 'f': case 'r': case 'n': case 't':
+            p++;
+            break;
+        case 'u':
+            p++;
+            for (i = 0; i < 4; i++, p++) {
+                if (p >= end) {
+                    return FLB_ERR_JSON_PART;
+                }
+                if (!json_is_hex(*p)) {
+                    return FLB_ERR_JSON_INVAL;
+                }
+            }
+            break;
+        default:
+            return FLB_ERR_JSON_INVAL;
+        }
     }
-    return 0;
+
+    return FLB_ERR_JSON_PART;
 }
 
-/* Sanitize incoming JSON string */
-static inline int pack_string_token(struct flb_pack_state *state,
-                                    const char *str, int len,
-                                    msgpack_packer *pck)
+/* Pack a string, decode escape sequences (if any) */
+static inline int json_pack_string(const char *str, int len, int escaped,
+                                   char **tmp_buf, size_t *tmp_size,
+                                   msgpack_packer *pck)
 {
-    int s;
     int out_len;
     char *tmp;
-    char *out_buf;
 
-    if (state->buf_size < len + 1) {
-        s = len + 1;
-        tmp = flb_realloc(state->buf_data, s);
+    if (escaped == FLB_FALSE) {
+        msgpack_pack_str(pck, len);
+        msgpack_pack_str_body(pck, str, len);
+        return 0;
+    }
+
+    if (*tmp_size < len + 1) {
+        tmp = flb_realloc(*tmp_buf, len + 1);
         if (!tmp) {
             flb_errno();
             return -1;
         }
-        else {
-            state->buf_data = tmp;
-            state->buf_size = s;
-        }
+        *tmp_buf = tmp;
+        *tmp_size = len + 1;
     }
-    out_buf = state->buf_data;
 
     /* Always decode any UTF-8 or special characters */
-    out_len = flb_unescape_string_utf8(str, len, out_buf);
+    out_len = flb_unescape_string_utf8(str, len, *tmp_buf);
 
-    /* Pack decoded text */
     msgpack_pack_str(pck, out_len);
-    msgpack_pack_str_body(pck, out_buf, out_len);
+    msgpack_pack_str_body(pck, *tmp_buf, out_len);
 
-    return out_len;
+    return 0;
 }
 
-/* Receive a tokenized JSON message and convert it to MsgPack */
-static char *tokens_to_msgpack(struct flb_pack_state *state,
-                               const char *js,
-                               int *out_size, int *last_byte)
+/*
+ * Pack a primitive: true, false, null or a number. Like in jsmn strict mode
+ * a primitive must be followed by a delimiter, otherwise it might be
+ * incomplete.
+ */
+static inline int json_pack_primitive(const char *p, const char *end,
+                                      const char **out, msgpack_packer *pck)
 {
-    int i;
-    int flen;
-    int arr_size;
-    const char *p;
-    char *buf;
-    const jsmntok_t *t;
-    msgpack_packer pck;
-    msgpack_sbuffer sbuf;
-    jsmntok_t *tokens;
+    int len;
+    int is_float = FLB_FALSE;
+    int digits = 0;
+    int negative = FLB_FALSE;
+    uint64_t n = 0;
+    const char *s = p;
+
+    while (p < end && !json_is_delimiter(*p)) {
+        if (*p < 32 || *p >= 127) {
+            return FLB_ERR_JSON_INVAL;
+        }
+        p++;
+    }
+    if (p >= end) {
+        return FLB_ERR_JSON_PART;
+    }
+    *out = p;
+    len = p - s;
 
-    tokens = state->tokens;
-    arr_size = state->tokens_count;
+    switch (*s) {
+    case 't':
+        if (len != 4 || memcmp(s, "true", 4) != 0) {
+            return FLB_ERR_JSON_INVAL;
+        }
+        msgpack_pack_true(pck);
+        return 0;
+    case 'f':
+        if (len != 5 || memcmp(s, "false", 5) != 0) {
+            return FLB_ERR_JSON_INVAL;
+        }
+        msgpack_pack_false(pck);
+        return 0;
+    case 'n':
+        if (len != 4 || memcmp(s, "null", 4) != 0) {
+            return FLB_ERR_JSON_INVAL;
+        }
+        msgpack_pack_nil(pck);
+        return 0;
+    }
 
-    if (arr_size == 0) {
-        return NULL;
+    /* Number */
+    p = s;
+    if (*p == '-') {
+        negative = FLB_TRUE;
+        p++;
+    }
+    while (p < *out) {
+        if (*p >= '0' && *p <= '9') {
+            n = (n * 10) + (*p - '0');
+            digits++;
+        }
+        else if (*p == '.' || *p == 'e' || *p == 'E' ||
+                 *p == '+' || *p == '-') {
+            is_float = FLB_TRUE;
+        }
+        else {
+            return FLB_ERR_JSON_INVAL;
+        }
+        p++;
     }
 
-    /* initialize buffers */
-    msgpack_sbuffer_init(&sbuf);
-    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+    if (digits == 0) {
+        return FLB_ERR_JSON_INVAL;
+    }
+
+    /*
+     * The primitive is followed by a delimiter, strtod() and strtoll() stop
+     * there at the latest.
+     */
+    if (is_float == FLB_TRUE) {
+        msgpack_pack_double(pck, strtod(s, NULL));
+    }
+    else if (digits > 18) {
+        msgpack_pack_int64(pck, strtoll(s, NULL, 10));
+    }
+    else if (negative == FLB_TRUE) {
+        msgpack_pack_int64(pck, -((int64_t) n));
+    }
+    else {
+        msgpack_pack_int64(pck, (int64_t) n);
+    }
+
+    return 0;
+}
+
+/* Reserve a one byte header for a new map or array */
+static inline int json_container_open(struct json_frame *f, int type,
+                                      msgpack_sbuffer *sbuf)
+{
+    int ret;
+
+    f->type = type;
+    f->count = 0;
+    f->pos = sbuf->size;
+
+    ret = msgpack_sbuffer_write(sbuf, "\0", 1);
+    if (ret != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Write the final header of a map or array */
+static inline int json_container_close(struct json_frame *f,
+                                       msgpack_sbuffer *sbuf)
+{
+    int ret;
+    int extra;
+    size_t body;
+    unsigned char *h;
+    uint32_t n = f->count;
+
+    if (n < 16) {
+        sbuf->data[f->pos] = (f->type == FLB_PACK_JSON_OBJECT ? 0x80 : 0x90) | n;
+        return 0;
+    }
+
+    /* Make room for a 16 or 32 bits header */
+    extra = (n < 65536) ? 2 : 4;
+    body = sbuf->size - f->pos - 1;
+
+    ret = msgpack_sbuffer_write(sbuf, "\0\0\0\0", extra);
+    if (ret != 0) {
+        return -1;
+    }
+    memmove(sbuf->data + f->pos + 1 + extra, sbuf->data + f->pos + 1, body);
+
+    h = (unsigned char *) sbuf->data + f->pos;
+    if (extra == 2) {
+        h[0] = (f->type == FLB_PACK_JSON_OBJECT) ? 0xde : 0xdc;
+        h[1] = (n >> 8) & 0xff;
+        h[2] = n & 0xff;
+    }
+    else {
+        h[0] = (f->type == FLB_PACK_JSON_OBJECT) ? 0xdf : 0xdd;
+        h[1] = (n >> 24) & 0xff;
+        h[2] = (n >> 16) & 0xff;
+        h[3] = (n >> 8) & 0xff;
+        h[4] = n & 0xff;
+    }
+
+    return 0;
+}
 
-    for (i = 0; i < arr_size ; i++) {
-        t = &tokens[i];
+/*
+ * Convert the JSON value found at the beginning of 'js' (spaces are
+ * skipped) and append it to 'sbuf'. On success it returns 0 and 'out'
+ * points to the byte after the value. If the buffer ends before the value,
+ * FLB_ERR_JSON_PART is returned.
+ */
+static int json_pack_value(const char *js, const char *end,
+                           char **tmp_buf, size_t *tmp_size,
+                           msgpack_sbuffer *sbuf, msgpack_packer *pck,
+                           const char **out, int *root_type)
+{
+    int ret = 0;
+    int type;
+    int depth = 0;
+    int state = JSON_VALUE;
+    int escaped;
+    int stack_size = JSON_STACK_SIZE;
+    const char *p = js;
+    const char *s;
+    struct json_frame *f;
+    struct json_frame *tmp;
+    struct json_frame *stack;
+    struct json_frame stack_buf[JSON_STACK_SIZE];
+
+    stack = stack_buf;
+
+    while (1) {
+        p = json_skip_spaces(p, end);
+
+        if (state == JSON_NEXT) {
+            if (depth == 0) {
+                break;
+            }
 
-        if (t->start == -1 || t->end == -1 || (t->start == 0 && t->end == 0)) {
+            f = &stack[depth - 1];
+            f->count++;
+
+            if (p >= end) {
+                ret = FLB_ERR_JSON_PART;
+                break;
+            }
+
+            if (*p == ',') {
+                p++;
+                state = (f->type == FLB_PACK_JSON_OBJECT) ? JSON_KEY : JSON_VALUE;
+                continue;
+            }
+            else if ((*p == '}' && f->type == FLB_PACK_JSON_OBJECT) ||
+                     (*p == ']' && f->type == FLB_PACK_JSON_ARRAY)) {
+                p++;
+                ret = json_container_close(f, sbuf);
+                if (ret == -1) {
+                    break;
+                }
+                depth--;
+                continue;
+            }
+
+            ret = FLB_ERR_JSON_INVAL;
             break;
         }
 
-        if (t->parent == -1) {
-            *last_byte = t->end;
+        if (p >= end) {
+            ret = FLB_ERR_JSON_PART;
+            break;
         }
 
-        flen = (t->end - t->start);
-        switch (t->type) {
-        case JSMN_OBJECT:
-            msgpack_pack_map(&pck, t->size);
-            break;
-        case JSMN_ARRAY:
-            msgpack_pack_array(&pck, t->size);
-            break;
-        case JSMN_STRING:
-            pack_string_token(state, js + t->start, flen, &pck);
-            break;
-        case JSMN_PRIMITIVE:
-            p = js + t->start;
-            if (*p == 'f') {
-                msgpack_pack_false(&pck);
+        if (state == JSON_KEY) {
+            if (*p != '"') {
+                ret = FLB_ERR_JSON_INVAL;
+                break;
+            }
+
+            escaped = FLB_FALSE;
+            ret = json_string_end(p + 1, end, &s, &escaped);
+            if (ret != 0) {
+                break;
+            }
+            ret = json_pack_string(p + 1, s - p - 1, escaped,
+                                   tmp_buf, tmp_size, pck);
+            if (ret == -1) {
+                break;
+            }
+
+            p = json_skip_spaces(s + 1, end);
+            if (p >= end) {
+                ret = FLB_ERR_JSON_PART;
+                break;
             }
-            else if (*p == 't') {
-                msgpack_pack_true(&pck);
+            if (*p != ':') {
+                ret = FLB_ERR_JSON_INVAL;
+                break;
             }
-            else if (*p == 'n') {
-                msgpack_pack_nil(&pck);
+            p++;
+            state = JSON_VALUE;
+            continue;
+        }
+
+        /* JSON_VALUE */
+        if (*p == '{' || *p == '[') {
+            type = (*p == '{') ? FLB_PACK_JSON_OBJECT : FLB_PACK_JSON_ARRAY;
+            if (depth == 0) {
+                *root_type = type;
             }
-            else {
-                if (is_float(p, flen)) {
-                    msgpack_pack_double(&pck, atof(p));
+
+            if (depth == stack_size) {
+                if (stack == stack_buf) {
+                    tmp = flb_malloc(sizeof(struct json_frame) * stack_size * 2);
+                    if (tmp) {
+                        memcpy(tmp, stack_buf, sizeof(stack_buf));
+                    }
                 }
                 else {
-                    msgpack_pack_int64(&pck, atol(p));
+                    tmp = flb_realloc(stack,
+                                      sizeof(struct json_frame) * stack_size * 2);
+                }
+                if (!tmp) {
+                    flb_errno();
+                    ret = -1;
+                    break;
                 }
+                stack = tmp;
+                stack_size *= 2;
             }
+
+            f = &stack[depth];
+            ret = json_container_open(f, type, sbuf);
+            if (ret == -1) {
+                break;
+            }
+            depth++;
+            p++;
+
+            /* Empty container */
+            p = json_skip_spaces(p, end);
+            if (p >= end) {
+                ret = FLB_ERR_JSON_PART;
+                break;
+            }
+            if ((*p == '}' && type == FLB_PACK_JSON_OBJECT) ||
+                (*p == ']' && type == FLB_PACK_JSON_ARRAY)) {
+                p++;
+                json_container_close(f, sbuf);
+                depth--;
+                state = JSON_NEXT;
+                continue;
+            }
+
+            state = (type == FLB_PACK_JSON_OBJECT) ? JSON_KEY : JSON_VALUE;
+            continue;
+        }
+        else if (*p == '"') {
+            if (depth == 0) {
+                *root_type = FLB_PACK_JSON_STRING;
+            }
+
+            escaped = FLB_FALSE;
+            ret = json_string_end(p + 1, end, &s, &escaped);
+            if (ret != 0) {
+                break;
+            }
+            ret = json_pack_string(p + 1, s - p - 1, escaped,
+                                   tmp_buf, tmp_size, pck);
+            if (ret == -1) {
+                break;
+            }
+            p = s + 1;
+        }
+        else if (*p == '-' || (*p >= '0' && *p <= '9') ||
+                 *p == 't' || *p == 'f' || *p == 'n') {
+            if (depth == 0) {
+                *root_type = FLB_PACK_JSON_PRIMITIVE;
+            }
+
+            ret = json_pack_primitive(p, end, &s, pck);
+            if (ret != 0) {
+                break;
+            }
+            p = s;
+        }
+        else {
+            ret = FLB_ERR_JSON_INVAL;
             break;
-        case JSMN_UNDEFINED:
-            msgpack_sbuffer_destroy(&sbuf);
-            return NULL;
         }
+
+        state = JSON_NEXT;
     }
 
-    *out_size = sbuf.size;
-    buf = sbuf.data;
+    if (stack != stack_buf) {
+        flb_free(stack);
+    }
 
-    return buf;
+    *out = p;
+    return ret;
+}
+
+/*
+ * Pack all the JSON values found in the buffer. If the buffer ends in the
+ * middle of a value, the values before it are kept in 'sbuf' and
+ * FLB_ERR_JSON_PART is returned. The end of the last complete value is set
+ * in 'last_byte' and the number of values in 'count'.
+ */
+static int json_pack_buffer(const char *js, size_t len,
+                            char **tmp_buf, size_t *tmp_size,
+                            msgpack_sbuffer *sbuf,
+                            int *root_type, int *last_byte, int *count)
+{
+    int ret;
+    int type;
+    size_t size;
+    const char *p = js;
+    const char *end = js + len;
+    const char *next;
+    msgpack_packer pck;
+
+    msgpack_packer_init(&pck, sbuf, msgpack_sbuffer_write);
+
+    *count = 0;
+    *last_byte = 0;
+
+    while (1) {
+        p = json_skip_spaces(p, end);
+        if (p >= end) {
+            return 0;
+        }
+
+        size = sbuf->size;
+        ret = json_pack_value(p, end, tmp_buf, tmp_size, sbuf, &pck,
+                              &next, &type);
+        if (ret != 0) {
+            /* discard the incomplete or invalid value */
+            sbuf->size = size;
+            return ret;
+        }
+
+        if (*count == 0) {
+            *root_type = type;
+        }
+        (*count)++;
+        *last_byte = next - js;
+        p = next;
+    }
+
+    return 0;
 }
 
 /*
@@ -220,42 +645,32 @@ int flb_pack_json(const char *js, size_t len, char **buffer, size_t *size,
                   int *root_type)
 
 {
-    int ret = -1;
-    int out;
+    int ret;
     int last;
-    char *buf = NULL;
-    struct flb_pack_state state;
+    int count;
+    int type = FLB_PACK_JSON_UNDEFINED;
+    char *tmp_buf = NULL;
+    size_t tmp_size = 0;
+    msgpack_sbuffer sbuf;
 
-    ret = flb_pack_state_init(&state);
-    if (ret != 0) {
-        return -1;
-    }
-    ret = flb_json_tokenise(js, len, &state);
-    if (ret != 0) {
-        ret = -1;
-        goto flb_pack_json_end;
-    }
+    msgpack_sbuffer_init(&sbuf);
 
-    if (state.tokens_count == 0) {
-        ret = -1;
-        goto flb_pack_json_end;
+    ret = json_pack_buffer(js, len, &tmp_buf, &tmp_size, &sbuf,
+                           &type, &last, &count);
+    if (tmp_buf) {
+        flb_free(tmp_buf);
     }
 
-    buf = tokens_to_msgpack(&state, js, &out, &last);
-    if (!buf) {
-        ret = -1;
-        goto flb_pack_json_end;
+    if (ret != 0 || count == 0) {
+        msgpack_sbuffer_destroy(&sbuf);
+        return -1;
     }
 
-    *root_type = state.tokens[0].type;
-    *size = out;
-    *buffer = buf;
-
-    ret = 0;
+    *root_type = type;
+    *size = sbuf.size;
+    *buffer = sbuf.data;
 
- flb_pack_json_end:
-    flb_pack_state_reset(&state);
-    return ret;
+    return 0;
 }
 
 /* Initialize a JSON packer state */
@@ -299,76 +714,47 @@ void flb_pack_state_reset(struct flb_pack_state *s)
     flb_free(s->buf_data);
 }
 
-
 /*
  * It parse a JSON string and convert it to MessagePack format. The main
- * difference of this function and the previous flb_pack_json() is that it
- * keeps a parser and tokens state, allowing to process big messages and
- * resume the parsing process instead of start from zero.
+ * difference of this function and the previous flb_pack_json() is that the
+ * incoming buffer may contain multiple JSON messages concatenated where the
+ * last one might be incomplete: the complete messages are packed and the
+ * end of the last one is set in state->last_byte so the caller can consume
+ * them.
  */
 int flb_pack_json_state(const char *js, size_t len,
                         char **buffer, int *size,
                         struct flb_pack_state *state)
 {
     int ret;
-    int out;
-    int delim = 0;
-    int last =  0;
-    char *buf;
-    jsmntok_t *t;
+    int last = 0;
+    int count = 0;
+    int type;
+    msgpack_sbuffer sbuf;
 
-    ret = flb_json_tokenise(js, len, state);
     state->multiple = FLB_TRUE;
-    if (ret == FLB_ERR_JSON_PART && state->multiple == FLB_TRUE) {
-        /*
-         * If the caller enabled 'multiple' flag, it means that the incoming
-         * JSON message may have multiple messages concatenated and likely
-         * the last one is only incomplete.
-         *
-         * The following routine aims to determinate how many JSON messages
-         * are OK in the array of tokens, if any, process them and adjust
-         * the JSMN context/buffers.
-         */
-        int i;
-        int found = 0;
-
-        for (i = 1; i < state->tokens_size; i++) {
-            t = &state->tokens[i];
-
-            if (t->start < (state->tokens[i - 1]).start) {
-                break;
-            }
-
-            if (t->parent == -1 && (t->end != 0)) {
-                found++;
-                delim = i;
-            }
 
-        }
-
-        if (found > 0) {
-            state->tokens_count += delim;
-        }
-        else {
-            return ret;
-        }
+    msgpack_sbuffer_init(&sbuf);
+    ret = json_pack_buffer(js, len, &state->buf_data, &state->buf_size,
+                           &sbuf, &type, &last, &count);
+    if (ret == FLB_ERR_JSON_PART && count == 0) {
+        flb_trace("[json pack] incomplete");
+        msgpack_sbuffer_destroy(&sbuf);
+        return ret;
     }
-    else if (ret != 0) {
+    else if (ret == FLB_ERR_JSON_INVAL || ret == -1) {
+        msgpack_sbuffer_destroy(&sbuf);
         return ret;
     }
 
-    if (state->tokens_count == 0) {
+    if (count == 0) {
+        msgpack_sbuffer_destroy(&sbuf);
         state->last_byte = last;
         return FLB_ERR_JSON_INVAL;
     }
 
-    buf = tokens_to_msgpack(state, js, &out, &last);
-    if (!buf) {
-        return -1;
-    }
-
-    *size = out;
-    *buffer = buf;
+    *size = sbuf.size;
+    *buffer = sbuf.data;
     state->last_byte = last;
 
     return 0;
@@ -583,6 +969,305 @@ static int msgpack2json(char *buf, int *off, size_t left,
     return ret;
 }
 
+/*
+ * Streaming MessagePack to JSON encoder
+ * =====================================
+ * Same output as msgpack2json() but appending to a growable sds buffer, so
+ * there is no need to guess the final size and start over if it was not
+ * enough. Strings are scanned eight bytes at a time: blocks that don't
+ * need escaping are copied as they are.
+ */
+
+/* Bytes that require escaping: < 0x20, '"', '\\', 0x7f and >= 0x80 */
+#define json_has_less(v, n)  (((v) - (JSON_ONES * (n))) & ~(v) & JSON_HIGHS)
+#define json_needs_escape(v)                                            \
+    (json_has_less(v, 0x20) | json_has_byte(v, '"') |                   \
+     json_has_byte(v, '\\') | json_has_byte(v, 0x7f) | ((v) & JSON_HIGHS))
+
+static inline int sds_reserve(flb_sds_t *s, size_t len)
+{
+    size_t inc;
+    flb_sds_t tmp;
+
+    if (flb_sds_avail(*s) >= len) {
+        return 0;
+    }
+
+    /* Grow at least twice the current size */
+    inc = flb_sds_alloc(*s);
+    if (inc < len) {
+        inc = len;
+    }
+
+    tmp = flb_sds_increase(*s, inc);
+    if (!tmp) {
+        return -1;
+    }
+    *s = tmp;
+
+    return 0;
+}
+
+static inline int sds_write(flb_sds_t *s, const char *str, size_t len)
+{
+    size_t off;
+
+    if (sds_reserve(s, len) == -1) {
+        return -1;
+    }
+
+    off = flb_sds_len(*s);
+    memcpy(*s + off, str, len);
+    flb_sds_len_set(*s, off + len);
+    (*s)[off + len] = '\0';
+
+    return 0;
+}
+
+static inline int sds_write_u64(flb_sds_t *s, uint64_t n, int negative)
+{
+    int len = 0;
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+
+    do {
+        *--p = '0' + (n % 10);
+        n /= 10;
+        len++;
+    } while (n > 0);
+
+    if (negative) {
+        *--p = '-';
+        len++;
+    }
+
+    return sds_write(s, p, len);
+}
+
+/* Escape a string, same rules than flb_utils_write_str() */
+static int sds_write_str(flb_sds_t *s, const char *str, size_t len)
+{
+    int ret;
+    int off;
+    int hex_bytes;
+    size_t i = 0;
+    size_t run;
+    uint64_t v;
+    unsigned char c;
+    char esc[8];
+
+    while (i < len) {
+        /* Copy blocks that don't need escaping */
+        run = i;
+        while (len - run >= 8) {
+            memcpy(&v, str + run, 8);
+            if (json_needs_escape(v)) {
+                break;
+            }
+            run += 8;
+        }
+        while (run < len) {
+            c = (unsigned char) str[run];
+            if (c < 0x20 || c == '"' || c == '\\' || c >= 0x7f) {
+                break;
+            }
+            run++;
+        }
+
+        if (run > i) {
+            if (sds_write(s, str + i, run - i) == -1) {
+                return -1;
+            }
+            i = run;
+        }
+        if (i >= len) {
+            break;
+        }
+
+        c = (unsigned char) str[i];
+        esc[0] = '\\';
+        switch (c) {
+        case '"':
+            esc[1] = '"';
+            break;
+        case '\\':
+            esc[1] = '\\';
+            break;
+        case '\n':
+            esc[1] = 'n';
+            break;
+        case '\r':
+            esc[1] = 'r';
+            break;
+        case '\t':
+            esc[1] = 't';
+            break;
+        case '\b':
+            esc[1] = 'b';
+            break;
+        case '\f':
+            esc[1] = 'f';
+            break;
+        default:
+            esc[1] = '\0';
+        }
+
+        if (esc[1] != '\0') {
+            ret = sds_write(s, esc, 2);
+            i++;
+        }
+        else if (c < 0x80) {
+            ret = snprintf(esc, sizeof(esc), "\\u%.4hhx", c);
+            ret = sds_write(s, esc, ret);
+            i++;
+        }
+        else {
+            /* UTF-8 sequence, a truncated or invalid one ends the string */
+            hex_bytes = flb_utf8_len(str + i);
+            if (i + hex_bytes > len || sds_reserve(s, 16) == -1) {
+                break;
+            }
+
+            off = flb_sds_len(*s);
+            flb_utils_write_str(*s, &off, flb_sds_len(*s) + 16,
+                                str + i, hex_bytes);
+            if (off == flb_sds_len(*s)) {
+                break;
+            }
+            flb_sds_len_set(*s, off);
+            (*s)[off] = '\0';
+            i += hex_bytes;
+            ret = 0;
+        }
+
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int msgpack2json_sds(flb_sds_t *s, const msgpack_object *o)
+{
+    int i;
+    int len;
+    int ret = 0;
+    char temp[512];
+    msgpack_object_kv *kv;
+
+    switch (o->type) {
+    case MSGPACK_OBJECT_NIL:
+        ret = sds_write(s, "null", 4);
+        break;
+
+    case MSGPACK_OBJECT_BOOLEAN:
+        if (o->via.boolean) {
+            ret = sds_write(s, "true", 4);
+        }
+        else {
+            ret = sds_write(s, "false", 5);
+        }
+        break;
+
+    case MSGPACK_OBJECT_POSITIVE_INTEGER:
+        ret = sds_write_u64(s, o->via.u64, FLB_FALSE);
+        break;
+
+    case MSGPACK_OBJECT_NEGATIVE_INTEGER:
+        ret = sds_write_u64(s, -((uint64_t) o->via.i64), FLB_TRUE);
+        break;
+
+    case MSGPACK_OBJECT_FLOAT32:
+    case MSGPACK_OBJECT_FLOAT64:
+        len = snprintf(temp, sizeof(temp) - 1, "%.16g", o->via.f64);
+        ret = sds_write(s, temp, len);
+        break;
+
+    case MSGPACK_OBJECT_STR:
+        if (sds_write(s, "\"", 1) == -1 ||
+            sds_write_str(s, o->via.str.ptr, o->via.str.size) == -1) {
+            return -1;
+        }
+        ret = sds_write(s, "\"", 1);
+        break;
+
+    case MSGPACK_OBJECT_BIN:
+        if (sds_write(s, "\"", 1) == -1 ||
+            sds_write_str(s, o->via.bin.ptr, o->via.bin.size) == -1) {
+            return -1;
+        }
+        ret = sds_write(s, "\"", 1);
+        break;
+
+    case MSGPACK_OBJECT_EXT:
+        if (sds_write(s, "\"", 1) == -1) {
+            return -1;
+        }
+        /* ext body. fortmat is similar to printf(1) */
+        for (i = 0; i < o->via.ext.size; i++) {
+            len = snprintf(temp, sizeof(temp) - 1, "\\x%02x",
+                           (char) o->via.ext.ptr[i]);
+            if (sds_write(s, temp, len) == -1) {
+                return -1;
+            }
+        }
+        ret = sds_write(s, "\"", 1);
+        break;
+
+    case MSGPACK_OBJECT_ARRAY:
+        if (sds_write(s, "[", 1) == -1) {
+            return -1;
+        }
+        for (i = 0; i < o->via.array.size; i++) {
+            if (i > 0 && sds_write(s, ",", 1) == -1) {
+                return -1;
+            }
+            if (msgpack2json_sds(s, o->via.array.ptr + i) == -1) {
+                return -1;
+            }
+        }
+        ret = sds_write(s, "]", 1);
+        break;
+
+    case MSGPACK_OBJECT_MAP:
+        if (sds_write(s, "{", 1) == -1) {
+            return -1;
+        }
+        for (i = 0; i < o->via.map.size; i++) {
+            kv = o->via.map.ptr + i;
+            if ((i > 0 && sds_write(s, ",", 1) == -1) ||
+                msgpack2json_sds(s, &kv->key) == -1 ||
+                sds_write(s, ":", 1) == -1 ||
+                msgpack2json_sds(s, &kv->val) == -1) {
+                return -1;
+            }
+        }
+        ret = sds_write(s, "}", 1);
+        break;
+
+    default:
+        flb_warn("[%s] unknown msgpack type %i", __FUNCTION__, o->type);
+        return -1;
+    }
+
+    return ret;
+}
+
+/*
+ * Convert a msgpack object to JSON and append it to the sds buffer. The
+ * buffer grows as needed, on error -1 is returned and the buffer keeps
+ * the data appended so far.
+ */
+int flb_msgpack_to_json_sds(flb_sds_t *json, const msgpack_object *obj)
+{
+    if (!json || !*json || !obj) {
+        return -1;
+    }
+
+    return msgpack2json_sds(json, obj);
+}
+
 /**
  *  convert msgpack to JSON string.
  *  This API is similar to snprintf.
@@ -611,14 +1296,10 @@ flb_sds_t flb_msgpack_raw_to_json_sds(const void *in_buf, size_t in_size)
 {
     int ret;
     size_t off = 0;
-    size_t out_size;
     msgpack_unpacked result;
-    msgpack_object *root;
     flb_sds_t out_buf;
-    flb_sds_t tmp_buf;
 
-    out_size = in_size * 1.5;
-    out_buf = flb_sds_create_size(out_size);
+    out_buf = flb_sds_create_size(in_size * 1.5);
     if (!out_buf) {
         flb_errno();
         return NULL;
@@ -626,30 +1307,14 @@ flb_sds_t flb_msgpack_raw_to_json_sds(const void *in_buf, size_t in_size)
 
     msgpack_unpacked_init(&result);
     msgpack_unpack_next(&result, in_buf, in_size, &off);
-    root = &result.data;
-
-    while (1) {
-        ret = flb_msgpack_to_json(out_buf, out_size, root);
-        if (ret <= 0) {
-            tmp_buf = flb_sds_increase(out_buf, 256);
-            if (tmp_buf) {
-                out_buf = tmp_buf;
-                out_size += 256;
-            }
-            else {
-                flb_errno();
-                flb_sds_destroy(out_buf);
-                msgpack_unpacked_destroy(&result);
-                return NULL;
-            }
-        }
-        else {
-            break;
-        }
-    }
 
+    ret = msgpack2json_sds(&out_buf, &result.data);
     msgpack_unpacked_destroy(&result);
-    flb_sds_len_set(out_buf, ret);
+
+    if (ret == -1) {
+        flb_sds_destroy(out_buf);
+        return NULL;
+    }
 
     return out_buf;
 }
@@ -694,204 +1359,144 @@ int flb_pack_to_json_date_type(const char *str)
 }
 
 
+/* Append the record timestamp formatted as 'date_format' */
+static int pack_json_date(flb_sds_t *out_buf, struct flb_time *tms,
+                          int date_format)
+{
+    int len;
+    size_t s;
+    char time_formatted[32];
+    struct tm tm;
+
+    switch (date_format) {
+    case FLB_PACK_JSON_DATE_DOUBLE:
+        len = snprintf(time_formatted, sizeof(time_formatted) - 1, "%.16g",
+                       flb_time_to_double(tms));
+        return sds_write(out_buf, time_formatted, len);
+    case FLB_PACK_JSON_DATE_ISO8601:
+        /* Format the time, use microsecond precision not nanoseconds */
+        gmtime_r(&tms->tm.tv_sec, &tm);
+        s = strftime(time_formatted + 1, sizeof(time_formatted) - 2,
+                     FLB_PACK_JSON_DATE_ISO8601_FMT, &tm);
+
+        len = snprintf(time_formatted + 1 + s,
+                       sizeof(time_formatted) - 2 - s,
+                       ".%06" PRIu64 "Z\"",
+                       (uint64_t) tms->tm.tv_nsec / 1000);
+        time_formatted[0] = '"';
+        return sds_write(out_buf, time_formatted, s + len + 1);
+    case FLB_PACK_JSON_DATE_EPOCH:
+        return sds_write_u64(out_buf, (uint64_t) tms->tm.tv_sec, FLB_FALSE);
+    }
+
+    return 0;
+}
+
+/*
+ * Convert a buffer of records to JSON in a single pass. Every record map
+ * gets the 'date_key' as its first entry and is appended to the output
+ * buffer as:
+ *
+ * FLB_PACK_JSON_FORMAT_JSON: an array of records
+ *
+ *     [{'ts':abc,'k1':1},{'ts':abc,'k1':2},{N}]
+ *
+ * FLB_PACK_JSON_FORMAT_LINES: add  breakline (\n) after each record
+ *
+ *     {'ts':abc,'k1':1}
+ *     {'ts':abc,'k1':2}
+ *     {N}
+ *
+ * FLB_PACK_JSON_FORMAT_STREAM: no separators, e.g:
+ *
+ *     {'ts':abc,'k1':1}{'ts':abc,'k1':2}{N}
+ */
 flb_sds_t flb_pack_msgpack_to_json_format(const char *data, uint64_t bytes,
                                           int json_format, int date_format,
                                           flb_sds_t date_key)
 {
     int i;
-    int len;
+    int ret = 0;
     int ok = MSGPACK_UNPACK_SUCCESS;
-    int records = 0;
-    int map_size;
+    int count = 0;
     size_t off = 0;
-    char time_formatted[32];
-    size_t s;
-    flb_sds_t out_tmp;
-    flb_sds_t out_js;
     flb_sds_t out_buf = NULL;
     msgpack_unpacked result;
     msgpack_object root;
     msgpack_object map;
-    msgpack_sbuffer tmp_sbuf;
-    msgpack_packer tmp_pck;
     msgpack_object *obj;
-    struct tm tm;
+    msgpack_object_kv *kv;
     struct flb_time tms;
 
     if (!date_key) {
         return NULL;
     }
 
-    /* Iterate the original buffer and perform adjustments */
-    records = flb_mp_count(data, bytes);
-    if (records <= 0) {
+    out_buf = flb_sds_create_size(bytes * 1.25);
+    if (!out_buf) {
+        flb_errno();
         return NULL;
     }
 
-    /* For json lines and streams mode we need a pre-allocated buffer */
-    if (json_format == FLB_PACK_JSON_FORMAT_LINES ||
-        json_format == FLB_PACK_JSON_FORMAT_STREAM) {
-        out_buf = flb_sds_create_size(bytes * 1.25);
-        if (!out_buf) {
-            flb_errno();
-            return NULL;
-        }
-    }
-
-    /* Create temporal msgpack buffer */
-    msgpack_sbuffer_init(&tmp_sbuf);
-    msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
-
-    /*
-     * If the format is the original msgpack style of one big array,
-     * registrate the array, otherwise is not necessary. FYI, original format:
-     *
-     * [
-     *   [timestamp, map],
-     *   [timestamp, map],
-     *   [T, M]...
-     * ]
-     */
     if (json_format == FLB_PACK_JSON_FORMAT_JSON) {
-        msgpack_pack_array(&tmp_pck, records);
+        ret = sds_write(&out_buf, "[", 1);
     }
 
     msgpack_unpacked_init(&result);
-    while (msgpack_unpack_next(&result, data, bytes, &off) == ok) {
+    while (ret == 0 &&
+           msgpack_unpack_next(&result, data, bytes, &off) == ok) {
         /* Each array must have two entries: time and record */
         root = result.data;
-        if (root.via.array.size != 2) {
+        if (root.type != MSGPACK_OBJECT_ARRAY || root.via.array.size != 2) {
             continue;
         }
 
-        /* Unpack time */
-        flb_time_pop_from_msgpack(&tms, &result, &obj);
-
         /* Get the record/map */
         map = root.via.array.ptr[1];
-        map_size = map.via.map.size;
-        msgpack_pack_map(&tmp_pck, map_size + 1);
-
-        /* Append date key */
-        msgpack_pack_str(&tmp_pck, flb_sds_len(date_key));
-        msgpack_pack_str_body(&tmp_pck, date_key, flb_sds_len(date_key));
-
-        /* Append date value */
-        switch (date_format) {
-        case FLB_PACK_JSON_DATE_DOUBLE:
-            msgpack_pack_double(&tmp_pck, flb_time_to_double(&tms));
-            break;
-        case FLB_PACK_JSON_DATE_ISO8601:
-            /* Format the time, use microsecond precision not nanoseconds */
-            gmtime_r(&tms.tm.tv_sec, &tm);
-            s = strftime(time_formatted, sizeof(time_formatted) - 1,
-                         FLB_PACK_JSON_DATE_ISO8601_FMT, &tm);
-
-            len = snprintf(time_formatted + s,
-                           sizeof(time_formatted) - 1 - s,
-                           ".%06" PRIu64 "Z",
-                           (uint64_t) tms.tm.tv_nsec / 1000);
-            s += len;
-            msgpack_pack_str(&tmp_pck, s);
-            msgpack_pack_str_body(&tmp_pck, time_formatted, s);
-            break;
-        case FLB_PACK_JSON_DATE_EPOCH:
-            msgpack_pack_uint64(&tmp_pck, (long long unsigned)(tms.tm.tv_sec));
-            break;
+        if (map.type != MSGPACK_OBJECT_MAP) {
+            continue;
         }
 
-        /* Append remaining keys/values */
-        for (i = 0; i < map_size; i++) {
-            msgpack_object *k = &map.via.map.ptr[i].key;
-            msgpack_object *v = &map.via.map.ptr[i].val;
+        /* Unpack time */
+        flb_time_pop_from_msgpack(&tms, &result, &obj);
 
-            msgpack_pack_object(&tmp_pck, *k);
-            msgpack_pack_object(&tmp_pck, *v);
+        if (json_format == FLB_PACK_JSON_FORMAT_JSON && count > 0) {
+            ret = sds_write(&out_buf, ",", 1);
         }
-
-        /*
-         * If the format is the original msgpack style, just continue since
-         * we don't care about separator or JSON convertion at this point.
-         */
-        if (json_format == FLB_PACK_JSON_FORMAT_JSON) {
-            continue;
+        count++;
+
+        /* Date key and value */
+        ret |= sds_write(&out_buf, "{\"", 2);
+        ret |= sds_write_str(&out_buf, date_key, flb_sds_len(date_key));
+        ret |= sds_write(&out_buf, "\":", 2);
+        ret |= pack_json_date(&out_buf, &tms, date_format);
+
+        /* Remaining keys/values */
+        for (i = 0; i < map.via.map.size && ret == 0; i++) {
+            kv = &map.via.map.ptr[i];
+            ret |= sds_write(&out_buf, ",", 1);
+            ret |= msgpack2json_sds(&out_buf, &kv->key);
+            ret |= sds_write(&out_buf, ":", 1);
+            ret |= msgpack2json_sds(&out_buf, &kv->val);
         }
+        ret |= sds_write(&out_buf, "}", 1);
 
-        /*
-         * Here we handle two types of records concatenation:
-         *
-         * FLB_PACK_JSON_FORMAT_LINES: add  breakline (\n) after each record
-         *
-         *
-         *     {'ts':abc,'k1':1}
-         *     {'ts':abc,'k1':2}
-         *     {N}
-         *
-         * FLB_PACK_JSON_FORMAT_STREAM: no separators, e.g:
-         *
-         *     {'ts':abc,'k1':1}{'ts':abc,'k1':2}{N}
-         */
-        if (json_format == FLB_PACK_JSON_FORMAT_LINES ||
-            json_format == FLB_PACK_JSON_FORMAT_STREAM) {
-
-            /* Encode current record into JSON in a temporal variable */
-            out_js = flb_msgpack_raw_to_json_sds(tmp_sbuf.data, tmp_sbuf.size);
-            if (!out_js) {
-                msgpack_sbuffer_destroy(&tmp_sbuf);
-                flb_sds_destroy(out_buf);
-                return NULL;
-            }
-
-            /*
-             * One map record has been converted, now append it to the
-             * outgoing out_buf sds variable.
-             */
-            out_tmp = flb_sds_cat(out_buf, out_js, flb_sds_len(out_js));
-            if (!out_tmp) {
-                msgpack_sbuffer_destroy(&tmp_sbuf);
-                flb_sds_destroy(out_js);
-                flb_sds_destroy(out_buf);
-                return NULL;
-            }
-
-            /* Release temporal json sds buffer */
-            flb_sds_destroy(out_js);
-
-            /* If a realloc happened, check the returned address */
-            if (out_tmp != out_buf) {
-                out_buf = out_tmp;
-            }
-
-            /* Append the breakline only for json lines mode */
-            if (json_format == FLB_PACK_JSON_FORMAT_LINES) {
-                out_tmp = flb_sds_cat(out_buf, "\n", 1);
-                if (!out_tmp) {
-                    msgpack_sbuffer_destroy(&tmp_sbuf);
-                    flb_sds_destroy(out_buf);
-                    return NULL;
-                }
-                if (out_tmp != out_buf) {
-                    out_buf = out_tmp;
-                }
-            }
-            msgpack_sbuffer_clear(&tmp_sbuf);
+        /* Append the breakline only for json lines mode */
+        if (json_format == FLB_PACK_JSON_FORMAT_LINES) {
+            ret |= sds_write(&out_buf, "\n", 1);
         }
     }
 
     /* Release the unpacker */
     msgpack_unpacked_destroy(&result);
 
-    /* Format to JSON */
-    if (json_format == FLB_PACK_JSON_FORMAT_JSON) {
-        out_buf = flb_msgpack_raw_to_json_sds(tmp_sbuf.data, tmp_sbuf.size);
-        msgpack_sbuffer_destroy(&tmp_sbuf);
-
-        if (!out_buf) {
-            return NULL;
-        }
+    if (ret == 0 && json_format == FLB_PACK_JSON_FORMAT_JSON) {
+        ret = sds_write(&out_buf, "]", 1);
     }
-    else {
-        msgpack_sbuffer_destroy(&tmp_sbuf);
+
+    if (ret != 0 || count == 0) {
+        flb_sds_destroy(out_buf);
+        return NULL;
     }
 
     return out_buf;
@@ -907,8 +1512,9 @@ flb_sds_t flb_pack_msgpack_to_json_format(const char *data, uint64_t bytes,
 char *flb_msgpack_to_json_str(size_t size, const msgpack_object *obj)
 {
     int ret;
-    char *buf = NULL;
-    char *tmp;
+    size_t len;
+    char *buf;
+    flb_sds_t json;
 
     if (obj == NULL) {
         return NULL;
@@ -918,31 +1524,29 @@ char *flb_msgpack_to_json_str(size_t size, const msgpack_object *obj)
         size = 128;
     }
 
-    buf = flb_malloc(size);
-    if (!buf) {
+    json = flb_sds_create_size(size);
+    if (!json) {
         flb_errno();
         return NULL;
     }
 
-    while (1) {
-        ret = flb_msgpack_to_json(buf, size, obj);
-        if (ret <= 0) {
-            /* buffer is small. retry.*/
-            size += 128;
-            tmp = flb_realloc(buf, size);
-            if (tmp) {
-                buf = tmp;
-            }
-            else {
-                flb_free(buf);
-                flb_errno();
-                return NULL;
-            }
-        }
-        else {
-            break;
-        }
+    ret = msgpack2json_sds(&json, obj);
+    if (ret == -1) {
+        flb_sds_destroy(json);
+        return NULL;
+    }
+
+    /* The caller expects a buffer that can be released with flb_free() */
+    len = flb_sds_len(json);
+    buf = flb_malloc(len + 1);
+    if (!buf) {
+        flb_errno();
+        flb_sds_destroy(json);
+        return NULL;
     }
+    memcpy(buf, json, len);
+    buf[len] = '\0';
+    flb_sds_destroy(json);
 
     return buf;
 }
@@ -183,6 +183,12 @@ struct flb_parser *flb_parser_create(const char *name, const char *format,
     if (time_fmt) {
         p->time_fmt = flb_strdup(time_fmt);
 
+        /*
+         * Compile the format into a specialized decoder, formats it does
+         * not support (NULL) are handled by strptime(3).
+         */
+        p->time_decoder = flb_parser_time_compile(time_fmt);
+
         /* Check if the format is considering the year */
         if (strstr(p->time_fmt, "%Y") || strstr(p->time_fmt, "%y")) {
             p->time_with_year = FLB_TRUE;
@@ -309,6 +315,9 @@ void flb_parser_destroy(struct flb_parser *parser)
     if (parser->time_fmt_year) {
         flb_free(parser->time_fmt_year);
     }
+    if (parser->time_decoder) {
+        flb_parser_time_destroy(parser->time_decoder);
+    }
     if (parser->time_key) {
         flb_free(parser->time_key);
     }
@@ -736,6 +745,16 @@ int flb_parser_time_lookup(const char *time_str, size_t tsize,
         tm->tm_mon = tmy.tm_mon;
         tm->tm_mday = tmy.tm_mday;
 
+        if (parser->time_decoder) {
+            tm->tm_year = tmy.tm_year;
+            ret = flb_parser_time_decode(parser->time_decoder,
+                                         time_str, tsize, tm, ns);
+            if (ret == 0) {
+                goto decoded;
+            }
+            *ns = 0;
+        }
+
         uint64_t t = tmy.tm_year + 1900;
 
         fmt = tmp;
@@ -752,6 +771,14 @@ int flb_parser_time_lookup(const char *time_str, size_t tsize,
         p = strptime(time_ptr, parser->time_fmt_year, tm);
     }
     else {
+        if (parser->time_decoder) {
+            ret = flb_parser_time_decode(parser->time_decoder,
+                                         time_str, tsize, tm, ns);
+            if (ret == 0) {
+                goto decoded;
+            }
+            *ns = 0;
+        }
         p = strptime(time_ptr, parser->time_fmt, tm);
     }
 
@@ -784,6 +811,7 @@ int flb_parser_time_lookup(const char *time_str, size_t tsize,
             }
         }
 
+    decoded:
 #ifdef FLB_HAVE_GMTOFF
         if (parser->time_with_tz == FLB_FALSE) {
             tm->tm_gmtoff = parser->time_offset;
@@ -796,6 +824,46 @@ int flb_parser_time_lookup(const char *time_str, size_t tsize,
     return -1;
 }
 
+/*
+ * Convert a parsed time to epoch. Records usually come in bursts within
+ * the same day, so the start of the last converted day is cached and only
+ * the time of the day is added, timegm(3) runs once per day change.
+ */
+time_t flb_parser_time_epoch(struct flb_parser *parser, const struct tm *tm)
+{
+    long gmtoff = 0;
+    time_t t;
+    struct flb_parser_time_cache *c = &parser->time_cache;
+
+#ifdef FLB_HAVE_GMTOFF
+    gmtoff = tm->tm_gmtoff;
+#endif
+
+    if (c->valid && c->mday == tm->tm_mday && c->mon == tm->tm_mon &&
+        c->year == tm->tm_year && c->gmtoff == gmtoff &&
+        tm->tm_hour >= 0 && tm->tm_hour <= 23 &&
+        tm->tm_min >= 0 && tm->tm_min <= 59 &&
+        tm->tm_sec >= 0 && tm->tm_sec <= 59) {
+        return c->day + (tm->tm_hour * 3600) + (tm->tm_min * 60) + tm->tm_sec;
+    }
+
+    t = flb_parser_tm2time(tm);
+
+    /* leap seconds and out of range values are not cached */
+    if (tm->tm_hour >= 0 && tm->tm_hour <= 23 &&
+        tm->tm_min >= 0 && tm->tm_min <= 59 &&
+        tm->tm_sec >= 0 && tm->tm_sec <= 59) {
+        c->year = tm->tm_year;
+        c->mon = tm->tm_mon;
+        c->mday = tm->tm_mday;
+        c->gmtoff = gmtoff;
+        c->day = t - ((tm->tm_hour * 3600) + (tm->tm_min * 60) + tm->tm_sec);
+        c->valid = FLB_TRUE;
+    }
+
+    return t;
+}
+
 int flb_parser_frac(const char *str, int len, double *frac, const char **end)
 {
     int ret = 0;
@@ -168,7 +168,7 @@ int flb_parser_json_do(struct flb_parser *parser,
         time_lookup = time(NULL);
     }
     else {
-        time_lookup = flb_parser_tm2time(&tm);
+        time_lookup = flb_parser_time_epoch(parser, &tm);
     }
 
     /* Compose a new map without the time_key field */
@@ -140,7 +140,7 @@ static int ltsv_parser(struct flb_parser *parser,
                                  parser->name, parser->time_fmt);
                        return -1;
                     }
-                    *time_lookup = flb_parser_tm2time(&tm);
+                    *time_lookup = flb_parser_time_epoch(parser, &tm);
                 }
                 time_found = FLB_TRUE;
             }
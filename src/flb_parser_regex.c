@@ -88,7 +88,7 @@ static void cb_results(const char *name, const char *value,
             }
 
             pcb->time_frac = frac;
-            pcb->time_lookup = flb_parser_tm2time(&tm);
+            pcb->time_lookup = flb_parser_time_epoch(parser, &tm);
 
             if (parser->time_keep == FLB_FALSE) {
                 pcb->num_skipped++;
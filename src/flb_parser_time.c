@@ -0,0 +1,410 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Time_Format compiler: the format is translated once into a list of
+ * operations that read fixed ranges of digits, month names and literals
+ * straight from the time string, no copies and no strptime(3) call.
+ *
+ * The readers follow the rules of the libc strptime(3) for the same
+ * conversions (number widths and ranges, white spaces, %z forms), so a
+ * decoded string gives the same 'struct tm'. If the decoder cannot handle
+ * a string it returns an error and the caller falls back to strptime(3).
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_parser_time.h>
+
+#include <string.h>
+#include <strings.h>
+
+/* Maximum digits of fractional seconds converted without precision loss */
+#define FRAC_DIGITS_MAX  15
+
+static const char *month_names[] = {
+    "January", "February", "March", "April", "May", "June", "July",
+    "August", "September", "October", "November", "December"
+};
+
+/* white spaces of the C locale, as skipped by strptime(3) */
+#define is_space(c)  ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+
+static const double pow10_table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+    1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+static int op_add(struct flb_parser_time *pt, int type, char c)
+{
+    if (pt->ops_len >= FLB_PARSER_TIME_OPS_MAX) {
+        return -1;
+    }
+
+    pt->ops[pt->ops_len].type = type;
+    pt->ops[pt->ops_len].c = c;
+    pt->ops_len++;
+    return 0;
+}
+
+/* Compile a format string, return NULL if it uses unsupported conversions */
+struct flb_parser_time *flb_parser_time_compile(const char *fmt)
+{
+    int ret = 0;
+    const char *p;
+    struct flb_parser_time *pt;
+
+    pt = flb_calloc(1, sizeof(struct flb_parser_time));
+    if (!pt) {
+        flb_errno();
+        return NULL;
+    }
+
+    for (p = fmt; *p != '\0' && ret == 0; p++) {
+        if (is_space(*p)) {
+            ret = op_add(pt, FLB_PTIME_SPACE, 0);
+            while (is_space(*(p + 1))) {
+                p++;
+            }
+            continue;
+        }
+        else if (*p != '%') {
+            ret = op_add(pt, FLB_PTIME_LITERAL, *p);
+            continue;
+        }
+
+        p++;
+        switch (*p) {
+        case 'Y':
+            ret = op_add(pt, FLB_PTIME_YEAR, 0);
+            break;
+        case 'y':
+            ret = op_add(pt, FLB_PTIME_YEAR2, 0);
+            break;
+        case 'm':
+            ret = op_add(pt, FLB_PTIME_MONTH, 0);
+            break;
+        case 'b':
+        case 'B':
+        case 'h':
+            ret = op_add(pt, FLB_PTIME_MONTH_NAME, 0);
+            break;
+        case 'd':
+        case 'e':
+            ret = op_add(pt, FLB_PTIME_MDAY, 0);
+            break;
+        case 'H':
+            ret = op_add(pt, FLB_PTIME_HOUR, 0);
+            break;
+        case 'M':
+            ret = op_add(pt, FLB_PTIME_MIN, 0);
+            break;
+        case 'S':
+        case 's':
+            ret = op_add(pt, *p == 'S' ? FLB_PTIME_SEC : FLB_PTIME_EPOCH, 0);
+
+            /* fractional seconds: '%S.%L' or '%S,%L' */
+            if (ret == 0 && (p[1] == '.' || p[1] == ',') &&
+                p[2] == '%' && p[3] == 'L') {
+                ret = op_add(pt, FLB_PTIME_FRAC, 0);
+                p += 3;
+            }
+            break;
+        case 'z':
+            ret = op_add(pt, FLB_PTIME_TZ, 0);
+            break;
+        case 'T':
+            ret |= op_add(pt, FLB_PTIME_HOUR, 0);
+            ret |= op_add(pt, FLB_PTIME_LITERAL, ':');
+            ret |= op_add(pt, FLB_PTIME_MIN, 0);
+            ret |= op_add(pt, FLB_PTIME_LITERAL, ':');
+            ret |= op_add(pt, FLB_PTIME_SEC, 0);
+            break;
+        case 'F':
+            ret |= op_add(pt, FLB_PTIME_YEAR, 0);
+            ret |= op_add(pt, FLB_PTIME_LITERAL, '-');
+            ret |= op_add(pt, FLB_PTIME_MONTH, 0);
+            ret |= op_add(pt, FLB_PTIME_LITERAL, '-');
+            ret |= op_add(pt, FLB_PTIME_MDAY, 0);
+            break;
+        case '%':
+            ret = op_add(pt, FLB_PTIME_LITERAL, '%');
+            break;
+        default:
+            /* any other conversion is handled by strptime(3) */
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret != 0) {
+        flb_free(pt);
+        return NULL;
+    }
+
+    return pt;
+}
+
+void flb_parser_time_destroy(struct flb_parser_time *pt)
+{
+    flb_free(pt);
+}
+
+/*
+ * Read a number like strptime(3) does: skip white spaces, then read up to
+ * 'digits' digits while the value can still grow within the range.
+ */
+static inline int read_number(const char **p, const char *end,
+                              int from, int to, int digits, int *val)
+{
+    int n = 0;
+    const char *s = *p;
+
+    while (s < end && is_space(*s)) {
+        s++;
+    }
+    if (s >= end || *s < '0' || *s > '9') {
+        return -1;
+    }
+
+    do {
+        n = (n * 10) + (*s++ - '0');
+    } while (--digits > 0 && n * 10 <= to &&
+             s < end && *s >= '0' && *s <= '9');
+
+    if (n < from || n > to) {
+        return -1;
+    }
+
+    *val = n;
+    *p = s;
+    return 0;
+}
+
+/* Full or abbreviated month name, case insensitive */
+static inline int read_month_name(const char **p, const char *end, int *mon)
+{
+    int i;
+    size_t len;
+    const char *s = *p;
+
+    if (end - s < 3) {
+        return -1;
+    }
+
+    /* abbreviations are unique, then check if the full name follows */
+    for (i = 0; i < 12; i++) {
+        if (strncasecmp(s, month_names[i], 3) == 0) {
+            break;
+        }
+    }
+    if (i == 12) {
+        return -1;
+    }
+
+    len = strlen(month_names[i]);
+    if (end - s >= len && strncasecmp(s + 3, month_names[i] + 3, len - 3) == 0) {
+        s += len;
+    }
+    else {
+        s += 3;
+    }
+
+    *mon = i;
+    *p = s;
+    return 0;
+}
+
+/* Timezone offset: 'Z', +hh, +hhmm or +hh:mm */
+static inline int read_tz(const char **p, const char *end, long *gmtoff)
+{
+    int n = 0;
+    int neg;
+    int val = 0;
+    const char *s = *p;
+
+    while (s < end && is_space(*s)) {
+        s++;
+    }
+    if (s >= end) {
+        return -1;
+    }
+
+    if (*s == 'Z') {
+        *gmtoff = 0;
+        *p = s + 1;
+        return 0;
+    }
+
+    if (*s != '+' && *s != '-') {
+        return -1;
+    }
+    neg = (*s++ == '-');
+
+    while (n < 4 && s < end && *s >= '0' && *s <= '9') {
+        val = (val * 10) + (*s++ - '0');
+        n++;
+        if (n == 2 && s + 1 < end && *s == ':' &&
+            s[1] >= '0' && s[1] <= '9') {
+            s++;
+        }
+    }
+
+    if (n == 2) {
+        val *= 100;
+    }
+    else if (n != 4 || val % 100 >= 60) {
+        return -1;
+    }
+
+    *gmtoff = ((val / 100) * 3600) + ((val % 100) * 60);
+    if (neg) {
+        *gmtoff = -*gmtoff;
+    }
+    *p = s;
+    return 0;
+}
+
+/* Fractional part of the seconds, the separator can be '.' or ',' */
+static inline int read_frac(const char **p, const char *end, double *ns)
+{
+    int n = 0;
+    uint64_t val = 0;
+    const char *s = *p;
+
+    if (s >= end || (*s != '.' && *s != ',')) {
+        return -1;
+    }
+    s++;
+
+    while (s < end && *s >= '0' && *s <= '9') {
+        if (++n > FRAC_DIGITS_MAX) {
+            return -1;
+        }
+        val = (val * 10) + (*s++ - '0');
+    }
+
+    /* no digits or an exponent, leave it to strtod(3) */
+    if (n == 0 || (s < end && (*s == 'e' || *s == 'E'))) {
+        return -1;
+    }
+
+    /* both operands are exact, the division is correctly rounded */
+    *ns = (double) val / pow10_table[n];
+    *p = s;
+    return 0;
+}
+
+static inline int read_epoch(const char **p, const char *end, struct tm *tm)
+{
+    time_t t = 0;
+    const char *s = *p;
+
+    if (s >= end || *s < '0' || *s > '9') {
+        return -1;
+    }
+
+    while (s < end && *s >= '0' && *s <= '9') {
+        t = (t * 10) + (*s++ - '0');
+    }
+
+    if (!gmtime_r(&t, tm)) {
+        return -1;
+    }
+    *p = s;
+    return 0;
+}
+
+/*
+ * Decode a time string with a compiled format, only the fields present in
+ * the format are set. Returns -1 if the string does not match.
+ */
+int flb_parser_time_decode(struct flb_parser_time *pt,
+                           const char *str, size_t len,
+                           struct tm *tm, double *ns)
+{
+    int i;
+    int ret = 0;
+    int val = 0;
+    long gmtoff = 0;
+    const char *p = str;
+    const char *end = str + len;
+    struct flb_parser_time_op *op;
+
+    for (i = 0; i < pt->ops_len && ret == 0; i++) {
+        op = &pt->ops[i];
+
+        switch (op->type) {
+        case FLB_PTIME_LITERAL:
+            if (p >= end || *p != op->c) {
+                return -1;
+            }
+            p++;
+            break;
+        case FLB_PTIME_SPACE:
+            while (p < end && is_space(*p)) {
+                p++;
+            }
+            break;
+        case FLB_PTIME_YEAR:
+            ret = read_number(&p, end, 0, 9999, 4, &val);
+            tm->tm_year = val - 1900;
+            break;
+        case FLB_PTIME_YEAR2:
+            ret = read_number(&p, end, 0, 99, 2, &val);
+            tm->tm_year = val >= 69 ? val : val + 100;
+            break;
+        case FLB_PTIME_MONTH:
+            ret = read_number(&p, end, 1, 12, 2, &val);
+            tm->tm_mon = val - 1;
+            break;
+        case FLB_PTIME_MONTH_NAME:
+            ret = read_month_name(&p, end, &tm->tm_mon);
+            break;
+        case FLB_PTIME_MDAY:
+            ret = read_number(&p, end, 1, 31, 2, &tm->tm_mday);
+            break;
+        case FLB_PTIME_HOUR:
+            ret = read_number(&p, end, 0, 23, 2, &tm->tm_hour);
+            break;
+        case FLB_PTIME_MIN:
+            ret = read_number(&p, end, 0, 59, 2, &tm->tm_min);
+            break;
+        case FLB_PTIME_SEC:
+            ret = read_number(&p, end, 0, 61, 2, &tm->tm_sec);
+            break;
+        case FLB_PTIME_FRAC:
+            ret = read_frac(&p, end, ns);
+            break;
+        case FLB_PTIME_EPOCH:
+            ret = read_epoch(&p, end, tm);
+            break;
+        case FLB_PTIME_TZ:
+            ret = read_tz(&p, end, &gmtoff);
+#ifdef FLB_HAVE_GMTOFF
+            tm->tm_gmtoff = gmtoff;
+#endif
+            break;
+        }
+    }
+
+    return ret;
+}
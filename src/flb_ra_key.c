@@ -243,6 +243,37 @@ struct flb_ra_value *flb_ra_key_to_value(flb_sds_t ckey,
     return result;
 }
 
+/*
+ * Reference the object of a key without copying it, returns NULL if the
+ * key or sub-keys are not found.
+ */
+msgpack_object *flb_ra_key_to_object(flb_sds_t ckey, msgpack_object map,
+                                     struct mk_list *subkeys)
+{
+    int i;
+    int ret;
+    msgpack_object *val;
+    msgpack_object *out;
+
+    /* Get the key position in the map */
+    i = ra_key_val_id(ckey, map);
+    if (i == -1) {
+        return NULL;
+    }
+
+    val = &map.via.map.ptr[i].val;
+    if ((val->type == MSGPACK_OBJECT_MAP || val->type == MSGPACK_OBJECT_ARRAY)
+        && subkeys != NULL) {
+        ret = subkey_to_object(val, subkeys, &out);
+        if (ret == 0) {
+            return out;
+        }
+        return NULL;
+    }
+
+    return val;
+}
+
 int flb_ra_key_strcmp(flb_sds_t ckey, msgpack_object map,
                       struct mk_list *subkeys, char *str, int len)
 {
@@ -559,3 +559,20 @@ struct flb_ra_value *flb_ra_get_value_object(struct flb_record_accessor *ra,
     rp = mk_list_entry_first(&ra->list, struct flb_ra_parser, _head);
     return flb_ra_key_to_value(rp->key->name, map, rp->key->subkeys);
 }
+
+/* Reference the value of a single key record accessor, no copies */
+msgpack_object *flb_ra_get_object(struct flb_record_accessor *ra,
+                                  msgpack_object map)
+{
+    struct flb_ra_parser *rp;
+
+    if (mk_list_size(&ra->list) == 0) {
+        return NULL;
+    }
+
+    rp = mk_list_entry_first(&ra->list, struct flb_ra_parser, _head);
+    if (rp->type != FLB_RA_PARSER_KEYMAP) {
+        return NULL;
+    }
+    return flb_ra_key_to_object(rp->key->name, map, rp->key->subkeys);
+}
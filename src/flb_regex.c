@@ -22,10 +22,44 @@
 #include <fluent-bit/flb_regex.h>
 #include <fluent-bit/flb_log.h>
 #include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_regex_dfa.h>
 
 #include <string.h>
 #include <onigmo.h>
 
+/* Pre-check: window of inputs and minimum rejections to keep it enabled */
+#define PRECHECK_WINDOW   256
+#define PRECHECK_REJECTS  (PRECHECK_WINDOW / 10)
+#define PRECHECK_SKIP     4096
+
+static void *dfa_create(const char *pattern)
+{
+    return flb_regex_dfa_create(&pattern, 1);
+}
+
+static int dfa_match(void *ctx, const char *str, size_t len)
+{
+    return flb_regex_dfa_exec(ctx, str, len, NULL);
+}
+
+static void dfa_destroy(void *ctx)
+{
+    flb_regex_dfa_destroy(ctx);
+}
+
+static struct flb_regex_engine engine_dfa = {
+    .name    = "dfa",
+    .create  = dfa_create,
+    .match   = dfa_match,
+    .destroy = dfa_destroy
+};
+
+/* Matching engines in order of preference, Onigmo is the fallback */
+static struct flb_regex_engine *engines[] = {
+    &engine_dfa,
+    NULL
+};
+
 static int
 cb_onig_named(const UChar *name, const UChar *name_end,
               int ngroup_num, int *group_nums,
@@ -94,11 +128,12 @@ int flb_regex_init()
 
 struct flb_regex *flb_regex_create(const char *pattern)
 {
+    int i;
     int ret;
     struct flb_regex *r;
 
     /* Create context */
-    r = flb_malloc(sizeof(struct flb_regex));
+    r = flb_calloc(1, sizeof(struct flb_regex));
     if (!r) {
         flb_errno();
         return NULL;
@@ -111,9 +146,67 @@ struct flb_regex *flb_regex_create(const char *pattern)
         return NULL;
     }
 
+    /* Look for a faster engine to match the pattern */
+    for (i = 0; engines[i]; i++) {
+        r->engine_ctx = engines[i]->create(pattern);
+        if (r->engine_ctx) {
+            r->engine = engines[i];
+            break;
+        }
+    }
+
+    flb_debug("[regex] engine=%s pattern='%s'",
+              flb_regex_engine_name(r), pattern);
     return r;
 }
 
+const char *flb_regex_engine_name(struct flb_regex *r)
+{
+    if (r->engine) {
+        return r->engine->name;
+    }
+    return "onigmo";
+}
+
+/*
+ * Before running Onigmo to get the captures, the matching engine rejects
+ * the strings that don't match. The check is skipped for a while when it
+ * rarely rejects anything: the pattern matches almost every string.
+ */
+static int regex_precheck(struct flb_regex *r, const char *str, size_t slen)
+{
+    int ret;
+
+    if (!r->engine) {
+        return FLB_TRUE;
+    }
+
+    if (r->skip > 0) {
+        r->skip--;
+        return FLB_TRUE;
+    }
+
+    ret = r->engine->match(r->engine_ctx, str, slen);
+    if (ret == -1) {
+        return FLB_TRUE;
+    }
+
+    r->checks++;
+    if (ret == 0) {
+        r->rejects++;
+    }
+
+    if (r->checks >= PRECHECK_WINDOW) {
+        if (r->rejects < PRECHECK_REJECTS) {
+            r->skip = PRECHECK_SKIP;
+        }
+        r->checks = 0;
+        r->rejects = 0;
+    }
+
+    return (ret == 1);
+}
+
 ssize_t flb_regex_do(struct flb_regex *r, const char *str, size_t slen,
                      struct flb_regex_search *result)
 {
@@ -123,6 +216,11 @@ ssize_t flb_regex_do(struct flb_regex *r, const char *str, size_t slen,
     const char *range;
     OnigRegion *region;
 
+    if (regex_precheck(r, str, slen) == FLB_FALSE) {
+        result->region = NULL;
+        return -1;
+    }
+
     region = onig_region_new();
     if (!region) {
         result->region = NULL;
@@ -208,6 +306,13 @@ int flb_regex_match(struct flb_regex *r, unsigned char *str, size_t slen)
     unsigned char *end;
     unsigned char *range;
 
+    if (r->engine) {
+        ret = r->engine->match(r->engine_ctx, (const char *) str, slen);
+        if (ret >= 0) {
+            return ret;
+        }
+    }
+
     /* Search scope */
     start = (unsigned char *) str;
     end   = start + slen;
@@ -248,6 +353,9 @@ int flb_regex_parse(struct flb_regex *r, struct flb_regex_search *result,
 
 int flb_regex_destroy(struct flb_regex *r)
 {
+    if (r->engine) {
+        r->engine->destroy(r->engine_ctx);
+    }
     onig_free(r->regex);
     flb_free(r);
     return 0;
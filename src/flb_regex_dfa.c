@@ -0,0 +1,1165 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_regex_dfa.h>
+
+#include <string.h>
+
+/* Syntax tree nodes */
+#define NODE_EMPTY    0
+#define NODE_BYTE     1   /* one byte of 'set'                          */
+#define NODE_CHAR     2   /* one character: ASCII of 'set' or multibyte */
+#define NODE_CAT      3
+#define NODE_ALT      4
+#define NODE_REPEAT   5
+#define NODE_ASSERT   6
+
+/* NFA states */
+#define NFA_BYTE      0
+#define NFA_SPLIT     1
+#define NFA_ASSERT    2
+#define NFA_MATCH     3
+
+/* Assertions */
+#define ASSERT_BOL    0   /* ^  */
+#define ASSERT_EOL    1   /* $  */
+#define ASSERT_BOS    2   /* \A */
+#define ASSERT_EOS    3   /* \z */
+
+/* Class of the previous byte */
+#define PREV_START    0
+#define PREV_NL       1
+#define PREV_OTHER    2
+
+/* Class of the next byte */
+#define NEXT_NL       0
+#define NEXT_CONT     1   /* UTF-8 continuation byte: not a char boundary */
+#define NEXT_OTHER    2
+#define NEXT_END      3
+
+#define NODES_MAX     2048
+#define REPEAT_INF    -1
+
+struct node {
+    int type;
+    int min;
+    int max;
+    uint8_t set[32];
+    struct node *left;
+    struct node *right;
+};
+
+struct parser {
+    const char *p;
+    const char *end;
+    int error;
+    int nodes_len;
+    struct node *nodes;
+};
+
+#define set_add(s, c)   ((s)[(uint8_t) (c) >> 3] |= (1 << ((uint8_t) (c) & 7)))
+#define set_has(s, c)   ((s)[(uint8_t) (c) >> 3] & (1 << ((uint8_t) (c) & 7)))
+
+static inline int is_alnum(char c)
+{
+    return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9'));
+}
+
+static void set_range(uint8_t *set, int from, int to)
+{
+    int c;
+
+    for (c = from; c <= to; c++) {
+        set_add(set, c);
+    }
+}
+
+static struct node *node_new(struct parser *ps, int type)
+{
+    struct node *n;
+
+    if (ps->nodes_len >= NODES_MAX) {
+        ps->error = FLB_TRUE;
+        return NULL;
+    }
+
+    n = &ps->nodes[ps->nodes_len++];
+    memset(n, '\0', sizeof(struct node));
+    n->type = type;
+    return n;
+}
+
+static struct node *node_pair(struct parser *ps, int type,
+                              struct node *left, struct node *right)
+{
+    struct node *n;
+
+    n = node_new(ps, type);
+    if (n) {
+        n->left = left;
+        n->right = right;
+    }
+    return n;
+}
+
+/* ASCII classes of \d, \w, \s and \h */
+static int class_escape(char c, uint8_t *set, int *negate)
+{
+    *negate = (c >= 'A' && c <= 'Z');
+
+    switch (c) {
+    case 'd':
+    case 'D':
+        set_range(set, '0', '9');
+        break;
+    case 'w':
+    case 'W':
+        set_range(set, '0', '9');
+        set_range(set, 'a', 'z');
+        set_range(set, 'A', 'Z');
+        set_add(set, '_');
+        break;
+    case 's':
+    case 'S':
+        set_range(set, '\t', '\r');
+        set_add(set, ' ');
+        break;
+    case 'h':
+    case 'H':
+        set_range(set, '0', '9');
+        set_range(set, 'a', 'f');
+        set_range(set, 'A', 'F');
+        break;
+    default:
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Escapes standing for a single byte */
+static int byte_escape(char c)
+{
+    switch (c) {
+    case 'n':
+        return '\n';
+    case 't':
+        return '\t';
+    case 'r':
+        return '\r';
+    case 'f':
+        return '\f';
+    case 'v':
+        return '\v';
+    case 'e':
+        return 0x1b;
+    case 'a':
+        return 0x07;
+    }
+
+    if (c != '<' && c != '>' && !is_alnum(c) && (uint8_t) c < 0x80 &&
+        c != '\0') {
+        return (uint8_t) c;
+    }
+
+    return -1;
+}
+
+/* Complement of an ASCII set: a character node */
+static struct node *char_node(struct parser *ps, uint8_t *set, int negate)
+{
+    int c;
+    struct node *n;
+
+    n = node_new(ps, NODE_CHAR);
+    if (!n) {
+        return NULL;
+    }
+
+    for (c = 0; c < 0x80; c++) {
+        if ((set_has(set, c) != 0) != (negate != 0)) {
+            set_add(n->set, c);
+        }
+    }
+    return n;
+}
+
+static struct node *parse_alt(struct parser *ps);
+
+static int parse_class_item(struct parser *ps, int *byte, uint8_t *set)
+{
+    int ret;
+    int negate;
+
+    if (ps->p >= ps->end) {
+        return -1;
+    }
+
+    if (*ps->p == '\\') {
+        if (ps->p + 1 >= ps->end) {
+            return -1;
+        }
+        ret = class_escape(ps->p[1], set, &negate);
+        if (ret == 0) {
+            /* negated classes inside a class include multibyte chars */
+            if (negate) {
+                return -1;
+            }
+            ps->p += 2;
+            *byte = -1;
+            return 0;
+        }
+        *byte = byte_escape(ps->p[1]);
+        if (*byte == -1) {
+            return -1;
+        }
+        ps->p += 2;
+        return 0;
+    }
+
+    if (*ps->p == '[' || (uint8_t) *ps->p >= 0x80 ||
+        (*ps->p == '&' && ps->p + 1 < ps->end && ps->p[1] == '&')) {
+        return -1;
+    }
+
+    *byte = (uint8_t) *ps->p++;
+    return 0;
+}
+
+/* Character class with ASCII members: [abc], [^a-z], [\d_] */
+static struct node *parse_class(struct parser *ps)
+{
+    int ret;
+    int negate = FLB_FALSE;
+    int from;
+    int to;
+    uint8_t set[32] = {0};
+    struct node *n;
+
+    ps->p++;
+    if (ps->p < ps->end && *ps->p == '^') {
+        negate = FLB_TRUE;
+        ps->p++;
+    }
+
+    if (ps->p >= ps->end || *ps->p == ']') {
+        ps->error = FLB_TRUE;
+        return NULL;
+    }
+
+    while (ps->p < ps->end && *ps->p != ']') {
+        ret = parse_class_item(ps, &from, set);
+        if (ret == -1) {
+            ps->error = FLB_TRUE;
+            return NULL;
+        }
+        if (from == -1) {
+            continue;
+        }
+
+        /* range */
+        if (ps->p + 1 < ps->end && *ps->p == '-' && ps->p[1] != ']') {
+            ps->p++;
+            ret = parse_class_item(ps, &to, set);
+            if (ret == -1 || to == -1 || to < from) {
+                ps->error = FLB_TRUE;
+                return NULL;
+            }
+            set_range(set, from, to);
+        }
+        else {
+            set_add(set, from);
+        }
+    }
+
+    if (ps->p >= ps->end) {
+        ps->error = FLB_TRUE;
+        return NULL;
+    }
+    ps->p++;
+
+    if (negate) {
+        return char_node(ps, set, FLB_TRUE);
+    }
+
+    /* a plain set of bytes */
+    n = node_new(ps, NODE_BYTE);
+    if (n) {
+        memcpy(n->set, set, 32);
+    }
+    return n;
+}
+
+static struct node *byte_node(struct parser *ps, int c)
+{
+    struct node *n;
+
+    n = node_new(ps, NODE_BYTE);
+    if (n) {
+        set_add(n->set, c);
+    }
+    return n;
+}
+
+static struct node *assert_node(struct parser *ps, int kind)
+{
+    struct node *n;
+
+    n = node_new(ps, NODE_ASSERT);
+    if (n) {
+        n->min = kind;
+    }
+    return n;
+}
+
+static struct node *parse_atom(struct parser *ps)
+{
+    int c;
+    int len;
+    int ret;
+    int negate;
+    uint8_t set[32] = {0};
+    struct node *n;
+
+    c = (uint8_t) *ps->p;
+
+    switch (c) {
+    case '(':
+        ps->p++;
+        if (ps->p < ps->end && *ps->p == '?') {
+            /* only non capturing and named groups */
+            if (ps->p + 1 < ps->end && ps->p[1] == ':') {
+                ps->p += 2;
+            }
+            else if (ps->p + 2 < ps->end && ps->p[1] == '<' &&
+                     (is_alnum(ps->p[2]) || ps->p[2] == '_')) {
+                ps->p += 2;
+                while (ps->p < ps->end && *ps->p != '>') {
+                    ps->p++;
+                }
+                ps->p++;
+            }
+            else {
+                ps->error = FLB_TRUE;
+                return NULL;
+            }
+        }
+        n = parse_alt(ps);
+        if (!n || ps->p >= ps->end || *ps->p != ')') {
+            ps->error = FLB_TRUE;
+            return NULL;
+        }
+        ps->p++;
+        return n;
+    case '[':
+        return parse_class(ps);
+    case '.':
+        ps->p++;
+        set_add(set, '\n');
+        return char_node(ps, set, FLB_TRUE);
+    case '^':
+        ps->p++;
+        return assert_node(ps, ASSERT_BOL);
+    case '$':
+        ps->p++;
+        return assert_node(ps, ASSERT_EOL);
+    case '\\':
+        if (ps->p + 1 >= ps->end) {
+            ps->error = FLB_TRUE;
+            return NULL;
+        }
+        c = ps->p[1];
+        ps->p += 2;
+        if (c == 'A') {
+            return assert_node(ps, ASSERT_BOS);
+        }
+        else if (c == 'z') {
+            return assert_node(ps, ASSERT_EOS);
+        }
+
+        ret = class_escape(c, set, &negate);
+        if (ret == 0) {
+            if (negate) {
+                return char_node(ps, set, FLB_TRUE);
+            }
+            n = node_new(ps, NODE_BYTE);
+            if (n) {
+                memcpy(n->set, set, 32);
+            }
+            return n;
+        }
+
+        c = byte_escape(c);
+        if (c == -1) {
+            ps->error = FLB_TRUE;
+            return NULL;
+        }
+        return byte_node(ps, c);
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+    case '}':
+    case ']':
+    case ')':
+    case '|':
+        ps->error = FLB_TRUE;
+        return NULL;
+    }
+
+    /* literal character, multibyte characters are a sequence of bytes */
+    if (c < 0x80) {
+        len = 1;
+    }
+    else if (c >= 0xc2 && c <= 0xdf) {
+        len = 2;
+    }
+    else if (c >= 0xe0 && c <= 0xef) {
+        len = 3;
+    }
+    else if (c >= 0xf0 && c <= 0xf4) {
+        len = 4;
+    }
+    else {
+        ps->error = FLB_TRUE;
+        return NULL;
+    }
+
+    if (ps->end - ps->p < len) {
+        ps->error = FLB_TRUE;
+        return NULL;
+    }
+
+    n = byte_node(ps, (uint8_t) *ps->p++);
+    while (n && --len > 0) {
+        n = node_pair(ps, NODE_CAT, n, byte_node(ps, (uint8_t) *ps->p++));
+    }
+    return n;
+}
+
+static int parse_number(struct parser *ps, int *val)
+{
+    int n = 0;
+    int digits = 0;
+
+    while (ps->p < ps->end && *ps->p >= '0' && *ps->p <= '9') {
+        n = (n * 10) + (*ps->p++ - '0');
+        if (n > FLB_REGEX_DFA_REPEAT_MAX) {
+            return -1;
+        }
+        digits++;
+    }
+
+    *val = n;
+    return digits;
+}
+
+/* Counted repetition: {n}, {n,}, {,m}, {n,m} */
+static int parse_counted(struct parser *ps, int *min, int *max)
+{
+    int ret;
+
+    ps->p++;
+    ret = parse_number(ps, min);
+    if (ret == -1) {
+        return -1;
+    }
+
+    if (ps->p < ps->end && *ps->p == ',') {
+        ps->p++;
+        if (parse_number(ps, max) <= 0) {
+            if (ret == 0) {
+                return -1;
+            }
+            *max = REPEAT_INF;
+        }
+    }
+    else if (ret == 0) {
+        return -1;
+    }
+    else {
+        *max = *min;
+    }
+
+    if (ps->p >= ps->end || *ps->p != '}') {
+        return -1;
+    }
+    ps->p++;
+
+    if (*max != REPEAT_INF && *max < *min) {
+        return -1;
+    }
+    return 0;
+}
+
+static struct node *parse_repeat(struct parser *ps)
+{
+    int min;
+    int max;
+    struct node *n;
+    struct node *r;
+
+    n = parse_atom(ps);
+
+    while (n && ps->p < ps->end) {
+        if (*ps->p == '*') {
+            min = 0;
+            max = REPEAT_INF;
+            ps->p++;
+        }
+        else if (*ps->p == '+') {
+            min = 1;
+            max = REPEAT_INF;
+            ps->p++;
+        }
+        else if (*ps->p == '?') {
+            min = 0;
+            max = 1;
+            ps->p++;
+        }
+        else if (*ps->p == '{') {
+            if (parse_counted(ps, &min, &max) == -1) {
+                ps->error = FLB_TRUE;
+                return NULL;
+            }
+        }
+        else {
+            break;
+        }
+
+        /* lazy quantifiers match the same strings, possessive ones don't */
+        if (ps->p < ps->end && *ps->p == '?') {
+            ps->p++;
+        }
+        else if (ps->p < ps->end && *ps->p == '+') {
+            ps->error = FLB_TRUE;
+            return NULL;
+        }
+
+        r = node_pair(ps, NODE_REPEAT, n, NULL);
+        if (r) {
+            r->min = min;
+            r->max = max;
+        }
+        n = r;
+    }
+
+    return n;
+}
+
+static struct node *parse_cat(struct parser *ps)
+{
+    struct node *n = NULL;
+    struct node *r;
+
+    while (ps->p < ps->end && *ps->p != '|' && *ps->p != ')') {
+        r = parse_repeat(ps);
+        if (!r) {
+            return NULL;
+        }
+        n = n ? node_pair(ps, NODE_CAT, n, r) : r;
+        if (!n) {
+            return NULL;
+        }
+    }
+
+    return n ? n : node_new(ps, NODE_EMPTY);
+}
+
+static struct node *parse_alt(struct parser *ps)
+{
+    struct node *n;
+    struct node *r;
+
+    n = parse_cat(ps);
+    while (n && ps->p < ps->end && *ps->p == '|') {
+        ps->p++;
+        r = parse_cat(ps);
+        if (!r) {
+            return NULL;
+        }
+        n = node_pair(ps, NODE_ALT, n, r);
+    }
+
+    return n;
+}
+
+/* Parse a pattern, the optional slashes are removed like flb_regex_create() */
+static struct node *parse(struct parser *ps, const char *pattern)
+{
+    int len;
+    struct node *n;
+
+    len = strlen(pattern);
+    ps->p = pattern;
+    ps->end = pattern + len;
+    ps->error = FLB_FALSE;
+
+    if (len > 0 && pattern[0] == '/' && pattern[len - 1] == '/') {
+        ps->p++;
+        ps->end--;
+    }
+
+    n = parse_alt(ps);
+    if (!n || ps->error || ps->p != ps->end) {
+        return NULL;
+    }
+    return n;
+}
+
+static int nfa_new(struct flb_regex_dfa *dfa, int type, int out, int out1)
+{
+    struct flb_regex_dfa_nfa *s;
+
+    if (dfa->nfa_len >= FLB_REGEX_DFA_NFA_MAX) {
+        return -1;
+    }
+
+    s = &dfa->nfa[dfa->nfa_len];
+    memset(s, '\0', sizeof(struct flb_regex_dfa_nfa));
+    s->type = type;
+    s->out = out;
+    s->out1 = out1;
+    return dfa->nfa_len++;
+}
+
+static int nfa_byte(struct flb_regex_dfa *dfa, uint8_t *set, int out)
+{
+    int s;
+
+    s = nfa_new(dfa, NFA_BYTE, out, -1);
+    if (s >= 0) {
+        memcpy(dfa->nfa[s].set, set, 32);
+    }
+    return s;
+}
+
+/*
+ * One character like Onigmo reads it: the length comes from the first
+ * byte of the sequence, bytes that cannot start a sequence count as one
+ * character.
+ */
+static int nfa_char(struct flb_regex_dfa *dfa, uint8_t *ascii, int out)
+{
+    int i;
+    int s;
+    int t;
+    int entry;
+    uint8_t set[32];
+    uint8_t any[32];
+
+    memset(any, 0xff, 32);
+
+    /* single byte */
+    memcpy(set, ascii, 32);
+    set_range(set, 0x80, 0xbf);
+    set_range(set, 0xf8, 0xff);
+    entry = nfa_byte(dfa, set, out);
+
+    /* 2, 3 and 4 bytes sequences */
+    for (i = 1; i <= 3 && entry >= 0; i++) {
+        t = out;
+        for (s = 0; s < i && t >= 0; s++) {
+            t = nfa_byte(dfa, any, t);
+        }
+        if (t < 0) {
+            return -1;
+        }
+
+        memset(set, '\0', 32);
+        if (i == 1) {
+            set_range(set, 0xc0, 0xdf);
+        }
+        else if (i == 2) {
+            set_range(set, 0xe0, 0xef);
+        }
+        else {
+            set_range(set, 0xf0, 0xf7);
+        }
+        t = nfa_byte(dfa, set, t);
+        if (t < 0) {
+            return -1;
+        }
+        entry = nfa_new(dfa, NFA_SPLIT, entry, t);
+    }
+
+    return entry;
+}
+
+/* Compile a node, 'out' is the state following it. Returns the entry */
+static int nfa_compile(struct flb_regex_dfa *dfa, struct node *n, int out)
+{
+    int i;
+    int s;
+    int t;
+    int left;
+
+    if (out < 0) {
+        return -1;
+    }
+
+    switch (n->type) {
+    case NODE_EMPTY:
+        return out;
+    case NODE_BYTE:
+        return nfa_byte(dfa, n->set, out);
+    case NODE_CHAR:
+        return nfa_char(dfa, n->set, out);
+    case NODE_CAT:
+        return nfa_compile(dfa, n->left, nfa_compile(dfa, n->right, out));
+    case NODE_ALT:
+        left = nfa_compile(dfa, n->left, out);
+        return nfa_new(dfa, NFA_SPLIT, left, nfa_compile(dfa, n->right, out));
+    case NODE_ASSERT:
+        return nfa_new(dfa, NFA_ASSERT, out, n->min);
+    case NODE_REPEAT:
+        t = out;
+        if (n->max == REPEAT_INF) {
+            /* loop: split to the node or to the exit */
+            s = nfa_new(dfa, NFA_SPLIT, -1, out);
+            if (s < 0) {
+                return -1;
+            }
+            dfa->nfa[s].out = nfa_compile(dfa, n->left, s);
+            if (dfa->nfa[s].out < 0) {
+                return -1;
+            }
+            t = s;
+        }
+        else {
+            /* optional copies */
+            for (i = n->min; i < n->max && t >= 0; i++) {
+                t = nfa_new(dfa, NFA_SPLIT,
+                            nfa_compile(dfa, n->left, t), out);
+            }
+        }
+
+        /* mandatory copies */
+        for (i = 0; i < n->min && t >= 0; i++) {
+            t = nfa_compile(dfa, n->left, t);
+        }
+        return t;
+    }
+
+    return -1;
+}
+
+/* Check if the engine supports a pattern */
+int flb_regex_dfa_check(const char *pattern)
+{
+    struct node *n;
+    struct parser ps = {0};
+
+    ps.nodes = flb_malloc(sizeof(struct node) * NODES_MAX);
+    if (!ps.nodes) {
+        flb_errno();
+        return -1;
+    }
+
+    n = parse(&ps, pattern);
+    flb_free(ps.nodes);
+
+    return n ? 0 : -1;
+}
+
+static void cache_clear(struct flb_regex_dfa *dfa)
+{
+    int i;
+
+    for (i = 0; i < dfa->states_len; i++) {
+        flb_free(dfa->states[i]->core);
+        flb_free(dfa->states[i]->matched);
+        flb_free(dfa->states[i]);
+    }
+    dfa->states_len = 0;
+    memset(dfa->table, -1, sizeof(int) * dfa->table_size);
+}
+
+/* Compile a set of patterns, returns NULL if one is not supported */
+struct flb_regex_dfa *flb_regex_dfa_create(const char **patterns, int count)
+{
+    int i;
+    int s;
+    int start = -1;
+    struct node *n;
+    struct parser ps = {0};
+    struct flb_regex_dfa *dfa;
+
+    dfa = flb_calloc(1, sizeof(struct flb_regex_dfa));
+    if (!dfa) {
+        flb_errno();
+        return NULL;
+    }
+    dfa->patterns = count;
+
+    dfa->nfa = flb_malloc(sizeof(struct flb_regex_dfa_nfa) *
+                          FLB_REGEX_DFA_NFA_MAX);
+    ps.nodes = flb_malloc(sizeof(struct node) * NODES_MAX);
+    if (!dfa->nfa || !ps.nodes) {
+        flb_errno();
+        flb_free(ps.nodes);
+        flb_free(dfa->nfa);
+        flb_free(dfa);
+        return NULL;
+    }
+
+    /* every pattern ends in its own match state */
+    for (i = 0; i < count; i++) {
+        ps.nodes_len = 0;
+        n = parse(&ps, patterns[i]);
+        if (!n) {
+            break;
+        }
+
+        s = nfa_compile(dfa, n, nfa_new(dfa, NFA_MATCH, -1, i));
+        if (s < 0) {
+            break;
+        }
+
+        start = (start == -1) ? s : nfa_new(dfa, NFA_SPLIT, start, s);
+        if (start < 0) {
+            break;
+        }
+    }
+    flb_free(ps.nodes);
+
+    if (i < count || count == 0) {
+        flb_free(dfa->nfa);
+        flb_free(dfa);
+        return NULL;
+    }
+    dfa->start = start;
+
+    dfa->table_size = FLB_REGEX_DFA_STATES_MAX * 2;
+    dfa->table = flb_malloc(sizeof(int) * dfa->table_size);
+    dfa->states = flb_malloc(sizeof(struct flb_regex_dfa_state *) *
+                             FLB_REGEX_DFA_STATES_MAX);
+    /* every state visited pushes at most two more */
+    dfa->stack = flb_malloc(sizeof(int) * (dfa->nfa_len * 3 + 1));
+    dfa->list = flb_malloc(sizeof(int) * dfa->nfa_len);
+    dfa->mark = flb_calloc(dfa->nfa_len, sizeof(int));
+    if (!dfa->table || !dfa->states || !dfa->stack || !dfa->list ||
+        !dfa->mark) {
+        flb_errno();
+        flb_regex_dfa_destroy(dfa);
+        return NULL;
+    }
+    memset(dfa->table, -1, sizeof(int) * dfa->table_size);
+    pthread_mutex_init(&dfa->lock, NULL);
+
+    return dfa;
+}
+
+void flb_regex_dfa_destroy(struct flb_regex_dfa *dfa)
+{
+    if (dfa->states) {
+        cache_clear(dfa);
+        pthread_mutex_destroy(&dfa->lock);
+    }
+    flb_free(dfa->states);
+    flb_free(dfa->table);
+    flb_free(dfa->stack);
+    flb_free(dfa->list);
+    flb_free(dfa->mark);
+    flb_free(dfa->nfa);
+    flb_free(dfa);
+}
+
+static inline int assert_true(int kind, int prev, int next)
+{
+    switch (kind) {
+    case ASSERT_BOL:
+        /* like Onigmo, not after a new line ending the string */
+        return (prev == PREV_START || (prev == PREV_NL && next != NEXT_END));
+    case ASSERT_EOL:
+        return (next == NEXT_END || next == NEXT_NL);
+    case ASSERT_BOS:
+        return (prev == PREV_START);
+    case ASSERT_EOS:
+        return (next == NEXT_END);
+    }
+    return FLB_FALSE;
+}
+
+/*
+ * Follow the empty transitions of the state core in the given context.
+ * The byte states are written to 'list' and the patterns reaching their
+ * match state to 'matched' (if set). Returns the number of byte states.
+ */
+static int closure(struct flb_regex_dfa *dfa, struct flb_regex_dfa_state *st,
+                   int next, char *matched, int *accept)
+{
+    int i;
+    int s;
+    int top = 0;
+    int len = 0;
+    struct flb_regex_dfa_nfa *ns;
+
+    dfa->gen++;
+    *accept = FLB_FALSE;
+
+    for (i = st->core_len - 1; i >= 0; i--) {
+        dfa->stack[top++] = st->core[i];
+    }
+
+    /* a new match can start on every character boundary */
+    if (next != NEXT_CONT) {
+        dfa->stack[top++] = dfa->start;
+    }
+
+    while (top > 0) {
+        s = dfa->stack[--top];
+        if (dfa->mark[s] == dfa->gen) {
+            continue;
+        }
+        dfa->mark[s] = dfa->gen;
+        ns = &dfa->nfa[s];
+
+        switch (ns->type) {
+        case NFA_BYTE:
+            dfa->list[len++] = s;
+            break;
+        case NFA_SPLIT:
+            dfa->stack[top++] = ns->out1;
+            dfa->stack[top++] = ns->out;
+            break;
+        case NFA_ASSERT:
+            if (assert_true(ns->out1, st->prev, next)) {
+                dfa->stack[top++] = ns->out;
+            }
+            break;
+        case NFA_MATCH:
+            *accept = FLB_TRUE;
+            if (matched) {
+                matched[ns->out1] = 1;
+            }
+            break;
+        }
+    }
+
+    return len;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+static uint32_t state_hash(int prev, int *core, int len)
+{
+    int i;
+    uint32_t h = 2166136261u ^ (uint32_t) prev;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ (uint32_t) core[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* Find or create the state of a sorted core, -1 if the cache is full */
+static int state_get(struct flb_regex_dfa *dfa, int prev, int *core, int len)
+{
+    int c;
+    int i;
+    int id;
+    int accept;
+    uint32_t h;
+    struct flb_regex_dfa_state *st;
+
+    h = state_hash(prev, core, len);
+    i = h % dfa->table_size;
+
+    while ((id = dfa->table[i]) != -1) {
+        st = dfa->states[id];
+        if (st->hash == h && st->prev == prev && st->core_len == len &&
+            memcmp(st->core, core, sizeof(int) * len) == 0) {
+            return id;
+        }
+        i = (i + 1) % dfa->table_size;
+    }
+
+    if (dfa->states_len >= FLB_REGEX_DFA_STATES_MAX) {
+        return -1;
+    }
+
+    st = flb_calloc(1, sizeof(struct flb_regex_dfa_state));
+    if (!st) {
+        flb_errno();
+        return -1;
+    }
+    st->core = flb_malloc(sizeof(int) * (len + 1));
+    st->matched = flb_calloc(4, dfa->patterns);
+    if (!st->core || !st->matched) {
+        flb_errno();
+        flb_free(st->core);
+        flb_free(st->matched);
+        flb_free(st);
+        return -1;
+    }
+
+    memcpy(st->core, core, sizeof(int) * len);
+    st->core_len = len;
+    st->prev = prev;
+    st->hash = h;
+    for (c = 0; c < 256; c++) {
+        st->next[c] = -1;
+    }
+
+    /* patterns matching before the next byte, for each class of byte */
+    for (id = 0; id < 4; id++) {
+        closure(dfa, st, id, st->matched + (id * dfa->patterns), &accept);
+        st->accept[id] = accept;
+    }
+
+    id = dfa->states_len++;
+    dfa->states[id] = st;
+    dfa->table[i] = id;
+
+    return id;
+}
+
+static inline int next_class(uint8_t c)
+{
+    if (c == '\n') {
+        return NEXT_NL;
+    }
+    else if (c >= 0x80 && c <= 0xbf) {
+        return NEXT_CONT;
+    }
+    return NEXT_OTHER;
+}
+
+/* Compute the transition of a state on a byte */
+static int transition(struct flb_regex_dfa *dfa, int id, uint8_t c)
+{
+    int i;
+    int n;
+    int len = 0;
+    int accept;
+    int ret;
+    int *core;
+    struct flb_regex_dfa_state *st = dfa->states[id];
+
+    n = closure(dfa, st, next_class(c), NULL, &accept);
+
+    /* states reached after the byte, 'stack' is free after the closure */
+    core = dfa->stack;
+    for (i = 0; i < n; i++) {
+        if (set_has(dfa->nfa[dfa->list[i]].set, c)) {
+            core[len++] = dfa->nfa[dfa->list[i]].out;
+        }
+    }
+    qsort(core, len, sizeof(int), cmp_int);
+
+    /* remove duplicates */
+    n = 0;
+    for (i = 0; i < len; i++) {
+        if (n == 0 || core[n - 1] != core[i]) {
+            core[n++] = core[i];
+        }
+    }
+
+    ret = state_get(dfa, (c == '\n') ? PREV_NL : PREV_OTHER, core, n);
+    if (ret >= 0) {
+        /* the table of states may have been reallocated */
+        dfa->states[id]->next[c] = ret;
+    }
+    return ret;
+}
+
+/*
+ * Search the patterns in a string. If 'matched' is set it receives one flag
+ * per pattern, otherwise the search stops on the first match. Returns the
+ * number of patterns matched or -1 if the string could not be processed
+ * (state cache full or busy): the caller must use another engine.
+ */
+int flb_regex_dfa_exec(struct flb_regex_dfa *dfa, const char *str, size_t len,
+                       char *matched)
+{
+    int i;
+    int id;
+    int next;
+    int cls;
+    int found = 0;
+    const uint8_t *p = (const uint8_t *) str;
+    const uint8_t *end = p + len;
+    struct flb_regex_dfa_state *st;
+
+    if (pthread_mutex_trylock(&dfa->lock) != 0) {
+        return -1;
+    }
+
+    if (matched) {
+        memset(matched, '\0', dfa->patterns);
+    }
+
+    id = state_get(dfa, PREV_START, NULL, 0);
+    if (id == -1) {
+        cache_clear(dfa);
+        pthread_mutex_unlock(&dfa->lock);
+        return -1;
+    }
+    st = dfa->states[id];
+
+    while (1) {
+        cls = (p < end) ? next_class(*p) : NEXT_END;
+
+        if (st->accept[cls]) {
+            if (!matched) {
+                found = 1;
+                break;
+            }
+            for (i = 0; i < dfa->patterns; i++) {
+                if (st->matched[(cls * dfa->patterns) + i] && !matched[i]) {
+                    matched[i] = 1;
+                    found++;
+                }
+            }
+            if (found == dfa->patterns) {
+                break;
+            }
+        }
+
+        if (p >= end) {
+            break;
+        }
+
+        next = st->next[*p];
+        if (next == -1) {
+            next = transition(dfa, id, *p);
+            if (next == -1) {
+                /* too many states: start again with an empty cache */
+                cache_clear(dfa);
+                pthread_mutex_unlock(&dfa->lock);
+                return -1;
+            }
+        }
+        id = next;
+        st = dfa->states[id];
+        p++;
+    }
+
+    pthread_mutex_unlock(&dfa->lock);
+    return found;
+}
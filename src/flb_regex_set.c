@@ -0,0 +1,712 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_str.h>
+#include <fluent-bit/flb_regex.h>
+#include <fluent-bit/flb_regex_set.h>
+
+#define ENTRIES_SIZE  8
+
+/* Characters with a special meaning in the Ruby syntax */
+static inline int is_meta(char c)
+{
+    return (strchr(".^$|()[]{}*+?\\", c) != NULL && c != '\0');
+}
+
+static inline int is_alnum(char c)
+{
+    return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9'));
+}
+
+/* Escaped character that stands for itself */
+static inline int is_escaped_literal(char c)
+{
+    return (c != '\0' && c != '<' && c != '>' && !is_alnum(c) &&
+            (unsigned char) c < 0x80);
+}
+
+/* Escape sequences without arguments matching something else than itself */
+static inline int is_simple_escape(char c)
+{
+    return (strchr("dDwWsShHbBAzZGntrfvea", c) != NULL && c != '\0');
+}
+
+/* Pattern content without the optional slashes, like flb_regex_create() */
+static void pattern_bounds(const char *pattern, const char **start,
+                           const char **end)
+{
+    int len;
+
+    len = strlen(pattern);
+    *start = pattern;
+    *end = pattern + len;
+
+    if (len > 0 && pattern[0] == '/' && pattern[len - 1] == '/') {
+        (*start)++;
+        (*end)--;
+    }
+}
+
+/*
+ * Check if a pattern is a plain string, optionally starting with '^' and/or
+ * ending with '$'. The unescaped string is written to 'buf'.
+ */
+static int pattern_literal(const char *start, const char *end, char *buf,
+                           int *len, int *anchor_start, int *anchor_end)
+{
+    int n = 0;
+    const char *p = start;
+
+    *anchor_start = FLB_FALSE;
+    *anchor_end = FLB_FALSE;
+
+    if (p < end && *p == '^') {
+        *anchor_start = FLB_TRUE;
+        p++;
+    }
+
+    while (p < end) {
+        if (*p == '\\') {
+            if (p + 1 >= end || !is_escaped_literal(p[1])) {
+                return -1;
+            }
+            buf[n++] = p[1];
+            p += 2;
+            continue;
+        }
+        else if (*p == '$' && p + 1 == end) {
+            *anchor_end = FLB_TRUE;
+            p++;
+            continue;
+        }
+        else if (is_meta(*p)) {
+            return -1;
+        }
+        buf[n++] = *p++;
+    }
+
+    /* an empty line is better handled by the regex engine */
+    if (n == 0 && (*anchor_start || *anchor_end)) {
+        return -1;
+    }
+
+    *len = n;
+    return 0;
+}
+
+/* Skip a character class, 'p' points to the opening bracket */
+static const char *skip_class(const char *p, const char *end)
+{
+    int depth = 1;
+
+    p++;
+    if (p < end && *p == '^') {
+        p++;
+    }
+    /* a closing bracket at the beginning is part of the class */
+    if (p < end && *p == ']') {
+        p++;
+    }
+
+    while (p < end) {
+        if (*p == '\\') {
+            p += 2;
+            continue;
+        }
+        if (*p == '[') {
+            depth++;
+        }
+        else if (*p == ']') {
+            depth--;
+            if (depth == 0) {
+                return p + 1;
+            }
+        }
+        p++;
+    }
+
+    return NULL;
+}
+
+/* Skip a group, 'p' points to the opening parenthesis */
+static const char *skip_group(const char *p, const char *end)
+{
+    int depth = 0;
+
+    while (p && p < end) {
+        if (*p == '\\') {
+            p += 2;
+            continue;
+        }
+        if (*p == '[') {
+            p = skip_class(p, end);
+            continue;
+        }
+        if (*p == '(') {
+            depth++;
+        }
+        else if (*p == ')') {
+            depth--;
+            if (depth == 0) {
+                return p + 1;
+            }
+        }
+        p++;
+    }
+
+    return NULL;
+}
+
+/* Skip a quantifier if present, set 'optional' if it allows zero times */
+static const char *skip_quantifier(const char *p, const char *end,
+                                   int *quantified, int *optional)
+{
+    *quantified = FLB_FALSE;
+    *optional = FLB_FALSE;
+
+    while (p < end) {
+        if (*p == '?' || *p == '*') {
+            *optional = FLB_TRUE;
+        }
+        else if (*p == '{') {
+            *optional = FLB_TRUE;
+            while (p < end && *p != '}') {
+                p++;
+            }
+        }
+        else if (*p != '+') {
+            break;
+        }
+        *quantified = FLB_TRUE;
+        p++;
+    }
+
+    return p;
+}
+
+/*
+ * Find the longest string that any match of the pattern must contain. The
+ * analysis is conservative: alternations, inline options and escapes with
+ * arguments disable it, groups and classes just split the literals.
+ */
+static int pattern_required(const char *start, const char *end, char *buf,
+                            int *len)
+{
+    int n = 0;
+    int best = 0;
+    int atom;
+    int quantified;
+    int optional;
+    const char *p = start;
+    char *run = buf + (end - start);
+
+    /* alternations and inline options */
+    for (p = start; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        }
+        else if (*p == '|') {
+            return -1;
+        }
+        else if (*p == '(' && p + 2 < end && p[1] == '?' &&
+                 (is_alnum(p[2]) || p[2] == '-')) {
+            return -1;
+        }
+    }
+
+    p = start;
+    while (p < end) {
+        atom = n;
+
+        if (*p == '(' || *p == '[') {
+            p = (*p == '(') ? skip_group(p, end) : skip_class(p, end);
+            if (!p) {
+                return -1;
+            }
+            atom = -1;
+        }
+        else if (*p == '\\') {
+            if (p + 1 >= end) {
+                return -1;
+            }
+            if (is_escaped_literal(p[1])) {
+                run[n++] = p[1];
+            }
+            else if (is_simple_escape(p[1])) {
+                atom = -1;
+            }
+            else {
+                return -1;
+            }
+            p += 2;
+        }
+        else if (is_meta(*p)) {
+            p++;
+            atom = -1;
+        }
+        else {
+            /* a full UTF-8 character is a single atom */
+            run[n++] = *p++;
+            while (p < end && ((unsigned char) *p & 0xc0) == 0x80) {
+                run[n++] = *p++;
+            }
+        }
+
+        p = skip_quantifier(p, end, &quantified, &optional);
+        if (atom >= 0 && optional) {
+            n = atom;
+        }
+
+        if (atom == -1 || quantified) {
+            if (n > best) {
+                memcpy(buf, run, n);
+                best = n;
+            }
+            n = 0;
+        }
+    }
+
+    if (n > best) {
+        memcpy(buf, run, n);
+        best = n;
+    }
+
+    if (best == 0) {
+        return -1;
+    }
+
+    *len = best;
+    return 0;
+}
+
+static int literal_add(struct flb_regex_set *set, const char *lit, int len)
+{
+    int i;
+    char **lits;
+    int *lits_len;
+
+    for (i = 0; i < set->lits_count; i++) {
+        if (set->lits_len[i] == len && memcmp(set->lits[i], lit, len) == 0) {
+            return i;
+        }
+    }
+
+    lits = flb_realloc(set->lits, sizeof(char *) * (set->lits_count + 1));
+    if (!lits) {
+        flb_errno();
+        return -1;
+    }
+    set->lits = lits;
+
+    lits_len = flb_realloc(set->lits_len, sizeof(int) * (set->lits_count + 1));
+    if (!lits_len) {
+        flb_errno();
+        return -1;
+    }
+    set->lits_len = lits_len;
+
+    set->lits[set->lits_count] = flb_malloc(len);
+    if (!set->lits[set->lits_count]) {
+        flb_errno();
+        return -1;
+    }
+    memcpy(set->lits[set->lits_count], lit, len);
+    set->lits_len[set->lits_count] = len;
+
+    return set->lits_count++;
+}
+
+struct flb_regex_set *flb_regex_set_create()
+{
+    struct flb_regex_set *set;
+
+    set = flb_calloc(1, sizeof(struct flb_regex_set));
+    if (!set) {
+        flb_errno();
+        return NULL;
+    }
+
+    set->entries = flb_malloc(sizeof(struct flb_regex_set_entry) *
+                              ENTRIES_SIZE);
+    if (!set->entries) {
+        flb_errno();
+        flb_free(set);
+        return NULL;
+    }
+    set->size = ENTRIES_SIZE;
+
+    return set;
+}
+
+void flb_regex_set_destroy(struct flb_regex_set *set)
+{
+    int i;
+
+    for (i = 0; i < set->count; i++) {
+        flb_free(set->entries[i].pattern);
+    }
+    for (i = 0; i < set->lits_count; i++) {
+        flb_free(set->lits[i]);
+    }
+    if (set->dfa) {
+        flb_regex_dfa_destroy(set->dfa);
+    }
+    flb_free(set->dfa_matched);
+    flb_free(set->lits);
+    flb_free(set->lits_len);
+    flb_free(set->found);
+    flb_free(set->delta);
+    flb_free(set->out_lit);
+    flb_free(set->out_link);
+    flb_free(set->entries);
+    flb_free(set);
+}
+
+/*
+ * Register a pattern and its compiled regex, returns the pattern id. The
+ * regex is still owned by the caller.
+ */
+int flb_regex_set_add(struct flb_regex_set *set,
+                      const char *pattern, struct flb_regex *regex)
+{
+    int ret;
+    int len = 0;
+    int new_size;
+    char *buf;
+    const char *start;
+    const char *end;
+    struct flb_regex_set_entry *tmp;
+    struct flb_regex_set_entry *e;
+
+    if (set->count == set->size) {
+        new_size = set->size * 2;
+        tmp = flb_realloc(set->entries,
+                          sizeof(struct flb_regex_set_entry) * new_size);
+        if (!tmp) {
+            flb_errno();
+            return -1;
+        }
+        set->entries = tmp;
+        set->size = new_size;
+    }
+
+    pattern_bounds(pattern, &start, &end);
+
+    /* room for the literal and the current run of the analysis */
+    buf = flb_malloc(((end - start) * 2) + 1);
+    if (!buf) {
+        flb_errno();
+        return -1;
+    }
+
+    e = &set->entries[set->count];
+    e->regex = regex;
+    e->lit_id = -1;
+    e->dfa_id = -1;
+    e->pattern = NULL;
+
+    ret = pattern_literal(start, end, buf, &len,
+                          &e->anchor_start, &e->anchor_end);
+    if (ret == 0) {
+        e->type = FLB_REGEX_SET_LITERAL;
+    }
+    else {
+        e->type = FLB_REGEX_SET_REGEX;
+        e->anchor_start = FLB_FALSE;
+        e->anchor_end = FLB_FALSE;
+        ret = pattern_required(start, end, buf, &len);
+        if (ret == -1) {
+            len = 0;
+        }
+
+        if (flb_regex_dfa_check(pattern) == 0) {
+            e->pattern = flb_strdup(pattern);
+        }
+    }
+
+    if (len > 0) {
+        e->lit_id = literal_add(set, buf, len);
+        if (e->lit_id == -1) {
+            flb_free(buf);
+            return -1;
+        }
+    }
+    flb_free(buf);
+
+    return set->count++;
+}
+
+/* Build a single DFA for all the regex patterns it supports */
+static int compile_dfa(struct flb_regex_set *set)
+{
+    int i;
+    int n = 0;
+    const char **patterns;
+    struct flb_regex_set_entry *e;
+
+    patterns = flb_malloc(sizeof(char *) * (set->count + 1));
+    if (!patterns) {
+        flb_errno();
+        return -1;
+    }
+
+    for (i = 0; i < set->count; i++) {
+        e = &set->entries[i];
+        if (e->pattern) {
+            e->dfa_id = n;
+            patterns[n++] = e->pattern;
+        }
+    }
+
+    if (n > 0) {
+        set->dfa = flb_regex_dfa_create(patterns, n);
+        set->dfa_matched = flb_calloc(1, n);
+    }
+    flb_free(patterns);
+
+    if (n > 0 && (!set->dfa || !set->dfa_matched)) {
+        /* not fatal: the patterns are still matched by their regex */
+        flb_warn("[regex set] cannot create DFA for %i patterns", n);
+        if (set->dfa) {
+            flb_regex_dfa_destroy(set->dfa);
+            set->dfa = NULL;
+        }
+        for (i = 0; i < set->count; i++) {
+            set->entries[i].dfa_id = -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Build the Aho-Corasick automaton of all the literals */
+int flb_regex_set_compile(struct flb_regex_set *set)
+{
+    int i;
+    int j;
+    int c;
+    int s;
+    int t;
+    int f;
+    int max = 1;
+    int head = 0;
+    int tail = 0;
+    int *fail;
+    int *queue;
+    unsigned char *lit;
+
+    set->found = flb_calloc(1, set->lits_count + 1);
+    if (!set->found) {
+        flb_errno();
+        return -1;
+    }
+
+    if (compile_dfa(set) == -1) {
+        return -1;
+    }
+
+    /* one or no literal: memmem(3) is faster */
+    if (set->lits_count < 2) {
+        return 0;
+    }
+
+    for (i = 0; i < set->lits_count; i++) {
+        max += set->lits_len[i];
+    }
+    if (max > FLB_REGEX_SET_STATES_MAX) {
+        return 0;
+    }
+
+    set->delta = flb_malloc(sizeof(int32_t) * 256 * max);
+    set->out_lit = flb_malloc(sizeof(int) * max);
+    set->out_link = flb_malloc(sizeof(int) * max);
+    fail = flb_malloc(sizeof(int) * max);
+    queue = flb_malloc(sizeof(int) * max);
+    if (!set->delta || !set->out_lit || !set->out_link || !fail || !queue) {
+        flb_errno();
+        flb_free(fail);
+        flb_free(queue);
+        flb_free(set->delta);
+        flb_free(set->out_lit);
+        flb_free(set->out_link);
+        set->delta = NULL;
+        set->out_lit = NULL;
+        set->out_link = NULL;
+        return -1;
+    }
+
+    memset(set->delta, -1, sizeof(int32_t) * 256);
+    set->out_lit[0] = -1;
+    set->out_link[0] = -1;
+    set->states = 1;
+
+    /* trie */
+    for (i = 0; i < set->lits_count; i++) {
+        s = 0;
+        lit = (unsigned char *) set->lits[i];
+        for (j = 0; j < set->lits_len[i]; j++) {
+            t = set->delta[(s * 256) + lit[j]];
+            if (t == -1) {
+                t = set->states++;
+                memset(set->delta + (t * 256), -1, sizeof(int32_t) * 256);
+                set->out_lit[t] = -1;
+                set->out_link[t] = -1;
+                set->delta[(s * 256) + lit[j]] = t;
+            }
+            s = t;
+        }
+        set->out_lit[s] = i;
+    }
+
+    /* failure links turned into a complete transition table */
+    for (c = 0; c < 256; c++) {
+        t = set->delta[c];
+        if (t == -1) {
+            set->delta[c] = 0;
+        }
+        else {
+            fail[t] = 0;
+            queue[tail++] = t;
+        }
+    }
+
+    while (head < tail) {
+        s = queue[head++];
+        for (c = 0; c < 256; c++) {
+            t = set->delta[(s * 256) + c];
+            f = set->delta[(fail[s] * 256) + c];
+            if (t == -1) {
+                set->delta[(s * 256) + c] = f;
+                continue;
+            }
+
+            fail[t] = f;
+            set->out_link[t] = (set->out_lit[f] != -1) ? f : set->out_link[f];
+            queue[tail++] = t;
+        }
+    }
+
+    flb_free(fail);
+    flb_free(queue);
+    return 0;
+}
+
+/* Look for all the literals of the set in the string */
+void flb_regex_set_scan(struct flb_regex_set *set,
+                        const char *str, size_t len)
+{
+    int i;
+    int s = 0;
+    int t;
+    int ret;
+    int pending;
+    const unsigned char *p;
+    const unsigned char *end;
+
+    memset(set->found, '\0', set->lits_count);
+
+    if (set->dfa) {
+        ret = flb_regex_dfa_exec(set->dfa, str, len, set->dfa_matched);
+        set->dfa_valid = (ret >= 0);
+    }
+
+    if (!set->delta) {
+        for (i = 0; i < set->lits_count; i++) {
+            set->found[i] = (memmem(str, len,
+                                    set->lits[i], set->lits_len[i]) != NULL);
+        }
+        return;
+    }
+
+    pending = set->lits_count;
+    p = (const unsigned char *) str;
+    end = p + len;
+
+    while (p < end && pending > 0) {
+        s = set->delta[(s * 256) + *p++];
+        t = (set->out_lit[s] != -1) ? s : set->out_link[s];
+        while (t > 0) {
+            if (!set->found[set->out_lit[t]]) {
+                set->found[set->out_lit[t]] = 1;
+                pending--;
+            }
+            t = set->out_link[t];
+        }
+    }
+}
+
+/* After a scan: returns FLB_FALSE if the pattern cannot match the string */
+int flb_regex_set_candidate(struct flb_regex_set *set, int id)
+{
+    struct flb_regex_set_entry *e = &set->entries[id];
+
+    if (e->dfa_id >= 0 && set->dfa_valid) {
+        return set->dfa_matched[e->dfa_id];
+    }
+    if (e->lit_id == -1) {
+        return FLB_TRUE;
+    }
+    return set->found[e->lit_id];
+}
+
+/* After a scan: returns FLB_TRUE if the pattern matches the string */
+int flb_regex_set_match(struct flb_regex_set *set, int id,
+                        const char *str, size_t len)
+{
+    int l;
+    const char *p;
+    const char *end = str + len;
+    struct flb_regex_set_entry *e = &set->entries[id];
+
+    if (flb_regex_set_candidate(set, id) == FLB_FALSE) {
+        return FLB_FALSE;
+    }
+
+    if (e->type == FLB_REGEX_SET_REGEX) {
+        if (e->dfa_id >= 0 && set->dfa_valid) {
+            return FLB_TRUE;
+        }
+        return (flb_regex_match(e->regex, (unsigned char *) str, len) > 0);
+    }
+
+    if (e->lit_id == -1 || (!e->anchor_start && !e->anchor_end)) {
+        return FLB_TRUE;
+    }
+
+    /* anchors match at the beginning and at the end of every line */
+    l = set->lits_len[e->lit_id];
+    p = str;
+    while ((p = memmem(p, end - p, set->lits[e->lit_id], l)) != NULL) {
+        if ((!e->anchor_start || p == str || p[-1] == '\n') &&
+            (!e->anchor_end || p + l == end || p[l] == '\n')) {
+            return FLB_TRUE;
+        }
+        p++;
+    }
+
+    return FLB_FALSE;
+}
@@ -0,0 +1,263 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Lock-free ingestion ring: a bounded multi-producer single-consumer queue
+ * based on per-slot sequence numbers. A producer owns a slot once it moves
+ * 'head' with a compare-and-swap, fills it and publishes it by storing the
+ * next sequence; the consumer reads slots in order and releases them for
+ * the next lap. A full ring is reported to the producer, it never blocks.
+ *
+ * Waking up the consumer costs a write(2), that only happens when the
+ * consumer is not already signaled: while the engine drains the ring,
+ * producers just enqueue.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_compat.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_ring.h>
+
+#include <monkey/mk_core.h>
+
+#ifdef MK_HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+#ifdef _MSC_VER
+#define ring_load(ptr)          (MemoryBarrier(), *(ptr))
+#define ring_store(ptr, val)    do { MemoryBarrier(); *(ptr) = (val); } while (0)
+#define ring_cas(ptr, exp, val)                                           \
+    (InterlockedCompareExchange64((LONG64 *) (ptr), (val), *(exp)) ==     \
+     (LONG64) *(exp) ? 1 : (*(exp) = *(ptr), 0))
+#define ring_xchg(ptr, val)     InterlockedExchange((LONG *) (ptr), (val))
+#else
+#define ring_load(ptr)          __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define ring_store(ptr, val)    __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define ring_cas(ptr, exp, val)                                     \
+    __atomic_compare_exchange_n(ptr, exp, val, 1, __ATOMIC_ACQ_REL,  \
+                                __ATOMIC_RELAXED)
+#define ring_xchg(ptr, val)     __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST)
+#endif
+
+static size_t round_pow2(size_t n)
+{
+    size_t size = 2;
+
+    while (size < n) {
+        size <<= 1;
+    }
+    return size;
+}
+
+static int wakeup_create(struct flb_ring *ring)
+{
+#ifdef MK_HAVE_EVENTFD
+    int fd;
+
+    fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd == -1) {
+        flb_errno();
+        return -1;
+    }
+    ring->ch[0] = fd;
+    ring->ch[1] = fd;
+#else
+    if (flb_pipe_create(ring->ch) == -1) {
+        return -1;
+    }
+
+    /* A full pipe means a wakeup is already pending: never block on it */
+    flb_pipe_set_nonblocking(ring->ch[0]);
+    flb_pipe_set_nonblocking(ring->ch[1]);
+#endif
+
+    return 0;
+}
+
+static void wakeup_destroy(struct flb_ring *ring)
+{
+#ifdef MK_HAVE_EVENTFD
+    close(ring->ch[0]);
+#else
+    flb_pipe_destroy(ring->ch);
+#endif
+}
+
+struct flb_ring *flb_ring_create(size_t slots)
+{
+    size_t i;
+    struct flb_ring *ring;
+
+    ring = flb_calloc(1, sizeof(struct flb_ring));
+    if (!ring) {
+        flb_errno();
+        return NULL;
+    }
+
+    if (slots == 0) {
+        slots = FLB_RING_SLOTS_DEFAULT;
+    }
+    ring->slots_size = round_pow2(slots);
+    ring->mask = ring->slots_size - 1;
+
+    ring->slots = flb_malloc(sizeof(struct flb_ring_slot) * ring->slots_size);
+    if (!ring->slots) {
+        flb_errno();
+        flb_free(ring);
+        return NULL;
+    }
+
+    for (i = 0; i < ring->slots_size; i++) {
+        ring->slots[i].seq = i;
+        ring->slots[i].data = NULL;
+    }
+
+    if (wakeup_create(ring) == -1) {
+        flb_free(ring->slots);
+        flb_free(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+/* Destroy the ring and the entries not consumed yet */
+void flb_ring_destroy(struct flb_ring *ring)
+{
+    int type;
+    size_t size;
+    void *data;
+
+    while (flb_ring_pop(ring, &type, &data, &size) == FLB_RING_OK) {
+        flb_free(data);
+    }
+
+    wakeup_destroy(ring);
+    flb_free(ring->slots);
+    flb_free(ring);
+}
+
+/*
+ * Enqueue an entry, on success the ring owns 'data' (it must be allocated
+ * with flb_malloc()). Safe to be called from any thread.
+ */
+int flb_ring_push(struct flb_ring *ring, int type, void *data, size_t size)
+{
+    int ret;
+    int64_t diff;
+    uint64_t seq;
+    uint64_t pos;
+    uint64_t one = 1;
+    struct flb_ring_slot *slot;
+
+    pos = ring_load(&ring->head);
+    while (1) {
+        slot = &ring->slots[pos & ring->mask];
+        seq = ring_load(&slot->seq);
+        diff = (int64_t) seq - (int64_t) pos;
+
+        if (diff == 0) {
+            /* the slot is free for this lap, try to reserve it */
+            if (ring_cas(&ring->head, &pos, pos + 1)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            /* the consumer did not release this slot yet */
+            return FLB_RING_FULL;
+        }
+        else {
+            pos = ring_load(&ring->head);
+        }
+    }
+
+    slot->type = type;
+    slot->data = data;
+    slot->size = size;
+    ring_store(&slot->seq, pos + 1);
+
+    /* Wake up the consumer if nobody did it since it was last drained */
+    if (ring_xchg(&ring->signaled, 1) == 0) {
+#ifdef MK_HAVE_EVENTFD
+        ret = write(ring->ch[1], &one, sizeof(one));
+#else
+        ret = flb_pipe_w(ring->ch[1], &one, 1);
+#endif
+        if (ret == -1 && !FLB_PIPE_WOULDBLOCK()) {
+            flb_errno();
+        }
+    }
+
+    return FLB_RING_OK;
+}
+
+/* Dequeue the oldest entry, only the consumer thread can call it */
+int flb_ring_pop(struct flb_ring *ring, int *type, void **data, size_t *size)
+{
+    uint64_t pos;
+    struct flb_ring_slot *slot;
+
+    pos = ring->tail;
+    slot = &ring->slots[pos & ring->mask];
+    if (ring_load(&slot->seq) != pos + 1) {
+        return FLB_RING_EMPTY;
+    }
+
+    *type = slot->type;
+    *data = slot->data;
+    *size = slot->size;
+    slot->data = NULL;
+
+    /* release the slot for the next lap */
+    ring_store(&slot->seq, pos + ring->slots_size);
+    ring->tail = pos + 1;
+
+    return FLB_RING_OK;
+}
+
+/* File descriptor to be registered in the consumer event loop */
+flb_pipefd_t flb_ring_fd(struct flb_ring *ring)
+{
+    return ring->ch[0];
+}
+
+/*
+ * Acknowledge a wakeup, must be called before draining the ring so entries
+ * pushed while draining trigger a new notification.
+ */
+void flb_ring_consume_signal(struct flb_ring *ring)
+{
+    int ret;
+    char buf[64];
+
+#ifdef MK_HAVE_EVENTFD
+    ret = read(ring->ch[0], buf, sizeof(uint64_t));
+#else
+    do {
+        ret = flb_pipe_r(ring->ch[0], buf, sizeof(buf));
+    } while (ret == sizeof(buf));
+#endif
+    (void) ret;
+
+    ring_xchg(&ring->signaled, 0);
+}
@@ -24,6 +24,8 @@
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_hash.h>
+#include <fluent-bit/flb_filter.h>
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_router.h>
 
@@ -108,6 +110,325 @@ int flb_router_match(const char *tag, int tag_len, const char *match,
     return router_match(tag, tag_len, match, match_regex);
 }
 
+/* Compile a 'Match' wildcard rule */
+int flb_router_pattern_init(struct flb_router_pattern *p,
+                            const char *match, void *match_regex)
+{
+    int len;
+    int n = 0;
+    const char *s;
+    const char *end;
+    const char *star;
+
+    memset(p, '\0', sizeof(struct flb_router_pattern));
+    p->regex = match_regex;
+
+    if (!match) {
+        return 0;
+    }
+
+    len = strlen(match);
+    p->active = FLB_TRUE;
+
+    /* Without wildcards the rule is a single part that must match all */
+    star = strchr(match, '*');
+    if (!star) {
+        p->parts = flb_malloc(sizeof(flb_sds_t));
+        if (!p->parts) {
+            flb_errno();
+            return -1;
+        }
+        p->parts[0] = flb_sds_create_len(match, len);
+        if (!p->parts[0]) {
+            flb_free(p->parts);
+            p->parts = NULL;
+            return -1;
+        }
+        p->n_parts = 1;
+        p->head = FLB_TRUE;
+        p->tail = FLB_TRUE;
+        p->min_len = len;
+        return 0;
+    }
+
+    /* There are at most (len / 2) + 1 non empty parts */
+    p->parts = flb_calloc((len / 2) + 1, sizeof(flb_sds_t));
+    if (!p->parts) {
+        flb_errno();
+        return -1;
+    }
+
+    p->head = (match[0] != '*');
+    p->tail = (match[len - 1] != '*');
+
+    s = match;
+    end = match + len;
+    while (s < end) {
+        star = memchr(s, '*', end - s);
+        if (!star) {
+            star = end;
+        }
+
+        /* skip successive '*' */
+        if (star > s) {
+            p->parts[n] = flb_sds_create_len(s, star - s);
+            if (!p->parts[n]) {
+                p->n_parts = n;
+                flb_router_pattern_destroy(p);
+                return -1;
+            }
+            p->min_len += (star - s);
+            n++;
+        }
+        s = star + 1;
+    }
+    p->n_parts = n;
+
+    return 0;
+}
+
+void flb_router_pattern_destroy(struct flb_router_pattern *p)
+{
+    int i;
+
+    if (!p->parts) {
+        return;
+    }
+
+    for (i = 0; i < p->n_parts; i++) {
+        flb_sds_destroy(p->parts[i]);
+    }
+    flb_free(p->parts);
+    p->parts = NULL;
+    p->n_parts = 0;
+}
+
+/* Find the first occurrence of 'str' in 'buf' */
+static inline const char *pattern_find(const char *buf, int len,
+                                       const char *str, int str_len)
+{
+    const char *p = buf;
+    const char *end = buf + len - str_len;
+
+    while (p <= end) {
+        p = memchr(p, str[0], (end - p) + 1);
+        if (!p) {
+            return NULL;
+        }
+        if (memcmp(p, str, str_len) == 0) {
+            return p;
+        }
+        p++;
+    }
+
+    return NULL;
+}
+
+/* Match a Tag against a compiled rule, the Tag don't need to be NULL ended */
+int flb_router_pattern_match(struct flb_router_pattern *p,
+                             const char *tag, int tag_len)
+{
+    int i;
+    int first = 0;
+    int last;
+    int start = 0;
+    int end = tag_len;
+    const char *pos;
+    flb_sds_t part;
+
+#ifdef FLB_HAVE_REGEX
+    int n;
+    struct flb_regex *match_regex = p->regex;
+
+    if (match_regex) {
+        n = onig_match(match_regex->regex,
+                       (const unsigned char *) tag,
+                       (const unsigned char *) tag + tag_len,
+                       (const unsigned char *) tag, 0,
+                       ONIG_OPTION_NONE);
+        if (n > 0) {
+            return FLB_TRUE;
+        }
+    }
+#endif
+
+    if (p->active == FLB_FALSE || tag_len < p->min_len) {
+        return FLB_FALSE;
+    }
+
+    last = p->n_parts;
+
+    /* Exact match */
+    if (p->n_parts == 1 && p->head == FLB_TRUE && p->tail == FLB_TRUE) {
+        part = p->parts[0];
+        if (tag_len == flb_sds_len(part) &&
+            memcmp(tag, part, tag_len) == 0) {
+            return FLB_TRUE;
+        }
+        return FLB_FALSE;
+    }
+
+    /* Anchored prefix and suffix */
+    if (p->head == FLB_TRUE) {
+        part = p->parts[0];
+        if (memcmp(tag, part, flb_sds_len(part)) != 0) {
+            return FLB_FALSE;
+        }
+        start = flb_sds_len(part);
+        first = 1;
+    }
+
+    if (p->tail == FLB_TRUE) {
+        part = p->parts[p->n_parts - 1];
+        end = tag_len - flb_sds_len(part);
+        if (end < start || memcmp(tag + end, part, flb_sds_len(part)) != 0) {
+            return FLB_FALSE;
+        }
+        last = p->n_parts - 1;
+    }
+
+    /* Parts in the middle, the left-most occurrence is always the best */
+    for (i = first; i < last; i++) {
+        part = p->parts[i];
+        pos = pattern_find(tag + start, end - start,
+                           part, flb_sds_len(part));
+        if (!pos) {
+            return FLB_FALSE;
+        }
+        start = (pos - tag) + flb_sds_len(part);
+    }
+
+    return FLB_TRUE;
+}
+
+struct flb_router_table *flb_router_table_create(struct flb_config *config)
+{
+    int i = 0;
+    int ret;
+    int total;
+    void *regex;
+    struct mk_list *head;
+    struct flb_filter_instance *f_ins;
+    struct flb_output_instance *o_ins;
+    struct flb_router_table *table;
+
+    table = flb_calloc(1, sizeof(struct flb_router_table));
+    if (!table) {
+        flb_errno();
+        return NULL;
+    }
+
+    table->n_filters = mk_list_size(&config->filters);
+    table->n_outputs = mk_list_size(&config->outputs);
+    total = table->n_filters + table->n_outputs;
+    table->words = (total / 64) + 1;
+
+    table->patterns = flb_calloc(total + 1, sizeof(struct flb_router_pattern));
+    if (!table->patterns) {
+        flb_errno();
+        flb_free(table);
+        return NULL;
+    }
+
+    table->cache = flb_hash_create(FLB_HASH_EVICT_LESS_USED,
+                                   FLB_ROUTER_CACHE_SIZE / 4,
+                                   FLB_ROUTER_CACHE_SIZE);
+    if (!table->cache) {
+        flb_router_table_destroy(table);
+        return NULL;
+    }
+
+    /* Compile the rules: filters first, then outputs */
+    mk_list_foreach(head, &config->filters) {
+        f_ins = mk_list_entry(head, struct flb_filter_instance, _head);
+#ifdef FLB_HAVE_REGEX
+        regex = f_ins->match_regex;
+#else
+        regex = NULL;
+#endif
+        ret = flb_router_pattern_init(&table->patterns[i], f_ins->match, regex);
+        if (ret == -1) {
+            flb_router_table_destroy(table);
+            return NULL;
+        }
+        i++;
+    }
+
+    mk_list_foreach(head, &config->outputs) {
+        o_ins = mk_list_entry(head, struct flb_output_instance, _head);
+#ifdef FLB_HAVE_REGEX
+        regex = o_ins->match_regex;
+#else
+        regex = NULL;
+#endif
+        ret = flb_router_pattern_init(&table->patterns[i], o_ins->match, regex);
+        if (ret == -1) {
+            flb_router_table_destroy(table);
+            return NULL;
+        }
+        i++;
+    }
+
+    return table;
+}
+
+/*
+ * Get the routes of a Tag, 'routes' must have room for 'table->words'
+ * entries. The result is copied since the cache entry can be evicted
+ * while the caller is still using it (e.g: a filter emitting records).
+ */
+int flb_router_table_get(struct flb_router_table *table,
+                         const char *tag, int tag_len, uint64_t *routes)
+{
+    int i;
+    int ret;
+    int total;
+    size_t size;
+    size_t out_size;
+    const char *out_buf;
+
+    size = sizeof(uint64_t) * table->words;
+
+    ret = flb_hash_get(table->cache, tag, tag_len, &out_buf, &out_size);
+    if (ret >= 0 && out_size == size) {
+        memcpy(routes, out_buf, size);
+        return 0;
+    }
+
+    memset(routes, '\0', size);
+    total = table->n_filters + table->n_outputs;
+    for (i = 0; i < total; i++) {
+        if (flb_router_pattern_match(&table->patterns[i], tag, tag_len)) {
+            routes[i / 64] |= (1ULL << (i % 64));
+        }
+    }
+
+    /* Empty Tags are not cached */
+    if (tag_len > 0) {
+        flb_hash_add(table->cache, tag, tag_len, (char *) routes, size);
+    }
+
+    return 0;
+}
+
+void flb_router_table_destroy(struct flb_router_table *table)
+{
+    int i;
+    int total;
+
+    if (table->patterns) {
+        total = table->n_filters + table->n_outputs;
+        for (i = 0; i < total; i++) {
+            flb_router_pattern_destroy(&table->patterns[i]);
+        }
+        flb_free(table->patterns);
+    }
+    if (table->cache) {
+        flb_hash_destroy(table->cache);
+    }
+    flb_free(table);
+}
+
 /* Associate and input and output instances due to a previous match */
 static int flb_router_connect(struct flb_input_instance *in,
                               struct flb_output_instance *out)
@@ -163,7 +484,7 @@ int flb_router_io_set(struct flb_config *config)
                       i_ins->name, o_ins->name);
             o_ins->match = flb_sds_create_len("*", 1);
             flb_router_connect(i_ins, o_ins);
-            return 0;
+            goto table;
         }
     }
 
@@ -209,6 +530,17 @@ int flb_router_io_set(struct flb_config *config)
         }
     }
 
+ table:
+    /* Compile the rules used to route records at runtime */
+    if (config->router) {
+        flb_router_table_destroy(config->router);
+    }
+    config->router = flb_router_table_create(config);
+    if (!config->router) {
+        flb_warn("[router] could not create routing table, Tags will be "
+                 "matched without cache");
+    }
+
     return 0;
 }
 
@@ -232,4 +564,9 @@ void flb_router_exit(struct flb_config *config)
             flb_free(r);
         }
     }
+
+    if (config->router) {
+        flb_router_table_destroy(config->router);
+        config->router = NULL;
+    }
 }
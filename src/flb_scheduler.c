@@ -95,121 +95,112 @@ static int random_uniform(int min, int max)
     return ra / copies + min;
 }
 
-/*
- * Schedule a request that will be processed within the next
- * FLB_SCHED_REQUEST_FRAME seconds.
- */
-static int schedule_request_now(int seconds,
-                                struct flb_sched_timer *timer,
-                                struct flb_sched_request *request,
-                                struct flb_config *config)
+/* Move all the entries of list 'from' to the end of list 'to' */
+static inline void list_splice(struct mk_list *from, struct mk_list *to)
 {
-    flb_pipefd_t fd;
-    struct mk_event *event;
-    struct flb_sched *sched = config->sched;
-
-    /* Initialize event */
-    event = &timer->event;
-    event->mask   = MK_EVENT_EMPTY;
-    event->status = MK_EVENT_NONE;
-
-    /* Create a timeout into the main event loop */
-    fd = mk_event_timeout_create(config->evl, seconds, 0, event);
-    if (fd == -1) {
-        return -1;
+    if (mk_list_is_empty(from) == 0) {
+        return;
     }
-    request->fd = fd;
+    mk_list_cat(from, to);
+    mk_list_init(from);
+}
 
-    /*
-     * Note: mk_event_timeout_create() sets a type = MK_EVENT_NOTIFICATION by
-     * default, we need to overwrite this value so we can do a clean check
-     * into the Engine when the event is triggered.
-     */
-    event->type = FLB_ENGINE_EV_SCHED;
-    mk_list_add(&request->_head, &sched->requests);
+static void wheel_init(struct flb_sched_wheel *wheel, time_t now)
+{
+    int i;
+    int l;
 
-    return 0;
+    wheel->now = now;
+    wheel->count = 0;
+
+    for (l = 0; l < FLB_SCHED_WHEEL_LEVELS; l++) {
+        for (i = 0; i < FLB_SCHED_WHEEL_SLOTS; i++) {
+            mk_list_init(&wheel->slots[l][i]);
+        }
+    }
 }
 
 /*
- * Enqueue a request that will wait until it expected timeout reach the
- * FLB_SCHED_REQUEST_FRAME interval.
+ * Link the request into the slot of its expiration time, the level is
+ * chosen by the distance to the current tick. Requests beyond the wheel
+ * span are capped to the last slot.
  */
-static int schedule_request_wait(struct flb_sched_request *request,
-                                 struct flb_config *config)
+static void wheel_insert(struct flb_sched_wheel *wheel,
+                         struct flb_sched_request *request)
 {
-    struct flb_sched *sched = config->sched;
+    int slot;
+    time_t delta;
+    struct mk_list *list;
 
-    mk_list_add(&request->_head, &sched->requests_wait);
-    return 0;
+    delta = request->expire - wheel->now;
+    if (delta <= 0) {
+        /* expired already, it fires on the next tick */
+        request->expire = wheel->now + 1;
+        delta = 1;
+    }
+    else if (delta >= FLB_SCHED_WHEEL_SPAN) {
+        request->expire = wheel->now + FLB_SCHED_WHEEL_SPAN - 1;
+        delta = FLB_SCHED_WHEEL_SPAN - 1;
+    }
+
+    if (delta < FLB_SCHED_WHEEL_SLOTS) {
+        slot = request->expire & FLB_SCHED_WHEEL_MASK;
+        list = &wheel->slots[0][slot];
+    }
+    else {
+        slot = (request->expire >> FLB_SCHED_WHEEL_BITS) & FLB_SCHED_WHEEL_MASK;
+        list = &wheel->slots[1][slot];
+    }
+
+    mk_list_add(&request->_head, list);
 }
 
 /*
- * Iterate requests_wait list looking for candidates to be promoted
- * to the 'requests' list.
+ * Advance the wheel up to 'now' and move the expired requests to the
+ * 'expired' list. If the loop was blocked for a while, the missed ticks
+ * are processed in order. It returns the number of expired requests, they
+ * are still owned by their retries until the caller releases them.
  */
-static int schedule_request_promote(struct flb_sched *sched)
+int flb_sched_wheel_advance(struct flb_sched *sched, time_t now,
+                            struct mk_list *expired)
 {
-    int ret;
-    int next;
-    int passed;
-    time_t now;
+    int c = 0;
+    int slot;
     struct mk_list *tmp;
     struct mk_list *head;
-    struct mk_list failed_requests;
+    struct mk_list *list;
     struct flb_sched_request *request;
-
-    now = time(NULL);
-    mk_list_init(&failed_requests);
-
-    mk_list_foreach_safe(head, tmp, &sched->requests_wait) {
-        request = mk_list_entry(head, struct flb_sched_request, _head);
-
-        /* First check how many seconds have passed since the request creation */
-        passed = (now - request->created);
-        ret = 0;
-
-        /* If we passed the original time, schedule now for the next second */
-        if (passed > request->timeout) {
-            mk_list_del(&request->_head);
-            ret = schedule_request_now(1, request->timer, request, sched->config);
-            if (ret != 0) {
-                mk_list_add(&request->_head, &failed_requests);
-            }
-        }
-        else if (passed + FLB_SCHED_REQUEST_FRAME >= request->timeout) {
-            /* Check if we should schedule within this frame */
-            mk_list_del(&request->_head);
-            next = labs(passed - request->timeout);
-            ret = schedule_request_now(next, request->timer, request, sched->config);
-            if (ret != 0) {
-                mk_list_add(&request->_head, &failed_requests);
+    struct flb_sched_wheel *wheel = &sched->wheel;
+
+    while (wheel->now < now) {
+        wheel->now++;
+
+        /* Cascade the next level 1 slot into level 0 */
+        if ((wheel->now & FLB_SCHED_WHEEL_MASK) == 0) {
+            slot = (wheel->now >> FLB_SCHED_WHEEL_BITS) & FLB_SCHED_WHEEL_MASK;
+            list = &wheel->slots[1][slot];
+            mk_list_foreach_safe(head, tmp, list) {
+                request = mk_list_entry(head, struct flb_sched_request, _head);
+                mk_list_del(&request->_head);
+                if (request->expire == wheel->now) {
+                    mk_list_add(&request->_head,
+                                &wheel->slots[0][wheel->now & FLB_SCHED_WHEEL_MASK]);
+                }
+                else {
+                    wheel_insert(wheel, request);
+                }
             }
         }
-        else {
-            continue;
-        }
 
-        /*
-         * If the 'request' could not be scheduled, this could only happen due to memory
-         * exhaustion or running out of file descriptors. There is no much we can do
-         * at this time.
-         */
-        if (ret == -1) {
-            flb_error("[sched] a 'retry request' could not be scheduled. the "
-                      "system might be running out of memory or file "
-                      "descriptors. The scheduler will do a retry later.");
+        list = &wheel->slots[0][wheel->now & FLB_SCHED_WHEEL_MASK];
+        if (mk_list_is_empty(list) == 0) {
+            continue;
         }
+        c += mk_list_size(list);
+        list_splice(list, expired);
     }
 
-    /* For each failed request, re-add them to the wait list */
-    mk_list_foreach_safe(head, tmp, &failed_requests) {
-        request = mk_list_entry(head, struct flb_sched_request, _head);
-        mk_list_del(&request->_head);
-        mk_list_add(&request->_head, &sched->requests_wait);
-    }
-
-    return 0;
+    return c;
 }
 
 static double ipow(double base, int exp)
@@ -249,17 +240,11 @@ static int backoff_full_jitter(int base, int cap, int n)
 /* Schedule the 'retry' for a thread buffer flush */
 int flb_sched_request_create(struct flb_config *config, void *data, int tries)
 {
-    int ret;
     int seconds;
-    struct flb_sched_timer *timer;
+    struct flb_sched *sched = config->sched;
+    struct flb_task_retry *retry = data;
     struct flb_sched_request *request;
 
-    /* Allocate timer context */
-    timer = flb_sched_timer_create(config->sched);
-    if (!timer) {
-        return -1;
-    }
-
     /* Allocate request node */
     request = flb_malloc(sizeof(struct flb_sched_request));
     if (!request) {
@@ -267,37 +252,24 @@ int flb_sched_request_create(struct flb_config *config, void *data, int tries)
         return -1;
     }
 
-    /* Link timer references */
-    timer->type = FLB_SCHED_TIMER_REQUEST;
-    timer->data = request;
-    timer->event.mask = MK_EVENT_EMPTY;
-
     /* Get suggested wait_time for this request */
     seconds = backoff_full_jitter(FLB_SCHED_BASE, FLB_SCHED_CAP, tries);
     seconds += 1;
 
     /* Populare request */
-    request->fd      = -1;
     request->created = time(NULL);
     request->timeout = seconds;
+    request->expire  = request->created + seconds;
     request->data    = data;
-    request->timer   = timer;
 
-    /* Request to be placed into the sched_requests_wait list */
-    if (seconds > FLB_SCHED_REQUEST_FRAME) {
-        schedule_request_wait(request, config);
-    }
-    else {
-        ret = schedule_request_now(seconds, timer, request, config);
-        if (ret == -1) {
-            flb_error("[sched]  'retry request' could not be created. the "
-                      "system might be running out of memory or file "
-                      "descriptors.");
-            flb_sched_timer_destroy(timer);
-            flb_free(request);
-            return -1;
-        }
+    /* A retry is scheduled only once */
+    if (retry->sched_req) {
+        flb_sched_request_destroy(config, retry->sched_req);
     }
+    retry->sched_req = request;
+
+    wheel_insert(&sched->wheel, request);
+    sched->wheel.count++;
 
     return seconds;
 }
@@ -305,28 +277,21 @@ int flb_sched_request_create(struct flb_config *config, void *data, int tries)
 int flb_sched_request_destroy(struct flb_config *config,
                               struct flb_sched_request *req)
 {
-    struct flb_sched_timer *timer;
+    struct flb_sched *sched = config->sched;
+    struct flb_task_retry *retry;
 
     if (!req) {
         return 0;
     }
 
+    /* Unlink from the wheel slot or the expired list */
     mk_list_del(&req->_head);
 
-    timer = req->timer;
-
-    /*
-     * We invalidate the timer since in the same event loop round
-     * an event associated to this timer can be present. Invalidation
-     * means the timer will do nothing and will be removed after
-     * the event loop round finish.
-     */
-    flb_sched_timer_invalidate(timer);
-
-#ifndef FLB_SYSTEM_WINDOWS
-    /* Close pipe after invalidating timer */
-    flb_pipe_close(req->fd);
-#endif
+    retry = req->data;
+    if (retry->sched_req == req) {
+        retry->sched_req = NULL;
+        sched->wheel.count--;
+    }
 
     /* Remove request */
     flb_free(req);
@@ -336,21 +301,48 @@ int flb_sched_request_destroy(struct flb_config *config,
 
 int flb_sched_request_invalidate(struct flb_config *config, void *data)
 {
-    struct mk_list *tmp;
-    struct mk_list *head;
+    struct flb_task_retry *retry = data;
+
+    if (!retry->sched_req) {
+        return -1;
+    }
+
+    flb_sched_request_destroy(config, retry->sched_req);
+    return 0;
+}
+
+/* Dispatch the retries of the requests expired up to 'now' */
+static int sched_requests_fire(struct flb_sched *sched, time_t now)
+{
+    int c;
+    void *data;
+    struct mk_list expired;
+    struct flb_task_retry *retry;
     struct flb_sched_request *request;
-    struct flb_sched *sched;
 
-    sched = config->sched;
-    mk_list_foreach_safe(head, tmp, &sched->requests) {
-        request = mk_list_entry(head, struct flb_sched_request, _head);
-        if (request->data == data) {
-            flb_sched_request_destroy(config, request);
-            return 0;
-        }
+    mk_list_init(&expired);
+    c = flb_sched_wheel_advance(sched, now, &expired);
+
+    /*
+     * A dispatch can destroy other retries of the same task, their requests
+     * are unlinked from the 'expired' list, so always take the first one.
+     */
+    while (mk_list_is_empty(&expired) != 0) {
+        request = mk_list_entry_first(&expired, struct flb_sched_request,
+                                      _head);
+        mk_list_del(&request->_head);
+
+        /* the request is gone before the retry is dispatched */
+        data = request->data;
+        retry = data;
+        retry->sched_req = NULL;
+        sched->wheel.count--;
+        flb_free(request);
+
+        flb_engine_dispatch_retry(data, sched->config);
     }
 
-    return -1;
+    return c;
 }
 
 /* Handle a timeout event set by a previous flb_sched_request_create(...) */
@@ -358,30 +350,18 @@ int flb_sched_event_handler(struct flb_config *config, struct mk_event *event)
 {
     struct flb_sched *sched;
     struct flb_sched_timer *timer;
-    struct flb_sched_request *req;
 
     timer = (struct flb_sched_timer *) event;
     if (timer->active == FLB_FALSE) {
         return 0;
     }
 
-    if (timer->type == FLB_SCHED_TIMER_REQUEST) {
-        /* Map request struct */
-        req = timer->data;
-        consume_byte(req->fd);
-
-        /* Dispatch 'retry' */
-        flb_engine_dispatch_retry(req->data, config);
-
-        /* Destroy this scheduled request, it's not longer required */
-        flb_sched_request_destroy(config, req);
-    }
-    else if (timer->type == FLB_SCHED_TIMER_FRAME) {
+    if (timer->type == FLB_SCHED_TIMER_FRAME) {
         sched = timer->data;
 #ifndef __APPLE__
         consume_byte(sched->frame_fd);
 #endif
-        schedule_request_promote(sched);
+        sched_requests_fire(sched, time(NULL));
     }
     else if (timer->type == FLB_SCHED_TIMER_CB_ONESHOT) {
         consume_byte(timer->timer_fd);
@@ -492,12 +472,11 @@ int flb_sched_init(struct flb_config *config)
     sched->config = config;
 
     /* Initialize lists */
-    mk_list_init(&sched->requests);
-    mk_list_init(&sched->requests_wait);
+    wheel_init(&sched->wheel, time(NULL));
     mk_list_init(&sched->timers);
     mk_list_init(&sched->timers_drop);
 
-    /* Create the frame timer who enqueue 'requests' for future time */
+    /* Create the frame timer who ticks the requests wheel */
     timer = flb_sched_timer_create(sched);
     if (!timer) {
         flb_free(sched);
@@ -535,6 +514,8 @@ int flb_sched_init(struct flb_config *config)
 /* Release all resources used by the Scheduler */
 int flb_sched_exit(struct flb_config *config)
 {
+    int i;
+    int l;
     int c = 0;
     struct mk_list *tmp;
     struct mk_list *head;
@@ -548,17 +529,14 @@ int flb_sched_exit(struct flb_config *config)
         return 0;
     }
 
-    mk_list_foreach_safe(head, tmp, &sched->requests) {
-        request = mk_list_entry(head, struct flb_sched_request, _head);
-        flb_sched_request_destroy(config, request);
-        c++; /* evil counter */
-    }
-
-    /* Delete requests on wait list */
-    mk_list_foreach_safe(head, tmp, &sched->requests_wait) {
-        request = mk_list_entry(head, struct flb_sched_request, _head);
-        flb_sched_request_destroy(config, request);
-        c++; /* evil counter */
+    for (l = 0; l < FLB_SCHED_WHEEL_LEVELS; l++) {
+        for (i = 0; i < FLB_SCHED_WHEEL_SLOTS; i++) {
+            mk_list_foreach_safe(head, tmp, &sched->wheel.slots[l][i]) {
+                request = mk_list_entry(head, struct flb_sched_request, _head);
+                flb_sched_request_destroy(config, request);
+                c++; /* evil counter */
+            }
+        }
     }
 
     /* Delete timers */
@@ -314,6 +314,7 @@ int flb_sosreport(struct flb_config *config)
         else {
             printf("    Retry Limit\t\t%i\n", ins_out->retry_limit);
         }
+        printf("    Workers\t\t%i\n", ins_out->workers);
         print_host(&ins_out->host);
         print_properties(&ins_out->properties);
         printf("\n");
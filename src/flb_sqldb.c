@@ -18,6 +18,8 @@
  *  limitations under the License.
  */
 
+#include <strings.h>
+
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_str.h>
 #include <fluent-bit/flb_log.h>
@@ -131,3 +133,33 @@ int64_t flb_sqldb_last_id(struct flb_sqldb *db)
 {
     return sqlite3_last_insert_rowid(db->handler);
 }
+
+/*
+ * Set the journal mode of the database: DELETE, TRUNCATE, PERSIST, MEMORY,
+ * WAL or OFF. Returns -1 if the mode is not valid or cannot be set.
+ */
+int flb_sqldb_journal_mode(struct flb_sqldb *db, const char *mode)
+{
+    int i;
+    char query[64];
+    static const char *modes[] = {
+        "delete", "truncate", "persist", "memory", "wal", "off", NULL
+    };
+
+    for (i = 0; modes[i]; i++) {
+        if (strcasecmp(mode, modes[i]) == 0) {
+            break;
+        }
+    }
+    if (!modes[i]) {
+        flb_error("[sqldb] invalid journal mode '%s'", mode);
+        return -1;
+    }
+
+    snprintf(query, sizeof(query) - 1, "PRAGMA journal_mode=%s;", modes[i]);
+    if (flb_sqldb_query(db, query, NULL, NULL) != FLB_OK) {
+        return -1;
+    }
+
+    return 0;
+}
@@ -21,6 +21,7 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_compress.h>
 #include <fluent-bit/flb_storage.h>
 
 static int sort_chunk_cmp(const void *a_arg, const void *b_arg)
@@ -73,6 +74,8 @@ static void print_storage_info(struct flb_config *ctx, struct cio_ctx *cio)
 {
     char *sync;
     char *checksum;
+    const char *compression = "none";
+    struct flb_compress_codec *codec;
     struct flb_input_instance *in;
 
     flb_info("[storage] version=%s, initializing...", cio_version());
@@ -98,8 +101,14 @@ static void print_storage_info(struct flb_config *ctx, struct cio_ctx *cio)
         checksum = "disabled";
     }
 
-    flb_info("[storage] %s synchronization mode, checksum %s, max_chunks_up=%i",
-             sync, checksum, ctx->storage_max_chunks_up);
+    codec = flb_compress_codec_lookup(cio->compress_type);
+    if (codec) {
+        compression = codec->name;
+    }
+
+    flb_info("[storage] %s synchronization mode, checksum %s, max_chunks_up=%i, "
+             "compression=%s",
+             sync, checksum, ctx->storage_max_chunks_up, compression);
 
     /* Storage input plugin */
     if (ctx->storage_input_plugin) {
@@ -127,6 +136,35 @@ static int log_cb(struct cio_ctx *ctx, int level, const char *file, int line,
     return 0;
 }
 
+/* Chunk I/O compression callbacks, 'type' is a FLB_COMPRESS_* codec */
+static int storage_compress_cb(int type, const void *in_data, size_t in_len,
+                               void **out_data, size_t *out_len)
+{
+    struct flb_compress_codec *codec;
+
+    codec = flb_compress_codec_lookup(type);
+    if (!codec) {
+        return -1;
+    }
+
+    return flb_compress_buffer(codec, FLB_COMPRESS_LEVEL_DEFAULT,
+                               in_data, in_len, out_data, out_len);
+}
+
+static int storage_uncompress_cb(int type, const void *in_data, size_t in_len,
+                                 void **out_data, size_t *out_len)
+{
+    struct flb_compress_codec *codec;
+
+    codec = flb_compress_codec_lookup(type);
+    if (!codec) {
+        flb_error("[storage] unsupported compression codec id=%i", type);
+        return -1;
+    }
+
+    return flb_uncompress_buffer(codec, in_data, in_len, out_data, out_len);
+}
+
 int flb_storage_input_create(struct cio_ctx *cio,
                              struct flb_input_instance *in)
 {
@@ -227,6 +265,8 @@ int flb_storage_create(struct flb_config *ctx)
 {
     int ret;
     int flags;
+    int compress = CIO_COMPRESS_NONE;
+    struct flb_compress_codec *codec;
     struct flb_input_instance *in = NULL;
     struct cio_ctx *cio;
 
@@ -252,6 +292,19 @@ int flb_storage_create(struct flb_config *ctx)
         flags |= CIO_CHECKSUM;
     }
 
+    /* compression of filesystem chunks */
+    if (ctx->storage_compression &&
+        strcasecmp(ctx->storage_compression, "none") != 0 &&
+        strcasecmp(ctx->storage_compression, "off") != 0) {
+        codec = flb_compress_codec_get(ctx->storage_compression);
+        if (!codec) {
+            flb_error("[storage] invalid compression codec '%s'",
+                      ctx->storage_compression);
+            return -1;
+        }
+        compress = codec->type;
+    }
+
     /* Create chunkio context */
     cio = cio_create(ctx->storage_path, log_cb, CIO_LOG_DEBUG, flags);
     if (!cio) {
@@ -266,6 +319,13 @@ int flb_storage_create(struct flb_config *ctx)
     }
     cio_set_max_chunks_up(ctx->cio, ctx->storage_max_chunks_up);
 
+    /*
+     * Compression callbacks are always registered: chunks compressed by a
+     * previous run must be readable even if compression is now disabled.
+     */
+    cio_set_compression(ctx->cio, compress,
+                        storage_compress_cb, storage_uncompress_cb);
+
     /* Load content from the file system if any */
     ret = cio_load(ctx->cio);
     if (ret == -1) {
@@ -33,25 +33,67 @@
 #include <fluent-bit/flb_scheduler.h>
 
 /*
- * Every task created must have an unique ID, this function lookup the
- * lowest number available in the tasks_map.
+ * Grow the tasks_map, the new entries are linked to the free list in
+ * ascending order.
+ */
+static int map_grow(struct flb_config *config)
+{
+    int i;
+    int size;
+    struct flb_task_map *map;
+
+    if (config->tasks_map_size >= FLB_TASK_MAP_MAX) {
+        return -1;
+    }
+
+    size = config->tasks_map_size * 2;
+    if (size == 0) {
+        size = FLB_TASK_MAP_SIZE;
+    }
+    else if (size > FLB_TASK_MAP_MAX) {
+        size = FLB_TASK_MAP_MAX;
+    }
+
+    map = flb_realloc(config->tasks_map, sizeof(struct flb_task_map) * size);
+    if (!map) {
+        flb_errno();
+        return -1;
+    }
+
+    for (i = config->tasks_map_size; i < size; i++) {
+        map[i].task = NULL;
+        map[i].next_free = (i + 1 < size) ? i + 1 : config->tasks_map_free;
+    }
+    config->tasks_map_free = config->tasks_map_size;
+    config->tasks_map = map;
+    config->tasks_map_size = size;
+
+    if (size > FLB_TASK_MAP_SIZE) {
+        flb_debug("[task] tasks table resized to %i entries", size);
+    }
+
+    return 0;
+}
+
+/*
+ * Every task created must have an unique ID, this function takes the first
+ * entry of the free list of the tasks_map, growing the table if required.
  *
  * This 'id' is used by the task interface to communicate with the engine event
  * loop about some action.
  */
-
-static inline int map_get_task_id(struct flb_config *config)
+int flb_task_map_get_id(struct flb_config *config)
 {
-    int i;
-    int map_size = (sizeof(config->tasks_map) / sizeof(struct flb_task_map));
+    int id;
 
-    for (i = 0; i < map_size; i++) {
-        if (config->tasks_map[i].task == NULL) {
-            return i;
-        }
+    if (config->tasks_map_free == -1 && map_grow(config) == -1) {
+        return -1;
     }
 
-    return -1;
+    id = config->tasks_map_free;
+    config->tasks_map_free = config->tasks_map[id].next_free;
+
+    return id;
 }
 
 static inline void map_set_task_id(int id, struct flb_task *task,
@@ -61,9 +103,11 @@ static inline void map_set_task_id(int id, struct flb_task *task,
 
 }
 
-static inline void map_free_task_id(int id, struct flb_config *config)
+void flb_task_map_free_id(int id, struct flb_config *config)
 {
     config->tasks_map[id].task = NULL;
+    config->tasks_map[id].next_free = config->tasks_map_free;
+    config->tasks_map_free = id;
 }
 
 
@@ -99,6 +143,7 @@ int flb_task_retry_reschedule(struct flb_task_retry *retry, struct flb_config *c
          * This is the worse case scenario: 'cannot re-schedule a retry'. If the Chunk
          * resides only in memory, it will be lost.  */
         flb_warn("[task] retry for task %i could not be re-scheduled", task->id);
+        flb_task_route_release(task, retry->o_ins);
         flb_task_retry_destroy(retry);
         if (task->users == 0 && mk_list_size(&task->retries) == 0) {
             flb_task_destroy(task, FLB_TRUE);
@@ -148,9 +193,10 @@ struct flb_task_retry *flb_task_retry_create(struct flb_task *task,
             return NULL;
         }
 
-        retry->attemps = 1;
-        retry->o_ins   = o_ins;
-        retry->parent  = task;
+        retry->attemps   = 1;
+        retry->o_ins     = o_ins;
+        retry->parent    = task;
+        retry->sched_req = NULL;
         mk_list_add(&retry->_head, &task->retries);
 
         flb_debug("[retry] new retry created for task_id=%i attemps=%i",
@@ -245,7 +291,7 @@ static struct flb_task *task_alloc(struct flb_config *config)
     }
 
     /* Get ID and set back 'task' reference */
-    task_id = map_get_task_id(config);
+    task_id = flb_task_map_get_id(config);
     if (task_id == -1) {
         flb_free(task);
         return NULL;
@@ -341,11 +387,17 @@ struct flb_task *flb_task_create(uint64_t ref_id,
                                  int *err)
 {
     int count = 0;
+    int o_id = 0;
+    int matched;
     uint64_t routes_mask = 0;
+    uint64_t routes_buf[FLB_ROUTER_WORDS_STACK];
+    uint64_t *routes = NULL;
+    struct flb_router_table *router = config->router;
     struct flb_task *task;
     struct flb_task_route *route;
     struct flb_output_instance *o_ins;
     struct mk_list *o_head;
+    struct mk_list *tmp;
 
     /* No error status */
     *err = FLB_FALSE;
@@ -361,6 +413,7 @@ struct flb_task *flb_task_create(uint64_t ref_id,
     task->tag = flb_malloc(tag_len + 1);
     if (!task->tag) {
         flb_errno();
+        flb_task_map_free_id(task->id, config);
         flb_free(task);
         *err = FLB_TRUE;
         return NULL;
@@ -377,22 +430,44 @@ struct flb_task *flb_task_create(uint64_t ref_id,
     task->ic     = ic;
     mk_list_add(&task->_head, &i_ins->tasks);
 
-#ifdef FLB_HAVE_METRICS
+    /* Statistics of the chunk */
     task->records = ((struct flb_input_chunk *) ic)->total_records;
-#endif
+    task->tm_min = ((struct flb_input_chunk *) ic)->tm_min;
+    task->tm_max = ((struct flb_input_chunk *) ic)->tm_max;
+
+    /* Lookup the outputs that matches the Tag in the routing table */
+    if (router) {
+        if (router->words <= FLB_ROUTER_WORDS_STACK) {
+            routes = routes_buf;
+        }
+        else {
+            routes = flb_malloc(sizeof(uint64_t) * router->words);
+        }
+        if (routes) {
+            flb_router_table_get(router, task->tag, task->tag_len, routes);
+        }
+    }
 
     /* Find matching routes for the incoming tag */
     mk_list_foreach(o_head, &config->outputs) {
         o_ins = mk_list_entry(o_head,
                               struct flb_output_instance, _head);
 
-        if (flb_router_match(task->tag, task->tag_len, o_ins->match
+        if (routes) {
+            matched = flb_router_routes_output(router, routes, o_id);
+        }
+        else {
+            matched = flb_router_match(task->tag, task->tag_len, o_ins->match
 #ifdef FLB_HAVE_REGEX
-                             , o_ins->match_regex
+                                       , o_ins->match_regex
 #else
-                             , NULL
+                                       , NULL
 #endif
-                             )) {
+                                       );
+        }
+        o_id++;
+
+        if (matched) {
             route = flb_malloc(sizeof(struct flb_task_route));
             if (!route) {
                 flb_errno();
@@ -400,14 +475,57 @@ struct flb_task *flb_task_create(uint64_t ref_id,
             }
 
             route->out = o_ins;
+            route->held = FLB_FALSE;
+            route->released = FLB_FALSE;
             mk_list_add(&route->_head, &task->routes);
-            count++;
+
+            /*
+             * The output reached its tasks limit: the route is held and
+             * started by a later dispatch, the other outputs get the chunk
+             * now. The hold counts as a user, so the task stays alive.
+             */
+            if (flb_task_route_can_start(route) == FLB_FALSE) {
+                if (o_ins->tasks_paused == FLB_FALSE) {
+                    flb_warn("[task] output %s reached its limit of %i tasks, "
+                             "chunks routed to it are paused",
+                             flb_output_name(o_ins), o_ins->tasks_limit);
+                    o_ins->tasks_paused = FLB_TRUE;
+                }
+                route->held = FLB_TRUE;
+                task->held++;
+                task->users++;
+            }
+            else {
+                o_ins->tasks_count++;
+                count++;
+            }
 
             /* set the routes as a mask */
             routes_mask |= o_ins->mask_id;
         }
     }
 
+    if (routes && routes != routes_buf) {
+        flb_free(routes);
+    }
+
+    /*
+     * Every output of the chunk reached its limit: keep the chunk for a
+     * later dispatch, so a stalled output cannot take all the task IDs.
+     */
+    if (count == 0 && task->held > 0) {
+        mk_list_foreach_safe(o_head, tmp, &task->routes) {
+            route = mk_list_entry(o_head, struct flb_task_route, _head);
+            flb_task_route_destroy(route);
+        }
+        mk_list_del(&task->_head);
+        flb_task_map_free_id(task->id, config);
+        flb_free(task->tag);
+        flb_free(task);
+        *err = FLB_TRUE;
+        return NULL;
+    }
+
     /* no destinations ?, useless task. */
     if (count == 0) {
         flb_debug("[task] created task=%p id=%i without routes, dropping.",
@@ -421,6 +539,74 @@ struct flb_task *flb_task_create(uint64_t ref_id,
     return task;
 }
 
+/* Give back the task a route takes from its output limit */
+static void route_slot_release(struct flb_task_route *route)
+{
+    struct flb_output_instance *o_ins = route->out;
+
+    if (route->held == FLB_TRUE || route->released == FLB_TRUE) {
+        return;
+    }
+
+    route->released = FLB_TRUE;
+    o_ins->tasks_count--;
+    if (o_ins->tasks_paused == FLB_TRUE &&
+        o_ins->tasks_count < o_ins->tasks_limit) {
+        o_ins->tasks_paused = FLB_FALSE;
+    }
+}
+
+/* Unlink a route from its task, it releases a task of the output limit */
+void flb_task_route_destroy(struct flb_task_route *route)
+{
+    route_slot_release(route);
+    mk_list_del(&route->_head);
+    flb_free(route);
+}
+
+/*
+ * The flush of the task on an output reached a final outcome (OK, ERROR or
+ * no more retries): its slot goes back to the output tasks limit right away,
+ * the task may still be alive because of other outputs.
+ */
+void flb_task_route_release(struct flb_task *task,
+                            struct flb_output_instance *o_ins)
+{
+    struct mk_list *head;
+    struct flb_task_route *route;
+
+    mk_list_foreach(head, &task->routes) {
+        route = mk_list_entry(head, struct flb_task_route, _head);
+        if (route->out == o_ins) {
+            route_slot_release(route);
+            return;
+        }
+    }
+}
+
+/* Check if the output of a route is under its tasks limit */
+int flb_task_route_can_start(struct flb_task_route *route)
+{
+    struct flb_output_instance *o_ins = route->out;
+
+    if (o_ins->tasks_limit > 0 && o_ins->tasks_count >= o_ins->tasks_limit) {
+        return FLB_FALSE;
+    }
+    return FLB_TRUE;
+}
+
+/*
+ * Release the hold of a route before its flush starts: the route takes a
+ * task of the output limit and the thread becomes the task user.
+ */
+void flb_task_route_start(struct flb_task *task, struct flb_task_route *route)
+{
+    route->held = FLB_FALSE;
+    route->out->tasks_count++;
+    task->held--;
+    task->users--;
+}
+
 void flb_task_destroy(struct flb_task *task, int del)
 {
     struct mk_list *tmp;
@@ -431,13 +617,12 @@ void flb_task_destroy(struct flb_task *task, int del)
     flb_debug("[task] destroy task=%p (task_id=%i)", task, task->id);
 
     /* Release task_id */
-    map_free_task_id(task->id, task->config);
+    flb_task_map_free_id(task->id, task->config);
 
     /* Remove routes */
     mk_list_foreach_safe(head, tmp, &task->routes) {
         route = mk_list_entry(head, struct flb_task_route, _head);
-        mk_list_del(&route->_head);
-        flb_free(route);
+        flb_task_route_destroy(route);
     }
 
     /* Unlink and release task */
@@ -465,8 +650,8 @@ void flb_task_add_thread(struct flb_thread *thread,
 
     out_th = (struct flb_output_thread *) FLB_THREAD_DATA(thread);
 
-    /* Always set an incremental thread_id */
-    out_th->id = task->n_threads;
+    /* Always set an incremental thread_id, it wraps at the event limit */
+    out_th->id = task->n_threads & FLB_TASK_TH_MASK;
     task->n_threads++;
     task->users++;
     mk_list_add(&out_th->_head, &task->threads);
@@ -23,6 +23,8 @@
 #include <fluent-bit/flb_macros.h>
 #include <fluent-bit/flb_log.h>
 #include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_thread.h>
+#include <fluent-bit/flb_scheduler.h>
 #ifdef FLB_HAVE_CLOCK_GET_TIME
 #  include <mach/clock.h>
 #  include <mach/mach.h>
@@ -190,42 +192,84 @@ int flb_time_append_to_msgpack(struct flb_time *tm, msgpack_packer *pk, int fmt)
     return ret;
 }
 
-int flb_time_pop_from_msgpack(struct flb_time *time, msgpack_unpacked *upk,
-                              msgpack_object **map)
+int flb_time_msgpack_to_time(struct flb_time *time, msgpack_object *obj)
 {
-    msgpack_object obj;
     uint32_t tmp;
 
-    if(time == NULL || upk == NULL) {
-        return -1;
-    }
-
-    if (upk->data.type != MSGPACK_OBJECT_ARRAY) {
-        return -1;
-    }
-
-    obj = upk->data.via.array.ptr[0];
-    *map = &upk->data.via.array.ptr[1];
-
-    switch(obj.type){
+    switch(obj->type){
     case MSGPACK_OBJECT_POSITIVE_INTEGER:
-        time->tm.tv_sec  = obj.via.u64;
+        time->tm.tv_sec  = obj->via.u64;
         time->tm.tv_nsec = 0;
         break;
     case MSGPACK_OBJECT_FLOAT:
-        time->tm.tv_sec  = obj.via.f64;
-        time->tm.tv_nsec = ((obj.via.f64 - time->tm.tv_sec) * ONESEC_IN_NSEC);
+        time->tm.tv_sec  = obj->via.f64;
+        time->tm.tv_nsec = ((obj->via.f64 - time->tm.tv_sec) * ONESEC_IN_NSEC);
         break;
     case MSGPACK_OBJECT_EXT:
-        memcpy(&tmp, &obj.via.ext.ptr[0], 4);
+        memcpy(&tmp, &obj->via.ext.ptr[0], 4);
         time->tm.tv_sec = (uint32_t)ntohl(tmp);
-        memcpy(&tmp, &obj.via.ext.ptr[4], 4);
+        memcpy(&tmp, &obj->via.ext.ptr[4], 4);
         time->tm.tv_nsec = (uint32_t)ntohl(tmp);
         break;
     default:
-        flb_warn("unknown time format %x", obj.type);
+        flb_warn("unknown time format %x", obj->type);
         return -1;
     }
 
     return 0;
 }
+
+int flb_time_pop_from_msgpack(struct flb_time *time, msgpack_unpacked *upk,
+                              msgpack_object **map)
+{
+    if(time == NULL || upk == NULL) {
+        return -1;
+    }
+
+    if (upk->data.type != MSGPACK_OBJECT_ARRAY) {
+        return -1;
+    }
+
+    *map = &upk->data.via.array.ptr[1];
+
+    return flb_time_msgpack_to_time(time, &upk->data.via.array.ptr[0]);
+}
+
+static void flb_time_thread_wakeup(struct flb_config *config, void *data)
+{
+    (void) config;
+    struct flb_thread *th;
+
+    th = (struct flb_thread *) data;
+    flb_thread_resume(th);
+}
+
+/*
+ * Sleep running thread for 'ms' (milliseconds). This function assume
+ * that's running in a co-routine.
+ *
+ * Internally it creates a timer and once the signal gets into the
+ * event loop after expiration time, this function resume.
+ *
+ * A context that invokes flb_time_sleep() will resume upon an
+ * internal call to flb_time_thread_wakeup().
+ */
+void flb_time_sleep(int ms, struct flb_config *config)
+{
+    int ret;
+    struct flb_thread *th;
+
+    th = (struct flb_thread *) pthread_getspecific(flb_thread_key);
+    if (!th) {
+        flb_error("[thread] invalid context for thread_sleep()");
+        return;
+    }
+
+    ret = flb_sched_timer_cb_create(config, FLB_SCHED_TIMER_CB_ONESHOT,
+                                    ms, flb_time_thread_wakeup, th);
+    if (ret == -1) {
+        return;
+    }
+
+    flb_thread_yield(th, FLB_FALSE);
+}
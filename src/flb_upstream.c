@@ -28,6 +28,7 @@
 #include <fluent-bit/flb_io_tls.h>
 #include <fluent-bit/flb_tls.h>
 #include <fluent-bit/flb_utils.h>
+#include <fluent-bit/flb_output_worker.h>
 
 /* Config map for Upstream networking setup */
 struct flb_config_map upstream_net[] = {
@@ -98,6 +99,7 @@ struct flb_upstream *flb_upstream_create(struct flb_config *config,
 
     mk_list_init(&u->av_queue);
     mk_list_init(&u->busy_queue);
+    pthread_mutex_init(&u->mutex, NULL);
 
 #ifdef FLB_HAVE_TLS
     u->tls      = (struct flb_tls *) tls;
@@ -190,6 +192,12 @@ static struct flb_upstream_conn *create_conn(struct flb_upstream *u)
     conn->fd            = -1;
     conn->net_error     = -1;
 
+    /* Use the event loop of the running thread, if any */
+    conn->evl = flb_output_worker_evl_get();
+    if (!conn->evl) {
+        conn->evl = u->evl;
+    }
+
     if (u->net.connect_timeout > 0) {
         conn->ts_connect_timeout = now + u->net.connect_timeout;
     }
@@ -215,13 +223,18 @@ static struct flb_upstream_conn *create_conn(struct flb_upstream *u)
     MK_EVENT_ZERO(&conn->event);
 
     /* Link new connection to the busy queue */
+    pthread_mutex_lock(&u->mutex);
     mk_list_add(&conn->_head, &u->busy_queue);
     u->n_connections++;
+    pthread_mutex_unlock(&u->mutex);
 
     /* Start connection */
     ret = flb_io_net_connect(conn, th);
     if (ret == -1) {
+        pthread_mutex_lock(&u->mutex);
         mk_list_del(&conn->_head);
+        u->n_connections--;
+        pthread_mutex_unlock(&u->mutex);
         flb_free(conn);
         return NULL;
     }
@@ -245,7 +258,7 @@ static int destroy_conn(struct flb_upstream_conn *u_conn)
               u_conn->fd, u->tcp_host, u->tcp_port);
 
     if (u->flags & FLB_IO_ASYNC) {
-        mk_event_del(u->evl, &u_conn->event);
+        mk_event_del(u_conn->evl, &u_conn->event);
     }
 
 #ifdef FLB_HAVE_TLS
@@ -260,9 +273,11 @@ static int destroy_conn(struct flb_upstream_conn *u_conn)
     }
 
     /* remove connection from the queue */
+    pthread_mutex_lock(&u->mutex);
     mk_list_del(&u_conn->_head);
-
     u->n_connections--;
+    pthread_mutex_unlock(&u->mutex);
+
     flb_free(u_conn);
 
     return 0;
@@ -286,6 +301,7 @@ int flb_upstream_destroy(struct flb_upstream *u)
 
     flb_free(u->tcp_host);
     mk_list_del(&u->_head);
+    pthread_mutex_destroy(&u->mutex);
     flb_free(u);
 
     return 0;
@@ -305,6 +321,7 @@ struct flb_upstream_conn *flb_upstream_conn_get(struct flb_upstream *u)
 {
     struct mk_list *tmp;
     struct mk_list *head;
+    struct mk_event_loop *evl;
     struct flb_upstream_conn *conn = NULL;
 
     flb_trace("[upstream] get new connection for %s:%i, net setup:\n"
@@ -327,13 +344,28 @@ struct flb_upstream_conn *flb_upstream_conn_get(struct flb_upstream *u)
      * If we are in keepalive mode, iterate list of available connections,
      * take a little of time to do some cleanup and assign a connection. If no
      * entries exists, just create a new one.
+     *
+     * Connections are bound to the event loop of the thread that created
+     * them, so only the ones that belongs to the running thread can be
+     * reused.
      */
+    evl = flb_output_worker_evl_get();
+    if (!evl) {
+        evl = u->evl;
+    }
+
+    pthread_mutex_lock(&u->mutex);
     mk_list_foreach_safe(head, tmp, &u->av_queue) {
         conn = mk_list_entry(head, struct flb_upstream_conn, _head);
+        if (conn->evl != evl) {
+            conn = NULL;
+            continue;
+        }
 
         /* This connection works, let's move it to the busy queue */
         mk_list_del(&conn->_head);
         mk_list_add(&conn->_head, &u->busy_queue);
+        pthread_mutex_unlock(&u->mutex);
 
         /* Reset errno */
         conn->net_error = -1;
@@ -354,6 +386,7 @@ struct flb_upstream_conn *flb_upstream_conn_get(struct flb_upstream *u)
          */
         return conn;
     }
+    pthread_mutex_unlock(&u->mutex);
 
     /* No keepalive connection available, create a new one */
     if (!conn) {
@@ -393,8 +426,10 @@ int flb_upstream_conn_release(struct flb_upstream_conn *conn)
          * This connection is still useful, move it to the 'available' queue and
          * initialize variables.
          */
+        pthread_mutex_lock(&u->mutex);
         mk_list_del(&conn->_head);
         mk_list_add(&conn->_head, &conn->u->av_queue);
+        pthread_mutex_unlock(&u->mutex);
         conn->ts_available = time(NULL);
 
         /*
@@ -405,7 +440,7 @@ int flb_upstream_conn_release(struct flb_upstream_conn *conn)
         conn->event.handler = cb_upstream_conn_ka_dropped;
         conn->event.data    = &conn;
 
-        ret = mk_event_add(u->evl, conn->fd,
+        ret = mk_event_add(conn->evl, conn->fd,
                            FLB_ENGINE_EV_CUSTOM,
                            MK_EVENT_CLOSE, &conn->event);
         if (ret == -1) {
@@ -441,6 +476,8 @@ int flb_upstream_conn_timeouts(struct flb_config *ctx)
     mk_list_foreach(head, &ctx->upstreams) {
         u = mk_list_entry(head, struct flb_upstream, _head);
 
+        pthread_mutex_lock(&u->mutex);
+
         /* Iterate every busy connection */
         mk_list_foreach(u_head, &u->busy_queue) {
             u_conn = mk_list_entry(u_head, struct flb_upstream_conn, _head);
@@ -479,6 +516,8 @@ int flb_upstream_conn_timeouts(struct flb_config *ctx)
                           u->tcp_host, u->tcp_port);
             }
         }
+
+        pthread_mutex_unlock(&u->mutex);
     }
 
     return 0;
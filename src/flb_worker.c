@@ -80,6 +80,9 @@ int flb_worker_create(void (*func) (void *), void *arg, pthread_t *tid,
     worker->data   = arg;
     worker->config = config;
     worker->log_ctx = config->log;
+    worker->log_ring = NULL;
+    worker->log_cache = NULL;
+    worker->log_dropped = 0;
 
     /* Initialize log-specific */
     ret = flb_log_worker_init(worker);
@@ -142,6 +145,7 @@ int flb_worker_exit(struct flb_config *config)
     mk_list_foreach_safe(head, tmp, &config->workers) {
         worker = mk_list_entry(head, struct flb_worker, _head);
         mk_list_del(&worker->_head);
+        flb_log_worker_destroy(worker);
         flb_free(worker);
         c++;
     }
@@ -1026,6 +1026,7 @@ int flb_main(int argc, char **argv)
     /* Prepare pthread keys */
     flb_thread_prepare();
     flb_output_prepare();
+    flb_output_worker_prepare();
 
 #ifdef FLB_SYSTEM_WINDOWS
     win32_started();
@@ -0,0 +1,68 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_BENCH_H
+#define FLB_BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Default number of iterations, override with the first argument */
+#define FLB_BENCH_ITERATIONS  200000
+
+static inline uint64_t bench_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static inline int bench_iterations(int argc, char **argv)
+{
+    int n;
+
+    if (argc > 1) {
+        n = atoi(argv[1]);
+        if (n > 0) {
+            return n;
+        }
+    }
+    return FLB_BENCH_ITERATIONS;
+}
+
+/* Print a result line: ns per operation and throughput */
+static inline void bench_report(const char *name, const char *path,
+                                int iterations, size_t bytes,
+                                uint64_t elapsed)
+{
+    double ns_op;
+    double mb_s;
+
+    ns_op = (double) elapsed / iterations;
+    mb_s = ((double) bytes * iterations / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0);
+
+    printf("%-22s %-8s %10.1f ns/op %10.1f MB/s\n", name, path, ns_op, mb_s);
+}
+
+#endif
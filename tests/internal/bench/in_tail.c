@@ -0,0 +1,175 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Tail benchmark: writes a file with a fixed number of lines and measures
+ * the time the pipeline takes to read it (files found at startup are read
+ * from the head) until every record reached a 'lib' output. The output
+ * only counts records, so the numbers are dominated by in_tail and the
+ * engine.
+ */
+
+#include <fluent-bit.h>
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_time.h>
+#include <unistd.h>
+
+#include "flb_bench.h"
+
+/* Give up if the pipeline did not deliver every record after this */
+#define BENCH_TIMEOUT_SEC  120
+
+struct bench_tail {
+    char *name;
+    char *line;
+    char *docker_mode;
+};
+
+static struct bench_tail samples[] = {
+    {"plain",
+     "10.0.0.12 - - [15/Jul/2020:10:21:33 +0000] \"GET /api/v1/items?page=2 "
+     "HTTP/1.1\" 200 5316 \"-\" \"curl/7.68.0\"",
+     "off"},
+
+    {"docker",
+     "{\"log\":\"10.0.0.12 - - [15/Jul/2020:10:21:33 +0000] \\\"GET /api/v1/"
+     "items?page=2 HTTP/1.1\\\" 200 5316 \\\"-\\\" \\\"curl/7.68.0\\\"\\n\","
+     "\"stream\":\"stdout\",\"time\":\"2020-07-15T10:21:33.123456789Z\"}",
+     "on"},
+
+    {0}
+};
+
+static volatile int records;
+
+static int cb_count(void *record, size_t size, void *data)
+{
+    (void) size;
+    (void) data;
+
+    records++;
+    flb_free(record);
+    return 0;
+}
+
+static int write_file(char *path, char *line, int lines)
+{
+    int i;
+    FILE *fp;
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        perror("fopen");
+        return -1;
+    }
+
+    for (i = 0; i < lines; i++) {
+        fprintf(fp, "%s\n", line);
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+static int run(struct bench_tail *s, char *path, int lines, uint64_t *elapsed)
+{
+    int ret;
+    int in_ffd;
+    int out_ffd;
+    uint64_t t;
+    uint64_t timeout;
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb;
+
+    records = 0;
+    cb.cb = cb_count;
+    cb.data = NULL;
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "0.05", "Grace", "1", "Log_Level", "error",
+                    NULL);
+
+    in_ffd = flb_input(ctx, "tail", NULL);
+    flb_input_set(ctx, in_ffd,
+                  "tag", "bench",
+                  "path", path,
+                  "docker_mode", s->docker_mode,
+                  "buffer_chunk_size", "256k",
+                  "buffer_max_size", "256k",
+                  NULL);
+
+    out_ffd = flb_output(ctx, "lib", &cb);
+    flb_output_set(ctx, out_ffd, "match", "*", NULL);
+
+    t = bench_now();
+    timeout = t + (BENCH_TIMEOUT_SEC * 1000000000ULL);
+    ret = flb_start(ctx);
+    if (ret != 0) {
+        flb_destroy(ctx);
+        *elapsed = bench_now() - t;
+        return -1;
+    }
+
+    while (records < lines && bench_now() < timeout) {
+        usleep(1000);
+    }
+    *elapsed = bench_now() - t;
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+
+    return records == lines ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int ret;
+    int lines;
+    int errors = 0;
+    char path[64];
+    uint64_t elapsed;
+    struct bench_tail *s;
+
+    lines = bench_iterations(argc, argv) * 5;
+    printf("lines: %i\n", lines);
+
+    snprintf(path, sizeof(path) - 1, "/tmp/flb-bench-tail-%i.log", getpid());
+
+    for (i = 0; samples[i].name; i++) {
+        s = &samples[i];
+
+        ret = write_file(path, s->line, lines);
+        if (ret != 0) {
+            return EXIT_FAILURE;
+        }
+
+        ret = run(s, path, lines, &elapsed);
+        if (ret != 0) {
+            printf("%s: got %i records, expected %i\n", s->name, records, lines);
+            errors++;
+        }
+        bench_report(s->name, "tail", lines, strlen(s->line) + 1, elapsed);
+        unlink(path);
+    }
+
+    return errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,227 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Library ingestion benchmark: several threads push records into a 'lib'
+ * input, as JSON with flb_lib_push() or as msgpack batches with
+ * flb_lib_push_msgpack(), until every record reached a 'lib' output that
+ * only counts them. Producers retry when the input ring is busy.
+ */
+
+#include <fluent-bit.h>
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_time.h>
+#include <msgpack.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "flb_bench.h"
+
+#define PRODUCERS           4
+#define BATCH_RECORDS      64
+#define BENCH_TIMEOUT_SEC  120
+
+#define JSON_RECORD                                                     \
+    "[1594808493.123, {\"log\":\"10.0.0.12 GET /api/v1/items 200 5316\","  \
+    "\"stream\":\"stdout\",\"status\":200}]"
+
+struct producer {
+    int records;
+    int busy;
+    int msgpack;
+    int in_ffd;
+    flb_ctx_t *ctx;
+};
+
+static volatile int records;
+
+static int cb_count(void *record, size_t size, void *data)
+{
+    (void) size;
+    (void) data;
+
+    __atomic_add_fetch(&records, 1, __ATOMIC_RELAXED);
+    flb_free(record);
+    return 0;
+}
+
+static void pack_batch(msgpack_sbuffer *sbuf)
+{
+    int i;
+    msgpack_packer pck;
+    struct flb_time tm;
+
+    msgpack_packer_init(&pck, sbuf, msgpack_sbuffer_write);
+    flb_time_get(&tm);
+
+    for (i = 0; i < BATCH_RECORDS; i++) {
+        msgpack_pack_array(&pck, 2);
+        flb_time_append_to_msgpack(&tm, &pck, 0);
+        msgpack_pack_map(&pck, 3);
+        msgpack_pack_str(&pck, 3);
+        msgpack_pack_str_body(&pck, "log", 3);
+        msgpack_pack_str(&pck, 34);
+        msgpack_pack_str_body(&pck, "10.0.0.12 GET /api/v1/items 200 53", 34);
+        msgpack_pack_str(&pck, 6);
+        msgpack_pack_str_body(&pck, "stream", 6);
+        msgpack_pack_str(&pck, 6);
+        msgpack_pack_str_body(&pck, "stdout", 6);
+        msgpack_pack_str(&pck, 6);
+        msgpack_pack_str_body(&pck, "status", 6);
+        msgpack_pack_int(&pck, 200);
+    }
+}
+
+static void *producer_worker(void *data)
+{
+    int i;
+    int ret;
+    int step;
+    size_t len;
+    const char *buf;
+    msgpack_sbuffer sbuf;
+    struct producer *p = data;
+
+    msgpack_sbuffer_init(&sbuf);
+    if (p->msgpack) {
+        pack_batch(&sbuf);
+        buf = sbuf.data;
+        len = sbuf.size;
+        step = BATCH_RECORDS;
+    }
+    else {
+        buf = JSON_RECORD;
+        len = strlen(JSON_RECORD);
+        step = 1;
+    }
+
+    for (i = 0; i < p->records; i += step) {
+        while (1) {
+            if (p->msgpack) {
+                ret = flb_lib_push_msgpack(p->ctx, p->in_ffd, buf, len);
+            }
+            else {
+                ret = flb_lib_push(p->ctx, p->in_ffd, buf, len);
+            }
+            if (ret != FLB_LIB_BUSY) {
+                break;
+            }
+            p->busy++;
+            usleep(100);
+        }
+    }
+
+    msgpack_sbuffer_destroy(&sbuf);
+    return NULL;
+}
+
+static int run(int msgpack, int total, uint64_t *elapsed, int *busy)
+{
+    int i;
+    int ret;
+    int in_ffd;
+    int out_ffd;
+    uint64_t t;
+    uint64_t timeout;
+    flb_ctx_t *ctx;
+    pthread_t tid[PRODUCERS];
+    struct producer p[PRODUCERS];
+    struct flb_lib_out_cb cb;
+
+    records = 0;
+    cb.cb = cb_count;
+    cb.data = NULL;
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "0.05", "Grace", "1", "Log_Level", "error",
+                    NULL);
+
+    in_ffd = flb_input(ctx, "lib", NULL);
+    flb_input_set(ctx, in_ffd, "tag", "bench", NULL);
+
+    out_ffd = flb_output(ctx, "lib", &cb);
+    flb_output_set(ctx, out_ffd, "match", "*", NULL);
+
+    ret = flb_start(ctx);
+    if (ret != 0) {
+        flb_destroy(ctx);
+        return -1;
+    }
+
+    t = bench_now();
+    timeout = t + (BENCH_TIMEOUT_SEC * 1000000000ULL);
+    for (i = 0; i < PRODUCERS; i++) {
+        p[i].records = total / PRODUCERS;
+        p[i].busy = 0;
+        p[i].msgpack = msgpack;
+        p[i].in_ffd = in_ffd;
+        p[i].ctx = ctx;
+        pthread_create(&tid[i], NULL, producer_worker, &p[i]);
+    }
+
+    *busy = 0;
+    for (i = 0; i < PRODUCERS; i++) {
+        pthread_join(tid[i], NULL);
+        *busy += p[i].busy;
+    }
+
+    while (records < total && bench_now() < timeout) {
+        usleep(1000);
+    }
+    *elapsed = bench_now() - t;
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+
+    return records == total ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    int busy;
+    int total;
+    int errors = 0;
+    uint64_t elapsed;
+
+    /* a multiple of the producers and the batch size */
+    total = bench_iterations(argc, argv);
+    total -= total % (PRODUCERS * BATCH_RECORDS);
+    printf("records: %i, producers: %i\n", total, PRODUCERS);
+
+    ret = run(FLB_FALSE, total, &elapsed, &busy);
+    if (ret != 0) {
+        printf("json: got %i records, expected %i\n", records, total);
+        errors++;
+    }
+    bench_report("lib_push", "json", total, strlen(JSON_RECORD), elapsed);
+    printf("%-22s %-8s %10i busy\n", "lib_push", "json", busy);
+
+    ret = run(FLB_TRUE, total, &elapsed, &busy);
+    if (ret != 0) {
+        printf("msgpack: got %i records, expected %i\n", records, total);
+        errors++;
+    }
+    bench_report("lib_push", "msgpack", total, strlen(JSON_RECORD), elapsed);
+    printf("%-22s %-8s %10i busy\n", "lib_push", "msgpack", busy);
+
+    return errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * JSON to MessagePack benchmark: compares flb_pack_json() against the
+ * previous implementation, jsmn tokens converted to msgpack in a second
+ * pass. Both outputs are compared before measuring.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_unescape.h>
+#include <msgpack.h>
+
+#include "flb_bench.h"
+
+struct bench_json {
+    char *name;
+    char *json;
+};
+
+static struct bench_json samples[] = {
+    {"docker",
+     "{\"log\":\"10.0.0.12 - - [15/Jul/2020:10:21:33 +0000] \\\"GET /api/v1/"
+     "items?page=2 HTTP/1.1\\\" 200 5316 \\\"-\\\" \\\"curl/7.68.0\\\"\\n\","
+     "\"stream\":\"stdout\",\"time\":\"2020-07-15T10:21:33.123456789Z\"}"},
+
+    {"app",
+     "{\"level\":\"info\",\"ts\":1594808493.123,\"caller\":\"server/"
+     "handler.go:121\",\"msg\":\"request completed\",\"method\":\"GET\","
+     "\"path\":\"/api/v1/items\",\"status\":200,\"bytes\":5316,"
+     "\"duration_ms\":12.77,\"user_agent\":\"curl/7.68.0\","
+     "\"request_id\":\"9f5c1e0a-2b7d-4c38-8a3e-5f5b1c2d3e4f\","
+     "\"remote_ip\":\"10.0.0.12\",\"cached\":false,\"error\":null}"},
+
+    {"kubernetes",
+     "{\"log\":\"starting worker pool size=8\",\"stream\":\"stderr\","
+     "\"kubernetes\":{\"pod_name\":\"api-7d9f8b6c5-x2x4k\","
+     "\"namespace_name\":\"production\",\"pod_id\":\"4b5c6d7e-8f90-1a2b-"
+     "3c4d-5e6f7a8b9c0d\",\"labels\":{\"app\":\"api\",\"pod-template-hash\""
+     ":\"7d9f8b6c5\",\"tier\":\"backend\"},\"annotations\":{\"prometheus.io/"
+     "scrape\":\"true\",\"prometheus.io/port\":\"9102\"},\"host\":\"node-3\","
+     "\"container_name\":\"api\",\"docker_id\":\"0f1e2d3c4b5a69788796a5b4c3"
+     "d2e1f00f1e2d3c4b5a69788796a5b4c3d2e1f0\",\"container_image\":"
+     "\"registry.local/api:1.8.2\"}}"},
+
+    {"escapes",
+     "{\"log\":\"line one\\nline two\\ttabbed \\\"quoted\\\" \\u00e9t\\u00e9"
+     " path C:\\\\temp\\\\file.txt\\n\",\"stream\":\"stdout\"}"},
+
+    {0}
+};
+
+/* Previous implementation: JSMN tokens converted to msgpack */
+static char *legacy_tokens_to_msgpack(struct flb_pack_state *state,
+                                      const char *js, int *out_size)
+{
+    int i;
+    int flen;
+    int out_len;
+    const char *p;
+    const char *end;
+    jsmntok_t *t;
+    msgpack_packer pck;
+    msgpack_sbuffer sbuf;
+
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+
+    for (i = 0; i < state->tokens_count; i++) {
+        t = &state->tokens[i];
+        if (t->start == -1 || t->end == -1 || (t->start == 0 && t->end == 0)) {
+            break;
+        }
+
+        flen = (t->end - t->start);
+        switch (t->type) {
+        case JSMN_OBJECT:
+            msgpack_pack_map(&pck, t->size);
+            break;
+        case JSMN_ARRAY:
+            msgpack_pack_array(&pck, t->size);
+            break;
+        case JSMN_STRING:
+            if (state->buf_size < flen + 1) {
+                state->buf_data = flb_realloc(state->buf_data, flen + 1);
+                state->buf_size = flen + 1;
+            }
+            out_len = flb_unescape_string_utf8(js + t->start, flen,
+                                               state->buf_data);
+            msgpack_pack_str(&pck, out_len);
+            msgpack_pack_str_body(&pck, state->buf_data, out_len);
+            break;
+        case JSMN_PRIMITIVE:
+            p = js + t->start;
+            if (*p == 'f') {
+                msgpack_pack_false(&pck);
+            }
+            else if (*p == 't') {
+                msgpack_pack_true(&pck);
+            }
+            else if (*p == 'n') {
+                msgpack_pack_nil(&pck);
+            }
+            else {
+                end = p + flen;
+                while (p < end && *p != '.') {
+                    p++;
+                }
+                if (p < end) {
+                    msgpack_pack_double(&pck, atof(js + t->start));
+                }
+                else {
+                    msgpack_pack_int64(&pck, atol(js + t->start));
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    *out_size = sbuf.size;
+    return sbuf.data;
+}
+
+static int legacy_pack_json(const char *js, size_t len,
+                            char **out_buf, int *out_size)
+{
+    int ret;
+    struct flb_pack_state state;
+
+    ret = flb_pack_state_init(&state);
+    if (ret != 0) {
+        return -1;
+    }
+
+    ret = flb_json_tokenise(js, len, &state);
+    if (ret != 0 || state.tokens_count == 0) {
+        flb_pack_state_reset(&state);
+        return -1;
+    }
+
+    *out_buf = legacy_tokens_to_msgpack(&state, js, out_size);
+    flb_pack_state_reset(&state);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int n;
+    int ret;
+    int type;
+    int errors = 0;
+    int iterations;
+    int legacy_size;
+    char *legacy_buf;
+    char *buf;
+    size_t len;
+    size_t size;
+    uint64_t t;
+    struct bench_json *s;
+
+    iterations = bench_iterations(argc, argv);
+    printf("iterations: %i\n", iterations);
+
+    for (i = 0; samples[i].name; i++) {
+        s = &samples[i];
+        len = strlen(s->json);
+
+        /* Both implementations must generate the same output */
+        ret = flb_pack_json(s->json, len, &buf, &size, &type);
+        if (ret != 0) {
+            printf("%s: flb_pack_json() failed\n", s->name);
+            errors++;
+            continue;
+        }
+        ret = legacy_pack_json(s->json, len, &legacy_buf, &legacy_size);
+        if (ret != 0) {
+            printf("%s: legacy packer failed\n", s->name);
+            flb_free(buf);
+            errors++;
+            continue;
+        }
+        if (size != legacy_size || memcmp(buf, legacy_buf, size) != 0) {
+            printf("%s: output mismatch\n", s->name);
+            errors++;
+        }
+        flb_free(buf);
+        flb_free(legacy_buf);
+
+        t = bench_now();
+        for (n = 0; n < iterations; n++) {
+            legacy_pack_json(s->json, len, &legacy_buf, &legacy_size);
+            flb_free(legacy_buf);
+        }
+        bench_report(s->name, "jsmn", iterations, len, bench_now() - t);
+
+        t = bench_now();
+        for (n = 0; n < iterations; n++) {
+            flb_pack_json(s->json, len, &buf, &size, &type);
+            flb_free(buf);
+        }
+        bench_report(s->name, "one-pass", iterations, len, bench_now() - t);
+    }
+
+    return errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
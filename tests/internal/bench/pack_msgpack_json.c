@@ -0,0 +1,217 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * MessagePack to JSON benchmark: compares the streaming encoder used by
+ * flb_pack_msgpack_to_json_format() against the previous approach, a fixed
+ * buffer that is enlarged and encoded again from scratch when it's not
+ * big enough.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_time.h>
+#include <msgpack.h>
+
+#include "flb_bench.h"
+
+#define RECORDS  64
+
+/* Previous flb_msgpack_raw_to_json_sds(): retry with a bigger buffer */
+static flb_sds_t legacy_raw_to_json_sds(const void *in_buf, size_t in_size)
+{
+    int ret;
+    size_t off = 0;
+    size_t out_size;
+    msgpack_unpacked result;
+    flb_sds_t out_buf;
+    flb_sds_t tmp_buf;
+
+    out_size = in_size * 1.5;
+    out_buf = flb_sds_create_size(out_size);
+
+    msgpack_unpacked_init(&result);
+    msgpack_unpack_next(&result, in_buf, in_size, &off);
+
+    while (1) {
+        ret = flb_msgpack_to_json(out_buf, out_size, &result.data);
+        if (ret > 0) {
+            break;
+        }
+        tmp_buf = flb_sds_increase(out_buf, 256);
+        out_buf = tmp_buf;
+        out_size += 256;
+    }
+
+    msgpack_unpacked_destroy(&result);
+    flb_sds_len_set(out_buf, ret);
+
+    return out_buf;
+}
+
+/* Previous json_lines path: re-pack every record, encode it and append */
+static flb_sds_t legacy_json_lines(const char *data, size_t bytes,
+                                   flb_sds_t date_key)
+{
+    int i;
+    size_t off = 0;
+    flb_sds_t out_js;
+    flb_sds_t out_buf;
+    msgpack_unpacked result;
+    msgpack_object map;
+    msgpack_object *obj;
+    msgpack_sbuffer tmp_sbuf;
+    msgpack_packer tmp_pck;
+    struct flb_time tms;
+
+    out_buf = flb_sds_create_size(bytes * 1.25);
+    msgpack_sbuffer_init(&tmp_sbuf);
+    msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
+
+    msgpack_unpacked_init(&result);
+    while (msgpack_unpack_next(&result, data, bytes, &off) ==
+           MSGPACK_UNPACK_SUCCESS) {
+        flb_time_pop_from_msgpack(&tms, &result, &obj);
+        map = result.data.via.array.ptr[1];
+
+        msgpack_pack_map(&tmp_pck, map.via.map.size + 1);
+        msgpack_pack_str(&tmp_pck, flb_sds_len(date_key));
+        msgpack_pack_str_body(&tmp_pck, date_key, flb_sds_len(date_key));
+        msgpack_pack_double(&tmp_pck, flb_time_to_double(&tms));
+        for (i = 0; i < map.via.map.size; i++) {
+            msgpack_pack_object(&tmp_pck, map.via.map.ptr[i].key);
+            msgpack_pack_object(&tmp_pck, map.via.map.ptr[i].val);
+        }
+
+        out_js = legacy_raw_to_json_sds(tmp_sbuf.data, tmp_sbuf.size);
+        out_buf = flb_sds_cat(out_buf, out_js, flb_sds_len(out_js));
+        out_buf = flb_sds_cat(out_buf, "\n", 1);
+        flb_sds_destroy(out_js);
+        msgpack_sbuffer_clear(&tmp_sbuf);
+    }
+    msgpack_unpacked_destroy(&result);
+    msgpack_sbuffer_destroy(&tmp_sbuf);
+
+    return out_buf;
+}
+
+static void pack_records(msgpack_packer *pck, int log_size)
+{
+    int i;
+    char *log;
+    struct flb_time tm;
+
+    log = flb_malloc(log_size);
+    memset(log, 'x', log_size);
+    memcpy(log, "GET /index.html \"curl\" \xc3\xa1\t", 27);
+
+    flb_time_get(&tm);
+    for (i = 0; i < RECORDS; i++) {
+        msgpack_pack_array(pck, 2);
+        flb_time_append_to_msgpack(&tm, pck, 0);
+        msgpack_pack_map(pck, 4);
+        msgpack_pack_str(pck, 3);
+        msgpack_pack_str_body(pck, "log", 3);
+        msgpack_pack_str(pck, log_size);
+        msgpack_pack_str_body(pck, log, log_size);
+        msgpack_pack_str(pck, 6);
+        msgpack_pack_str_body(pck, "stream", 6);
+        msgpack_pack_str(pck, 6);
+        msgpack_pack_str_body(pck, "stdout", 6);
+        msgpack_pack_str(pck, 6);
+        msgpack_pack_str_body(pck, "status", 6);
+        msgpack_pack_int(pck, 200);
+        msgpack_pack_str(pck, 8);
+        msgpack_pack_str_body(pck, "duration", 8);
+        msgpack_pack_double(pck, 12.77);
+    }
+
+    flb_free(log);
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int n;
+    int errors = 0;
+    int iterations;
+    int sizes[] = {100, 1000, 16000};
+    char name[32];
+    uint64_t t;
+    flb_sds_t out;
+    flb_sds_t legacy;
+    flb_sds_t date_key;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+
+    iterations = bench_iterations(argc, argv) / 100;
+    if (iterations <= 0) {
+        iterations = 1;
+    }
+    printf("iterations: %i (%i records each)\n", iterations, RECORDS);
+
+    date_key = flb_sds_create("date");
+
+    for (i = 0; i < sizeof(sizes) / sizeof(int); i++) {
+        msgpack_sbuffer_init(&mp_sbuf);
+        msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+        pack_records(&mp_pck, sizes[i]);
+        snprintf(name, sizeof(name) - 1, "json_lines_%i", sizes[i]);
+
+        /* Both implementations must generate the same output */
+        out = flb_pack_msgpack_to_json_format(mp_sbuf.data, mp_sbuf.size,
+                                              FLB_PACK_JSON_FORMAT_LINES,
+                                              FLB_PACK_JSON_DATE_DOUBLE,
+                                              date_key);
+        legacy = legacy_json_lines(mp_sbuf.data, mp_sbuf.size, date_key);
+        if (!out || strcmp(out, legacy) != 0) {
+            printf("%s: output mismatch\n", name);
+            errors++;
+        }
+        flb_sds_destroy(out);
+        flb_sds_destroy(legacy);
+
+        t = bench_now();
+        for (n = 0; n < iterations; n++) {
+            legacy = legacy_json_lines(mp_sbuf.data, mp_sbuf.size, date_key);
+            flb_sds_destroy(legacy);
+        }
+        bench_report(name, "retry", iterations, mp_sbuf.size,
+                     bench_now() - t);
+
+        t = bench_now();
+        for (n = 0; n < iterations; n++) {
+            out = flb_pack_msgpack_to_json_format(mp_sbuf.data, mp_sbuf.size,
+                                                  FLB_PACK_JSON_FORMAT_LINES,
+                                                  FLB_PACK_JSON_DATE_DOUBLE,
+                                                  date_key);
+            flb_sds_destroy(out);
+        }
+        bench_report(name, "stream", iterations, mp_sbuf.size,
+                     bench_now() - t);
+
+        msgpack_sbuffer_destroy(&mp_sbuf);
+    }
+
+    flb_sds_destroy(date_key);
+    return errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
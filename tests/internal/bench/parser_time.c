@@ -0,0 +1,119 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Time_Format benchmark: time strings parsed with strptime(3) and timegm(3)
+ * as the parsers did before, against the compiled decoder and the cached
+ * day conversion. Both results are compared before measuring.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_parser.h>
+#include <fluent-bit/flb_parser_time.h>
+
+#include <string.h>
+#include <time.h>
+
+#include "flb_bench.h"
+
+struct bench_time {
+    char *name;
+    char *fmt;
+    char *time;
+};
+
+static struct bench_time samples[] = {
+    {"iso8601", "%Y-%m-%dT%H:%M:%S%z"  , "2020-07-15T10:21:33+0000"},
+    {"clf"    , "%d/%b/%Y:%H:%M:%S %z" , "15/Jul/2020:10:21:33 +0000"},
+    {"rfc3164", "%Y %b %d %H:%M:%S"    , "2020 Jul 15 10:21:33"},
+    {"epoch"  , "%s"                   , "1594808493"},
+    {0}
+};
+
+static time_t legacy_parse(struct bench_time *b, int i)
+{
+    struct tm tm = {0};
+
+    strptime(b->time, b->fmt, &tm);
+    tm.tm_sec = i % 60;
+    return flb_parser_tm2time(&tm);
+}
+
+static time_t compiled_parse(struct flb_parser *parser,
+                             struct bench_time *b, size_t len, int i)
+{
+    double ns;
+    struct tm tm = {0};
+
+    flb_parser_time_decode(parser->time_decoder, b->time, len, &tm, &ns);
+    tm.tm_sec = i % 60;
+    return flb_parser_time_epoch(parser, &tm);
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int iterations;
+    size_t len;
+    time_t sum;
+    uint64_t t;
+    struct flb_parser parser;
+    struct bench_time *b;
+
+    iterations = bench_iterations(argc, argv);
+
+    for (b = samples; b->name; b++) {
+        memset(&parser, '\0', sizeof(parser));
+        parser.time_decoder = flb_parser_time_compile(b->fmt);
+        if (!parser.time_decoder) {
+            printf("%s: format not compiled\n", b->name);
+            return EXIT_FAILURE;
+        }
+        len = strlen(b->time);
+
+        if (strcmp(b->fmt, "%s") != 0 &&
+            legacy_parse(b, 7) != compiled_parse(&parser, b, len, 7)) {
+            printf("%s: results differ\n", b->name);
+            return EXIT_FAILURE;
+        }
+
+        sum = 0;
+        t = bench_now();
+        for (i = 0; i < iterations; i++) {
+            sum += legacy_parse(b, i);
+        }
+        bench_report(b->name, "strptime", iterations, len, bench_now() - t);
+
+        t = bench_now();
+        for (i = 0; i < iterations; i++) {
+            sum -= compiled_parse(&parser, b, len, i);
+        }
+        bench_report(b->name, "compiled", iterations, len, bench_now() - t);
+
+        if (sum != 0 && strcmp(b->fmt, "%s") != 0) {
+            printf("%s: results differ\n", b->name);
+            return EXIT_FAILURE;
+        }
+        flb_parser_time_destroy(parser.time_decoder);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Scheduler benchmark: keeps N retry requests pending in the timer wheel
+ * (100k by default), cancels half of them and fires the rest by advancing
+ * the wheel over the whole backoff range.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_scheduler.h>
+
+#include "flb_bench.h"
+
+#define PENDING_RETRIES  100000
+
+static void report(const char *name, int ops, uint64_t elapsed)
+{
+    printf("%-22s %10i ops %10.1f ns/op\n", name, ops,
+           (double) elapsed / (ops > 0 ? ops : 1));
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int n;
+    int ret;
+    int fired = 0;
+    int cancelled = 0;
+    int errors = 0;
+    time_t now;
+    uint64_t t;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct mk_list expired;
+    struct flb_config *config;
+    struct flb_sched *sched;
+    struct flb_sched_request *request;
+    struct flb_task_retry *retries;
+
+    n = PENDING_RETRIES;
+    if (argc > 1 && atoi(argv[1]) > 0) {
+        n = atoi(argv[1]);
+    }
+    printf("pending retries: %i\n", n);
+
+    config = flb_config_init();
+    if (!config) {
+        return 1;
+    }
+    config->evl = mk_event_loop_create(8);
+    if (!config->evl || flb_sched_init(config) != 0) {
+        flb_config_exit(config);
+        return 1;
+    }
+    sched = config->sched;
+
+    retries = flb_calloc(n, sizeof(struct flb_task_retry));
+    if (!retries) {
+        flb_config_exit(config);
+        return 1;
+    }
+
+    /* Schedule all the retries, the attempts spread the backoff range */
+    t = bench_now();
+    for (i = 0; i < n; i++) {
+        ret = flb_sched_request_create(config, &retries[i], (i % 10) + 1);
+        if (ret == -1) {
+            errors++;
+        }
+    }
+    report("request_create", n, bench_now() - t);
+
+    /* Cancel every other retry */
+    t = bench_now();
+    for (i = 0; i < n; i += 2) {
+        ret = flb_sched_request_invalidate(config, &retries[i]);
+        if (ret == 0) {
+            cancelled++;
+        }
+    }
+    report("request_invalidate", cancelled, bench_now() - t);
+
+    /* One tick per second over the whole backoff range */
+    now = sched->wheel.now;
+    t = bench_now();
+    for (i = 0; i <= FLB_SCHED_CAP + 1; i++) {
+        now++;
+        mk_list_init(&expired);
+        flb_sched_wheel_advance(sched, now, &expired);
+        mk_list_foreach_safe(head, tmp, &expired) {
+            request = mk_list_entry(head, struct flb_sched_request, _head);
+            flb_sched_request_destroy(config, request);
+            fired++;
+        }
+    }
+    report("wheel_advance", fired, bench_now() - t);
+    printf("%-22s %10i ticks\n", "ticks", FLB_SCHED_CAP + 2);
+
+    if (fired + cancelled != n || sched->wheel.count != 0) {
+        printf("error: fired=%i cancelled=%i pending=%i\n",
+               fired, cancelled, sched->wheel.count);
+        errors++;
+    }
+
+    flb_free(retries);
+    flb_config_exit(config);
+
+    return errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,178 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_compress.h>
+
+#include "flb_tests_internal.h"
+
+/* Sample data */
+static char *morpheus = "This is your last chance. After this, there is no "
+    "turning back. You take the blue pill - the story ends, you wake up in "
+    "your bed and believe whatever you want to believe. You take the red pill,"
+    "you stay in Wonderland and I show you how deep the rabbit-hole goes.";
+
+static char *codecs[] = {"gzip", "zstd", "lz4", "snappy", NULL};
+
+/* Compress and uncompress the buffer with every available codec */
+static void check_roundtrip(const char *data, size_t size, int level)
+{
+    int i;
+    int ret;
+    void *out_buf;
+    size_t out_size;
+    void *buf;
+    size_t len;
+    struct flb_compress_codec *codec;
+
+    for (i = 0; codecs[i]; i++) {
+        codec = flb_compress_codec_get(codecs[i]);
+        if (!codec) {
+            continue;
+        }
+
+        ret = flb_compress_buffer(codec, level, data, size,
+                                  &out_buf, &out_size);
+        TEST_CHECK(ret == 0);
+        TEST_MSG("codec: %s", codec->name);
+
+        ret = flb_uncompress_buffer(codec, out_buf, out_size, &buf, &len);
+        TEST_CHECK(ret == 0);
+        TEST_MSG("codec: %s", codec->name);
+        if (ret == 0) {
+            TEST_CHECK(len == size);
+            TEST_CHECK(memcmp(buf, data, size) == 0);
+            TEST_MSG("codec: %s", codec->name);
+            flb_free(buf);
+        }
+        flb_free(out_buf);
+    }
+}
+
+void test_lookup()
+{
+    struct flb_compress_codec *codec;
+
+    codec = flb_compress_codec_get("GZIP");
+    TEST_CHECK(codec != NULL);
+    TEST_CHECK(codec->type == FLB_COMPRESS_GZIP);
+    TEST_CHECK(strcmp(codec->encoding, "gzip") == 0);
+    TEST_CHECK(flb_compress_codec_lookup(FLB_COMPRESS_GZIP) == codec);
+
+    TEST_CHECK(flb_compress_codec_get("brotli") == NULL);
+    TEST_CHECK(flb_compress_codec_lookup(FLB_COMPRESS_NONE) == NULL);
+}
+
+void test_buffer()
+{
+    check_roundtrip(morpheus, strlen(morpheus), FLB_COMPRESS_LEVEL_DEFAULT);
+    check_roundtrip(morpheus, strlen(morpheus), 1);
+    check_roundtrip("", 0, FLB_COMPRESS_LEVEL_DEFAULT);
+}
+
+void test_stream()
+{
+    int i;
+    int n;
+    int ret;
+    size_t len;
+    size_t size;
+    size_t out_size;
+    char *data;
+    void *out_buf;
+    void *buf;
+    struct flb_compress *ctx;
+    struct flb_compress_codec *codec;
+
+    /* ~1MB, bigger than any internal buffer of the codecs */
+    len = strlen(morpheus);
+    size = len * 4096;
+    data = flb_malloc(size);
+    TEST_CHECK(data != NULL);
+    for (n = 0; n < 4096; n++) {
+        memcpy(data + (n * len), morpheus, len);
+        data[n * len] = n & 0xff;
+    }
+
+    for (i = 0; codecs[i]; i++) {
+        codec = flb_compress_codec_get(codecs[i]);
+        if (!codec) {
+            continue;
+        }
+
+        ctx = flb_compress_create(codec, FLB_COMPRESS_LEVEL_DEFAULT);
+        TEST_CHECK(ctx != NULL);
+
+        /* Feed the data in small pieces */
+        for (n = 0; n < 4096; n++) {
+            ret = flb_compress_update(ctx, data + (n * len), len);
+            TEST_CHECK(ret == 0);
+        }
+        ret = flb_compress_finish(ctx, &out_buf, &out_size);
+        TEST_CHECK(ret == 0);
+        flb_compress_destroy(ctx);
+
+        TEST_CHECK(out_size < size);
+        TEST_MSG("codec: %s, size: %zu", codec->name, out_size);
+
+        ret = flb_uncompress_buffer(codec, out_buf, out_size, &buf, &len);
+        TEST_CHECK(ret == 0);
+        if (ret == 0) {
+            TEST_CHECK(len == size);
+            TEST_CHECK(memcmp(buf, data, size) == 0);
+            TEST_MSG("codec: %s", codec->name);
+            flb_free(buf);
+        }
+        flb_free(out_buf);
+        len = strlen(morpheus);
+    }
+
+    check_roundtrip(data, size, FLB_COMPRESS_LEVEL_DEFAULT);
+    flb_free(data);
+}
+
+/* The gzip codec must interoperate with flb_gzip */
+void test_gzip_compat()
+{
+    int ret;
+    size_t len;
+    size_t out_size;
+    void *out_buf;
+    void *buf;
+    struct flb_compress_codec *codec;
+
+    codec = flb_compress_codec_lookup(FLB_COMPRESS_GZIP);
+
+    ret = flb_compress_buffer(codec, 9, morpheus, strlen(morpheus),
+                              &out_buf, &out_size);
+    TEST_CHECK(ret == 0);
+    ret = flb_gzip_uncompress(out_buf, out_size, &buf, &len);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(len == strlen(morpheus));
+    TEST_CHECK(memcmp(buf, morpheus, len) == 0);
+    flb_free(out_buf);
+    flb_free(buf);
+
+    ret = flb_gzip_compress(morpheus, strlen(morpheus), &out_buf, &out_size);
+    TEST_CHECK(ret == 0);
+    ret = flb_uncompress_buffer(codec, out_buf, out_size, &buf, &len);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(len == strlen(morpheus));
+    TEST_CHECK(memcmp(buf, morpheus, len) == 0);
+
+    /* corrupt the CRC32 */
+    ((char *) out_buf)[out_size - 8] ^= 0xff;
+    flb_free(buf);
+    ret = flb_uncompress_buffer(codec, out_buf, out_size, &buf, &len);
+    TEST_CHECK(ret == -1);
+    flb_free(out_buf);
+}
+
+TEST_LIST = {
+    {"lookup", test_lookup},
+    {"buffer", test_buffer},
+    {"stream", test_stream},
+    {"gzip_compat", test_gzip_compat},
+    { 0 }
+};
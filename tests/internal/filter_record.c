@@ -0,0 +1,160 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_filter_record.h>
+#include <msgpack.h>
+
+#include "flb_tests_internal.h"
+
+/* Pack a test record: [123, {"a": 1, "b": "x"}] */
+static void pack_record(msgpack_sbuffer *mp_sbuf)
+{
+    msgpack_packer mp_pck;
+
+    msgpack_sbuffer_init(mp_sbuf);
+    msgpack_packer_init(&mp_pck, mp_sbuf, msgpack_sbuffer_write);
+
+    msgpack_pack_array(&mp_pck, 2);
+    msgpack_pack_uint64(&mp_pck, 123);
+    msgpack_pack_map(&mp_pck, 2);
+    msgpack_pack_str(&mp_pck, 1);
+    msgpack_pack_str_body(&mp_pck, "a", 1);
+    msgpack_pack_int(&mp_pck, 1);
+    msgpack_pack_str(&mp_pck, 1);
+    msgpack_pack_str_body(&mp_pck, "b", 1);
+    msgpack_pack_str(&mp_pck, 1);
+    msgpack_pack_str_body(&mp_pck, "x", 1);
+}
+
+/* Serialize the record view and compare it as JSON */
+static void check_json(struct flb_filter_record *r, char *expected)
+{
+    int ret;
+    size_t off = 0;
+    char json[256];
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+    msgpack_unpacked result;
+
+    msgpack_sbuffer_init(&mp_sbuf);
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+    ret = flb_filter_record_pack(r, &mp_pck);
+    TEST_CHECK(ret == 0);
+
+    msgpack_unpacked_init(&result);
+    ret = msgpack_unpack_next(&result, mp_sbuf.data, mp_sbuf.size, &off);
+    TEST_CHECK(ret == MSGPACK_UNPACK_SUCCESS);
+
+    ret = flb_msgpack_to_json(json, sizeof(json), &result.data);
+    TEST_CHECK(ret > 0);
+    TEST_CHECK(strcmp(json, expected) == 0);
+    TEST_MSG("expected: %s, got: %s", expected, json);
+
+    msgpack_unpacked_destroy(&result);
+    msgpack_sbuffer_destroy(&mp_sbuf);
+}
+
+void test_record_edits()
+{
+    int ret;
+    int idx;
+    size_t off = 0;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_unpacked result;
+    msgpack_object val;
+    struct flb_filter_record r;
+
+    pack_record(&mp_sbuf);
+
+    ret = flb_filter_record_init(&r);
+    TEST_CHECK(ret == 0);
+
+    msgpack_unpacked_init(&result);
+    msgpack_unpack_next(&result, mp_sbuf.data, mp_sbuf.size, &off);
+
+    ret = flb_filter_record_load(&r, &result.data, mp_sbuf.data, off);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(r.tm.tm.tv_sec == 123);
+    TEST_CHECK(flb_filter_record_entries(&r) == 2);
+
+    /* Untouched record is copied as it is */
+    check_json(&r, "[123,{\"a\":1,\"b\":\"x\"}]");
+
+    /* Lookups */
+    TEST_CHECK(flb_filter_record_key_find(&r, "a", 1) == 0);
+    TEST_CHECK(flb_filter_record_key_find(&r, "b", 1) == 1);
+    TEST_CHECK(flb_filter_record_key_find(&r, "c", 1) == -1);
+
+    /* Rename, remove and add */
+    ret = flb_filter_record_rename(&r, 0, "new_a", 5);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_filter_record_key_find(&r, "a", 1) == -1);
+    TEST_CHECK(flb_filter_record_key_find(&r, "new_a", 5) == 0);
+
+    idx = flb_filter_record_key_find(&r, "b", 1);
+    ret = flb_filter_record_remove(&r, idx);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_filter_record_key_find(&r, "b", 1) == -1);
+
+    ret = flb_filter_record_add_str(&r, "c", 1, "zz", 2);
+    TEST_CHECK(ret == 2);
+
+    val = r.kv[0].val;
+    ret = flb_filter_record_add(&r, "d", 1, &val);
+    TEST_CHECK(ret == 3);
+
+    /* Empty strings don't need a source buffer */
+    ret = flb_filter_record_add_str(&r, "e", 1, NULL, 0);
+    TEST_CHECK(ret == 4);
+
+    TEST_CHECK(r.modified == FLB_TRUE);
+    TEST_CHECK(flb_filter_record_entries(&r) == 4);
+    check_json(&r, "[123,{\"new_a\":1,\"c\":\"zz\",\"d\":1,\"e\":\"\"}]");
+
+    /* Reload: the edit log is reset */
+    ret = flb_filter_record_load(&r, &result.data, mp_sbuf.data, off);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(r.modified == FLB_FALSE);
+    check_json(&r, "[123,{\"a\":1,\"b\":\"x\"}]");
+
+    msgpack_unpacked_destroy(&result);
+    msgpack_sbuffer_destroy(&mp_sbuf);
+    flb_filter_record_destroy(&r);
+}
+
+void test_record_invalid()
+{
+    int ret;
+    size_t off = 0;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+    msgpack_unpacked result;
+    struct flb_filter_record r;
+
+    /* A map is not a valid record */
+    msgpack_sbuffer_init(&mp_sbuf);
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+    msgpack_pack_map(&mp_pck, 0);
+
+    ret = flb_filter_record_init(&r);
+    TEST_CHECK(ret == 0);
+
+    msgpack_unpacked_init(&result);
+    msgpack_unpack_next(&result, mp_sbuf.data, mp_sbuf.size, &off);
+
+    ret = flb_filter_record_load(&r, &result.data, mp_sbuf.data, off);
+    TEST_CHECK(ret == -1);
+
+    msgpack_unpacked_destroy(&result);
+    msgpack_sbuffer_destroy(&mp_sbuf);
+    flb_filter_record_destroy(&r);
+}
+
+TEST_LIST = {
+    { "edits"  , test_record_edits},
+    { "invalid", test_record_invalid},
+    { 0 }
+};
@@ -40,7 +40,34 @@ void test_compress()
     flb_free(str);
 }
 
+/* Content of 'gzip' with an original file name in the header */
+void test_uncompress_header()
+{
+    int ret;
+    void *str;
+    size_t len;
+    char in_data[] =
+        "\x1f\x8b\x08\x08\x00\x00\x00\x00\x02\xff\x61\x2e\x74\x78"
+        "\x74\x00\xcb\x48\xcd\xc9\xc9\x57\x48\xaf\xca\x2c\x00\x00"
+        "\x19\x6a\xd2\xdf\x0a\x00\x00\x00";
+    size_t in_len = sizeof(in_data) - 1;
+
+    ret = flb_gzip_uncompress(in_data, in_len, &str, &len);
+    TEST_CHECK(ret == 0);
+    if (ret == 0) {
+        TEST_CHECK(len == 10);
+        TEST_CHECK(memcmp(str, "hello gzip", 10) == 0);
+        flb_free(str);
+    }
+
+    /* corrupt the CRC32 */
+    in_data[in_len - 8] ^= 0xff;
+    ret = flb_gzip_uncompress(in_data, in_len, &str, &len);
+    TEST_CHECK(ret == -1);
+}
+
 TEST_LIST = {
     {"compress", test_compress},
+    {"uncompress_header", test_uncompress_header},
     { 0 }
 };
@@ -0,0 +1,136 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_chunk.h>
+#include <fluent-bit/flb_metrics.h>
+#include <fluent-bit/flb_storage.h>
+#include <fluent-bit/flb_time.h>
+#include <msgpack.h>
+
+#include "flb_tests_internal.h"
+
+#define CHUNK_RECORDS 3
+
+/* Pack CHUNK_RECORDS records stamped 100.000000001, 101.000000001 ... */
+static void pack_records(msgpack_sbuffer *mp_sbuf)
+{
+    int i;
+    struct flb_time tm;
+    msgpack_packer mp_pck;
+
+    msgpack_sbuffer_init(mp_sbuf);
+    msgpack_packer_init(&mp_pck, mp_sbuf, msgpack_sbuffer_write);
+
+    for (i = 0; i < CHUNK_RECORDS; i++) {
+        flb_time_set(&tm, 100 + i, 1);
+        msgpack_pack_array(&mp_pck, 2);
+        flb_time_append_to_msgpack(&tm, &mp_pck, 0);
+        msgpack_pack_map(&mp_pck, 1);
+        msgpack_pack_str(&mp_pck, 1);
+        msgpack_pack_str_body(&mp_pck, "a", 1);
+        msgpack_pack_int(&mp_pck, i);
+    }
+}
+
+static void check_stats(struct flb_input_chunk *ic)
+{
+    TEST_CHECK(ic->total_records == CHUNK_RECORDS);
+    TEST_MSG("total_records=%i", ic->total_records);
+    TEST_CHECK(ic->tm_min.tm.tv_sec == 100 && ic->tm_min.tm.tv_nsec == 1);
+    TEST_CHECK(ic->tm_max.tm.tv_sec == 100 + CHUNK_RECORDS - 1 &&
+               ic->tm_max.tm.tv_nsec == 1);
+}
+
+/*
+ * Appends only mark the stats header as dirty: a chunk left behind by a
+ * process that died before writing it must be counted again when mapped.
+ */
+void test_input_chunk_map_stale()
+{
+    int ret;
+    void *chunk;
+    msgpack_sbuffer mp_sbuf;
+    struct flb_config *config;
+    struct flb_input_instance *in;
+    struct flb_input_chunk *ic;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+    if (!config) {
+        return;
+    }
+
+    in = flb_input_new(config, "lib", NULL, FLB_TRUE);
+    TEST_CHECK(in != NULL);
+    ret = flb_storage_create(config);
+    TEST_CHECK(ret == 0);
+    if (!in || ret != 0) {
+        flb_config_exit(config);
+        return;
+    }
+
+#ifdef FLB_HAVE_METRICS
+    /* mapped chunks are accounted in the input metrics */
+    in->metrics = flb_metrics_create("lib.0");
+    flb_metrics_add(FLB_METRIC_N_RECORDS, "records", in->metrics);
+    flb_metrics_add(FLB_METRIC_N_BYTES, "bytes", in->metrics);
+#endif
+
+    ic = flb_input_chunk_create(in, "test", 4);
+    TEST_CHECK(ic != NULL);
+    if (!ic) {
+        flb_input_exit_all(config);
+        flb_storage_destroy(config);
+        flb_config_exit(config);
+        return;
+    }
+
+    pack_records(&mp_sbuf);
+    ret = flb_input_chunk_write(ic, mp_sbuf.data, mp_sbuf.size);
+    TEST_CHECK(ret == 0);
+    msgpack_sbuffer_destroy(&mp_sbuf);
+    check_stats(ic);
+
+    /* the process goes away, only the chunk with its create time header */
+    chunk = ic->chunk;
+    mk_list_del(&ic->_head);
+    flb_free(ic);
+
+    ic = flb_input_chunk_map(in, chunk);
+    TEST_CHECK(ic != NULL);
+    if (!ic) {
+        flb_input_exit_all(config);
+        flb_storage_destroy(config);
+        flb_config_exit(config);
+        return;
+    }
+    check_stats(ic);
+    TEST_CHECK(ic->meta_dirty == FLB_TRUE);
+
+    /* once written, the header matches the content and it's trusted */
+    flb_input_chunk_down(ic);
+    flb_input_chunk_set_up(ic);
+    chunk = ic->chunk;
+    mk_list_del(&ic->_head);
+    flb_free(ic);
+
+    ic = flb_input_chunk_map(in, chunk);
+    TEST_CHECK(ic != NULL);
+    if (ic) {
+        check_stats(ic);
+        TEST_CHECK(ic->meta_dirty == FLB_FALSE);
+        flb_input_chunk_destroy(ic, FLB_TRUE);
+    }
+
+    flb_input_exit_all(config);
+    flb_storage_destroy(config);
+    flb_config_exit(config);
+}
+
+TEST_LIST = {
+    {"map_stale", test_input_chunk_map_stale},
+    { 0 }
+};
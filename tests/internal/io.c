@@ -0,0 +1,661 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_io.h>
+#include <fluent-bit/flb_upstream.h>
+
+#ifdef FLB_HAVE_TLS
+#include <fluent-bit/flb_io_tls.h>
+#include <mbedtls/net.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/ssl_cache.h>
+#endif
+
+#ifdef FLB_HAVE_METRICS
+#include <fluent-bit/flb_metrics.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "flb_tests_internal.h"
+
+#define TLS_CERT  FLB_TESTS_DATA_PATH "/data/tls/certificate.pem"
+#define TLS_KEY   FLB_TESTS_DATA_PATH "/data/tls/private_key.pem"
+
+/*
+ * sendmsg(2) used by the plain TCP writes, when 'sendmsg_max' is set every
+ * call writes at most that number of bytes.
+ */
+static size_t sendmsg_max = 0;
+static int sendmsg_calls = 0;
+
+ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+    int i;
+    int cnt = 0;
+    size_t len = 0;
+    struct iovec vec[64];
+    (void) flags;
+
+    sendmsg_calls++;
+    if (sendmsg_max == 0) {
+        return writev(fd, msg->msg_iov, msg->msg_iovlen);
+    }
+
+    for (i = 0; i < msg->msg_iovlen && cnt < 64 && len < sendmsg_max; i++) {
+        vec[cnt] = msg->msg_iov[i];
+        if (len + vec[cnt].iov_len > sendmsg_max) {
+            vec[cnt].iov_len = sendmsg_max - len;
+        }
+        len += vec[cnt].iov_len;
+        cnt++;
+    }
+
+    return writev(fd, vec, cnt);
+}
+
+static int listener_create(int *port)
+{
+    int fd;
+    int on = 1;
+    socklen_t len;
+    struct sockaddr_in addr;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    len = sizeof(addr);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+        listen(fd, 8) == -1 ||
+        getsockname(fd, (struct sockaddr *) &addr, &len) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static struct flb_config *io_config()
+{
+    struct flb_config *config;
+
+    config = flb_config_init();
+    if (!config) {
+        return NULL;
+    }
+
+    /* connections register their events here */
+    config->evl = mk_event_loop_create(8);
+    if (!config->evl) {
+        flb_config_exit(config);
+        return NULL;
+    }
+
+    return config;
+}
+
+/* Blocking upstream without keepalive, released connections are closed */
+static struct flb_upstream *io_upstream(struct flb_config *config, int port,
+                                        int flags, void *tls)
+{
+    struct flb_upstream *u;
+
+    u = flb_upstream_create(config, "127.0.0.1", port, flags, tls);
+    if (!u) {
+        return NULL;
+    }
+    u->flags &= ~(FLB_IO_ASYNC);
+    u->net.keepalive = FLB_FALSE;
+
+    return u;
+}
+
+/* Fill 'cnt' vectors with a pattern, the concatenation is stored in 'out' */
+static size_t iov_fill(struct iovec *iov, int cnt, size_t *sizes, char *out)
+{
+    int i;
+    size_t j;
+    size_t total = 0;
+    char *buf;
+
+    for (i = 0; i < cnt; i++) {
+        buf = flb_malloc(sizes[i] + 1);
+        for (j = 0; j < sizes[i]; j++) {
+            buf[j] = (char) (i * 31 + j);
+        }
+        memcpy(out + total, buf, sizes[i]);
+        total += sizes[i];
+
+        iov[i].iov_base = buf;
+        iov[i].iov_len = sizes[i];
+    }
+
+    return total;
+}
+
+static void iov_free(struct iovec *iov, int cnt)
+{
+    int i;
+
+    for (i = 0; i < cnt; i++) {
+        flb_free(iov[i].iov_base);
+    }
+}
+
+/*
+ * Every sendmsg(2) call writes a few bytes: the write resumes in the middle
+ * of a vector, skips the empty ones and the caller vectors are not touched.
+ */
+void test_writev_partial()
+{
+    int i;
+    int ret;
+    int fd;
+    int lfd;
+    int port;
+    ssize_t bytes;
+    size_t total;
+    size_t out_len = 0;
+    size_t recv_len = 0;
+    size_t sizes[] = {1, 0, 5, 7, 8, 0, 13, 100, 1000, 3, 4096, 2};
+    int cnt = sizeof(sizes) / sizeof(size_t);
+    char expected[8192];
+    char received[8192];
+    struct iovec iov[12];
+    struct iovec iov_copy[12];
+    struct flb_config *config;
+    struct flb_upstream *u;
+    struct flb_upstream_conn *conn;
+
+    config = io_config();
+    TEST_CHECK(config != NULL);
+    if (!config) {
+        return;
+    }
+
+    lfd = listener_create(&port);
+    TEST_CHECK(lfd != -1);
+    if (lfd == -1) {
+        flb_config_exit(config);
+        return;
+    }
+
+    u = io_upstream(config, port, FLB_IO_TCP, NULL);
+    TEST_CHECK(u != NULL);
+    conn = flb_upstream_conn_get(u);
+    TEST_CHECK(conn != NULL);
+    if (!conn) {
+        close(lfd);
+        flb_upstream_destroy(u);
+        flb_config_exit(config);
+        return;
+    }
+    fd = accept(lfd, NULL, NULL);
+    TEST_CHECK(fd != -1);
+
+    total = iov_fill(iov, cnt, sizes, expected);
+    memcpy(iov_copy, iov, sizeof(iov));
+
+    sendmsg_max = 7;
+    sendmsg_calls = 0;
+    ret = flb_io_net_writev(conn, iov, cnt, &out_len);
+    sendmsg_max = 0;
+
+    TEST_CHECK(ret == total);
+    TEST_CHECK(out_len == total);
+    TEST_CHECK(sendmsg_calls == (total + 6) / 7);
+    TEST_MSG("calls=%i total=%zu", sendmsg_calls, total);
+    TEST_CHECK(memcmp(iov, iov_copy, sizeof(iov)) == 0);
+
+    while (recv_len < total) {
+        bytes = read(fd, received + recv_len, sizeof(received) - recv_len);
+        if (bytes <= 0) {
+            break;
+        }
+        recv_len += bytes;
+    }
+    TEST_CHECK(recv_len == total);
+    TEST_CHECK(memcmp(received, expected, total) == 0);
+
+    for (i = 0; i < cnt; i++) {
+        TEST_CHECK(iov[i].iov_len == sizes[i]);
+    }
+
+    iov_free(iov, cnt);
+    flb_upstream_conn_release(conn);
+    close(fd);
+    close(lfd);
+    flb_upstream_destroy(u);
+    flb_config_exit(config);
+}
+
+#ifdef FLB_HAVE_TLS
+
+/*
+ * TLS server, it reads the data of 'conns' connections. Sessions are cached
+ * so clients can resume them.
+ */
+struct tls_server {
+    int fd;
+    int port;
+    int conns;
+    int drop;                         /* connection closed before handshake */
+    int records;                      /* application data records */
+    size_t len;                       /* bytes received */
+    char buf[65536];
+    pthread_t tid;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_x509_crt cert;
+    mbedtls_pk_context key;
+    mbedtls_ssl_config conf;
+    mbedtls_ssl_cache_context cache;
+};
+
+static void tls_server_conn(struct tls_server *s, int fd)
+{
+    int ret;
+    unsigned char rbuf[32768];
+    mbedtls_ssl_context ssl;
+    mbedtls_net_context net;
+
+    net.fd = fd;
+    mbedtls_ssl_init(&ssl);
+    if (mbedtls_ssl_setup(&ssl, &s->conf) != 0) {
+        mbedtls_ssl_free(&ssl);
+        return;
+    }
+    mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+    if (mbedtls_ssl_handshake(&ssl) != 0) {
+        mbedtls_ssl_free(&ssl);
+        return;
+    }
+
+    /*
+     * The read buffer is bigger than a record, each read returns the
+     * content of a single record.
+     */
+    while (1) {
+        ret = mbedtls_ssl_read(&ssl, rbuf, sizeof(rbuf));
+        if (ret <= 0) {
+            break;
+        }
+        s->records++;
+        if (s->len + ret <= sizeof(s->buf)) {
+            memcpy(s->buf + s->len, rbuf, ret);
+        }
+        s->len += ret;
+    }
+
+    mbedtls_ssl_close_notify(&ssl);
+    mbedtls_ssl_free(&ssl);
+}
+
+static void *tls_server_worker(void *data)
+{
+    int i;
+    int fd;
+    struct tls_server *s = data;
+
+    for (i = 0; i < s->conns; i++) {
+        fd = accept(s->fd, NULL, NULL);
+        if (fd == -1) {
+            break;
+        }
+        if (i + 1 != s->drop) {
+            tls_server_conn(s, fd);
+        }
+        close(fd);
+    }
+
+    return NULL;
+}
+
+/* Serve 'conns' connections, the number 'drop' (from 1) is just closed */
+static int tls_server_start(struct tls_server *s, int conns, int drop)
+{
+    int ret;
+
+    memset(s, 0, sizeof(struct tls_server));
+    s->conns = conns;
+    s->drop = drop;
+
+    mbedtls_entropy_init(&s->entropy);
+    mbedtls_ctr_drbg_init(&s->ctr_drbg);
+    mbedtls_x509_crt_init(&s->cert);
+    mbedtls_pk_init(&s->key);
+    mbedtls_ssl_config_init(&s->conf);
+    mbedtls_ssl_cache_init(&s->cache);
+
+    ret = mbedtls_ctr_drbg_seed(&s->ctr_drbg, mbedtls_entropy_func,
+                                &s->entropy, NULL, 0);
+    if (ret == 0) {
+        ret = mbedtls_x509_crt_parse_file(&s->cert, TLS_CERT);
+    }
+    if (ret == 0) {
+        ret = mbedtls_pk_parse_keyfile(&s->key, TLS_KEY, NULL);
+    }
+    if (ret == 0) {
+        ret = mbedtls_ssl_config_defaults(&s->conf,
+                                          MBEDTLS_SSL_IS_SERVER,
+                                          MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (ret == 0) {
+        mbedtls_ssl_conf_rng(&s->conf, mbedtls_ctr_drbg_random, &s->ctr_drbg);
+        mbedtls_ssl_conf_session_cache(&s->conf, &s->cache,
+                                       mbedtls_ssl_cache_get,
+                                       mbedtls_ssl_cache_set);
+        ret = mbedtls_ssl_conf_own_cert(&s->conf, &s->cert, &s->key);
+    }
+    if (ret != 0) {
+        return -1;
+    }
+
+    s->fd = listener_create(&s->port);
+    if (s->fd == -1) {
+        return -1;
+    }
+
+    return pthread_create(&s->tid, NULL, tls_server_worker, s);
+}
+
+/* Wait for the connections to be served and release the server */
+static void tls_server_stop(struct tls_server *s)
+{
+    pthread_join(s->tid, NULL);
+    close(s->fd);
+
+    mbedtls_ssl_cache_free(&s->cache);
+    mbedtls_ssl_config_free(&s->conf);
+    mbedtls_pk_free(&s->key);
+    mbedtls_x509_crt_free(&s->cert);
+    mbedtls_ctr_drbg_free(&s->ctr_drbg);
+    mbedtls_entropy_free(&s->entropy);
+}
+
+static struct flb_tls_context *tls_context()
+{
+    return flb_tls_context_new(FLB_FALSE, -1, NULL, NULL, TLS_CERT,
+                               NULL, NULL, NULL);
+}
+
+/*
+ * Write the vectors over a new TLS connection, returns the number of
+ * records the server got.
+ */
+static int tls_writev_run(size_t *sizes, int cnt)
+{
+    int ret;
+    int records = -1;
+    size_t total;
+    size_t out_len = 0;
+    char *expected;
+    struct iovec *iov;
+    struct tls_server *s;
+    struct flb_tls tls;
+    struct flb_config *config;
+    struct flb_upstream *u;
+    struct flb_upstream_conn *conn;
+
+    s = flb_malloc(sizeof(struct tls_server));
+    iov = flb_malloc(sizeof(struct iovec) * cnt);
+    expected = flb_malloc(sizeof(s->buf));
+    config = io_config();
+    if (!s || !iov || !expected || !config) {
+        TEST_CHECK(FLB_FALSE);
+        goto exit;
+    }
+
+    ret = tls_server_start(s, 1, 0);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        goto exit;
+    }
+
+    tls.context = tls_context();
+    TEST_CHECK(tls.context != NULL);
+    u = io_upstream(config, s->port, FLB_IO_TLS, &tls);
+    TEST_CHECK(u != NULL);
+
+    conn = flb_upstream_conn_get(u);
+    TEST_CHECK(conn != NULL);
+    if (conn) {
+        total = iov_fill(iov, cnt, sizes, expected);
+        ret = flb_io_net_writev(conn, iov, cnt, &out_len);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(out_len == total);
+        iov_free(iov, cnt);
+
+        /* closing the connection ends the server */
+        flb_upstream_conn_release(conn);
+    }
+    tls_server_stop(s);
+
+    if (conn) {
+        TEST_CHECK(s->len == total);
+        TEST_CHECK(memcmp(s->buf, expected, total) == 0);
+        records = s->records;
+    }
+
+    flb_upstream_destroy(u);
+    flb_tls_context_destroy(tls.context);
+
+ exit:
+    if (config) {
+        flb_config_exit(config);
+    }
+    flb_free(expected);
+    flb_free(iov);
+    flb_free(s);
+    return records;
+}
+
+/* Small vectors share a record, a big one fills the current record first */
+void test_tls_writev_merge()
+{
+    int records;
+    size_t small[] = {10, 10, 10, 10, 10, 10, 10, 10, 10, 10};
+    size_t big[] = {20, 40000};
+
+    records = tls_writev_run(small, sizeof(small) / sizeof(size_t));
+    TEST_CHECK(records == 1);
+    TEST_MSG("records=%i", records);
+
+    /* 20 + 16364, then 23636 bytes are written directly in two records */
+    records = tls_writev_run(big, sizeof(big) / sizeof(size_t));
+    TEST_CHECK(records == 3);
+    TEST_MSG("records=%i", records);
+}
+
+/*
+ * Open 'conns' connections one after the other against a server that
+ * closes the connection number 'drop' before the handshake. Returns the
+ * connections established.
+ */
+static int tls_session_run(struct flb_tls_context *ctx, int conns, int drop)
+{
+    int i;
+    int ret;
+    int count = 0;
+    size_t out_len;
+    struct tls_server *s;
+    struct flb_tls tls;
+    struct flb_config *config;
+    struct flb_upstream *u;
+    struct flb_upstream_conn *conn;
+
+    s = flb_malloc(sizeof(struct tls_server));
+    config = io_config();
+    if (!s || !config) {
+        TEST_CHECK(FLB_FALSE);
+        flb_free(s);
+        if (config) {
+            flb_config_exit(config);
+        }
+        return -1;
+    }
+
+    ret = tls_server_start(s, conns, drop);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        flb_free(s);
+        flb_config_exit(config);
+        return -1;
+    }
+
+    tls.context = ctx;
+    u = io_upstream(config, s->port, FLB_IO_TLS, &tls);
+    TEST_CHECK(u != NULL);
+
+    for (i = 0; i < conns; i++) {
+        conn = flb_upstream_conn_get(u);
+        if (!conn) {
+            continue;
+        }
+        ret = flb_io_net_write(conn, "hello", 5, &out_len);
+        TEST_CHECK(ret == 0);
+        flb_upstream_conn_release(conn);
+        count++;
+    }
+
+    tls_server_stop(s);
+    flb_upstream_destroy(u);
+    flb_config_exit(config);
+    flb_free(s);
+
+    return count;
+}
+
+/* Connections after the first one resume its session */
+void test_tls_session_resume()
+{
+    int ret;
+    struct flb_tls_context *ctx;
+
+    ctx = tls_context();
+    TEST_CHECK(ctx != NULL);
+    if (!ctx) {
+        return;
+    }
+
+    ret = tls_session_run(ctx, 3, 0);
+    TEST_CHECK(ret == 3);
+    TEST_CHECK(ctx->handshakes_full == 1);
+    TEST_CHECK(ctx->handshakes_resumed == 2);
+    TEST_MSG("full=%lu resumed=%lu",
+             ctx->handshakes_full, ctx->handshakes_resumed);
+    flb_tls_context_destroy(ctx);
+
+    /* without the cache every connection does a full handshake */
+    ctx = tls_context();
+    TEST_CHECK(ctx != NULL);
+    if (!ctx) {
+        return;
+    }
+    ctx->session_cache = FLB_FALSE;
+
+    ret = tls_session_run(ctx, 3, 0);
+    TEST_CHECK(ret == 3);
+    TEST_CHECK(ctx->handshakes_full == 3);
+    TEST_CHECK(ctx->handshakes_resumed == 0);
+    TEST_CHECK(mk_list_size(&ctx->sessions) == 0);
+    flb_tls_context_destroy(ctx);
+}
+
+/*
+ * The handshake offering the cached session fails: the session is dropped
+ * and the next connection does a full handshake, even if the server still
+ * knows the session.
+ */
+void test_tls_session_invalidate()
+{
+    int ret;
+    struct flb_tls_context *ctx;
+
+    ctx = tls_context();
+    TEST_CHECK(ctx != NULL);
+    if (!ctx) {
+        return;
+    }
+
+    ret = tls_session_run(ctx, 4, 2);
+    TEST_CHECK(ret == 3);
+    TEST_CHECK(ctx->handshakes_full == 2);
+    TEST_CHECK(ctx->handshakes_resumed == 1);
+    TEST_MSG("full=%lu resumed=%lu",
+             ctx->handshakes_full, ctx->handshakes_resumed);
+    TEST_CHECK(mk_list_size(&ctx->sessions) == 1);
+    flb_tls_context_destroy(ctx);
+}
+
+#ifdef FLB_HAVE_METRICS
+/* Handshakes are reported in the metrics of the owner */
+void test_tls_session_metrics()
+{
+    int ret;
+    struct flb_metric *full;
+    struct flb_metric *resumed;
+    struct flb_metrics *metrics;
+    struct flb_tls_context *ctx;
+
+    metrics = flb_metrics_create("tls");
+    TEST_CHECK(metrics != NULL);
+    flb_metrics_add(FLB_METRIC_OUT_TLS_FULL, "tls_full_handshakes", metrics);
+    flb_metrics_add(FLB_METRIC_OUT_TLS_RESUMED, "tls_resumed_handshakes",
+                    metrics);
+
+    ctx = tls_context();
+    TEST_CHECK(ctx != NULL);
+    if (!ctx) {
+        flb_metrics_destroy(metrics);
+        return;
+    }
+    ctx->metrics = metrics;
+
+    ret = tls_session_run(ctx, 3, 0);
+    TEST_CHECK(ret == 3);
+
+    full = flb_metrics_get_id(FLB_METRIC_OUT_TLS_FULL, metrics);
+    resumed = flb_metrics_get_id(FLB_METRIC_OUT_TLS_RESUMED, metrics);
+    TEST_CHECK(full != NULL && full->val == 1);
+    TEST_CHECK(resumed != NULL && resumed->val == 2);
+
+    flb_tls_context_destroy(ctx);
+    flb_metrics_destroy(metrics);
+}
+#endif
+#endif
+
+TEST_LIST = {
+    {"writev_partial", test_writev_partial},
+#ifdef FLB_HAVE_TLS
+    {"tls_writev_merge", test_tls_writev_merge},
+    {"tls_session_resume", test_tls_session_resume},
+    {"tls_session_invalidate", test_tls_session_invalidate},
+#ifdef FLB_HAVE_METRICS
+    {"tls_session_metrics", test_tls_session_metrics},
+#endif
+#endif
+    { 0 }
+};
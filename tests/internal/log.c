@@ -0,0 +1,224 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_config.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "flb_tests_internal.h"
+
+#define LOG_FILE   "/tmp/flb-test-log.txt"
+
+static const char *file_a = "a.c";
+static const char *file_b = "b.c";
+
+void test_log_rate_check()
+{
+    int i;
+    int ret;
+    int allowed = 0;
+    int suppressed;
+    struct flb_log_cache cache = {0};
+
+    /* only a burst of messages per second from the same call site */
+    for (i = 0; i < 100; i++) {
+        ret = flb_log_rate_check(&cache, file_a, 10, 1000, &suppressed);
+        TEST_CHECK(suppressed == 0);
+        if (ret == FLB_TRUE) {
+            allowed++;
+        }
+    }
+    TEST_CHECK(allowed == FLB_LOG_RATE_BURST);
+
+    /* the next second reports the messages lost */
+    ret = flb_log_rate_check(&cache, file_a, 10, 1001, &suppressed);
+    TEST_CHECK(ret == FLB_TRUE);
+    TEST_CHECK(suppressed == 100 - FLB_LOG_RATE_BURST);
+    TEST_MSG("suppressed=%i", suppressed);
+
+    ret = flb_log_rate_check(&cache, file_a, 10, 1002, &suppressed);
+    TEST_CHECK(ret == FLB_TRUE);
+    TEST_CHECK(suppressed == 0);
+
+    /* other call sites are not affected */
+    for (i = 0; i < FLB_LOG_RATE_BURST; i++) {
+        ret = flb_log_rate_check(&cache, file_a, 10, 1002, &suppressed);
+    }
+    TEST_CHECK(ret == FLB_FALSE);
+    ret = flb_log_rate_check(&cache, file_b, 10, 1002, &suppressed);
+    TEST_CHECK(ret == FLB_TRUE);
+    ret = flb_log_rate_check(&cache, file_a, 11, 1002, &suppressed);
+    TEST_CHECK(ret == FLB_TRUE);
+}
+
+/* Call sites sharing a hash slot keep their own counts */
+void test_log_rate_sites()
+{
+    int i;
+    int ret;
+    int suppressed;
+    char file_copy[8];
+    struct flb_log_cache cache = {0};
+
+    /* suppress messages from a.c:10 */
+    for (i = 0; i < FLB_LOG_RATE_BURST + 5; i++) {
+        flb_log_rate_check(&cache, file_a, 10, 1000, &suppressed);
+    }
+
+    /* more call sites than slots, none of them evicts a.c:10 */
+    for (i = 0; i < FLB_LOG_RATE_SLOTS * 2; i++) {
+        ret = flb_log_rate_check(&cache, file_b, i, 1000, &suppressed);
+        TEST_CHECK(ret == FLB_TRUE);
+        TEST_CHECK(suppressed == 0);
+    }
+
+    /* the same file name from another string is the same call site */
+    strcpy(file_copy, file_a);
+    ret = flb_log_rate_check(&cache, file_copy, 10, 1000, &suppressed);
+    TEST_CHECK(ret == FLB_FALSE);
+
+    ret = flb_log_rate_check(&cache, file_a, 10, 1001, &suppressed);
+    TEST_CHECK(ret == FLB_TRUE);
+    TEST_CHECK(suppressed == 6);
+    TEST_MSG("suppressed=%i", suppressed);
+
+    /* quiet call sites give their slot to new ones */
+    for (i = 0; i < FLB_LOG_RATE_SLOTS; i++) {
+        ret = flb_log_rate_check(&cache, file_b, 1000 + i, 1002, &suppressed);
+    }
+    for (i = 0; i < FLB_LOG_RATE_BURST; i++) {
+        ret = flb_log_rate_check(&cache, file_b, 1000, 1002, &suppressed);
+    }
+    TEST_CHECK(ret == FLB_FALSE);
+}
+
+/* Messages go through the worker ring and are written by the log thread */
+void test_log_file()
+{
+    int i;
+    int lines = 0;
+    int errors = 0;
+    char buf[4096];
+    FILE *fp;
+    struct flb_config *config;
+
+    unlink(LOG_FILE);
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+    if (!config) {
+        return;
+    }
+
+    config->log = flb_log_init(config, FLB_LOG_FILE, FLB_LOG_INFO, LOG_FILE);
+    TEST_CHECK(config->log != NULL);
+    if (!config->log) {
+        flb_config_exit(config);
+        return;
+    }
+
+    for (i = 0; i < 100; i++) {
+        flb_info("message %i", i);
+    }
+    for (i = 0; i < 100; i++) {
+        flb_error("repeated error");
+    }
+
+    /* stopping the logger writes the pending messages */
+    flb_config_exit(config);
+
+    fp = fopen(LOG_FILE, "r");
+    TEST_CHECK(fp != NULL);
+    if (!fp) {
+        return;
+    }
+    while (fgets(buf, sizeof(buf), fp)) {
+        if (strstr(buf, "[ info] message ")) {
+            lines++;
+        }
+        else if (strstr(buf, "[error] repeated error")) {
+            errors++;
+        }
+    }
+    fclose(fp);
+    unlink(LOG_FILE);
+
+    TEST_CHECK(lines == 100);
+    TEST_MSG("lines=%i", lines);
+    /* the loop may cross a second boundary */
+    TEST_CHECK(errors >= FLB_LOG_RATE_BURST && errors <= FLB_LOG_RATE_BURST * 2);
+    TEST_MSG("errors=%i", errors);
+}
+
+/* The log worker reports suppressed messages without a new message */
+void test_log_rate_flush()
+{
+    int i;
+    int errors = 0;
+    int suppressed = 0;
+    char *p;
+    char buf[4096];
+    FILE *fp;
+    struct flb_config *config;
+
+    unlink(LOG_FILE);
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+    if (!config) {
+        return;
+    }
+
+    config->log = flb_log_init(config, FLB_LOG_FILE, FLB_LOG_INFO, LOG_FILE);
+    TEST_CHECK(config->log != NULL);
+    if (!config->log) {
+        flb_config_exit(config);
+        return;
+    }
+
+    for (i = 0; i < 100; i++) {
+        flb_error("flushed error");
+    }
+
+    /* the timer runs every second, after the second of the messages */
+    sleep(3);
+
+    fp = fopen(LOG_FILE, "r");
+    TEST_CHECK(fp != NULL);
+    if (fp) {
+        while (fgets(buf, sizeof(buf), fp)) {
+            if (strstr(buf, "[error] flushed error")) {
+                errors++;
+            }
+            else if ((p = strstr(buf, "similar messages suppressed"))) {
+                TEST_CHECK(strstr(buf, "log.c:") != NULL);
+                while (p > buf && *(p - 1) == ' ') {
+                    p--;
+                }
+                while (p > buf && *(p - 1) >= '0' && *(p - 1) <= '9') {
+                    p--;
+                }
+                suppressed += atoi(p);
+            }
+        }
+        fclose(fp);
+    }
+
+    flb_config_exit(config);
+    unlink(LOG_FILE);
+
+    TEST_CHECK(suppressed > 0);
+    TEST_CHECK(errors + suppressed == 100);
+    TEST_MSG("errors=%i suppressed=%i", errors, suppressed);
+}
+
+TEST_LIST = {
+    {"rate_check", test_log_rate_check},
+    {"rate_sites", test_log_rate_sites},
+    {"rate_flush", test_log_rate_flush},
+    {"file",       test_log_file},
+    { 0 }
+};
@@ -0,0 +1,290 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_ml.h>
+
+#include "flb_tests_internal.h"
+
+#define RECORDS_MAX  16
+
+struct records {
+    int count;
+    flb_sds_t buf[RECORDS_MAX];
+};
+
+static char *java_lines[] = {
+    "single line before",
+    "java.lang.RuntimeException: top level",
+    "    at com.example.App.run(App.java:10)",
+    "    at com.example.App.main(App.java:5)",
+    "Caused by: java.lang.NullPointerException",
+    "    at com.example.Dao.get(Dao.java:42)",
+    "    ... 2 more",
+    "single line after",
+    NULL
+};
+
+static char *go_lines[] = {
+    "panic: runtime error: index out of range",
+    "",
+    "goroutine 1 [running]:",
+    "main.main()",
+    "\t/app/main.go:10 +0x1d",
+    "single line after",
+    NULL
+};
+
+static char *python_lines[] = {
+    "Traceback (most recent call last):",
+    "  File \"app.py\", line 3, in <module>",
+    "    main()",
+    "  File \"app.py\", line 2, in main",
+    "    raise ValueError('bad')",
+    "ValueError: bad",
+    "Traceback (most recent call last):",
+    "  File \"other.py\", line 1, in <module>",
+    "    x = y",
+    "NameError: name 'y' is not defined",
+    NULL
+};
+
+static int cb_flush(const char *buf, size_t size, struct flb_time *tm,
+                    void *data)
+{
+    struct records *r = data;
+
+    TEST_CHECK(r->count < RECORDS_MAX);
+    if (r->count < RECORDS_MAX) {
+        r->buf[r->count++] = flb_sds_create_len(buf, size);
+    }
+    return 0;
+}
+
+/* Run the lines, single lines are stored as records too */
+static void run(struct flb_ml *ml, char **lines, struct records *r)
+{
+    int i;
+    int ret;
+    struct flb_time tm;
+    struct flb_ml_stream stream;
+
+    memset(r, 0, sizeof(struct records));
+    flb_ml_stream_init(&stream);
+    flb_time_get(&tm);
+
+    for (i = 0; lines[i]; i++) {
+        ret = flb_ml_process(ml, &stream, lines[i], strlen(lines[i]), &tm,
+                             cb_flush, r);
+        if (ret == FLB_ML_NA) {
+            cb_flush(lines[i], strlen(lines[i]), &tm, r);
+        }
+    }
+    flb_ml_flush(ml, &stream, cb_flush, r);
+    flb_ml_stream_destroy(&stream);
+}
+
+static void records_destroy(struct records *r)
+{
+    int i;
+
+    for (i = 0; i < r->count; i++) {
+        flb_sds_destroy(r->buf[i]);
+    }
+}
+
+static void check_record(struct records *r, int id, char **lines,
+                         int start, int end)
+{
+    int i;
+    flb_sds_t exp;
+
+    if (!TEST_CHECK(id < r->count)) {
+        return;
+    }
+
+    exp = flb_sds_create_size(256);
+    for (i = start; i < end; i++) {
+        if (i > start) {
+            exp = flb_sds_cat(exp, "\n", 1);
+        }
+        exp = flb_sds_cat(exp, lines[i], strlen(lines[i]));
+    }
+
+    TEST_CHECK(strcmp(r->buf[id], exp) == 0);
+    TEST_MSG("record %i: expected '%s', got '%s'", id, exp, r->buf[id]);
+    flb_sds_destroy(exp);
+}
+
+void test_ml_java()
+{
+    struct flb_ml *ml;
+    struct records r;
+
+    ml = flb_ml_builtin_create("java");
+    TEST_CHECK(ml != NULL);
+    if (!ml) {
+        return;
+    }
+
+    run(ml, java_lines, &r);
+    TEST_CHECK(r.count == 3);
+    check_record(&r, 0, java_lines, 0, 1);
+    check_record(&r, 1, java_lines, 1, 7);
+    check_record(&r, 2, java_lines, 7, 8);
+
+    records_destroy(&r);
+    flb_ml_destroy(ml);
+}
+
+void test_ml_go()
+{
+    struct flb_ml *ml;
+    struct records r;
+
+    ml = flb_ml_builtin_create("go");
+    TEST_CHECK(ml != NULL);
+    if (!ml) {
+        return;
+    }
+
+    run(ml, go_lines, &r);
+    TEST_CHECK(r.count == 2);
+    check_record(&r, 0, go_lines, 0, 5);
+    check_record(&r, 1, go_lines, 5, 6);
+
+    records_destroy(&r);
+    flb_ml_destroy(ml);
+}
+
+void test_ml_python()
+{
+    struct flb_ml *ml;
+    struct records r;
+
+    ml = flb_ml_builtin_create("python");
+    TEST_CHECK(ml != NULL);
+    if (!ml) {
+        return;
+    }
+
+    /* the exception line ends a traceback, the next one starts a new one */
+    run(ml, python_lines, &r);
+    TEST_CHECK(r.count == 2);
+    check_record(&r, 0, python_lines, 0, 6);
+    check_record(&r, 1, python_lines, 6, 10);
+
+    records_destroy(&r);
+    flb_ml_destroy(ml);
+}
+
+void test_ml_max_lines()
+{
+    struct flb_ml *ml;
+    struct records r;
+
+    ml = flb_ml_builtin_create("java");
+    TEST_CHECK(ml != NULL);
+    if (!ml) {
+        return;
+    }
+    ml->max_lines = 3;
+
+    run(ml, java_lines, &r);
+
+    /* the trace is cut after 3 lines, 'Caused by' starts a new one */
+    TEST_CHECK(r.count == 4);
+    check_record(&r, 1, java_lines, 1, 4);
+    check_record(&r, 2, java_lines, 4, 7);
+    check_record(&r, 3, java_lines, 7, 8);
+
+    records_destroy(&r);
+    flb_ml_destroy(ml);
+}
+
+void test_ml_flush_timeout()
+{
+    int ret;
+    time_t now;
+    struct flb_ml *ml;
+    struct flb_ml_stream stream;
+    struct flb_time tm;
+    struct records r = {0};
+
+    ml = flb_ml_builtin_create("java");
+    TEST_CHECK(ml != NULL);
+    if (!ml) {
+        return;
+    }
+    ml->flush_timeout = 2;
+
+    flb_ml_stream_init(&stream);
+    flb_time_get(&tm);
+    ret = flb_ml_process(ml, &stream, java_lines[1], strlen(java_lines[1]),
+                         &tm, cb_flush, &r);
+    TEST_CHECK(ret == FLB_ML_MORE);
+
+    now = time(NULL);
+    ret = flb_ml_flush_pending(ml, &stream, now, cb_flush, &r);
+    TEST_CHECK(ret == -1);
+    TEST_CHECK(r.count == 0);
+
+    ret = flb_ml_flush_pending(ml, &stream, now + 2, cb_flush, &r);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(r.count == 1);
+    TEST_CHECK(stream.state == -1);
+
+    flb_ml_stream_destroy(&stream);
+    records_destroy(&r);
+    flb_ml_destroy(ml);
+}
+
+void test_ml_rules()
+{
+    int ret;
+    struct flb_ml *ml;
+    struct records r;
+    char *lines[] = {"BEGIN", "one", "two", "END", "other", NULL};
+
+    ml = flb_ml_create("custom");
+    TEST_CHECK(ml != NULL);
+    if (!ml) {
+        return;
+    }
+
+    /* a start state is required */
+    ret = flb_ml_compile(ml);
+    TEST_CHECK(ret == -1);
+
+    ret = flb_ml_rule_add(ml, "start_state", "^BEGIN$", "body");
+    TEST_CHECK(ret == 0);
+    ret = flb_ml_rule_add(ml, "body", "^END$", "start_state");
+    TEST_CHECK(ret == 0);
+    ret = flb_ml_rule_add(ml, "body", ".", "body");
+    TEST_CHECK(ret == 0);
+    ret = flb_ml_rule_add(ml, "body", "(", "body");
+    TEST_CHECK(ret == -1);
+    ret = flb_ml_compile(ml);
+    TEST_CHECK(ret == 0);
+
+    run(ml, lines, &r);
+    TEST_CHECK(r.count == 2);
+    check_record(&r, 0, lines, 0, 4);
+    check_record(&r, 1, lines, 4, 5);
+
+    records_destroy(&r);
+    flb_ml_destroy(ml);
+
+    TEST_CHECK(flb_ml_builtin_create("cobol") == NULL);
+}
+
+TEST_LIST = {
+    {"java",          test_ml_java},
+    {"go",            test_ml_go},
+    {"python",        test_ml_python},
+    {"max_lines",     test_ml_max_lines},
+    {"flush_timeout", test_ml_flush_timeout},
+    {"rules",         test_ml_rules},
+    { 0 }
+};
@@ -579,6 +579,339 @@ void test_json_pack_bug1278()
     }
 }
 
+/* Containers which size don't fit in a one byte header, nested levels */
+/*
+ * Numbers with a fraction or an exponent are packed as doubles, the others
+ * as integers. Before the one-pass encoder an exponent without a fraction
+ * ('1e3') was read as the integer before the 'e'.
+ */
+void test_json_pack_numbers()
+{
+    int i;
+    int ret;
+    int type;
+    size_t off;
+    size_t out_size;
+    char *out_buf;
+    char *json = "[0, -7, 1e3, 2E-2, -5e+1, 1.5, 12345678901234567890]";
+    msgpack_unpacked result;
+    msgpack_object *o;
+    struct {
+        int type;
+        int64_t i;
+        double f;
+    } expected[] = {
+        {MSGPACK_OBJECT_POSITIVE_INTEGER, 0, 0},
+        {MSGPACK_OBJECT_NEGATIVE_INTEGER, -7, 0},
+        {MSGPACK_OBJECT_FLOAT, 0, 1000.0},
+        {MSGPACK_OBJECT_FLOAT, 0, 0.02},
+        {MSGPACK_OBJECT_FLOAT, 0, -50.0},
+        {MSGPACK_OBJECT_FLOAT, 0, 1.5},
+        /* out of range, strtoll() saturates */
+        {MSGPACK_OBJECT_POSITIVE_INTEGER, INT64_MAX, 0},
+    };
+
+    ret = flb_pack_json(json, strlen(json), &out_buf, &out_size, &type);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        return;
+    }
+
+    off = 0;
+    msgpack_unpacked_init(&result);
+    ret = msgpack_unpack_next(&result, out_buf, out_size, &off);
+    TEST_CHECK(ret == MSGPACK_UNPACK_SUCCESS);
+    TEST_CHECK(result.data.type == MSGPACK_OBJECT_ARRAY);
+    TEST_CHECK(result.data.via.array.size == 7);
+
+    for (i = 0; i < 7 && i < result.data.via.array.size; i++) {
+        o = &result.data.via.array.ptr[i];
+        TEST_CHECK(o->type == expected[i].type);
+        TEST_MSG("entry %i: type=%i", i, o->type);
+        if (expected[i].type == MSGPACK_OBJECT_FLOAT) {
+            TEST_CHECK(o->via.f64 == expected[i].f);
+        }
+        else {
+            TEST_CHECK(o->via.i64 == expected[i].i);
+        }
+        TEST_MSG("entry %i", i);
+    }
+
+    msgpack_unpacked_destroy(&result);
+    flb_free(out_buf);
+}
+
+void test_json_pack_containers()
+{
+    int i;
+    int ret;
+    int type;
+    int sizes[] = {15, 16, 65535, 65536};
+    size_t off;
+    size_t len;
+    size_t out_size;
+    char *out_buf;
+    flb_sds_t json;
+    msgpack_unpacked result;
+    msgpack_object *o;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(int); i++) {
+        json = flb_sds_create("[");
+        for (len = 0; len < sizes[i]; len++) {
+            flb_sds_printf(&json, "%s%zu", len > 0 ? "," : "", len);
+        }
+        json = flb_sds_cat(json, "]", 1);
+
+        ret = flb_pack_json(json, flb_sds_len(json), &out_buf, &out_size,
+                            &type);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(type == FLB_PACK_JSON_ARRAY);
+
+        off = 0;
+        msgpack_unpacked_init(&result);
+        ret = msgpack_unpack_next(&result, out_buf, out_size, &off);
+        TEST_CHECK(ret == MSGPACK_UNPACK_SUCCESS);
+        TEST_CHECK(off == out_size);
+        TEST_CHECK(result.data.type == MSGPACK_OBJECT_ARRAY);
+        TEST_CHECK(result.data.via.array.size == sizes[i]);
+        o = &result.data.via.array.ptr[sizes[i] - 1];
+        TEST_CHECK(o->via.u64 == sizes[i] - 1);
+
+        msgpack_unpacked_destroy(&result);
+        flb_free(out_buf);
+        flb_sds_destroy(json);
+    }
+
+    /* Nested levels */
+    json = flb_sds_create("");
+    for (i = 0; i < 100; i++) {
+        json = flb_sds_cat(json, "{\"k\": [", 7);
+    }
+    json = flb_sds_cat(json, "1.5", 3);
+    for (i = 0; i < 100; i++) {
+        json = flb_sds_cat(json, "]}", 2);
+    }
+
+    ret = flb_pack_json(json, flb_sds_len(json), &out_buf, &out_size, &type);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(type == FLB_PACK_JSON_OBJECT);
+
+    /*
+     * msgpack-c can't unpack that many levels, check the encoding: every
+     * level is a fixmap, the 'k' key and a fixarray, then a double.
+     */
+    TEST_CHECK(out_size == (100 * 4) + 9);
+    for (i = 0; i < 100; i++) {
+        TEST_CHECK(memcmp(out_buf + (i * 4), "\x81\xa1k\x91", 4) == 0);
+    }
+    TEST_CHECK((unsigned char) out_buf[400] == 0xcb);
+
+    flb_free(out_buf);
+    flb_sds_destroy(json);
+}
+
+/* Incomplete and invalid messages */
+void test_json_pack_errors()
+{
+    int i;
+    int ret;
+    int type;
+    int out_size;
+    size_t size;
+    char *out_buf;
+    struct flb_pack_state state;
+
+    char *invalid[] = {
+        "{\"a\" 1}",
+        "{\"a\": 1,}",
+        "{1: 2}",
+        "[1 2]",
+        "{\"a\": tru }",
+        "[\"\\q\"]",
+        "{\"a\": 1]",
+    };
+
+    char *partial[] = {
+        "{\"a\": 1",
+        "{\"a\": \"one",
+        "[\"\\u00",
+        "[1, 2, {",
+        "123",
+    };
+
+    for (i = 0; i < sizeof(invalid) / sizeof(char *); i++) {
+        ret = flb_pack_json(invalid[i], strlen(invalid[i]),
+                            &out_buf, &size, &type);
+        TEST_CHECK(ret == -1);
+
+        flb_pack_state_init(&state);
+        ret = flb_pack_json_state(invalid[i], strlen(invalid[i]),
+                                  &out_buf, &out_size, &state);
+        TEST_CHECK(ret == FLB_ERR_JSON_INVAL);
+        TEST_MSG("invalid JSON accepted: %s", invalid[i]);
+        flb_pack_state_reset(&state);
+    }
+
+    for (i = 0; i < sizeof(partial) / sizeof(char *); i++) {
+        ret = flb_pack_json(partial[i], strlen(partial[i]),
+                            &out_buf, &size, &type);
+        TEST_CHECK(ret == -1);
+
+        flb_pack_state_init(&state);
+        ret = flb_pack_json_state(partial[i], strlen(partial[i]),
+                                  &out_buf, &out_size, &state);
+        TEST_CHECK(ret == FLB_ERR_JSON_PART);
+        TEST_MSG("incomplete JSON not detected: %s", partial[i]);
+        flb_pack_state_reset(&state);
+    }
+}
+
+/* Streaming encoder must generate the same output than the fixed buffer one */
+void test_msgpack_to_json_sds()
+{
+    int i;
+    int ret;
+    char json[4096];
+    char big[3000];
+    flb_sds_t out;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+    msgpack_unpacked result;
+    size_t off = 0;
+
+    char *strings[] = {
+        "plain ascii text",
+        "quotes \" and \\ backslash / slash",
+        "control \n\r\t\b\f\v\a\x01\x7f end",
+        "utf-8 \xc3\xa1 \xe2\x82\xac \xf0\x9f\x98\x80 done",
+        "invalid \xff utf-8",
+        "truncated \xe2\x82",
+        "",
+    };
+
+    memset(big, 'a', sizeof(big));
+    big[100] = '"';
+    big[2000] = '\n';
+
+    msgpack_sbuffer_init(&mp_sbuf);
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+    msgpack_pack_map(&mp_pck, sizeof(strings) / sizeof(char *) + 6);
+    for (i = 0; i < sizeof(strings) / sizeof(char *); i++) {
+        msgpack_pack_int(&mp_pck, i);
+        msgpack_pack_str(&mp_pck, strlen(strings[i]));
+        msgpack_pack_str_body(&mp_pck, strings[i], strlen(strings[i]));
+    }
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "big", 3);
+    msgpack_pack_str(&mp_pck, sizeof(big));
+    msgpack_pack_str_body(&mp_pck, big, sizeof(big));
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "neg", 3);
+    msgpack_pack_int64(&mp_pck, -9223372036854775807LL - 1);
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "u64", 3);
+    msgpack_pack_uint64(&mp_pck, 18446744073709551615ULL);
+    msgpack_pack_str(&mp_pck, 5);
+    msgpack_pack_str_body(&mp_pck, "float", 5);
+    msgpack_pack_double(&mp_pck, 0.1);
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "arr", 3);
+    msgpack_pack_array(&mp_pck, 4);
+    msgpack_pack_nil(&mp_pck);
+    msgpack_pack_true(&mp_pck);
+    msgpack_pack_false(&mp_pck);
+    msgpack_pack_map(&mp_pck, 0);
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "ext", 3);
+    msgpack_pack_ext(&mp_pck, 2, 1);
+    msgpack_pack_ext_body(&mp_pck, "\x01\x80", 2);
+
+    msgpack_unpacked_init(&result);
+    ret = msgpack_unpack_next(&result, mp_sbuf.data, mp_sbuf.size, &off);
+    TEST_CHECK(ret == MSGPACK_UNPACK_SUCCESS);
+
+    ret = flb_msgpack_to_json(json, sizeof(json), &result.data);
+    TEST_CHECK(ret > 0);
+
+    /* Start with a small buffer so it grows many times */
+    out = flb_sds_create_size(1);
+    ret = flb_msgpack_to_json_sds(&out, &result.data);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(strcmp(out, json) == 0);
+    TEST_MSG("expected: %s\nencoded : %s", json, out);
+    flb_sds_destroy(out);
+
+    out = flb_msgpack_raw_to_json_sds(mp_sbuf.data, mp_sbuf.size);
+    TEST_CHECK(out != NULL);
+    TEST_CHECK(strcmp(out, json) == 0);
+    flb_sds_destroy(out);
+
+    msgpack_unpacked_destroy(&result);
+    msgpack_sbuffer_destroy(&mp_sbuf);
+}
+
+void test_msgpack_to_json_format()
+{
+    int i;
+    flb_sds_t out;
+    flb_sds_t date_key;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+    struct flb_time tm;
+
+    msgpack_sbuffer_init(&mp_sbuf);
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+    tm.tm.tv_sec = 1594808493;
+    tm.tm.tv_nsec = 123456789;
+    for (i = 0; i < 2; i++) {
+        msgpack_pack_array(&mp_pck, 2);
+        flb_time_append_to_msgpack(&tm, &mp_pck, 0);
+        msgpack_pack_map(&mp_pck, 1);
+        msgpack_pack_str(&mp_pck, 1);
+        msgpack_pack_str_body(&mp_pck, "k", 1);
+        msgpack_pack_int(&mp_pck, i);
+    }
+
+    date_key = flb_sds_create("date");
+
+    out = flb_pack_msgpack_to_json_format(mp_sbuf.data, mp_sbuf.size,
+                                          FLB_PACK_JSON_FORMAT_JSON,
+                                          FLB_PACK_JSON_DATE_EPOCH,
+                                          date_key);
+    TEST_CHECK(out != NULL);
+    TEST_CHECK(strcmp(out, "[{\"date\":1594808493,\"k\":0},"
+                      "{\"date\":1594808493,\"k\":1}]") == 0);
+    TEST_MSG("output: %s", out);
+    flb_sds_destroy(out);
+
+    out = flb_pack_msgpack_to_json_format(mp_sbuf.data, mp_sbuf.size,
+                                          FLB_PACK_JSON_FORMAT_LINES,
+                                          FLB_PACK_JSON_DATE_ISO8601,
+                                          date_key);
+    TEST_CHECK(out != NULL);
+    TEST_CHECK(strcmp(out,
+                      "{\"date\":\"2020-07-15T10:21:33.123456Z\",\"k\":0}\n"
+                      "{\"date\":\"2020-07-15T10:21:33.123456Z\",\"k\":1}\n")
+               == 0);
+    TEST_MSG("output: %s", out);
+    flb_sds_destroy(out);
+
+    out = flb_pack_msgpack_to_json_format(mp_sbuf.data, mp_sbuf.size,
+                                          FLB_PACK_JSON_FORMAT_STREAM,
+                                          FLB_PACK_JSON_DATE_DOUBLE,
+                                          date_key);
+    TEST_CHECK(out != NULL);
+    TEST_CHECK(strcmp(out, "{\"date\":1594808493.123457,\"k\":0}"
+                      "{\"date\":1594808493.123457,\"k\":1}") == 0);
+    TEST_MSG("output: %s", out);
+    flb_sds_destroy(out);
+
+    flb_sds_destroy(date_key);
+    msgpack_sbuffer_destroy(&mp_sbuf);
+}
+
 TEST_LIST = {
     /* JSON maps iteration */
     { "json_pack", test_json_pack },
@@ -587,8 +920,13 @@ TEST_LIST = {
     { "json_pack_mult_iter", test_json_pack_mult_iter},
     { "json_pack_bug342", test_json_pack_bug342},
     { "json_pack_bug1278"  , test_json_pack_bug1278},
+    { "json_pack_containers", test_json_pack_containers},
+    { "json_pack_numbers", test_json_pack_numbers},
+    { "json_pack_errors", test_json_pack_errors},
 
     /* Mixed bytes, check JSON encoding */
     { "utf8_to_json", test_utf8_to_json},
+    { "msgpack_to_json_sds", test_msgpack_to_json_sds},
+    { "msgpack_to_json_format", test_msgpack_to_json_format},
     { 0 }
 };
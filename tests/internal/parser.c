@@ -477,6 +477,153 @@ static int a_mysql_unquote_test(struct flb_parser *p, char *source, char *expect
     return 1;
 }
 
+/* Compiled Time_Format decoder against strptime(3) */
+struct time_decode_check {
+    char *fmt;
+    char *time_string;
+};
+
+struct time_decode_check time_decode_entries[] = {
+    {"%Y-%m-%dT%H:%M:%S%z"  , "2017-07-17T20:17:03+0000"},
+    {"%Y-%m-%dT%H:%M:%S%z"  , "2017-07-18T01:47:03+05:30"},
+    {"%Y-%m-%dT%H:%M:%S%z"  , "2017-07-17T14:17:03-06"},
+    {"%Y-%m-%dT%H:%M:%S%z"  , "2017-07-17T20:17:03Z"},
+    {"%Y-%m-%d %H:%M:%S"    , "2017-7-1 2:3:4"},
+    {"%Y-%m-%d %H:%M:%S"    , "2017-07-17   20:17:03"},
+    {"%FT%T"                , "2020-02-29T23:59:60"},
+    {"%d/%b/%Y:%H:%M:%S %z" , "17/Jul/2017:20:17:03 -0600"},
+    {"%d/%b/%Y:%H:%M:%S %z" , "17/july/2017:20:17:03 +0100"},
+    {"%b %e %H:%M:%S %Y"    , "Sep  5 01:02:03 2016"},
+    {"%B %d %y %H:%M"       , "December 31 99 23:59"},
+    {"%B %d %y %H:%M"       , "March 01 68 00:00"},
+    {"%m/%d/%Y %H:%M:%S %z" , "07/18/2017 05:17:03 +0900"},
+    {"%s"                   , "1500322623"},
+    {"%Y%m%d%H%M%S"         , "20170717201703"},
+    {"%H:%M:%S %%Y %Y"      , "20:17:03 %Y 2017"},
+};
+
+/* Strings the decoder must reject */
+struct time_decode_check time_decode_errors[] = {
+    {"%Y-%m-%d %H:%M:%S"    , "2017-13-01 00:00:00"},
+    {"%Y-%m-%d %H:%M:%S"    , "2017-07-17 24:00:00"},
+    {"%Y-%m-%d %H:%M:%S"    , "2017-07-17 20:17"},
+    {"%Y-%m-%dT%H:%M:%S%z"  , "2017-07-17T20:17:03+0090"},
+    {"%Y-%m-%dT%H:%M:%S%z"  , "2017-07-17T20:17:03+1"},
+    {"%d/%b/%Y"             , "17/Jux/2017"},
+    {"%H:%M:%S.%L"          , "20:17:03"},
+    {"%H:%M:%S.%L"          , "20:17:03."},
+    {"%H:%M:%S.%L"          , "20:17:03.1e3"},
+};
+
+void test_parser_time_decoder()
+{
+    int i;
+    int ret;
+    char *p;
+    double ns;
+    struct tm tm;
+    struct tm tm_libc;
+    struct flb_parser_time *pt;
+    struct time_decode_check *t;
+
+    for (i = 0; i < sizeof(time_decode_entries) /
+             sizeof(struct time_decode_check); i++) {
+        t = &time_decode_entries[i];
+        pt = flb_parser_time_compile(t->fmt);
+        TEST_CHECK(pt != NULL);
+        if (!pt) {
+            continue;
+        }
+
+        memset(&tm, '\0', sizeof(struct tm));
+        memset(&tm_libc, '\0', sizeof(struct tm));
+        ret = flb_parser_time_decode(pt, t->time_string,
+                                     strlen(t->time_string), &tm, &ns);
+        p = strptime(t->time_string, t->fmt, &tm_libc);
+        TEST_CHECK(ret == 0 && p != NULL);
+        TEST_MSG("format '%s', time '%s'", t->fmt, t->time_string);
+
+        if (strcmp(t->fmt, "%s") == 0) {
+            /* strptime(3) fills the broken down time in local time */
+            TEST_CHECK(flb_parser_tm2time(&tm) == 1500322623);
+        }
+        else {
+            TEST_CHECK(flb_parser_tm2time(&tm) == flb_parser_tm2time(&tm_libc));
+            TEST_CHECK(tm.tm_year == tm_libc.tm_year &&
+                       tm.tm_mon == tm_libc.tm_mon &&
+                       tm.tm_mday == tm_libc.tm_mday &&
+                       tm.tm_hour == tm_libc.tm_hour &&
+                       tm.tm_min == tm_libc.tm_min &&
+                       tm.tm_sec == tm_libc.tm_sec);
+        }
+        TEST_MSG("format '%s', time '%s'", t->fmt, t->time_string);
+        flb_parser_time_destroy(pt);
+    }
+
+    for (i = 0; i < sizeof(time_decode_errors) /
+             sizeof(struct time_decode_check); i++) {
+        t = &time_decode_errors[i];
+        pt = flb_parser_time_compile(t->fmt);
+        TEST_CHECK(pt != NULL);
+        if (!pt) {
+            continue;
+        }
+
+        memset(&tm, '\0', sizeof(struct tm));
+        ret = flb_parser_time_decode(pt, t->time_string,
+                                     strlen(t->time_string), &tm, &ns);
+        TEST_CHECK(ret == -1);
+        TEST_MSG("format '%s', time '%s'", t->fmt, t->time_string);
+        flb_parser_time_destroy(pt);
+    }
+
+    /* fractional seconds are converted like strtod(3) */
+    pt = flb_parser_time_compile("%H:%M:%S,%L");
+    TEST_CHECK(pt != NULL);
+    ret = flb_parser_time_decode(pt, "20:17:03,123456789", 18, &tm, &ns);
+    TEST_CHECK(ret == 0 && ns == strtod("0.123456789", NULL));
+    flb_parser_time_destroy(pt);
+
+    /* other conversions are left to strptime(3) */
+    TEST_CHECK(flb_parser_time_compile("%a %b %d %H:%M:%S %Y") == NULL);
+    TEST_CHECK(flb_parser_time_compile("%Y-%m-%d %Z") == NULL);
+}
+
+/* Cached day to epoch conversion */
+void test_parser_time_epoch()
+{
+    int errors = 0;
+    time_t t;
+    struct tm tm;
+    struct flb_parser *p;
+    struct flb_config *config;
+
+    config = flb_config_init();
+    load_json_parsers(config);
+
+    p = flb_parser_get("generic_TZ", config);
+    TEST_CHECK(p != NULL);
+
+    /* a week of records every 997 seconds with different offsets */
+    for (t = 1500322623; t < 1500322623 + (7 * 86400); t += 997) {
+        gmtime_r(&t, &tm);
+#ifdef FLB_HAVE_GMTOFF
+        tm.tm_gmtoff = (t % 3) * 1800;
+#endif
+        if (flb_parser_time_epoch(p, &tm) != flb_parser_tm2time(&tm)) {
+            errors++;
+        }
+    }
+    TEST_CHECK(errors == 0);
+
+    /* leap second */
+    gmtime_r(&t, &tm);
+    tm.tm_sec = 60;
+    TEST_CHECK(flb_parser_time_epoch(p, &tm) == flb_parser_tm2time(&tm));
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
 
 void test_mysql_unquoted()
 {
@@ -513,6 +660,8 @@ TEST_LIST = {
     { "time_lookup", test_parser_time_lookup},
     { "json_time_lookup", test_json_parser_time_lookup},
     { "regex_time_lookup", test_regex_parser_time_lookup},
+    { "time_decoder", test_parser_time_decoder},
+    { "time_epoch", test_parser_time_epoch},
     { "mysql_unquoted" , test_mysql_unquoted },
     { 0 }
 };
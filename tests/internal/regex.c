@@ -0,0 +1,306 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_regex.h>
+#include <fluent-bit/flb_regex_dfa.h>
+
+#include <onigmo.h>
+
+#include "flb_tests_internal.h"
+
+static char *patterns[] = {
+    "error",
+    "^GET ",
+    "\\.png$",
+    "/^kube-system$/",
+    "\\Astart",
+    "end\\z",
+    "^$",
+    "^\\s*$",
+    "a.c",
+    "^.$",
+    "^..$",
+    "[^a]b",
+    "\\W",
+    "\\D+x",
+    "[a-f0-9]{4}",
+    "\\h{2,}",
+    "x{,2}y",
+    "(ab|cd)+e",
+    "(?:ab)*c$",
+    "(?<key>[^ ]+) (?<val>\\d+)",
+    "colou??r",
+    "a+?b",
+    "[-a]z",
+    "[a-]z",
+    "[\\]\\-]x",
+    "\\t\\[\\]",
+    "é+t",
+    "caf.",
+    "^\\w+$",
+    "\\S+@\\S+",
+    "(a|)b",
+    "()",
+    "(a*)*b",
+    NULL
+};
+
+static char *strings[] = {
+    "",
+    "error",
+    "GET /",
+    "x GET /",
+    "image.png",
+    "image.png\nnext",
+    "image.pngx",
+    "kube-system",
+    "x\nkube-system\ny",
+    "start here",
+    "not start",
+    "the end",
+    "the end\n",
+    "\n",
+    "a\n\nb",
+    "   ",
+    "abc",
+    "a\nc",
+    "aéc",
+    "é",
+    "éé",
+    "a",
+    "\nb",
+    "ab",
+    "éb",
+    "x",
+    "!",
+    "12x",
+    "éx",
+    "beef",
+    "BEEF",
+    "xxxy",
+    "y",
+    "x{2",
+    "ababcde",
+    "ababc",
+    "ababc\n",
+    "key 10",
+    "key value",
+    "color",
+    "colour",
+    "aaab",
+    "-z",
+    "]x",
+    "\t[]",
+    "ééét",
+    "café",
+    "cafe",
+    "word_1",
+    "wörd",
+    "me@host",
+    "b",
+    "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+    NULL
+};
+
+static int onigmo_match(const char *pattern, const char *str, size_t len)
+{
+    int ret;
+    int plen;
+    const unsigned char *start;
+    const unsigned char *end;
+    OnigErrorInfo einfo;
+    regex_t *reg;
+
+    plen = strlen(pattern);
+    start = (const unsigned char *) pattern;
+    end = start + plen;
+    if (plen > 1 && pattern[0] == '/' && pattern[plen - 1] == '/') {
+        start++;
+        end--;
+    }
+
+    ret = onig_new(&reg, start, end, ONIG_OPTION_DEFAULT,
+                   ONIG_ENCODING_UTF8, ONIG_SYNTAX_RUBY, &einfo);
+    if (ret != ONIG_NORMAL) {
+        return -1;
+    }
+
+    ret = onig_search(reg, (const unsigned char *) str,
+                      (const unsigned char *) str + len,
+                      (const unsigned char *) str,
+                      (const unsigned char *) str + len,
+                      NULL, ONIG_OPTION_NONE);
+    onig_free(reg);
+
+    return (ret >= 0);
+}
+
+/* Patterns using Onigmo features are not handled by the DFA engine */
+void test_regex_engine()
+{
+    int i;
+    struct flb_regex *r;
+    char *dfa[] = {"^abc", "(?<a>\\d+)-(?<b>\\w+)", "x{2,5}?", NULL};
+    char *onigmo[] = {"(a)\\1", "a(?=b)", "(?<!a)b", "(?i)abc", "\\bword",
+                      "[[:alpha:]]", "\\p{Greek}", "a*+", "(?>a)", "x{2", NULL};
+
+    for (i = 0; dfa[i]; i++) {
+        r = flb_regex_create(dfa[i]);
+        TEST_CHECK(r != NULL);
+        TEST_CHECK(strcmp(flb_regex_engine_name(r), "dfa") == 0);
+        TEST_MSG("pattern '%s'", dfa[i]);
+        flb_regex_destroy(r);
+    }
+
+    for (i = 0; onigmo[i]; i++) {
+        r = flb_regex_create(onigmo[i]);
+        TEST_CHECK(r != NULL);
+        TEST_CHECK(strcmp(flb_regex_engine_name(r), "onigmo") == 0);
+        TEST_MSG("pattern '%s'", onigmo[i]);
+        flb_regex_destroy(r);
+    }
+}
+
+/* Every pattern must give the same result than Onigmo */
+void test_regex_dfa_match()
+{
+    int i;
+    int j;
+    int ret;
+    int expected;
+    struct flb_regex_dfa *dfa;
+
+    for (i = 0; patterns[i]; i++) {
+        dfa = flb_regex_dfa_create((const char **) &patterns[i], 1);
+        TEST_CHECK(dfa != NULL);
+        TEST_MSG("pattern '%s'", patterns[i]);
+        if (!dfa) {
+            continue;
+        }
+
+        for (j = 0; strings[j]; j++) {
+            expected = onigmo_match(patterns[i], strings[j],
+                                    strlen(strings[j]));
+            ret = flb_regex_dfa_exec(dfa, strings[j], strlen(strings[j]),
+                                     NULL);
+            TEST_CHECK(ret == expected);
+            TEST_MSG("pattern '%s', string '%s': expected %i, got %i",
+                     patterns[i], strings[j], expected, ret);
+        }
+        flb_regex_dfa_destroy(dfa);
+    }
+}
+
+/* All the patterns in a single scan */
+void test_regex_dfa_set()
+{
+    int i;
+    int j;
+    int n;
+    int ret;
+    int count;
+    char matched[64];
+    struct flb_regex_dfa *dfa;
+
+    for (n = 0; patterns[n]; n++);
+
+    dfa = flb_regex_dfa_create((const char **) patterns, n);
+    TEST_CHECK(dfa != NULL);
+    if (!dfa) {
+        return;
+    }
+
+    for (j = 0; strings[j]; j++) {
+        ret = flb_regex_dfa_exec(dfa, strings[j], strlen(strings[j]),
+                                 matched);
+        count = 0;
+        for (i = 0; i < n; i++) {
+            TEST_CHECK(matched[i] == onigmo_match(patterns[i], strings[j],
+                                                  strlen(strings[j])));
+            TEST_MSG("pattern '%s', string '%s'", patterns[i], strings[j]);
+            count += matched[i];
+        }
+        TEST_CHECK(ret == count);
+    }
+
+    flb_regex_dfa_destroy(dfa);
+}
+
+/* Captures still come from Onigmo after the DFA pre-check */
+void test_regex_do()
+{
+    int i;
+    int ret;
+    ptrdiff_t start;
+    ptrdiff_t end;
+    struct flb_regex *r;
+    struct flb_regex_search result;
+    char *line = "key 10";
+    char *other = "no numbers";
+
+    r = flb_regex_create("(?<key>[^ ]+) (?<val>\\d+)");
+    TEST_CHECK(r != NULL);
+    if (!r) {
+        return;
+    }
+
+    /* enough calls to go through the pre-check windows */
+    for (i = 0; i < 10000; i++) {
+        ret = flb_regex_do(r, line, strlen(line), &result);
+        TEST_CHECK(ret == 2);
+        if (ret <= 0) {
+            break;
+        }
+        flb_regex_results_get(&result, 2, &start, &end);
+        TEST_CHECK(start == 4 && end == 6);
+        flb_regex_results_release(&result);
+
+        ret = flb_regex_do(r, other, strlen(other), &result);
+        TEST_CHECK(ret == -1);
+    }
+
+    flb_regex_destroy(r);
+}
+
+/* Inputs needing too many DFA states are matched by Onigmo */
+void test_regex_fallback()
+{
+    int i;
+    int ret;
+    int dfa_ret;
+    char buf[4096];
+    char *pattern = "(a|b)*a(a|b){12}c";
+    struct flb_regex *r;
+
+    r = flb_regex_create(pattern);
+    TEST_CHECK(r != NULL);
+    if (!r) {
+        return;
+    }
+    TEST_CHECK(strcmp(flb_regex_engine_name(r), "dfa") == 0);
+
+    srand(1);
+    for (i = 0; i < sizeof(buf) - 1; i++) {
+        buf[i] = (rand() % 2) ? 'a' : 'b';
+    }
+    buf[sizeof(buf) - 2] = 'c';
+    buf[sizeof(buf) - 1] = '\0';
+
+    dfa_ret = flb_regex_dfa_exec(r->engine_ctx, buf, strlen(buf), NULL);
+    TEST_CHECK(dfa_ret == -1);
+
+    ret = flb_regex_match(r, (unsigned char *) buf, strlen(buf));
+    TEST_CHECK(ret == onigmo_match(pattern, buf, strlen(buf)));
+
+    flb_regex_destroy(r);
+}
+
+TEST_LIST = {
+    {"engine",    test_regex_engine},
+    {"dfa_match", test_regex_dfa_match},
+    {"dfa_set",   test_regex_dfa_set},
+    {"do",        test_regex_do},
+    {"fallback",  test_regex_fallback},
+    { 0 }
+};
@@ -0,0 +1,169 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_regex.h>
+#include <fluent-bit/flb_regex_set.h>
+
+#include "flb_tests_internal.h"
+
+static char *patterns[] = {
+    "error",
+    "^GET ",
+    "\\.png$",
+    "/^kube-system$/",
+    "^\\[debug\\]",
+    "",
+    "time(out)?s",
+    "conn(ection)? refused",
+    "colou?r",
+    "a+b",
+    "ab*c",
+    "x{2,3}y",
+    "[0-9]+ms",
+    "[]x]abc",
+    "([)]xyz)?done",
+    "\\d+ bytes",
+    "warn|error",
+    "(?i)error",
+    "\\x41BC",
+    "é?tat",
+    "^$",
+    "^\\s*$",
+    "level=(warn|info) msg",
+    NULL
+};
+
+static char *strings[] = {
+    "",
+    "error",
+    "an ERROR here",
+    "GET /index.html",
+    "POST /GET ",
+    "image.png",
+    "image.png\nnext",
+    "image.pngx",
+    "kube-system",
+    "x kube-system",
+    "line\n[debug] message",
+    "[debug] message",
+    "timeouts",
+    "times",
+    "timeout",
+    "connection refused",
+    "conn refused",
+    "color colour",
+    "aaab",
+    "ac",
+    "abbbc",
+    "xxy",
+    "xy",
+    "took 15ms",
+    "xabc",
+    "]abc",
+    "done",
+    ")xyzdone",
+    "sent 10 bytes",
+    "warning",
+    "ABC",
+    "tat",
+    "état",
+    "a\n\nb",
+    "   ",
+    "level=warn msg",
+    "level=info msg",
+    "level=debug msg",
+    NULL
+};
+
+/* Every pattern of the set must give the same result than the regex engine */
+void test_regex_set_match()
+{
+    int i;
+    int j;
+    int id;
+    int ret;
+    int expected;
+    int n = 0;
+    struct flb_regex *regex[32];
+    struct flb_regex_set *set;
+
+    set = flb_regex_set_create();
+    TEST_CHECK(set != NULL);
+    if (!set) {
+        return;
+    }
+
+    for (i = 0; patterns[i]; i++) {
+        regex[i] = flb_regex_create(patterns[i]);
+        TEST_CHECK(regex[i] != NULL);
+        id = flb_regex_set_add(set, patterns[i], regex[i]);
+        TEST_CHECK(id == i);
+        n++;
+    }
+
+    ret = flb_regex_set_compile(set);
+    TEST_CHECK(ret == 0);
+
+    for (j = 0; strings[j]; j++) {
+        flb_regex_set_scan(set, strings[j], strlen(strings[j]));
+
+        for (i = 0; i < n; i++) {
+            expected = flb_regex_match(regex[i], (unsigned char *) strings[j],
+                                       strlen(strings[j])) > 0;
+            ret = flb_regex_set_match(set, i, strings[j], strlen(strings[j]));
+            TEST_CHECK(ret == expected);
+            TEST_MSG("pattern '%s', string '%s': expected %i, got %i",
+                     patterns[i], strings[j], expected, ret);
+
+            if (expected) {
+                TEST_CHECK(flb_regex_set_candidate(set, i) == FLB_TRUE);
+            }
+        }
+    }
+
+    flb_regex_set_destroy(set);
+    for (i = 0; i < n; i++) {
+        flb_regex_destroy(regex[i]);
+    }
+}
+
+void test_regex_set_literals()
+{
+    struct flb_regex_set *set;
+
+    set = flb_regex_set_create();
+    TEST_CHECK(set != NULL);
+    if (!set) {
+        return;
+    }
+
+    /* plain strings don't need the regex engine */
+    flb_regex_set_add(set, "error", NULL);
+    flb_regex_set_add(set, "^GET ", NULL);
+    flb_regex_set_add(set, "x{2}y", NULL);
+    flb_regex_set_add(set, "timeouts?", NULL);
+    flb_regex_set_add(set, "a|b", NULL);
+    TEST_CHECK(flb_regex_set_compile(set) == 0);
+
+    TEST_CHECK(set->entries[0].type == FLB_REGEX_SET_LITERAL);
+    TEST_CHECK(set->entries[1].type == FLB_REGEX_SET_LITERAL);
+    TEST_CHECK(set->entries[1].anchor_start == FLB_TRUE);
+    TEST_CHECK(set->entries[2].type == FLB_REGEX_SET_REGEX);
+    TEST_CHECK(set->entries[2].lit_id >= 0);
+    TEST_CHECK(set->entries[3].type == FLB_REGEX_SET_REGEX);
+    TEST_CHECK(set->lits_len[set->entries[3].lit_id] == 7);
+    TEST_CHECK(set->entries[4].lit_id == -1);
+
+    /* shared literals and automaton */
+    TEST_CHECK(set->lits_count == 4);
+    TEST_CHECK(set->delta != NULL);
+
+    flb_regex_set_destroy(set);
+}
+
+TEST_LIST = {
+    {"match",    test_regex_set_match},
+    {"literals", test_regex_set_literals},
+    { 0 }
+};
@@ -0,0 +1,173 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_ring.h>
+
+#include <pthread.h>
+#include <poll.h>
+#include "flb_tests_internal.h"
+
+#define PRODUCERS   4
+#define ENTRIES     50000
+
+struct producer {
+    int id;
+    int busy;
+    struct flb_ring *ring;
+};
+
+static void *producer_worker(void *data)
+{
+    int i;
+    int ret;
+    int *val;
+    struct producer *p = data;
+
+    for (i = 0; i < ENTRIES; i++) {
+        val = flb_malloc(sizeof(int));
+        *val = i;
+        while ((ret = flb_ring_push(p->ring, p->id, val, sizeof(int))) ==
+               FLB_RING_FULL) {
+            p->busy++;
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+void test_push_pop()
+{
+    int i;
+    int ret;
+    int type;
+    int *val;
+    size_t size;
+    void *data;
+    struct flb_ring *ring;
+
+    ring = flb_ring_create(5);
+    TEST_CHECK(ring != NULL);
+    TEST_CHECK(ring->slots_size == 8);
+
+    ret = flb_ring_pop(ring, &type, &data, &size);
+    TEST_CHECK(ret == FLB_RING_EMPTY);
+
+    /* fill the ring, the next push must not block */
+    for (i = 0; i < 8; i++) {
+        val = flb_malloc(sizeof(int));
+        *val = i;
+        ret = flb_ring_push(ring, 1, val, sizeof(int));
+        TEST_CHECK(ret == FLB_RING_OK);
+    }
+    ret = flb_ring_push(ring, 1, NULL, 0);
+    TEST_CHECK(ret == FLB_RING_FULL);
+
+    /* entries come out in order and release their slots */
+    for (i = 0; i < 4; i++) {
+        ret = flb_ring_pop(ring, &type, &data, &size);
+        TEST_CHECK(ret == FLB_RING_OK);
+        TEST_CHECK(type == 1 && size == sizeof(int) && *(int *) data == i);
+        flb_free(data);
+    }
+
+    val = flb_malloc(sizeof(int));
+    *val = 8;
+    ret = flb_ring_push(ring, 2, val, sizeof(int));
+    TEST_CHECK(ret == FLB_RING_OK);
+
+    /* remaining entries are released by the ring */
+    flb_ring_destroy(ring);
+}
+
+void test_signal()
+{
+    int ret;
+    struct pollfd pfd;
+    struct flb_ring *ring;
+
+    ring = flb_ring_create(16);
+    TEST_CHECK(ring != NULL);
+
+    pfd.fd = flb_ring_fd(ring);
+    pfd.events = POLLIN;
+    ret = poll(&pfd, 1, 0);
+    TEST_CHECK(ret == 0);
+
+    flb_ring_push(ring, 0, flb_malloc(1), 1);
+    flb_ring_push(ring, 0, flb_malloc(1), 1);
+    ret = poll(&pfd, 1, 0);
+    TEST_CHECK(ret == 1);
+    TEST_CHECK(ring->signaled == 1);
+
+    /* once consumed, the next push signals again */
+    flb_ring_consume_signal(ring);
+    ret = poll(&pfd, 1, 0);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(ring->signaled == 0);
+
+    flb_ring_push(ring, 0, flb_malloc(1), 1);
+    ret = poll(&pfd, 1, 0);
+    TEST_CHECK(ret == 1);
+
+    flb_ring_destroy(ring);
+}
+
+void test_producers()
+{
+    int i;
+    int ret;
+    int type;
+    int total = 0;
+    int last[PRODUCERS];
+    size_t size;
+    void *data;
+    pthread_t tid[PRODUCERS];
+    struct producer p[PRODUCERS];
+    struct flb_ring *ring;
+
+    ring = flb_ring_create(64);
+    TEST_CHECK(ring != NULL);
+
+    for (i = 0; i < PRODUCERS; i++) {
+        p[i].id = i;
+        p[i].busy = 0;
+        p[i].ring = ring;
+        last[i] = -1;
+        pthread_create(&tid[i], NULL, producer_worker, &p[i]);
+    }
+
+    /* every entry is received once, in order for each producer */
+    while (total < PRODUCERS * ENTRIES) {
+        ret = flb_ring_pop(ring, &type, &data, &size);
+        if (ret == FLB_RING_EMPTY) {
+            sched_yield();
+            continue;
+        }
+        TEST_CHECK(type >= 0 && type < PRODUCERS);
+        if (*(int *) data != last[type] + 1) {
+            TEST_CHECK(*(int *) data == last[type] + 1);
+            TEST_MSG("producer %i: expected %i, got %i",
+                     type, last[type] + 1, *(int *) data);
+            break;
+        }
+        last[type] = *(int *) data;
+        flb_free(data);
+        total++;
+    }
+
+    for (i = 0; i < PRODUCERS; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    TEST_CHECK(total == PRODUCERS * ENTRIES);
+
+    flb_ring_destroy(ring);
+}
+
+TEST_LIST = {
+    {"push_pop" , test_push_pop},
+    {"signal"   , test_signal},
+    {"producers", test_producers},
+    { 0 }
+};
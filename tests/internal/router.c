@@ -1,6 +1,9 @@
 /* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_filter.h>
+#include <fluent-bit/flb_output.h>
 #include <fluent-bit/flb_router.h>
 
 #include "flb_tests_internal.h"
@@ -22,7 +25,13 @@ struct check route_checks[] = {
     {"cpu.rpi"        , "mem.*"      , FLB_FALSE},
     {"cpu.rpi"        , "*u.r*"      , FLB_TRUE},
     {"hoge"           , "hogeeeeeee" , FLB_FALSE},
-    {"test"           , "test"       , FLB_TRUE}
+    {"test"           , "test"       , FLB_TRUE},
+    {"test"           , "tes"        , FLB_FALSE},
+    {"aaa"            , "a*a*a"      , FLB_TRUE},
+    {"aa"             , "a*a*a"      , FLB_FALSE},
+    {"abcbd"          , "a*b*d"      , FLB_TRUE},
+    {"kube.var.log"   , "kube.**.log", FLB_TRUE},
+    {"kube.log"       , "kube.*.log" , FLB_FALSE}
 };
 
 void test_router_wildcard()
@@ -42,7 +51,111 @@ void test_router_wildcard()
     }
 }
 
+void test_router_pattern()
+{
+    int i;
+    int ret;
+    int len;
+    int checks = 0;
+    struct check *c;
+    struct flb_router_pattern p;
+
+    checks = sizeof(route_checks) / sizeof(struct check);
+    for (i = 0; i < checks; i++) {
+        c = &route_checks[i];
+        len = strlen(c->tag);
+
+        ret = flb_router_pattern_init(&p, c->match, NULL);
+        TEST_CHECK(ret == 0);
+
+        ret = flb_router_pattern_match(&p, c->tag, len);
+        TEST_CHECK(ret == c->matched);
+        TEST_MSG("tag=%s match=%s expected=%i", c->tag, c->match, c->matched);
+
+        flb_router_pattern_destroy(&p);
+    }
+
+    /* The Tag don't need to be NULL terminated */
+    ret = flb_router_pattern_init(&p, "cpu.*i", NULL);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_router_pattern_match(&p, "cpu.rpi.local", 7) == FLB_TRUE);
+    TEST_CHECK(flb_router_pattern_match(&p, "cpu.rpi.local", 6) == FLB_FALSE);
+    flb_router_pattern_destroy(&p);
+}
+
+void test_router_table()
+{
+    int i;
+    int j;
+    int ret;
+    int len;
+    int pass;
+    int checks = 0;
+    uint64_t routes[FLB_ROUTER_WORDS_STACK];
+    struct check *c;
+    struct flb_config *config;
+    struct flb_filter_instance *f_ins;
+    struct flb_output_instance *o_ins;
+    struct flb_router_table *table;
+    struct mk_list *tmp;
+    struct mk_list *head;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    /* One filter and one output per rule */
+    checks = sizeof(route_checks) / sizeof(struct check);
+    for (i = 0; i < checks; i++) {
+        c = &route_checks[i];
+
+        f_ins = flb_filter_new(config, "modify", NULL);
+        TEST_CHECK(f_ins != NULL);
+        flb_filter_set_property(f_ins, "match", c->match);
+
+        o_ins = flb_output_new(config, "null", NULL);
+        TEST_CHECK(o_ins != NULL);
+        flb_output_set_property(o_ins, "match", c->match);
+    }
+
+    table = flb_router_table_create(config);
+    TEST_CHECK(table != NULL);
+    TEST_CHECK(table->n_filters == checks);
+    TEST_CHECK(table->n_outputs == checks);
+
+    /* Second pass runs from the cache */
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < checks; i++) {
+            len = strlen(route_checks[i].tag);
+            ret = flb_router_table_get(table, route_checks[i].tag, len,
+                                       routes);
+            TEST_CHECK(ret == 0);
+
+            for (j = 0; j < checks; j++) {
+                c = &route_checks[j];
+                ret = flb_router_match(route_checks[i].tag, len,
+                                       c->match, NULL);
+                TEST_CHECK(!!flb_router_routes_filter(table, routes, j) == ret);
+                TEST_CHECK(!!flb_router_routes_output(table, routes, j) == ret);
+            }
+        }
+    }
+
+    flb_router_table_destroy(table);
+
+    mk_list_foreach_safe(head, tmp, &config->filters) {
+        f_ins = mk_list_entry(head, struct flb_filter_instance, _head);
+        flb_filter_instance_destroy(f_ins);
+    }
+    mk_list_foreach_safe(head, tmp, &config->outputs) {
+        o_ins = mk_list_entry(head, struct flb_output_instance, _head);
+        flb_output_instance_destroy(o_ins);
+    }
+    flb_config_exit(config);
+}
+
 TEST_LIST = {
     { "wildcard", test_router_wildcard},
+    { "pattern" , test_router_pattern},
+    { "table"   , test_router_table},
     { 0 }
 };
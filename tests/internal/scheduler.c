@@ -0,0 +1,167 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_scheduler.h>
+
+#include "flb_tests_internal.h"
+
+#define RETRIES  1000
+
+static struct flb_config *sched_config()
+{
+    int ret;
+    struct flb_config *config;
+
+    config = flb_config_init();
+    if (!config) {
+        return NULL;
+    }
+
+    config->evl = mk_event_loop_create(8);
+    if (!config->evl) {
+        flb_config_exit(config);
+        return NULL;
+    }
+
+    ret = flb_sched_init(config);
+    if (ret != 0) {
+        flb_config_exit(config);
+        return NULL;
+    }
+
+    return config;
+}
+
+/* Release the expired requests the same way the dispatcher does */
+static int expired_release(struct flb_config *config, struct mk_list *expired)
+{
+    int c = 0;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_sched_request *request;
+
+    mk_list_foreach_safe(head, tmp, expired) {
+        request = mk_list_entry(head, struct flb_sched_request, _head);
+        flb_sched_request_destroy(config, request);
+        c++;
+    }
+
+    return c;
+}
+
+void test_sched_wheel()
+{
+    int i;
+    int ret;
+    int fired = 0;
+    time_t now;
+    time_t max = 0;
+    struct mk_list expired;
+    struct flb_config *config;
+    struct flb_sched *sched;
+    struct flb_task_retry *retries;
+
+    config = sched_config();
+    TEST_CHECK(config != NULL);
+    if (!config) {
+        return;
+    }
+    sched = config->sched;
+
+    retries = flb_calloc(RETRIES, sizeof(struct flb_task_retry));
+    TEST_CHECK(retries != NULL);
+
+    for (i = 0; i < RETRIES; i++) {
+        ret = flb_sched_request_create(config, &retries[i], (i % 10) + 1);
+        TEST_CHECK(ret >= 1 && ret <= FLB_SCHED_CAP + 1);
+        TEST_CHECK(retries[i].sched_req != NULL);
+    }
+    TEST_CHECK(sched->wheel.count == RETRIES);
+
+    /* cancel every other retry */
+    for (i = 0; i < RETRIES; i += 2) {
+        ret = flb_sched_request_invalidate(config, &retries[i]);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(retries[i].sched_req == NULL);
+    }
+    ret = flb_sched_request_invalidate(config, &retries[0]);
+    TEST_CHECK(ret == -1);
+    TEST_CHECK(sched->wheel.count == RETRIES / 2);
+
+    for (i = 1; i < RETRIES; i += 2) {
+        if (retries[i].sched_req->expire > max) {
+            max = retries[i].sched_req->expire;
+        }
+    }
+
+    /* every request expires on its own tick, never before */
+    now = sched->wheel.now;
+    while (now < max) {
+        now++;
+        mk_list_init(&expired);
+        ret = flb_sched_wheel_advance(sched, now, &expired);
+        TEST_CHECK(ret == mk_list_size(&expired));
+        if (ret > 0) {
+            TEST_CHECK(mk_list_entry_first(&expired, struct flb_sched_request,
+                                           _head)->expire == now);
+        }
+        fired += expired_release(config, &expired);
+    }
+
+    TEST_CHECK(fired == RETRIES / 2);
+    TEST_MSG("fired=%i", fired);
+    TEST_CHECK(sched->wheel.count == 0);
+
+    flb_free(retries);
+    flb_config_exit(config);
+}
+
+void test_sched_wheel_catch_up()
+{
+    int i;
+    int ret;
+    struct mk_list expired;
+    struct flb_config *config;
+    struct flb_sched *sched;
+    struct flb_task_retry retries[8] = {0};
+
+    config = sched_config();
+    TEST_CHECK(config != NULL);
+    if (!config) {
+        return;
+    }
+    sched = config->sched;
+
+    for (i = 0; i < 8; i++) {
+        ret = flb_sched_request_create(config, &retries[i], 1);
+        TEST_CHECK(ret > 0);
+    }
+
+    /* a re-schedule replaces the pending request */
+    ret = flb_sched_request_create(config, &retries[0], 2);
+    TEST_CHECK(ret > 0);
+    TEST_CHECK(sched->wheel.count == 8);
+
+    /* the loop was blocked, all the missed ticks are processed at once */
+    mk_list_init(&expired);
+    ret = flb_sched_wheel_advance(sched, sched->wheel.now + FLB_SCHED_CAP + 1,
+                                  &expired);
+    TEST_CHECK(ret == 8);
+    TEST_CHECK(expired_release(config, &expired) == 8);
+    TEST_CHECK(sched->wheel.count == 0);
+
+    /* pending requests are released on exit */
+    for (i = 0; i < 8; i++) {
+        ret = flb_sched_request_create(config, &retries[i], 3);
+        TEST_CHECK(ret > 0);
+    }
+    flb_config_exit(config);
+}
+
+TEST_LIST = {
+    {"wheel",          test_sched_wheel},
+    {"wheel_catch_up", test_sched_wheel_catch_up},
+    { 0 }
+};
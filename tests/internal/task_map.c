@@ -0,0 +1,76 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_task.h>
+
+#include "flb_tests_internal.h"
+
+/* IDs taken past the initial size, the table doubles twice */
+#define TASK_IDS  (FLB_TASK_MAP_SIZE * 3)
+
+void test_task_map_grow()
+{
+    int i;
+    int id;
+    int *ids;
+    char *used;
+    struct flb_config *config;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+    if (!config) {
+        return;
+    }
+
+    ids = flb_malloc(sizeof(int) * TASK_IDS);
+    used = flb_calloc(1, TASK_IDS);
+    TEST_CHECK(ids != NULL && used != NULL);
+    if (!ids || !used) {
+        flb_free(ids);
+        flb_free(used);
+        flb_config_exit(config);
+        return;
+    }
+
+    /* every ID is unique and the table grows on demand */
+    for (i = 0; i < TASK_IDS; i++) {
+        id = flb_task_map_get_id(config);
+        TEST_CHECK(id >= 0 && id < TASK_IDS);
+        if (id < 0 || id >= TASK_IDS) {
+            break;
+        }
+        TEST_CHECK(used[id] == 0);
+        used[id] = 1;
+        ids[i] = id;
+        config->tasks_map[id].task = &ids[i];
+    }
+    TEST_CHECK(i == TASK_IDS);
+    TEST_CHECK(config->tasks_map_size == FLB_TASK_MAP_SIZE * 4);
+    TEST_MSG("tasks_map_size=%i", config->tasks_map_size);
+
+    /* entries copied by the resize keep their task */
+    for (i = 0; i < TASK_IDS; i++) {
+        TEST_CHECK(config->tasks_map[ids[i]].task == &ids[i]);
+    }
+
+    /* a released ID is taken again before any new entry */
+    flb_task_map_free_id(ids[10], config);
+    flb_task_map_free_id(ids[20], config);
+    TEST_CHECK(config->tasks_map[ids[20]].task == NULL);
+    TEST_CHECK(flb_task_map_get_id(config) == ids[20]);
+    TEST_CHECK(flb_task_map_get_id(config) == ids[10]);
+    TEST_CHECK(flb_task_map_get_id(config) == TASK_IDS);
+    TEST_CHECK(config->tasks_map_size == FLB_TASK_MAP_SIZE * 4);
+
+    flb_free(ids);
+    flb_free(used);
+    flb_config_exit(config);
+}
+
+TEST_LIST = {
+    {"grow", test_task_map_grow},
+    { 0 }
+};
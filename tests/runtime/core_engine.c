@@ -19,6 +19,7 @@
  */
 
 #include <fluent-bit.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -29,10 +30,20 @@
 
 /* Test functions*/
 void flb_test_engine_wildcard(void);
+void flb_test_engine_workers(void);
+void flb_test_engine_workers_unsupported(void);
+void flb_test_engine_tasks_limit(void);
+void flb_test_engine_tasks_limit_retry(void);
+void flb_test_engine_lib_push_stop(void);
 
 /* Test list */
 TEST_LIST = {
     {"wildcard",    flb_test_engine_wildcard },
+    {"workers",     flb_test_engine_workers },
+    {"workers_unsupported", flb_test_engine_workers_unsupported },
+    {"tasks_limit", flb_test_engine_tasks_limit },
+    {"tasks_limit_retry", flb_test_engine_tasks_limit_retry },
+    {"lib_push_stop", flb_test_engine_lib_push_stop },
     {NULL, NULL}
 };
 
@@ -165,3 +176,353 @@ void flb_test_engine_wildcard(void)
         i++;
     }
 }
+
+#define WORKERS_INPUTS   4
+#define WORKERS_RECORDS  25
+
+struct workers_result {
+    int records;
+    int threads_count;
+    pthread_t threads[WORKERS_INPUTS];
+    pthread_mutex_t mutex;
+};
+
+/* Count the records and the threads that flushed them */
+int callback_workers(void* data, size_t size, void* cb_data)
+{
+    int i;
+    struct workers_result *r = cb_data;
+
+    flb_lib_free(data);
+
+    pthread_mutex_lock(&r->mutex);
+    r->records++;
+    for (i = 0; i < r->threads_count; i++) {
+        if (pthread_equal(r->threads[i], pthread_self())) {
+            break;
+        }
+    }
+    if (i == r->threads_count && i < WORKERS_INPUTS) {
+        r->threads[r->threads_count++] = pthread_self();
+    }
+    pthread_mutex_unlock(&r->mutex);
+
+    return 0;
+}
+
+void flb_test_engine_workers(void)
+{
+    int i;
+    int n;
+    int ret;
+    int records;
+    int64_t start;
+    int in_ffd[WORKERS_INPUTS];
+    int out_ffd;
+    char *str = (char *) "[1, {\"key\":\"value\"}]";
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb;
+    struct workers_result r;
+
+    memset(&r, 0, sizeof(r));
+    pthread_mutex_init(&r.mutex, NULL);
+    cb.cb   = callback_workers;
+    cb.data = &r;
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "1", "Grace", "1", NULL);
+
+    /* every input gets its own chunk, so each flush is a separate task */
+    for (i = 0; i < WORKERS_INPUTS; i++) {
+        in_ffd[i] = flb_input(ctx, (char *) "lib", NULL);
+        TEST_CHECK(in_ffd[i] >= 0);
+        flb_input_set(ctx, in_ffd[i], "tag", "test", NULL);
+    }
+
+    out_ffd = flb_output(ctx, (char *) "lib", &cb);
+    TEST_CHECK(out_ffd >= 0);
+    ret = flb_output_set(ctx, out_ffd, "match", "test", "workers", "2", NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < WORKERS_INPUTS; i++) {
+        for (n = 0; n < WORKERS_RECORDS; n++) {
+            ret = flb_test_lib_push(ctx, in_ffd[i], str, strlen(str));
+            TEST_CHECK(ret == strlen(str));
+        }
+    }
+
+    start = time_in_ms();
+    do {
+        usleep(10000);
+        pthread_mutex_lock(&r.mutex);
+        records = r.records;
+        pthread_mutex_unlock(&r.mutex);
+    } while (records < WORKERS_INPUTS * WORKERS_RECORDS &&
+             time_in_ms() - start < MAX_WAIT_TIME * 2);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+
+    /* the tasks are handed to the workers round-robin */
+    TEST_CHECK(r.records == WORKERS_INPUTS * WORKERS_RECORDS);
+    TEST_MSG("records=%i", r.records);
+    TEST_CHECK(r.threads_count == 2);
+    TEST_MSG("threads=%i", r.threads_count);
+    pthread_mutex_destroy(&r.mutex);
+}
+
+/* Plugins that did not opt in cannot run flushes in workers */
+void flb_test_engine_workers_unsupported(void)
+{
+    int ret;
+    int out_ffd;
+    flb_ctx_t *ctx;
+
+    ctx = flb_create();
+
+    out_ffd = flb_output(ctx, (char *) "counter", NULL);
+    TEST_CHECK(out_ffd >= 0);
+    ret = flb_output_set(ctx, out_ffd, "workers", "2", NULL);
+    TEST_CHECK(ret == -1);
+    ret = flb_output_set(ctx, out_ffd, "workers", "0", NULL);
+    TEST_CHECK(ret == 0);
+
+    out_ffd = flb_output(ctx, (char *) "null", NULL);
+    TEST_CHECK(out_ffd >= 0);
+    ret = flb_output_set(ctx, out_ffd, "workers", "2", NULL);
+    TEST_CHECK(ret == 0);
+
+    flb_destroy(ctx);
+}
+
+#define LIMIT_INPUTS 3
+
+static int callback_count(void* data, size_t size, void* cb_data)
+{
+    int *count = cb_data;
+
+    flb_lib_free(data);
+    __sync_fetch_and_add(count, 1);
+    return 0;
+}
+
+static void wait_count(int *count, int expected, int64_t max_wait)
+{
+    int64_t start;
+
+    start = time_in_ms();
+    while (__sync_fetch_and_add(count, 0) < expected &&
+           time_in_ms() - start < max_wait) {
+        usleep(10000);
+    }
+}
+
+/*
+ * An output at its tasks limit only holds its own route: the other output
+ * gets every chunk of the flush, the held routes are started later.
+ */
+void flb_test_engine_tasks_limit(void)
+{
+    int i;
+    int ret;
+    int count_limited = 0;
+    int count_other = 0;
+    int in_ffd[LIMIT_INPUTS];
+    int out_ffd;
+    char *str = (char *) "[1, {\"key\":\"value\"}]";
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb_limited;
+    struct flb_lib_out_cb cb_other;
+
+    cb_limited.cb = callback_count;
+    cb_limited.data = &count_limited;
+    cb_other.cb = callback_count;
+    cb_other.data = &count_other;
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "1", "Grace", "1", NULL);
+
+    /* one chunk per input, all of them dispatched by the same flush */
+    for (i = 0; i < LIMIT_INPUTS; i++) {
+        in_ffd[i] = flb_input(ctx, (char *) "lib", NULL);
+        TEST_CHECK(in_ffd[i] >= 0);
+        flb_input_set(ctx, in_ffd[i], "tag", "test", NULL);
+    }
+
+    out_ffd = flb_output(ctx, (char *) "lib", &cb_limited);
+    TEST_CHECK(out_ffd >= 0);
+    ret = flb_output_set(ctx, out_ffd, "match", "test", "tasks_limit", "1",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    out_ffd = flb_output(ctx, (char *) "lib", &cb_other);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd, "match", "test", NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < LIMIT_INPUTS; i++) {
+        ret = flb_test_lib_push(ctx, in_ffd[i], str, strlen(str));
+        TEST_CHECK(ret == strlen(str));
+    }
+
+    /* the first flush delivers every chunk to the output without limit */
+    wait_count(&count_other, 1, MAX_WAIT_TIME * 2);
+    wait_count(&count_other, LIMIT_INPUTS, 500);
+    TEST_CHECK(count_other == LIMIT_INPUTS);
+    TEST_MSG("other=%i", count_other);
+    TEST_CHECK(count_limited < LIMIT_INPUTS);
+
+    /* one held route is started on each of the next flushes */
+    wait_count(&count_limited, LIMIT_INPUTS, MAX_WAIT_TIME * 4);
+    TEST_CHECK(count_limited == LIMIT_INPUTS);
+    TEST_MSG("limited=%i", count_limited);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+
+    TEST_CHECK(count_other == LIMIT_INPUTS);
+}
+
+#define LIMIT_CHUNKS 2
+
+/*
+ * The slot of a chunk goes back to the output tasks limit once its flush is
+ * done there, not when the task goes away: an output retrying the same
+ * chunks (http to a closed port) must not stop the limited one.
+ */
+void flb_test_engine_tasks_limit_retry(void)
+{
+    int i;
+    int ret;
+    int count = 0;
+    int in_ffd;
+    int out_ffd;
+    char *str = (char *) "[1, {\"key\":\"value\"}]";
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb;
+
+    cb.cb = callback_count;
+    cb.data = &count;
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "1", "Grace", "1", NULL);
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    flb_input_set(ctx, in_ffd, "tag", "test", NULL);
+
+    out_ffd = flb_output(ctx, (char *) "http", NULL);
+    TEST_CHECK(out_ffd >= 0);
+    ret = flb_output_set(ctx, out_ffd, "match", "test",
+                         "host", "127.0.0.1", "port", "1",
+                         "retry_limit", "1", NULL);
+    TEST_CHECK(ret == 0);
+
+    out_ffd = flb_output(ctx, (char *) "lib", &cb);
+    TEST_CHECK(out_ffd >= 0);
+    ret = flb_output_set(ctx, out_ffd, "match", "test", "tasks_limit", "1",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    /* one chunk per flush, every task stays alive on the retrying output */
+    for (i = 0; i < LIMIT_CHUNKS; i++) {
+        ret = flb_test_lib_push(ctx, in_ffd, str, strlen(str));
+        TEST_CHECK(ret == strlen(str));
+
+        wait_count(&count, i + 1, MAX_WAIT_TIME * 2);
+        TEST_CHECK(count == i + 1);
+        TEST_MSG("chunk=%i count=%i", i, count);
+    }
+
+    /* let the single retry of each chunk fail, so they can be dropped */
+    sleep(15);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+}
+
+#define PUSH_THREADS 4
+
+struct push_worker {
+    pthread_t tid;
+    flb_ctx_t *ctx;
+    int in_ffd;
+    int pushed;
+    int ret;
+};
+
+/* Push records until the engine refuses them */
+static void *push_worker(void *data)
+{
+    int ret;
+    char *str = (char *) "[1, {\"key\":\"value\"}]";
+    struct push_worker *w = data;
+
+    while (1) {
+        ret = flb_lib_push(w->ctx, w->in_ffd, str, strlen(str));
+        if (ret == FLB_LIB_BUSY) {
+            usleep(100);
+            continue;
+        }
+        else if (ret < 0) {
+            break;
+        }
+        w->pushed++;
+    }
+    w->ret = ret;
+
+    return NULL;
+}
+
+/* Producers still pushing while the engine stops get an error */
+void flb_test_engine_lib_push_stop(void)
+{
+    int i;
+    int ret;
+    int in_ffd;
+    int out_ffd;
+    flb_ctx_t *ctx;
+    struct push_worker workers[PUSH_THREADS];
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "1", "Grace", "1", NULL);
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    flb_input_set(ctx, in_ffd, "tag", "test", "ring_size", "64", NULL);
+
+    out_ffd = flb_output(ctx, (char *) "null", NULL);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd, "match", "test", NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < PUSH_THREADS; i++) {
+        workers[i].ctx = ctx;
+        workers[i].in_ffd = in_ffd;
+        workers[i].pushed = 0;
+        workers[i].ret = 0;
+        ret = pthread_create(&workers[i].tid, NULL, push_worker, &workers[i]);
+        TEST_CHECK(ret == 0);
+    }
+
+    usleep(500000);
+    flb_stop(ctx);
+
+    for (i = 0; i < PUSH_THREADS; i++) {
+        pthread_join(workers[i].tid, NULL);
+        TEST_CHECK(workers[i].pushed > 0);
+        TEST_CHECK(workers[i].ret == -1);
+    }
+
+    flb_destroy(ctx);
+}
@@ -7,6 +7,11 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <poll.h>
 #include <unistd.h>
 
 struct kube_test {
@@ -338,6 +343,163 @@ exit:
     }
 }
 
+/* Collect every record delivered by out_lib in msgpack format */
+struct kube_splice_result {
+    msgpack_sbuffer sbuf;
+    int records;
+};
+
+static int cb_splice_collect(void *record, size_t size, void *data)
+{
+    struct kube_splice_result *res = data;
+
+    msgpack_sbuffer_write(&res->sbuf, record, size);
+    res->records++;
+    flb_free(record);
+    return 0;
+}
+
+/*
+ * Pack records using the three timestamp formats: integer, float and
+ * EventTime. None of them carries a 'log' key, so merging leaves the
+ * content as it is.
+ */
+static void splice_records(msgpack_sbuffer *sbuf)
+{
+    msgpack_packer pck;
+    struct flb_time tm;
+
+    msgpack_packer_init(&pck, sbuf, msgpack_sbuffer_write);
+
+    msgpack_pack_array(&pck, 2);
+    msgpack_pack_uint64(&pck, 1590000000);
+    msgpack_pack_map(&pck, 1);
+    msgpack_pack_str(&pck, 1);
+    msgpack_pack_str_body(&pck, "k", 1);
+    msgpack_pack_str(&pck, 1);
+    msgpack_pack_str_body(&pck, "v", 1);
+
+    msgpack_pack_array(&pck, 2);
+    msgpack_pack_double(&pck, 1590000000.5);
+    msgpack_pack_map(&pck, 2);
+    msgpack_pack_str(&pck, 1);
+    msgpack_pack_str_body(&pck, "k", 1);
+    msgpack_pack_str(&pck, 1);
+    msgpack_pack_str_body(&pck, "v", 1);
+    msgpack_pack_str(&pck, 1);
+    msgpack_pack_str_body(&pck, "n", 1);
+    msgpack_pack_int(&pck, 1);
+
+    flb_time_set(&tm, 1590000000, 123456789);
+    msgpack_pack_array(&pck, 2);
+    flb_time_append_to_msgpack(&tm, &pck, FLB_TIME_ETFMT_V1_FIXEXT);
+    msgpack_pack_map(&pck, 1);
+    msgpack_pack_str(&pck, 1);
+    msgpack_pack_str_body(&pck, "k", 1);
+    msgpack_pack_str(&pck, 0);
+    msgpack_pack_str_body(&pck, "", 0);
+}
+
+static void splice_run(const char *merge_log, struct kube_splice_result *res)
+{
+    int i;
+    int ret;
+    int in_ffd;
+    int filter_ffd;
+    int out_ffd;
+    flb_ctx_t *ctx;
+    msgpack_sbuffer sbuf;
+    struct flb_lib_out_cb cb_data;
+
+    msgpack_sbuffer_init(&res->sbuf);
+    res->records = 0;
+
+    ctx = flb_create();
+    TEST_CHECK_(ctx != NULL, "initialising service");
+    if (!ctx) {
+        return;
+    }
+    flb_service_set(ctx, "Flush", "0.2", "Grace", "1",
+                    "Log_Level", "error",
+                    "Parsers_File", DPATH "/parsers.conf",
+                    NULL);
+
+    /* metadata comes from the core_base.meta preload file */
+    in_ffd = flb_input(ctx, "lib", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    flb_input_set(ctx, in_ffd, "Tag", "kube.core.base.fluent-bit", NULL);
+
+    filter_ffd = flb_filter(ctx, "kubernetes", NULL);
+    TEST_CHECK(filter_ffd >= 0);
+    ret = flb_filter_set(ctx, filter_ffd,
+                         "Match", "kube.*",
+                         "Kube_Url", KUBE_URL,
+                         "Kube_Meta_Preload_Cache_Dir", DPATH "/meta",
+                         "Regex_Parser", "kubernetes-tag",
+                         "Kube_Tag_Prefix", "kube.",
+                         "Merge_Log", merge_log,
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    cb_data.cb = cb_splice_collect;
+    cb_data.data = res;
+    out_ffd = flb_output(ctx, "lib", (void *) &cb_data);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd, "Match", "kube.*", "format", "msgpack", NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK_(ret == 0, "starting engine");
+    if (ret == 0) {
+        msgpack_sbuffer_init(&sbuf);
+        splice_records(&sbuf);
+        ret = flb_lib_push_msgpack(ctx, in_ffd, sbuf.data, sbuf.size);
+        TEST_CHECK(ret >= 0);
+        msgpack_sbuffer_destroy(&sbuf);
+
+        for (i = 0; i < 2000 && res->records < 3; i++) {
+            usleep(1000);
+        }
+        flb_stop(ctx);
+    }
+    flb_destroy(ctx);
+}
+
+/*
+ * With Merge_Log off the cached metadata is spliced into the record bytes,
+ * with Merge_Log on the record is decoded and packed again. Both must give
+ * the same bytes, timestamps included.
+ */
+void flb_test_core_splice(void)
+{
+    size_t off = 0;
+    msgpack_unpacked result;
+    struct kube_splice_result splice;
+    struct kube_splice_result repack;
+
+    splice_run("Off", &splice);
+    splice_run("On", &repack);
+
+    TEST_CHECK(splice.records == 3);
+    TEST_CHECK(repack.records == 3);
+    TEST_CHECK(splice.sbuf.size == repack.sbuf.size);
+    if (splice.sbuf.size == repack.sbuf.size) {
+        TEST_CHECK(memcmp(splice.sbuf.data, repack.sbuf.data,
+                          splice.sbuf.size) == 0);
+    }
+
+    /* every timestamp is an EventTime */
+    msgpack_unpacked_init(&result);
+    while (msgpack_unpack_next(&result, splice.sbuf.data, splice.sbuf.size,
+                               &off) == MSGPACK_UNPACK_SUCCESS) {
+        TEST_CHECK(result.data.type == MSGPACK_OBJECT_ARRAY &&
+                   result.data.via.array.ptr[0].type == MSGPACK_OBJECT_EXT);
+    }
+    msgpack_unpacked_destroy(&result);
+
+    msgpack_sbuffer_destroy(&splice.sbuf);
+    msgpack_sbuffer_destroy(&repack.sbuf);
+}
+
 #define flb_test_core(target, suffix, nExpected) \
     kube_test("core/" target, KUBE_TAIL, suffix, nExpected, NULL);
 
@@ -361,6 +523,497 @@ static void flb_test_core_unescaping_json()
     flb_test_core("core_unescaping_json", NULL, 1);
 }
 
+/*
+ * No API server is listening: the watcher cannot list the node pods, the
+ * miss is served by the fetcher thread (from the preload cache directory)
+ * while the filter holds the record back.
+ */
+static void flb_test_core_meta_watch()
+{
+    kube_test("core/core_base_fluent-bit", KUBE_TAIL, NULL, 1,
+              "Kube_Meta_Watch", "On",
+              "Kube_Node_Name", "ip-10-49-18-80.eu-west-1.compute.internal",
+              "Kube_Meta_Miss_Wait", "1000",
+              NULL);
+}
+
+/*
+ * Local stand-in of the API server for the metadata watcher: it lists the
+ * pods of 'node1', serves single pods and keeps the watch connection open
+ * so the test case can send events through it.
+ */
+#define KUBE_WATCH_NODE  "node1"
+#define KUBE_WATCH_NS    "watch"
+#define KUBE_WATCH_ID    "c9898099f6d235126d564ed38a020007" \
+                         "ea7a6fac6e25e718de683c9dd0076c16"
+
+struct kube_api_pod {
+    const char *name;
+    const char *version;           /* value of the 'app' label */
+    int listed;                    /* part of the node pods list */
+    int fetchable;                 /* served by the pod end point */
+    int fetches;
+};
+
+struct kube_api {
+    int fd;
+    int watch_fd;
+    int running;
+    pthread_t tid;
+    pthread_mutex_t mutex;
+    struct kube_api_pod pods[4];
+};
+
+#define KUBE_POD_A  0
+#define KUBE_POD_B  1
+#define KUBE_POD_C  2
+#define KUBE_POD_D  3
+
+struct kube_watch_test {
+    flb_ctx_t *flb;
+    int in_ffd[4];
+    int records;
+    char *last[64];
+    pthread_mutex_t mutex;
+    struct flb_lib_out_cb cb_data;
+    struct kube_api api;
+};
+
+static int api_pod_json(struct kube_api_pod *pod, char *buf, size_t size)
+{
+    return snprintf(buf, size,
+                    "{\"kind\":\"Pod\",\"metadata\":{\"name\":\"%s\","
+                    "\"namespace\":\"" KUBE_WATCH_NS "\","
+                    "\"uid\":\"uid-%s\",\"resourceVersion\":\"%s\","
+                    "\"labels\":{\"app\":\"%s\"}},"
+                    "\"spec\":{\"nodeName\":\"" KUBE_WATCH_NODE "\","
+                    "\"containers\":[{\"name\":\"app\",\"image\":\"app:%s\"}]}}",
+                    pod->name, pod->name, pod->version, pod->version,
+                    pod->version);
+}
+
+static void api_reply(int fd, int status, const char *body)
+{
+    int len;
+    char buf[8192];
+
+    len = snprintf(buf, sizeof(buf),
+                   "HTTP/1.1 %i %s\r\n"
+                   "Content-Type: application/json\r\n"
+                   "Content-Length: %i\r\n"
+                   "Connection: close\r\n\r\n%s",
+                   status, status == 200 ? "OK" : "Not Found",
+                   (int) strlen(body), body);
+    send(fd, buf, len, MSG_NOSIGNAL);
+}
+
+/* Serve one request, the connection is closed unless it is a watch */
+static void api_handle(struct kube_api *api, int fd)
+{
+    int i;
+    int len = 0;
+    ssize_t n;
+    char req[4096];
+    char body[8192];
+    char name[64];
+    const char *hdr = "HTTP/1.1 200 OK\r\n"
+                      "Content-Type: application/json\r\n"
+                      "Transfer-Encoding: chunked\r\n\r\n";
+
+    while (len < sizeof(req) - 1) {
+        n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n <= 0) {
+            close(fd);
+            return;
+        }
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n")) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&api->mutex);
+    if (strstr(req, "&watch=1")) {
+        send(fd, hdr, strlen(hdr), MSG_NOSIGNAL);
+        if (api->watch_fd != -1) {
+            close(api->watch_fd);
+        }
+        api->watch_fd = fd;
+        pthread_mutex_unlock(&api->mutex);
+        return;
+    }
+
+    if (strncmp(req, "GET /api/v1/pods?", 17) == 0) {
+        len = snprintf(body, sizeof(body),
+                       "{\"kind\":\"PodList\","
+                       "\"metadata\":{\"resourceVersion\":\"1\"},\"items\":[");
+        for (i = 0; i < 4; i++) {
+            if (!api->pods[i].listed) {
+                continue;
+            }
+            if (body[len - 1] == '}') {
+                body[len++] = ',';
+            }
+            len += api_pod_json(&api->pods[i], body + len, sizeof(body) - len);
+        }
+        snprintf(body + len, sizeof(body) - len, "]}");
+        api_reply(fd, 200, body);
+    }
+    else if (sscanf(req, "GET /api/v1/namespaces/" KUBE_WATCH_NS
+                    "/pods/%63[^ ]", name) == 1) {
+        for (i = 0; i < 4; i++) {
+            if (strcmp(api->pods[i].name, name) == 0) {
+                break;
+            }
+        }
+        if (i < 4) {
+            api->pods[i].fetches++;
+        }
+        if (i < 4 && api->pods[i].fetchable) {
+            api_pod_json(&api->pods[i], body, sizeof(body));
+            api_reply(fd, 200, body);
+        }
+        else {
+            api_reply(fd, 404, "");
+        }
+    }
+    else {
+        api_reply(fd, 404, "");
+    }
+    pthread_mutex_unlock(&api->mutex);
+    close(fd);
+}
+
+static void *api_worker(void *data)
+{
+    int fd;
+    struct pollfd pfd;
+    struct kube_api *api = data;
+
+    pfd.fd = api->fd;
+    pfd.events = POLLIN;
+    while (api->running) {
+        if (poll(&pfd, 1, 50) <= 0) {
+            continue;
+        }
+        fd = accept(api->fd, NULL, NULL);
+        if (fd != -1) {
+            api_handle(api, fd);
+        }
+    }
+    return NULL;
+}
+
+static int api_start(struct kube_api *api)
+{
+    int on = 1;
+    struct sockaddr_in addr;
+
+    api->watch_fd = -1;
+    api->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (api->fd == -1) {
+        return -1;
+    }
+    setsockopt(api->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(KUBE_PORT));
+    addr.sin_addr.s_addr = inet_addr(KUBE_IP);
+    if (bind(api->fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+        listen(api->fd, 16) == -1) {
+        close(api->fd);
+        return -1;
+    }
+
+    pthread_mutex_init(&api->mutex, NULL);
+    api->running = FLB_TRUE;
+    return pthread_create(&api->tid, NULL, api_worker, api);
+}
+
+static void api_stop(struct kube_api *api)
+{
+    api->running = FLB_FALSE;
+    pthread_join(api->tid, NULL);
+    if (api->watch_fd != -1) {
+        close(api->watch_fd);
+    }
+    close(api->fd);
+    pthread_mutex_destroy(&api->mutex);
+}
+
+/* Send a watch event through the open watch connection */
+static int api_event(struct kube_api *api, const char *type, int pod)
+{
+    int i;
+    int len;
+    int ret = -1;
+    char obj[2048];
+    char event[2560];
+    char buf[4096];
+
+    /* wait for the watcher to list the pods and start watching */
+    for (i = 0; i < 2000; i++) {
+        pthread_mutex_lock(&api->mutex);
+        if (api->watch_fd != -1) {
+            break;
+        }
+        pthread_mutex_unlock(&api->mutex);
+        usleep(1000);
+    }
+    if (i == 2000) {
+        return -1;
+    }
+
+    api_pod_json(&api->pods[pod], obj, sizeof(obj));
+    snprintf(event, sizeof(event), "{\"type\":\"%s\",\"object\":%s}\n",
+             type, obj);
+    len = snprintf(buf, sizeof(buf), "%x\r\n%s\r\n",
+                   (int) strlen(event), event);
+    if (send(api->watch_fd, buf, len, MSG_NOSIGNAL) == len) {
+        ret = 0;
+    }
+    pthread_mutex_unlock(&api->mutex);
+
+    /* let the watcher apply it */
+    usleep(200000);
+    return ret;
+}
+
+static int cb_watch_collect(void *record, size_t size, void *data)
+{
+    struct kube_watch_test *t = data;
+
+    pthread_mutex_lock(&t->mutex);
+    if (t->records < 64) {
+        t->last[t->records++] = record;
+    }
+    else {
+        flb_free(record);
+    }
+    pthread_mutex_unlock(&t->mutex);
+    return 0;
+}
+
+static int watch_test_start(struct kube_watch_test *t, const char *miss_wait)
+{
+    int i;
+    int ret;
+    int filter_ffd;
+    int out_ffd;
+    char tag[256];
+    static const char *names[] = {"pod-a", "pod-b", "pod-c", "pod-d"};
+
+    memset(t, 0, sizeof(struct kube_watch_test));
+    pthread_mutex_init(&t->mutex, NULL);
+    for (i = 0; i < 4; i++) {
+        t->api.pods[i].name = names[i];
+        t->api.pods[i].version = "v1";
+    }
+
+    t->flb = flb_create();
+    TEST_CHECK_(t->flb != NULL, "initialising service");
+    flb_service_set(t->flb, "Flush", "1", "Grace", "1",
+                    "Log_Level", "error", NULL);
+
+    for (i = 0; i < 4; i++) {
+        snprintf(tag, sizeof(tag),
+                 "kube.var.log.containers.%s_" KUBE_WATCH_NS "_app-"
+                 KUBE_WATCH_ID ".log", names[i]);
+        t->in_ffd[i] = flb_input(t->flb, "lib", NULL);
+        TEST_CHECK_(t->in_ffd[i] >= 0, "initialising input");
+        flb_input_set(t->flb, t->in_ffd[i], "tag", tag, NULL);
+    }
+
+    filter_ffd = flb_filter(t->flb, "kubernetes", NULL);
+    TEST_CHECK_(filter_ffd >= 0, "initialising filter");
+    ret = flb_filter_set(t->flb, filter_ffd,
+                         "Match", "kube.*",
+                         "Kube_Url", KUBE_URL,
+                         "Kube_Meta_Watch", "On",
+                         "Kube_Node_Name", KUBE_WATCH_NODE,
+                         "Kube_Meta_Miss_Wait", miss_wait,
+                         NULL);
+    TEST_CHECK_(ret == 0, "setting filter options");
+
+    t->cb_data.cb = cb_watch_collect;
+    t->cb_data.data = t;
+    out_ffd = flb_output(t->flb, "lib", (void *) &t->cb_data);
+    TEST_CHECK_(out_ffd >= 0, "initialising output");
+    flb_output_set(t->flb, out_ffd, "Match", "kube.*", "format", "json", NULL);
+
+    return 0;
+}
+
+static int watch_test_run(struct kube_watch_test *t)
+{
+    int ret;
+
+    ret = api_start(&t->api);
+    TEST_CHECK_(ret == 0, "starting the API server stand-in");
+    if (ret != 0) {
+        return -1;
+    }
+
+    ret = flb_start(t->flb);
+    TEST_CHECK_(ret == 0, "starting engine");
+    return ret;
+}
+
+static void watch_test_push(struct kube_watch_test *t, int pod, const char *step)
+{
+    int ret;
+    char buf[256];
+
+    ret = snprintf(buf, sizeof(buf), "[%lu, {\"log\":\"%s\"}]",
+                   (unsigned long) time(NULL), step);
+    flb_lib_push(t->flb, t->in_ffd[pod], buf, ret);
+}
+
+/* Wait for the record of a step and check its metadata */
+static void watch_test_check(struct kube_watch_test *t, const char *step,
+                             const char *expected)
+{
+    int i;
+    int n;
+    char *record = NULL;
+    char log[128];
+
+    snprintf(log, sizeof(log), "\"log\":\"%s\"", step);
+    for (n = 0; n < 5000 && !record; n++) {
+        pthread_mutex_lock(&t->mutex);
+        for (i = 0; i < t->records; i++) {
+            if (strstr(t->last[i], log)) {
+                record = t->last[i];
+                break;
+            }
+        }
+        pthread_mutex_unlock(&t->mutex);
+        usleep(1000);
+    }
+
+    TEST_CHECK_(record != NULL, "record %s delivered", step);
+    if (!record) {
+        return;
+    }
+    if (expected) {
+        TEST_CHECK_(strstr(record, expected) != NULL,
+                    "record %s has %s", step, expected);
+    }
+    else {
+        TEST_CHECK_(strstr(record, "\"kubernetes\"") == NULL,
+                    "record %s has no metadata", step);
+    }
+    TEST_MSG("record: %s", record);
+}
+
+static void watch_test_stop(struct kube_watch_test *t)
+{
+    int i;
+
+    flb_stop(t->flb);
+    flb_destroy(t->flb);
+    api_stop(&t->api);
+
+    for (i = 0; i < t->records; i++) {
+        flb_free(t->last[i]);
+    }
+    pthread_mutex_destroy(&t->mutex);
+}
+
+/* The pods of the node are listed once, no pod is fetched on demand */
+static void flb_test_watch_list()
+{
+    struct kube_watch_test t;
+
+    watch_test_start(&t, "1000");
+    t.api.pods[KUBE_POD_A].listed = FLB_TRUE;
+    t.api.pods[KUBE_POD_B].listed = FLB_TRUE;
+    t.api.pods[KUBE_POD_B].version = "v2";
+    if (watch_test_run(&t) == 0) {
+        api_event(&t.api, "BOOKMARK", KUBE_POD_A);
+        watch_test_push(&t, KUBE_POD_A, "list-a");
+        watch_test_push(&t, KUBE_POD_B, "list-b");
+        watch_test_check(&t, "list-a", "\"labels\":{\"app\":\"v1\"}");
+        watch_test_check(&t, "list-b", "\"labels\":{\"app\":\"v2\"}");
+    }
+    watch_test_stop(&t);
+
+    TEST_CHECK(t.api.pods[KUBE_POD_A].fetches == 0);
+    TEST_CHECK(t.api.pods[KUBE_POD_B].fetches == 0);
+}
+
+/* Watch events replace the snapshot and invalidate the cached metadata */
+static void flb_test_watch_events()
+{
+    struct kube_watch_test t;
+
+    watch_test_start(&t, "300");
+    t.api.pods[KUBE_POD_A].listed = FLB_TRUE;
+    if (watch_test_run(&t) == 0) {
+        api_event(&t.api, "BOOKMARK", KUBE_POD_A);
+        watch_test_push(&t, KUBE_POD_A, "events-1");
+        watch_test_check(&t, "events-1", "\"labels\":{\"app\":\"v1\"}");
+
+        /* MODIFIED: the cached metadata of the pod is dropped */
+        pthread_mutex_lock(&t.api.mutex);
+        t.api.pods[KUBE_POD_A].version = "v2";
+        pthread_mutex_unlock(&t.api.mutex);
+        api_event(&t.api, "MODIFIED", KUBE_POD_A);
+        watch_test_push(&t, KUBE_POD_A, "events-2");
+        watch_test_check(&t, "events-2", "\"labels\":{\"app\":\"v2\"}");
+
+        /* ADDED: served from the snapshot, not fetched */
+        api_event(&t.api, "ADDED", KUBE_POD_B);
+        watch_test_push(&t, KUBE_POD_B, "events-3");
+        watch_test_check(&t, "events-3", "\"pod_name\":\"pod-b\"");
+
+        /* DELETED: the pod is gone from the snapshot and the API server */
+        api_event(&t.api, "DELETED", KUBE_POD_A);
+        watch_test_push(&t, KUBE_POD_A, "events-4");
+        watch_test_check(&t, "events-4", NULL);
+    }
+    watch_test_stop(&t);
+
+    TEST_CHECK(t.api.pods[KUBE_POD_B].fetches == 0);
+    TEST_CHECK(t.api.pods[KUBE_POD_A].fetches == 1);
+}
+
+/*
+ * A pod missing in the snapshot is fetched while the record waits; a pod
+ * that cannot be fetched is only requested (and waited for) once.
+ */
+static void flb_test_watch_miss_fetch()
+{
+    int i;
+    char step[32];
+    struct kube_watch_test t;
+
+    watch_test_start(&t, "1000");
+    t.api.pods[KUBE_POD_C].fetchable = FLB_TRUE;
+    if (watch_test_run(&t) == 0) {
+        api_event(&t.api, "BOOKMARK", KUBE_POD_A);
+        watch_test_push(&t, KUBE_POD_C, "miss-c");
+        watch_test_check(&t, "miss-c", "\"pod_name\":\"pod-c\"");
+
+        /* the first chunk waits for the fetch, the next ones do not */
+        watch_test_push(&t, KUBE_POD_D, "miss-d-0");
+        usleep(1200000);
+        for (i = 1; i < 5; i++) {
+            snprintf(step, sizeof(step), "miss-d-%i", i);
+            watch_test_push(&t, KUBE_POD_D, step);
+            usleep(100000);
+        }
+        watch_test_check(&t, "miss-d-4", NULL);
+    }
+    watch_test_stop(&t);
+
+    TEST_CHECK(t.api.pods[KUBE_POD_C].fetches == 1);
+    TEST_CHECK(t.api.pods[KUBE_POD_D].fetches == 1);
+    TEST_MSG("pod-d fetches: %i", t.api.pods[KUBE_POD_D].fetches);
+}
+
 #define flb_test_options_merge_log_enabled(target, suffix, nExpected) \
     kube_test("options/" target, KUBE_TAIL, suffix, nExpected, \
               "Merge_Log", "On", \
@@ -928,9 +1581,14 @@ static void flb_test_systemd_logs()
 
 TEST_LIST = {
     {"kube_core_base", flb_test_core_base},
+    {"kube_core_splice", flb_test_core_splice},
     {"kube_core_no_meta", flb_test_core_no_meta},
     {"kube_core_unescaping_text", flb_test_core_unescaping_text},
     {"kube_core_unescaping_json", flb_test_core_unescaping_json},
+    {"kube_core_meta_watch", flb_test_core_meta_watch},
+    {"kube_watch_list", flb_test_watch_list},
+    {"kube_watch_events", flb_test_watch_events},
+    {"kube_watch_miss_fetch", flb_test_watch_miss_fetch},
     {"kube_options_merge_log_enabled_text", flb_test_options_merge_log_enabled_text},
     {"kube_options_merge_log_enabled_json", flb_test_options_merge_log_enabled_json},
     {"kube_options_merge_log_enabled_invalid_json", flb_test_options_merge_log_enabled_invalid_json},
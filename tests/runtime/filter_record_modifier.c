@@ -0,0 +1,183 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit.h>
+#include "flb_tests_runtime.h"
+
+#define MAX_WAIT_TIME  2000
+
+struct filter_test {
+    flb_ctx_t *flb;    /* Fluent Bit library context */
+    int i_ffd;         /* Input fd  */
+};
+
+struct expect {
+    char *map;         /* expected record map, in JSON */
+    int records;       /* records received             */
+    int matched;       /* records equal to 'map'       */
+};
+
+/* Callback to check the whole record map */
+static int cb_check_result(void *record, size_t size, void *data)
+{
+    char *p;
+    struct expect *exp = data;
+
+    p = strchr((char *) record, '{');
+    exp->records++;
+    if (p && strncmp(p, exp->map, strlen(exp->map)) == 0 &&
+        strcmp(p + strlen(exp->map), "]") == 0) {
+        exp->matched++;
+    }
+    else {
+        flb_error("Expected '%s' in result '%s'", exp->map, (char *) record);
+    }
+
+    flb_free(record);
+    return 0;
+}
+
+static struct filter_test *filter_test_create(struct flb_lib_out_cb *data)
+{
+    int i_ffd;
+    int o_ffd;
+    struct filter_test *ctx;
+
+    ctx = flb_malloc(sizeof(struct filter_test));
+    if (!ctx) {
+        flb_errno();
+        return NULL;
+    }
+
+    ctx->flb = flb_create();
+    flb_service_set(ctx->flb,
+                    "Flush", "0.200000000",
+                    "Grace", "1",
+                    NULL);
+
+    i_ffd = flb_input(ctx->flb, (char *) "lib", NULL);
+    TEST_CHECK(i_ffd >= 0);
+    flb_input_set(ctx->flb, i_ffd, "tag", "test", NULL);
+    ctx->i_ffd = i_ffd;
+
+    o_ffd = flb_output(ctx->flb, (char *) "lib", (void *) data);
+    TEST_CHECK(o_ffd >= 0);
+    flb_output_set(ctx->flb, o_ffd,
+                   "match", "test",
+                   "format", "json",
+                   NULL);
+
+    return ctx;
+}
+
+static int filter_add(struct filter_test *ctx, char *name)
+{
+    int f_ffd;
+
+    f_ffd = flb_filter(ctx->flb, name, NULL);
+    TEST_CHECK(f_ffd >= 0);
+    flb_filter_set(ctx->flb, f_ffd, "match", "*", NULL);
+
+    return f_ffd;
+}
+
+static void filter_test_run(struct filter_test *ctx, struct expect *exp,
+                            int records)
+{
+    int i;
+    int len;
+    int ret;
+    int bytes;
+    int waited = 0;
+    char *p = "[0, {\"k\":\"v\",\"drop\":1}]";
+
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    len = strlen(p);
+    for (i = 0; i < records; i++) {
+        bytes = flb_test_lib_push(ctx->flb, ctx->i_ffd, p, len);
+        TEST_CHECK(bytes == len);
+    }
+
+    while (exp->records < records && waited < MAX_WAIT_TIME) {
+        usleep(10000);
+        waited += 10;
+    }
+
+    flb_stop(ctx->flb);
+    flb_destroy(ctx->flb);
+    flb_free(ctx);
+
+    TEST_CHECK(exp->records == records);
+    TEST_CHECK(exp->matched == records);
+    TEST_MSG("records=%i matched=%i", exp->records, exp->matched);
+}
+
+/* A single record based filter */
+static void flb_test_single()
+{
+    int f_ffd;
+    struct flb_lib_out_cb cb_data;
+    struct filter_test *ctx;
+    struct expect exp = {"{\"k\":\"v\",\"a\":\"1\"}", 0, 0};
+
+    cb_data.cb = cb_check_result;
+    cb_data.data = &exp;
+
+    ctx = filter_test_create(&cb_data);
+    if (!ctx) {
+        exit(EXIT_FAILURE);
+    }
+
+    f_ffd = filter_add(ctx, "record_modifier");
+    flb_filter_set(ctx->flb, f_ffd,
+                   "record", "a 1",
+                   "remove_key", "drop",
+                   NULL);
+
+    filter_test_run(ctx, &exp, 3);
+}
+
+/*
+ * Two record based filters share a stage, a legacy filter runs on the
+ * serialized result and a third record based filter opens a new stage.
+ */
+static void flb_test_stages()
+{
+    int f_ffd;
+    struct flb_lib_out_cb cb_data;
+    struct filter_test *ctx;
+    struct expect exp = {"{\"k\":\"v\",\"A\":\"1\",\"b\":\"2\",\"c\":\"3\"}",
+                         0, 0};
+
+    cb_data.cb = cb_check_result;
+    cb_data.data = &exp;
+
+    ctx = filter_test_create(&cb_data);
+    if (!ctx) {
+        exit(EXIT_FAILURE);
+    }
+
+    f_ffd = filter_add(ctx, "record_modifier");
+    flb_filter_set(ctx->flb, f_ffd,
+                   "record", "a 1",
+                   "remove_key", "drop",
+                   NULL);
+
+    f_ffd = filter_add(ctx, "record_modifier");
+    flb_filter_set(ctx->flb, f_ffd, "record", "b 2", NULL);
+
+    f_ffd = filter_add(ctx, "modify");
+    flb_filter_set(ctx->flb, f_ffd, "rename", "a A", NULL);
+
+    f_ffd = filter_add(ctx, "record_modifier");
+    flb_filter_set(ctx->flb, f_ffd, "record", "c 3", NULL);
+
+    filter_test_run(ctx, &exp, 3);
+}
+
+TEST_LIST = {
+    {"single",      flb_test_single},
+    {"stages",      flb_test_stages},
+    {NULL, NULL}
+};
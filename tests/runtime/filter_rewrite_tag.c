@@ -0,0 +1,162 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit.h>
+#include <fluent-bit/flb_time.h>
+#include <msgpack.h>
+#include "flb_tests_runtime.h"
+
+#define MAX_WAIT_TIME  3000   /* milliseconds */
+
+/* Records received on each tag */
+struct rtag_counts {
+    int orig;
+    int a;
+    int b;
+};
+
+static int cb_count(void *record, size_t size, void *data)
+{
+    int *count = data;
+    (void) size;
+
+    __sync_fetch_and_add(count, 1);
+    flb_free(record);
+    return 0;
+}
+
+static void out_add(flb_ctx_t *ctx, char *match, struct flb_lib_out_cb *cb,
+                    int *count)
+{
+    int out_ffd;
+
+    cb->cb = cb_count;
+    cb->data = count;
+    out_ffd = flb_output(ctx, (char *) "lib", cb);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd, "match", match, NULL);
+}
+
+/*
+ * Pack 'n_a' records with key=a followed by 'n_b' records with key=b in a
+ * single buffer, so the filter gets all of them in one chunk.
+ */
+static void pack_records(msgpack_sbuffer *sbuf, int n_a, int n_b)
+{
+    int i;
+    char *key;
+    msgpack_packer pck;
+
+    msgpack_sbuffer_init(sbuf);
+    msgpack_packer_init(&pck, sbuf, msgpack_sbuffer_write);
+
+    for (i = 0; i < n_a + n_b; i++) {
+        key = i < n_a ? "a" : "b";
+        msgpack_pack_array(&pck, 2);
+        msgpack_pack_uint64(&pck, 1590000000 + i);
+        msgpack_pack_map(&pck, 2);
+        msgpack_pack_str(&pck, 3);
+        msgpack_pack_str_body(&pck, "key", 3);
+        msgpack_pack_str(&pck, 1);
+        msgpack_pack_str_body(&pck, key, 1);
+        msgpack_pack_str(&pck, 1);
+        msgpack_pack_str_body(&pck, "n", 1);
+        msgpack_pack_int(&pck, i);
+    }
+}
+
+static void rtag_run(char *mem_buf_limit, int n_a, int n_b,
+                     struct rtag_counts *counts, int expected)
+{
+    int ret;
+    int in_ffd;
+    int f_ffd;
+    int waited = 0;
+    flb_ctx_t *ctx;
+    msgpack_sbuffer sbuf;
+    struct flb_lib_out_cb cb_orig;
+    struct flb_lib_out_cb cb_a;
+    struct flb_lib_out_cb cb_b;
+
+    memset(counts, 0, sizeof(struct rtag_counts));
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "0.200000000", "Grace", "1",
+                    "Log_Level", "error", NULL);
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    flb_input_set(ctx, in_ffd, "tag", "orig", NULL);
+
+    /* records are moved to their new tag */
+    f_ffd = flb_filter(ctx, (char *) "rewrite_tag", NULL);
+    TEST_CHECK(f_ffd >= 0);
+    ret = flb_filter_set(ctx, f_ffd,
+                         "match", "orig",
+                         "rule", "$key ^(a|b)$ new.$key false",
+                         NULL);
+    TEST_CHECK(ret == 0);
+    if (mem_buf_limit) {
+        ret = flb_filter_set(ctx, f_ffd,
+                             "emitter_mem_buf_limit", mem_buf_limit,
+                             NULL);
+        TEST_CHECK(ret == 0);
+    }
+
+    out_add(ctx, "orig", &cb_orig, &counts->orig);
+    out_add(ctx, "new.a", &cb_a, &counts->a);
+    out_add(ctx, "new.b", &cb_b, &counts->b);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    pack_records(&sbuf, n_a, n_b);
+    ret = flb_lib_push_msgpack(ctx, in_ffd, sbuf.data, sbuf.size);
+    TEST_CHECK(ret >= 0);
+    msgpack_sbuffer_destroy(&sbuf);
+
+    while (__sync_fetch_and_add(&counts->orig, 0) +
+           __sync_fetch_and_add(&counts->a, 0) +
+           __sync_fetch_and_add(&counts->b, 0) < expected &&
+           waited < MAX_WAIT_TIME) {
+        usleep(10000);
+        waited += 10;
+    }
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+}
+
+/* Each group of a chunk is emitted with its new tag */
+void flb_test_rewrite_tag_batched_emit()
+{
+    struct rtag_counts counts;
+
+    rtag_run(NULL, 30, 20, &counts, 50);
+
+    TEST_CHECK(counts.a == 30);
+    TEST_CHECK(counts.b == 20);
+    TEST_CHECK(counts.orig == 0);
+    TEST_MSG("orig=%i a=%i b=%i", counts.orig, counts.a, counts.b);
+}
+
+/*
+ * The emitter takes the first group but its memory limit refuses the
+ * second one: those records stay in the original chunk with their tag.
+ */
+void flb_test_rewrite_tag_emit_refused()
+{
+    struct rtag_counts counts;
+
+    rtag_run("1000", 10, 200, &counts, 210);
+
+    TEST_CHECK(counts.a == 10);
+    TEST_CHECK(counts.b == 0);
+    TEST_CHECK(counts.orig == 200);
+    TEST_MSG("orig=%i a=%i b=%i", counts.orig, counts.a, counts.b);
+}
+
+TEST_LIST = {
+    {"batched_emit", flb_test_rewrite_tag_batched_emit},
+    {"emit_refused", flb_test_rewrite_tag_emit_refused},
+    {NULL, NULL}
+};
@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_TESTS_RUNTIME_H
+#define FLB_TESTS_RUNTIME_H
+
+#include <unistd.h>
+#include <fluent-bit.h>
+
+#include "../lib/acutest/acutest.h"
+#define FLB_TESTS_DATA_PATH "/root/repo/tests/runtime"
+
+/*
+ * Push data through the 'lib' input, when its ring is full wait for the
+ * engine to drain it instead of failing.
+ */
+static inline int flb_test_lib_push(flb_ctx_t *ctx, int ffd,
+                                    const void *data, size_t len)
+{
+    int ret;
+
+    while ((ret = flb_lib_push(ctx, ffd, data, len)) == FLB_LIB_BUSY) {
+        usleep(1000);
+    }
+    return ret;
+}
+
+#endif
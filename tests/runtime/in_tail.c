@@ -0,0 +1,350 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "flb_tests_runtime.h"
+
+#ifdef FLB_HAVE_SQLDB
+#include <sqlite3.h>
+#endif
+
+#define MAX_WAIT_TIME  10000   /* milliseconds */
+
+static int records;
+
+static int cb_count(void *record, size_t size, void *data)
+{
+    (void) size;
+    (void) data;
+
+    __sync_fetch_and_add(&records, 1);
+    flb_free(record);
+    return 0;
+}
+
+static int write_lines(char *path, char *mode, int lines)
+{
+    int i;
+    FILE *fp;
+
+    fp = fopen(path, mode);
+    if (!fp) {
+        return -1;
+    }
+    for (i = 0; i < lines; i++) {
+        fprintf(fp, "line %i of the tail runtime test\n", i);
+    }
+    fclose(fp);
+    return 0;
+}
+
+static void wait_records(int expected)
+{
+    int waited = 0;
+
+    while (__sync_fetch_and_add(&records, 0) < expected &&
+           waited < MAX_WAIT_TIME) {
+        usleep(10000);
+        waited += 10;
+    }
+}
+
+static flb_ctx_t *tail_create(char *path, char *db, char *db_flush,
+                              struct flb_lib_out_cb *cb)
+{
+    int ret;
+    int in_ffd;
+    int out_ffd;
+    flb_ctx_t *ctx;
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "0.200000000", "Grace", "1",
+                    "Log_Level", "error", NULL);
+
+    in_ffd = flb_input(ctx, (char *) "tail", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    ret = flb_input_set(ctx, in_ffd,
+                        "tag", "test",
+                        "path", path,
+                        "refresh_interval", "1",
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    if (db) {
+        ret = flb_input_set(ctx, in_ffd,
+                            "db", db,
+                            "db.flush_interval", db_flush,
+                            NULL);
+        TEST_CHECK(ret == 0);
+    }
+
+    out_ffd = flb_output(ctx, (char *) "lib", cb);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd, "match", "test", NULL);
+
+    return ctx;
+}
+
+/*
+ * Lines appended once the file was promoted to event mode: the size of
+ * the file is refreshed before the pending data is read.
+ */
+void flb_test_in_tail_append()
+{
+    int i;
+    int ret;
+    char path[256];
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb;
+
+    snprintf(path, sizeof(path) - 1, "/tmp/flb-rt-in_tail-%i.log", getpid());
+    ret = write_lines(path, "w", 0);
+    TEST_CHECK(ret == 0);
+
+    records = 0;
+    cb.cb = cb_count;
+    cb.data = NULL;
+
+    ctx = tail_create(path, NULL, NULL, &cb);
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    /* let the file be promoted to event mode */
+    sleep(1);
+
+    for (i = 0; i < 5; i++) {
+        ret = write_lines(path, "a", 1000);
+        TEST_CHECK(ret == 0);
+        usleep(100000);
+    }
+    wait_records(5000);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    unlink(path);
+
+    TEST_CHECK(records == 5000);
+    TEST_MSG("records=%i", records);
+}
+
+/* Content found at startup is read, then the appended lines */
+void flb_test_in_tail_static_append()
+{
+    int ret;
+    char path[256];
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb;
+
+    snprintf(path, sizeof(path) - 1, "/tmp/flb-rt-in_tail-%i.log", getpid());
+    ret = write_lines(path, "w", 20000);
+    TEST_CHECK(ret == 0);
+
+    records = 0;
+    cb.cb = cb_count;
+    cb.data = NULL;
+
+    ctx = tail_create(path, NULL, NULL, &cb);
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    wait_records(20000);
+    ret = write_lines(path, "a", 1000);
+    TEST_CHECK(ret == 0);
+    wait_records(21000);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    unlink(path);
+
+    TEST_CHECK(records == 21000);
+    TEST_MSG("records=%i", records);
+}
+
+#ifdef FLB_HAVE_SQLDB
+/*
+ * Offset stored in the database for a file, -1 if it has no entry. The
+ * database is opened read-only next to the running plugin.
+ */
+static long long db_offset(char *db, char *path)
+{
+    int ret;
+    long long offset = -1;
+    sqlite3 *sql;
+    sqlite3_stmt *stmt;
+
+    ret = sqlite3_open_v2(db, &sql, SQLITE_OPEN_READONLY, NULL);
+    if (ret != SQLITE_OK) {
+        sqlite3_close(sql);
+        return -1;
+    }
+
+    ret = sqlite3_prepare_v2(sql,
+                             "SELECT offset FROM in_tail_files WHERE name=?;",
+                             -1, &stmt, NULL);
+    if (ret == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            offset = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(sql);
+
+    return offset;
+}
+
+static long long file_size(char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) == -1) {
+        return -1;
+    }
+    return st.st_size;
+}
+
+static void db_paths(char *path, char *db, size_t size)
+{
+    snprintf(path, size - 1, "/tmp/flb-rt-in_tail-%i.log", getpid());
+    snprintf(db, size - 1, "/tmp/flb-rt-in_tail-%i.db", getpid());
+    unlink(db);
+}
+
+/* Offsets are written by the timer once 'db.flush_interval' elapses */
+void flb_test_in_tail_db_flush_interval()
+{
+    int i;
+    int ret;
+    char path[256];
+    char db[256];
+    long long size;
+    long long offset = -1;
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb;
+
+    db_paths(path, db, sizeof(path));
+    ret = write_lines(path, "w", 1000);
+    TEST_CHECK(ret == 0);
+    size = file_size(path);
+
+    records = 0;
+    cb.cb = cb_count;
+    cb.data = NULL;
+
+    ctx = tail_create(path, db, "1", &cb);
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+    wait_records(1000);
+
+    /* written while the engine runs, not at exit */
+    for (i = 0; i < 30 && offset != size; i++) {
+        usleep(100000);
+        offset = db_offset(db, path);
+    }
+    TEST_CHECK(offset == size);
+    TEST_MSG("offset=%lli size=%lli", offset, size);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    unlink(path);
+    unlink(db);
+}
+
+/* With a long interval the offsets are kept in memory until exit */
+void flb_test_in_tail_db_flush_exit()
+{
+    int ret;
+    char path[256];
+    char db[256];
+    long long size;
+    long long offset;
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb;
+
+    db_paths(path, db, sizeof(path));
+    ret = write_lines(path, "w", 1000);
+    TEST_CHECK(ret == 0);
+    size = file_size(path);
+
+    records = 0;
+    cb.cb = cb_count;
+    cb.data = NULL;
+
+    ctx = tail_create(path, db, "3600", &cb);
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+    wait_records(1000);
+    sleep(1);
+
+    /* the file entry exists but its offset was not written yet */
+    offset = db_offset(db, path);
+    TEST_CHECK(offset == 0);
+    TEST_MSG("offset=%lli", offset);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+
+    offset = db_offset(db, path);
+    TEST_CHECK(offset == size);
+    TEST_MSG("offset=%lli size=%lli", offset, size);
+
+    unlink(path);
+    unlink(db);
+}
+
+/*
+ * A deleted file drops its entry and its pending offset: nothing is
+ * written for it afterwards, not even at exit.
+ */
+void flb_test_in_tail_db_flush_removal()
+{
+    int i;
+    int ret;
+    char path[256];
+    char db[256];
+    long long offset = 0;
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb;
+
+    db_paths(path, db, sizeof(path));
+    ret = write_lines(path, "w", 1000);
+    TEST_CHECK(ret == 0);
+
+    records = 0;
+    cb.cb = cb_count;
+    cb.data = NULL;
+
+    ctx = tail_create(path, db, "3600", &cb);
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+    wait_records(1000);
+    sleep(1);
+
+    unlink(path);
+    for (i = 0; i < 30 && offset != -1; i++) {
+        usleep(100000);
+        offset = db_offset(db, path);
+    }
+    TEST_CHECK(offset == -1);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+
+    TEST_CHECK(db_offset(db, path) == -1);
+    TEST_CHECK(records == 1000);
+    unlink(db);
+}
+#endif
+
+TEST_LIST = {
+    {"append",        flb_test_in_tail_append},
+    {"static_append", flb_test_in_tail_static_append},
+#ifdef FLB_HAVE_SQLDB
+    {"db_flush_interval", flb_test_in_tail_db_flush_interval},
+    {"db_flush_exit",     flb_test_in_tail_db_flush_exit},
+    {"db_flush_removal",  flb_test_in_tail_db_flush_removal},
+#endif
+    {NULL, NULL}
+};
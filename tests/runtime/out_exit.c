@@ -51,7 +51,7 @@ void flb_test_exit_json_invalid(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_INVALID) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -87,7 +87,7 @@ void flb_test_exit_json_long(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_LONG) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -122,7 +122,7 @@ void flb_test_exit_json_small(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -158,7 +158,7 @@ void flb_test_exit_keep_alive(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -59,7 +59,7 @@ void flb_test_file_json_invalid(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_INVALID) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -104,7 +104,7 @@ void flb_test_file_json_long(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_LONG) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -150,7 +150,7 @@ void flb_test_file_json_small(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -198,7 +198,7 @@ void flb_test_file_format_csv(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -247,7 +247,7 @@ void flb_test_file_format_ltsv(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -296,7 +296,7 @@ void flb_test_file_format_invalid(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
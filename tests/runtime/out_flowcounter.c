@@ -57,7 +57,7 @@ void flb_test_flowcounter_json_invalid(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_INVALID) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -91,7 +91,7 @@ void flb_test_flowcounter_json_long(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_LONG) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -126,7 +126,7 @@ void flb_test_flowcounter_json_small(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -162,7 +162,7 @@ void flb_test_flowcounter_unit_second(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -198,7 +198,7 @@ void flb_test_flowcounter_unit_minute(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -234,7 +234,7 @@ void flb_test_flowcounter_unit_hour(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -270,7 +270,7 @@ void flb_test_flowcounter_unit_day(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -306,7 +306,7 @@ void flb_test_flowcounter_unit_invalid(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
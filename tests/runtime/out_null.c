@@ -47,7 +47,7 @@ void flb_test_null_json_invalid(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_INVALID) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -81,7 +81,7 @@ void flb_test_null_json_long(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_LONG) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 
@@ -116,7 +116,7 @@ void flb_test_null_json_small(void)
     TEST_CHECK(ret == 0);
 
     for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
-        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        bytes = flb_test_lib_push(ctx, in_ffd, p + i, 1);
         TEST_CHECK(bytes == 1);
     }
 